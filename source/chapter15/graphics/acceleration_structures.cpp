@@ -0,0 +1,347 @@
+#include "graphics/acceleration_structures.hpp"
+
+#include "graphics/command_buffer.hpp"
+#include "graphics/gpu_profiler.hpp"
+#include "graphics/render_scene.hpp"
+
+#include "foundation/assert.hpp"
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+#include "foundation/time.hpp"
+
+namespace raptor {
+
+// Acceleration structures offsets inside a buffer must be a multiple of 256 bytes.
+static const u64                    k_acceleration_structure_alignment = 256;
+
+// submit_immediate ends the command buffer, start recording again the same way get_command_buffer does.
+static void restart_immediate_commands( CommandBuffer* gpu_commands ) {
+    gpu_commands->reset();
+    gpu_commands->begin();
+
+    GpuThreadFramePools* thread_pools = gpu_commands->thread_frame_pool;
+    thread_pools->time_queries->reset();
+    vkCmdResetQueryPool( gpu_commands->vk_command_buffer, thread_pools->vulkan_timestamp_query_pool, 0, thread_pools->time_queries->time_queries.size * 2 );
+
+    vkCmdResetQueryPool( gpu_commands->vk_command_buffer, thread_pools->vulkan_pipeline_stats_query_pool, 0, GpuPipelineStatistics::Count );
+
+    vkCmdBeginQuery( gpu_commands->vk_command_buffer, thread_pools->vulkan_pipeline_stats_query_pool, 0, 0 );
+}
+
+static VkAccelerationStructureKHR create_acceleration_structure( GpuDevice& gpu, BufferHandle buffer, u64 offset, u64 size, VkAccelerationStructureTypeKHR type ) {
+    VkAccelerationStructureCreateInfoKHR as_create_info{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR };
+    as_create_info.buffer = gpu.access_buffer( buffer )->vk_buffer;
+    as_create_info.offset = offset;
+    as_create_info.size = size;
+    as_create_info.type = type;
+
+    VkAccelerationStructureKHR acceleration_structure = VK_NULL_HANDLE;
+    VkResult result = gpu.vkCreateAccelerationStructureKHR( gpu.vulkan_device, &as_create_info, gpu.vulkan_allocation_callbacks, &acceleration_structure );
+    RASSERT( result == VK_SUCCESS );
+    return acceleration_structure;
+}
+
+// BlasSizeQueryTask //////////////////////////////////////////////////////
+
+void BlasSizeQueryTask::ExecuteRange( enki::TaskSetPartition range, uint32_t thread_index ) {
+    for ( u32 b = range.start; b < range.end; ++b ) {
+        BlasBuildDesc& blas = blases[ b ];
+
+        VkAccelerationStructureBuildGeometryInfoKHR& as_info = build_infos[ b ];
+        as_info = VkAccelerationStructureBuildGeometryInfoKHR{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR };
+        as_info.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+        as_info.flags = build_flags;
+        as_info.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+        as_info.geometryCount = blas.geometry_count;
+        as_info.pGeometries = &scene->geometries[ blas.first_geometry ];
+
+        VkAccelerationStructureBuildSizesInfoKHR as_size_info{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
+        gpu->vkGetAccelerationStructureBuildSizesKHR( gpu->vulkan_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &as_info, max_primitive_counts + blas.first_geometry, &as_size_info );
+
+        blas.acceleration_structure_size = as_size_info.accelerationStructureSize;
+        blas.build_scratch_size = as_size_info.buildScratchSize;
+    }
+}
+
+// Acceleration structures ////////////////////////////////////////////////
+
+void acceleration_structures_build( GpuDevice& gpu, RenderScene& scene, enki::TaskScheduler* task_scheduler, Allocator* allocator,
+                                    const AccelerationStructureBuildSettings& settings, AccelerationStructureBuildStats* out_stats ) {
+    const i64 start_time = time_now();
+
+    const u32 geometry_count = scene.geometries.size;
+    RASSERT( geometry_count == scene.build_range_infos.size );
+
+    Array<u32> max_primitive_counts;
+    max_primitive_counts.init( allocator, geometry_count, geometry_count );
+
+    for ( u32 range_index = 0; range_index < geometry_count; range_index++ ) {
+        max_primitive_counts[ range_index ] = scene.build_range_infos[ range_index ].primitiveCount;
+    }
+
+    Array<BlasBuildDesc> blases;
+    blases.init( allocator, 16 );
+    blas_partition_geometries( max_primitive_counts.data, geometry_count, settings.max_primitives_per_blas, settings.max_geometries_per_blas, blases );
+
+    const u32 blas_count = blases.size;
+
+    VkBuildAccelerationStructureFlagsKHR build_flags = settings.build_mode == BvhBuildMode::FastBuild ? VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR :
+                                                                                                         VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+    if ( settings.compact ) {
+        build_flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+    }
+
+    // Build infos and sizes are independent for every blas, query them on all threads.
+    Array<VkAccelerationStructureBuildGeometryInfoKHR> build_infos;
+    build_infos.init( allocator, blas_count, blas_count );
+
+    BlasSizeQueryTask size_query_task;
+    size_query_task.gpu = &gpu;
+    size_query_task.scene = &scene;
+    size_query_task.blases = blases.data;
+    size_query_task.build_infos = build_infos.data;
+    size_query_task.max_primitive_counts = max_primitive_counts.data;
+    size_query_task.build_flags = build_flags;
+    size_query_task.m_SetSize = blas_count;
+    size_query_task.m_MinRange = 8;
+
+    if ( task_scheduler && blas_count > size_query_task.m_MinRange ) {
+        task_scheduler->AddTaskSetToPipe( &size_query_task );
+        task_scheduler->WaitforTask( &size_query_task );
+    } else {
+        size_query_task.ExecuteRange( { 0, blas_count }, 0 );
+    }
+
+    const u64 scratch_alignment = max( ( u64 )gpu.acceleration_structure_properties.minAccelerationStructureScratchOffsetAlignment, ( u64 )1 );
+
+    Array<BlasBuildBatch> batches;
+    batches.init( allocator, 4 );
+    const u64 scratch_size = blas_plan_batches( blases.data, blas_count, settings.scratch_budget, scratch_alignment, batches );
+    const u64 build_size = blas_plan_storage( blases.data, blas_count, k_acceleration_structure_alignment );
+
+    BufferCreation as_buffer_creation{ };
+    as_buffer_creation.set( VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR, ResourceUsageType::Immutable, ( u32 )build_size ).set_device_only( true ).set_name( settings.compact ? "blas_build_buffer" : "blas_buffer" );
+    BufferHandle blas_build_buffer_handle = gpu.create_buffer( as_buffer_creation );
+
+    as_buffer_creation.reset().set( VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR, ResourceUsageType::Immutable, ( u32 )scratch_size ).set_device_only( true ).set_name( "blas_scratch_buffer" );
+    BufferHandle blas_scratch_buffer_handle = gpu.create_buffer( as_buffer_creation );
+
+    const VkDeviceAddress scratch_address = gpu.get_buffer_device_address( blas_scratch_buffer_handle );
+
+    Array<VkAccelerationStructureKHR> built_blases;
+    built_blases.init( allocator, blas_count, blas_count );
+
+    Array<VkAccelerationStructureBuildRangeInfoKHR*> blas_ranges;
+    blas_ranges.init( allocator, blas_count, blas_count );
+
+    for ( u32 b = 0; b < blas_count; ++b ) {
+        const BlasBuildDesc& blas = blases[ b ];
+
+        built_blases[ b ] = create_acceleration_structure( gpu, blas_build_buffer_handle, blas.acceleration_structure_offset, blas.acceleration_structure_size,
+                                                           VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR );
+
+        build_infos[ b ].dstAccelerationStructure = built_blases[ b ];
+        build_infos[ b ].scratchData.deviceAddress = scratch_address + blas.scratch_offset;
+
+        blas_ranges[ b ] = &scene.build_range_infos[ blas.first_geometry ];
+    }
+
+    VkQueryPool compacted_size_query_pool = VK_NULL_HANDLE;
+    if ( settings.compact ) {
+        VkQueryPoolCreateInfo query_pool_info{ VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+        query_pool_info.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+        query_pool_info.queryCount = blas_count;
+
+        vkCreateQueryPool( gpu.vulkan_device, &query_pool_info, gpu.vulkan_allocation_callbacks, &compacted_size_query_pool );
+    }
+
+    // Batches reuse the same scratch memory, each one is waited for before recording the next.
+    CommandBuffer* gpu_commands = gpu.get_command_buffer( 0, 0, true );
+
+    for ( u32 batch_index = 0; batch_index < batches.size; ++batch_index ) {
+        const BlasBuildBatch& batch = batches[ batch_index ];
+
+        if ( batch_index > 0 ) {
+            restart_immediate_commands( gpu_commands );
+        }
+
+        gpu.vkCmdBuildAccelerationStructuresKHR( gpu_commands->vk_command_buffer, batch.blas_count, &build_infos[ batch.first_blas ], &blas_ranges[ batch.first_blas ] );
+
+        if ( settings.compact ) {
+            VkMemoryBarrier barrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+            barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+            barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+
+            vkCmdPipelineBarrier( gpu_commands->vk_command_buffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr );
+
+            vkCmdResetQueryPool( gpu_commands->vk_command_buffer, compacted_size_query_pool, batch.first_blas, batch.blas_count );
+
+            gpu.vkCmdWriteAccelerationStructuresPropertiesKHR( gpu_commands->vk_command_buffer, batch.blas_count, &built_blases[ batch.first_blas ],
+                                                               VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, compacted_size_query_pool, batch.first_blas );
+        }
+
+        gpu.submit_immediate( gpu_commands );
+    }
+
+    scene.blases.init( allocator, blas_count, blas_count );
+
+    u64 compacted_size = build_size;
+    if ( settings.compact ) {
+        Array<u64> compacted_sizes;
+        compacted_sizes.init( allocator, blas_count, blas_count );
+
+        VkResult result = vkGetQueryPoolResults( gpu.vulkan_device, compacted_size_query_pool, 0, blas_count, compacted_sizes.size_in_bytes(), compacted_sizes.data,
+                                                 sizeof( u64 ), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT );
+        RASSERT( result == VK_SUCCESS );
+
+        for ( u32 b = 0; b < blas_count; ++b ) {
+            blases[ b ].compacted_size = compacted_sizes[ b ];
+        }
+        compacted_sizes.shutdown();
+
+        compacted_size = blas_plan_compaction( blases.data, blas_count, k_acceleration_structure_alignment );
+
+        as_buffer_creation.reset().set( VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR, ResourceUsageType::Immutable, ( u32 )compacted_size ).set_device_only( true ).set_name( "blas_buffer" );
+        scene.blas_buffer = gpu.create_buffer( as_buffer_creation );
+
+        restart_immediate_commands( gpu_commands );
+
+        for ( u32 b = 0; b < blas_count; ++b ) {
+            const BlasBuildDesc& blas = blases[ b ];
+
+            scene.blases[ b ] = create_acceleration_structure( gpu, scene.blas_buffer, blas.compacted_offset, blas.compacted_size, VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR );
+
+            VkCopyAccelerationStructureInfoKHR copy_info{ VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR };
+            copy_info.src = built_blases[ b ];
+            copy_info.dst = scene.blases[ b ];
+            copy_info.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+
+            gpu.vkCmdCopyAccelerationStructureKHR( gpu_commands->vk_command_buffer, &copy_info );
+        }
+
+        gpu.submit_immediate( gpu_commands );
+
+        for ( u32 b = 0; b < blas_count; ++b ) {
+            gpu.vkDestroyAccelerationStructureKHR( gpu.vulkan_device, built_blases[ b ], gpu.vulkan_allocation_callbacks );
+        }
+        gpu.destroy_buffer( blas_build_buffer_handle );
+
+        vkDestroyQueryPool( gpu.vulkan_device, compacted_size_query_pool, gpu.vulkan_allocation_callbacks );
+    } else {
+        for ( u32 b = 0; b < blas_count; ++b ) {
+            scene.blases[ b ] = built_blases[ b ];
+        }
+        scene.blas_buffer = blas_build_buffer_handle;
+    }
+
+    // NOTE(marco): build TLAS
+    Array<VkAccelerationStructureInstanceKHR> instances;
+    instances.init( allocator, blas_count, blas_count );
+
+    for ( u32 b = 0; b < blas_count; ++b ) {
+        VkAccelerationStructureDeviceAddressInfoKHR blas_address_info{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR };
+        blas_address_info.accelerationStructure = scene.blases[ b ];
+
+        // Shaders index mesh instances with gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT, the custom index has 24 bits.
+        RASSERT( blases[ b ].first_geometry < ( 1u << 24 ) );
+
+        VkAccelerationStructureInstanceKHR& tlas_structure = instances[ b ];
+        tlas_structure = VkAccelerationStructureInstanceKHR{ };
+        // NOTE(marco): identity matrix
+        tlas_structure.transform.matrix[ 0 ][ 0 ] = 1.0f;
+        tlas_structure.transform.matrix[ 1 ][ 1 ] = 1.0f;
+        tlas_structure.transform.matrix[ 2 ][ 2 ] = -1.0f;
+        tlas_structure.instanceCustomIndex = blases[ b ].first_geometry;
+        tlas_structure.mask = 0xff;
+        tlas_structure.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+        tlas_structure.accelerationStructureReference = gpu.vkGetAccelerationStructureDeviceAddressKHR( gpu.vulkan_device, &blas_address_info );
+    }
+
+    as_buffer_creation.reset().set( VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, ResourceUsageType::Immutable, instances.size_in_bytes() ).set_data( instances.data ).set_name( "tlas_instance_buffer" );
+    BufferHandle tlas_instance_buffer_handle = gpu.create_buffer( as_buffer_creation );
+
+    VkAccelerationStructureGeometryKHR tlas_geometry{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR };
+    tlas_geometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+    tlas_geometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+    tlas_geometry.geometry.instances.arrayOfPointers = false;
+    tlas_geometry.geometry.instances.data.deviceAddress = gpu.get_buffer_device_address( tlas_instance_buffer_handle );
+
+    VkAccelerationStructureBuildGeometryInfoKHR as_info{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR };
+    as_info.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+    as_info.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+    as_info.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+    as_info.geometryCount = 1;
+    as_info.pGeometries = &tlas_geometry;
+
+    VkAccelerationStructureBuildSizesInfoKHR as_size_info{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
+    gpu.vkGetAccelerationStructureBuildSizesKHR( gpu.vulkan_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &as_info, &blas_count, &as_size_info );
+
+    as_buffer_creation.reset().set( VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR, ResourceUsageType::Immutable, ( u32 )as_size_info.accelerationStructureSize ).set_device_only( true ).set_name( "tlas_buffer" );
+    scene.tlas_buffer = gpu.create_buffer( as_buffer_creation );
+
+    as_buffer_creation.reset().set( VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR, ResourceUsageType::Immutable, ( u32 )as_size_info.buildScratchSize ).set_device_only( true ).set_name( "tlas_scratch_buffer" );
+    BufferHandle tlas_scratch_buffer_handle = gpu.create_buffer( as_buffer_creation );
+
+    scene.tlas = create_acceleration_structure( gpu, scene.tlas_buffer, 0, as_size_info.accelerationStructureSize, VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR );
+
+    as_info.dstAccelerationStructure = scene.tlas;
+    as_info.scratchData.deviceAddress = gpu.get_buffer_device_address( tlas_scratch_buffer_handle );
+
+    VkAccelerationStructureBuildRangeInfoKHR tlas_range_info{ };
+    tlas_range_info.primitiveCount = blas_count;
+
+    VkAccelerationStructureBuildRangeInfoKHR* tlas_ranges[] = {
+        &tlas_range_info
+    };
+
+    restart_immediate_commands( gpu_commands );
+
+    gpu.vkCmdBuildAccelerationStructuresKHR( gpu_commands->vk_command_buffer, 1, &as_info, tlas_ranges );
+
+    gpu.submit_immediate( gpu_commands );
+
+    gpu.destroy_buffer( blas_scratch_buffer_handle );
+    gpu.destroy_buffer( tlas_scratch_buffer_handle );
+    gpu.destroy_buffer( tlas_instance_buffer_handle );
+
+    AccelerationStructureBuildStats stats;
+    stats.blas_count = blas_count;
+    stats.batch_count = batches.size;
+    stats.build_bytes = build_size;
+    stats.compacted_bytes = compacted_size;
+    stats.scratch_bytes = scratch_size;
+    stats.build_ms = time_from_milliseconds( start_time );
+
+    rprint( "Built %u blas in %u batches (%s), %.2f MB compacted to %.2f MB, %.2f MB scratch, %.2f ms\n", stats.blas_count, stats.batch_count,
+            BvhBuildMode::ToString( settings.build_mode ), stats.build_bytes / ( 1024.0 * 1024.0 ), stats.compacted_bytes / ( 1024.0 * 1024.0 ),
+            stats.scratch_bytes / ( 1024.0 * 1024.0 ), stats.build_ms );
+
+    if ( out_stats ) {
+        *out_stats = stats;
+    }
+
+    instances.shutdown();
+    blas_ranges.shutdown();
+    built_blases.shutdown();
+    batches.shutdown();
+    build_infos.shutdown();
+    blases.shutdown();
+    max_primitive_counts.shutdown();
+
+    scene.geometries.shutdown();
+    scene.build_range_infos.shutdown();
+}
+
+void acceleration_structures_destroy( GpuDevice& gpu, RenderScene& scene ) {
+    for ( u32 b = 0; b < scene.blases.size; ++b ) {
+        gpu.vkDestroyAccelerationStructureKHR( gpu.vulkan_device, scene.blases[ b ], gpu.vulkan_allocation_callbacks );
+    }
+    scene.blases.shutdown();
+    gpu.destroy_buffer( scene.blas_buffer );
+
+    gpu.vkDestroyAccelerationStructureKHR( gpu.vulkan_device, scene.tlas, gpu.vulkan_allocation_callbacks );
+    gpu.destroy_buffer( scene.tlas_buffer );
+}
+
+} // namespace raptor
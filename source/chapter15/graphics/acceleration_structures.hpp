@@ -0,0 +1,65 @@
+#pragma once
+
+#include "graphics/bvh.hpp"
+#include "graphics/gpu_device.hpp"
+
+#include "foundation/memory.hpp"
+
+#include "external/enkiTS/TaskScheduler.h"
+
+namespace raptor {
+
+struct RenderScene;
+
+//
+// Scene geometries are grouped in bottom level acceleration structures, built in batches that share
+// a scratch buffer of bounded size, then compacted into a single buffer. Each blas becomes one
+// instance of the top level acceleration structure with the index of its first geometry as custom index.
+struct AccelerationStructureBuildSettings {
+
+    u64                             scratch_budget          = rmega( 128 );
+    u32                             max_primitives_per_blas = 1024 * 1024;
+    u32                             max_geometries_per_blas = 256;
+
+    BvhBuildMode::Enum              build_mode              = BvhBuildMode::FastTrace;
+    bool                            compact                 = true;
+
+}; // struct AccelerationStructureBuildSettings
+
+//
+//
+struct AccelerationStructureBuildStats {
+
+    u32                             blas_count              = 0;
+    u32                             batch_count             = 0;
+
+    u64                             build_bytes             = 0;
+    u64                             compacted_bytes         = 0;
+    u64                             scratch_bytes           = 0;
+
+    f64                             build_ms                = 0.0;
+
+}; // struct AccelerationStructureBuildStats
+
+//
+// Fills the build geometry info and queries the build sizes of a range of blases.
+struct BlasSizeQueryTask : public enki::ITaskSet {
+
+    void                            ExecuteRange( enki::TaskSetPartition range, uint32_t thread_index ) override;
+
+    GpuDevice*                      gpu                     = nullptr;
+    RenderScene*                    scene                   = nullptr;
+    BlasBuildDesc*                  blases                  = nullptr;
+    VkAccelerationStructureBuildGeometryInfoKHR* build_infos = nullptr;
+    const u32*                      max_primitive_counts    = nullptr;
+    VkBuildAccelerationStructureFlagsKHR build_flags        = 0;
+
+}; // struct BlasSizeQueryTask
+
+// Builds blases and tlas from scene geometries and build ranges, that are released afterwards.
+void                                acceleration_structures_build( GpuDevice& gpu, RenderScene& scene, enki::TaskScheduler* task_scheduler, Allocator* allocator,
+                                                                   const AccelerationStructureBuildSettings& settings, AccelerationStructureBuildStats* out_stats );
+
+void                                acceleration_structures_destroy( GpuDevice& gpu, RenderScene& scene );
+
+} // namespace raptor
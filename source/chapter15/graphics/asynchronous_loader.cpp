@@ -1,6 +1,7 @@
 #include "graphics/asynchronous_loader.hpp"
 #include "graphics/renderer.hpp"
 
+#include "foundation/memory.hpp"
 #include "foundation/time.hpp"
 
 #include "external/stb_image.h"
@@ -9,6 +10,22 @@
 
 namespace raptor
 {
+static const u32        k_max_file_reads        = 8;
+
+static void add_texture_upload( Array<UploadRequest>& upload_requests, const FileLoadRequest& load_request, u8* texture_data ) {
+    if ( texture_data ) {
+        rprint( "File %s read in %f ms\n", load_request.path, time_from_milliseconds( load_request.start_time ) );
+
+        UploadRequest& upload_request = upload_requests.push_use();
+        upload_request.data = texture_data;
+        upload_request.texture = load_request.texture;
+        upload_request.cpu_buffer = k_invalid_buffer;
+    }
+    else {
+        rprint( "Error reading file %s\n", load_request.path );
+    }
+}
+
 // AsynchonousLoader //////////////////////////////////////////////////////
 
 void AsynchronousLoader::init( Renderer* renderer_, enki::TaskScheduler* task_scheduler_, Allocator* resident_allocator ) {
@@ -17,8 +34,12 @@ void AsynchronousLoader::init( Renderer* renderer_, enki::TaskScheduler* task_sc
     allocator = resident_allocator;
 
     file_load_requests.init( allocator, 16 );
+    file_reads.init( allocator, k_max_file_reads );
     upload_requests.init( allocator, 16 );
 
+    // Reads are allocated and freed on the IO thread while other threads use the resident allocator.
+    file_reader.init( task_scheduler, &MemoryService::instance()->thread_allocator, k_max_file_reads );
+
     texture_ready.index = k_invalid_texture.index;
     cpu_buffer_ready.index = k_invalid_buffer.index;
     gpu_buffer_ready.index = k_invalid_buffer.index;
@@ -64,7 +85,15 @@ void AsynchronousLoader::shutdown() {
 
     renderer->gpu->destroy_buffer( staging_buffer->handle );
 
+    for ( u32 i = 0; i < file_reads.size; ++i ) {
+        FileReadTask* read_task = file_reads[ i ].read_task;
+        file_reader.release( read_task );
+        rfree( read_task->request.data, file_reader.allocator );
+    }
+    file_reader.shutdown();
+
     file_load_requests.shutdown();
+    file_reads.shutdown();
     upload_requests.shutdown();
 
     for ( u32 i = 0; i < k_max_frames; ++i ) {
@@ -177,27 +206,48 @@ void AsynchronousLoader::update( Allocator* scratch_allocator ) {
         }
     }
 
-    // Process a file request
-    if ( file_load_requests.size ) {
-        FileLoadRequest load_request = file_load_requests.back();
-        file_load_requests.pop();
+    // Decode the files read so far, reads run on the task threads
+    for ( u32 i = 0; i < file_reads.size; ) {
+        FileLoadRequest load_request = file_reads[ i ];
+        FileReadTask* read_task = load_request.read_task;
+        if ( !read_task->GetIsComplete() ) {
+            ++i;
+            continue;
+        }
+
+        file_reads.delete_swap( i );
 
-        i64 start_reading_file = time_now();
-        // Process request
         int x, y, comp;
-        u8* texture_data = stbi_load( load_request.path, &x, &y, &comp, 4 );
+        u8* texture_data = nullptr;
+        if ( read_task->request.success ) {
+            texture_data = stbi_load_from_memory( read_task->request.data, ( int )read_task->request.bytes_read, &x, &y, &comp, 4 );
+        }
 
-        if ( texture_data ) {
-            rprint( "File %s read in %f ms\n", load_request.path, time_from_milliseconds( start_reading_file ) );
+        rfree( read_task->request.data, file_reader.allocator );
+        file_reader.release( read_task );
 
-            UploadRequest& upload_request = upload_requests.push_use();
-            upload_request.data = texture_data;
-            upload_request.texture = load_request.texture;
-            upload_request.cpu_buffer = k_invalid_buffer;
-        }
-        else {
-            rprint( "Error reading file %s\n", load_request.path );
+        add_texture_upload( upload_requests, load_request, texture_data );
+    }
+
+    // Start reading new file requests
+    while ( file_load_requests.size && file_reader.has_free_task() ) {
+        FileLoadRequest load_request = file_load_requests.back();
+        file_load_requests.pop();
+
+        FileReadRequest read_request;
+        strcpy( read_request.path, load_request.path );
+
+        load_request.start_time = time_now();
+        load_request.read_task = file_reader.read( read_request );
+        if ( load_request.read_task ) {
+            file_reads.push( load_request );
+            continue;
         }
+
+        // Read and decode here when the file could not be read asynchronously.
+        int x, y, comp;
+        u8* texture_data = stbi_load( load_request.path, &x, &y, &comp, 4 );
+        add_texture_upload( upload_requests, load_request, texture_data );
     }
 
     staging_buffer_offset = 0;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "foundation/array.hpp"
+#include "foundation/file_async.hpp"
 #include "foundation/platform.hpp"
 
 #include "graphics/command_buffer.hpp"
@@ -29,6 +30,9 @@ namespace raptor
         char                                    path[ 512 ];
         TextureHandle                           texture     = k_invalid_texture;
         BufferHandle                            buffer      = k_invalid_buffer;
+
+        FileReadTask*                           read_task   = nullptr;
+        i64                                     start_time  = 0;
     }; // struct FileLoadRequest
 
     //
@@ -58,8 +62,11 @@ namespace raptor
         enki::TaskScheduler*                    task_scheduler  = nullptr;
 
         Array<FileLoadRequest>                  file_load_requests;
+        Array<FileLoadRequest>                  file_reads;         // Requests whose file is being read by the task threads.
         Array<UploadRequest>                    upload_requests;
 
+        AsynchronousFileReader                  file_reader;
+
         Buffer*                                 staging_buffer  = nullptr;
 
         std::atomic_size_t                      staging_buffer_offset;
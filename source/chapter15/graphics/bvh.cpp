@@ -0,0 +1,551 @@
+#include "graphics/bvh.hpp"
+
+#include "foundation/assert.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+#include "foundation/time.hpp"
+
+#include <float.h>
+#include <string.h>
+
+namespace raptor {
+
+static const u32                    k_bvh_max_bins      = 64;
+static const u32                    k_bvh_max_depth     = 64;
+
+//
+//
+struct BvhAabb {
+
+    f32                             min[ 3 ];
+    f32                             max[ 3 ];
+
+    void                            reset();
+    void                            add_point( const f32* point );
+    void                            add( const BvhAabb& other );
+
+    f32                             surface_area() const;
+    bool                            contains( const BvhAabb& other ) const;
+
+}; // struct BvhAabb
+
+void BvhAabb::reset() {
+    min[ 0 ] = min[ 1 ] = min[ 2 ] = FLT_MAX;
+    max[ 0 ] = max[ 1 ] = max[ 2 ] = -FLT_MAX;
+}
+
+void BvhAabb::add_point( const f32* point ) {
+    for ( u32 a = 0; a < 3; ++a ) {
+        min[ a ] = raptor::min( min[ a ], point[ a ] );
+        max[ a ] = raptor::max( max[ a ], point[ a ] );
+    }
+}
+
+void BvhAabb::add( const BvhAabb& other ) {
+    for ( u32 a = 0; a < 3; ++a ) {
+        min[ a ] = raptor::min( min[ a ], other.min[ a ] );
+        max[ a ] = raptor::max( max[ a ], other.max[ a ] );
+    }
+}
+
+f32 BvhAabb::surface_area() const {
+    if ( min[ 0 ] > max[ 0 ] ) {
+        return 0.0f;
+    }
+
+    const f32 dx = max[ 0 ] - min[ 0 ];
+    const f32 dy = max[ 1 ] - min[ 1 ];
+    const f32 dz = max[ 2 ] - min[ 2 ];
+    return 2.0f * ( dx * dy + dy * dz + dz * dx );
+}
+
+bool BvhAabb::contains( const BvhAabb& other ) const {
+    for ( u32 a = 0; a < 3; ++a ) {
+        const f32 epsilon = ( max[ a ] - min[ a ] ) * 1e-5f + 1e-6f;
+        if ( other.min[ a ] < min[ a ] - epsilon || other.max[ a ] > max[ a ] + epsilon ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// Per triangle data only needed during the build.
+struct BvhBuildPrimitive {
+
+    BvhAabb                         bounds;
+    f32                             centroid[ 3 ];
+
+}; // struct BvhBuildPrimitive
+
+//
+//
+struct BvhBin {
+
+    BvhAabb                         bounds;
+    u32                             count;
+
+}; // struct BvhBin
+
+//
+//
+struct BvhBuildItem {
+
+    u32                             node_index;
+    u32                             depth;
+
+}; // struct BvhBuildItem
+
+static void bvh_node_set_bounds( BvhNode& node, const BvhAabb& bounds ) {
+    for ( u32 a = 0; a < 3; ++a ) {
+        node.aabb_min[ a ] = bounds.min[ a ];
+        node.aabb_max[ a ] = bounds.max[ a ];
+    }
+}
+
+static BvhAabb bvh_node_get_bounds( const BvhNode& node ) {
+    BvhAabb bounds;
+    for ( u32 a = 0; a < 3; ++a ) {
+        bounds.min[ a ] = node.aabb_min[ a ];
+        bounds.max[ a ] = node.aabb_max[ a ];
+    }
+    return bounds;
+}
+
+static u32 bvh_bin_index( f32 centroid, f32 centroid_min, f32 bin_scale, u32 bin_count ) {
+    const i32 bin = ( i32 )( ( centroid - centroid_min ) * bin_scale );
+    return ( u32 )raptor::max( 0, raptor::min( bin, ( i32 )bin_count - 1 ) );
+}
+
+// Moves the triangles for which the predicate is true at the beginning of the range, returns how many there are.
+template <typename Predicate>
+static u32 bvh_partition( u32* indices, u32 count, Predicate predicate ) {
+    u32 left = 0;
+    u32 right = count;
+    while ( left < right ) {
+        if ( predicate( indices[ left ] ) ) {
+            ++left;
+        } else {
+            --right;
+            const u32 temp = indices[ left ];
+            indices[ left ] = indices[ right ];
+            indices[ right ] = temp;
+        }
+    }
+    return left;
+}
+
+// CpuBvh /////////////////////////////////////////////////////////////////
+
+void CpuBvh::init( Allocator* allocator_, u32 triangle_capacity ) {
+    allocator = allocator_;
+
+    triangles.init( allocator, triangle_capacity );
+    triangle_indices.init( allocator, triangle_capacity );
+    nodes.init( allocator, raptor::max( triangle_capacity * 2, 1u ) );
+}
+
+void CpuBvh::shutdown() {
+    triangles.shutdown();
+    triangle_indices.shutdown();
+    nodes.shutdown();
+}
+
+void CpuBvh::add_triangles( const u8* positions, u32 position_stride, const u8* indices, u32 index_size, u32 triangle_count, const f32* transform ) {
+    RASSERT( index_size == 2 || index_size == 4 );
+
+    for ( u32 t = 0; t < triangle_count; ++t ) {
+        BvhTriangle& triangle = triangles.push_use();
+        f32* vertices[ 3 ] = { triangle.v0, triangle.v1, triangle.v2 };
+
+        for ( u32 v = 0; v < 3; ++v ) {
+            const u32 i = t * 3 + v;
+            const u32 index = index_size == 2 ? ( ( const u16* )indices )[ i ] : ( ( const u32* )indices )[ i ];
+            const f32* position = ( const f32* )( positions + ( sizet )index * position_stride );
+
+            f32* out = vertices[ v ];
+            if ( transform ) {
+                for ( u32 row = 0; row < 3; ++row ) {
+                    const f32* m = transform + row * 4;
+                    out[ row ] = m[ 0 ] * position[ 0 ] + m[ 1 ] * position[ 1 ] + m[ 2 ] * position[ 2 ] + m[ 3 ];
+                }
+            } else {
+                out[ 0 ] = position[ 0 ];
+                out[ 1 ] = position[ 1 ];
+                out[ 2 ] = position[ 2 ];
+            }
+        }
+    }
+}
+
+void CpuBvh::build( const CpuBvhBuildOptions& options_ ) {
+    options = options_;
+    options.bin_count = raptor::max( 2u, raptor::min( options.bin_count, k_bvh_max_bins ) );
+    options.max_leaf_triangles = raptor::max( options.max_leaf_triangles, 1u );
+
+    const i64 start_time = time_now();
+
+    const u32 triangle_count = triangles.size;
+    stats = CpuBvhStats();
+    stats.triangle_count = triangle_count;
+
+    nodes.clear();
+    triangle_indices.set_size( triangle_count );
+
+    if ( triangle_count == 0 ) {
+        return;
+    }
+
+    Array<BvhBuildPrimitive> primitives;
+    primitives.init( allocator, triangle_count, triangle_count );
+
+    for ( u32 t = 0; t < triangle_count; ++t ) {
+        const BvhTriangle& triangle = triangles[ t ];
+        BvhBuildPrimitive& primitive = primitives[ t ];
+
+        primitive.bounds.reset();
+        primitive.bounds.add_point( triangle.v0 );
+        primitive.bounds.add_point( triangle.v1 );
+        primitive.bounds.add_point( triangle.v2 );
+
+        for ( u32 a = 0; a < 3; ++a ) {
+            primitive.centroid[ a ] = ( primitive.bounds.min[ a ] + primitive.bounds.max[ a ] ) * 0.5f;
+        }
+
+        triangle_indices[ t ] = t;
+    }
+
+    BvhNode& root = nodes.push_use();
+    root.left_or_first = 0;
+    root.triangle_count = triangle_count;
+
+    // Every split adds a node, the stack never holds more than depth + 1 items.
+    BvhBuildItem stack[ k_bvh_max_depth + 1 ];
+    u32 stack_size = 0;
+    stack[ stack_size++ ] = { 0, 0 };
+
+    BvhBin bins[ k_bvh_max_bins ];
+    f32 right_areas[ k_bvh_max_bins ];
+    u32 right_counts[ k_bvh_max_bins ];
+
+    while ( stack_size > 0 ) {
+        const BvhBuildItem item = stack[ --stack_size ];
+
+        const u32 first = nodes[ item.node_index ].left_or_first;
+        const u32 count = nodes[ item.node_index ].triangle_count;
+        u32* indices = triangle_indices.data + first;
+
+        BvhAabb bounds, centroid_bounds;
+        bounds.reset();
+        centroid_bounds.reset();
+        for ( u32 i = 0; i < count; ++i ) {
+            const BvhBuildPrimitive& primitive = primitives[ indices[ i ] ];
+            bounds.add( primitive.bounds );
+            centroid_bounds.add_point( primitive.centroid );
+        }
+        bvh_node_set_bounds( nodes[ item.node_index ], bounds );
+
+        stats.max_depth = raptor::max( stats.max_depth, item.depth );
+
+        if ( count <= 1 ) {
+            continue;
+        }
+
+        u32 split_axis = 0;
+        for ( u32 a = 1; a < 3; ++a ) {
+            if ( centroid_bounds.max[ a ] - centroid_bounds.min[ a ] > centroid_bounds.max[ split_axis ] - centroid_bounds.min[ split_axis ] ) {
+                split_axis = a;
+            }
+        }
+        const f32 split_extent = centroid_bounds.max[ split_axis ] - centroid_bounds.min[ split_axis ];
+
+        u32 left_count = 0;
+
+        if ( options.mode == BvhBuildMode::FastTrace ) {
+            const f32 parent_area = bounds.surface_area();
+            const f32 leaf_cost = count * options.intersection_cost;
+
+            f32 best_cost = FLT_MAX;
+            u32 best_axis = 0;
+            u32 best_bin = 0;
+
+            for ( u32 axis = 0; axis < 3; ++axis ) {
+                const f32 extent = centroid_bounds.max[ axis ] - centroid_bounds.min[ axis ];
+                if ( extent <= 0.0f ) {
+                    continue;
+                }
+
+                const f32 bin_scale = options.bin_count / extent;
+                for ( u32 b = 0; b < options.bin_count; ++b ) {
+                    bins[ b ].bounds.reset();
+                    bins[ b ].count = 0;
+                }
+
+                for ( u32 i = 0; i < count; ++i ) {
+                    const BvhBuildPrimitive& primitive = primitives[ indices[ i ] ];
+                    BvhBin& bin = bins[ bvh_bin_index( primitive.centroid[ axis ], centroid_bounds.min[ axis ], bin_scale, options.bin_count ) ];
+                    bin.bounds.add( primitive.bounds );
+                    ++bin.count;
+                }
+
+                // Sweep from the right to get the area of every right side, then from the left to evaluate the splits.
+                BvhAabb accumulated;
+                accumulated.reset();
+                u32 accumulated_count = 0;
+                for ( u32 b = options.bin_count - 1; b > 0; --b ) {
+                    accumulated.add( bins[ b ].bounds );
+                    accumulated_count += bins[ b ].count;
+                    right_areas[ b ] = accumulated.surface_area();
+                    right_counts[ b ] = accumulated_count;
+                }
+
+                accumulated.reset();
+                accumulated_count = 0;
+                for ( u32 b = 0; b < options.bin_count - 1; ++b ) {
+                    accumulated.add( bins[ b ].bounds );
+                    accumulated_count += bins[ b ].count;
+
+                    if ( accumulated_count == 0 || right_counts[ b + 1 ] == 0 ) {
+                        continue;
+                    }
+
+                    const f32 cost = options.traversal_cost + options.intersection_cost *
+                                     ( accumulated.surface_area() * accumulated_count + right_areas[ b + 1 ] * right_counts[ b + 1 ] ) / parent_area;
+                    if ( cost < best_cost ) {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_bin = b + 1;
+                    }
+                }
+            }
+
+            if ( count <= options.max_leaf_triangles && best_cost >= leaf_cost ) {
+                continue;
+            }
+
+            if ( best_cost < FLT_MAX ) {
+                const f32 axis_min = centroid_bounds.min[ best_axis ];
+                const f32 bin_scale = options.bin_count / ( centroid_bounds.max[ best_axis ] - axis_min );
+                const u32 bin_count = options.bin_count;
+
+                left_count = bvh_partition( indices, count, [&]( u32 index ) {
+                    return bvh_bin_index( primitives[ index ].centroid[ best_axis ], axis_min, bin_scale, bin_count ) < best_bin;
+                } );
+            }
+        } else {
+            if ( count <= options.max_leaf_triangles ) {
+                continue;
+            }
+
+            if ( split_extent > 0.0f ) {
+                const f32 split_position = ( centroid_bounds.min[ split_axis ] + centroid_bounds.max[ split_axis ] ) * 0.5f;
+
+                left_count = bvh_partition( indices, count, [&]( u32 index ) {
+                    return primitives[ index ].centroid[ split_axis ] < split_position;
+                } );
+            }
+        }
+
+        // Coincident centroids or a degenerate split: halve the range, the order does not matter.
+        if ( left_count == 0 || left_count == count ) {
+            left_count = count / 2;
+        }
+
+        // Too deep: keep the rest as a leaf, stats report the oversized leaf.
+        if ( item.depth >= k_bvh_max_depth ) {
+            continue;
+        }
+
+        const u32 left_index = nodes.size;
+        BvhNode& left = nodes.push_use();
+        left.left_or_first = first;
+        left.triangle_count = left_count;
+
+        BvhNode& right = nodes.push_use();
+        right.left_or_first = first + left_count;
+        right.triangle_count = count - left_count;
+
+        BvhNode& node = nodes[ item.node_index ];
+        node.left_or_first = left_index;
+        node.triangle_count = 0;
+
+        stack[ stack_size++ ] = { left_index + 1, item.depth + 1 };
+        stack[ stack_size++ ] = { left_index, item.depth + 1 };
+    }
+
+    primitives.shutdown();
+
+    stats.build_ms = time_from_milliseconds( start_time );
+
+    // Surface area heuristic of the final tree.
+    const f32 root_area = bvh_node_get_bounds( nodes[ 0 ] ).surface_area();
+    const f32 inverse_root_area = root_area > 0.0f ? 1.0f / root_area : 0.0f;
+
+    f64 sah_cost = 0.0;
+    for ( u32 n = 0; n < nodes.size; ++n ) {
+        const BvhNode& node = nodes[ n ];
+        const f32 area_ratio = root_area > 0.0f ? bvh_node_get_bounds( node ).surface_area() * inverse_root_area : 1.0f;
+
+        if ( node.is_leaf() ) {
+            ++stats.leaf_count;
+            stats.max_leaf_triangles = raptor::max( stats.max_leaf_triangles, node.triangle_count );
+            sah_cost += area_ratio * node.triangle_count * options.intersection_cost;
+        } else {
+            sah_cost += area_ratio * options.traversal_cost;
+        }
+    }
+
+    stats.node_count = nodes.size;
+    stats.sah_cost = ( f32 )sah_cost;
+    stats.average_leaf_triangles = stats.leaf_count ? ( f32 )triangle_count / stats.leaf_count : 0.0f;
+    stats.node_bytes = ( sizet )nodes.size * sizeof( BvhNode );
+    stats.index_bytes = ( sizet )triangle_count * sizeof( u32 );
+    stats.triangle_bytes = ( sizet )triangle_count * sizeof( BvhTriangle );
+}
+
+bool CpuBvh::validate() const {
+    if ( triangles.size == 0 ) {
+        return nodes.size == 0;
+    }
+
+    if ( nodes.size == 0 || triangle_indices.size != triangles.size ) {
+        return false;
+    }
+
+    Array<u8> referenced;
+    referenced.init( allocator, triangles.size, triangles.size );
+    memset( referenced.data, 0, triangles.size );
+
+    bool valid = true;
+    for ( u32 n = 0; n < nodes.size && valid; ++n ) {
+        const BvhNode& node = nodes[ n ];
+        const BvhAabb bounds = bvh_node_get_bounds( node );
+
+        if ( !node.is_leaf() ) {
+            if ( node.left_or_first <= n || node.left_or_first + 1 >= nodes.size ) {
+                valid = false;
+                break;
+            }
+
+            valid = bounds.contains( bvh_node_get_bounds( nodes[ node.left_or_first ] ) ) &&
+                    bounds.contains( bvh_node_get_bounds( nodes[ node.left_or_first + 1 ] ) );
+            continue;
+        }
+
+        if ( node.left_or_first + node.triangle_count > triangle_indices.size ) {
+            valid = false;
+            break;
+        }
+
+        for ( u32 i = 0; i < node.triangle_count; ++i ) {
+            const u32 triangle_index = triangle_indices[ node.left_or_first + i ];
+            if ( triangle_index >= triangles.size || referenced[ triangle_index ] ) {
+                valid = false;
+                break;
+            }
+            referenced[ triangle_index ] = 1;
+
+            const BvhTriangle& triangle = triangles[ triangle_index ];
+            BvhAabb triangle_bounds;
+            triangle_bounds.reset();
+            triangle_bounds.add_point( triangle.v0 );
+            triangle_bounds.add_point( triangle.v1 );
+            triangle_bounds.add_point( triangle.v2 );
+
+            if ( !bounds.contains( triangle_bounds ) ) {
+                valid = false;
+                break;
+            }
+        }
+    }
+
+    for ( u32 t = 0; t < triangles.size && valid; ++t ) {
+        valid = referenced[ t ] != 0;
+    }
+
+    referenced.shutdown();
+
+    return valid;
+}
+
+void CpuBvh::print_stats() const {
+    rprint( "Bvh %s: %u triangles, %u nodes, %u leaves (avg %.2f, max %u triangles), depth %u, sah cost %.2f, %.2f KB nodes + %.2f KB indices, built in %.2f ms\n",
+            BvhBuildMode::ToString( options.mode ), stats.triangle_count, stats.node_count, stats.leaf_count, stats.average_leaf_triangles,
+            stats.max_leaf_triangles, stats.max_depth, stats.sah_cost, stats.node_bytes / 1024.0f, stats.index_bytes / 1024.0f, stats.build_ms );
+}
+
+// Blas build planning ////////////////////////////////////////////////////
+
+void blas_partition_geometries( const u32* primitive_counts, u32 geometry_count, u32 max_primitives_per_blas, u32 max_geometries_per_blas, Array<BlasBuildDesc>& out_blases ) {
+    out_blases.clear();
+
+    max_geometries_per_blas = raptor::max( max_geometries_per_blas, 1u );
+
+    for ( u32 g = 0; g < geometry_count; ++g ) {
+        const u32 primitive_count = primitive_counts[ g ];
+
+        bool new_blas = out_blases.size == 0;
+        if ( !new_blas ) {
+            const BlasBuildDesc& current = out_blases.back();
+            new_blas = current.geometry_count >= max_geometries_per_blas ||
+                       ( u64 )current.primitive_count + primitive_count > max_primitives_per_blas;
+        }
+
+        if ( new_blas ) {
+            BlasBuildDesc& blas = out_blases.push_use();
+            blas = BlasBuildDesc();
+            blas.first_geometry = g;
+        }
+
+        BlasBuildDesc& blas = out_blases.back();
+        ++blas.geometry_count;
+        blas.primitive_count += primitive_count;
+    }
+}
+
+u64 blas_plan_storage( BlasBuildDesc* blases, u32 blas_count, u64 alignment ) {
+    u64 offset = 0;
+    for ( u32 b = 0; b < blas_count; ++b ) {
+        blases[ b ].acceleration_structure_offset = offset;
+        offset = memory_align( offset + blases[ b ].acceleration_structure_size, alignment );
+    }
+    return offset;
+}
+
+u64 blas_plan_batches( BlasBuildDesc* blases, u32 blas_count, u64 scratch_budget, u64 scratch_alignment, Array<BlasBuildBatch>& out_batches ) {
+    out_batches.clear();
+
+    u64 max_scratch_size = 0;
+    for ( u32 b = 0; b < blas_count; ++b ) {
+        BlasBuildDesc& blas = blases[ b ];
+        const u64 scratch_size = memory_align( blas.build_scratch_size, scratch_alignment );
+
+        if ( out_batches.size == 0 || out_batches.back().scratch_size + scratch_size > scratch_budget ) {
+            BlasBuildBatch& batch = out_batches.push_use();
+            batch = BlasBuildBatch();
+            batch.first_blas = b;
+        }
+
+        BlasBuildBatch& batch = out_batches.back();
+        blas.batch = out_batches.size - 1;
+        blas.scratch_offset = batch.scratch_size;
+
+        ++batch.blas_count;
+        batch.scratch_size += scratch_size;
+
+        max_scratch_size = raptor::max( max_scratch_size, batch.scratch_size );
+    }
+
+    return max_scratch_size;
+}
+
+u64 blas_plan_compaction( BlasBuildDesc* blases, u32 blas_count, u64 alignment ) {
+    u64 offset = 0;
+    for ( u32 b = 0; b < blas_count; ++b ) {
+        blases[ b ].compacted_offset = offset;
+        offset = memory_align( offset + blases[ b ].compacted_size, alignment );
+    }
+    return offset;
+}
+
+} // namespace raptor
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/platform.hpp"
+
+namespace raptor {
+
+struct Allocator;
+
+//
+// CPU bounding volume hierarchy over the same triangles given to the acceleration structure builds.
+// It does not need ray tracing hardware: it is used as a reference to compare build strategies
+// (SAH cost, node count, memory) the same way the driver trades trace speed for build speed.
+
+namespace BvhBuildMode {
+    enum Enum {
+        FastTrace,      // Binned SAH, matches VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR.
+        FastBuild,      // Centroid midpoint splits, matches VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR.
+        Count
+    };
+
+    static cstring                  s_value_names[] = { "FastTrace", "FastBuild", "Count" };
+
+    static cstring ToString( Enum e ) {
+        return ( ( u32 )e < Count ) ? s_value_names[ ( int )e ] : "unsupported";
+    }
+} // namespace BvhBuildMode
+
+//
+// 32 bytes node. Children of an internal node are stored next to each other.
+struct BvhNode {
+
+    f32                             aabb_min[ 3 ];
+    u32                             left_or_first;      // Left child for internal nodes, first triangle for leaves.
+    f32                             aabb_max[ 3 ];
+    u32                             triangle_count;     // 0 for internal nodes.
+
+    bool                            is_leaf() const     { return triangle_count > 0; }
+
+}; // struct BvhNode
+
+//
+//
+struct BvhTriangle {
+
+    f32                             v0[ 3 ];
+    f32                             v1[ 3 ];
+    f32                             v2[ 3 ];
+
+}; // struct BvhTriangle
+
+//
+//
+struct CpuBvhBuildOptions {
+
+    BvhBuildMode::Enum              mode                = BvhBuildMode::FastTrace;
+    u32                             bin_count           = 16;
+    u32                             max_leaf_triangles  = 4;
+
+    f32                             traversal_cost      = 1.0f;
+    f32                             intersection_cost   = 1.0f;
+
+}; // struct CpuBvhBuildOptions
+
+//
+//
+struct CpuBvhStats {
+
+    u32                             triangle_count      = 0;
+    u32                             node_count          = 0;
+    u32                             leaf_count          = 0;
+    u32                             max_depth           = 0;
+    u32                             max_leaf_triangles  = 0;
+
+    f32                             sah_cost            = 0.0f;     // Expected cost of a random ray, relative to the root surface area.
+    f32                             average_leaf_triangles = 0.0f;
+
+    sizet                           node_bytes          = 0;
+    sizet                           index_bytes         = 0;
+    sizet                           triangle_bytes      = 0;
+
+    f64                             build_ms            = 0.0;
+
+}; // struct CpuBvhStats
+
+//
+//
+struct CpuBvh {
+
+    void                            init( Allocator* allocator, u32 triangle_capacity );
+    void                            shutdown();
+
+    // Positions are 3 floats every position_stride bytes, index_size is 2 or 4.
+    // Transform is an optional 3x4 row major matrix, same layout as VkTransformMatrixKHR.
+    void                            add_triangles( const u8* positions, u32 position_stride, const u8* indices, u32 index_size,
+                                                   u32 triangle_count, const f32* transform );
+
+    void                            build( const CpuBvhBuildOptions& options );
+    // Checks that every triangle is referenced once and that children are contained in their parent.
+    bool                            validate() const;
+
+    void                            print_stats() const;
+
+    Array<BvhTriangle>              triangles;
+    Array<u32>                      triangle_indices;
+    Array<BvhNode>                  nodes;
+
+    CpuBvhBuildOptions              options;
+    CpuBvhStats                     stats;
+
+    Allocator*                      allocator           = nullptr;
+
+}; // struct CpuBvh
+
+// Blas build planning //////////////////////////////////////////////////////
+
+//
+// A bottom level acceleration structure covering a contiguous range of scene geometries.
+struct BlasBuildDesc {
+
+    u32                             first_geometry      = 0;
+    u32                             geometry_count      = 0;
+    u32                             primitive_count     = 0;
+    u32                             batch               = 0;
+
+    u64                             acceleration_structure_size = 0;
+    u64                             acceleration_structure_offset = 0;
+    u64                             build_scratch_size  = 0;
+    u64                             scratch_offset      = 0;
+
+    u64                             compacted_size      = 0;
+    u64                             compacted_offset    = 0;
+
+}; // struct BlasBuildDesc
+
+//
+// Blases built with a single command, their scratch memory is allocated side by side.
+struct BlasBuildBatch {
+
+    u32                             first_blas          = 0;
+    u32                             blas_count          = 0;
+    u64                             scratch_size        = 0;
+
+}; // struct BlasBuildBatch
+
+// Groups consecutive geometries until one of the limits is reached, a geometry is never split.
+void                                blas_partition_geometries( const u32* primitive_counts, u32 geometry_count, u32 max_primitives_per_blas,
+                                                               u32 max_geometries_per_blas, Array<BlasBuildDesc>& out_blases );
+
+// Assigns aligned offsets inside a single buffer. Returns the total size.
+u64                                 blas_plan_storage( BlasBuildDesc* blases, u32 blas_count, u64 alignment );
+
+// Batches consecutive builds so that their scratch memory fits in the budget. A blas bigger than
+// the budget gets its own batch. Returns the scratch size needed by the biggest batch.
+u64                                 blas_plan_batches( BlasBuildDesc* blases, u32 blas_count, u64 scratch_budget, u64 scratch_alignment,
+                                                       Array<BlasBuildBatch>& out_batches );
+
+// Same as blas_plan_storage but for the compacted sizes.
+u64                                 blas_plan_compaction( BlasBuildDesc* blases, u32 blas_count, u64 alignment );
+
+} // namespace raptor
@@ -0,0 +1,739 @@
+#include "graphics/cloth_solver.hpp"
+
+#include "foundation/assert.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+#include "foundation/time.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#if defined( _M_X64 ) || defined( __x86_64__ )
+    #define RAPTOR_CLOTH_AVX2
+    #include <immintrin.h>
+    #if defined( _MSC_VER )
+        #include <intrin.h>
+        #define RAPTOR_TARGET_AVX2
+    #else
+        #define RAPTOR_TARGET_AVX2 __attribute__( ( target( "avx2" ) ) )
+    #endif
+#endif
+
+namespace raptor {
+
+// Same as cloth.glsl.
+static const vec3s                  k_cloth_fixed_positions[]       = { { 0.0f, 1.0f, -1.0f }, { 0.0f, -1.0f, -1.0f } };
+static const u32                    k_cloth_min_parallel_constraints = 1024;
+static const u32                    k_cloth_max_colors              = 64;
+
+static bool cloth_cpu_supports_avx2() {
+#if defined( RAPTOR_CLOTH_AVX2 )
+#if defined( _MSC_VER )
+    int info[ 4 ];
+    __cpuid( info, 0 );
+    if ( info[ 0 ] < 7 ) {
+        return false;
+    }
+
+    __cpuid( info, 1 );
+    const bool os_saves_ymm = ( info[ 2 ] & ( 1 << 27 ) ) != 0 && ( _xgetbv( 0 ) & 6 ) == 6;
+
+    __cpuidex( info, 7, 0 );
+    return os_saves_ymm && ( info[ 1 ] & ( 1 << 5 ) ) != 0;
+#else
+    return __builtin_cpu_supports( "avx2" );
+#endif
+#else
+    return false;
+#endif
+}
+
+static bool cloth_has_joint( const PhysicsVertexGpuData& vertex, u32 other_vertex ) {
+    for ( u32 j = 0; j < vertex.joint_count; ++j ) {
+        if ( vertex.joints[ j ] == other_vertex ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static f32 cloth_distance( vec3s a, vec3s b ) {
+    const f32 dx = a.x - b.x;
+    const f32 dy = a.y - b.y;
+    const f32 dz = a.z - b.z;
+    return sqrtf( dx * dx + dy * dy + dz * dz );
+}
+
+static void cloth_run_task( ClothSolverTask& task, enki::TaskScheduler* task_scheduler, bool parallel, u32 set_size, u32 min_range ) {
+    if ( set_size == 0 ) {
+        return;
+    }
+
+    if ( parallel ) {
+        task.m_SetSize = set_size;
+        task.m_MinRange = min_range;
+        task_scheduler->AddTaskSetToPipe( &task );
+        task_scheduler->WaitforTask( &task );
+    } else {
+        task.ExecuteRange( { 0, set_size }, 0 );
+    }
+}
+
+// ClothSolverTask ////////////////////////////////////////////////////////
+void ClothSolverTask::ExecuteRange( enki::TaskSetPartition range, uint32_t ) {
+    switch ( pass ) {
+        case Pass_MassSpring:
+        {
+            if ( solver->use_avx2 && solver->avx2_supported ) {
+                solver->mass_spring_blocks_avx2( range.start, range.end );
+            } else {
+                solver->mass_spring_blocks( range.start, range.end );
+            }
+            break;
+        }
+        case Pass_XPBDPredict:
+            solver->xpbd_predict_blocks( range.start, range.end );
+            break;
+        case Pass_XPBDConstraints:
+            solver->xpbd_constraints( color, range.start, range.end );
+            break;
+        case Pass_XPBDFinish:
+            solver->xpbd_finish_blocks( range.start, range.end );
+            break;
+        case Pass_Normals:
+            solver->normals_blocks( range.start, range.end );
+            break;
+    }
+}
+
+// ClothSolver ////////////////////////////////////////////////////////////
+void ClothSolver::init( Allocator* allocator_, const PhysicsMeshGpuData& mesh_data, const PhysicsVertexGpuData* vertices, const u32* indices_ ) {
+    allocator = allocator_;
+    avx2_supported = cloth_cpu_supports_avx2();
+
+    vertex_count = mesh_data.vertex_count;
+    padded_vertex_count = raptor::max( ( vertex_count + k_cloth_simd_width - 1 ) / k_cloth_simd_width, 1u ) * k_cloth_simd_width;
+
+    streams.init( allocator, ClothStream::Count * padded_vertex_count, ClothStream::Count * padded_vertex_count );
+    memset( streams.data, 0, streams.size_in_bytes() );
+
+    fixed_masks.init( allocator, padded_vertex_count, padded_vertex_count );
+    joint_counts.init( allocator, padded_vertex_count, padded_vertex_count );
+    joint_indices.init( allocator, padded_vertex_count * k_max_joint_count, padded_vertex_count * k_max_joint_count );
+    joint_rest_lengths.init( allocator, padded_vertex_count * k_max_joint_count, padded_vertex_count * k_max_joint_count );
+
+    f32* start_x = stream( ClothStream::StartX );
+    f32* start_y = stream( ClothStream::StartY );
+    f32* start_z = stream( ClothStream::StartZ );
+    f32* mass = stream( ClothStream::Mass );
+
+    // Padding vertices are fixed, without joints.
+    for ( u32 v = 0; v < padded_vertex_count; ++v ) {
+        const bool padding = v >= vertex_count;
+        const PhysicsVertexGpuData& vertex = vertices[ padding ? 0 : v ];
+
+        start_x[ v ] = padding ? 0.f : vertex.start_position.x;
+        start_y[ v ] = padding ? 0.f : vertex.start_position.y;
+        start_z[ v ] = padding ? 0.f : vertex.start_position.z;
+        mass[ v ] = padding ? 1.f : vertex.mass;
+
+        stream( ClothStream::NormalX )[ v ] = padding ? 0.f : vertex.normal.x;
+        stream( ClothStream::NormalY )[ v ] = padding ? 0.f : vertex.normal.y;
+        stream( ClothStream::NormalZ )[ v ] = padding ? 0.f : vertex.normal.z;
+
+        bool fixed = padding;
+        for ( u32 f = 0; f < ArraySize( k_cloth_fixed_positions ) && !fixed; ++f ) {
+            const vec3s& fixed_position = k_cloth_fixed_positions[ f ];
+            fixed = vertex.start_position.x == fixed_position.x && vertex.start_position.y == fixed_position.y && vertex.start_position.z == fixed_position.z;
+        }
+        fixed_masks[ v ] = fixed ? u32_max : 0;
+
+        joint_counts[ v ] = padding ? 0 : vertex.joint_count;
+        for ( u32 j = 0; j < k_max_joint_count; ++j ) {
+            const u32 other_vertex = j < joint_counts[ v ] ? vertex.joints[ j ] : v;
+            joint_indices[ j * padded_vertex_count + v ] = other_vertex;
+            joint_rest_lengths[ j * padded_vertex_count + v ] = j < joint_counts[ v ] ? cloth_distance( vertex.start_position, vertices[ other_vertex ].start_position ) : 0.f;
+        }
+    }
+
+    // Springs, once per joined pair even if only one of the vertices lists the other.
+    constraint_vertices.init( allocator, vertex_count * 8 );
+    Array<u32> unsorted_vertices;
+    unsorted_vertices.init( allocator, vertex_count * 8 );
+    for ( u32 v = 0; v < vertex_count; ++v ) {
+        const PhysicsVertexGpuData& vertex = vertices[ v ];
+        for ( u32 j = 0; j < vertex.joint_count; ++j ) {
+            const u32 other_vertex = vertex.joints[ j ];
+            if ( other_vertex > v || ( other_vertex < v && !cloth_has_joint( vertices[ other_vertex ], v ) ) ) {
+                unsorted_vertices.push( v );
+                unsorted_vertices.push( other_vertex );
+            }
+        }
+    }
+    const u32 num_constraints = unsorted_vertices.size / 2;
+
+    // Greedy coloring: the lowest color used by neither vertex, at most twice the joints per vertex.
+    Array<u64> vertex_colors;
+    vertex_colors.init( allocator, vertex_count, vertex_count );
+    memset( vertex_colors.data, 0, vertex_colors.size_in_bytes() );
+
+    Array<u32> constraint_colors;
+    constraint_colors.init( allocator, num_constraints, num_constraints );
+
+    color_offsets.init( allocator, k_cloth_max_colors + 1, k_cloth_max_colors + 1 );
+    memset( color_offsets.data, 0, color_offsets.size_in_bytes() );
+
+    u32 num_colors = 0;
+    for ( u32 c = 0; c < num_constraints; ++c ) {
+        const u32 a = unsorted_vertices[ c * 2 ];
+        const u32 b = unsorted_vertices[ c * 2 + 1 ];
+        const u64 used_colors = vertex_colors[ a ] | vertex_colors[ b ];
+
+        u32 color = 0;
+        while ( used_colors & ( 1ull << color ) ) {
+            ++color;
+        }
+        RASSERT( color < k_cloth_max_colors );
+
+        vertex_colors[ a ] |= 1ull << color;
+        vertex_colors[ b ] |= 1ull << color;
+        constraint_colors[ c ] = color;
+        ++color_offsets[ color + 1 ];
+        num_colors = raptor::max( num_colors, color + 1 );
+    }
+
+    for ( u32 color = 0; color < k_cloth_max_colors; ++color ) {
+        color_offsets[ color + 1 ] += color_offsets[ color ];
+    }
+    color_offsets.set_size( num_colors + 1 );
+
+    constraint_vertices.set_size( num_constraints * 2 );
+    constraint_rest_lengths.init( allocator, num_constraints, num_constraints );
+    constraint_lambdas.init( allocator, num_constraints, num_constraints );
+
+    Array<u32> color_cursors;
+    color_cursors.init( allocator, num_colors + 1, num_colors + 1 );
+    memory_copy( color_cursors.data, color_offsets.data, color_offsets.size_in_bytes() );
+
+    for ( u32 c = 0; c < num_constraints; ++c ) {
+        const u32 a = unsorted_vertices[ c * 2 ];
+        const u32 b = unsorted_vertices[ c * 2 + 1 ];
+        const u32 sorted = color_cursors[ constraint_colors[ c ] ]++;
+
+        constraint_vertices[ sorted * 2 ] = a;
+        constraint_vertices[ sorted * 2 + 1 ] = b;
+        constraint_rest_lengths[ sorted ] = cloth_distance( vertices[ a ].start_position, vertices[ b ].start_position );
+    }
+
+    color_cursors.shutdown();
+    constraint_colors.shutdown();
+    vertex_colors.shutdown();
+    unsorted_vertices.shutdown();
+
+    // Triangles of each vertex, a triangle with a repeated vertex is listed twice like in the shader loop.
+    const u32 index_count = mesh_data.index_count;
+    indices.init( allocator, index_count, index_count );
+    memory_copy( indices.data, ( void* )indices_, index_count * sizeof( u32 ) );
+
+    vertex_triangle_offsets.init( allocator, padded_vertex_count + 1, padded_vertex_count + 1 );
+    memset( vertex_triangle_offsets.data, 0, vertex_triangle_offsets.size_in_bytes() );
+    for ( u32 i = 0; i < index_count; ++i ) {
+        ++vertex_triangle_offsets[ indices[ i ] + 1 ];
+    }
+    for ( u32 v = 0; v < padded_vertex_count; ++v ) {
+        vertex_triangle_offsets[ v + 1 ] += vertex_triangle_offsets[ v ];
+    }
+
+    vertex_triangles.init( allocator, index_count, index_count );
+    Array<u32> triangle_cursors;
+    triangle_cursors.init( allocator, padded_vertex_count, padded_vertex_count );
+    memory_copy( triangle_cursors.data, vertex_triangle_offsets.data, triangle_cursors.size_in_bytes() );
+    for ( u32 i = 0; i < index_count; ++i ) {
+        vertex_triangles[ triangle_cursors[ indices[ i ] ]++ ] = i / 3;
+    }
+    triangle_cursors.shutdown();
+
+    stats = ClothSolverStats{};
+    stats.vertices = vertex_count;
+    stats.constraints = num_constraints;
+    stats.colors = num_colors;
+
+    scene_data = PhysicsSceneData{};
+
+    // Positions can differ from the start ones, keep them.
+    for ( u32 v = 0; v < padded_vertex_count; ++v ) {
+        const bool padding = v >= vertex_count;
+        const PhysicsVertexGpuData& vertex = vertices[ padding ? 0 : v ];
+
+        stream( ClothStream::PositionX )[ v ] = padding ? 0.f : vertex.position.x;
+        stream( ClothStream::PositionY )[ v ] = padding ? 0.f : vertex.position.y;
+        stream( ClothStream::PositionZ )[ v ] = padding ? 0.f : vertex.position.z;
+        stream( ClothStream::PreviousX )[ v ] = padding ? 0.f : vertex.previous_position.x;
+        stream( ClothStream::PreviousY )[ v ] = padding ? 0.f : vertex.previous_position.y;
+        stream( ClothStream::PreviousZ )[ v ] = padding ? 0.f : vertex.previous_position.z;
+        stream( ClothStream::VelocityX )[ v ] = padding ? 0.f : vertex.velocity.x;
+        stream( ClothStream::VelocityY )[ v ] = padding ? 0.f : vertex.velocity.y;
+        stream( ClothStream::VelocityZ )[ v ] = padding ? 0.f : vertex.velocity.z;
+        stream( ClothStream::ForceX )[ v ] = padding ? 0.f : vertex.force.x;
+        stream( ClothStream::ForceY )[ v ] = padding ? 0.f : vertex.force.y;
+        stream( ClothStream::ForceZ )[ v ] = padding ? 0.f : vertex.force.z;
+    }
+    position_stream = ClothStream::PositionX;
+    next_stream = ClothStream::NextX;
+}
+
+void ClothSolver::shutdown() {
+    streams.shutdown();
+    fixed_masks.shutdown();
+    joint_counts.shutdown();
+    joint_indices.shutdown();
+    joint_rest_lengths.shutdown();
+    constraint_vertices.shutdown();
+    constraint_rest_lengths.shutdown();
+    constraint_lambdas.shutdown();
+    color_offsets.shutdown();
+    vertex_triangle_offsets.shutdown();
+    vertex_triangles.shutdown();
+    indices.shutdown();
+}
+
+void ClothSolver::reset() {
+    const sizet stream_size = padded_vertex_count * sizeof( f32 );
+
+    for ( u32 axis = 0; axis < 3; ++axis ) {
+        memory_copy( stream( position_stream + axis ), stream( ClothStream::StartX + axis ), stream_size );
+        memory_copy( stream( ClothStream::PreviousX + axis ), stream( ClothStream::StartX + axis ), stream_size );
+        memset( stream( ClothStream::VelocityX + axis ), 0, stream_size );
+        memset( stream( ClothStream::ForceX + axis ), 0, stream_size );
+    }
+}
+
+void ClothSolver::simulate( const PhysicsSceneData& scene_data_, enki::TaskScheduler* task_scheduler ) {
+    const i64 start_time = time_now();
+
+    scene_data = scene_data_;
+    if ( scene_data.reset_simulation ) {
+        reset();
+    }
+
+    const u32 blocks = padded_vertex_count / k_cloth_simd_width;
+    const bool parallel = task_scheduler != nullptr && blocks >= min_parallel_blocks;
+
+    ClothSolverTask task;
+    task.solver = this;
+
+    for ( u32 s = 0; s < sim_steps; ++s ) {
+        if ( type == ClothSolverType::MassSpring ) {
+            task.pass = ClothSolverTask::Pass_MassSpring;
+            cloth_run_task( task, task_scheduler, parallel, blocks, blocks_per_task );
+        } else {
+            memset( constraint_lambdas.data, 0, constraint_lambdas.size_in_bytes() );
+
+            task.pass = ClothSolverTask::Pass_XPBDPredict;
+            cloth_run_task( task, task_scheduler, parallel, blocks, blocks_per_task );
+
+            task.pass = ClothSolverTask::Pass_XPBDConstraints;
+            for ( u32 i = 0; i < xpbd_iterations; ++i ) {
+                for ( u32 color = 0; color + 1 < color_offsets.size; ++color ) {
+                    const u32 color_constraints = color_offsets[ color + 1 ] - color_offsets[ color ];
+
+                    task.color = color;
+                    cloth_run_task( task, task_scheduler, task_scheduler != nullptr && color_constraints >= k_cloth_min_parallel_constraints,
+                                    color_constraints, k_cloth_min_parallel_constraints / 2 );
+                }
+            }
+
+            task.pass = ClothSolverTask::Pass_XPBDFinish;
+            cloth_run_task( task, task_scheduler, parallel, blocks, blocks_per_task );
+        }
+
+        const u32 previous_position_stream = position_stream;
+        position_stream = next_stream;
+        next_stream = previous_position_stream;
+    }
+
+    task.pass = ClothSolverTask::Pass_Normals;
+    cloth_run_task( task, task_scheduler, parallel, blocks, blocks_per_task );
+
+    stats.steps += sim_steps;
+    stats.simulate_ms = ( f32 )time_from_milliseconds( start_time );
+    stats.vertices_per_ms = stats.simulate_ms > 0.f ? ( vertex_count * sim_steps ) / stats.simulate_ms : 0.f;
+}
+
+void ClothSolver::read_vertex( u32 v, PhysicsVertexGpuData& vertex ) const {
+    const f32* data = streams.data;
+    const u32 p = padded_vertex_count;
+
+    vertex.position = { data[ position_stream * p + v ], data[ ( position_stream + 1 ) * p + v ], data[ ( position_stream + 2 ) * p + v ] };
+    vertex.start_position = { data[ ClothStream::StartX * p + v ], data[ ClothStream::StartY * p + v ], data[ ClothStream::StartZ * p + v ] };
+    vertex.previous_position = { data[ ClothStream::PreviousX * p + v ], data[ ClothStream::PreviousY * p + v ], data[ ClothStream::PreviousZ * p + v ] };
+    vertex.normal = { data[ ClothStream::NormalX * p + v ], data[ ClothStream::NormalY * p + v ], data[ ClothStream::NormalZ * p + v ] };
+    vertex.velocity = { data[ ClothStream::VelocityX * p + v ], data[ ClothStream::VelocityY * p + v ], data[ ClothStream::VelocityZ * p + v ] };
+    vertex.force = { data[ ClothStream::ForceX * p + v ], data[ ClothStream::ForceY * p + v ], data[ ClothStream::ForceZ * p + v ] };
+    vertex.mass = data[ ClothStream::Mass * p + v ];
+    vertex.joint_count = joint_counts[ v ];
+
+    for ( u32 j = 0; j < k_max_joint_count; ++j ) {
+        vertex.joints[ j ] = j < joint_counts[ v ] ? joint_indices[ j * p + v ] : 0;
+    }
+}
+
+void ClothSolver::read_vertices( PhysicsVertexGpuData* out_vertices ) const {
+    for ( u32 v = 0; v < vertex_count; ++v ) {
+        read_vertex( v, out_vertices[ v ] );
+    }
+}
+
+// Forces of cloth.glsl, the order of the operations is the same in the AVX2 version to get the same results.
+void ClothSolver::mass_spring_blocks( u32 begin_block, u32 end_block ) {
+    const f32* px = stream( position_stream );
+    const f32* py = stream( position_stream + 1 );
+    const f32* pz = stream( position_stream + 2 );
+    f32* nx = stream( next_stream );
+    f32* ny = stream( next_stream + 1 );
+    f32* nz = stream( next_stream + 2 );
+    f32* previous_x = stream( ClothStream::PreviousX );
+    f32* previous_y = stream( ClothStream::PreviousY );
+    f32* previous_z = stream( ClothStream::PreviousZ );
+    f32* velocity_x = stream( ClothStream::VelocityX );
+    f32* velocity_y = stream( ClothStream::VelocityY );
+    f32* velocity_z = stream( ClothStream::VelocityZ );
+    f32* force_x = stream( ClothStream::ForceX );
+    f32* force_y = stream( ClothStream::ForceY );
+    f32* force_z = stream( ClothStream::ForceZ );
+    const f32* normal_x = stream( ClothStream::NormalX );
+    const f32* normal_y = stream( ClothStream::NormalY );
+    const f32* normal_z = stream( ClothStream::NormalZ );
+    const f32* mass = stream( ClothStream::Mass );
+
+    const f32 stiffness = scene_data.spring_stiffness;
+    const f32 damping = -scene_data.spring_damping;
+    const f32 air_density = scene_data.air_density;
+    const vec3s wind = scene_data.wind_direction;
+    const f32 dt2 = delta_time * delta_time;
+
+    for ( u32 v = begin_block * k_cloth_simd_width; v < end_block * k_cloth_simd_width; ++v ) {
+        const f32 x = px[ v ];
+        const f32 y = py[ v ];
+        const f32 z = pz[ v ];
+
+        f32 fx = force_x[ v ];
+        f32 fy = force_y[ v ];
+        f32 fz = force_z[ v ];
+
+        if ( fixed_masks[ v ] == 0 ) {
+            f32 spring_x = 0.f;
+            f32 spring_y = 0.f;
+            f32 spring_z = 0.f;
+
+            for ( u32 j = 0; j < joint_counts[ v ]; ++j ) {
+                const u32 other = joint_indices[ j * padded_vertex_count + v ];
+                const f32 rest_length = joint_rest_lengths[ j * padded_vertex_count + v ];
+
+                const f32 dx = x - px[ other ];
+                const f32 dy = y - py[ other ];
+                const f32 dz = z - pz[ other ];
+                const f32 inverse_length = 1.f / sqrtf( ( dx * dx + dy * dy ) + dz * dz );
+
+                spring_x = spring_x + ( dx - ( dx * inverse_length ) * rest_length ) * stiffness;
+                spring_y = spring_y + ( dy - ( dy * inverse_length ) * rest_length ) * stiffness;
+                spring_z = spring_z + ( dz - ( dz * inverse_length ) * rest_length ) * stiffness;
+            }
+
+            const f32 vx = velocity_x[ v ];
+            const f32 vy = velocity_y[ v ];
+            const f32 vz = velocity_z[ v ];
+            const f32 normal_wind = ( normal_x[ v ] * ( wind.x - vx ) + normal_y[ v ] * ( wind.y - vy ) ) + normal_z[ v ] * ( wind.z - vz );
+
+            fx = ( ( gravity.x * mass[ v ] - spring_x ) + vx * damping ) + ( normal_x[ v ] * normal_wind ) * air_density;
+            fy = ( ( gravity.y * mass[ v ] - spring_y ) + vy * damping ) + ( normal_y[ v ] * normal_wind ) * air_density;
+            fz = ( ( gravity.z * mass[ v ] - spring_z ) + vz * damping ) + ( normal_z[ v ] * normal_wind ) * air_density;
+        }
+
+        // Verlet integration
+        const f32 new_x = ( x * 2.f - previous_x[ v ] ) + fx * dt2;
+        const f32 new_y = ( y * 2.f - previous_y[ v ] ) + fy * dt2;
+        const f32 new_z = ( z * 2.f - previous_z[ v ] ) + fz * dt2;
+
+        nx[ v ] = new_x;
+        ny[ v ] = new_y;
+        nz[ v ] = new_z;
+        previous_x[ v ] = x;
+        previous_y[ v ] = y;
+        previous_z[ v ] = z;
+        velocity_x[ v ] = new_x - x;
+        velocity_y[ v ] = new_y - y;
+        velocity_z[ v ] = new_z - z;
+        force_x[ v ] = fx;
+        force_y[ v ] = fy;
+        force_z[ v ] = fz;
+    }
+}
+
+#if defined( RAPTOR_CLOTH_AVX2 )
+RAPTOR_TARGET_AVX2 void ClothSolver::mass_spring_blocks_avx2( u32 begin_block, u32 end_block ) {
+    const f32* px = stream( position_stream );
+    const f32* py = stream( position_stream + 1 );
+    const f32* pz = stream( position_stream + 2 );
+    f32* nx = stream( next_stream );
+    f32* ny = stream( next_stream + 1 );
+    f32* nz = stream( next_stream + 2 );
+    f32* previous_x = stream( ClothStream::PreviousX );
+    f32* previous_y = stream( ClothStream::PreviousY );
+    f32* previous_z = stream( ClothStream::PreviousZ );
+    f32* velocity_x = stream( ClothStream::VelocityX );
+    f32* velocity_y = stream( ClothStream::VelocityY );
+    f32* velocity_z = stream( ClothStream::VelocityZ );
+    f32* force_x = stream( ClothStream::ForceX );
+    f32* force_y = stream( ClothStream::ForceY );
+    f32* force_z = stream( ClothStream::ForceZ );
+    const f32* normal_x = stream( ClothStream::NormalX );
+    const f32* normal_y = stream( ClothStream::NormalY );
+    const f32* normal_z = stream( ClothStream::NormalZ );
+    const f32* mass = stream( ClothStream::Mass );
+
+    const __m256 stiffness = _mm256_set1_ps( scene_data.spring_stiffness );
+    const __m256 damping = _mm256_set1_ps( -scene_data.spring_damping );
+    const __m256 air_density = _mm256_set1_ps( scene_data.air_density );
+    const __m256 wind_x = _mm256_set1_ps( scene_data.wind_direction.x );
+    const __m256 wind_y = _mm256_set1_ps( scene_data.wind_direction.y );
+    const __m256 wind_z = _mm256_set1_ps( scene_data.wind_direction.z );
+    const __m256 gravity_x = _mm256_set1_ps( gravity.x );
+    const __m256 gravity_y = _mm256_set1_ps( gravity.y );
+    const __m256 gravity_z = _mm256_set1_ps( gravity.z );
+    const __m256 dt2 = _mm256_set1_ps( delta_time * delta_time );
+    const __m256 one = _mm256_set1_ps( 1.f );
+    const __m256 two = _mm256_set1_ps( 2.f );
+
+    for ( u32 v = begin_block * k_cloth_simd_width; v < end_block * k_cloth_simd_width; v += k_cloth_simd_width ) {
+        const __m256 x = _mm256_loadu_ps( px + v );
+        const __m256 y = _mm256_loadu_ps( py + v );
+        const __m256 z = _mm256_loadu_ps( pz + v );
+
+        const __m256i counts = _mm256_loadu_si256( ( const __m256i* )( joint_counts.data + v ) );
+        u32 max_count = 0;
+        for ( u32 lane = 0; lane < k_cloth_simd_width; ++lane ) {
+            max_count = raptor::max( max_count, joint_counts[ v + lane ] );
+        }
+
+        __m256 spring_x = _mm256_setzero_ps();
+        __m256 spring_y = _mm256_setzero_ps();
+        __m256 spring_z = _mm256_setzero_ps();
+
+        for ( u32 j = 0; j < max_count; ++j ) {
+            const __m256i others = _mm256_loadu_si256( ( const __m256i* )( joint_indices.data + j * padded_vertex_count + v ) );
+            const __m256 rest_length = _mm256_loadu_ps( joint_rest_lengths.data + j * padded_vertex_count + v );
+            const __m256 valid = _mm256_castsi256_ps( _mm256_cmpgt_epi32( counts, _mm256_set1_epi32( ( int )j ) ) );
+
+            const __m256 dx = _mm256_sub_ps( x, _mm256_i32gather_ps( px, others, 4 ) );
+            const __m256 dy = _mm256_sub_ps( y, _mm256_i32gather_ps( py, others, 4 ) );
+            const __m256 dz = _mm256_sub_ps( z, _mm256_i32gather_ps( pz, others, 4 ) );
+            const __m256 length_squared = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( dx, dx ), _mm256_mul_ps( dy, dy ) ), _mm256_mul_ps( dz, dz ) );
+            const __m256 inverse_length = _mm256_div_ps( one, _mm256_sqrt_ps( length_squared ) );
+
+            // Missing joints point to the vertex itself, mask their NaNs out.
+            const __m256 pull_x = _mm256_mul_ps( _mm256_sub_ps( dx, _mm256_mul_ps( _mm256_mul_ps( dx, inverse_length ), rest_length ) ), stiffness );
+            const __m256 pull_y = _mm256_mul_ps( _mm256_sub_ps( dy, _mm256_mul_ps( _mm256_mul_ps( dy, inverse_length ), rest_length ) ), stiffness );
+            const __m256 pull_z = _mm256_mul_ps( _mm256_sub_ps( dz, _mm256_mul_ps( _mm256_mul_ps( dz, inverse_length ), rest_length ) ), stiffness );
+            spring_x = _mm256_blendv_ps( spring_x, _mm256_add_ps( spring_x, pull_x ), valid );
+            spring_y = _mm256_blendv_ps( spring_y, _mm256_add_ps( spring_y, pull_y ), valid );
+            spring_z = _mm256_blendv_ps( spring_z, _mm256_add_ps( spring_z, pull_z ), valid );
+        }
+
+        const __m256 vx = _mm256_loadu_ps( velocity_x + v );
+        const __m256 vy = _mm256_loadu_ps( velocity_y + v );
+        const __m256 vz = _mm256_loadu_ps( velocity_z + v );
+        const __m256 n_x = _mm256_loadu_ps( normal_x + v );
+        const __m256 n_y = _mm256_loadu_ps( normal_y + v );
+        const __m256 n_z = _mm256_loadu_ps( normal_z + v );
+        const __m256 normal_wind = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( n_x, _mm256_sub_ps( wind_x, vx ) ), _mm256_mul_ps( n_y, _mm256_sub_ps( wind_y, vy ) ) ),
+                                                  _mm256_mul_ps( n_z, _mm256_sub_ps( wind_z, vz ) ) );
+        const __m256 m = _mm256_loadu_ps( mass + v );
+
+        __m256 fx = _mm256_add_ps( _mm256_add_ps( _mm256_sub_ps( _mm256_mul_ps( gravity_x, m ), spring_x ), _mm256_mul_ps( vx, damping ) ),
+                                   _mm256_mul_ps( _mm256_mul_ps( n_x, normal_wind ), air_density ) );
+        __m256 fy = _mm256_add_ps( _mm256_add_ps( _mm256_sub_ps( _mm256_mul_ps( gravity_y, m ), spring_y ), _mm256_mul_ps( vy, damping ) ),
+                                   _mm256_mul_ps( _mm256_mul_ps( n_y, normal_wind ), air_density ) );
+        __m256 fz = _mm256_add_ps( _mm256_add_ps( _mm256_sub_ps( _mm256_mul_ps( gravity_z, m ), spring_z ), _mm256_mul_ps( vz, damping ) ),
+                                   _mm256_mul_ps( _mm256_mul_ps( n_z, normal_wind ), air_density ) );
+
+        // Fixed vertices keep their force.
+        const __m256 fixed = _mm256_castsi256_ps( _mm256_loadu_si256( ( const __m256i* )( fixed_masks.data + v ) ) );
+        fx = _mm256_blendv_ps( fx, _mm256_loadu_ps( force_x + v ), fixed );
+        fy = _mm256_blendv_ps( fy, _mm256_loadu_ps( force_y + v ), fixed );
+        fz = _mm256_blendv_ps( fz, _mm256_loadu_ps( force_z + v ), fixed );
+
+        // Verlet integration
+        const __m256 new_x = _mm256_add_ps( _mm256_sub_ps( _mm256_mul_ps( x, two ), _mm256_loadu_ps( previous_x + v ) ), _mm256_mul_ps( fx, dt2 ) );
+        const __m256 new_y = _mm256_add_ps( _mm256_sub_ps( _mm256_mul_ps( y, two ), _mm256_loadu_ps( previous_y + v ) ), _mm256_mul_ps( fy, dt2 ) );
+        const __m256 new_z = _mm256_add_ps( _mm256_sub_ps( _mm256_mul_ps( z, two ), _mm256_loadu_ps( previous_z + v ) ), _mm256_mul_ps( fz, dt2 ) );
+
+        _mm256_storeu_ps( nx + v, new_x );
+        _mm256_storeu_ps( ny + v, new_y );
+        _mm256_storeu_ps( nz + v, new_z );
+        _mm256_storeu_ps( previous_x + v, x );
+        _mm256_storeu_ps( previous_y + v, y );
+        _mm256_storeu_ps( previous_z + v, z );
+        _mm256_storeu_ps( velocity_x + v, _mm256_sub_ps( new_x, x ) );
+        _mm256_storeu_ps( velocity_y + v, _mm256_sub_ps( new_y, y ) );
+        _mm256_storeu_ps( velocity_z + v, _mm256_sub_ps( new_z, z ) );
+        _mm256_storeu_ps( force_x + v, fx );
+        _mm256_storeu_ps( force_y + v, fy );
+        _mm256_storeu_ps( force_z + v, fz );
+    }
+}
+#else
+void ClothSolver::mass_spring_blocks_avx2( u32 begin_block, u32 end_block ) {
+    mass_spring_blocks( begin_block, end_block );
+}
+#endif // RAPTOR_CLOTH_AVX2
+
+// XPBD: the external forces move the vertices, then the springs are distance constraints.
+// The shader integrates forces as accelerations, so all free vertices have an inverse mass of 1 here too.
+void ClothSolver::xpbd_predict_blocks( u32 begin_block, u32 end_block ) {
+    const f32* px = stream( position_stream );
+    const f32* py = stream( position_stream + 1 );
+    const f32* pz = stream( position_stream + 2 );
+    f32* nx = stream( next_stream );
+    f32* ny = stream( next_stream + 1 );
+    f32* nz = stream( next_stream + 2 );
+    const f32* previous_x = stream( ClothStream::PreviousX );
+    const f32* previous_y = stream( ClothStream::PreviousY );
+    const f32* previous_z = stream( ClothStream::PreviousZ );
+    const f32* velocity_x = stream( ClothStream::VelocityX );
+    const f32* velocity_y = stream( ClothStream::VelocityY );
+    const f32* velocity_z = stream( ClothStream::VelocityZ );
+    f32* force_x = stream( ClothStream::ForceX );
+    f32* force_y = stream( ClothStream::ForceY );
+    f32* force_z = stream( ClothStream::ForceZ );
+    const f32* normal_x = stream( ClothStream::NormalX );
+    const f32* normal_y = stream( ClothStream::NormalY );
+    const f32* normal_z = stream( ClothStream::NormalZ );
+    const f32* mass = stream( ClothStream::Mass );
+
+    const f32 damping = -scene_data.spring_damping;
+    const f32 air_density = scene_data.air_density;
+    const vec3s wind = scene_data.wind_direction;
+    const f32 dt2 = delta_time * delta_time;
+
+    for ( u32 v = begin_block * k_cloth_simd_width; v < end_block * k_cloth_simd_width; ++v ) {
+        if ( fixed_masks[ v ] ) {
+            nx[ v ] = px[ v ];
+            ny[ v ] = py[ v ];
+            nz[ v ] = pz[ v ];
+            continue;
+        }
+
+        const f32 vx = velocity_x[ v ];
+        const f32 vy = velocity_y[ v ];
+        const f32 vz = velocity_z[ v ];
+        const f32 normal_wind = ( normal_x[ v ] * ( wind.x - vx ) + normal_y[ v ] * ( wind.y - vy ) ) + normal_z[ v ] * ( wind.z - vz );
+
+        const f32 fx = ( gravity.x * mass[ v ] + vx * damping ) + ( normal_x[ v ] * normal_wind ) * air_density;
+        const f32 fy = ( gravity.y * mass[ v ] + vy * damping ) + ( normal_y[ v ] * normal_wind ) * air_density;
+        const f32 fz = ( gravity.z * mass[ v ] + vz * damping ) + ( normal_z[ v ] * normal_wind ) * air_density;
+
+        nx[ v ] = ( px[ v ] * 2.f - previous_x[ v ] ) + fx * dt2;
+        ny[ v ] = ( py[ v ] * 2.f - previous_y[ v ] ) + fy * dt2;
+        nz[ v ] = ( pz[ v ] * 2.f - previous_z[ v ] ) + fz * dt2;
+        force_x[ v ] = fx;
+        force_y[ v ] = fy;
+        force_z[ v ] = fz;
+    }
+}
+
+void ClothSolver::xpbd_constraints( u32 color, u32 begin, u32 end ) {
+    f32* nx = stream( next_stream );
+    f32* ny = stream( next_stream + 1 );
+    f32* nz = stream( next_stream + 2 );
+
+    // Compliance of a spring of the same stiffness, scaled by the step.
+    const f32 alpha = scene_data.spring_stiffness > 0.f ? 1.f / ( scene_data.spring_stiffness * delta_time * delta_time ) : 0.f;
+
+    const u32 first = color_offsets[ color ];
+    for ( u32 c = first + begin; c < first + end; ++c ) {
+        const u32 a = constraint_vertices[ c * 2 ];
+        const u32 b = constraint_vertices[ c * 2 + 1 ];
+        const f32 weight_a = fixed_masks[ a ] ? 0.f : 1.f;
+        const f32 weight_b = fixed_masks[ b ] ? 0.f : 1.f;
+
+        const f32 dx = nx[ a ] - nx[ b ];
+        const f32 dy = ny[ a ] - ny[ b ];
+        const f32 dz = nz[ a ] - nz[ b ];
+        const f32 length = sqrtf( ( dx * dx + dy * dy ) + dz * dz );
+        const f32 denominator = weight_a + weight_b + alpha;
+        if ( length == 0.f || denominator == 0.f ) {
+            continue;
+        }
+
+        const f32 constraint = length - constraint_rest_lengths[ c ];
+        const f32 delta_lambda = ( -constraint - alpha * constraint_lambdas[ c ] ) / denominator;
+        constraint_lambdas[ c ] += delta_lambda;
+
+        const f32 correction = delta_lambda / length;
+        nx[ a ] += weight_a * correction * dx;
+        ny[ a ] += weight_a * correction * dy;
+        nz[ a ] += weight_a * correction * dz;
+        nx[ b ] -= weight_b * correction * dx;
+        ny[ b ] -= weight_b * correction * dy;
+        nz[ b ] -= weight_b * correction * dz;
+    }
+}
+
+void ClothSolver::xpbd_finish_blocks( u32 begin_block, u32 end_block ) {
+    for ( u32 axis = 0; axis < 3; ++axis ) {
+        const f32* p = stream( position_stream + axis );
+        const f32* n = stream( next_stream + axis );
+        f32* previous = stream( ClothStream::PreviousX + axis );
+        f32* velocity = stream( ClothStream::VelocityX + axis );
+
+        for ( u32 v = begin_block * k_cloth_simd_width; v < end_block * k_cloth_simd_width; ++v ) {
+            previous[ v ] = p[ v ];
+            velocity[ v ] = n[ v ] - p[ v ];
+        }
+    }
+}
+
+void ClothSolver::normals_blocks( u32 begin_block, u32 end_block ) {
+    const f32* px = stream( position_stream );
+    const f32* py = stream( position_stream + 1 );
+    const f32* pz = stream( position_stream + 2 );
+    f32* normal_x = stream( ClothStream::NormalX );
+    f32* normal_y = stream( ClothStream::NormalY );
+    f32* normal_z = stream( ClothStream::NormalZ );
+
+    for ( u32 v = begin_block * k_cloth_simd_width; v < end_block * k_cloth_simd_width; ++v ) {
+        f32 x = normal_x[ v ];
+        f32 y = normal_y[ v ];
+        f32 z = normal_z[ v ];
+
+        for ( u32 t = vertex_triangle_offsets[ v ]; t < vertex_triangle_offsets[ v + 1 ]; ++t ) {
+            const u32 triangle = vertex_triangles[ t ];
+            const u32 i0 = indices[ triangle * 3 ];
+            const u32 i1 = indices[ triangle * 3 + 1 ];
+            const u32 i2 = indices[ triangle * 3 + 2 ];
+
+            const f32 e1x = px[ i1 ] - px[ i0 ];
+            const f32 e1y = py[ i1 ] - py[ i0 ];
+            const f32 e1z = pz[ i1 ] - pz[ i0 ];
+            const f32 e2x = px[ i2 ] - px[ i0 ];
+            const f32 e2y = py[ i2 ] - py[ i0 ];
+            const f32 e2z = pz[ i2 ] - pz[ i0 ];
+
+            x += e1y * e2z - e1z * e2y;
+            y += e1z * e2x - e1x * e2z;
+            z += e1x * e2y - e1y * e2x;
+
+            const f32 inverse_length = 1.f / sqrtf( ( x * x + y * y ) + z * z );
+            x *= inverse_length;
+            y *= inverse_length;
+            z *= inverse_length;
+        }
+
+        normal_x[ v ] = x;
+        normal_y[ v ] = y;
+        normal_z[ v ] = z;
+    }
+}
+
+} // namespace raptor
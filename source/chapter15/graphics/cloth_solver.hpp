@@ -0,0 +1,202 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/platform.hpp"
+
+#include "external/cglm/types-struct.h"
+#include "external/enkiTS/TaskScheduler.h"
+
+namespace raptor {
+
+struct Allocator;
+struct ClothSolver;
+
+static const u32                    k_max_joint_count           = 12;
+static const u32                    k_cloth_simd_width          = 8;        // Vertices per AVX2 register.
+
+// Cloth data as read by cloth.glsl ///////////////////////////////////////
+
+//
+//
+struct PhysicsVertexGpuData {
+    vec3s                           position;
+    f32                             pad0_;
+
+    vec3s                           start_position;
+    f32                             pad1_;
+
+    vec3s                           previous_position;
+    f32                             pad2_;
+
+    vec3s                           normal;
+    u32                             joint_count;
+
+    vec3s                           velocity;
+    f32                             mass;
+
+    vec3s                           force;
+
+    // TODO(marco): better storage, values are never greater than 12
+    u32                             joints[ k_max_joint_count ];
+    u32                             pad3_;
+}; // struct PhysicsVertexGpuData
+
+//
+//
+struct PhysicsMeshGpuData {
+    u32                             index_count;
+    u32                             vertex_count;
+
+    u32                             padding_[ 2 ];
+}; // struct PhysicsMeshGpuData
+
+//
+//
+struct PhysicsSceneData {
+    vec3s                           wind_direction;
+    u32                             reset_simulation;
+
+    f32                             air_density;
+    f32                             spring_stiffness;
+    f32                             spring_damping;
+    f32                             padding_;
+}; // struct PhysicsSceneData
+
+// ClothSolver ////////////////////////////////////////////////////////////
+
+namespace ClothSolverType {
+    enum Enum : u8 {
+        MassSpring, XPBD, Count
+    };
+
+    static const char* s_value_names[] = {
+        "Mass Spring", "XPBD", "Count"
+    };
+
+    static const char* ToString( Enum e ) {
+        return ( ( u32 )e < Enum::Count ? s_value_names[ ( int )e ] : "unsupported" );
+    }
+} // namespace ClothSolverType
+
+// Per vertex float streams, each padded to a multiple of k_cloth_simd_width.
+namespace ClothStream {
+    enum Enum : u8 {
+        PositionX, PositionY, PositionZ,
+        NextX, NextY, NextZ,
+        PreviousX, PreviousY, PreviousZ,
+        VelocityX, VelocityY, VelocityZ,
+        NormalX, NormalY, NormalZ,
+        ForceX, ForceY, ForceZ,
+        StartX, StartY, StartZ,
+        Mass,
+        Count
+    };
+} // namespace ClothStream
+
+//
+//
+struct ClothSolverStats {
+
+    u32                             vertices                = 0;
+    u32                             constraints             = 0;    // Springs, each pair of joined vertices once.
+    u32                             colors                  = 0;    // Constraint colors of the XPBD solver.
+    u32                             steps                   = 0;
+
+    f32                             simulate_ms             = 0.f;
+    f32                             vertices_per_ms         = 0.f;  // Vertex steps per millisecond.
+
+}; // struct ClothSolverStats
+
+//
+// Runs a range of vertex blocks or of the constraints of a color.
+struct ClothSolverTask : public enki::ITaskSet {
+
+    enum Pass : u8 {
+        Pass_MassSpring, Pass_XPBDPredict, Pass_XPBDConstraints, Pass_XPBDFinish, Pass_Normals
+    };
+
+    void                            ExecuteRange( enki::TaskSetPartition range, uint32_t ) override;
+
+    ClothSolver*                    solver                  = nullptr;
+    Pass                            pass                    = Pass_MassSpring;
+    u32                             color                   = 0;
+
+}; // struct ClothSolverTask
+
+//
+// CPU version of cloth.glsl, initialized from the same buffer and parameters to compare the results or to
+// simulate without a GPU. Vertices are stored as structure of arrays, padded to full AVX2 registers.
+// MassSpring is the reference: forces of all the springs from the positions of the previous step, then Verlet
+// integration, a Jacobi step that gives the same result on any number of threads, with or without AVX2.
+// XPBD replaces the spring forces with distance constraints with compliance 1 / spring_stiffness, solved
+// Gauss-Seidel one color at a time: constraints of a color share no vertex and run in parallel.
+// Normals are accumulated per vertex in triangle order, as the serial loop of the shader.
+struct ClothSolver {
+
+    void                            init( Allocator* allocator, const PhysicsMeshGpuData& mesh_data, const PhysicsVertexGpuData* vertices,
+                                          const u32* indices );
+    void                            shutdown();
+
+    void                            reset();
+
+    // Same work as a cloth.glsl dispatch: sim_steps steps of delta_time, then normals.
+    void                            simulate( const PhysicsSceneData& scene_data, enki::TaskScheduler* task_scheduler );
+
+    // Positions, previous positions, normals, velocities and forces in the layout of the GPU buffer.
+    void                            read_vertex( u32 vertex_index, PhysicsVertexGpuData& out_vertex ) const;
+    void                            read_vertices( PhysicsVertexGpuData* out_vertices ) const;
+
+    f32*                            stream( u32 stream_index )          { return streams.data + stream_index * padded_vertex_count; }
+
+    void                            mass_spring_blocks( u32 begin_block, u32 end_block );
+    void                            mass_spring_blocks_avx2( u32 begin_block, u32 end_block );
+    void                            xpbd_predict_blocks( u32 begin_block, u32 end_block );
+    void                            xpbd_constraints( u32 color, u32 begin, u32 end );
+    void                            xpbd_finish_blocks( u32 begin_block, u32 end_block );
+    void                            normals_blocks( u32 begin_block, u32 end_block );
+
+    Array<f32>                      streams;                // ClothStream::Count streams of padded_vertex_count.
+    Array<u32>                      fixed_masks;            // All bits set for fixed vertices.
+    Array<u32>                      joint_counts;
+    // Joint j of vertex v at j * padded_vertex_count + v, missing joints point to the vertex itself.
+    Array<u32>                      joint_indices;
+    Array<f32>                      joint_rest_lengths;
+
+    // XPBD distance constraints, sorted by color.
+    Array<u32>                      constraint_vertices;    // Pairs.
+    Array<f32>                      constraint_rest_lengths;
+    Array<f32>                      constraint_lambdas;
+    Array<u32>                      color_offsets;          // colors + 1.
+
+    // Triangles of each vertex, in increasing order: between offsets[ v ] and offsets[ v + 1 ].
+    Array<u32>                      vertex_triangle_offsets;
+    Array<u32>                      vertex_triangles;
+    Array<u32>                      indices;
+
+    ClothSolverStats                stats;
+
+    // Parameters of the current simulate call.
+    PhysicsSceneData                scene_data;
+
+    Allocator*                      allocator               = nullptr;
+
+    u32                             vertex_count            = 0;
+    u32                             padded_vertex_count     = 0;
+    u32                             position_stream         = ClothStream::PositionX;  // Swapped with next_stream after each step.
+    u32                             next_stream             = ClothStream::NextX;
+
+    ClothSolverType::Enum           type                    = ClothSolverType::MassSpring;
+    bool                            use_avx2                = true;     // When supported by the CPU.
+    bool                            avx2_supported          = false;
+
+    u32                             sim_steps               = 10;       // As cloth.glsl.
+    f32                             delta_time              = 1.f / 600.f;
+    vec3s                           gravity                 = { 0.f, -9.8f, 0.f };
+    u32                             xpbd_iterations         = 1;
+
+    u32                             min_parallel_blocks     = 16;       // Smaller meshes run on the calling thread.
+    u32                             blocks_per_task         = 8;
+
+}; // struct ClothSolver
+
+} // namespace raptor
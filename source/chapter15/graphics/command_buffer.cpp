@@ -22,18 +22,21 @@ void CommandBuffer::reset() {
     current_pipeline = nullptr;
     current_command = 0;
 
+    state_filter.reset();
+
     vkResetDescriptorPool( gpu_device->vulkan_device, vk_descriptor_pool, 0 );
 
-    u32 resource_count = descriptor_sets.free_indices_head;
-    for ( u32 i = 0; i < resource_count; ++i) {
-        DescriptorSet* v_descriptor_set = ( DescriptorSet* )descriptor_sets.access_resource( i );
+    // Sets in use are the first free_indices_head entries of the free list, release them in reverse order.
+    for ( i32 i = ( i32 )descriptor_sets.free_indices_head - 1; i >= 0; --i ) {
+        const u32 set_index = descriptor_sets.free_indices[ i ];
+        DescriptorSet* v_descriptor_set = ( DescriptorSet* )descriptor_sets.access_resource( set_index );
 
-        if ( v_descriptor_set ) {
-            // Contains the allocation for all the resources, binding and samplers arrays.
-            rfree( v_descriptor_set->resources, gpu_device->allocator );
-        }
-        descriptor_sets.release_resource( i );
+        // Contains the allocation for all the resources, binding and samplers arrays.
+        rfree( v_descriptor_set->resources, gpu_device->allocator );
+        descriptor_sets.release_resource( set_index );
     }
+
+    descriptor_set_cache.clear();
 }
 
 static const u32 k_descriptor_sets_pool_size = 4096;
@@ -60,7 +63,8 @@ void CommandBuffer::init( GpuDevice* gpu ) {
     };
     VkDescriptorPoolCreateInfo pool_info = {};
     pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    // Sets are never freed one by one, the whole pool is reset with the command buffer.
+    pool_info.flags = 0;
     pool_info.maxSets = k_descriptor_sets_pool_size;
     pool_info.poolSizeCount = ( u32 )ArraySize( pool_sizes );
     pool_info.pPoolSizes = pool_sizes;
@@ -68,6 +72,7 @@ void CommandBuffer::init( GpuDevice* gpu ) {
     RASSERT( result == VK_SUCCESS );
 
     descriptor_sets.init( gpu_device->allocator, k_descriptor_sets_pool_size, sizeof( DescriptorSet ) );
+    descriptor_set_cache.init( gpu_device->allocator, 64 );
 
     reset();
 }
@@ -79,6 +84,7 @@ void CommandBuffer::shutdown() {
     reset();
 
     descriptor_sets.shutdown();
+    descriptor_set_cache.shutdown();
 
     vkDestroyDescriptorPool( gpu_device->vulkan_device, vk_descriptor_pool, gpu_device->vulkan_allocation_callbacks );
 }
@@ -86,7 +92,59 @@ void CommandBuffer::shutdown() {
 DescriptorSetHandle CommandBuffer::create_descriptor_set( const DescriptorSetCreation& creation ) {
     ZoneScoped;
 
-    DescriptorSetHandle handle = gpu_device->create_descriptor_set( creation );
+    const DescriptorSetLayout* descriptor_set_layout = gpu_device->access_descriptor_set_layout( creation.layout );
+    RASSERTM( !descriptor_set_layout->bindless, "Bindless descriptor sets can't be allocated per command buffer." );
+
+    ResourceHandle resources[ k_max_descriptors_per_set ];
+    SamplerHandle samplers[ k_max_descriptors_per_set ];
+    u16 bindings[ k_max_descriptors_per_set ];
+    GpuDevice::sort_descriptor_set_resources( creation, resources, samplers, bindings );
+
+    DescriptorSetKey key;
+    key.resources = resources;
+    key.samplers = ( const u32* )samplers;
+    key.bindings = bindings;
+    key.acceleration_structure = ( u64 )creation.as;
+    key.layout = ( u64 )descriptor_set_layout;
+    key.num_resources = creation.num_resources;
+
+    // Identical sets requested while recording return the same VkDescriptorSet.
+    const u64 key_hash = descriptor_set_key_hash( key );
+    const u32 cached_index = descriptor_set_cache.find( key_hash );
+    if ( cached_index != k_invalid_index ) {
+        const DescriptorSet* cached_descriptor_set = ( const DescriptorSet* )descriptor_sets.access_resource( cached_index );
+
+        if ( descriptor_set_key_equals( key, GpuDevice::get_descriptor_set_key( cached_descriptor_set ) ) ) {
+#if defined(_DEBUG)
+            RASSERTM( cached_descriptor_set->views_hash == gpu_device->get_descriptor_set_views_hash( descriptor_set_layout, key ),
+                      "Descriptor set %u cached in this command buffer references a texture or buffer recreated while recording", cached_index );
+#endif // _DEBUG
+            ++descriptor_set_cache.stats.hits;
+            return { cached_index };
+        }
+
+        ++descriptor_set_cache.stats.collisions;
+    }
+
+    DescriptorSetHandle handle = { descriptor_sets.obtain_resource() };
+    if ( handle.index == k_invalid_index ) {
+        return handle;
+    }
+
+    DescriptorSet* descriptor_set = ( DescriptorSet* )descriptor_sets.access_resource( handle.index );
+    if ( !gpu_device->init_descriptor_set( descriptor_set, vk_descriptor_pool, descriptor_set_layout, key ) ) {
+        rfree( descriptor_set->resources, gpu_device->allocator );
+        descriptor_set->resources = nullptr;
+        descriptor_sets.release_resource( handle.index );
+        return { k_invalid_index };
+    }
+
+    ++descriptor_set_cache.stats.allocations;
+
+    if ( cached_index == k_invalid_index ) {
+        descriptor_set->cache_hash = key_hash;
+        descriptor_set_cache.add( key_hash, handle.index );
+    }
 
     return handle;
 }
@@ -100,6 +158,7 @@ void CommandBuffer::begin() {
         vkBeginCommandBuffer( vk_command_buffer, &beginInfo );
 
         is_recording = true;
+        state_filter.reset();
     }
 }
 
@@ -117,6 +176,7 @@ void CommandBuffer::begin_secondary( RenderPass* current_render_pass_, Framebuff
         vkBeginCommandBuffer( vk_command_buffer, &beginInfo );
 
         is_recording = true;
+        state_filter.reset();
 
         current_render_pass = current_render_pass_;
     }
@@ -162,8 +222,12 @@ void CommandBuffer::bind_pass( RenderPassHandle handle_, FramebufferHandle frame
             if ( gpu_device->dynamic_rendering_extension_present ) {
                 Array<VkRenderingAttachmentInfoKHR> color_attachments_info;
 
-                u64 marker = gpu_device->temporary_allocator->get_marker();
-                color_attachments_info.init( gpu_device->temporary_allocator, framebuffer->num_color_attachments, framebuffer->num_color_attachments );
+                // Passes can be recorded by any task thread, use the scratch memory of the recording thread.
+                ThreadArenaAllocator& thread_allocator = MemoryService::instance()->thread_allocator;
+                StackAllocator* temporary_allocator = thread_index < thread_allocator.num_threads ? thread_allocator.get_scratch( thread_index ) : gpu_device->temporary_allocator;
+
+                u64 marker = temporary_allocator->get_marker();
+                color_attachments_info.init( temporary_allocator, framebuffer->num_color_attachments, framebuffer->num_color_attachments );
                 memset( color_attachments_info.data, 0, sizeof( VkRenderingAttachmentInfoKHR ) * framebuffer->num_color_attachments );
 
                 for ( u32 a = 0; a < framebuffer->num_color_attachments; ++a ) {
@@ -247,7 +311,7 @@ void CommandBuffer::bind_pass( RenderPassHandle handle_, FramebufferHandle frame
 
                 gpu_device->vkCmdBeginRenderingKHR( vk_command_buffer, &rendering_info );
 
-                gpu_device->temporary_allocator->free_marker( marker );
+                temporary_allocator->free_marker( marker );
             } else {
                 VkRenderPassBeginInfo render_pass_begin{ VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
                 render_pass_begin.framebuffer = framebuffer->vk_framebuffer;
@@ -278,7 +342,9 @@ void CommandBuffer::bind_pass( RenderPassHandle handle_, FramebufferHandle frame
 void CommandBuffer::bind_pipeline( PipelineHandle handle_ ) {
 
     Pipeline* pipeline = gpu_device->access_pipeline( handle_ );
-    vkCmdBindPipeline( vk_command_buffer, pipeline->vk_bind_point, pipeline->vk_pipeline );
+    if ( state_filter.bind_pipeline( pipeline->vk_bind_point, ( u64 )pipeline->vk_pipeline, ( u64 )pipeline->vk_pipeline_layout ) ) {
+        vkCmdBindPipeline( vk_command_buffer, pipeline->vk_bind_point, pipeline->vk_pipeline );
+    }
 
     // Cache pipeline
     current_pipeline = pipeline;
@@ -297,12 +363,19 @@ void CommandBuffer::bind_vertex_buffer( BufferHandle handle_, u32 binding, u32 o
         offsets[ 0 ] = buffer->global_offset;
     }
 
+    const u64 filter_buffer = ( u64 )vk_buffer;
+    const u64 filter_offset = offsets[ 0 ];
+    if ( !state_filter.bind_vertex_buffers( binding, 1, &filter_buffer, &filter_offset ) ) {
+        return;
+    }
+
     vkCmdBindVertexBuffers( vk_command_buffer, binding, 1, &vk_buffer, offsets );
 }
 
 void CommandBuffer::bind_vertex_buffers( BufferHandle* handles, u32 first_binding, u32 binding_count, u32* offsets_ ) {
     VkBuffer vk_buffers[ 8 ];
     VkDeviceSize offsets[ 8 ];
+    u64 filter_buffers[ 8 ];
 
     for ( u32 i = 0; i < binding_count; ++i ) {
         Buffer* buffer = gpu_device->access_buffer( handles[i] );
@@ -319,6 +392,11 @@ void CommandBuffer::bind_vertex_buffers( BufferHandle* handles, u32 first_bindin
         }
 
         vk_buffers[ i ] = vk_buffer;
+        filter_buffers[ i ] = ( u64 )vk_buffer;
+    }
+
+    if ( !state_filter.bind_vertex_buffers( first_binding, binding_count, filter_buffers, offsets ) ) {
+        return;
     }
 
     vkCmdBindVertexBuffers( vk_command_buffer, first_binding, binding_count, vk_buffers, offsets );
@@ -335,6 +413,11 @@ void CommandBuffer::bind_index_buffer( BufferHandle handle_, u32 offset_, VkInde
         vk_buffer = parent_buffer->vk_buffer;
         offset = buffer->global_offset;
     }
+
+    if ( !state_filter.bind_index_buffer( ( u64 )vk_buffer, offset, index_type ) ) {
+        return;
+    }
+
     vkCmdBindIndexBuffer( vk_command_buffer, vk_buffer, offset, index_type );
 }
 
@@ -366,6 +449,14 @@ void CommandBuffer::bind_descriptor_set( DescriptorSetHandle* handles, u32 num_l
         }
     }
 
+    if ( num_lists == 1 ) {
+        if ( !state_filter.bind_descriptor_set( ( u64 )vk_descriptor_sets[ 0 ], offsets_cache, num_offsets ) ) {
+            return;
+        }
+    } else {
+        state_filter.invalidate_descriptor_sets();
+    }
+
     const u32 k_first_set = 1;
     vkCmdBindDescriptorSets( vk_command_buffer, current_pipeline->vk_bind_point, current_pipeline->vk_pipeline_layout, k_first_set,
                              num_lists, vk_descriptor_sets, num_offsets, offsets_cache );
@@ -402,6 +493,14 @@ void CommandBuffer::bind_local_descriptor_set( DescriptorSetHandle* handles, u32
         }
     }
 
+    if ( num_lists == 1 ) {
+        if ( !state_filter.bind_descriptor_set( ( u64 )vk_descriptor_sets[ 0 ], offsets_cache, num_offsets ) ) {
+            return;
+        }
+    } else {
+        state_filter.invalidate_descriptor_sets();
+    }
+
     const u32 k_first_set = 1;
     vkCmdBindDescriptorSets( vk_command_buffer, current_pipeline->vk_bind_point, current_pipeline->vk_pipeline_layout, k_first_set,
                              num_lists, vk_descriptor_sets, num_offsets, offsets_cache );
@@ -992,6 +1091,7 @@ void CommandBufferManager::init( GpuDevice* gpu_, u32 num_threads ) {
 
         // TODO(marco): move to have a ring per queue per thread
         current_command_buffer.handle = i;
+        current_command_buffer.thread_index = thread_index;
         current_command_buffer.thread_frame_pool = &gpu->thread_frame_pools[ pool_index ];
         current_command_buffer.init( gpu );
     }
@@ -1012,6 +1112,7 @@ void CommandBufferManager::init( GpuDevice* gpu_, u32 num_threads ) {
             cb.vk_command_buffer = secondary_buffers[ scb_index ];
 
             cb.handle = handle++;
+            cb.thread_index = pool_index % num_pools_per_frame;
             cb.thread_frame_pool = &gpu->thread_frame_pools[ pool_index ];
             cb.init( gpu );
 
@@ -1086,6 +1187,8 @@ CommandBuffer* CommandBufferManager::get_secondary_command_buffer( u32 frame, u3
     RASSERT( current_used_buffer < k_secondary_command_buffers_count );
 
     CommandBuffer* cb = &secondary_command_buffers[ ( pool_index * k_secondary_command_buffers_count ) + current_used_buffer ];
+    // Release the descriptor sets allocated the last time this frame was recorded.
+    cb->reset();
     return cb;
 }
 
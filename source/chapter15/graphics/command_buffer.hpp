@@ -1,5 +1,6 @@
 #pragma once
 
+#include "graphics/command_state_filter.hpp"
 #include "graphics/gpu_device.hpp"
 
 namespace raptor {
@@ -87,8 +88,10 @@ struct CommandBuffer {
 
     VkCommandBuffer                 vk_command_buffer;
 
+    // Per frame and thread descriptor sets, released together when the command buffer is reset.
     VkDescriptorPool                vk_descriptor_pool;
     ResourcePool                    descriptor_sets;
+    DescriptorSetCache              descriptor_set_cache;
 
     GpuThreadFramePools*            thread_frame_pool;
     GpuDevice*                      gpu_device;
@@ -98,10 +101,12 @@ struct CommandBuffer {
     RenderPass*                     current_render_pass;
     Framebuffer*                    current_framebuffer;
     Pipeline*                       current_pipeline;
+    CommandStateFilter              state_filter;       // Drops binds of already bound state.
     VkClearValue                    clear_values[ k_max_image_outputs + 1 ];    // Clear value for each attachment with depth/stencil at the end.
     bool                            is_recording;
 
     u32                             handle;
+    u32                             thread_index;       // Task thread recording the commands.
 
     u32                             current_command;
     ResourceHandle                  resource_handle;
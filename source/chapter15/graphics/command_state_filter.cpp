@@ -0,0 +1,113 @@
+#include "graphics/command_state_filter.hpp"
+
+#include <string.h>
+
+namespace raptor {
+
+// CommandStateFilter /////////////////////////////////////////////////////
+
+void CommandStateFilter::reset() {
+    pipeline = 0;
+    pipeline_layout = 0;
+    bind_point = u32_max;
+
+    invalidate_descriptor_sets();
+
+    valid_vertex_bindings = 0;
+
+    index_buffer = 0;
+    index_offset = 0;
+    index_type = u32_max;
+}
+
+bool CommandStateFilter::bind_pipeline( u32 bind_point_, u64 pipeline_, u64 pipeline_layout_ ) {
+    if ( pipeline_ == pipeline && bind_point_ == bind_point ) {
+        ++stats.pipeline_skipped;
+        return false;
+    }
+
+    // Sets bound with a different layout can be disturbed, do not track compatibility.
+    if ( pipeline_layout_ != pipeline_layout || bind_point_ != bind_point ) {
+        invalidate_descriptor_sets();
+    }
+
+    pipeline = pipeline_;
+    pipeline_layout = pipeline_layout_;
+    bind_point = bind_point_;
+
+    ++stats.pipeline_binds;
+    return true;
+}
+
+bool CommandStateFilter::bind_descriptor_set( u64 descriptor_set_, const u32* dynamic_offsets_, u32 num_dynamic_offsets_ ) {
+    if ( num_dynamic_offsets_ > k_max_filtered_dynamic_offsets ) {
+        invalidate_descriptor_sets();
+        ++stats.descriptor_set_binds;
+        return true;
+    }
+
+    // Offsets can be null when there are none.
+    if ( descriptor_set_ == descriptor_set && num_dynamic_offsets_ == num_dynamic_offsets &&
+         ( num_dynamic_offsets_ == 0 || memcmp( dynamic_offsets_, dynamic_offsets, sizeof( u32 ) * num_dynamic_offsets_ ) == 0 ) ) {
+        ++stats.descriptor_set_skipped;
+        return false;
+    }
+
+    descriptor_set = descriptor_set_;
+    num_dynamic_offsets = num_dynamic_offsets_;
+    if ( num_dynamic_offsets_ ) {
+        memcpy( dynamic_offsets, dynamic_offsets_, sizeof( u32 ) * num_dynamic_offsets_ );
+    }
+
+    ++stats.descriptor_set_binds;
+    return true;
+}
+
+void CommandStateFilter::invalidate_descriptor_sets() {
+    descriptor_set = 0;
+    num_dynamic_offsets = 0;
+}
+
+bool CommandStateFilter::bind_vertex_buffers( u32 first_binding, u32 binding_count, const u64* buffers, const u64* offsets ) {
+    if ( first_binding + binding_count > k_max_filtered_vertex_bindings ) {
+        valid_vertex_bindings = 0;
+        ++stats.vertex_buffer_binds;
+        return true;
+    }
+
+    bool changed = false;
+    for ( u32 i = 0; i < binding_count; ++i ) {
+        const u32 binding = first_binding + i;
+        if ( ( valid_vertex_bindings & ( 1 << binding ) ) == 0 || vertex_buffers[ binding ] != buffers[ i ] || vertex_offsets[ binding ] != offsets[ i ] ) {
+            changed = true;
+        }
+
+        vertex_buffers[ binding ] = buffers[ i ];
+        vertex_offsets[ binding ] = offsets[ i ];
+        valid_vertex_bindings |= 1 << binding;
+    }
+
+    if ( !changed ) {
+        ++stats.vertex_buffer_skipped;
+        return false;
+    }
+
+    ++stats.vertex_buffer_binds;
+    return true;
+}
+
+bool CommandStateFilter::bind_index_buffer( u64 buffer, u64 offset, u32 index_type_ ) {
+    if ( buffer == index_buffer && offset == index_offset && index_type_ == index_type ) {
+        ++stats.index_buffer_skipped;
+        return false;
+    }
+
+    index_buffer = buffer;
+    index_offset = offset;
+    index_type = index_type_;
+
+    ++stats.index_buffer_binds;
+    return true;
+}
+
+} // namespace raptor
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "foundation/platform.hpp"
+
+namespace raptor {
+
+static const u32                    k_max_filtered_vertex_bindings = 8;
+static const u32                    k_max_filtered_dynamic_offsets = 8;
+
+//
+//
+struct CommandStateFilterStats {
+
+    u32                             pipeline_binds          = 0;
+    u32                             pipeline_skipped        = 0;
+    u32                             descriptor_set_binds    = 0;
+    u32                             descriptor_set_skipped  = 0;
+    u32                             vertex_buffer_binds     = 0;
+    u32                             vertex_buffer_skipped   = 0;
+    u32                             index_buffer_binds      = 0;
+    u32                             index_buffer_skipped    = 0;
+
+}; // struct CommandStateFilterStats
+
+//
+// Tracks the state bound in a command buffer, to drop binds of the state that is already bound.
+// Each method returns true when the bind has to be recorded. Handles are the Vulkan ones, as different
+// resources can share them (e.g. sub-allocated buffers).
+struct CommandStateFilter {
+
+    // State is unknown, e.g. a new recording started.
+    void                            reset();
+
+    bool                            bind_pipeline( u32 bind_point, u64 pipeline, u64 pipeline_layout );
+    // A single set with its dynamic offsets, bound at the first set index.
+    bool                            bind_descriptor_set( u64 descriptor_set, const u32* dynamic_offsets, u32 num_dynamic_offsets );
+    // Anything else bound outside of the filter, e.g. multiple sets.
+    void                            invalidate_descriptor_sets();
+    bool                            bind_vertex_buffers( u32 first_binding, u32 binding_count, const u64* buffers, const u64* offsets );
+    bool                            bind_index_buffer( u64 buffer, u64 offset, u32 index_type );
+
+    u64                             pipeline                = 0;
+    u64                             pipeline_layout         = 0;
+    u32                             bind_point              = u32_max;
+
+    u64                             descriptor_set          = 0;
+    u32                             dynamic_offsets[ k_max_filtered_dynamic_offsets ];
+    u32                             num_dynamic_offsets     = 0;
+
+    u64                             vertex_buffers[ k_max_filtered_vertex_bindings ];
+    u64                             vertex_offsets[ k_max_filtered_vertex_bindings ];
+    u32                             valid_vertex_bindings   = 0;        // Bitmask
+
+    u64                             index_buffer            = 0;
+    u64                             index_offset            = 0;
+    u32                             index_type              = u32_max;
+
+    CommandStateFilterStats         stats;
+
+}; // struct CommandStateFilter
+
+} // namespace raptor
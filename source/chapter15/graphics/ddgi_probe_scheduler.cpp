@@ -0,0 +1,365 @@
+#include "graphics/ddgi_probe_scheduler.hpp"
+
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+
+#include "external/cglm/struct/vec3.h"
+
+#include <float.h>
+#include <stdlib.h>
+
+namespace raptor {
+
+// Probes that were never traced are scheduled before any other.
+static const f32                    k_ddgi_uninitialized_priority   = 1e30f;
+
+static void probe_heap_sift_down( u32* probes, f32* priorities, u32 heap_size, u32 parent ) {
+    const u32 probe = probes[ parent ];
+    const f32 priority = priorities[ parent ];
+
+    for ( ;; ) {
+        u32 child = parent * 2 + 1;
+        if ( child >= heap_size ) {
+            break;
+        }
+        if ( child + 1 < heap_size && priorities[ child + 1 ] < priorities[ child ] ) {
+            ++child;
+        }
+        if ( priority <= priorities[ child ] ) {
+            break;
+        }
+        probes[ parent ] = probes[ child ];
+        priorities[ parent ] = priorities[ child ];
+        parent = child;
+    }
+
+    probes[ parent ] = probe;
+    priorities[ parent ] = priority;
+}
+
+static f32 probe_luminance( vec3s color ) {
+    return color.x * 0.2126f + color.y * 0.7152f + color.z * 0.0722f;
+}
+
+// DDGIProbeScheduler /////////////////////////////////////////////////////
+void DDGIProbeScheduler::init( Allocator* allocator, u32 probe_count_x_, u32 probe_count_y_, u32 probe_count_z_ ) {
+    probe_count_x = probe_count_x_;
+    probe_count_y = probe_count_y_;
+    probe_count_z = probe_count_z_;
+
+    const u32 num_probes = get_total_probes();
+    probes.init( allocator, num_probes, num_probes );
+    update_list.init( allocator, num_probes );
+    schedule_priorities.init( allocator, num_probes );
+
+    grid_position = vec3s{ 0, 0, 0 };
+    probe_spacing = vec3s{ 1, 1, 1 };
+
+    reset();
+}
+
+void DDGIProbeScheduler::shutdown() {
+    probes.shutdown();
+    update_list.shutdown();
+    schedule_priorities.shutdown();
+}
+
+void DDGIProbeScheduler::set_grid( vec3s grid_position_, vec3s probe_spacing_, f32 max_probe_offset_, f32 self_shadow_bias_ ) {
+    const bool moved = !glms_vec3_eqv( grid_position, grid_position_ ) || !glms_vec3_eqv( probe_spacing, probe_spacing_ );
+
+    grid_position = grid_position_;
+    probe_spacing = probe_spacing_;
+    max_probe_offset = max_probe_offset_;
+    self_shadow_bias = self_shadow_bias_;
+
+    // Offsets and statuses belong to the previous positions.
+    if ( moved ) {
+        reset();
+    }
+}
+
+void DDGIProbeScheduler::reset() {
+    for ( u32 i = 0; i < probes.size; ++i ) {
+        DDGIProbeState& probe = probes[ i ];
+        probe.offset = vec3s{ 0, 0, 0 };
+        probe.variance = 0.f;
+        probe.irradiance = vec3s{ 0, 0, 0 };
+        probe.priority = 0.f;
+        probe.last_update_frame = 0;
+        probe.updates = 0;
+        probe.status = DDGIProbeStatus::Uninitialized;
+    }
+
+    update_list.clear();
+}
+
+vec3s DDGIProbeScheduler::probe_grid_indices( u32 probe_index ) const {
+    const u32 probe_counts_xy = probe_count_x * probe_count_y;
+    return vec3s{ ( f32 )( probe_index % probe_count_x ), ( f32 )( ( probe_index % probe_counts_xy ) / probe_count_x ), ( f32 )( probe_index / probe_counts_xy ) };
+}
+
+vec3s DDGIProbeScheduler::probe_position( u32 probe_index ) const {
+    const vec3s grid_indices = probe_grid_indices( probe_index );
+    return glms_vec3_add( glms_vec3_add( glms_vec3_mul( grid_indices, probe_spacing ), grid_position ), probes[ probe_index ].offset );
+}
+
+DDGIProbeStatus::Enum DDGIProbeScheduler::classify_probe( u32 probe_index, const f32* ray_distances, const vec3s* ray_directions, u32 num_rays ) {
+    // Worst case, view and normal contribute in the same direction, so need 2x self-shadow bias.
+    const vec3s spacing = glms_vec3_abs( probe_spacing );
+    const vec3s outer_bounds = glms_vec3_scale( glms_vec3_normalize( spacing ), glms_vec3_norm( spacing ) + 2.0f * self_shadow_bias );
+
+    u32 backfaces_count = 0;
+    f32 closest_frontface_distance = FLT_MAX;
+    bool shades_surface = false;
+
+    for ( u32 ray_index = 0; ray_index < num_rays; ++ray_index ) {
+        const f32 distance = ray_distances[ ray_index ];
+        if ( distance <= 0.f ) {
+            ++backfaces_count;
+            continue;
+        }
+
+        const vec3s hit = glms_vec3_scale( ray_directions[ ray_index ], distance );
+        shades_surface |= fabsf( hit.x ) < outer_bounds.x && fabsf( hit.y ) < outer_bounds.y && fabsf( hit.z ) < outer_bounds.z;
+        closest_frontface_distance = raptor::min( closest_frontface_distance, distance );
+    }
+
+    DDGIProbeStatus::Enum status = DDGIProbeStatus::Inactive;
+    if ( backfaces_count && ( f32 )backfaces_count > backface_ratio * num_rays ) {
+        // Inside geometry.
+        status = DDGIProbeStatus::Off;
+    } else if ( closest_frontface_distance == FLT_MAX ) {
+        // Only backfaces and sky.
+        status = DDGIProbeStatus::Off;
+    } else if ( shades_surface || closest_frontface_distance < close_frontface_distance ) {
+        status = DDGIProbeStatus::Active;
+    }
+
+    probes[ probe_index ].status = status;
+    return status;
+}
+
+void DDGIProbeScheduler::relocate_probe( u32 probe_index, const f32* ray_distances, const vec3s* ray_directions, u32 num_rays ) {
+    u32 backfaces_count = 0;
+    u32 closest_backface_index = u32_max;
+    f32 closest_backface_distance = FLT_MAX;
+    u32 closest_frontface_index = u32_max;
+    f32 closest_frontface_distance = FLT_MAX;
+    u32 farthest_frontface_index = u32_max;
+    f32 farthest_frontface_distance = 0.f;
+
+    for ( u32 ray_index = 0; ray_index < num_rays; ++ray_index ) {
+        const f32 distance = ray_distances[ ray_index ];
+        if ( distance <= 0.f ) {
+            ++backfaces_count;
+            if ( -distance < closest_backface_distance ) {
+                closest_backface_distance = -distance;
+                closest_backface_index = ray_index;
+            }
+            continue;
+        }
+
+        if ( distance < closest_frontface_distance ) {
+            closest_frontface_distance = distance;
+            closest_frontface_index = ray_index;
+        }
+        if ( distance > farthest_frontface_distance ) {
+            farthest_frontface_distance = distance;
+            farthest_frontface_index = ray_index;
+        }
+    }
+
+    DDGIProbeState& probe = probes[ probe_index ];
+    const vec3s cell_offset_limit = glms_vec3_scale( glms_vec3_abs( probe_spacing ), max_probe_offset );
+    vec3s full_offset = probe.offset;
+    bool move = false;
+
+    if ( closest_backface_index != u32_max && ( f32 )backfaces_count > backface_ratio * num_rays ) {
+        // Inside geometry: cross the closest backface, as far as the cell allows.
+        const vec3s direction = ray_directions[ closest_backface_index ];
+        f32 max_distance = FLT_MAX;
+        for ( u32 axis = 0; axis < 3; ++axis ) {
+            if ( direction.raw[ axis ] != 0.f ) {
+                const f32 limit = direction.raw[ axis ] > 0.f ? cell_offset_limit.raw[ axis ] : -cell_offset_limit.raw[ axis ];
+                max_distance = raptor::min( max_distance, ( limit - probe.offset.raw[ axis ] ) / direction.raw[ axis ] );
+            }
+        }
+
+        const f32 distance = raptor::min( closest_backface_distance + close_frontface_distance, max_distance - 0.001f );
+        if ( distance > 0.f ) {
+            full_offset = glms_vec3_add( probe.offset, glms_vec3_scale( direction, distance ) );
+            move = true;
+        }
+    } else if ( closest_frontface_index != u32_max && closest_frontface_distance < close_frontface_distance ) {
+        // Too close to a surface: move toward the farthest one, unless it is the same surface.
+        const vec3s farthest_direction = ray_directions[ farthest_frontface_index ];
+        if ( glms_vec3_dot( farthest_direction, ray_directions[ closest_frontface_index ] ) < 0.5f ) {
+            full_offset = glms_vec3_add( probe.offset, glms_vec3_scale( farthest_direction, raptor::min( 0.2f, farthest_frontface_distance ) ) );
+            move = true;
+        }
+    }
+
+    // Probes never leave their cell.
+    if ( move && fabsf( full_offset.x ) < cell_offset_limit.x && fabsf( full_offset.y ) < cell_offset_limit.y && fabsf( full_offset.z ) < cell_offset_limit.z ) {
+        probe.offset = full_offset;
+    }
+}
+
+void DDGIProbeScheduler::report_irradiance( u32 probe_index, vec3s irradiance ) {
+    DDGIProbeState& probe = probes[ probe_index ];
+
+    // The variance already decayed when the probe was scheduled.
+    const f32 change = probe_luminance( glms_vec3_sub( irradiance, probe.irradiance ) );
+    probe.variance += change * change * ( 1.f - variance_hysteresis );
+    probe.irradiance = irradiance;
+}
+
+void DDGIProbeScheduler::invalidate_sphere( vec4s world_sphere ) {
+    if ( probes.size == 0 ) {
+        return;
+    }
+
+    // Grid range of the bounding box of the sphere.
+    const vec3s center = vec3s{ world_sphere.x, world_sphere.y, world_sphere.z };
+    const u32 probe_counts[ 3 ] = { probe_count_x, probe_count_y, probe_count_z };
+    u32 first[ 3 ], last[ 3 ];
+    for ( u32 axis = 0; axis < 3; ++axis ) {
+        const f32 spacing = probe_spacing.raw[ axis ];
+        if ( spacing == 0.f ) {
+            first[ axis ] = 0;
+            last[ axis ] = probe_counts[ axis ] - 1;
+            continue;
+        }
+
+        f32 low = ( center.raw[ axis ] - world_sphere.w - grid_position.raw[ axis ] ) / spacing;
+        f32 high = ( center.raw[ axis ] + world_sphere.w - grid_position.raw[ axis ] ) / spacing;
+        if ( low > high ) {
+            const f32 temp = low;
+            low = high;
+            high = temp;
+        }
+        // Offsets move probes by less than a cell.
+        low = floorf( low ) - 1.f;
+        high = ceilf( high ) + 1.f;
+        if ( high < 0.f || low > ( f32 )( probe_counts[ axis ] - 1 ) ) {
+            return;
+        }
+        first[ axis ] = ( u32 )raptor::max( low, 0.f );
+        last[ axis ] = ( u32 )raptor::min( high, ( f32 )( probe_counts[ axis ] - 1 ) );
+    }
+
+    const f32 radius2 = world_sphere.w * world_sphere.w;
+    for ( u32 z = first[ 2 ]; z <= last[ 2 ]; ++z ) {
+        for ( u32 y = first[ 1 ]; y <= last[ 1 ]; ++y ) {
+            for ( u32 x = first[ 0 ]; x <= last[ 0 ]; ++x ) {
+                const u32 probe_index = x + y * probe_count_x + z * probe_count_x * probe_count_y;
+                if ( glms_vec3_distance2( probe_position( probe_index ), center ) <= radius2 ) {
+                    probes[ probe_index ].variance = raptor::max( probes[ probe_index ].variance, change_variance );
+                }
+            }
+        }
+    }
+}
+
+void DDGIProbeScheduler::schedule( vec3s camera_position, u32 ray_budget, u32 rays_per_probe ) {
+    ++frame;
+
+    stats = DDGIProbeSchedulerStats{};
+
+    const u32 num_probes = probes.size;
+    const u32 budget_probes = raptor::min( rays_per_probe ? ray_budget / rays_per_probe : 0, num_probes );
+    stats.budget_probes = budget_probes;
+
+    // Min heap of the highest priorities found so far.
+    schedule_priorities.set_size( budget_probes );
+    update_list.set_size( budget_probes );
+    u32* heap_probes = update_list.data;
+    f32* heap_priorities = schedule_priorities.data;
+    u32 heap_size = 0;
+
+    for ( u32 probe_index = 0; probe_index < num_probes; ++probe_index ) {
+        DDGIProbeState& probe = probes[ probe_index ];
+        const u32 age = frame - probe.last_update_frame;
+
+        const f32 distance_factor = 1.f / ( 1.f + distance_weight * glms_vec3_distance2( probe_position( probe_index ), camera_position ) );
+        f32 priority = 0.f;
+
+        switch ( probe.status ) {
+            case DDGIProbeStatus::Off:
+            {
+                ++stats.off_probes;
+                priority = age >= off_recheck_frames ? age_weight * age * distance_factor : 0.f;
+                break;
+            }
+
+            case DDGIProbeStatus::Inactive:
+            {
+                ++stats.inactive_probes;
+                priority = age * ( age_weight + variance_weight * probe.variance ) * distance_factor * inactive_weight;
+                break;
+            }
+
+            case DDGIProbeStatus::Active:
+            case DDGIProbeStatus::Uninitialized:
+            {
+                if ( probe.status == DDGIProbeStatus::Active ) {
+                    ++stats.active_probes;
+                    stats.max_age = raptor::max( stats.max_age, age );
+                } else {
+                    ++stats.uninitialized_probes;
+                }
+
+                // Without classification, probes that were traced once are handled as active.
+                priority = probe.updates == 0 ? k_ddgi_uninitialized_priority * distance_factor
+                                              : age * ( age_weight + variance_weight * probe.variance ) * distance_factor;
+                break;
+            }
+        }
+
+        stats.max_variance = raptor::max( stats.max_variance, probe.variance );
+        probe.priority = priority;
+
+        if ( priority <= 0.f ) {
+            continue;
+        }
+
+        if ( heap_size < budget_probes ) {
+            u32 child = heap_size++;
+            while ( child > 0 ) {
+                const u32 parent = ( child - 1 ) / 2;
+                if ( heap_priorities[ parent ] <= priority ) {
+                    break;
+                }
+                heap_probes[ child ] = heap_probes[ parent ];
+                heap_priorities[ child ] = heap_priorities[ parent ];
+                child = parent;
+            }
+            heap_probes[ child ] = probe_index;
+            heap_priorities[ child ] = priority;
+        } else if ( heap_size && priority > heap_priorities[ 0 ] ) {
+            heap_probes[ 0 ] = probe_index;
+            heap_priorities[ 0 ] = priority;
+            probe_heap_sift_down( heap_probes, heap_priorities, heap_size, 0 );
+        }
+    }
+
+    for ( u32 i = 0; i < heap_size; ++i ) {
+        DDGIProbeState& probe = probes[ heap_probes[ i ] ];
+        probe.last_update_frame = frame;
+        probe.variance *= variance_hysteresis;
+        ++probe.updates;
+    }
+
+    // Rebuilt in index order, so that consecutive rays read neighbouring probes.
+    update_list.clear();
+    for ( u32 probe_index = 0; probe_index < num_probes && update_list.size < heap_size; ++probe_index ) {
+        if ( probes[ probe_index ].last_update_frame == frame ) {
+            update_list.push( probe_index );
+        }
+    }
+
+    stats.scheduled_probes = update_list.size;
+    stats.scheduled_rays = update_list.size * rays_per_probe;
+}
+
+} // namespace raptor
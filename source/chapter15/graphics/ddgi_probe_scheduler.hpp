@@ -0,0 +1,117 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/platform.hpp"
+
+#include "external/cglm/types-struct.h"
+
+namespace raptor {
+
+struct Allocator;
+
+// Same values as PROBE_STATUS_* in ddgi.h.
+namespace DDGIProbeStatus {
+    enum Enum : u8 {
+        Off = 0, Inactive = 1, Active = 4, Uninitialized = 6
+    };
+} // namespace DDGIProbeStatus
+
+//
+//
+struct DDGIProbeState {
+
+    vec3s                           offset;                 // Relocation inside the cell, in world units.
+    f32                             variance;               // Running average of the squared irradiance changes.
+
+    vec3s                           irradiance;             // Last reported.
+    f32                             priority;
+
+    u32                             last_update_frame;
+    u32                             updates;
+    DDGIProbeStatus::Enum           status;
+
+}; // struct DDGIProbeState
+
+//
+//
+struct DDGIProbeSchedulerStats {
+
+    u32                             scheduled_probes        = 0;
+    u32                             scheduled_rays          = 0;
+    u32                             budget_probes           = 0;
+
+    u32                             off_probes              = 0;
+    u32                             inactive_probes         = 0;
+    u32                             active_probes           = 0;
+    u32                             uninitialized_probes    = 0;
+
+    u32                             max_age                 = 0;    // Frames since the update of the oldest active probe.
+    f32                             max_variance            = 0.f;
+
+}; // struct DDGIProbeSchedulerStats
+
+//
+// CPU side of the DDGI probe management: classifies probes from their traced rays, moves them out of walls and
+// selects which probes get traced each frame inside a ray budget.
+// Classification and relocation follow the calculate_probe_statuses and calculate_probe_offsets shaders, except
+// that probes seeing no surface in their shading range are Inactive instead of keeping their previous status.
+// Priority grows with the irradiance variance and with the frames since the last update, and decreases with the
+// squared distance to the camera. Probes never traced come first, Off probes are only traced again after
+// off_recheck_frames in case the geometry around them moved.
+struct DDGIProbeScheduler {
+
+    void                            init( Allocator* allocator, u32 probe_count_x, u32 probe_count_y, u32 probe_count_z );
+    void                            shutdown();
+
+    void                            set_grid( vec3s grid_position, vec3s probe_spacing, f32 max_probe_offset, f32 self_shadow_bias );
+    void                            reset();
+
+    u32                             get_total_probes() const        { return probe_count_x * probe_count_y * probe_count_z; }
+
+    vec3s                           probe_grid_indices( u32 probe_index ) const;
+    vec3s                           probe_position( u32 probe_index ) const;        // Including the offset.
+
+    // Ray distances are negative for backfaces, as stored by the raytracing hit shader, directions are normalized.
+    DDGIProbeStatus::Enum           classify_probe( u32 probe_index, const f32* ray_distances, const vec3s* ray_directions, u32 num_rays );
+    void                            relocate_probe( u32 probe_index, const f32* ray_distances, const vec3s* ray_directions, u32 num_rays );
+
+    // Variance decays each time a probe is scheduled, reported irradiance changes raise it again.
+    void                            report_irradiance( u32 probe_index, vec3s irradiance );
+    // Raises the variance of the probes near a change in the scene, as a light moving, to at least change_variance.
+    void                            invalidate_sphere( vec4s world_sphere );
+
+    // Fills update_list with the probes to trace this frame, in increasing index order.
+    void                            schedule( vec3s camera_position, u32 ray_budget, u32 rays_per_probe );
+
+    Array<DDGIProbeState>           probes;
+    Array<u32>                      update_list;
+    Array<f32>                      schedule_priorities;    // Scratch of schedule.
+
+    DDGIProbeSchedulerStats         stats;
+
+    vec3s                           grid_position;
+    vec3s                           probe_spacing;
+    f32                             max_probe_offset        = 0.4f;
+    f32                             self_shadow_bias        = 0.3f;
+
+    u32                             probe_count_x           = 0;
+    u32                             probe_count_y           = 0;
+    u32                             probe_count_z           = 0;
+    u32                             frame                   = 0;
+
+    // Classification
+    f32                             backface_ratio          = 0.25f;    // Over it the probe is inside geometry.
+    f32                             close_frontface_distance = 0.05f;
+
+    // Scheduling
+    f32                             variance_hysteresis     = 0.9f;
+    f32                             change_variance         = 0.05f;
+    f32                             variance_weight         = 16.f;
+    f32                             age_weight              = 0.01f;
+    f32                             distance_weight         = 0.01f;    // Per squared world unit.
+    f32                             inactive_weight         = 0.1f;
+    u32                             off_recheck_frames      = 300;
+
+}; // struct DDGIProbeScheduler
+
+} // namespace raptor
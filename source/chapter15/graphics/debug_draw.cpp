@@ -0,0 +1,428 @@
+#include "graphics/debug_draw.hpp"
+
+#include "foundation/assert.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+
+#include <math.h>
+#include <new>
+#include <string.h>
+
+#if defined( _M_X64 ) || defined( __x86_64__ )
+    // SSE2 is part of x64, no runtime check needed.
+    #define RAPTOR_DEBUG_DRAW_SSE
+    #include <emmintrin.h>
+#endif
+
+namespace raptor {
+
+static_assert( sizeof( DebugLineVertex ) == 16, "DebugLineVertex must match the debug_line_cpu vertex input" );
+static_assert( sizeof( DebugLineCommand ) == 32, "DebugLineCommand must match the debug_line_cpu instance stride" );
+static_assert( sizeof( DebugAabbCommand ) == 32, "DebugAabbCommand is loaded as two 16 bytes registers" );
+static_assert( k_debug_draw_sphere_segments % 4 == 0, "Sphere segments are expanded 4 at a time" );
+
+// Corner of the box as bits: x 1, y 2, z 4. Same edges as the previous DebugRenderer::aabb.
+static const u8                     k_aabb_edges[ k_debug_draw_lines_per_aabb ][ 2 ] = {
+    { 0, 2 }, { 2, 3 }, { 3, 1 }, { 1, 0 },
+    { 0, 4 }, { 2, 6 }, { 3, 7 }, { 1, 5 },
+    { 4, 6 }, { 6, 7 }, { 7, 5 }, { 5, 4 }
+};
+
+static void debug_draw_set_vertex( DebugLineVertex& vertex, f32 x, f32 y, f32 z, u32 color ) {
+    vertex.position = { x, y, z };
+    vertex.color = color;
+}
+
+static void debug_draw_expand_aabbs_scalar( const DebugAabbCommand* aabbs, u32 count, DebugLineVertex* out_vertices ) {
+    for ( u32 a = 0; a < count; ++a ) {
+        const DebugAabbCommand& aabb = aabbs[ a ];
+
+        DebugLineVertex corners[ 8 ];
+        for ( u32 c = 0; c < 8; ++c ) {
+            debug_draw_set_vertex( corners[ c ], ( c & 1 ) ? aabb.max.x : aabb.min.x, ( c & 2 ) ? aabb.max.y : aabb.min.y,
+                                   ( c & 4 ) ? aabb.max.z : aabb.min.z, aabb.color );
+        }
+
+        for ( u32 e = 0; e < k_debug_draw_lines_per_aabb; ++e ) {
+            *out_vertices++ = corners[ k_aabb_edges[ e ][ 0 ] ];
+            *out_vertices++ = corners[ k_aabb_edges[ e ][ 1 ] ];
+        }
+    }
+}
+
+// Angles of the sphere segments, with the first repeated at the end to close the circles.
+static void debug_draw_sphere_table( f32* cosines, f32* sines ) {
+    for ( u32 s = 0; s <= k_debug_draw_sphere_segments; ++s ) {
+        const f32 angle = ( s % k_debug_draw_sphere_segments ) * ( 2.f * 3.14159265358979f / k_debug_draw_sphere_segments );
+        cosines[ s ] = cosf( angle );
+        sines[ s ] = sinf( angle );
+    }
+}
+
+static void debug_draw_expand_spheres_scalar( const DebugSphereCommand* spheres, u32 count, DebugLineVertex* out_vertices ) {
+    f32 cosines[ k_debug_draw_sphere_segments + 1 ];
+    f32 sines[ k_debug_draw_sphere_segments + 1 ];
+    debug_draw_sphere_table( cosines, sines );
+
+    for ( u32 i = 0; i < count; ++i ) {
+        const DebugSphereCommand& sphere = spheres[ i ];
+        const f32 cx = sphere.center.x;
+        const f32 cy = sphere.center.y;
+        const f32 cz = sphere.center.z;
+        const f32 r = sphere.radius;
+
+        // XY, XZ and YZ circles.
+        for ( u32 plane = 0; plane < 3; ++plane ) {
+            for ( u32 s = 0; s < k_debug_draw_sphere_segments; ++s ) {
+                for ( u32 v = 0; v < 2; ++v ) {
+                    const f32 u = cx + r * cosines[ s + v ];
+                    const f32 w = cy + r * sines[ s + v ];
+                    const f32 ry = cy + r * cosines[ s + v ];
+                    const f32 rz = cz + r * sines[ s + v ];
+
+                    DebugLineVertex& vertex = *out_vertices++;
+                    if ( plane == 0 ) {
+                        debug_draw_set_vertex( vertex, u, w, cz, sphere.color );
+                    } else if ( plane == 1 ) {
+                        debug_draw_set_vertex( vertex, u, cy, rz, sphere.color );
+                    } else {
+                        debug_draw_set_vertex( vertex, cx, ry, rz, sphere.color );
+                    }
+                }
+            }
+        }
+    }
+}
+
+#if defined( RAPTOR_DEBUG_DRAW_SSE )
+
+// Corners are selected lane by lane between min and max, the color lane always comes from min.
+static void debug_draw_expand_aabbs_sse( const DebugAabbCommand* aabbs, u32 count, DebugLineVertex* out_vertices ) {
+    __m128 corner_masks[ 8 ];
+    for ( u32 c = 0; c < 8; ++c ) {
+        corner_masks[ c ] = _mm_castsi128_ps( _mm_setr_epi32( ( c & 1 ) ? -1 : 0, ( c & 2 ) ? -1 : 0, ( c & 4 ) ? -1 : 0, 0 ) );
+    }
+
+    f32* out = ( f32* )out_vertices;
+    for ( u32 a = 0; a < count; ++a ) {
+        const __m128 min = _mm_loadu_ps( &aabbs[ a ].min.x );
+        const __m128 max = _mm_loadu_ps( &aabbs[ a ].max.x );
+
+        __m128 corners[ 8 ];
+        for ( u32 c = 0; c < 8; ++c ) {
+            corners[ c ] = _mm_or_ps( _mm_andnot_ps( corner_masks[ c ], min ), _mm_and_ps( corner_masks[ c ], max ) );
+        }
+
+        for ( u32 e = 0; e < k_debug_draw_lines_per_aabb; ++e ) {
+            _mm_storeu_ps( out, corners[ k_aabb_edges[ e ][ 0 ] ] );
+            _mm_storeu_ps( out + 4, corners[ k_aabb_edges[ e ][ 1 ] ] );
+            out += 8;
+        }
+    }
+}
+
+// Stores the lines of 4 consecutive segments, given the x, y, z lanes of their start and end points.
+static f32* debug_draw_store_segments( f32* out, __m128 start_x, __m128 start_y, __m128 start_z, __m128 end_x, __m128 end_y, __m128 end_z, __m128 color ) {
+    __m128 start_color = color;
+    __m128 end_color = color;
+    _MM_TRANSPOSE4_PS( start_x, start_y, start_z, start_color );
+    _MM_TRANSPOSE4_PS( end_x, end_y, end_z, end_color );
+
+    _mm_storeu_ps( out, start_x );
+    _mm_storeu_ps( out + 4, end_x );
+    _mm_storeu_ps( out + 8, start_y );
+    _mm_storeu_ps( out + 12, end_y );
+    _mm_storeu_ps( out + 16, start_z );
+    _mm_storeu_ps( out + 20, end_z );
+    _mm_storeu_ps( out + 24, start_color );
+    _mm_storeu_ps( out + 28, end_color );
+    return out + 32;
+}
+
+static void debug_draw_expand_spheres_sse( const DebugSphereCommand* spheres, u32 count, DebugLineVertex* out_vertices ) {
+    f32 cosines[ k_debug_draw_sphere_segments + 1 ];
+    f32 sines[ k_debug_draw_sphere_segments + 1 ];
+    debug_draw_sphere_table( cosines, sines );
+
+    f32* out = ( f32* )out_vertices;
+    for ( u32 i = 0; i < count; ++i ) {
+        const DebugSphereCommand& sphere = spheres[ i ];
+        const __m128 cx = _mm_set1_ps( sphere.center.x );
+        const __m128 cy = _mm_set1_ps( sphere.center.y );
+        const __m128 cz = _mm_set1_ps( sphere.center.z );
+        const __m128 r = _mm_set1_ps( sphere.radius );
+        const __m128 color = _mm_castsi128_ps( _mm_set1_epi32( ( int )sphere.color ) );
+
+        // Cosines and sines of the start and end of the segments, scaled by the radius.
+        __m128 start_cos[ k_debug_draw_sphere_segments / 4 ], start_sin[ k_debug_draw_sphere_segments / 4 ];
+        __m128 end_cos[ k_debug_draw_sphere_segments / 4 ], end_sin[ k_debug_draw_sphere_segments / 4 ];
+        for ( u32 g = 0; g < k_debug_draw_sphere_segments / 4; ++g ) {
+            start_cos[ g ] = _mm_mul_ps( r, _mm_loadu_ps( cosines + g * 4 ) );
+            start_sin[ g ] = _mm_mul_ps( r, _mm_loadu_ps( sines + g * 4 ) );
+            end_cos[ g ] = _mm_mul_ps( r, _mm_loadu_ps( cosines + g * 4 + 1 ) );
+            end_sin[ g ] = _mm_mul_ps( r, _mm_loadu_ps( sines + g * 4 + 1 ) );
+        }
+
+        for ( u32 g = 0; g < k_debug_draw_sphere_segments / 4; ++g ) {
+            out = debug_draw_store_segments( out, _mm_add_ps( cx, start_cos[ g ] ), _mm_add_ps( cy, start_sin[ g ] ), cz,
+                                             _mm_add_ps( cx, end_cos[ g ] ), _mm_add_ps( cy, end_sin[ g ] ), cz, color );
+        }
+        for ( u32 g = 0; g < k_debug_draw_sphere_segments / 4; ++g ) {
+            out = debug_draw_store_segments( out, _mm_add_ps( cx, start_cos[ g ] ), cy, _mm_add_ps( cz, start_sin[ g ] ),
+                                             _mm_add_ps( cx, end_cos[ g ] ), cy, _mm_add_ps( cz, end_sin[ g ] ), color );
+        }
+        for ( u32 g = 0; g < k_debug_draw_sphere_segments / 4; ++g ) {
+            out = debug_draw_store_segments( out, cx, _mm_add_ps( cy, start_cos[ g ] ), _mm_add_ps( cz, start_sin[ g ] ),
+                                             cx, _mm_add_ps( cy, end_cos[ g ] ), _mm_add_ps( cz, end_sin[ g ] ), color );
+        }
+    }
+}
+
+#endif // RAPTOR_DEBUG_DRAW_SSE
+
+void debug_draw_expand_aabbs( const DebugAabbCommand* aabbs, u32 count, DebugLineVertex* out_vertices, bool use_simd ) {
+#if defined( RAPTOR_DEBUG_DRAW_SSE )
+    if ( use_simd ) {
+        debug_draw_expand_aabbs_sse( aabbs, count, out_vertices );
+        return;
+    }
+#endif // RAPTOR_DEBUG_DRAW_SSE
+    debug_draw_expand_aabbs_scalar( aabbs, count, out_vertices );
+}
+
+void debug_draw_expand_spheres( const DebugSphereCommand* spheres, u32 count, DebugLineVertex* out_vertices, bool use_simd ) {
+#if defined( RAPTOR_DEBUG_DRAW_SSE )
+    if ( use_simd ) {
+        debug_draw_expand_spheres_sse( spheres, count, out_vertices );
+        return;
+    }
+#endif // RAPTOR_DEBUG_DRAW_SSE
+    debug_draw_expand_spheres_scalar( spheres, count, out_vertices );
+}
+
+// DebugDraw //////////////////////////////////////////////////////////////
+void DebugDraw::init( Allocator* allocator_, u32 num_threads_, u32 max_lines, u32 max_aabbs, u32 max_spheres, u32 max_lines_2d ) {
+    RASSERT( num_threads_ > 0 && num_threads_ <= k_debug_draw_max_threads );
+
+    allocator = allocator_;
+    num_threads = num_threads_;
+
+    thread_commands = ( DebugDrawThreadCommands* )allocator->allocate( sizeof( DebugDrawThreadCommands ) * num_threads, alignof( DebugDrawThreadCommands ) );
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        DebugDrawThreadCommands* commands = new ( &thread_commands[ t ] ) DebugDrawThreadCommands();
+        commands->lines.init( allocator, max_lines );
+        commands->aabbs.init( allocator, max_aabbs );
+        commands->spheres.init( allocator, max_spheres );
+        commands->lines_2d.init( allocator, max_lines_2d );
+    }
+}
+
+void DebugDraw::shutdown() {
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        DebugDrawThreadCommands& commands = thread_commands[ t ];
+        commands.lines.shutdown();
+        commands.aabbs.shutdown();
+        commands.spheres.shutdown();
+        commands.lines_2d.shutdown();
+    }
+
+    allocator->deallocate( thread_commands );
+    thread_commands = nullptr;
+}
+
+void DebugDraw::line( u32 thread_index, const vec3s& from, const vec3s& to, Color color0, Color color1 ) {
+    RASSERT( thread_index < num_threads );
+    DebugDrawThreadCommands& commands = thread_commands[ thread_index ];
+    if ( commands.lines.size == commands.lines.capacity ) {
+        ++commands.dropped;
+        return;
+    }
+
+    DebugLineCommand& command = commands.lines.push_use();
+    command.from = { from, color0.abgr };
+    command.to = { to, color1.abgr };
+}
+
+void DebugDraw::line_2d( u32 thread_index, const vec2s& from, const vec2s& to, Color color ) {
+    RASSERT( thread_index < num_threads );
+    DebugDrawThreadCommands& commands = thread_commands[ thread_index ];
+    if ( commands.lines_2d.size == commands.lines_2d.capacity ) {
+        ++commands.dropped;
+        return;
+    }
+
+    DebugLineCommand& command = commands.lines_2d.push_use();
+    command.from = { { from.x, from.y, 0.f }, color.abgr };
+    command.to = { { to.x, to.y, 0.f }, color.abgr };
+}
+
+void DebugDraw::aabb( u32 thread_index, const vec3s& min, const vec3s& max, Color color ) {
+    RASSERT( thread_index < num_threads );
+    DebugDrawThreadCommands& commands = thread_commands[ thread_index ];
+    if ( commands.aabbs.size == commands.aabbs.capacity ) {
+        ++commands.dropped;
+        return;
+    }
+
+    commands.aabbs.push( { min, color.abgr, max, 0 } );
+}
+
+void DebugDraw::sphere( u32 thread_index, const vec3s& center, f32 radius, Color color ) {
+    RASSERT( thread_index < num_threads );
+    DebugDrawThreadCommands& commands = thread_commands[ thread_index ];
+    if ( commands.spheres.size == commands.spheres.capacity ) {
+        ++commands.dropped;
+        return;
+    }
+
+    commands.spheres.push( { center, radius, color.abgr } );
+}
+
+u32 DebugDraw::count_lines() const {
+    u32 count = 0;
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        const DebugDrawThreadCommands& commands = thread_commands[ t ];
+        count += commands.lines.size + commands.aabbs.size * k_debug_draw_lines_per_aabb + commands.spheres.size * k_debug_draw_lines_per_sphere;
+    }
+    return count;
+}
+
+u32 DebugDraw::count_lines_2d() const {
+    u32 count = 0;
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        count += thread_commands[ t ].lines_2d.size;
+    }
+    return count;
+}
+
+u32 DebugDraw::expand_lines( DebugLineVertex* out_vertices, u32 max_lines ) const {
+    u32 written = 0;
+
+    // Lines first, then boxes and spheres: only whole primitives are written.
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        const Array<DebugLineCommand>& lines = thread_commands[ t ].lines;
+        const u32 count = raptor::min( lines.size, max_lines - written );
+        memory_copy( out_vertices + written * 2, lines.data, sizeof( DebugLineCommand ) * count );
+        written += count;
+    }
+
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        const Array<DebugAabbCommand>& aabbs = thread_commands[ t ].aabbs;
+        const u32 count = raptor::min( aabbs.size, ( max_lines - written ) / k_debug_draw_lines_per_aabb );
+        debug_draw_expand_aabbs( aabbs.data, count, out_vertices + written * 2, use_simd );
+        written += count * k_debug_draw_lines_per_aabb;
+    }
+
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        const Array<DebugSphereCommand>& spheres = thread_commands[ t ].spheres;
+        const u32 count = raptor::min( spheres.size, ( max_lines - written ) / k_debug_draw_lines_per_sphere );
+        debug_draw_expand_spheres( spheres.data, count, out_vertices + written * 2, use_simd );
+        written += count * k_debug_draw_lines_per_sphere;
+    }
+
+    return written;
+}
+
+u32 DebugDraw::expand_lines_2d( DebugLineVertex* out_vertices, u32 max_lines ) const {
+    u32 written = 0;
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        const Array<DebugLineCommand>& lines_2d = thread_commands[ t ].lines_2d;
+        const u32 count = raptor::min( lines_2d.size, max_lines - written );
+        memory_copy( out_vertices + written * 2, lines_2d.data, sizeof( DebugLineCommand ) * count );
+        written += count;
+    }
+    return written;
+}
+
+void DebugDraw::clear() {
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        DebugDrawThreadCommands& commands = thread_commands[ t ];
+        commands.lines.clear();
+        commands.aabbs.clear();
+        commands.spheres.clear();
+        commands.lines_2d.clear();
+    }
+}
+
+u32 DebugDraw::dropped_commands() const {
+    u32 dropped = 0;
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        dropped += thread_commands[ t ].dropped;
+    }
+    return dropped;
+}
+
+// DebugDrawRing //////////////////////////////////////////////////////////
+void DebugDrawRing::init( u32 size_, u32 alignment_ ) {
+    size = size_;
+    alignment = alignment_;
+
+    head = tail = used = 0;
+    first_frame = frame_count = 0;
+    peak_used = wraps = failed_allocations = 0;
+}
+
+void DebugDrawRing::retire( u64 completed_timeline_value ) {
+    while ( frame_count && frames[ first_frame ].timeline_value <= completed_timeline_value ) {
+        const DebugDrawRingFrame& frame = frames[ first_frame ];
+        used -= frame.size;
+        tail = frame.end;
+
+        first_frame = ( first_frame + 1 ) % k_debug_draw_ring_max_frames;
+        --frame_count;
+    }
+
+    // Nothing in flight: restart from the beginning to keep the largest contiguous space.
+    if ( used == 0 ) {
+        head = tail = 0;
+    }
+}
+
+u32 DebugDrawRing::allocate( u32 allocation_size, u64 timeline_value ) {
+    allocation_size = ( u32 )memory_align( allocation_size, alignment );
+
+    const bool new_frame = frame_count == 0 || frames[ ( first_frame + frame_count - 1 ) % k_debug_draw_ring_max_frames ].timeline_value != timeline_value;
+    if ( new_frame && frame_count == k_debug_draw_ring_max_frames ) {
+        ++failed_allocations;
+        return u32_max;
+    }
+
+    u32 offset = u32_max;
+    u32 consumed = allocation_size;
+    if ( used == size ) {
+        // Full, head reached the tail.
+    } else if ( head >= tail ) {
+        if ( size - head >= allocation_size ) {
+            offset = head;
+        } else if ( tail >= allocation_size ) {
+            // Skip the end of the buffer, it is given back with the frame.
+            consumed += size - head;
+            offset = 0;
+            ++wraps;
+        }
+    } else if ( tail - head >= allocation_size ) {
+        offset = head;
+    }
+
+    if ( offset == u32_max ) {
+        ++failed_allocations;
+        return u32_max;
+    }
+
+    head = ( offset + allocation_size ) % size;
+    used += consumed;
+    peak_used = raptor::max( peak_used, used );
+
+    if ( new_frame ) {
+        frames[ ( first_frame + frame_count ) % k_debug_draw_ring_max_frames ] = { timeline_value, head, consumed };
+        ++frame_count;
+    } else {
+        DebugDrawRingFrame& frame = frames[ ( first_frame + frame_count - 1 ) % k_debug_draw_ring_max_frames ];
+        frame.end = head;
+        frame.size += consumed;
+    }
+
+    return offset;
+}
+
+} // namespace raptor
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/color.hpp"
+#include "foundation/platform.hpp"
+
+#include "external/cglm/types-struct.h"
+
+namespace raptor {
+
+struct Allocator;
+
+static const u32                    k_debug_draw_max_threads        = 64;
+static const u32                    k_debug_draw_sphere_segments    = 16;       // Per circle, multiple of 4 for the SIMD expansion.
+static const u32                    k_debug_draw_lines_per_aabb     = 12;
+static const u32                    k_debug_draw_lines_per_sphere   = 3 * k_debug_draw_sphere_segments;
+static const u32                    k_debug_draw_ring_max_frames    = 8;
+
+//
+// Vertex of the debug_line_cpu vertex input, two of them are a line instance.
+struct DebugLineVertex {
+
+    vec3s                           position;
+    u32                             color;
+
+}; // struct DebugLineVertex
+
+//
+//
+struct DebugLineCommand {
+
+    DebugLineVertex                 from;
+    DebugLineVertex                 to;
+
+}; // struct DebugLineCommand
+
+//
+// Color is in the fourth lane of min, the one of max is not read.
+struct DebugAabbCommand {
+
+    vec3s                           min;
+    u32                             color;
+    vec3s                           max;
+    u32                             pad;
+
+}; // struct DebugAabbCommand
+
+//
+// Drawn as three circles, one per axis plane.
+struct DebugSphereCommand {
+
+    vec3s                           center;
+    f32                             radius;
+    u32                             color;
+
+}; // struct DebugSphereCommand
+
+//
+// Commands added by a thread during the frame. On their own cache lines, commands over capacity are dropped.
+struct alignas( 64 ) DebugDrawThreadCommands {
+
+    Array<DebugLineCommand>         lines;
+    Array<DebugAabbCommand>         aabbs;
+    Array<DebugSphereCommand>       spheres;
+    Array<DebugLineCommand>         lines_2d;
+
+    u32                             dropped             = 0;
+
+}; // struct DebugDrawThreadCommands
+
+//
+// Debug primitives recorded from any thread without locks, each thread writes only the commands of its own index
+// (the enkiTS thread number for tasks). Once the threads are done the commands are expanded into line instances,
+// all threads and primitive types one after the other so they can be drawn with a single instanced draw.
+struct DebugDraw {
+
+    // Capacities are per thread.
+    void                            init( Allocator* allocator, u32 num_threads, u32 max_lines, u32 max_aabbs, u32 max_spheres, u32 max_lines_2d );
+    void                            shutdown();
+
+    void                            line( u32 thread_index, const vec3s& from, const vec3s& to, Color color0, Color color1 );
+    void                            line_2d( u32 thread_index, const vec2s& from, const vec2s& to, Color color );
+    void                            aabb( u32 thread_index, const vec3s& min, const vec3s& max, Color color );
+    void                            sphere( u32 thread_index, const vec3s& center, f32 radius, Color color );
+
+    // Line instances after expansion.
+    u32                             count_lines() const;
+    u32                             count_lines_2d() const;
+
+    // Write up to max_lines line instances (2 vertices each), returns the written ones.
+    u32                             expand_lines( DebugLineVertex* out_vertices, u32 max_lines ) const;
+    u32                             expand_lines_2d( DebugLineVertex* out_vertices, u32 max_lines ) const;
+
+    // Drops the commands of all threads, they must not be adding commands.
+    void                            clear();
+
+    u32                             dropped_commands() const;
+
+    DebugDrawThreadCommands*        thread_commands     = nullptr;
+
+    Allocator*                      allocator           = nullptr;
+    u32                             num_threads         = 0;
+
+    bool                            use_simd            = true;
+
+}; // struct DebugDraw
+
+// Expansion of the primitives, exposed to compare the SIMD and scalar paths.
+void                                debug_draw_expand_aabbs( const DebugAabbCommand* aabbs, u32 count, DebugLineVertex* out_vertices, bool use_simd );
+void                                debug_draw_expand_spheres( const DebugSphereCommand* spheres, u32 count, DebugLineVertex* out_vertices, bool use_simd );
+
+//
+//
+struct DebugDrawRingFrame {
+
+    u64                             timeline_value;
+    u32                             end;                // Head after the last allocation of the frame.
+    u32                             size;               // Allocated bytes, including the end skipped when wrapping.
+
+}; // struct DebugDrawRingFrame
+
+//
+// Allocations in a persistently mapped buffer used as a ring. Each allocation belongs to the frame with the given
+// gpu timeline value, and its space is reused only after retire is called with a completed value past it. When the
+// gpu still reads the space the allocation fails instead of waiting.
+struct DebugDrawRing {
+
+    void                            init( u32 size, u32 alignment );
+
+    void                            retire( u64 completed_timeline_value );
+
+    // Contiguous range, returns the offset or u32_max.
+    u32                             allocate( u32 size, u64 timeline_value );
+
+    u32                             size                = 0;
+    u32                             alignment           = 0;
+
+    u32                             head                = 0;
+    u32                             tail                = 0;
+    u32                             used                = 0;
+
+    DebugDrawRingFrame              frames[ k_debug_draw_ring_max_frames ];
+    u32                             first_frame         = 0;
+    u32                             frame_count         = 0;
+
+    u32                             peak_used           = 0;
+    u32                             wraps               = 0;
+    u32                             failed_allocations  = 0;
+
+}; // struct DebugDrawRing
+
+} // namespace raptor
@@ -0,0 +1,125 @@
+#include "graphics/deletion_queue.hpp"
+
+#include "foundation/assert.hpp"
+
+namespace raptor {
+
+// Users are destroyed before the resources they reference.
+static const ResourceUpdateType::Enum k_destruction_order[] = {
+    ResourceUpdateType::DescriptorSet, ResourceUpdateType::Pipeline, ResourceUpdateType::ShaderState, ResourceUpdateType::DescriptorSetLayout,
+    ResourceUpdateType::Framebuffer, ResourceUpdateType::RenderPass, ResourceUpdateType::TextureView, ResourceUpdateType::Texture,
+    ResourceUpdateType::Sampler, ResourceUpdateType::Buffer, ResourceUpdateType::PagePool
+};
+
+static_assert( ArraySize( k_destruction_order ) == ResourceUpdateType::Count, "Missing resource types in the destruction order" );
+
+// DeletionQueue //////////////////////////////////////////////////////////
+
+void DeletionQueue::init( Allocator* allocator_, u32 initial_capacity_ ) {
+    allocator = allocator_;
+    initial_capacity = initial_capacity_;
+
+    buckets.init( allocator, k_deletion_queue_buckets );
+    for ( u32 b = 0; b < k_deletion_queue_buckets; ++b ) {
+        add_bucket();
+    }
+
+    completed_value = 0;
+    stats = DeletionQueueStats();
+}
+
+void DeletionQueue::shutdown() {
+    RASSERTM( stats.pending == 0, "Deletion queue still has %u resources pending", stats.pending );
+
+    for ( u32 b = 0; b < buckets.size; ++b ) {
+        for ( u32 t = 0; t < ResourceUpdateType::Count; ++t ) {
+            buckets[ b ].handles[ t ].shutdown();
+        }
+    }
+    buckets.shutdown();
+}
+
+void DeletionQueue::enqueue( ResourceUpdateType::Enum type, u32 handle, u64 timeline_value ) {
+    // Already completed values are destroyed on the next collect.
+    if ( timeline_value <= completed_value ) {
+        timeline_value = completed_value + 1;
+    }
+
+    u32 bucket_index = ( u32 )( timeline_value % buckets.size );
+    if ( buckets[ bucket_index ].count && buckets[ bucket_index ].timeline_value != timeline_value ) {
+        bucket_index = find_bucket( timeline_value );
+    }
+
+    DeletionBucket& bucket = buckets[ bucket_index ];
+    bucket.timeline_value = timeline_value;
+    bucket.handles[ type ].push( handle );
+    ++bucket.count;
+
+    ++stats.enqueued;
+    ++stats.pending;
+    stats.peak_pending = stats.peak_pending > stats.pending ? stats.peak_pending : stats.pending;
+}
+
+u32 DeletionQueue::collect( u64 completed_value_, DeletionQueueCallback callback, void* context ) {
+    completed_value = completed_value_ > completed_value ? completed_value_ : completed_value;
+
+    u32 destroyed = 0;
+    for ( u32 t = 0; t < ResourceUpdateType::Count; ++t ) {
+        const ResourceUpdateType::Enum type = k_destruction_order[ t ];
+
+        for ( u32 b = 0; b < buckets.size; ++b ) {
+            DeletionBucket& bucket = buckets[ b ];
+            Array<u32>& handles = bucket.handles[ type ];
+            if ( bucket.count == 0 || bucket.timeline_value > completed_value || handles.size == 0 ) {
+                continue;
+            }
+
+            callback( context, type, handles.data, handles.size );
+
+            destroyed += handles.size;
+            handles.clear();
+        }
+    }
+
+    for ( u32 b = 0; b < buckets.size; ++b ) {
+        if ( buckets[ b ].count && buckets[ b ].timeline_value <= completed_value ) {
+            buckets[ b ].count = 0;
+        }
+    }
+
+    stats.destroyed += destroyed;
+    stats.pending -= destroyed;
+
+    return destroyed;
+}
+
+u32 DeletionQueue::find_bucket( u64 timeline_value ) {
+    ++stats.bucket_conflicts;
+
+    // More values pending than the ring was sized for, e.g. resources kept alive for more frames.
+    u32 free_bucket = u32_max;
+    for ( u32 b = 0; b < buckets.size; ++b ) {
+        if ( buckets[ b ].count == 0 ) {
+            free_bucket = free_bucket == u32_max ? b : free_bucket;
+        } else if ( buckets[ b ].timeline_value == timeline_value ) {
+            return b;
+        }
+    }
+
+    if ( free_bucket != u32_max ) {
+        return free_bucket;
+    }
+
+    add_bucket();
+    return buckets.size - 1;
+}
+
+void DeletionQueue::add_bucket() {
+    DeletionBucket bucket;
+    for ( u32 t = 0; t < ResourceUpdateType::Count; ++t ) {
+        bucket.handles[ t ].init( allocator, initial_capacity );
+    }
+    buckets.push( bucket );
+}
+
+} // namespace raptor
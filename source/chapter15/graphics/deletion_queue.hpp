@@ -0,0 +1,76 @@
+#pragma once
+
+#include "graphics/gpu_enum.hpp"
+
+#include "foundation/array.hpp"
+#include "foundation/platform.hpp"
+
+namespace raptor {
+
+struct Allocator;
+
+// Initial number of distinct timeline values that can be pending at the same time, the ring grows past it.
+static const u32                    k_deletion_queue_buckets = 8;
+
+// Destroys count resources of the same type.
+typedef void                        ( *DeletionQueueCallback )( void* context, ResourceUpdateType::Enum type, const u32* handles, u32 count );
+
+//
+// Resources that become safe to destroy when the gpu timeline reaches timeline_value.
+struct DeletionBucket {
+
+    Array<u32>                      handles[ ResourceUpdateType::Count ];
+
+    u64                             timeline_value      = 0;
+    u32                             count               = 0;
+
+}; // struct DeletionBucket
+
+//
+//
+struct DeletionQueueStats {
+
+    u32                             enqueued            = 0;
+    u32                             destroyed           = 0;
+    u32                             pending             = 0;
+    u32                             peak_pending        = 0;
+    u32                             bucket_conflicts    = 0;    // Enqueues whose ring slot held another pending value.
+
+}; // struct DeletionQueueStats
+
+//
+// Deferred resource destruction driven by the gpu timeline value.
+// Resources are stored in a ring of buckets indexed by the timeline value after which they are safe to destroy,
+// one array per resource type, so enqueue is O(1) and only completed buckets are visited when collecting.
+// A bucket only ever holds one value: when the slot of a value is taken by another pending one, any free bucket
+// is used instead and the ring grows when none is left.
+struct DeletionQueue {
+
+    void                            init( Allocator* allocator, u32 initial_capacity );
+    void                            shutdown();
+
+    // The resource is destroyed once the completed timeline value is >= timeline_value.
+    void                            enqueue( ResourceUpdateType::Enum type, u32 handle, u64 timeline_value );
+
+    // Destroys all resources that are safe at completed_value, type by type. Returns the number of destroyed resources.
+    u32                             collect( u64 completed_value, DeletionQueueCallback callback, void* context );
+
+    u32                             pending() const     { return stats.pending; }
+
+    Array<DeletionBucket>           buckets;
+
+    Allocator*                      allocator           = nullptr;
+    u32                             initial_capacity    = 0;
+
+    u64                             completed_value     = 0;
+
+    DeletionQueueStats              stats;
+
+private:
+
+    u32                             find_bucket( u64 timeline_value );
+    void                            add_bucket();
+
+}; // struct DeletionQueue
+
+} // namespace raptor
@@ -0,0 +1,60 @@
+#include "graphics/descriptor_set_cache.hpp"
+
+#include <string.h>
+
+namespace raptor {
+
+u64 descriptor_set_key_hash( const DescriptorSetKey& key ) {
+    u64 hash = hash_calculate( key.layout );
+    hash = hash_calculate( key.acceleration_structure, hash );
+    hash = hash_calculate( key.num_resources, hash );
+    hash = hash_bytes( ( void* )key.resources, sizeof( u32 ) * key.num_resources, hash );
+    hash = hash_bytes( ( void* )key.samplers, sizeof( u32 ) * key.num_resources, hash );
+    hash = hash_bytes( ( void* )key.bindings, sizeof( u16 ) * key.num_resources, hash );
+    return hash;
+}
+
+bool descriptor_set_key_equals( const DescriptorSetKey& a, const DescriptorSetKey& b ) {
+    if ( a.layout != b.layout || a.acceleration_structure != b.acceleration_structure || a.num_resources != b.num_resources ) {
+        return false;
+    }
+
+    const u32 count = a.num_resources;
+    return memcmp( a.resources, b.resources, sizeof( u32 ) * count ) == 0 && memcmp( a.samplers, b.samplers, sizeof( u32 ) * count ) == 0 &&
+           memcmp( a.bindings, b.bindings, sizeof( u16 ) * count ) == 0;
+}
+
+// DescriptorSetCache /////////////////////////////////////////////////////
+
+void DescriptorSetCache::init( Allocator* allocator, u32 initial_capacity ) {
+    sets.init( allocator, initial_capacity );
+    sets.set_default_value( u32_max );
+
+    stats = DescriptorSetCacheStats();
+}
+
+void DescriptorSetCache::shutdown() {
+    sets.shutdown();
+}
+
+void DescriptorSetCache::clear() {
+    sets.clear();
+}
+
+u32 DescriptorSetCache::find( u64 hash ) {
+    ++stats.lookups;
+    return sets.get( hash );
+}
+
+void DescriptorSetCache::add( u64 hash, u32 set_index ) {
+    sets.insert( hash, set_index );
+}
+
+void DescriptorSetCache::remove( u64 hash, u32 set_index ) {
+    FlatHashMapIterator it = sets.find( hash );
+    if ( it.is_valid() && sets.get( it ) == set_index ) {
+        sets.remove( it );
+    }
+}
+
+} // namespace raptor
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "foundation/hash_map.hpp"
+#include "foundation/platform.hpp"
+
+namespace raptor {
+
+struct Allocator;
+
+//
+// Content of a descriptor set, with resources sorted by binding.
+struct DescriptorSetKey {
+
+    const u32*                      resources           = nullptr;
+    const u32*                      samplers            = nullptr;
+    const u16*                      bindings            = nullptr;
+    u64                             acceleration_structure = 0;
+    u64                             layout              = 0;
+    u32                             num_resources       = 0;
+
+}; // struct DescriptorSetKey
+
+u64                                 descriptor_set_key_hash( const DescriptorSetKey& key );
+bool                                descriptor_set_key_equals( const DescriptorSetKey& a, const DescriptorSetKey& b );
+
+//
+//
+struct DescriptorSetCacheStats {
+
+    u32                             lookups             = 0;
+    u32                             hits                = 0;
+    u32                             collisions          = 0;    // Same hash, different content.
+    u32                             allocations         = 0;
+    u32                             invalidations       = 0;    // Entries dropped because a resource they reference changed.
+
+}; // struct DescriptorSetCacheStats
+
+//
+// Maps the hash of a descriptor set content to the index of the set that holds it.
+// The cache does not own the sets: on a hit the caller compares the full key with the content of the cached set,
+// as different contents can share a hash. A colliding set is allocated but not cached.
+struct DescriptorSetCache {
+
+    void                            init( Allocator* allocator, u32 initial_capacity );
+    void                            shutdown();
+
+    // Called when the sets are released all together, e.g. when their pool is reset.
+    void                            clear();
+
+    // Returns u32_max if no set with this hash is cached.
+    u32                             find( u64 hash );
+    void                            add( u64 hash, u32 set_index );
+    // Only removes the entry if it points to set_index.
+    void                            remove( u64 hash, u32 set_index );
+    // Removes the entries whose set index satisfies the predicate, e.g. sets referencing a resource that was
+    // recreated or destroyed. The sets themselves stay valid for their owners. Returns the number of removed entries.
+    template <typename Predicate>
+    u32                             remove_if( Predicate predicate );
+
+    FlatHashMap<u64, u32>           sets;
+    DescriptorSetCacheStats         stats;
+
+}; // struct DescriptorSetCache
+
+template <typename Predicate>
+u32 DescriptorSetCache::remove_if( Predicate predicate ) {
+    u32 removed = 0;
+    // Removing only marks the slot, the iteration can continue past it.
+    for ( FlatHashMapIterator it = sets.iterator_begin(); it.is_valid(); sets.iterator_advance( it ) ) {
+        if ( predicate( sets.get( it ) ) ) {
+            sets.remove( it );
+            ++removed;
+        }
+    }
+    stats.invalidations += removed;
+    return removed;
+}
+
+} // namespace raptor
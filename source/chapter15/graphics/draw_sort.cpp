@@ -0,0 +1,188 @@
+#include "graphics/draw_sort.hpp"
+
+#include <math.h>
+#include <string.h>
+
+namespace raptor {
+
+// Draw sort keys /////////////////////////////////////////////////////////
+
+// Fields are truncated: keys only order the draws, the recorded state does not depend on them.
+static u64 draw_key_field( u32 value, u32 bits ) {
+    return ( u64 )( value & ( ( 1u << bits ) - 1 ) );
+}
+
+u64 draw_sort_key( u32 pass, u32 pipeline, u32 material, u32 depth, u32 mesh ) {
+    u64 key = draw_key_field( pass, k_draw_key_pass_bits );
+    key = ( key << k_draw_key_pipeline_bits ) | draw_key_field( pipeline, k_draw_key_pipeline_bits );
+    key = ( key << k_draw_key_material_bits ) | draw_key_field( material, k_draw_key_material_bits );
+    key = ( key << k_draw_key_depth_bits ) | draw_key_field( depth, k_draw_key_depth_bits );
+    key = ( key << k_draw_key_mesh_bits ) | draw_key_field( mesh, k_draw_key_mesh_bits );
+    return key;
+}
+
+u64 draw_sort_key_back_to_front( u32 pass, u32 pipeline, u32 material, u32 depth, u32 mesh ) {
+    const u32 depth_mask = ( 1u << k_draw_key_depth_bits ) - 1;
+
+    u64 key = draw_key_field( pass, k_draw_key_pass_bits );
+    key = ( key << k_draw_key_depth_bits ) | ( depth_mask - draw_key_field( depth, k_draw_key_depth_bits ) );
+    key = ( key << k_draw_key_pipeline_bits ) | draw_key_field( pipeline, k_draw_key_pipeline_bits );
+    key = ( key << k_draw_key_material_bits ) | draw_key_field( material, k_draw_key_material_bits );
+    key = ( key << k_draw_key_mesh_bits ) | draw_key_field( mesh, k_draw_key_mesh_bits );
+    return key;
+}
+
+u32 draw_sort_depth( f32 view_depth, f32 z_near, f32 z_far ) {
+    const u32 depth_mask = ( 1u << k_draw_key_depth_bits ) - 1;
+
+    if ( view_depth <= z_near ) {
+        return 0;
+    }
+    if ( view_depth >= z_far ) {
+        return depth_mask;
+    }
+
+    const f32 t = logf( view_depth / z_near ) / logf( z_far / z_near );
+    return ( u32 )( t * depth_mask );
+}
+
+// RadixSortTask //////////////////////////////////////////////////////////
+
+void RadixSortTask::ExecuteRange( enki::TaskSetPartition range, uint32_t ) {
+    for ( u32 p = range.start; p < range.end; ++p ) {
+        const u32 begin = p * partition_size;
+        const u32 end = begin + partition_size < count ? begin + partition_size : count;
+        u32* histogram = histograms + p * k_radix_sort_buckets;
+
+        if ( !scatter ) {
+            memset( histogram, 0, sizeof( u32 ) * k_radix_sort_buckets );
+
+            for ( u32 i = begin; i < end; ++i ) {
+                ++histogram[ ( source_keys[ i ] >> shift ) & ( k_radix_sort_buckets - 1 ) ];
+            }
+        } else {
+            // Histogram contains the first destination of each bucket for this partition.
+            for ( u32 i = begin; i < end; ++i ) {
+                const u32 destination = histogram[ ( source_keys[ i ] >> shift ) & ( k_radix_sort_buckets - 1 ) ]++;
+                destination_keys[ destination ] = source_keys[ i ];
+                destination_values[ destination ] = source_values[ i ];
+            }
+        }
+    }
+}
+
+static void radix_sort_run( RadixSortTask& task, enki::TaskScheduler* task_scheduler ) {
+    if ( task.m_SetSize > 1 ) {
+        task_scheduler->AddTaskSetToPipe( &task );
+        task_scheduler->WaitforTask( &task );
+    } else {
+        task.ExecuteRange( { 0, 1 }, 0 );
+    }
+}
+
+void radix_sort( u64* keys, u32* values, u64* scratch_keys, u32* scratch_values, u32 count, enki::TaskScheduler* task_scheduler, u32 min_parallel_count ) {
+    if ( count < 2 ) {
+        return;
+    }
+
+    u32 num_partitions = 1;
+    if ( task_scheduler && count >= min_parallel_count ) {
+        num_partitions = task_scheduler->GetNumTaskThreads();
+        num_partitions = num_partitions < k_radix_sort_max_partitions ? num_partitions : k_radix_sort_max_partitions;
+    }
+    const u32 partition_size = ( count + num_partitions - 1 ) / num_partitions;
+    num_partitions = ( count + partition_size - 1 ) / partition_size;
+
+    // Digits that are the same in all keys do not change the order.
+    u64 differing_bits = 0;
+    for ( u32 i = 1; i < count; ++i ) {
+        differing_bits |= keys[ i ] ^ keys[ 0 ];
+    }
+
+    u32 histograms[ k_radix_sort_max_partitions * k_radix_sort_buckets ];
+
+    RadixSortTask task;
+    task.m_SetSize = num_partitions;
+    task.m_MinRange = 1;
+    task.histograms = histograms;
+    task.count = count;
+    task.partition_size = partition_size;
+
+    u64* source_keys = keys;
+    u32* source_values = values;
+    u64* destination_keys = scratch_keys;
+    u32* destination_values = scratch_values;
+
+    for ( u32 shift = 0; shift < 64; shift += k_radix_sort_digit_bits ) {
+        if ( ( ( differing_bits >> shift ) & ( k_radix_sort_buckets - 1 ) ) == 0 ) {
+            continue;
+        }
+
+        task.source_keys = source_keys;
+        task.source_values = source_values;
+        task.destination_keys = destination_keys;
+        task.destination_values = destination_values;
+        task.shift = shift;
+        task.scatter = false;
+        radix_sort_run( task, task_scheduler );
+
+        // Buckets first, then partitions: keys of a partition land after the ones of the previous partitions, keeping the sort stable.
+        u32 offset = 0;
+        for ( u32 b = 0; b < k_radix_sort_buckets; ++b ) {
+            for ( u32 p = 0; p < num_partitions; ++p ) {
+                const u32 bucket_count = histograms[ p * k_radix_sort_buckets + b ];
+                histograms[ p * k_radix_sort_buckets + b ] = offset;
+                offset += bucket_count;
+            }
+        }
+
+        task.scatter = true;
+        radix_sort_run( task, task_scheduler );
+
+        u64* temp_keys = source_keys;
+        source_keys = destination_keys;
+        destination_keys = temp_keys;
+
+        u32* temp_values = source_values;
+        source_values = destination_values;
+        destination_values = temp_values;
+    }
+
+    if ( source_keys != keys ) {
+        memcpy( keys, source_keys, sizeof( u64 ) * count );
+        memcpy( values, source_values, sizeof( u32 ) * count );
+    }
+}
+
+// DrawSorter /////////////////////////////////////////////////////////////
+
+void DrawSorter::init( Allocator* allocator, u32 initial_capacity ) {
+    keys.init( allocator, initial_capacity );
+    values.init( allocator, initial_capacity );
+    scratch_keys.init( allocator, initial_capacity );
+    scratch_values.init( allocator, initial_capacity );
+}
+
+void DrawSorter::shutdown() {
+    keys.shutdown();
+    values.shutdown();
+    scratch_keys.shutdown();
+    scratch_values.shutdown();
+}
+
+void DrawSorter::begin( u32 count ) {
+    keys.set_size( count );
+    values.set_size( count );
+    scratch_keys.set_size( count );
+    scratch_values.set_size( count );
+
+    for ( u32 i = 0; i < count; ++i ) {
+        values[ i ] = i;
+    }
+}
+
+void DrawSorter::sort( enki::TaskScheduler* task_scheduler ) {
+    radix_sort( keys.data, values.data, scratch_keys.data, scratch_values.data, keys.size, task_scheduler, min_parallel_count );
+}
+
+} // namespace raptor
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/platform.hpp"
+
+#include "external/enkiTS/TaskScheduler.h"
+
+namespace raptor {
+
+struct Allocator;
+
+// Draw sort keys /////////////////////////////////////////////////////////
+
+// Bits used by each field of a draw sort key, from the most significant.
+static const u32                    k_draw_key_pass_bits        = 4;
+static const u32                    k_draw_key_pipeline_bits    = 12;
+static const u32                    k_draw_key_material_bits    = 16;
+static const u32                    k_draw_key_depth_bits       = 16;
+static const u32                    k_draw_key_mesh_bits        = 16;
+
+// Opaque draws: state first, then front to back inside the same state.
+// pass | pipeline | material | depth | mesh
+u64                                 draw_sort_key( u32 pass, u32 pipeline, u32 material, u32 depth, u32 mesh );
+// Transparent draws: back to front, state only breaks ties.
+// pass | inverted depth | pipeline | material | mesh
+u64                                 draw_sort_key_back_to_front( u32 pass, u32 pipeline, u32 material, u32 depth, u32 mesh );
+
+// Quantizes a view space depth with a logarithmic distribution between z_near and z_far.
+u32                                 draw_sort_depth( f32 view_depth, f32 z_near, f32 z_far );
+
+// Radix sort /////////////////////////////////////////////////////////////
+
+static const u32                    k_radix_sort_digit_bits     = 8;
+static const u32                    k_radix_sort_buckets        = 1 << k_radix_sort_digit_bits;
+static const u32                    k_radix_sort_max_partitions = 32;
+
+//
+// Counts or scatters one digit of a contiguous partition of the keys.
+struct RadixSortTask : public enki::ITaskSet {
+
+    void                            ExecuteRange( enki::TaskSetPartition range, uint32_t thread_index ) override;
+
+    const u64*                      source_keys             = nullptr;
+    const u32*                      source_values           = nullptr;
+    u64*                            destination_keys        = nullptr;
+    u32*                            destination_values      = nullptr;
+
+    u32*                            histograms              = nullptr;  // k_radix_sort_buckets per partition.
+    u32                             count                   = 0;
+    u32                             partition_size          = 0;
+    u32                             shift                   = 0;
+    bool                            scatter                 = false;
+
+}; // struct RadixSortTask
+
+//
+// Stable LSD radix sort of 64 bit keys with a 32 bit payload. Partitions of the keys are counted and scattered
+// in parallel, and digits that are the same for all keys are skipped.
+struct DrawSorter {
+
+    void                            init( Allocator* allocator, u32 initial_capacity );
+    void                            shutdown();
+
+    // Resizes the keys and fills the values with the identity, keys are written by the caller.
+    void                            begin( u32 count );
+    void                            sort( enki::TaskScheduler* task_scheduler );
+
+    Array<u64>                      keys;
+    Array<u32>                      values;
+
+    Array<u64>                      scratch_keys;
+    Array<u32>                      scratch_values;
+
+    u32                             min_parallel_count      = 16 * 1024;
+
+}; // struct DrawSorter
+
+// Sorts count keys and values, using scratch buffers of the same size. The sorted result is in keys and values.
+void                                radix_sort( u64* keys, u32* values, u64* scratch_keys, u32* scratch_values, u32 count,
+                                                enki::TaskScheduler* task_scheduler, u32 min_parallel_count );
+
+} // namespace raptor
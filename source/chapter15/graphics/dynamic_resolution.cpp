@@ -0,0 +1,169 @@
+#include "graphics/dynamic_resolution.hpp"
+
+#include "graphics/gpu_profiler.hpp"
+
+#include "foundation/assert.hpp"
+#include "foundation/hash_map.hpp"
+#include "foundation/numerics.hpp"
+
+#include <math.h>
+
+namespace raptor {
+
+void DynamicResolutionController::init( f32 min_scale_, f32 max_scale_, f32 target_frame_ms_ ) {
+    RASSERT( min_scale_ > 0.f && min_scale_ <= max_scale_ );
+
+    min_scale = min_scale_;
+    max_scale = max_scale_;
+    target_frame_ms = target_frame_ms_;
+    num_scaled_passes = 0;
+
+    reset( max_scale );
+}
+
+void DynamicResolutionController::reset( f32 scale_ ) {
+    scale = raptor::clamp( scale_, min_scale, max_scale );
+    integral = 0.f;
+    frames_since_change = 0;
+    spike_samples = 0;
+    emergency_count = 0;
+    under_target_count = 0;
+    stats = DynamicResolutionStats{};
+}
+
+void DynamicResolutionController::add_scaled_pass( cstring name ) {
+    RASSERT( num_scaled_passes < k_dynamic_resolution_max_passes );
+
+    scaled_pass_hashes[ num_scaled_passes++ ] = hash_calculate( name );
+}
+
+bool DynamicResolutionController::update( const GPUTimeQuery* timestamps, u32 num_timestamps ) {
+    f32 frame_ms = 0.f;
+    f32 scaled_ms = 0.f;
+
+    for ( u32 i = 0; i < num_timestamps; ++i ) {
+        const GPUTimeQuery& timestamp = timestamps[ i ];
+        if ( timestamp.depth == 0 ) {
+            frame_ms += ( f32 )timestamp.elapsed_ms;
+        }
+
+        if ( timestamp.name == nullptr ) {
+            continue;
+        }
+
+        const u64 name_hash = hash_calculate( timestamp.name );
+        for ( u32 p = 0; p < num_scaled_passes; ++p ) {
+            if ( scaled_pass_hashes[ p ] == name_hash ) {
+                scaled_ms += ( f32 )timestamp.elapsed_ms;
+                break;
+            }
+        }
+    }
+
+    return update( frame_ms, scaled_ms );
+}
+
+bool DynamicResolutionController::update( f32 frame_ms, f32 scaled_ms ) {
+    stats.frame_ms = frame_ms;
+    stats.scaled_ms = scaled_ms;
+
+    ++frames_since_change;
+
+    // GPU timings arrive some frames late: the first ones after a change still measure the previous scale.
+    if ( frame_ms <= 0.f || frames_since_change <= latency_frames ) {
+        return false;
+    }
+
+    // A sustained jump over the target lowers the scale at once, from the last sample instead of the filtered ones.
+    emergency_count = ( frame_ms - target_frame_ms ) > emergency_error * target_frame_ms ? emergency_count + 1 : 0;
+    const bool emergency = emergency_count >= emergency_samples;
+
+    // A sample much slower than the filtered time is taken only if the next one is slow too: single hitches
+    // would otherwise lower the scale for the whole cooldown.
+    if ( stats.samples > 0 && frame_ms > stats.filtered_frame_ms * ( 1.f + spike_ratio ) && spike_samples == 0 ) {
+        ++spike_samples;
+        ++stats.rejected_samples;
+        return false;
+    }
+    spike_samples = 0;
+
+    const f32 full_scale_ms = scaled_ms / ( scale * scale );
+    const f32 fixed_ms = raptor::max( frame_ms - scaled_ms, 0.f );
+
+    if ( stats.samples == 0 || emergency ) {
+        stats.filtered_frame_ms = frame_ms;
+        stats.fixed_ms = fixed_ms;
+        stats.full_scale_ms = full_scale_ms;
+    } else {
+        stats.filtered_frame_ms += ( frame_ms - stats.filtered_frame_ms ) * smoothing;
+        stats.fixed_ms += ( fixed_ms - stats.fixed_ms ) * smoothing;
+        stats.full_scale_ms += ( full_scale_ms - stats.full_scale_ms ) * smoothing;
+    }
+    ++stats.samples;
+
+    const f32 error = ( stats.filtered_frame_ms - target_frame_ms ) / target_frame_ms;
+    const bool over_target = error > dead_band;
+    const bool under_target = error < -dead_band;
+    under_target_count = under_target ? under_target_count + 1 : 0;
+
+    f32 desired_scale;
+    if ( stats.full_scale_ms > 0.f ) {
+        const f32 available_ms = target_frame_ms - stats.fixed_ms;
+        stats.model_scale = available_ms > 0.f ? sqrtf( available_ms / stats.full_scale_ms ) : 0.f;
+        desired_scale = stats.model_scale;
+    } else {
+        stats.model_scale = 0.f;
+        desired_scale = scale * ( 1.f - proportional_gain * error );
+    }
+
+    // Integrate only the error the model does not explain: out of the band while it asks to keep the scale.
+    // Not against a limit of the scale either, to avoid winding up.
+    const bool model_keeps_scale = quantize( raptor::clamp( desired_scale, min_scale, max_scale ) ) == scale;
+    if ( model_keeps_scale && ( ( over_target && scale > min_scale ) || ( under_target && scale < max_scale ) ) ) {
+        integral = raptor::clamp( integral + error, -integral_limit, integral_limit );
+    } else if ( !over_target && !under_target ) {
+        integral *= 0.9f;
+    }
+
+    desired_scale = quantize( raptor::clamp( desired_scale - integral_gain * integral, min_scale, max_scale ) );
+
+    if ( desired_scale < scale ) {
+        if ( !emergency && ( !over_target || frames_since_change < lower_cooldown_frames ) ) {
+            return false;
+        }
+    } else if ( desired_scale > scale ) {
+        if ( under_target_count < raise_cooldown_frames ) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    // Predict the frame time at the new scale, so that the filter does not keep reacting to the old one.
+    if ( stats.full_scale_ms > 0.f ) {
+        stats.filtered_frame_ms = stats.fixed_ms + stats.full_scale_ms * desired_scale * desired_scale;
+    }
+
+    scale = desired_scale;
+    frames_since_change = 0;
+    emergency_count = 0;
+    under_target_count = 0;
+
+    ++stats.scale_changes;
+    if ( emergency ) {
+        ++stats.emergency_changes;
+    }
+
+    return true;
+}
+
+f32 DynamicResolutionController::quantize( f32 value ) const {
+    if ( scale_step <= 0.f ) {
+        return value;
+    }
+
+    const f32 quantized = floorf( value / scale_step + 0.5f ) * scale_step;
+    return raptor::clamp( quantized, min_scale, max_scale );
+}
+
+} // namespace raptor
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "foundation/platform.hpp"
+
+namespace raptor {
+
+struct GPUTimeQuery;
+
+static const u32                    k_dynamic_resolution_max_passes = 8;
+
+//
+//
+struct DynamicResolutionStats {
+
+    f32                             frame_ms                = 0.f;  // Last sample.
+    f32                             scaled_ms               = 0.f;  // Time of the scaled passes in the last sample.
+
+    f32                             filtered_frame_ms       = 0.f;
+    f32                             fixed_ms                = 0.f;  // Filtered time of the passes not affected by the scale.
+    f32                             full_scale_ms           = 0.f;  // Filtered time of the scaled passes, normalized to scale 1.
+    f32                             model_scale             = 0.f;  // Scale that would hit the target according to the filtered times.
+
+    u32                             samples                 = 0;
+    u32                             scale_changes           = 0;
+    u32                             emergency_changes       = 0;
+    u32                             rejected_samples        = 0;    // Single slow frames ignored.
+
+}; // struct DynamicResolutionStats
+
+//
+// Chooses the resolution scale of a group of passes to keep the GPU frame time under a target.
+// The cost of the scaled passes is assumed proportional to the pixel count, so the scale squared: the times of the
+// scaled passes divided by it give a cost at scale 1 that does not change with the scale, and with the time of the
+// other passes it predicts the scale hitting the target. An integral term corrects the error of this model.
+// The scale is quantized and changes only when the filtered frame time leaves a band around the target, it is
+// raised only after staying under the band for a while. Samples measured with an old scale and isolated spikes
+// are skipped.
+// Only the raytraced reflections and their SVGF denoising are scaled: the GBuffer and TAA chain renders at
+// swapchain size and would need an upscaling pass first, so its cost counts as fixed time.
+struct DynamicResolutionController {
+
+    void                            init( f32 min_scale, f32 max_scale, f32 target_frame_ms );
+    void                            reset( f32 scale );
+
+    // Names of the GPU time queries of the scaled passes, as the frame graph node names.
+    void                            add_scaled_pass( cstring name );
+
+    // Frame time is the sum of the root queries. Returns true when the scale changed.
+    bool                            update( const GPUTimeQuery* timestamps, u32 num_timestamps );
+    bool                            update( f32 frame_ms, f32 scaled_ms );
+
+    f32                             quantize( f32 value ) const;
+
+    DynamicResolutionStats          stats;
+
+    u64                             scaled_pass_hashes[ k_dynamic_resolution_max_passes ];
+    u32                             num_scaled_passes       = 0;
+
+    f32                             scale                   = 1.f;
+    f32                             min_scale               = 0.25f;
+    f32                             max_scale               = 1.f;
+    f32                             scale_step              = 1.f / 32.f;
+    f32                             target_frame_ms         = 16.6f;
+
+    f32                             smoothing               = 0.2f;     // Weight of a new sample in the filtered times.
+    f32                             dead_band               = 0.05f;    // Relative error tolerated around the target.
+    f32                             spike_ratio             = 0.5f;     // Slower than the filtered time by this is a spike.
+    f32                             emergency_error         = 0.25f;    // Over it the scale is lowered without waiting.
+    f32                             proportional_gain       = 0.5f;     // Used while the scaled passes are not measured.
+    f32                             integral_gain           = 0.05f;
+    f32                             integral_limit          = 4.f;
+    f32                             integral                = 0.f;
+
+    u32                             latency_frames          = 3;        // Samples skipped after a change.
+    u32                             emergency_samples       = 2;        // Consecutive samples over emergency_error.
+    u32                             lower_cooldown_frames   = 4;        // Frames since the last change.
+    u32                             raise_cooldown_frames   = 30;       // Consecutive samples under the band.
+    u32                             frames_since_change     = 0;
+    u32                             spike_samples           = 0;
+    u32                             emergency_count         = 0;
+    u32                             under_target_count      = 0;
+
+}; // struct DynamicResolutionController
+
+} // namespace raptor
@@ -0,0 +1,353 @@
+#include "graphics/frame_statistics.hpp"
+
+#include "foundation/assert.hpp"
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+#include "foundation/time.hpp"
+
+#include "external/imgui/imgui.h"
+
+#include <float.h>
+#include <math.h>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+namespace raptor {
+
+static int sorting_ms_fn( const void* a, const void* b ) {
+    const f32 ms_a = *( const f32* )a;
+    const f32 ms_b = *( const f32* )b;
+    return ms_a < ms_b ? -1 : ( ms_a > ms_b ? 1 : 0 );
+}
+
+// Nearest rank on sorted samples.
+static f32 percentile( const f32* sorted_samples, u32 count, f32 p ) {
+    const u32 rank = ( u32 )ceilf( p * count );
+    return sorted_samples[ raptor::clamp( rank, 1u, count ) - 1 ];
+}
+
+// FrameStatistics ////////////////////////////////////////////////////////
+void FrameStatistics::init( Allocator* allocator_, u32 history_frames_, u32 num_threads_ ) {
+    RASSERT( num_threads_ > 0 && num_threads_ <= k_frame_statistics_max_threads );
+
+    allocator = allocator_;
+    history_frames = history_frames_;
+    num_threads = num_threads_;
+
+    thread_timings = ( FrameThreadTimings* )allocator->allocate( sizeof( FrameThreadTimings ) * num_threads, alignof( FrameThreadTimings ) );
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        new ( &thread_timings[ t ] ) FrameThreadTimings();
+        for ( u32 p = 0; p < FramePhase::Count; ++p ) {
+            thread_timings[ t ].ticks[ p ].store( 0, std::memory_order_relaxed );
+        }
+    }
+
+    history.init( allocator, history_frames, history_frames );
+
+    reset();
+}
+
+void FrameStatistics::shutdown() {
+    history.shutdown();
+
+    allocator->deallocate( thread_timings );
+    thread_timings = nullptr;
+}
+
+void FrameStatistics::reset() {
+    memset( histogram, 0, sizeof( histogram ) );
+    memset( filtered_phase_ms, 0, sizeof( filtered_phase_ms ) );
+
+    hitch_count = 0;
+    last_frame_tick = 0;
+    frame_number = 0;
+    history_count = 0;
+    history_next = 0;
+    filtered_frame_ms = 0.f;
+}
+
+void FrameStatistics::add_phase_time( u32 thread_index, FramePhase::Enum phase, i64 ticks ) {
+    RASSERT( thread_index < num_threads );
+    thread_timings[ thread_index ].ticks[ phase ].fetch_add( ticks, std::memory_order_relaxed );
+}
+
+void FrameStatistics::end_frame( f32 gpu_ms ) {
+    const i64 current_tick = time_now();
+    const i64 previous_tick = last_frame_tick;
+    last_frame_tick = current_tick;
+
+    // The first frame has no start, drop what was measured until now.
+    if ( previous_tick == 0 ) {
+        for ( u32 t = 0; t < num_threads; ++t ) {
+            for ( u32 p = 0; p < FramePhase::Count; ++p ) {
+                thread_timings[ t ].ticks[ p ].store( 0, std::memory_order_relaxed );
+            }
+        }
+        return;
+    }
+
+    end_frame( ( f32 )time_delta_milliseconds( previous_tick, current_tick ), gpu_ms );
+}
+
+void FrameStatistics::end_frame( f32 frame_ms, f32 gpu_ms ) {
+    if ( history_frames == 0 ) {
+        return;
+    }
+
+    FrameRecord& record = history[ history_next ];
+    record.frame_number = frame_number;
+    record.frame_ms = frame_ms;
+    record.gpu_ms = gpu_ms;
+
+    for ( u32 p = 0; p < FramePhase::Count; ++p ) {
+        i64 ticks = 0;
+        for ( u32 t = 0; t < num_threads; ++t ) {
+            ticks += thread_timings[ t ].ticks[ p ].exchange( 0, std::memory_order_relaxed );
+        }
+        record.phase_ms[ p ] = ( f32 )time_milliseconds( ticks );
+    }
+
+    const u32 bucket = ( u32 )( frame_ms / k_frame_statistics_bucket_ms );
+    ++histogram[ raptor::min( bucket, k_frame_statistics_histogram_buckets - 1 ) ];
+
+    const bool detect_hitches = frame_number >= warmup_frames;
+    const bool hitch = detect_hitches && frame_ms > filtered_frame_ms * hitch_ratio && frame_ms - filtered_frame_ms > hitch_min_delta_ms;
+
+    if ( hitch ) {
+        FrameHitch& frame_hitch = hitches[ hitch_count % k_frame_statistics_max_hitches ];
+        frame_hitch.frame_number = frame_number;
+        frame_hitch.frame_ms = frame_ms;
+        frame_hitch.expected_frame_ms = filtered_frame_ms;
+
+        f32 max_growth_ms = -FLT_MAX;
+        for ( u32 p = 0; p < FramePhase::Count; ++p ) {
+            const f32 growth_ms = record.phase_ms[ p ] - filtered_phase_ms[ p ];
+            if ( growth_ms > max_growth_ms ) {
+                max_growth_ms = growth_ms;
+                frame_hitch.phase = ( FramePhase::Enum )p;
+                frame_hitch.phase_ms = record.phase_ms[ p ];
+                frame_hitch.expected_phase_ms = filtered_phase_ms[ p ];
+            }
+        }
+
+        ++hitch_count;
+    } else if ( frame_number == 0 ) {
+        filtered_frame_ms = frame_ms;
+        memory_copy( filtered_phase_ms, record.phase_ms, sizeof( filtered_phase_ms ) );
+    } else {
+        // Hitches stay out of the filtered times, or the following frames would be compared with them.
+        filtered_frame_ms += ( frame_ms - filtered_frame_ms ) * smoothing;
+        for ( u32 p = 0; p < FramePhase::Count; ++p ) {
+            filtered_phase_ms[ p ] += ( record.phase_ms[ p ] - filtered_phase_ms[ p ] ) * smoothing;
+        }
+    }
+
+    ++frame_number;
+    history_next = ( history_next + 1 ) % history_frames;
+    history_count = raptor::min( history_count + 1, history_frames );
+}
+
+const FrameRecord& FrameStatistics::get_frame( u32 index ) const {
+    RASSERT( index < history_count );
+    return history[ ( history_next + history_frames - history_count + index ) % history_frames ];
+}
+
+void FrameStatistics::compute_summary( FrameStatisticsSummary& out_summary ) const {
+    memset( &out_summary, 0, sizeof( FrameStatisticsSummary ) );
+    out_summary.frames = history_count;
+
+    if ( history_count == 0 ) {
+        return;
+    }
+
+    Array<f32> samples;
+    samples.init( allocator, history_count, history_count );
+
+    f64 frame_sum = 0.0;
+    f64 gpu_sum = 0.0;
+    f64 cpu_busy_sum = 0.0;
+    f64 overlap_sum = 0.0;
+    u32 overlap_frames = 0;
+
+    for ( u32 f = 0; f < history_count; ++f ) {
+        const FrameRecord& record = get_frame( f );
+        samples[ f ] = record.frame_ms;
+
+        const f32 present_wait_ms = record.phase_ms[ FramePhase::PresentWait ];
+        const f32 cpu_busy_ms = raptor::max( record.frame_ms - present_wait_ms, 0.f );
+
+        frame_sum += record.frame_ms;
+        gpu_sum += record.gpu_ms;
+        cpu_busy_sum += cpu_busy_ms;
+
+        if ( present_wait_ms > gpu_bound_wait_ms ) {
+            ++out_summary.gpu_bound_frames;
+        } else {
+            ++out_summary.cpu_bound_frames;
+        }
+
+        if ( record.gpu_ms > 0.f && cpu_busy_ms > 0.f ) {
+            overlap_sum += raptor::clamp( ( cpu_busy_ms + record.gpu_ms - record.frame_ms ) / raptor::min( cpu_busy_ms, record.gpu_ms ), 0.f, 1.f );
+            ++overlap_frames;
+        }
+    }
+
+    qsort( samples.data, history_count, sizeof( f32 ), sorting_ms_fn );
+    out_summary.frame_min_ms = samples[ 0 ];
+    out_summary.frame_average_ms = ( f32 )( frame_sum / history_count );
+    out_summary.frame_p50_ms = percentile( samples.data, history_count, 0.5f );
+    out_summary.frame_p95_ms = percentile( samples.data, history_count, 0.95f );
+    out_summary.frame_p99_ms = percentile( samples.data, history_count, 0.99f );
+    out_summary.frame_max_ms = samples[ history_count - 1 ];
+
+    out_summary.gpu_average_ms = ( f32 )( gpu_sum / history_count );
+    out_summary.cpu_busy_average_ms = ( f32 )( cpu_busy_sum / history_count );
+    out_summary.overlap = overlap_frames ? ( f32 )( overlap_sum / overlap_frames ) : 0.f;
+
+    for ( u32 p = 0; p < FramePhase::Count; ++p ) {
+        f64 phase_sum = 0.0;
+        for ( u32 f = 0; f < history_count; ++f ) {
+            samples[ f ] = get_frame( f ).phase_ms[ p ];
+            phase_sum += samples[ f ];
+        }
+
+        qsort( samples.data, history_count, sizeof( f32 ), sorting_ms_fn );
+        out_summary.phase_average_ms[ p ] = ( f32 )( phase_sum / history_count );
+        out_summary.phase_p95_ms[ p ] = percentile( samples.data, history_count, 0.95f );
+        out_summary.phase_p99_ms[ p ] = percentile( samples.data, history_count, 0.99f );
+    }
+
+    samples.shutdown();
+}
+
+bool FrameStatistics::write_json( cstring path ) const {
+    FILE* file = fopen( path, "w" );
+    if ( !file ) {
+        rprint( "Cannot write frame statistics %s\n", path );
+        return false;
+    }
+
+    write_json( file );
+
+    fclose( file );
+    return true;
+}
+
+void FrameStatistics::write_json( FILE* file ) const {
+    FrameStatisticsSummary summary;
+    compute_summary( summary );
+
+    fprintf( file, "{\n\t\"summary\": { \"frames\": %u, \"min_ms\": %f, \"average_ms\": %f, \"p50_ms\": %f, \"p95_ms\": %f, \"p99_ms\": %f, \"max_ms\": %f,\n",
+             summary.frames, summary.frame_min_ms, summary.frame_average_ms, summary.frame_p50_ms, summary.frame_p95_ms, summary.frame_p99_ms, summary.frame_max_ms );
+    fprintf( file, "\t\t\"gpu_average_ms\": %f, \"cpu_busy_average_ms\": %f, \"overlap\": %f, \"gpu_bound_frames\": %u, \"cpu_bound_frames\": %u },\n",
+             summary.gpu_average_ms, summary.cpu_busy_average_ms, summary.overlap, summary.gpu_bound_frames, summary.cpu_bound_frames );
+
+    fprintf( file, "\t\"phases\": [" );
+    for ( u32 p = 0; p < FramePhase::Count; ++p ) {
+        fprintf( file, "%s\n\t\t{ \"name\": \"%s\", \"average_ms\": %f, \"p95_ms\": %f, \"p99_ms\": %f }", p ? "," : "",
+                 FramePhase::s_value_names[ p ], summary.phase_average_ms[ p ], summary.phase_p95_ms[ p ], summary.phase_p99_ms[ p ] );
+    }
+    fprintf( file, "\n\t],\n" );
+
+    fprintf( file, "\t\"histogram\": { \"bucket_ms\": %f, \"counts\": [", k_frame_statistics_bucket_ms );
+    for ( u32 b = 0; b < k_frame_statistics_histogram_buckets; ++b ) {
+        fprintf( file, "%s%u", b ? ", " : "", histogram[ b ] );
+    }
+    fprintf( file, "] },\n" );
+
+    fprintf( file, "\t\"hitch_count\": %u,\n\t\"hitches\": [", hitch_count );
+    const u32 kept_hitches = raptor::min( hitch_count, k_frame_statistics_max_hitches );
+    for ( u32 h = 0; h < kept_hitches; ++h ) {
+        const FrameHitch& hitch = hitches[ ( hitch_count - kept_hitches + h ) % k_frame_statistics_max_hitches ];
+        fprintf( file, "%s\n\t\t{ \"frame\": %llu, \"frame_ms\": %f, \"expected_frame_ms\": %f, \"phase\": \"%s\", \"phase_ms\": %f, \"expected_phase_ms\": %f }",
+                 h ? "," : "", hitch.frame_number, hitch.frame_ms, hitch.expected_frame_ms, FramePhase::ToString( hitch.phase ), hitch.phase_ms, hitch.expected_phase_ms );
+    }
+    fprintf( file, "\n\t],\n" );
+
+    fprintf( file, "\t\"frames\": [" );
+    for ( u32 f = 0; f < history_count; ++f ) {
+        const FrameRecord& record = get_frame( f );
+        fprintf( file, "%s\n\t\t{ \"frame\": %llu, \"frame_ms\": %f, \"gpu_ms\": %f, \"phases_ms\": [", f ? "," : "", record.frame_number, record.frame_ms, record.gpu_ms );
+        for ( u32 p = 0; p < FramePhase::Count; ++p ) {
+            fprintf( file, "%s%f", p ? ", " : "", record.phase_ms[ p ] );
+        }
+        fprintf( file, "] }" );
+    }
+    fprintf( file, "\n\t]\n}\n" );
+}
+
+static f32 frame_record_ms_getter( void* data, int index ) {
+    const FrameStatistics* frame_statistics = ( const FrameStatistics* )data;
+    return frame_statistics->get_frame( index ).frame_ms;
+}
+
+void FrameStatistics::imgui_draw() {
+    if ( ImGui::Begin( "Frame Statistics" ) ) {
+        FrameStatisticsSummary summary;
+        compute_summary( summary );
+
+        ImGui::PlotLines( "Frame ms", frame_record_ms_getter, this, history_count, 0, nullptr, 0.f, summary.frame_p99_ms * 1.5f, { 0.f, 80.f } );
+
+        ImGui::Text( "Frame: avg %2.2fms, p50 %2.2fms, p95 %2.2fms, p99 %2.2fms, max %2.2fms", summary.frame_average_ms, summary.frame_p50_ms,
+                     summary.frame_p95_ms, summary.frame_p99_ms, summary.frame_max_ms );
+        ImGui::Text( "CPU busy %2.2fms, GPU %2.2fms, overlap %3.0f%%, GPU bound frames %u/%u", summary.cpu_busy_average_ms, summary.gpu_average_ms,
+                     summary.overlap * 100.f, summary.gpu_bound_frames, summary.frames );
+
+        if ( ImGui::BeginTable( "Frame phases", 4 ) ) {
+            ImGui::TableSetupColumn( "Phase" );
+            ImGui::TableSetupColumn( "Avg" );
+            ImGui::TableSetupColumn( "P95" );
+            ImGui::TableSetupColumn( "P99" );
+            ImGui::TableHeadersRow();
+
+            for ( u32 p = 0; p < FramePhase::Count; ++p ) {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::TextUnformatted( FramePhase::s_value_names[ p ] );
+                ImGui::TableNextColumn();
+                ImGui::Text( "%2.3f", summary.phase_average_ms[ p ] );
+                ImGui::TableNextColumn();
+                ImGui::Text( "%2.3f", summary.phase_p95_ms[ p ] );
+                ImGui::TableNextColumn();
+                ImGui::Text( "%2.3f", summary.phase_p99_ms[ p ] );
+            }
+
+            ImGui::EndTable();
+        }
+
+        ImGui::SliderFloat( "Hitch ratio", &hitch_ratio, 1.1f, 4.f );
+        ImGui::SliderFloat( "Hitch min delta ms", &hitch_min_delta_ms, 0.f, 33.f );
+
+        ImGui::Text( "Hitches %u", hitch_count );
+        const u32 kept_hitches = raptor::min( hitch_count, k_frame_statistics_max_hitches );
+        for ( u32 h = 0; h < kept_hitches; ++h ) {
+            const FrameHitch& hitch = hitches[ ( hitch_count - 1 - h ) % k_frame_statistics_max_hitches ];
+            ImGui::Text( "Frame %llu: %2.2fms (expected %2.2fms), %s %2.2fms (expected %2.2fms)", hitch.frame_number, hitch.frame_ms, hitch.expected_frame_ms,
+                         FramePhase::ToString( hitch.phase ), hitch.phase_ms, hitch.expected_phase_ms );
+        }
+
+        if ( ImGui::Button( "Export" ) ) {
+            write_json( "frame_statistics.json" );
+        }
+        ImGui::SameLine();
+        if ( ImGui::Button( "Reset" ) ) {
+            reset();
+        }
+    }
+    ImGui::End();
+}
+
+// FramePhaseScope ////////////////////////////////////////////////////////
+FramePhaseScope::FramePhaseScope( FrameStatistics* frame_statistics_, FramePhase::Enum phase_, u32 thread_index_ )
+    : frame_statistics( frame_statistics_ ), start_tick( frame_statistics_ ? time_now() : 0 ), thread_index( thread_index_ ), phase( phase_ ) {
+}
+
+FramePhaseScope::~FramePhaseScope() {
+    if ( frame_statistics ) {
+        frame_statistics->add_phase_time( thread_index, phase, time_now() - start_tick );
+    }
+}
+
+} // namespace raptor
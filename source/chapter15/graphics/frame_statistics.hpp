@@ -0,0 +1,165 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/platform.hpp"
+
+#include <atomic>
+#include <stdio.h>
+
+namespace raptor {
+
+struct Allocator;
+
+// Parts of the CPU frame. Phases running on other threads overlap the ones of the main thread.
+namespace FramePhase {
+    enum Enum : u8 {
+        PresentWait, Input, ImGui, Animation, SceneGraph, Upload, Recording, Physics, Submit, Count
+    };
+
+    static const char* s_value_names[] = {
+        "PresentWait", "Input", "ImGui", "Animation", "SceneGraph", "Upload", "Recording", "Physics", "Submit", "Count"
+    };
+
+    static const char* ToString( Enum e ) {
+        return ( ( u32 )e < Enum::Count ? s_value_names[ ( int )e ] : "unsupported" );
+    }
+} // namespace FramePhase
+
+static const u32                    k_frame_statistics_max_threads      = 64;
+static const u32                    k_frame_statistics_histogram_buckets = 128;
+static const f32                    k_frame_statistics_bucket_ms        = 0.5f;    // Last bucket counts everything slower.
+static const u32                    k_frame_statistics_max_hitches      = 32;
+
+//
+// Phase times of a thread in the current frame, in time ticks. On its own cache lines: threads add to their slot
+// without locks and without sharing lines, end_frame collects and clears them.
+struct alignas( 64 ) FrameThreadTimings {
+
+    std::atomic<i64>                ticks[ FramePhase::Count ];
+
+}; // struct FrameThreadTimings
+
+//
+//
+struct FrameRecord {
+
+    u64                             frame_number;
+
+    f32                             frame_ms;           // Between two end_frame calls.
+    f32                             gpu_ms;             // GPU frame time passed to end_frame, from the profiler.
+    f32                             phase_ms[ FramePhase::Count ];
+
+}; // struct FrameRecord
+
+//
+//
+struct FrameHitch {
+
+    u64                             frame_number;
+
+    f32                             frame_ms;
+    f32                             expected_frame_ms;  // Filtered frame time before the hitch.
+    f32                             phase_ms;
+    f32                             expected_phase_ms;
+
+    FramePhase::Enum                phase;              // Phase that grew the most.
+
+}; // struct FrameHitch
+
+//
+// Frame times of the recorded history. CPU busy time is the frame without the present wait: with CPU and GPU
+// working in parallel the frame lasts as the slowest of the two, when they serialize as their sum.
+struct FrameStatisticsSummary {
+
+    u32                             frames;
+
+    f32                             frame_min_ms;
+    f32                             frame_average_ms;
+    f32                             frame_p50_ms;
+    f32                             frame_p95_ms;
+    f32                             frame_p99_ms;
+    f32                             frame_max_ms;
+
+    f32                             phase_average_ms[ FramePhase::Count ];
+    f32                             phase_p95_ms[ FramePhase::Count ];
+    f32                             phase_p99_ms[ FramePhase::Count ];
+
+    f32                             gpu_average_ms;
+    f32                             cpu_busy_average_ms;
+    f32                             overlap;            // 1 when CPU and GPU work fully overlaps, 0 when serialized.
+
+    u32                             gpu_bound_frames;   // Frames waiting on present longer than gpu_bound_wait_ms.
+    u32                             cpu_bound_frames;
+
+}; // struct FrameStatisticsSummary
+
+//
+// Per frame CPU timings of the phases of the main loop, with a history for percentiles, a histogram of the frame
+// times since the last reset and hitch detection: frames slower than the filtered frame time by hitch_ratio and
+// hitch_min_delta_ms are attributed to the phase that grew the most over its own filtered time.
+struct FrameStatistics {
+
+    void                            init( Allocator* allocator, u32 history_frames, u32 num_threads );
+    void                            shutdown();
+
+    void                            reset();
+
+    // Lock free, from any thread.
+    void                            add_phase_time( u32 thread_index, FramePhase::Enum phase, i64 ticks );
+
+    // Once per frame on the main thread, after all the tasks adding phase times are done.
+    void                            end_frame( f32 gpu_ms );
+    void                            end_frame( f32 frame_ms, f32 gpu_ms );
+
+    const FrameRecord&              get_frame( u32 index ) const;       // From the oldest.
+
+    void                            compute_summary( FrameStatisticsSummary& out_summary ) const;
+
+    bool                            write_json( cstring path ) const;
+    void                            write_json( FILE* file ) const;
+
+    void                            imgui_draw();
+
+    FrameThreadTimings*             thread_timings      = nullptr;
+    Array<FrameRecord>              history;
+    u32                             histogram[ k_frame_statistics_histogram_buckets ];
+
+    FrameHitch                      hitches[ k_frame_statistics_max_hitches ];
+    u32                             hitch_count         = 0;            // Since the last reset, the last k_frame_statistics_max_hitches are kept.
+
+    Allocator*                      allocator           = nullptr;
+
+    i64                             last_frame_tick     = 0;
+    u64                             frame_number        = 0;
+
+    u32                             num_threads         = 0;
+    u32                             history_frames      = 0;
+    u32                             history_count       = 0;
+    u32                             history_next        = 0;
+
+    f32                             filtered_frame_ms   = 0.f;
+    f32                             filtered_phase_ms[ FramePhase::Count ];
+
+    f32                             smoothing           = 0.05f;        // Weight of a new frame in the filtered times.
+    f32                             hitch_ratio         = 1.5f;
+    f32                             hitch_min_delta_ms  = 4.f;
+    f32                             gpu_bound_wait_ms   = 0.5f;
+    u32                             warmup_frames       = 10;           // Frames without hitch detection after a reset.
+
+}; // struct FrameStatistics
+
+//
+// Adds the time of the scope to a phase of the thread.
+struct FramePhaseScope {
+
+    FramePhaseScope( FrameStatistics* frame_statistics, FramePhase::Enum phase, u32 thread_index = 0 );
+    ~FramePhaseScope();
+
+    FrameStatistics*                frame_statistics;
+    i64                             start_tick;
+    u32                             thread_index;
+    FramePhase::Enum                phase;
+
+}; // struct FramePhaseScope
+
+} // namespace raptor
@@ -0,0 +1,472 @@
+#include "graphics/froxel_light_assigner.hpp"
+
+#include "foundation/assert.hpp"
+
+#include "external/cglm/struct/mat4.h"
+
+#include <float.h>
+#include <math.h>
+
+namespace raptor {
+
+static f32 froxel_min( f32 a, f32 b ) {
+    return a < b ? a : b;
+}
+
+static f32 froxel_max( f32 a, f32 b ) {
+    return a > b ? a : b;
+}
+
+// Clamps before converting, values can be far outside of the grid.
+static i32 froxel_floor( f32 value, u32 dimension ) {
+    value = froxel_max( -1.f, froxel_min( value, ( f32 )dimension ) );
+    return ( i32 )floorf( value );
+}
+
+static i32 froxel_ceil( f32 value, u32 dimension ) {
+    value = froxel_max( -1.f, froxel_min( value, ( f32 )dimension ) );
+    return ( i32 )ceilf( value );
+}
+
+// Distance of a coordinate outside of a range, zero inside.
+static f32 froxel_axis_distance( f32 value, f32 range_min, f32 range_max ) {
+    return value < range_min ? range_min - value : ( value > range_max ? value - range_max : 0.f );
+}
+
+static bool sphere_box_overlap( const vec4s& sphere, const vec3s& box_min, const vec3s& box_max ) {
+    const f32 dx = froxel_axis_distance( sphere.x, box_min.x, box_max.x );
+    const f32 dy = froxel_axis_distance( sphere.y, box_min.y, box_max.y );
+    const f32 dz = froxel_axis_distance( sphere.z, box_min.z, box_max.z );
+    return dx * dx + dy * dy + dz * dz <= sphere.w * sphere.w;
+}
+
+static bool box_box_overlap( const vec3s& a_min, const vec3s& a_max, const vec3s& b_min, const vec3s& b_max ) {
+    return a_min.x <= b_max.x && a_max.x >= b_min.x &&
+           a_min.y <= b_max.y && a_max.y >= b_min.y &&
+           a_min.z <= b_max.z && a_max.z >= b_min.z;
+}
+
+// Highest NDC of the low edge of a froxel that can reach a view space coordinate, for a slice between near and far depth.
+static f32 froxel_max_low_edge( f32 view_coordinate, f32 projection, f32 near_depth, f32 far_depth ) {
+    return view_coordinate * projection / ( view_coordinate >= 0.f ? near_depth : far_depth );
+}
+
+// Lowest NDC of the high edge of a froxel that can reach a view space coordinate.
+static f32 froxel_min_high_edge( f32 view_coordinate, f32 projection, f32 near_depth, f32 far_depth ) {
+    return view_coordinate * projection / ( view_coordinate >= 0.f ? far_depth : near_depth );
+}
+
+// Slices touched by a depth range, padded by one: froxels are tested after.
+static u32 froxel_slice_range( f32 min_depth, f32 max_depth, f32 near_z, f32 far_z, u32 dimension_z, f32 z_jitter ) {
+    if ( max_depth <= 0.f ) {
+        return u32_max;
+    }
+
+    const f32 slices_scale = dimension_z / logf( far_z / near_z );
+    const f32 min_slice = min_depth > 0.f ? logf( min_depth / near_z ) * slices_scale : -( f32 )dimension_z;
+    const f32 max_slice = logf( max_depth / near_z ) * slices_scale;
+
+    const i32 first = froxel_ceil( min_slice - 0.5f - z_jitter, dimension_z ) - 1;
+    const i32 last = froxel_floor( max_slice - 0.5f + z_jitter, dimension_z ) + 1;
+    if ( last < 0 || first >= ( i32 )dimension_z ) {
+        return u32_max;
+    }
+
+    const u32 first_slice = first < 0 ? 0 : first;
+    const u32 last_slice = last >= ( i32 )dimension_z ? dimension_z - 1 : last;
+    return first_slice | ( last_slice << 16 );
+}
+
+// FroxelLightTask ////////////////////////////////////////////////////////
+
+void FroxelLightTask::ExecuteRange( enki::TaskSetPartition range, uint32_t ) {
+    for ( u32 slice = range.start; slice < range.end; ++slice ) {
+        assigner->process_slice( slice, write );
+    }
+}
+
+// FroxelLightAssigner ////////////////////////////////////////////////////
+
+void FroxelLightAssigner::init( Allocator* allocator_, u32 initial_lights ) {
+    allocator = allocator_;
+
+    light_offsets.init( allocator, 16 );
+    light_indices.init( allocator, initial_lights );
+    volume_offsets.init( allocator, 16 );
+    volume_indices.init( allocator, 16 );
+
+    column_edges.init( allocator, 16 );
+    row_edges.init( allocator, 16 );
+    slice_edges.init( allocator, 16 );
+
+    view_spheres.init( allocator, initial_lights );
+    view_volumes.init( allocator, 16 );
+    light_slices.init( allocator, initial_lights );
+    volume_slices.init( allocator, 16 );
+    slice_light_counts.init( allocator, 16 );
+    slice_volume_counts.init( allocator, 16 );
+
+    stats = FroxelLightStats();
+}
+
+void FroxelLightAssigner::shutdown() {
+    light_offsets.shutdown();
+    light_indices.shutdown();
+    volume_offsets.shutdown();
+    volume_indices.shutdown();
+
+    column_edges.shutdown();
+    row_edges.shutdown();
+    slice_edges.shutdown();
+
+    view_spheres.shutdown();
+    view_volumes.shutdown();
+    light_slices.shutdown();
+    volume_slices.shutdown();
+    slice_light_counts.shutdown();
+    slice_volume_counts.shutdown();
+}
+
+void FroxelLightAssigner::set_grid( u32 dimension_x_, u32 dimension_y_, u32 dimension_z_, f32 near_z_, f32 far_z_,
+                                    f32 projection_00_, f32 projection_11_, f32 xy_jitter_, f32 z_jitter_ ) {
+    RASSERT( dimension_x_ && dimension_y_ && dimension_z_ && dimension_z_ <= 0xffff );
+    RASSERT( dimension_x_ <= k_froxel_max_dimension && dimension_y_ <= k_froxel_max_dimension );
+    RASSERTM( projection_00_ > 0.f && projection_11_ > 0.f && near_z_ > 0.f && far_z_ > near_z_, "Froxels need a perspective projection" );
+
+    dimension_x = dimension_x_;
+    dimension_y = dimension_y_;
+    dimension_z = dimension_z_;
+    near_z = near_z_;
+    far_z = far_z_;
+    projection_00 = projection_00_;
+    projection_11 = projection_11_;
+    // Froxels cover at least their own cell.
+    xy_jitter = froxel_max( xy_jitter_, 0.5f );
+    z_jitter = froxel_max( z_jitter_, 0.5f );
+
+    column_edges.set_size( dimension_x * 2 );
+    for ( u32 x = 0; x < dimension_x; ++x ) {
+        column_edges[ x * 2 ] = ( x + 0.5f - xy_jitter ) / dimension_x * 2.f - 1.f;
+        column_edges[ x * 2 + 1 ] = ( x + 0.5f + xy_jitter ) / dimension_x * 2.f - 1.f;
+    }
+
+    // Rows go down the screen, NDC y goes up.
+    row_edges.set_size( dimension_y * 2 );
+    for ( u32 y = 0; y < dimension_y; ++y ) {
+        row_edges[ y * 2 ] = 1.f - ( y + 0.5f + xy_jitter ) / dimension_y * 2.f;
+        row_edges[ y * 2 + 1 ] = 1.f - ( y + 0.5f - xy_jitter ) / dimension_y * 2.f;
+    }
+
+    slice_edges.set_size( dimension_z * 2 );
+    for ( u32 z = 0; z < dimension_z; ++z ) {
+        slice_edges[ z * 2 ] = near_z * powf( far_z / near_z, ( z + 0.5f - z_jitter ) / dimension_z );
+        slice_edges[ z * 2 + 1 ] = near_z * powf( far_z / near_z, ( z + 0.5f + z_jitter ) / dimension_z );
+    }
+
+    slice_light_counts.set_size( dimension_z );
+    slice_volume_counts.set_size( dimension_z );
+}
+
+// View space range of a column or a row between two NDC edges, for a slice between near and far depth.
+static void froxel_edges_range( f32 low_edge, f32 high_edge, f32 projection, f32 near_depth, f32 far_depth, f32& out_min, f32& out_max ) {
+    out_min = froxel_min( low_edge * near_depth, low_edge * far_depth ) / projection;
+    out_max = froxel_max( high_edge * near_depth, high_edge * far_depth ) / projection;
+}
+
+void FroxelLightAssigner::froxel_bounds( u32 x, u32 y, u32 slice, vec3s& out_min, vec3s& out_max ) const {
+    const f32 near_depth = slice_edges[ slice * 2 ];
+    const f32 far_depth = slice_edges[ slice * 2 + 1 ];
+
+    froxel_edges_range( column_edges[ x * 2 ], column_edges[ x * 2 + 1 ], projection_00, near_depth, far_depth, out_min.x, out_max.x );
+    froxel_edges_range( row_edges[ y * 2 ], row_edges[ y * 2 + 1 ], projection_11, near_depth, far_depth, out_min.y, out_max.y );
+    out_min.z = near_depth;
+    out_max.z = far_depth;
+}
+
+void FroxelLightAssigner::process_slice( u32 slice, bool write ) {
+    const u32 slice_size = dimension_x * dimension_y;
+    const u32 first_froxel = slice * slice_size;
+
+    const f32 near_depth = slice_edges[ slice * 2 ];
+    const f32 far_depth = slice_edges[ slice * 2 + 1 ];
+
+    // Counts are stored after the froxel. When writing they become the first index of the froxel and are moved
+    // to the end of its list while writing, which is the first index of the next froxel.
+    u32 running_lights = slice_light_counts[ slice ];
+    u32 running_volumes = slice_volume_counts[ slice ];
+    for ( u32 f = first_froxel; f < first_froxel + slice_size; ++f ) {
+        if ( write ) {
+            const u32 lights = light_offsets[ f + 1 ];
+            light_offsets[ f + 1 ] = running_lights;
+            running_lights += lights;
+
+            const u32 volumes = volume_offsets[ f + 1 ];
+            volume_offsets[ f + 1 ] = running_volumes;
+            running_volumes += volumes;
+        } else {
+            light_offsets[ f + 1 ] = 0;
+            volume_offsets[ f + 1 ] = 0;
+        }
+    }
+
+    // Ranges of the columns and the rows in this slice, the same for all the items.
+    f32 columns_range[ k_froxel_max_dimension * 2 ];
+    f32 rows_range[ k_froxel_max_dimension * 2 ];
+    for ( u32 x = 0; x < dimension_x; ++x ) {
+        froxel_edges_range( column_edges[ x * 2 ], column_edges[ x * 2 + 1 ], projection_00, near_depth, far_depth, columns_range[ x * 2 ], columns_range[ x * 2 + 1 ] );
+    }
+    for ( u32 y = 0; y < dimension_y; ++y ) {
+        froxel_edges_range( row_edges[ y * 2 ], row_edges[ y * 2 + 1 ], projection_11, near_depth, far_depth, rows_range[ y * 2 ], rows_range[ y * 2 + 1 ] );
+    }
+
+    u32 slice_lights = 0;
+    u32 slice_volumes = 0;
+
+    const u32 num_items = view_spheres.size + view_volumes.size / 2;
+    for ( u32 i = 0; i < num_items; ++i ) {
+        const bool is_light = i < view_spheres.size;
+        const u32 item = is_light ? i : i - view_spheres.size;
+
+        const u32 slices = is_light ? light_slices[ item ] : volume_slices[ item ];
+        if ( slices == u32_max || slice < ( slices & 0xffff ) || slice > ( slices >> 16 ) ) {
+            continue;
+        }
+
+        vec3s item_min, item_max;
+        if ( is_light ) {
+            const vec4s& sphere = view_spheres[ item ];
+            item_min = { sphere.x - sphere.w, sphere.y - sphere.w, sphere.z - sphere.w };
+            item_max = { sphere.x + sphere.w, sphere.y + sphere.w, sphere.z + sphere.w };
+        } else {
+            item_min = view_volumes[ item * 2 ];
+            item_max = view_volumes[ item * 2 + 1 ];
+        }
+
+        // Columns and rows whose froxel boxes can reach the item, padded by one.
+        const f32 max_left = froxel_max_low_edge( item_max.x, projection_00, near_depth, far_depth );
+        const f32 min_right = froxel_min_high_edge( item_min.x, projection_00, near_depth, far_depth );
+        const f32 max_bottom = froxel_max_low_edge( item_max.y, projection_11, near_depth, far_depth );
+        const f32 min_top = froxel_min_high_edge( item_min.y, projection_11, near_depth, far_depth );
+
+        const i32 first_x = froxel_ceil( ( min_right + 1.f ) * 0.5f * dimension_x - 0.5f - xy_jitter, dimension_x ) - 1;
+        const i32 last_x = froxel_floor( ( max_left + 1.f ) * 0.5f * dimension_x - 0.5f + xy_jitter, dimension_x ) + 1;
+        const i32 first_y = froxel_ceil( ( 1.f - max_bottom ) * 0.5f * dimension_y - 0.5f - xy_jitter, dimension_y ) - 1;
+        const i32 last_y = froxel_floor( ( 1.f - min_top ) * 0.5f * dimension_y - 0.5f + xy_jitter, dimension_y ) + 1;
+
+        if ( last_x < 0 || last_y < 0 ) {
+            continue;
+        }
+
+        const u32 x_begin = first_x < 0 ? 0 : first_x;
+        const u32 x_end = last_x >= ( i32 )dimension_x ? dimension_x - 1 : last_x;
+        const u32 y_begin = first_y < 0 ? 0 : first_y;
+        const u32 y_end = last_y >= ( i32 )dimension_y ? dimension_y - 1 : last_y;
+
+        // Same tests as sphere_box_overlap and box_box_overlap, split by axis.
+        const vec4s sphere = is_light ? view_spheres[ item ] : vec4s{ 0.f, 0.f, 0.f, 0.f };
+        const f32 radius2 = is_light ? sphere.w * sphere.w : 0.f;
+        const f32 dz = is_light ? froxel_axis_distance( sphere.z, near_depth, far_depth ) : 0.f;
+        const f32 dz2 = dz * dz;
+        if ( !is_light && ( item_min.z > far_depth || item_max.z < near_depth ) ) {
+            continue;
+        }
+
+        for ( u32 y = y_begin; y <= y_end; ++y ) {
+            const f32 row_min = rows_range[ y * 2 ];
+            const f32 row_max = rows_range[ y * 2 + 1 ];
+
+            f32 dy2 = 0.f;
+            if ( is_light ) {
+                const f32 dy = froxel_axis_distance( sphere.y, row_min, row_max );
+                dy2 = dy * dy;
+                if ( dy2 + dz2 > radius2 ) {
+                    continue;
+                }
+            } else if ( item_min.y > row_max || item_max.y < row_min ) {
+                continue;
+            }
+
+            for ( u32 x = x_begin; x <= x_end; ++x ) {
+                const f32 column_min = columns_range[ x * 2 ];
+                const f32 column_max = columns_range[ x * 2 + 1 ];
+
+                if ( is_light ) {
+                    const f32 dx = froxel_axis_distance( sphere.x, column_min, column_max );
+                    if ( dx * dx + dy2 + dz2 > radius2 ) {
+                        continue;
+                    }
+                } else if ( item_min.x > column_max || item_max.x < column_min ) {
+                    continue;
+                }
+
+                const u32 f = froxel_index( x, y, slice );
+                if ( is_light ) {
+                    if ( write ) {
+                        light_indices[ light_offsets[ f + 1 ]++ ] = item;
+                    } else {
+                        ++light_offsets[ f + 1 ];
+                        ++slice_lights;
+                    }
+                } else {
+                    if ( write ) {
+                        volume_indices[ volume_offsets[ f + 1 ]++ ] = item;
+                    } else {
+                        ++volume_offsets[ f + 1 ];
+                        ++slice_volumes;
+                    }
+                }
+            }
+        }
+    }
+
+    if ( !write ) {
+        slice_light_counts[ slice ] = slice_lights;
+        slice_volume_counts[ slice ] = slice_volumes;
+    }
+}
+
+// Transforms the lights and the volumes in view space, looking down +z, and finds the slices they touch.
+static void froxel_prepare( FroxelLightAssigner& assigner, const mat4s& world_to_camera, const vec4s* light_spheres, u32 num_lights,
+                            const FroxelVolume* volumes, u32 num_volumes ) {
+    assigner.view_spheres.set_size( num_lights );
+    assigner.light_slices.set_size( num_lights );
+    assigner.view_volumes.set_size( num_volumes * 2 );
+    assigner.volume_slices.set_size( num_volumes );
+
+    assigner.stats = FroxelLightStats();
+    assigner.stats.froxels = assigner.froxel_count();
+    assigner.stats.volumes = num_volumes;
+
+    for ( u32 l = 0; l < num_lights; ++l ) {
+        const vec4s& sphere = light_spheres[ l ];
+        const vec4s view_position = glms_mat4_mulv( world_to_camera, vec4s{ sphere.x, sphere.y, sphere.z, 1.f } );
+
+        const vec4s view_sphere = { view_position.x, view_position.y, view_position.z, sphere.w };
+        assigner.view_spheres[ l ] = view_sphere;
+        assigner.light_slices[ l ] = froxel_slice_range( view_sphere.z - sphere.w, view_sphere.z + sphere.w, assigner.near_z, assigner.far_z,
+                                                         assigner.dimension_z, assigner.z_jitter );
+        assigner.stats.lights += assigner.light_slices[ l ] != u32_max ? 1 : 0;
+    }
+
+    for ( u32 v = 0; v < num_volumes; ++v ) {
+        const FroxelVolume& volume = volumes[ v ];
+
+        vec3s view_min = { FLT_MAX, FLT_MAX, FLT_MAX };
+        vec3s view_max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for ( u32 c = 0; c < 8; ++c ) {
+            const vec4s corner = { ( c & 1 ) ? volume.aabb_max.x : volume.aabb_min.x, ( c & 2 ) ? volume.aabb_max.y : volume.aabb_min.y,
+                                   ( c & 4 ) ? volume.aabb_max.z : volume.aabb_min.z, 1.f };
+            const vec4s view_corner = glms_mat4_mulv( world_to_camera, corner );
+
+            view_min = { froxel_min( view_min.x, view_corner.x ), froxel_min( view_min.y, view_corner.y ), froxel_min( view_min.z, view_corner.z ) };
+            view_max = { froxel_max( view_max.x, view_corner.x ), froxel_max( view_max.y, view_corner.y ), froxel_max( view_max.z, view_corner.z ) };
+        }
+
+        assigner.view_volumes[ v * 2 ] = view_min;
+        assigner.view_volumes[ v * 2 + 1 ] = view_max;
+        assigner.volume_slices[ v ] = froxel_slice_range( view_min.z, view_max.z, assigner.near_z, assigner.far_z, assigner.dimension_z, assigner.z_jitter );
+    }
+
+    assigner.light_offsets.set_size( assigner.froxel_count() + 1 );
+    assigner.volume_offsets.set_size( assigner.froxel_count() + 1 );
+    assigner.light_offsets[ 0 ] = 0;
+    assigner.volume_offsets[ 0 ] = 0;
+}
+
+static void froxel_finish_stats( FroxelLightAssigner& assigner, u32 num_lights ) {
+    FroxelLightStats& stats = assigner.stats;
+    stats.light_pairs = assigner.light_indices.size;
+    stats.volume_pairs = assigner.volume_indices.size;
+
+    for ( u32 f = 0; f < stats.froxels; ++f ) {
+        const u32 lights = assigner.light_offsets[ f + 1 ] - assigner.light_offsets[ f ];
+        const u32 volumes = assigner.volume_offsets[ f + 1 ] - assigner.volume_offsets[ f ];
+
+        stats.max_lights_per_froxel = lights > stats.max_lights_per_froxel ? lights : stats.max_lights_per_froxel;
+        stats.empty_froxels += ( lights + volumes ) == 0 ? 1 : 0;
+    }
+
+    // Without lists each froxel evaluates all the lights.
+    stats.average_lights_per_froxel = stats.froxels ? stats.light_pairs / ( f32 )stats.froxels : 0.f;
+    stats.light_tests_saved_per_froxel = num_lights - stats.average_lights_per_froxel;
+}
+
+void FroxelLightAssigner::assign( const mat4s& world_to_camera, const vec4s* light_spheres, u32 num_lights,
+                                  const FroxelVolume* volumes, u32 num_volumes, enki::TaskScheduler* task_scheduler ) {
+    froxel_prepare( *this, world_to_camera, light_spheres, num_lights, volumes, num_volumes );
+
+    FroxelLightTask task;
+    task.m_SetSize = dimension_z;
+    task.m_MinRange = 1;
+    task.assigner = this;
+
+    const bool parallel = task_scheduler && dimension_z >= min_parallel_slices;
+
+    // Count, then write each slice after the previous ones.
+    for ( u32 pass = 0; pass < 2; ++pass ) {
+        task.write = pass == 1;
+
+        if ( parallel ) {
+            task_scheduler->AddTaskSetToPipe( &task );
+            task_scheduler->WaitforTask( &task );
+        } else {
+            task.ExecuteRange( { 0, dimension_z }, 0 );
+        }
+
+        if ( pass == 0 ) {
+            u32 total_lights = 0;
+            u32 total_volumes = 0;
+            for ( u32 z = 0; z < dimension_z; ++z ) {
+                const u32 slice_lights = slice_light_counts[ z ];
+                slice_light_counts[ z ] = total_lights;
+                total_lights += slice_lights;
+
+                const u32 slice_volumes = slice_volume_counts[ z ];
+                slice_volume_counts[ z ] = total_volumes;
+                total_volumes += slice_volumes;
+            }
+
+            light_indices.set_size( total_lights );
+            volume_indices.set_size( total_volumes );
+        }
+    }
+
+    froxel_finish_stats( *this, num_lights );
+}
+
+void FroxelLightAssigner::assign_reference( const mat4s& world_to_camera, const vec4s* light_spheres, u32 num_lights,
+                                            const FroxelVolume* volumes, u32 num_volumes ) {
+    froxel_prepare( *this, world_to_camera, light_spheres, num_lights, volumes, num_volumes );
+
+    light_indices.clear();
+    volume_indices.clear();
+
+    for ( u32 z = 0; z < dimension_z; ++z ) {
+        for ( u32 y = 0; y < dimension_y; ++y ) {
+            for ( u32 x = 0; x < dimension_x; ++x ) {
+                vec3s froxel_min_bounds, froxel_max_bounds;
+                froxel_bounds( x, y, z, froxel_min_bounds, froxel_max_bounds );
+
+                for ( u32 l = 0; l < num_lights; ++l ) {
+                    if ( sphere_box_overlap( view_spheres[ l ], froxel_min_bounds, froxel_max_bounds ) ) {
+                        light_indices.push( l );
+                    }
+                }
+
+                for ( u32 v = 0; v < num_volumes; ++v ) {
+                    if ( box_box_overlap( view_volumes[ v * 2 ], view_volumes[ v * 2 + 1 ], froxel_min_bounds, froxel_max_bounds ) ) {
+                        volume_indices.push( v );
+                    }
+                }
+
+                const u32 f = froxel_index( x, y, z );
+                light_offsets[ f + 1 ] = light_indices.size;
+                volume_offsets[ f + 1 ] = volume_indices.size;
+            }
+        }
+    }
+
+    froxel_finish_stats( *this, num_lights );
+}
+
+} // namespace raptor
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/platform.hpp"
+
+#include "external/cglm/types-struct.h"
+#include "external/enkiTS/TaskScheduler.h"
+
+namespace raptor {
+
+struct Allocator;
+struct FroxelLightAssigner;
+
+static const u32                    k_froxel_max_dimension      = 1024;     // Columns or rows of the grid.
+
+//
+// World space box of local fog density.
+struct FroxelVolume {
+
+    vec3s                           aabb_min;
+    vec3s                           aabb_max;
+
+}; // struct FroxelVolume
+
+//
+//
+struct FroxelLightStats {
+
+    u32                             froxels                 = 0;
+    u32                             lights                  = 0;    // Lights in front of the camera.
+    u32                             volumes                 = 0;
+
+    u32                             light_pairs             = 0;    // Froxel and light.
+    u32                             volume_pairs            = 0;
+    u32                             max_lights_per_froxel   = 0;
+    u32                             empty_froxels           = 0;    // No light and no volume.
+
+    // Lights evaluated per froxel with the lists, against all the lights evaluated without them.
+    f32                             average_lights_per_froxel   = 0.f;
+    f32                             light_tests_saved_per_froxel = 0.f;
+
+}; // struct FroxelLightStats
+
+//
+// Counts or writes the lists of a range of slices.
+struct FroxelLightTask : public enki::ITaskSet {
+
+    void                            ExecuteRange( enki::TaskSetPartition range, uint32_t thread_index ) override;
+
+    FroxelLightAssigner*            assigner                = nullptr;
+    bool                            write                   = false;
+
+}; // struct FroxelLightTask
+
+//
+// Builds per froxel lists of the lights and of the density volumes touching each froxel of the volumetric fog grid,
+// stored compacted: the lists of froxel f are between offsets[ f ] and offsets[ f + 1 ].
+// Froxels are indexed x + y * dimension_x + slice * dimension_x * dimension_y, slices are distributed exponentially
+// between near and far like slice_to_exponential_depth in the shaders. Froxels are tested as view space boxes,
+// enlarged by the jitter of the sample positions: jitter is the offset from the center of the froxel, in froxels.
+// assign is meant to be the reference for a GPU version, assign_reference tests every froxel against every light.
+struct FroxelLightAssigner {
+
+    void                            init( Allocator* allocator, u32 initial_lights );
+    void                            shutdown();
+
+    void                            set_grid( u32 dimension_x, u32 dimension_y, u32 dimension_z, f32 near_z, f32 far_z,
+                                              f32 projection_00, f32 projection_11, f32 xy_jitter, f32 z_jitter );
+
+    // Spheres are world space center and radius.
+    void                            assign( const mat4s& world_to_camera, const vec4s* light_spheres, u32 num_lights,
+                                            const FroxelVolume* volumes, u32 num_volumes, enki::TaskScheduler* task_scheduler );
+    void                            assign_reference( const mat4s& world_to_camera, const vec4s* light_spheres, u32 num_lights,
+                                                      const FroxelVolume* volumes, u32 num_volumes );
+
+    u32                             froxel_index( u32 x, u32 y, u32 slice ) const   { return x + y * dimension_x + slice * dimension_x * dimension_y; }
+    u32                             froxel_count() const                            { return dimension_x * dimension_y * dimension_z; }
+
+    // View space box of a froxel, views look down +z.
+    void                            froxel_bounds( u32 x, u32 y, u32 slice, vec3s& out_min, vec3s& out_max ) const;
+
+    void                            process_slice( u32 slice, bool write );
+
+    // Results
+    Array<u32>                      light_offsets;          // froxel_count() + 1.
+    Array<u32>                      light_indices;
+    Array<u32>                      volume_offsets;
+    Array<u32>                      volume_indices;
+
+    FroxelLightStats                stats;
+
+    // Grid edges, in NDC for columns and rows and in view depth for slices.
+    Array<f32>                      column_edges;           // Left and right of each column.
+    Array<f32>                      row_edges;              // Bottom and top of each row.
+    Array<f32>                      slice_edges;            // Near and far of each slice.
+
+    // View space spheres and boxes of the current assignment, with their slice ranges.
+    Array<vec4s>                    view_spheres;
+    Array<vec3s>                    view_volumes;           // Min and max.
+    Array<u32>                      light_slices;           // First and last slice, u32_max when not visible.
+    Array<u32>                      volume_slices;
+    Array<u32>                      slice_light_counts;
+    Array<u32>                      slice_volume_counts;
+
+    Allocator*                      allocator               = nullptr;
+
+    u32                             dimension_x             = 0;
+    u32                             dimension_y             = 0;
+    u32                             dimension_z             = 0;
+    f32                             near_z                  = 0.f;
+    f32                             far_z                   = 0.f;
+    f32                             projection_00           = 1.f;
+    f32                             projection_11           = 1.f;
+    f32                             xy_jitter               = 0.5f;
+    f32                             z_jitter                = 0.5f;
+
+    u32                             min_parallel_slices     = 4;
+
+}; // struct FroxelLightAssigner
+
+} // namespace raptor
@@ -0,0 +1,553 @@
+#include "graphics/geometry_compression.hpp"
+
+#include "foundation/file.hpp"
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+
+#include "external/meshoptimizer/meshoptimizer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace raptor {
+
+static const u32                    k_geometry_magic                = 0x4743504d;   // 'MPCG'
+static const u32                    k_geometry_version              = 1;
+static const sizet                  k_geometry_raw_chunk_size       = rmega( 1 );
+
+static u32 accessor_element_size( const glTF::Accessor& accessor ) {
+    u32 component_size = 0;
+    switch ( accessor.component_type ) {
+        case glTF::Accessor::BYTE:
+        case glTF::Accessor::UNSIGNED_BYTE:
+            component_size = 1;
+            break;
+        case glTF::Accessor::SHORT:
+        case glTF::Accessor::UNSIGNED_SHORT:
+            component_size = 2;
+            break;
+        case glTF::Accessor::UNSIGNED_INT:
+        case glTF::Accessor::FLOAT:
+            component_size = 4;
+            break;
+    }
+
+    static const u32 s_component_count[] = { 1, 2, 3, 4, 4, 9, 16 };
+    return component_size * s_component_count[ accessor.type ];
+}
+
+static bool primitive_is_triangle_list( const glTF::MeshPrimitive& primitive ) {
+    return primitive.mode == glTF::INVALID_INT_VALUE || primitive.mode == 4;
+}
+
+static u32 view_stride( const glTF::BufferView& view, u32 element_size ) {
+    return view.byte_stride == glTF::INVALID_INT_VALUE ? element_size : ( u32 )view.byte_stride;
+}
+
+static int sorting_stream_fn( const void* a, const void* b ) {
+    const GeometryStream* sa = ( const GeometryStream* )a;
+    const GeometryStream* sb = ( const GeometryStream* )b;
+
+    if ( sa->offset < sb->offset ) return -1;
+    else if ( sa->offset > sb->offset ) return 1;
+    // Bigger stream first, so that contained ones are dropped.
+    else if ( sa->element_size * sa->element_count > sb->element_size * sb->element_count ) return -1;
+    else if ( sa->element_size * sa->element_count < sb->element_size * sb->element_count ) return 1;
+    return 0;
+}
+
+// Encoding ///////////////////////////////////////////////////////////////
+
+u32 geometry_optimize_gltf( glTF::glTF& gltf_scene, u8** buffers_data, Allocator* temp_allocator ) {
+    if ( gltf_scene.accessors_count == 0 ) {
+        return 0;
+    }
+
+    // Reordering vertices is safe only if no one else reads the same accessors.
+    Array<u32> accessor_references;
+    accessor_references.init( temp_allocator, gltf_scene.accessors_count, gltf_scene.accessors_count );
+    memset( accessor_references.data, 0, accessor_references.size_in_bytes() );
+
+    for ( u32 m = 0; m < gltf_scene.meshes_count; ++m ) {
+        const glTF::Mesh& mesh = gltf_scene.meshes[ m ];
+        for ( u32 p = 0; p < mesh.primitives_count; ++p ) {
+            const glTF::MeshPrimitive& primitive = mesh.primitives[ p ];
+            if ( primitive.indices != glTF::INVALID_INT_VALUE ) {
+                ++accessor_references[ primitive.indices ];
+            }
+            for ( u32 a = 0; a < primitive.attribute_count; ++a ) {
+                ++accessor_references[ primitive.attributes[ a ].accessor_index ];
+            }
+        }
+    }
+    for ( u32 s = 0; s < gltf_scene.skins_count; ++s ) {
+        if ( gltf_scene.skins[ s ].inverse_bind_matrices_buffer_index != glTF::INVALID_INT_VALUE ) {
+            ++accessor_references[ gltf_scene.skins[ s ].inverse_bind_matrices_buffer_index ];
+        }
+    }
+    for ( u32 a = 0; a < gltf_scene.animations_count; ++a ) {
+        const glTF::Animation& animation = gltf_scene.animations[ a ];
+        for ( u32 s = 0; s < animation.samplers_count; ++s ) {
+            ++accessor_references[ animation.samplers[ s ].input_keyframe_buffer_index ];
+            ++accessor_references[ animation.samplers[ s ].output_keyframe_buffer_index ];
+        }
+    }
+
+    u32 optimized_primitives = 0;
+
+    for ( u32 m = 0; m < gltf_scene.meshes_count; ++m ) {
+        const glTF::Mesh& mesh = gltf_scene.meshes[ m ];
+        for ( u32 p = 0; p < mesh.primitives_count; ++p ) {
+            const glTF::MeshPrimitive& primitive = mesh.primitives[ p ];
+            if ( !primitive_is_triangle_list( primitive ) || primitive.indices == glTF::INVALID_INT_VALUE || primitive.attribute_count == 0 ) {
+                continue;
+            }
+
+            const glTF::Accessor& indices_accessor = gltf_scene.accessors[ primitive.indices ];
+            const u32 index_size = accessor_element_size( indices_accessor );
+            if ( ( index_size != 2 && index_size != 4 ) || accessor_references[ primitive.indices ] != 1 || indices_accessor.count % 3 != 0 ) {
+                continue;
+            }
+
+            const u32 vertex_count = gltf_scene.accessors[ primitive.attributes[ 0 ].accessor_index ].count;
+
+            bool can_optimize = true;
+            for ( u32 a = 0; a < primitive.attribute_count && can_optimize; ++a ) {
+                const i32 accessor_index = primitive.attributes[ a ].accessor_index;
+                const glTF::Accessor& accessor = gltf_scene.accessors[ accessor_index ];
+                const glTF::BufferView& view = gltf_scene.buffer_views[ accessor.buffer_view ];
+                const u32 element_size = accessor_element_size( accessor );
+
+                can_optimize = accessor_references[ accessor_index ] == 1 && ( u32 )accessor.count == vertex_count &&
+                               view_stride( view, element_size ) == element_size && buffers_data[ view.buffer ] != nullptr;
+            }
+
+            const glTF::BufferView& indices_view = gltf_scene.buffer_views[ indices_accessor.buffer_view ];
+            if ( !can_optimize || buffers_data[ indices_view.buffer ] == nullptr ) {
+                continue;
+            }
+
+            const u32 index_count = indices_accessor.count;
+            u8* index_data = buffers_data[ indices_view.buffer ] + glTF::get_data_offset( indices_accessor.byte_offset, indices_view.byte_offset );
+
+            u32* indices = ( u32* )ralloca( sizeof( u32 ) * index_count, temp_allocator );
+            for ( u32 i = 0; i < index_count; ++i ) {
+                indices[ i ] = index_size == 2 ? ( ( u16* )index_data )[ i ] : ( ( u32* )index_data )[ i ];
+            }
+
+            meshopt_optimizeVertexCache( indices, indices, index_count, vertex_count );
+
+            u32* remap = ( u32* )ralloca( sizeof( u32 ) * vertex_count, temp_allocator );
+            u32 next_vertex = ( u32 )meshopt_optimizeVertexFetchRemap( remap, indices, index_count, vertex_count );
+
+            // Keep unreferenced vertices at the end, so that accessors still cover the same data.
+            for ( u32 v = 0; v < vertex_count; ++v ) {
+                if ( remap[ v ] == u32_max ) {
+                    remap[ v ] = next_vertex++;
+                }
+            }
+
+            meshopt_remapIndexBuffer( indices, indices, index_count, remap );
+
+            for ( u32 i = 0; i < index_count; ++i ) {
+                if ( index_size == 2 ) {
+                    ( ( u16* )index_data )[ i ] = ( u16 )indices[ i ];
+                } else {
+                    ( ( u32* )index_data )[ i ] = indices[ i ];
+                }
+            }
+
+            for ( u32 a = 0; a < primitive.attribute_count; ++a ) {
+                const glTF::Accessor& accessor = gltf_scene.accessors[ primitive.attributes[ a ].accessor_index ];
+                const glTF::BufferView& view = gltf_scene.buffer_views[ accessor.buffer_view ];
+                const u32 element_size = accessor_element_size( accessor );
+
+                u8* vertex_data = buffers_data[ view.buffer ] + glTF::get_data_offset( accessor.byte_offset, view.byte_offset );
+                u8* remapped = ( u8* )ralloca( element_size * vertex_count, temp_allocator );
+                meshopt_remapVertexBuffer( remapped, vertex_data, vertex_count, element_size, remap );
+                memcpy( vertex_data, remapped, element_size * vertex_count );
+                rfree( remapped, temp_allocator );
+            }
+
+            rfree( remap, temp_allocator );
+            rfree( indices, temp_allocator );
+
+            ++optimized_primitives;
+        }
+    }
+
+    accessor_references.shutdown();
+
+    return optimized_primitives;
+}
+
+void geometry_collect_streams( glTF::glTF& gltf_scene, u32 buffer_index, Array<GeometryStream>& out_streams ) {
+    out_streams.clear();
+
+    const sizet buffer_size = gltf_scene.buffers[ buffer_index ].byte_length;
+
+    for ( u32 m = 0; m < gltf_scene.meshes_count; ++m ) {
+        const glTF::Mesh& mesh = gltf_scene.meshes[ m ];
+        for ( u32 p = 0; p < mesh.primitives_count; ++p ) {
+            const glTF::MeshPrimitive& primitive = mesh.primitives[ p ];
+
+            if ( primitive.indices != glTF::INVALID_INT_VALUE ) {
+                const glTF::Accessor& accessor = gltf_scene.accessors[ primitive.indices ];
+                const glTF::BufferView& view = gltf_scene.buffer_views[ accessor.buffer_view ];
+                const u32 index_size = accessor_element_size( accessor );
+
+                // The index codec works only on triangle lists.
+                if ( view.buffer == ( i32 )buffer_index && primitive_is_triangle_list( primitive ) && ( index_size == 2 || index_size == 4 ) && accessor.count % 3 == 0 ) {
+                    GeometryStream& stream = out_streams.push_use();
+                    stream.offset = glTF::get_data_offset( accessor.byte_offset, view.byte_offset );
+                    stream.element_size = index_size;
+                    stream.element_count = accessor.count;
+                    stream.type = GeometryChunkType::Index;
+                }
+            }
+
+            for ( u32 a = 0; a < primitive.attribute_count; ++a ) {
+                const glTF::Accessor& accessor = gltf_scene.accessors[ primitive.attributes[ a ].accessor_index ];
+                const glTF::BufferView& view = gltf_scene.buffer_views[ accessor.buffer_view ];
+                if ( view.buffer != ( i32 )buffer_index ) {
+                    continue;
+                }
+
+                const u32 element_size = accessor_element_size( accessor );
+                const u32 stride = view_stride( view, element_size );
+
+                GeometryStream& stream = out_streams.push_use();
+                stream.type = GeometryChunkType::Vertex;
+                if ( stride == element_size ) {
+                    stream.offset = glTF::get_data_offset( accessor.byte_offset, view.byte_offset );
+                    stream.element_size = element_size;
+                    stream.element_count = accessor.count;
+                } else {
+                    // Interleaved attributes: the whole view is a single stream.
+                    stream.offset = glTF::get_data_offset( 0, view.byte_offset );
+                    stream.element_size = stride;
+                    stream.element_count = view.byte_length / stride;
+                }
+            }
+        }
+    }
+
+    if ( out_streams.size > 1 ) {
+        qsort( out_streams.data, out_streams.size, sizeof( GeometryStream ), sorting_stream_fn );
+    }
+
+    // Drop overlapping streams (shared accessors, interleaved views referenced more than once)
+    // and the ones going past the buffer.
+    u32 kept = 0;
+    sizet end = 0;
+    for ( u32 s = 0; s < out_streams.size; ++s ) {
+        const GeometryStream& stream = out_streams[ s ];
+        const sizet stream_end = stream.offset + ( sizet )stream.element_size * stream.element_count;
+        if ( stream.element_count == 0 || stream.offset < end || stream_end > buffer_size ) {
+            continue;
+        }
+
+        out_streams[ kept++ ] = stream;
+        end = stream_end;
+    }
+    out_streams.set_size( kept );
+}
+
+static void add_raw_chunks( Array<GeometryCompressedChunk>& chunks, sizet offset, sizet size ) {
+    while ( size > 0 ) {
+        const sizet chunk_size = min( size, k_geometry_raw_chunk_size );
+
+        GeometryCompressedChunk& chunk = chunks.push_use();
+        chunk = GeometryCompressedChunk{ };
+        chunk.type = GeometryChunkType::Raw;
+        chunk.element_size = 1;
+        chunk.element_count = ( u32 )chunk_size;
+        chunk.destination_offset = offset;
+
+        offset += chunk_size;
+        size -= chunk_size;
+    }
+}
+
+static sizet chunk_encode_bound( const GeometryCompressedChunk& chunk ) {
+    const sizet raw_size = ( sizet )chunk.element_size * chunk.element_count;
+    switch ( chunk.type ) {
+        case GeometryChunkType::Vertex:
+            return max( raw_size, meshopt_encodeVertexBufferBound( chunk.element_count, chunk.element_size ) );
+        case GeometryChunkType::Index:
+            // Vertex count is only used to size the bound, the maximum index is not known yet.
+            return max( raw_size, meshopt_encodeIndexBufferBound( chunk.element_count, chunk.element_size == 2 ? u16_max + 1 : u32_max ) );
+        default:
+            return raw_size;
+    }
+}
+
+void geometry_encode( u8* data, sizet size, const GeometryStream* streams, u32 stream_count, Array<u8>& out_data, Allocator* temp_allocator ) {
+    // Plan all the chunks first, so that the output can be sized once.
+    Array<GeometryCompressedChunk> chunks;
+    chunks.init( temp_allocator, stream_count * 2 + 16 );
+
+    sizet cursor = 0;
+    for ( u32 s = 0; s < stream_count; ++s ) {
+        const GeometryStream& stream = streams[ s ];
+        RASSERT( stream.offset >= cursor );
+
+        add_raw_chunks( chunks, cursor, stream.offset - cursor );
+
+        // meshoptimizer vertex codec needs a stride multiple of 4.
+        const bool encodable = stream.type == GeometryChunkType::Index ||
+                               ( stream.type == GeometryChunkType::Vertex && stream.element_size % 4 == 0 && stream.element_size <= 256 );
+        const sizet stream_size = ( sizet )stream.element_size * stream.element_count;
+        if ( !encodable ) {
+            add_raw_chunks( chunks, stream.offset, stream_size );
+        } else {
+            const u32 elements_per_chunk = stream.type == GeometryChunkType::Index ? k_geometry_chunk_indices : k_geometry_chunk_vertices;
+            for ( u32 first = 0; first < stream.element_count; first += elements_per_chunk ) {
+                GeometryCompressedChunk& chunk = chunks.push_use();
+                chunk = GeometryCompressedChunk{ };
+                chunk.type = stream.type;
+                chunk.element_size = stream.element_size;
+                chunk.element_count = min( elements_per_chunk, stream.element_count - first );
+                chunk.destination_offset = stream.offset + ( sizet )first * stream.element_size;
+            }
+        }
+
+        cursor = stream.offset + stream_size;
+    }
+    add_raw_chunks( chunks, cursor, size - cursor );
+
+    sizet payload_bound = 0;
+    for ( u32 c = 0; c < chunks.size; ++c ) {
+        payload_bound += chunk_encode_bound( chunks[ c ] );
+    }
+
+    const sizet header_size = sizeof( GeometryCompressedHeader ) + sizeof( GeometryCompressedChunk ) * chunks.size;
+    const u32 output_start = out_data.size;
+    out_data.set_size( ( u32 )( output_start + header_size + payload_bound ) );
+
+    u8* payload = out_data.data + output_start + header_size;
+    sizet payload_size = 0;
+
+    // Temporary 32 bit indices for the index codec.
+    u32* indices = ( u32* )ralloca( sizeof( u32 ) * k_geometry_chunk_indices, temp_allocator );
+
+    for ( u32 c = 0; c < chunks.size; ++c ) {
+        GeometryCompressedChunk& chunk = chunks[ c ];
+        const u8* source = data + chunk.destination_offset;
+        const sizet raw_size = ( sizet )chunk.element_size * chunk.element_count;
+        const sizet bound = chunk_encode_bound( chunk );
+
+        sizet encoded_size = 0;
+        if ( chunk.type == GeometryChunkType::Vertex ) {
+            encoded_size = meshopt_encodeVertexBuffer( payload + payload_size, bound, source, chunk.element_count, chunk.element_size );
+        } else if ( chunk.type == GeometryChunkType::Index ) {
+            for ( u32 i = 0; i < chunk.element_count; ++i ) {
+                indices[ i ] = chunk.element_size == 2 ? ( ( const u16* )source )[ i ] : ( ( const u32* )source )[ i ];
+            }
+            encoded_size = meshopt_encodeIndexBuffer( payload + payload_size, bound, indices, chunk.element_count );
+
+            // The codec can rotate triangles: store the same rotation in the source, so that decoding is exact.
+            if ( encoded_size > 0 && encoded_size < raw_size ) {
+                meshopt_decodeIndexBuffer( data + chunk.destination_offset, chunk.element_count, chunk.element_size, payload + payload_size, encoded_size );
+            }
+        }
+
+        // Fall back to raw storage when the codec does not help.
+        if ( encoded_size == 0 || encoded_size >= raw_size ) {
+            memcpy( payload + payload_size, source, raw_size );
+            encoded_size = raw_size;
+            chunk.type = GeometryChunkType::Raw;
+            chunk.element_count = ( u32 )raw_size;
+            chunk.element_size = 1;
+        }
+
+        chunk.source_offset = payload_size;
+        chunk.source_size = encoded_size;
+        payload_size += encoded_size;
+    }
+
+    rfree( indices, temp_allocator );
+
+    GeometryCompressedHeader* header = ( GeometryCompressedHeader* )( out_data.data + output_start );
+    header->magic = k_geometry_magic;
+    header->version = k_geometry_version;
+    header->buffer_size = size;
+    header->chunk_count = chunks.size;
+    header->padding = 0;
+
+    memcpy( header + 1, chunks.data, sizeof( GeometryCompressedChunk ) * chunks.size );
+
+    out_data.set_size( ( u32 )( output_start + header_size + payload_size ) );
+
+    chunks.shutdown();
+}
+
+void geometry_compressed_path( cstring buffer_uri, char* out_path, sizet out_path_size ) {
+    snprintf( out_path, out_path_size, "%s.meshopt", buffer_uri );
+}
+
+bool geometry_compress_gltf( glTF::glTF& gltf_scene, void** buffers_data, Allocator* allocator, GeometryCompressionStats* out_stats, bool optimize ) {
+    GeometryCompressionStats stats{ };
+
+    // Work on copies, source buffers can be read only mappings.
+    Array<u8*> buffers_copy;
+    buffers_copy.init( allocator, gltf_scene.buffers_count, gltf_scene.buffers_count );
+    for ( u32 b = 0; b < gltf_scene.buffers_count; ++b ) {
+        const sizet size = gltf_scene.buffers[ b ].byte_length;
+        buffers_copy[ b ] = nullptr;
+        if ( buffers_data[ b ] != nullptr && size > 0 ) {
+            buffers_copy[ b ] = ( u8* )ralloca( size, allocator );
+            memcpy( buffers_copy[ b ], buffers_data[ b ], size );
+        }
+    }
+
+    if ( optimize ) {
+        stats.optimized_primitives = geometry_optimize_gltf( gltf_scene, buffers_copy.data, allocator );
+    }
+
+    Array<GeometryStream> streams;
+    streams.init( allocator, 64 );
+
+    Array<u8> compressed;
+    compressed.init( allocator, 0 );
+
+    bool success = true;
+    char compressed_path[ k_max_path ];
+
+    for ( u32 b = 0; b < gltf_scene.buffers_count; ++b ) {
+        glTF::Buffer& buffer = gltf_scene.buffers[ b ];
+        if ( buffers_copy[ b ] == nullptr ) {
+            continue;
+        }
+
+        geometry_collect_streams( gltf_scene, b, streams );
+
+        compressed.clear();
+        geometry_encode( buffers_copy[ b ], buffer.byte_length, streams.data, streams.size, compressed, allocator );
+
+        geometry_compressed_path( buffer.uri.data, compressed_path, k_max_path );
+
+        FileHandle file;
+        file_open( compressed_path, "wb", &file );
+        if ( !file ) {
+            rprint( "Error writing compressed geometry %s\n", compressed_path );
+            success = false;
+            continue;
+        }
+        file_write( compressed.data, 1, compressed.size, file );
+        file_close( file );
+
+        stats.raw_bytes += buffer.byte_length;
+        stats.compressed_bytes += compressed.size;
+        stats.chunk_count += ( ( GeometryCompressedHeader* )compressed.data )->chunk_count;
+    }
+
+    compressed.shutdown();
+    streams.shutdown();
+
+    for ( u32 b = 0; b < gltf_scene.buffers_count; ++b ) {
+        if ( buffers_copy[ b ] ) {
+            rfree( buffers_copy[ b ], allocator );
+        }
+    }
+    buffers_copy.shutdown();
+
+    if ( out_stats ) {
+        *out_stats = stats;
+    }
+
+    return success;
+}
+
+// Decoding ///////////////////////////////////////////////////////////////
+
+static bool decode_chunk( const GeometryCompressedChunk& chunk, const u8* source, u8* destination ) {
+    const u8* chunk_source = source + chunk.source_offset;
+    u8* chunk_destination = destination + chunk.destination_offset;
+
+    switch ( chunk.type ) {
+        case GeometryChunkType::Raw:
+            memcpy( chunk_destination, chunk_source, chunk.source_size );
+            return true;
+        case GeometryChunkType::Vertex:
+            return meshopt_decodeVertexBuffer( chunk_destination, chunk.element_count, chunk.element_size, chunk_source, chunk.source_size ) == 0;
+        case GeometryChunkType::Index:
+            return meshopt_decodeIndexBuffer( chunk_destination, chunk.element_count, chunk.element_size, chunk_source, chunk.source_size ) == 0;
+        default:
+            return false;
+    }
+}
+
+void GeometryDecodeTask::ExecuteRange( enki::TaskSetPartition range, uint32_t ) {
+    for ( u32 c = range.start; c < range.end; ++c ) {
+        if ( !decode_chunk( chunks[ c ], source, destination ) ) {
+            failed_chunks.fetch_add( 1 );
+        }
+    }
+}
+
+sizet geometry_decoded_size( const u8* data, sizet size ) {
+    if ( size < sizeof( GeometryCompressedHeader ) ) {
+        return 0;
+    }
+
+    const GeometryCompressedHeader* header = ( const GeometryCompressedHeader* )data;
+    if ( header->magic != k_geometry_magic || header->version != k_geometry_version ) {
+        return 0;
+    }
+
+    if ( size < sizeof( GeometryCompressedHeader ) + sizeof( GeometryCompressedChunk ) * ( sizet )header->chunk_count ) {
+        return 0;
+    }
+
+    return header->buffer_size;
+}
+
+bool geometry_decode( const u8* data, sizet size, u8* destination, enki::TaskScheduler* task_scheduler ) {
+    const sizet buffer_size = geometry_decoded_size( data, size );
+    if ( buffer_size == 0 ) {
+        return false;
+    }
+
+    const GeometryCompressedHeader* header = ( const GeometryCompressedHeader* )data;
+    const GeometryCompressedChunk* chunks = ( const GeometryCompressedChunk* )( header + 1 );
+    const u8* payload = ( const u8* )( chunks + header->chunk_count );
+    const sizet payload_size = size - ( payload - data );
+
+    // Validate all ranges upfront, so that decoding never goes out of bounds.
+    for ( u32 c = 0; c < header->chunk_count; ++c ) {
+        const GeometryCompressedChunk& chunk = chunks[ c ];
+        const sizet decoded_size = ( sizet )chunk.element_size * chunk.element_count;
+        if ( chunk.type >= GeometryChunkType::Count || chunk.destination_offset + decoded_size > buffer_size ||
+             chunk.source_offset + chunk.source_size > payload_size || ( chunk.type == GeometryChunkType::Raw && chunk.source_size != decoded_size ) ) {
+            rprint( "Invalid compressed geometry chunk %u\n", c );
+            return false;
+        }
+    }
+
+    if ( task_scheduler == nullptr || header->chunk_count == 1 ) {
+        for ( u32 c = 0; c < header->chunk_count; ++c ) {
+            if ( !decode_chunk( chunks[ c ], payload, destination ) ) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    GeometryDecodeTask decode_task;
+    decode_task.chunks = chunks;
+    decode_task.source = payload;
+    decode_task.destination = destination;
+    decode_task.failed_chunks = 0;
+    decode_task.m_SetSize = header->chunk_count;
+    decode_task.m_MinRange = 1;
+
+    task_scheduler->AddTaskSetToPipe( &decode_task );
+    task_scheduler->WaitforTask( &decode_task );
+
+    return decode_task.failed_chunks.load() == 0;
+}
+
+} // namespace raptor
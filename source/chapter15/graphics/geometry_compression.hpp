@@ -0,0 +1,122 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/gltf.hpp"
+#include "foundation/platform.hpp"
+
+#include "external/enkiTS/TaskScheduler.h"
+
+#include <atomic>
+
+namespace raptor {
+
+struct Allocator;
+
+//
+// Compressed geometry is stored next to each glTF buffer as "<uri>.meshopt". Decoding gives back the exact
+// bytes that were encoded, which are not the bytes of the source buffer: the index codec can rotate triangles,
+// and optimization reorders vertices and triangles. The geometry is the same (same triangles and winding,
+// unreferenced vertices kept), as are buffer sizes and offsets, so accessors and buffer views are unchanged.
+// Vertex and index streams are encoded with the meshoptimizer codecs, everything else is stored raw.
+// Streams are split in chunks that can be decoded independently, one task per chunk range.
+
+namespace GeometryChunkType {
+    enum Enum {
+        Raw, Vertex, Index, Count
+    };
+}
+
+static const u32                    k_geometry_chunk_vertices       = 16384;
+static const u32                    k_geometry_chunk_indices        = 16384 * 3;
+
+//
+//
+struct GeometryCompressedHeader {
+
+    u32                             magic;
+    u32                             version;
+    u64                             buffer_size;
+    u32                             chunk_count;
+    u32                             padding;
+
+}; // struct GeometryCompressedHeader
+
+//
+// Chunk table entry, source offsets are relative to the end of the chunk table.
+struct GeometryCompressedChunk {
+
+    u32                             type;               // GeometryChunkType
+    u32                             element_size;       // Vertex stride or index size.
+    u32                             element_count;
+    u32                             padding;
+
+    u64                             destination_offset;
+    u64                             source_offset;
+    u64                             source_size;
+
+}; // struct GeometryCompressedChunk
+
+//
+// Region of a buffer to encode with one of the codecs.
+struct GeometryStream {
+
+    sizet                           offset              = 0;
+    u32                             element_size        = 0;
+    u32                             element_count       = 0;
+    GeometryChunkType::Enum         type                = GeometryChunkType::Raw;
+
+}; // struct GeometryStream
+
+//
+//
+struct GeometryCompressionStats {
+
+    sizet                           raw_bytes           = 0;
+    sizet                           compressed_bytes    = 0;
+
+    u32                             chunk_count         = 0;
+    u32                             optimized_primitives = 0;
+
+}; // struct GeometryCompressionStats
+
+//
+//
+struct GeometryDecodeTask : public enki::ITaskSet {
+
+    void                            ExecuteRange( enki::TaskSetPartition range, uint32_t thread_index ) override;
+
+    const GeometryCompressedChunk*  chunks              = nullptr;
+    const u8*                       source              = nullptr;
+    u8*                             destination         = nullptr;
+
+    std::atomic_uint32_t            failed_chunks;
+
+}; // struct GeometryDecodeTask
+
+// Encoding ///////////////////////////////////////////////////////////////
+
+// Vertex cache and vertex fetch optimization of all the triangle primitives whose accessors are not shared.
+// Works in place on writable copies of the buffers, returns the number of optimized primitives.
+u32                                 geometry_optimize_gltf( glTF::glTF& gltf_scene, u8** buffers_data, Allocator* temp_allocator );
+
+// Vertex streams are taken from primitive attributes, index streams from primitive indices.
+void                                geometry_collect_streams( glTF::glTF& gltf_scene, u32 buffer_index, Array<GeometryStream>& out_streams );
+
+// Encodes a whole buffer, gaps between streams are stored raw. Output is appended to out_data.
+// Index data is updated with the triangle rotation chosen by the codec.
+void                                geometry_encode( u8* data, sizet size, const GeometryStream* streams, u32 stream_count, Array<u8>& out_data, Allocator* temp_allocator );
+
+// Optimizes and writes the compressed version of every buffer of the scene.
+bool                                geometry_compress_gltf( glTF::glTF& gltf_scene, void** buffers_data, Allocator* allocator, GeometryCompressionStats* out_stats, bool optimize = true );
+
+void                                geometry_compressed_path( cstring buffer_uri, char* out_path, sizet out_path_size );
+
+// Decoding ///////////////////////////////////////////////////////////////
+
+// Returns 0 if the data is not valid compressed geometry.
+sizet                               geometry_decoded_size( const u8* data, sizet size );
+
+// Destination must hold geometry_decoded_size bytes. Without task scheduler decoding happens on the calling thread.
+bool                                geometry_decode( const u8* data, sizet size, u8* destination, enki::TaskScheduler* task_scheduler );
+
+} // namespace raptor
@@ -2,6 +2,8 @@
 #include "graphics/gpu_profiler.hpp"
 #include "graphics/raptor_imgui.hpp"
 #include "graphics/asynchronous_loader.hpp"
+#include "graphics/geometry_compression.hpp"
+#include "graphics/bvh.hpp"
 #include "graphics/scene_graph.hpp"
 
 #include "foundation/file.hpp"
@@ -158,6 +160,8 @@ void glTFScene::init( SceneGraph* scene_graph_, Allocator* resident_allocator_,
     geometry_transform_buffers.init( resident_allocator, 4 );
 
     gltf_scenes.init( resident_allocator, 4 );
+
+    material_table.init( resident_allocator, 64 );
 }
 
 void glTFScene::add_mesh( cstring filename, cstring path, StackAllocator* temp_allocator, AsynchronousLoader* async_loader ) {
@@ -285,15 +289,55 @@ void glTFScene::add_mesh( cstring filename, cstring path, StackAllocator* temp_a
 
     i64 end_creating_samplers = time_now();
 
-    // Temporary array of buffer data
+    // Temporary array of buffer data, mapped so that accessors are read in place.
+    Array<MappedFile> buffers_files;
+    buffers_files.init( resident_allocator, gltf_scene.buffers_count );
+
     Array<void*> buffers_data;
     buffers_data.init( resident_allocator, gltf_scene.buffers_count );
 
+    bool has_compressed_geometry = false;
+    char compressed_path[ k_max_path ];
+
     for ( u32 buffer_index = 0; buffer_index < gltf_scene.buffers_count; ++buffer_index ) {
         glTF::Buffer& buffer = gltf_scene.buffers[ buffer_index ];
 
-        FileReadResult buffer_data = file_read_binary( buffer.uri.data, resident_allocator );
-        buffers_data.push( buffer_data.data );
+        MappedFile& buffer_file = buffers_files.push_use();
+        buffer_file = MappedFile{ };
+
+        // Prefer the compressed version of the buffer, decoded in parallel on the task scheduler.
+        geometry_compressed_path( buffer.uri.data, compressed_path, k_max_path );
+        if ( file_exists( compressed_path ) && buffer_file.open( compressed_path, FileAccessHint::Sequential ) ) {
+            u8* decoded_data = nullptr;
+            if ( geometry_decoded_size( ( u8* )buffer_file.data, buffer_file.size ) == ( sizet )buffer.byte_length ) {
+                decoded_data = ( u8* )ralloca( buffer.byte_length, resident_allocator );
+                if ( !geometry_decode( ( u8* )buffer_file.data, buffer_file.size, decoded_data, task_scheduler ) ) {
+                    rfree( decoded_data, resident_allocator );
+                    decoded_data = nullptr;
+                }
+            }
+            buffer_file.close();
+
+            if ( decoded_data ) {
+                has_compressed_geometry = true;
+                buffers_data.push( decoded_data );
+                continue;
+            }
+            rprint( "Error decoding %s, using uncompressed buffer\n", compressed_path );
+        }
+
+        if ( !buffer_file.open( buffer.uri.data, FileAccessHint::WillNeed ) ) {
+            rprint( "Error mapping buffer %s\n", buffer.uri.data );
+        }
+        buffers_data.push( buffer_file.data );
+    }
+
+    if ( write_compressed_geometry && !has_compressed_geometry ) {
+        GeometryCompressionStats compression_stats;
+        geometry_compress_gltf( gltf_scene, buffers_data.data, resident_allocator, &compression_stats );
+
+        rprint( "Compressed geometry: %llu -> %llu bytes, %u chunks, %u primitives optimized\n", ( u64 )compression_stats.raw_bytes,
+                ( u64 )compression_stats.compressed_bytes, compression_stats.chunk_count, compression_stats.optimized_primitives );
     }
 
 
@@ -802,6 +846,47 @@ void glTFScene::add_mesh( cstring filename, cstring path, StackAllocator* temp_a
     Buffer* gpu_geometry_transform_buffer = renderer->gpu->access_buffer( geometry_transform_buffer );
     memcpy( gpu_geometry_transform_buffer->mapped_data, geometry_transform.data, geometry_transform_buffer_size );
 
+    if ( analyze_bvh ) {
+        // Cpu reference of the acceleration structures built from the same triangles.
+        u32 total_triangles = 0;
+        for ( u32 mesh_index = 0; mesh_index < transform_count; ++mesh_index ) {
+            total_triangles += mesh_instances[ mesh_index + mesh_instances_offset ].mesh->primitive_count / 3;
+        }
+
+        CpuBvh bvh;
+        bvh.init( resident_allocator, total_triangles );
+
+        for ( u32 mesh_index = 0; mesh_index < transform_count; ++mesh_index ) {
+            Mesh& mesh = *mesh_instances[ mesh_index + mesh_instances_offset ].mesh;
+
+            const u8* positions = nullptr;
+            const u8* indices = nullptr;
+            for ( u32 buffer_index = buffers_offset; buffer_index < buffers.size; ++buffer_index ) {
+                const u8* buffer_data = ( const u8* )buffers_data[ buffer_index - buffers_offset ];
+                if ( buffers[ buffer_index ].handle.index == mesh.position_buffer.index ) {
+                    positions = buffer_data + mesh.position_offset;
+                }
+                if ( buffers[ buffer_index ].handle.index == mesh.index_buffer.index ) {
+                    indices = buffer_data + mesh.index_offset;
+                }
+            }
+
+            if ( positions && indices ) {
+                bvh.add_triangles( positions, sizeof( float ) * 3, indices, mesh.index_type == VK_INDEX_TYPE_UINT16 ? 2 : 4,
+                                   mesh.primitive_count / 3, &geometry_transform[ mesh_index ].matrix[ 0 ][ 0 ] );
+            }
+        }
+
+        for ( u32 mode = 0; mode < BvhBuildMode::Count; ++mode ) {
+            CpuBvhBuildOptions bvh_options{ };
+            bvh_options.mode = ( BvhBuildMode::Enum )mode;
+            bvh.build( bvh_options );
+            bvh.print_stats();
+        }
+
+        bvh.shutdown();
+    }
+
     i64 end_building_meshlets = time_now();
 
     // Before unloading buffer data, load animations
@@ -901,6 +986,8 @@ void glTFScene::add_mesh( cstring filename, cstring path, StackAllocator* temp_a
 
         Skin& skin = skins.push_use();
         skin.skeleton_root_index = gltf_skin.skeleton_root_node_index;
+        skin.descriptor_set_main = k_invalid_set;
+        skin.descriptor_set_transparent = k_invalid_set;
 
         // Copy joints
         skin.joints.init( resident_allocator, gltf_skin.joints_count, gltf_skin.joints_count );
@@ -927,11 +1014,15 @@ void glTFScene::add_mesh( cstring filename, cstring path, StackAllocator* temp_a
         skin.joint_transforms = renderer->gpu->create_buffer( bc );
     }
 
-    // Deallocate file-read buffer data
+    // Unmap buffer data
     for ( u32 buffer_index = 0; buffer_index < gltf_scene.buffers_count; ++buffer_index ) {
-        void* buffer = buffers_data[ buffer_index ];
-        resident_allocator->deallocate( buffer );
+        // Decoded buffers are not backed by a mapping.
+        if ( buffers_data[ buffer_index ] != buffers_files[ buffer_index ].data ) {
+            rfree( buffers_data[ buffer_index ], resident_allocator );
+        }
+        buffers_files[ buffer_index ].close();
     }
+    buffers_files.shutdown();
     buffers_data.shutdown();
 
     i64 end_creating_buffers = time_now();
@@ -971,6 +1062,9 @@ void glTFScene::shutdown( Renderer* renderer ) {
         skin.joints.shutdown();
         rfree( skin.inverse_bind_matrices, resident_allocator );
 
+        gpu.destroy_descriptor_set( skin.descriptor_set_main );
+        gpu.destroy_descriptor_set( skin.descriptor_set_transparent );
+
         renderer->gpu->destroy_buffer( skin.joint_transforms );
     }
     skins.shutdown();
@@ -982,17 +1076,20 @@ void glTFScene::shutdown( Renderer* renderer ) {
     meshlets_data.shutdown();
     gltf_mesh_to_mesh_offset.shutdown();
 
-    // Unload meshes
+    // Unload meshes, their descriptor sets are shared.
+    gpu.destroy_descriptor_set( mesh_descriptor_set_main );
+    gpu.destroy_descriptor_set( mesh_descriptor_set_transparent );
+
     for ( u32 mesh_index = 0; mesh_index < meshes.size; ++mesh_index ) {
         Mesh& mesh = meshes[ mesh_index ];
 
-        gpu.destroy_buffer( mesh.pbr_material.material_buffer );
-        gpu.destroy_descriptor_set( mesh.pbr_material.descriptor_set_transparent );
-        gpu.destroy_descriptor_set( mesh.pbr_material.descriptor_set_main );
+        material_table.release( mesh.pbr_material.material_index, gpu.frame_timeline_value() );
     }
+    material_table.shutdown();
 
     gpu.destroy_buffer( scene_cb );
     gpu.destroy_buffer( meshes_sb );
+    gpu.destroy_buffer( materials_sb );
     gpu.destroy_buffer( mesh_bounds_sb );
     gpu.destroy_buffer( mesh_instances_sb );
     gpu.destroy_buffer( meshlets_sb );
@@ -1050,6 +1147,9 @@ void glTFScene::shutdown( Renderer* renderer ) {
 
     lights.shutdown();
     lights_lut.shutdown();
+    light_bvh.shutdown();
+    shadow_lights.shutdown();
+    shadow_light_scores.shutdown();
 
     meshes.shutdown();
     mesh_instances.shutdown();
@@ -1095,9 +1195,21 @@ void glTFScene::prepare_draws( Renderer* renderer, StackAllocator* scratch_alloc
 
     // Create mesh ssbo
     // TODO[gabriel] : move this to be static?
-    buffer_creation.reset().set( VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic, sizeof( GpuMaterialData ) * meshes.size ).set_name( "meshes_sb" );
+    buffer_creation.reset().set( VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic, sizeof( GpuMeshDrawData ) * meshes.size ).set_name( "meshes_sb" );
     meshes_sb = renderer->gpu->create_buffer( buffer_creation );
 
+    // Create material table ssbo. Meshes with the same material content share the entry,
+    // the table is copied when changed in upload_gpu_data.
+    for ( u32 m = 0; m < meshes.size; ++m ) {
+        Mesh& mesh = meshes[ m ];
+        mesh.pbr_material.material_index = add_material( mesh.pbr_material );
+    }
+
+    buffer_creation.reset().set( VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Immutable, sizeof( GpuMaterial ) * material_table.size() ).set_name( "materials_sb" );
+    materials_sb = renderer->gpu->create_buffer( buffer_creation );
+
+    rprint( "Material table: %u materials for %u meshes\n", material_table.stats.live, meshes.size );
+
     // Create mesh bound ssbo
     buffer_creation.reset().set( VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic, sizeof( vec4s ) * meshes.size ).set_name( "mesh_bound_sb" );
     mesh_bounds_sb = renderer->gpu->create_buffer( buffer_creation );
@@ -1142,45 +1254,55 @@ void glTFScene::prepare_draws( Renderer* renderer, StackAllocator* scratch_alloc
         debug_line_commands_sb = renderer->gpu->create_buffer( buffer_creation );
     }
 
-    // Create per mesh descriptor sets, using the mesh draw ssbo
+    // Create mesh descriptor sets. Material data is read from the material table with the index
+    // stored in the mesh instance, so all meshes share the same sets, skinned ones add their joints.
     const u64 hashed_name = hash_calculate( "main" );
     GpuTechnique* main_technique = renderer->resource_cache.techniques.get( hashed_name );
+    {
+        const u32 pass_index = main_technique->name_hash_to_index.get( hash_calculate( "transparent_no_cull" ) );
+        const u32 depth_pass_index = main_technique->name_hash_to_index.get( hash_calculate( "depth_pre" ) );
+
+        DescriptorSetCreation ds_creation{};
+        DescriptorSetLayoutHandle layout = renderer->gpu->get_descriptor_set_layout( main_technique->passes[ pass_index ].pipeline, k_material_descriptor_set_index );
+        ds_creation.buffer( scene_cb, 0 ).buffer( meshes_sb, 2 ).buffer( mesh_instances_sb, 10 ).buffer( mesh_bounds_sb, 12 ).buffer( materials_sb, 14 )
+            .buffer( debug_line_sb, 20 ).buffer( debug_line_count_sb, 21 ).buffer( debug_line_commands_sb, 22).buffer( mesh_bounds_sb, 25 ).set_layout(layout);
+        mesh_descriptor_set_transparent = renderer->gpu->create_descriptor_set( ds_creation );
+
+        layout = renderer->gpu->get_descriptor_set_layout( main_technique->passes[ depth_pass_index ].pipeline, k_material_descriptor_set_index );
+        ds_creation.reset().buffer( scene_cb, 0 ).buffer( meshes_sb, 2 ).buffer( mesh_instances_sb, 10 ).buffer( mesh_bounds_sb, 12 ).buffer( materials_sb, 14 ).set_layout( layout );
+        mesh_descriptor_set_main = renderer->gpu->create_descriptor_set( ds_creation );
+    }
 
     for ( u32 m = 0; m < meshes.size; ++m ) {
         Mesh& mesh = meshes[ m ];
 
-        // Create material buffer
-        BufferCreation buffer_creation;
-        buffer_creation.reset().set( VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, ResourceUsageType::Dynamic, sizeof( GpuMaterialData ) ).set_name( "mesh_data" );
-        mesh.pbr_material.material_buffer = renderer->gpu->create_buffer( buffer_creation );
+        mesh.pbr_material.descriptor_set_main = mesh_descriptor_set_main;
+        mesh.pbr_material.descriptor_set_transparent = mesh_descriptor_set_transparent;
 
-        DescriptorSetCreation ds_creation{};
-        u32 pass_index = 0;
-        u32 depth_pass_index = 0;
-        if ( mesh.has_skinning() ) {
-            pass_index = main_technique->name_hash_to_index.get( hash_calculate( "transparent_skinning_no_cull" ) );
-            depth_pass_index = main_technique->name_hash_to_index.get( hash_calculate( "depth_pre_skinning" ) );
-        } else {
-            pass_index = main_technique->name_hash_to_index.get( hash_calculate( "transparent_no_cull" ) );
-            depth_pass_index = main_technique->name_hash_to_index.get( hash_calculate( "depth_pre" ) );
+        if ( !mesh.has_skinning() ) {
+            continue;
         }
 
-        DescriptorSetLayoutHandle layout = renderer->gpu->get_descriptor_set_layout( main_technique->passes[ pass_index ].pipeline, k_material_descriptor_set_index );
-        //DescriptorSetLayout* ds = renderer->gpu->access_descriptor_set_layout( layout );
-        ds_creation.buffer( scene_cb, 0 ).buffer( meshes_sb, 2 ).buffer( mesh_instances_sb, 10 ).buffer( mesh_bounds_sb, 12 )
-            .buffer( debug_line_sb, 20 ).buffer( debug_line_count_sb, 21 ).buffer( debug_line_commands_sb, 22).buffer( mesh_bounds_sb, 25 ).set_layout(layout);
+        Skin& skin = skins[ mesh.skin_index ];
+        if ( skin.descriptor_set_transparent.index == k_invalid_index ) {
+            const u32 pass_index = main_technique->name_hash_to_index.get( hash_calculate( "transparent_skinning_no_cull" ) );
+            const u32 depth_pass_index = main_technique->name_hash_to_index.get( hash_calculate( "depth_pre_skinning" ) );
 
-        if ( mesh.has_skinning() ) {
-            ds_creation.buffer( skins[ mesh.skin_index ].joint_transforms, 3 );
+            DescriptorSetCreation ds_creation{};
+            DescriptorSetLayoutHandle layout = renderer->gpu->get_descriptor_set_layout( main_technique->passes[ pass_index ].pipeline, k_material_descriptor_set_index );
+            ds_creation.buffer( scene_cb, 0 ).buffer( meshes_sb, 2 ).buffer( mesh_instances_sb, 10 ).buffer( mesh_bounds_sb, 12 ).buffer( materials_sb, 14 )
+                .buffer( debug_line_sb, 20 ).buffer( debug_line_count_sb, 21 ).buffer( debug_line_commands_sb, 22).buffer( mesh_bounds_sb, 25 )
+                .buffer( skin.joint_transforms, 3 ).set_layout(layout);
+            skin.descriptor_set_transparent = renderer->gpu->create_descriptor_set( ds_creation );
+
+            layout = renderer->gpu->get_descriptor_set_layout( main_technique->passes[ depth_pass_index ].pipeline, k_material_descriptor_set_index );
+            ds_creation.reset().buffer( scene_cb, 0 ).buffer( meshes_sb, 2 ).buffer( mesh_instances_sb, 10 ).buffer( mesh_bounds_sb, 12 ).buffer( materials_sb, 14 )
+                .buffer( skin.joint_transforms, 3 ).set_layout( layout );
+            skin.descriptor_set_main = renderer->gpu->create_descriptor_set( ds_creation );
         }
-        // Create main descriptor set
-        mesh.pbr_material.descriptor_set_transparent = renderer->gpu->create_descriptor_set( ds_creation );
 
-        // Create depth descriptor set
-        layout = renderer->gpu->get_descriptor_set_layout( main_technique->passes[ depth_pass_index ].pipeline, k_material_descriptor_set_index );
-        //ds = renderer->gpu->access_descriptor_set_layout( layout );
-        ds_creation.reset().buffer( scene_cb, 0 ).buffer( meshes_sb, 2 ).buffer( mesh_instances_sb, 10 ).buffer( mesh_bounds_sb, 12 ).set_layout( layout );
-        mesh.pbr_material.descriptor_set_main = renderer->gpu->create_descriptor_set( ds_creation );
+        mesh.pbr_material.descriptor_set_main = skin.descriptor_set_main;
+        mesh.pbr_material.descriptor_set_transparent = skin.descriptor_set_transparent;
     }
 
     // Create meshlets index buffer, that will be used to emulate meshlets if mesh shaders are not present.
@@ -1333,6 +1455,10 @@ void glTFScene::prepare_draws( Renderer* renderer, StackAllocator* scratch_alloc
 
     lights_lut.init( resident_allocator, k_light_z_bins, k_light_z_bins );
 
+    light_bvh.init( resident_allocator, k_num_lights );
+    shadow_lights.init( resident_allocator, k_num_lights );
+    shadow_light_scores.init( resident_allocator, k_num_lights );
+
     for ( u32 i = 0; i < k_max_frames; ++i ) {
         buffer_creation.reset().set( VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic, sizeof( u32 ) * k_light_z_bins ).set_name( "light_z_bins" );
         lights_lut_sb[ i ] = renderer->gpu->create_buffer( buffer_creation );
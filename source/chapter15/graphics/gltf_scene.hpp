@@ -29,6 +29,9 @@ namespace raptor {
 
         Array<glTF::glTF>       gltf_scenes; // Source gltf scene
 
+        bool                    write_compressed_geometry = false; // Write "<buffer>.meshopt" files, used instead of the raw buffers on the next load.
+        bool                    analyze_bvh = false; // Build cpu bvhs of the loaded meshes with both build modes and print their stats.
+
     }; // struct GltfScene
 
 } // namespace raptor
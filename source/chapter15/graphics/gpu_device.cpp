@@ -241,6 +241,42 @@ static const u32        k_bindless_texture_binding = 10;
 static const u32        k_bindless_image_binding = 11;
 static const u32        k_max_bindless_resources = 1024;
 
+static void destroy_resources_callback( void* context, ResourceUpdateType::Enum type, const u32* handles, u32 count ) {
+    ( ( GpuDevice* )context )->destroy_resources_instant( type, handles, count );
+}
+
+static u32 vma_memory_budget_provider( void* context, GpuMemoryHeapBudget* out_heaps, u32 max_heaps ) {
+    VmaAllocator allocator = ( VmaAllocator )context;
+
+    const VkPhysicalDeviceMemoryProperties* memory_properties = nullptr;
+    vmaGetMemoryProperties( allocator, &memory_properties );
+
+    VmaBudget budgets[ VK_MAX_MEMORY_HEAPS ];
+    vmaGetHeapBudgets( allocator, budgets );
+
+    const u32 heap_count = raptor_min( memory_properties->memoryHeapCount, max_heaps );
+    for ( u32 i = 0; i < heap_count; ++i ) {
+        out_heaps[ i ].usage = budgets[ i ].usage;
+        out_heaps[ i ].budget = budgets[ i ].budget;
+        out_heaps[ i ].device_local = ( memory_properties->memoryHeaps[ i ].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ) != 0;
+    }
+    return heap_count;
+}
+
+static GpuMemoryCategory::Enum gpu_memory_category( const Texture* texture ) {
+    return ( texture->flags & ( TextureFlags::RenderTarget_mask | TextureFlags::Compute_mask ) ) ? GpuMemoryCategory::RenderTargets : GpuMemoryCategory::Textures;
+}
+
+static GpuMemoryCategory::Enum gpu_memory_category( VkBufferUsageFlags type_flags ) {
+    if ( type_flags & VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR ) {
+        return GpuMemoryCategory::AccelerationStructures;
+    }
+    if ( type_flags & ( VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR ) ) {
+        return GpuMemoryCategory::Geometry;
+    }
+    return GpuMemoryCategory::Other;
+}
+
 bool GpuDevice::get_family_queue( VkPhysicalDevice physical_device ) {
     u32 queue_family_count = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr );
@@ -431,6 +467,11 @@ void GpuDevice::init( const GpuDeviceCreation& creation ) {
                 continue;
             }
 
+            if ( !strcmp( extensions[ i ].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME ) ) {
+                memory_budget_extension_present = true;
+                continue;
+            }
+
             if ( !strcmp( extensions[ i ].extensionName, VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME ) ) {
                 fragment_shading_rate_present = true;
                 continue;
@@ -475,6 +516,12 @@ void GpuDevice::init( const GpuDeviceCreation& creation ) {
         physical_device_properties_pnext = &ray_tracing_pipeline_properties;
     }
 
+    acceleration_structure_properties = VkPhysicalDeviceAccelerationStructurePropertiesKHR{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR };
+    if ( ray_tracing_present ) {
+        acceleration_structure_properties.pNext = physical_device_properties_pnext;
+        physical_device_properties_pnext = &acceleration_structure_properties;
+    }
+
     physical_device_properties_2.pNext = physical_device_properties_pnext;
 
     vkGetPhysicalDeviceProperties2( vulkan_physical_device, &physical_device_properties_2 );
@@ -586,6 +633,10 @@ void GpuDevice::init( const GpuDeviceCreation& creation ) {
         device_extensions.push( VK_KHR_MULTIVIEW_EXTENSION_NAME );
     }
 
+    if ( memory_budget_extension_present ) {
+        device_extensions.push( VK_EXT_MEMORY_BUDGET_EXTENSION_NAME );
+    }
+
     if ( fragment_shading_rate_present ) {
         device_extensions.push( VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME );
         device_extensions.push( VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME );
@@ -831,6 +882,10 @@ void GpuDevice::init( const GpuDeviceCreation& creation ) {
     //////// Create VMA Allocator
     VmaAllocatorCreateInfo allocatorInfo = {};
     allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
+    // Without the extension VMA estimates the budgets from its own allocations.
+    if ( memory_budget_extension_present ) {
+        allocatorInfo.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+    }
     allocatorInfo.physicalDevice = vulkan_physical_device;
     allocatorInfo.device = vulkan_device;
     allocatorInfo.instance = vulkan_instance;
@@ -838,6 +893,22 @@ void GpuDevice::init( const GpuDeviceCreation& creation ) {
     result = vmaCreateAllocator( &allocatorInfo, &vma_allocator );
     check( result );
 
+    const VkPhysicalDeviceMemoryProperties* memory_properties = nullptr;
+    vmaGetMemoryProperties( vma_allocator, &memory_properties );
+
+    u64 device_local_bytes = 0;
+    for ( u32 i = 0; i < memory_properties->memoryHeapCount; ++i ) {
+        if ( memory_properties->memoryHeaps[ i ].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ) {
+            device_local_bytes += memory_properties->memoryHeaps[ i ].size;
+        }
+    }
+
+    GpuMemoryBudgetCreation memory_budget_creation;
+    memory_budget_creation.set_device_limits( device_local_bytes );
+    memory_budget_creation.provider = vma_memory_budget_provider;
+    memory_budget_creation.provider_context = vma_allocator;
+    memory_budget.init( memory_budget_creation );
+
     ////////  Create Descriptor Pools
     const GpuDescriptorPoolCreation& pool_creation = creation.descriptor_pool_creation;
     VkDescriptorPoolSize pool_sizes[] =
@@ -983,8 +1054,10 @@ void GpuDevice::init( const GpuDeviceCreation& creation ) {
     absolute_frame = 0;
     timestamps_enabled = false;
 
-    resource_deletion_queue.init( allocator, 16 );
+    deletion_queue.init( allocator, 16 );
     descriptor_set_updates.init( allocator, 16 );
+    descriptor_set_cache.init( allocator, 256 );
+    reflection_cache.init( allocator, 128 );
     texture_to_update_bindless.init( allocator, 16 );
 
     // Init render pass cache
@@ -1108,90 +1181,14 @@ void GpuDevice::shutdown() {
 
     // Add pending bindless textures to delete.
     for ( u32 i = 0; i < texture_to_update_bindless.size; ++i ) {
-        ResourceUpdate& update = texture_to_update_bindless[ i ];
+        BindlessTextureUpdate& update = texture_to_update_bindless[ i ];
         if ( update.deleting ) {
-            destroy_texture_instant( update.handle );
+            deletion_queue.enqueue( ResourceUpdateType::Texture, update.handle, frame_timeline_value() );
         }
     }
 
     // Destroy all pending resources.
-    for ( u32 i = 0; i < resource_deletion_queue.size; i++ ) {
-        ResourceUpdate& resource_deletion = resource_deletion_queue[ i ];
-
-        // Skip just freed resources.
-        if ( resource_deletion.current_frame == -1 )
-            continue;
-
-        switch ( resource_deletion.type ) {
-
-            case ResourceUpdateType::Buffer:
-            {
-                destroy_buffer_instant( resource_deletion.handle );
-                break;
-            }
-
-            case ResourceUpdateType::Pipeline:
-            {
-                destroy_pipeline_instant( resource_deletion.handle );
-                break;
-            }
-
-            case ResourceUpdateType::RenderPass:
-            {
-                destroy_render_pass_instant( resource_deletion.handle );
-                break;
-            }
-
-            case ResourceUpdateType::DescriptorSet:
-            {
-                destroy_descriptor_set_instant( resource_deletion.handle );
-                break;
-            }
-
-            case ResourceUpdateType::DescriptorSetLayout:
-            {
-                destroy_descriptor_set_layout_instant( resource_deletion.handle );
-                break;
-            }
-
-            case ResourceUpdateType::Sampler:
-            {
-                destroy_sampler_instant( resource_deletion.handle );
-                break;
-            }
-
-            case ResourceUpdateType::ShaderState:
-            {
-                destroy_shader_state_instant( resource_deletion.handle );
-                break;
-            }
-
-            case ResourceUpdateType::Texture:
-            {
-                destroy_texture_instant( resource_deletion.handle );
-                break;
-            }
-
-            case ResourceUpdateType::Framebuffer:
-            {
-                destroy_framebuffer_instant( resource_deletion.handle );
-                break;
-            }
-
-            case ResourceUpdateType::PagePool:
-            {
-                destroy_page_pool_instant( resource_deletion.handle );
-                break;
-            }
-
-            default:
-            {
-                RASSERTM( false, "Cannot process resource type %u\n", resource_deletion.type );
-                break;
-            }
-        }
-    }
-
+    deletion_queue.collect( u64_max, destroy_resources_callback, this );
 
     // Destroy render passes from the cache.
     // Swapchain vkRenderPass is also present.
@@ -1210,8 +1207,11 @@ void GpuDevice::shutdown() {
     vkDestroySurfaceKHR( vulkan_instance, vulkan_window_surface, vulkan_allocation_callbacks );
 
     texture_to_update_bindless.shutdown();
-    resource_deletion_queue.shutdown();
+    deletion_queue.shutdown();
     descriptor_set_updates.shutdown();
+    descriptor_set_cache.shutdown();
+    // Layouts referencing binding names are gone, cached reflection can be saved and released.
+    reflection_cache.shutdown();
 
     // Resource tracker shutdown, checking leaks
 #if defined (RAPTOR_GPU_DEVICE_RESOURCE_TRACKING)
@@ -1257,6 +1257,8 @@ void GpuDevice::shutdown() {
     rfree( gpu_time_queries_manager, allocator );
     thread_frame_pools.shutdown();
 
+    memory_budget.shutdown();
+
     // Put this here so that pools catch which kind of resource has leaked.
     vmaDestroyAllocator( vma_allocator );
 
@@ -1376,8 +1378,10 @@ static void vulkan_create_texture( GpuDevice& gpu, const TextureCreation& creati
         if ( is_sparse_texture ) {
             check( vkCreateImage( gpu.vulkan_device, &image_info, gpu.vulkan_allocation_callbacks, &texture->vk_image ) );
         } else {
+            VmaAllocationInfo allocation_info{};
             check( vmaCreateImage( gpu.vma_allocator, &image_info, &memory_info,
-                                &texture->vk_image, &texture->vma_allocation, nullptr ) );
+                                &texture->vk_image, &texture->vma_allocation, &allocation_info ) );
+            gpu.memory_budget.on_allocation( gpu_memory_category( texture ), allocation_info.size );
 
     #if defined (_DEBUG)
             vmaSetAllocationName( gpu.vma_allocator, texture->vma_allocation, creation.name );
@@ -1404,7 +1408,7 @@ static void vulkan_create_texture( GpuDevice& gpu, const TextureCreation& creati
 
     // Add deferred bindless update.
     if ( gpu.bindless_supported ) {
-        ResourceUpdate resource_update{ ResourceUpdateType::Texture, texture->handle.index, gpu.current_frame, 0 };
+        BindlessTextureUpdate resource_update{ texture->handle.index, 0 };
         gpu.texture_to_update_bindless.push( resource_update );
     }
 }
@@ -1610,21 +1614,26 @@ void dump_shader_code( StringBuffer& temp_string_buffer, cstring code, VkShaderS
 }
 
 VkShaderModuleCreateInfo GpuDevice::compile_shader( cstring code, u32 code_size, VkShaderStageFlagBits stage, cstring name ) {
+    return compile_shader( code, code_size, stage, name, temporary_allocator, "" );
+}
+
+VkShaderModuleCreateInfo GpuDevice::compile_shader( cstring code, u32 code_size, VkShaderStageFlagBits stage, cstring name, Allocator* allocator, cstring temp_file_prefix,
+                                                   cstring defines ) {
 
     VkShaderModuleCreateInfo shader_create_info = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
 
     // Compile from glsl to SpirV.
     // TODO: detect if input is HLSL.
-    const char* temp_filename = "temp.shader";
+    char temp_filename[ 256 ];
+    snprintf( temp_filename, ArraySize( temp_filename ), "%stemp.shader", temp_file_prefix );
 
     // Write current shader to file.
     FILE* temp_shader_file = fopen( temp_filename, "w" );
     fwrite( code, code_size, 1, temp_shader_file );
     fclose( temp_shader_file );
 
-    sizet current_marker = temporary_allocator->get_marker();
     StringBuffer temp_string_buffer;
-    temp_string_buffer.init( rkilo( 1 ), temporary_allocator );
+    temp_string_buffer.init( rkilo( 1 ), allocator );
 
     // Add uppercase define as STAGE_NAME
     char* stage_define = temp_string_buffer.append_use_f( "%s_%s", to_stage_defines( stage ), name );
@@ -1635,13 +1644,13 @@ VkShaderModuleCreateInfo GpuDevice::compile_shader( cstring code, u32 code_size,
     // Compile to SPV
 #if defined(_MSC_VER)
     char* glsl_compiler_path = temp_string_buffer.append_use_f( "%sglslangValidator.exe", vulkan_binaries_path );
-    char* final_spirv_filename = temp_string_buffer.append_use( "shader_final.spv" );
+    char* final_spirv_filename = temp_string_buffer.append_use_f( "%sshader_final.spv", temp_file_prefix );
     // TODO: add optional debug information in shaders (option -g).
-    char* arguments = temp_string_buffer.append_use_f( "glslangValidator.exe %s -V --target-env vulkan1.2 -o %s -S %s --D %s --D %s", temp_filename, final_spirv_filename, to_compiler_extension( stage ), stage_define, to_stage_defines( stage ) );
+    char* arguments = temp_string_buffer.append_use_f( "glslangValidator.exe %s -V --target-env vulkan1.2 -o %s -S %s --D %s --D %s %s", temp_filename, final_spirv_filename, to_compiler_extension( stage ), stage_define, to_stage_defines( stage ), defines );
 #else
     char* glsl_compiler_path = temp_string_buffer.append_use_f( "%sglslangValidator", vulkan_binaries_path );
-    char* final_spirv_filename = temp_string_buffer.append_use( "shader_final.spv" );
-    char* arguments = temp_string_buffer.append_use_f( "%s -V --target-env vulkan1.2 -o %s -S %s --D %s --D %s", temp_filename, final_spirv_filename, to_compiler_extension( stage ), stage_define, to_stage_defines( stage ) );
+    char* final_spirv_filename = temp_string_buffer.append_use_f( "%sshader_final.spv", temp_file_prefix );
+    char* arguments = temp_string_buffer.append_use_f( "%s -V --target-env vulkan1.2 -o %s -S %s --D %s --D %s %s", temp_filename, final_spirv_filename, to_compiler_extension( stage ), stage_define, to_stage_defines( stage ), defines );
 #endif
     process_execute( ".", glsl_compiler_path, arguments, "" );
 
@@ -1651,29 +1660,29 @@ VkShaderModuleCreateInfo GpuDevice::compile_shader( cstring code, u32 code_size,
         // TODO: add optional optimization stage
         //"spirv-opt -O input -o output
         char* spirv_optimizer_path = temp_string_buffer.append_use_f( "%sspirv-opt.exe", vulkan_binaries_path );
-        char* optimized_spirv_filename = temp_string_buffer.append_use_f( "shader_opt.spv" );
+        char* optimized_spirv_filename = temp_string_buffer.append_use_f( "%sshader_opt.spv", temp_file_prefix );
         char* spirv_opt_arguments = temp_string_buffer.append_use_f( "spirv-opt.exe -O --preserve-bindings %s -o %s", final_spirv_filename, optimized_spirv_filename );
 
         process_execute( ".", spirv_optimizer_path, spirv_opt_arguments, "" );
 
         // Read back SPV file.
-        shader_create_info.pCode = reinterpret_cast< const u32* >( file_read_binary( optimized_spirv_filename, temporary_allocator, &shader_create_info.codeSize ) );
+        shader_create_info.pCode = reinterpret_cast< const u32* >( file_read_binary( optimized_spirv_filename, allocator, &shader_create_info.codeSize ) );
 
         file_delete( optimized_spirv_filename );
     } else {
         // Read back SPV file.
-        shader_create_info.pCode = reinterpret_cast< const u32* >( file_read_binary( final_spirv_filename, temporary_allocator, &shader_create_info.codeSize ) );
+        shader_create_info.pCode = reinterpret_cast< const u32* >( file_read_binary( final_spirv_filename, allocator, &shader_create_info.codeSize ) );
     }
 
+    // Temporary files cleanup, before the string buffer is reused to dump the code.
+    file_delete( temp_filename );
+    file_delete( final_spirv_filename );
+
     // Handling compilation error
     if ( shader_create_info.pCode == nullptr ) {
         dump_shader_code( temp_string_buffer, code, stage, name );
     }
 
-    // Temporary files cleanup
-    file_delete( temp_filename );
-    file_delete( final_spirv_filename );
-
     return shader_create_info;
 }
 
@@ -1732,7 +1741,9 @@ ShaderStateHandle GpuDevice::create_shader_state( const ShaderStateCreation& cre
         // Spir-V file is not generated when there is a compilation error, we can use this to know when compilation is succeded.
         if ( shader_create_info.pCode ) {
             // Parse the generated Spir-V to obtain specialization constants informations.
-            spirv::parse_binary( shader_create_info.pCode, shader_create_info.codeSize, name_buffer, shader_state->parse_result );
+            // Stages are reflected once and cached by content, their results are merged into the shader state one.
+            const spirv::ParseResult* stage_parse_result = reflection_cache.get( shader_create_info.pCode, shader_create_info.codeSize );
+            spirv::merge_parse_result( shader_state->parse_result, *stage_parse_result );
 
             // Compile shader module
             VkPipelineShaderStageCreateInfo& shader_stage_info = shader_state->shader_stage_info[ compiled_shaders ];
@@ -1761,13 +1772,22 @@ ShaderStateHandle GpuDevice::create_shader_state( const ShaderStateCreation& cre
                     cstring specialization_name = shader_state->parse_result->specialization_names[ i ].name;
                     VkSpecializationMapEntry& specialization_entry = specialization_entries[ i ];
 
-                    if ( strcmp( specialization_name, "SUBGROUP_SIZE" ) == 0 ) {
-                        specialization_entry.constantID = specialization_constant.binding;
-                        specialization_entry.size = sizeof( u32 );
-                        specialization_entry.offset = i * sizeof( u32 );
+                    // Every constant gets an entry: defaults come from the Spir-V, creation values override them by name.
+                    specialization_entry.constantID = specialization_constant.binding;
+                    specialization_entry.size = sizeof( u32 );
+                    specialization_entry.offset = i * sizeof( u32 );
 
+                    specialization_data[ i ] = specialization_constant.default_value.value.value_u;
+
+                    if ( strcmp( specialization_name, "SUBGROUP_SIZE" ) == 0 ) {
                         specialization_data[ i ] = subgroup_size;
                     }
+
+                    for ( u32 v = 0; v < creation.specializations_count; ++v ) {
+                        if ( strcmp( specialization_name, creation.specializations[ v ].name ) == 0 ) {
+                            specialization_data[ i ] = creation.specializations[ v ].value;
+                        }
+                    }
                 }
 
                 shader_stage_info.pSpecializationInfo = &specialization_info;
@@ -2305,6 +2325,7 @@ BufferHandle GpuDevice::create_buffer( const BufferCreation& creation ) {
     set_resource_name( VK_OBJECT_TYPE_BUFFER, ( u64 )buffer->vk_buffer, creation.name );
 
     buffer->vk_device_memory = allocation_info.deviceMemory;
+    memory_budget.on_allocation( gpu_memory_category( creation.type_flags ), allocation_info.size );
 
     if ( creation.initial_data ) {
         void* data;
@@ -2659,23 +2680,111 @@ static int sorting_descriptor_func( const void* a, const void* b ) {
     return 0;
 }
 
-DescriptorSetHandle GpuDevice::create_descriptor_set( const DescriptorSetCreation& creation ) {
-    DescriptorSetHandle handle = { descriptor_sets.obtain_resource() };
-    if ( handle.index == k_invalid_index ) {
-        return handle;
+void GpuDevice::sort_descriptor_set_resources( const DescriptorSetCreation& creation, ResourceHandle* out_resources, SamplerHandle* out_samplers, u16* out_bindings ) {
+    RASSERTM( creation.num_resources < k_max_descriptors_per_set, "Overflow in resources, please bump k_max_descriptors_per_set." );
+
+    DescriptorSortingData sorting_data[ k_max_descriptors_per_set ];
+
+    for ( u32 r = 0; r < creation.num_resources; r++ ) {
+        sorting_data[ r ].binding_point = creation.bindings[ r ];
+        sorting_data[ r ].resource_index = r;
     }
 
-    resource_tracker.track_create_resource( ResourceUpdateType::DescriptorSet, handle.index, creation.name );
+    // Sort resources based on binding points
+    qsort( sorting_data, creation.num_resources, sizeof( DescriptorSortingData ), sorting_descriptor_func );
+    for ( u32 r = 0; r < creation.num_resources; r++ ) {
 
-    DescriptorSet* descriptor_set = access_descriptor_set( handle );
-    const DescriptorSetLayout* descriptor_set_layout = access_descriptor_set_layout( creation.layout );
+        u32 resource_index = sorting_data[ r ].resource_index;
+        out_resources[ r ] = creation.resources[ resource_index ];
+        out_samplers[ r ] = creation.samplers[ resource_index ];
+        out_bindings[ r ] = creation.bindings[ resource_index ];
+    }
+}
+
+DescriptorSetKey GpuDevice::get_descriptor_set_key( const DescriptorSet* descriptor_set ) {
+    DescriptorSetKey key;
+    key.resources = descriptor_set->resources;
+    key.samplers = ( const u32* )descriptor_set->samplers;
+    key.bindings = descriptor_set->bindings;
+    key.acceleration_structure = ( u64 )descriptor_set->as;
+    key.layout = ( u64 )descriptor_set->layout;
+    key.num_resources = descriptor_set->num_resources;
+    return key;
+}
+
+static VkDescriptorType descriptor_binding_type( const DescriptorSetLayout* descriptor_set_layout, u16 layout_binding_index ) {
+    const u32 binding_data_index = descriptor_set_layout->index_to_binding[ layout_binding_index ];
+    if ( binding_data_index >= descriptor_set_layout->num_bindings ) {
+        return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+    }
+    return descriptor_set_layout->bindings[ binding_data_index ].type;
+}
+
+static bool descriptor_type_is_image( VkDescriptorType type ) {
+    return type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER || type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE || type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+}
+
+static bool descriptor_type_is_buffer( VkDescriptorType type ) {
+    return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ||
+           type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+}
+
+u64 GpuDevice::get_descriptor_set_views_hash( const DescriptorSetLayout* descriptor_set_layout, const DescriptorSetKey& key ) {
+    u64 hash = 0;
+    for ( u32 r = 0; r < key.num_resources; ++r ) {
+        if ( key.resources[ r ] == k_invalid_index ) {
+            continue;
+        }
+
+        const VkDescriptorType type = descriptor_binding_type( descriptor_set_layout, key.bindings[ r ] );
+        if ( descriptor_type_is_image( type ) ) {
+            hash = hash_calculate( ( u64 )access_texture( { key.resources[ r ] } )->vk_image_view, hash );
+        } else if ( descriptor_type_is_buffer( type ) ) {
+            hash = hash_calculate( ( u64 )access_buffer( { key.resources[ r ] } )->vk_buffer, hash );
+        }
+    }
+    return hash;
+}
+
+void GpuDevice::uncache_descriptor_sets( ResourceHandle resource, bool texture ) {
+    descriptor_set_cache.remove_if( [ & ]( u32 set_index ) {
+        DescriptorSet* descriptor_set = access_descriptor_set( { set_index } );
+        for ( u32 r = 0; r < descriptor_set->num_resources; ++r ) {
+            const VkDescriptorType type = descriptor_binding_type( descriptor_set->layout, descriptor_set->bindings[ r ] );
+            if ( descriptor_set->resources[ r ] == resource && ( texture ? descriptor_type_is_image( type ) : descriptor_type_is_buffer( type ) ) ) {
+                descriptor_set->cache_hash = 0;
+                return true;
+            }
+        }
+        return false;
+    } );
+}
+
+bool GpuDevice::init_descriptor_set( DescriptorSet* descriptor_set, VkDescriptorPool descriptor_pool, const DescriptorSetLayout* descriptor_set_layout,
+                                     const DescriptorSetKey& key ) {
+    // Cache data
+    u8* memory = rallocam( ( sizeof( ResourceHandle ) + sizeof( SamplerHandle ) + sizeof( u16 ) ) * key.num_resources, allocator );
+    descriptor_set->resources = ( ResourceHandle* )memory;
+    descriptor_set->samplers = ( SamplerHandle* )( memory + sizeof( ResourceHandle ) * key.num_resources );
+    descriptor_set->bindings = ( u16* )( memory + ( sizeof( ResourceHandle ) + sizeof( SamplerHandle ) ) * key.num_resources );
+    descriptor_set->num_resources = key.num_resources;
+    descriptor_set->layout = descriptor_set_layout;
+    descriptor_set->as = ( VkAccelerationStructureKHR )key.acceleration_structure;
+    descriptor_set->cache_hash = 0;
+    descriptor_set->views_hash = get_descriptor_set_views_hash( descriptor_set_layout, key );
+    descriptor_set->references = 1;
+
+    memcpy( descriptor_set->resources, key.resources, sizeof( ResourceHandle ) * key.num_resources );
+    memcpy( descriptor_set->samplers, key.samplers, sizeof( SamplerHandle ) * key.num_resources );
+    memcpy( descriptor_set->bindings, key.bindings, sizeof( u16 ) * key.num_resources );
 
     // Allocate descriptor set
     VkDescriptorSetAllocateInfo alloc_info{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
-    alloc_info.descriptorPool = descriptor_set_layout->bindless ? vulkan_bindless_descriptor_pool : vulkan_descriptor_pool;
+    alloc_info.descriptorPool = descriptor_pool;
     alloc_info.descriptorSetCount = 1;
     alloc_info.pSetLayouts = &descriptor_set_layout->vk_descriptor_set_layout;
 
+    VkResult result;
     if ( descriptor_set_layout->bindless ) {
         VkDescriptorSetVariableDescriptorCountAllocateInfoEXT count_info{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT };
         u32 max_binding = k_max_bindless_resources - 1;
@@ -2683,21 +2792,16 @@ DescriptorSetHandle GpuDevice::create_descriptor_set( const DescriptorSetCreatio
         // This number is the max allocatable count
         count_info.pDescriptorCounts = &max_binding;
         alloc_info.pNext = &count_info;
-        check( vkAllocateDescriptorSets( vulkan_device, &alloc_info, &descriptor_set->vk_descriptor_set ) );
+        result = vkAllocateDescriptorSets( vulkan_device, &alloc_info, &descriptor_set->vk_descriptor_set );
     }
     else {
-        check( vkAllocateDescriptorSets( vulkan_device, &alloc_info, &descriptor_set->vk_descriptor_set ) );
+        result = vkAllocateDescriptorSets( vulkan_device, &alloc_info, &descriptor_set->vk_descriptor_set );
     }
 
-    // Cache data
-    u8* memory = rallocam( ( sizeof( ResourceHandle ) + sizeof( SamplerHandle ) + sizeof( u16 ) ) * creation.num_resources, allocator );
-    descriptor_set->resources = ( ResourceHandle* )memory;
-    descriptor_set->samplers = ( SamplerHandle* )( memory + sizeof( ResourceHandle ) * creation.num_resources );
-    descriptor_set->bindings = ( u16* )( memory + ( sizeof( ResourceHandle ) + sizeof( SamplerHandle ) ) * creation.num_resources );
-    descriptor_set->num_resources = creation.num_resources;
-    descriptor_set->layout = descriptor_set_layout;
-
-    RASSERTM( creation.num_resources < k_max_descriptors_per_set, "Overflow in resources, please bump k_max_descriptors_per_set." );
+    if ( result != VK_SUCCESS ) {
+        rprint( "Graphics error: descriptor set allocation failed, '%s'\n", string_VkResult( result ) );
+        return false;
+    }
 
     // TODO: fix gltf problems and enable this. It asserts when creating draws.
     if ( descriptor_set_layout->set_index != 0 ) {
@@ -2711,31 +2815,75 @@ DescriptorSetHandle GpuDevice::create_descriptor_set( const DescriptorSetCreatio
 
     Sampler* vk_default_sampler = access_sampler( default_sampler );
 
-    DescriptorSortingData sorting_data[ k_max_descriptors_per_set ];
+    u32 num_resources = key.num_resources;
+    fill_write_descriptor_sets( *this, descriptor_set_layout, descriptor_set, descriptor_write, buffer_info, image_info, vk_default_sampler->vk_sampler,
+                                num_resources );
 
-    // Cache resources
-    for ( u32 r = 0; r < creation.num_resources; r++ ) {
-        sorting_data[ r ].binding_point = creation.bindings[ r ];
-        sorting_data[ r ].resource_index = r;
+    vkUpdateDescriptorSets( vulkan_device, num_resources, descriptor_write, 0, nullptr );
+
+    return true;
+}
+
+DescriptorSetHandle GpuDevice::create_descriptor_set( const DescriptorSetCreation& creation ) {
+    const DescriptorSetLayout* descriptor_set_layout = access_descriptor_set_layout( creation.layout );
+
+    ResourceHandle resources[ k_max_descriptors_per_set ];
+    SamplerHandle samplers[ k_max_descriptors_per_set ];
+    u16 bindings[ k_max_descriptors_per_set ];
+    sort_descriptor_set_resources( creation, resources, samplers, bindings );
+
+    DescriptorSetKey key;
+    key.resources = resources;
+    key.samplers = ( const u32* )samplers;
+    key.bindings = bindings;
+    key.acceleration_structure = ( u64 )creation.as;
+    key.layout = ( u64 )descriptor_set_layout;
+    key.num_resources = creation.num_resources;
+
+    // Sets with the same layout and resources are shared, bindless sets are always unique as their content is updated every frame.
+    u64 key_hash = 0;
+    u32 cached_index = k_invalid_index;
+    if ( !descriptor_set_layout->bindless ) {
+        key_hash = descriptor_set_key_hash( key );
+        cached_index = descriptor_set_cache.find( key_hash );
+
+        if ( cached_index != k_invalid_index ) {
+            DescriptorSet* cached_descriptor_set = access_descriptor_set( { cached_index } );
+
+            if ( descriptor_set_key_equals( key, get_descriptor_set_key( cached_descriptor_set ) ) ) {
+#if defined(_DEBUG)
+                RASSERTM( cached_descriptor_set->views_hash == get_descriptor_set_views_hash( descriptor_set_layout, key ),
+                          "Cached descriptor set %u references a texture or buffer recreated since it was written", cached_index );
+#endif // _DEBUG
+                ++cached_descriptor_set->references;
+                ++descriptor_set_cache.stats.hits;
+                return { cached_index };
+            }
+
+            ++descriptor_set_cache.stats.collisions;
+        }
     }
 
-    // Sort resources based on binding points
-    qsort( sorting_data, creation.num_resources, sizeof( DescriptorSortingData ), sorting_descriptor_func );
-    for ( u32 r = 0; r < creation.num_resources; r++ ) {
+    DescriptorSetHandle handle = { descriptor_sets.obtain_resource() };
+    if ( handle.index == k_invalid_index ) {
+        return handle;
+    }
 
-        u32 resource_index = sorting_data[ r ].resource_index;
-        descriptor_set->resources[ r ] = creation.resources[ resource_index ];
-        descriptor_set->samplers[ r ] = creation.samplers[ resource_index ];
-        descriptor_set->bindings[ r ] = creation.bindings[ resource_index ];
+    DescriptorSet* descriptor_set = access_descriptor_set( handle );
+    if ( !init_descriptor_set( descriptor_set, descriptor_set_layout->bindless ? vulkan_bindless_descriptor_pool : vulkan_descriptor_pool, descriptor_set_layout, key ) ) {
+        rfree( descriptor_set->resources, allocator );
+        descriptor_sets.release_resource( handle.index );
+        return { k_invalid_index };
     }
 
-    descriptor_set->as = creation.as;
+    resource_tracker.track_create_resource( ResourceUpdateType::DescriptorSet, handle.index, creation.name );
 
-    u32 num_resources = creation.num_resources;
-    fill_write_descriptor_sets( *this, descriptor_set_layout, descriptor_set, descriptor_write, buffer_info, image_info, vk_default_sampler->vk_sampler,
-                                num_resources );
+    ++descriptor_set_cache.stats.allocations;
 
-    vkUpdateDescriptorSets( vulkan_device, num_resources, descriptor_write, 0, nullptr );
+    if ( !descriptor_set_layout->bindless && cached_index == k_invalid_index ) {
+        descriptor_set->cache_hash = key_hash;
+        descriptor_set_cache.add( key_hash, handle.index );
+    }
 
     return handle;
 }
@@ -3006,9 +3154,12 @@ FramebufferHandle GpuDevice::create_framebuffer( const FramebufferCreation& crea
 void GpuDevice::destroy_buffer( BufferHandle buffer ) {
     if ( buffer.index < buffers.pool_size ) {
 
+        // The handle can be reused by a new buffer, sets written with this one can't be shared anymore.
+        uncache_descriptor_sets( buffer.index, false );
+
         resource_tracker.track_destroy_resource( ResourceUpdateType::Buffer, buffer.index );
 
-        resource_deletion_queue.push( { ResourceUpdateType::Buffer, buffer.index, current_frame, 1 } );
+        deletion_queue.enqueue( ResourceUpdateType::Buffer, buffer.index, frame_timeline_value() );
     } else {
         rprint( "Graphics error: trying to free invalid Buffer %u\n", buffer.index );
     }
@@ -3017,10 +3168,12 @@ void GpuDevice::destroy_buffer( BufferHandle buffer ) {
 void GpuDevice::destroy_texture( TextureHandle texture ) {
     if ( texture.index < textures.pool_size ) {
 
+        uncache_descriptor_sets( texture.index, true );
+
         resource_tracker.track_destroy_resource( ResourceUpdateType::Texture, texture.index );
 
         // Do not add textures to deletion queue, textures will be deleted after bindless descriptor is updated.
-        texture_to_update_bindless.push( { ResourceUpdateType::Texture, texture.index, current_frame, 1 } );
+        texture_to_update_bindless.push( { texture.index, 1 } );
     } else {
         rprint( "Graphics error: trying to free invalid Texture %u\n", texture.index );
     }
@@ -3031,7 +3184,7 @@ void GpuDevice::destroy_pipeline( PipelineHandle pipeline ) {
 
         resource_tracker.track_destroy_resource( ResourceUpdateType::Pipeline, pipeline.index );
 
-        resource_deletion_queue.push( { ResourceUpdateType::Pipeline, pipeline.index, current_frame, 1 } );
+        deletion_queue.enqueue( ResourceUpdateType::Pipeline, pipeline.index, frame_timeline_value() );
         // Shader state creation is handled internally when creating a pipeline, thus add this to track correctly.
         Pipeline* v_pipeline = access_pipeline( pipeline );
 
@@ -3054,12 +3207,27 @@ void GpuDevice::destroy_pipeline( PipelineHandle pipeline ) {
     }
 }
 
+void GpuDevice::replace_pipeline( PipelineHandle pipeline, PipelineHandle replacement ) {
+    RASSERT( pipeline.index < pipelines.pool_size && replacement.index < pipelines.pool_size );
+
+    // Swap the contents: users of the handle see the new pipeline from now on, the previous one
+    // goes through the deletion queue and lives until the frames recorded with it are completed.
+    Pipeline* v_pipeline = access_pipeline( pipeline );
+    Pipeline* v_replacement = access_pipeline( replacement );
+
+    Pipeline previous = *v_pipeline;
+    *v_pipeline = *v_replacement;
+    *v_replacement = previous;
+
+    destroy_pipeline( replacement );
+}
+
 void GpuDevice::destroy_sampler( SamplerHandle sampler ) {
     if ( sampler.index < samplers.pool_size ) {
 
         resource_tracker.track_destroy_resource( ResourceUpdateType::Sampler, sampler.index );
 
-        resource_deletion_queue.push( { ResourceUpdateType::Sampler, sampler.index, current_frame, 1 } );
+        deletion_queue.enqueue( ResourceUpdateType::Sampler, sampler.index, frame_timeline_value() );
     } else {
         rprint( "Graphics error: trying to free invalid Sampler %u\n", sampler.index );
     }
@@ -3070,7 +3238,7 @@ void GpuDevice::destroy_descriptor_set_layout( DescriptorSetLayoutHandle descrip
 
         resource_tracker.track_destroy_resource( ResourceUpdateType::DescriptorSetLayout, descriptor_set_layout.index );
 
-        resource_deletion_queue.push( { ResourceUpdateType::DescriptorSetLayout, descriptor_set_layout.index, current_frame, 1 } );
+        deletion_queue.enqueue( ResourceUpdateType::DescriptorSetLayout, descriptor_set_layout.index, frame_timeline_value() );
     } else {
         rprint( "Graphics error: trying to free invalid DescriptorSetLayout %u\n", descriptor_set_layout.index );
     }
@@ -3079,9 +3247,21 @@ void GpuDevice::destroy_descriptor_set_layout( DescriptorSetLayoutHandle descrip
 void GpuDevice::destroy_descriptor_set( DescriptorSetHandle descriptor_set ) {
     if ( descriptor_set.index < descriptor_sets.pool_size ) {
 
+        // Shared sets are destroyed with their last reference.
+        DescriptorSet* v_descriptor_set = access_descriptor_set( descriptor_set );
+        if ( v_descriptor_set->references > 1 ) {
+            --v_descriptor_set->references;
+            return;
+        }
+
+        if ( v_descriptor_set->cache_hash ) {
+            descriptor_set_cache.remove( v_descriptor_set->cache_hash, descriptor_set.index );
+            v_descriptor_set->cache_hash = 0;
+        }
+
         resource_tracker.track_destroy_resource( ResourceUpdateType::DescriptorSet, descriptor_set.index );
 
-        resource_deletion_queue.push( { ResourceUpdateType::DescriptorSet, descriptor_set.index, current_frame, 1 } );
+        deletion_queue.enqueue( ResourceUpdateType::DescriptorSet, descriptor_set.index, frame_timeline_value() );
     } else {
         rprint( "Graphics error: trying to free invalid DescriptorSet %u\n", descriptor_set.index );
     }
@@ -3092,7 +3272,7 @@ void GpuDevice::destroy_render_pass( RenderPassHandle render_pass ) {
 
         resource_tracker.track_destroy_resource( ResourceUpdateType::RenderPass, render_pass.index );
 
-        resource_deletion_queue.push( { ResourceUpdateType::RenderPass, render_pass.index, current_frame, 1 } );
+        deletion_queue.enqueue( ResourceUpdateType::RenderPass, render_pass.index, frame_timeline_value() );
     } else {
         rprint( "Graphics error: trying to free invalid RenderPass %u\n", render_pass.index );
     }
@@ -3103,7 +3283,7 @@ void GpuDevice::destroy_framebuffer( FramebufferHandle framebuffer ) {
 
         resource_tracker.track_destroy_resource( ResourceUpdateType::Framebuffer, framebuffer.index );
 
-        resource_deletion_queue.push( { ResourceUpdateType::Framebuffer, framebuffer.index, current_frame, 1 } );
+        deletion_queue.enqueue( ResourceUpdateType::Framebuffer, framebuffer.index, frame_timeline_value() );
     } else {
         rprint( "Graphics error: trying to free invalid Framebuffer %u\n", framebuffer.index );
     }
@@ -3114,7 +3294,7 @@ void GpuDevice::destroy_shader_state( ShaderStateHandle shader ) {
 
         resource_tracker.track_destroy_resource( ResourceUpdateType::ShaderState, shader.index );
 
-        resource_deletion_queue.push( { ResourceUpdateType::ShaderState, shader.index, current_frame, 1 } );
+        deletion_queue.enqueue( ResourceUpdateType::ShaderState, shader.index, frame_timeline_value() );
 
         ShaderState* state = access_shader_state( shader );
 
@@ -3124,11 +3304,106 @@ void GpuDevice::destroy_shader_state( ShaderStateHandle shader ) {
     }
 }
 // Real destruction methods - the other enqueue only the resources.
+void GpuDevice::destroy_resources_instant( ResourceUpdateType::Enum type, const u32* handles, u32 count ) {
+    switch ( type ) {
+
+        case ResourceUpdateType::Buffer:
+        {
+            for ( u32 i = 0; i < count; ++i ) {
+                destroy_buffer_instant( handles[ i ] );
+            }
+            break;
+        }
+
+        case ResourceUpdateType::Texture:
+        {
+            for ( u32 i = 0; i < count; ++i ) {
+                destroy_texture_instant( handles[ i ] );
+            }
+            break;
+        }
+
+        case ResourceUpdateType::Pipeline:
+        {
+            for ( u32 i = 0; i < count; ++i ) {
+                destroy_pipeline_instant( handles[ i ] );
+            }
+            break;
+        }
+
+        case ResourceUpdateType::Sampler:
+        {
+            for ( u32 i = 0; i < count; ++i ) {
+                destroy_sampler_instant( handles[ i ] );
+            }
+            break;
+        }
+
+        case ResourceUpdateType::DescriptorSetLayout:
+        {
+            for ( u32 i = 0; i < count; ++i ) {
+                destroy_descriptor_set_layout_instant( handles[ i ] );
+            }
+            break;
+        }
+
+        case ResourceUpdateType::DescriptorSet:
+        {
+            for ( u32 i = 0; i < count; ++i ) {
+                destroy_descriptor_set_instant( handles[ i ] );
+            }
+            break;
+        }
+
+        case ResourceUpdateType::RenderPass:
+        {
+            for ( u32 i = 0; i < count; ++i ) {
+                destroy_render_pass_instant( handles[ i ] );
+            }
+            break;
+        }
+
+        case ResourceUpdateType::Framebuffer:
+        {
+            for ( u32 i = 0; i < count; ++i ) {
+                destroy_framebuffer_instant( handles[ i ] );
+            }
+            break;
+        }
+
+        case ResourceUpdateType::ShaderState:
+        {
+            for ( u32 i = 0; i < count; ++i ) {
+                destroy_shader_state_instant( handles[ i ] );
+            }
+            break;
+        }
+
+        case ResourceUpdateType::PagePool:
+        {
+            for ( u32 i = 0; i < count; ++i ) {
+                destroy_page_pool_instant( handles[ i ] );
+            }
+            break;
+        }
+
+        default:
+        {
+            RASSERTM( false, "Cannot process resource type %u", type );
+            break;
+        }
+    }
+}
+
 void GpuDevice::destroy_buffer_instant( ResourceHandle buffer ) {
 
     Buffer* v_buffer = ( Buffer* )buffers.access_resource( buffer );
 
     if ( v_buffer && v_buffer->parent_buffer.index == k_invalid_buffer.index ) {
+        VmaAllocationInfo allocation_info{};
+        vmaGetAllocationInfo( vma_allocator, v_buffer->vma_allocation, &allocation_info );
+        memory_budget.on_free( gpu_memory_category( v_buffer->type_flags ), allocation_info.size );
+
         vmaDestroyBuffer( vma_allocator, v_buffer->vk_buffer, v_buffer->vma_allocation );
     }
     buffers.release_resource( buffer );
@@ -3149,6 +3424,10 @@ void GpuDevice::destroy_texture_instant( ResourceHandle texture ) {
 
         // Standard texture: vma allocation valid, and is NOT a texture view (parent_texture is invalid)
         if ( v_texture->vma_allocation != 0 && v_texture->parent_texture.index == k_invalid_texture.index ) {
+            VmaAllocationInfo allocation_info{};
+            vmaGetAllocationInfo( vma_allocator, v_texture->vma_allocation, &allocation_info );
+            memory_budget.on_free( gpu_memory_category( v_texture ), allocation_info.size );
+
             vmaDestroyImage( vma_allocator, v_texture->vk_image, v_texture->vma_allocation );
         } else if ( ( v_texture->flags & TextureFlags::Sparse_mask ) == TextureFlags::Sparse_mask ) {
             // Sparse textures
@@ -3499,6 +3778,14 @@ void GpuDevice::update_descriptor_set( DescriptorSetHandle descriptor_set ) {
 
     if ( descriptor_set.index < descriptor_sets.pool_size ) {
 
+        // The content is going to change, the set can't be shared anymore.
+        DescriptorSet* v_descriptor_set = access_descriptor_set( descriptor_set );
+        RASSERTM( v_descriptor_set->references <= 1, "Updating a descriptor set shared by %u owners\n", v_descriptor_set->references );
+        if ( v_descriptor_set->cache_hash ) {
+            descriptor_set_cache.remove( v_descriptor_set->cache_hash, descriptor_set.index );
+            v_descriptor_set->cache_hash = 0;
+        }
+
         DescriptorSetUpdate new_update = { descriptor_set, current_frame };
         descriptor_set_updates.push( new_update );
 
@@ -3522,6 +3809,8 @@ void GpuDevice::update_descriptor_set_instant( const DescriptorSetUpdate& update
     dummy_delete_descriptor_set->resources = nullptr;
     dummy_delete_descriptor_set->samplers = nullptr;
     dummy_delete_descriptor_set->num_resources = 0;
+    dummy_delete_descriptor_set->cache_hash = 0;
+    dummy_delete_descriptor_set->references = 1;
 
     destroy_descriptor_set( dummy_delete_descriptor_set_handle );
 
@@ -3632,6 +3921,9 @@ void GpuDevice::resize_texture_3d( TextureHandle texture, u32 width, u32 height,
       .set_mips( vk_texture->mip_level_count );
     vulkan_create_texture( *this, tc, vk_texture->handle, vk_texture );
 
+    // Same handle, new image view: cached sets still point to the old one.
+    uncache_descriptor_sets( texture.index, true );
+
     destroy_texture( texture_to_delete );
 }
 
@@ -3715,6 +4007,7 @@ PagePoolHandle GpuDevice::allocate_texture_pool( TextureHandle texture_handle, u
     page_memory_requirements.size = memory_requirements.alignment;
 
     vmaAllocateMemoryPages( vma_allocator, &page_memory_requirements, &allocation_create_info, block_count, page_pool->vma_allocations.data, nullptr );
+    memory_budget.on_allocation( GpuMemoryCategory::PagePools, ( u64 )block_count * page_pool->block_size );
 
     return pool_handle;
 }
@@ -3724,7 +4017,7 @@ void GpuDevice::destroy_page_pool( PagePoolHandle pool_handle ) {
 
         //resource_tracker.track_destroy_resource( ResourceUpdateType::PagePool, pool_handle.index );
 
-        resource_deletion_queue.push( { ResourceUpdateType::PagePool, pool_handle.index, current_frame + k_max_frames, 1 } );
+        deletion_queue.enqueue( ResourceUpdateType::PagePool, pool_handle.index, frame_timeline_value() + k_max_frames );
     } else {
         rprint( "Graphics error: trying to free invalid PagePool %u\n", pool_handle.index );
     }
@@ -3733,6 +4026,7 @@ void GpuDevice::destroy_page_pool( PagePoolHandle pool_handle ) {
 void GpuDevice::destroy_page_pool_instant( ResourceHandle handle ) {
     PagePool* page_pool = ( PagePool* )page_pools.access_resource( handle );
     if ( page_pool ) {
+        memory_budget.on_free( GpuMemoryCategory::PagePools, ( u64 )page_pool->vma_allocations.size * page_pool->block_size );
         vmaFreeMemoryPages( vma_allocator, page_pool->vma_allocations.size, page_pool->vma_allocations.data );
 
         page_pool->vma_allocations.shutdown();
@@ -3872,6 +4166,11 @@ void GpuDevice::new_frame() {
         vkResetFences( vulkan_device, fence_count, fences );
     }
 
+    // Frames up to absolute_frame - k_max_frames are completed: destroy the resources they could use.
+    deletion_queue.collect( completed_frame_timeline_value(), destroy_resources_callback, this );
+    // After the collect, so frees of completed frames are already visible in the budgets.
+    memory_budget.update( absolute_frame );
+
     VkResult result = vkAcquireNextImageKHR( vulkan_device, vulkan_swapchain, UINT64_MAX, vulkan_image_acquired_semaphore, VK_NULL_HANDLE, &vulkan_image_index );
     if ( result == VK_ERROR_OUT_OF_DATE_KHR ) {
         resize_swapchain();
@@ -3938,89 +4237,85 @@ void GpuDevice::present( CommandBuffer* async_compute_command_buffer ) {
         VkDescriptorImageInfo bindless_image_info[ k_max_bindless_resources ];
 
         Texture* vk_dummy_texture = access_texture( dummy_texture );
+        Sampler* vk_default_sampler = access_sampler( default_sampler );
 
+        // Updates are written in order, so a texture created and destroyed in the same frame
+        // ends with the dummy texture in its slot. Updates that do not fit are kept for the next frame.
         u32 current_write_index = 0;
-        for ( i32 it = texture_to_update_bindless.size - 1; it >= 0; it-- ) {
-            ResourceUpdate& texture_to_update = texture_to_update_bindless[ it ];
+        u32 num_pending_updates = 0;
+        for ( u32 it = 0; it < texture_to_update_bindless.size; ++it ) {
+            const BindlessTextureUpdate texture_to_update = texture_to_update_bindless[ it ];
 
-            //if ( texture_to_update.current_frame == current_frame )
-            {
-                Texture* texture = access_texture( { texture_to_update.handle } );
+            if ( current_write_index + 2 > k_max_bindless_resources ) {
+                texture_to_update_bindless[ num_pending_updates++ ] = texture_to_update;
+                continue;
+            }
 
-                if ( texture->vk_image_view == VK_NULL_HANDLE ) {
-                    continue;
-                }
+            Texture* texture = access_texture( { texture_to_update.handle } );
 
-                VkWriteDescriptorSet& descriptor_write = bindless_descriptor_writes[ current_write_index ];
-                descriptor_write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
-                descriptor_write.descriptorCount = 1;
-                descriptor_write.dstArrayElement = texture_to_update.handle;
-                descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-                descriptor_write.dstSet = vulkan_bindless_descriptor_set_cached;
-                descriptor_write.dstBinding = k_bindless_texture_binding;
+            // Already destroyed.
+            if ( texture->vk_image_view == VK_NULL_HANDLE ) {
+                continue;
+            }
 
-                // Handles should be the same.
-                RASSERT( texture->handle.index == texture_to_update.handle );
+            VkWriteDescriptorSet& descriptor_write = bindless_descriptor_writes[ current_write_index ];
+            descriptor_write = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+            descriptor_write.descriptorCount = 1;
+            descriptor_write.dstArrayElement = texture_to_update.handle;
+            descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptor_write.dstSet = vulkan_bindless_descriptor_set_cached;
+            descriptor_write.dstBinding = k_bindless_texture_binding;
 
-                Sampler* vk_default_sampler = access_sampler( default_sampler );
-                VkDescriptorImageInfo& descriptor_image_info = bindless_image_info[ current_write_index ];
+            // Handles should be the same.
+            RASSERT( texture->handle.index == texture_to_update.handle );
 
-                // Update image view and sampler if valid
-                if ( !texture_to_update.deleting ) {
-                    descriptor_image_info.imageView = texture->vk_image_view;
+            VkDescriptorImageInfo& descriptor_image_info = bindless_image_info[ current_write_index ];
 
-                    if ( texture->sampler != nullptr ) {
-                        descriptor_image_info.sampler = texture->sampler->vk_sampler;
-                    } else {
-                        descriptor_image_info.sampler = vk_default_sampler->vk_sampler;
-                    }
-                }
-                else {
-                    // Deleting: set to default image view and sampler in the current slot.
-                    descriptor_image_info.imageView = vk_dummy_texture->vk_image_view;
+            // Update image view and sampler if valid
+            if ( !texture_to_update.deleting ) {
+                descriptor_image_info.imageView = texture->vk_image_view;
+
+                if ( texture->sampler != nullptr ) {
+                    descriptor_image_info.sampler = texture->sampler->vk_sampler;
+                } else {
                     descriptor_image_info.sampler = vk_default_sampler->vk_sampler;
                 }
+            }
+            else {
+                // Deleting: set to default image view and sampler in the current slot.
+                descriptor_image_info.imageView = vk_dummy_texture->vk_image_view;
+                descriptor_image_info.sampler = vk_default_sampler->vk_sampler;
 
-                descriptor_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-                descriptor_write.pImageInfo = &descriptor_image_info;
-
-                texture_to_update.current_frame = u32_max;
-                // Cache this value, as delete_swap will modify the texture_to_update reference.
-                const bool add_texture_to_delete = texture_to_update.deleting;
-                texture_to_update_bindless.delete_swap( it );
-
-                ++current_write_index;
+                // The slot is recycled when the texture is destroyed, after the frames that can still sample it are completed.
+                deletion_queue.enqueue( ResourceUpdateType::Texture, texture->handle.index, frame_timeline_value() );
+            }
 
-                // Debug
-                //if ( strcmp("", texture->name) == 0 ) {
-                    //rprint( "%s texture %u\n", add_texture_to_delete ? "Deleting" : "Updating", texture->handle.index );
-                //}
+            descriptor_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            descriptor_write.pImageInfo = &descriptor_image_info;
 
-                // Add texture to delete
-                if ( add_texture_to_delete ) {
-                    resource_deletion_queue.push( { ResourceUpdateType::Texture, texture->handle.index, current_frame, 1 } );
-                }
+            ++current_write_index;
 
-                // Add optional compute bindless descriptor update
-                if ( texture->flags & TextureFlags::Compute_mask ) {
-                    VkWriteDescriptorSet& descriptor_write_image = bindless_descriptor_writes[ current_write_index ];
-                    VkDescriptorImageInfo& descriptor_image_info_compute = bindless_image_info[ current_write_index ];
+            // Add optional compute bindless descriptor update
+            if ( texture->flags & TextureFlags::Compute_mask ) {
+                VkWriteDescriptorSet& descriptor_write_image = bindless_descriptor_writes[ current_write_index ];
+                VkDescriptorImageInfo& descriptor_image_info_compute = bindless_image_info[ current_write_index ];
 
-                    // Copy common data from descriptor and image info
-                    descriptor_write_image = descriptor_write;
-                    descriptor_image_info_compute = descriptor_image_info;
+                // Copy common data from descriptor and image info
+                descriptor_write_image = descriptor_write;
+                descriptor_image_info_compute = descriptor_image_info;
 
-                    descriptor_image_info_compute.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+                descriptor_image_info_compute.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
-                    descriptor_write_image.dstBinding = k_bindless_image_binding;
-                    descriptor_write_image.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-                    descriptor_write_image.pImageInfo = &descriptor_image_info_compute;
+                descriptor_write_image.dstBinding = k_bindless_image_binding;
+                descriptor_write_image.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                descriptor_write_image.pImageInfo = &descriptor_image_info_compute;
 
-                    ++current_write_index;
-                }
+                ++current_write_index;
             }
         }
 
+        texture_to_update_bindless.set_size( num_pending_updates );
+
         if ( current_write_index ) {
             vkUpdateDescriptorSets( vulkan_device, current_write_index, bindless_descriptor_writes, 0, nullptr );
         }
@@ -4327,85 +4622,6 @@ void GpuDevice::present( CommandBuffer* async_compute_command_buffer ) {
 
     // This is called inside resize_swapchain as well to correctly work.
     frame_counters_advance();
-
-    // Resource deletion using reverse iteration and swap with last element.
-    if ( resource_deletion_queue.size > 0 ) {
-        for ( i32 i = resource_deletion_queue.size - 1; i >= 0; i-- ) {
-            ResourceUpdate& resource_deletion = resource_deletion_queue[ i ];
-
-            if ( resource_deletion.current_frame == current_frame ) {
-
-                switch ( resource_deletion.type ) {
-
-                    case ResourceUpdateType::Buffer:
-                    {
-                        destroy_buffer_instant( resource_deletion.handle );
-                        break;
-                    }
-
-                    case ResourceUpdateType::Pipeline:
-                    {
-                        destroy_pipeline_instant( resource_deletion.handle );
-                        break;
-                    }
-
-                    case ResourceUpdateType::RenderPass:
-                    {
-                        destroy_render_pass_instant( resource_deletion.handle );
-                        break;
-                    }
-
-                    case ResourceUpdateType::Framebuffer:
-                    {
-                        destroy_framebuffer_instant( resource_deletion.handle );
-                        break;
-                    }
-
-                    case ResourceUpdateType::DescriptorSet:
-                    {
-                        destroy_descriptor_set_instant( resource_deletion.handle );
-                        break;
-                    }
-
-                    case ResourceUpdateType::DescriptorSetLayout:
-                    {
-                        destroy_descriptor_set_layout_instant( resource_deletion.handle );
-                        break;
-                    }
-
-                    case ResourceUpdateType::Sampler:
-                    {
-                        destroy_sampler_instant( resource_deletion.handle );
-                        break;
-                    }
-
-                    case ResourceUpdateType::ShaderState:
-                    {
-                        destroy_shader_state_instant( resource_deletion.handle );
-                        break;
-                    }
-
-                    case ResourceUpdateType::Texture:
-                    {
-                        destroy_texture_instant( resource_deletion.handle );
-                        break;
-                    }
-
-                    case ResourceUpdateType::PagePool:
-                    {
-                        destroy_page_pool_instant( resource_deletion.handle );
-                        break;
-                    }
-                }
-
-                // Mark resource as free
-                resource_deletion.current_frame = u32_max;
-
-                // Swap element
-                resource_deletion_queue.delete_swap( i );
-            }
-        }
-    }
 }
 
 void GpuDevice::submit_compute_load( CommandBuffer* command_buffer ) {
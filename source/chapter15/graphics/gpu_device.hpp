@@ -21,6 +21,10 @@
 VK_DEFINE_HANDLE( VmaAllocator )
 
 #include "graphics/gpu_resources.hpp"
+#include "graphics/deletion_queue.hpp"
+#include "graphics/gpu_memory_budget.hpp"
+#include "graphics/descriptor_set_cache.hpp"
+#include "graphics/spirv_reflection_cache.hpp"
 
 #include "foundation/data_structures.hpp"
 #include "foundation/string.hpp"
@@ -122,6 +126,10 @@ struct GpuDevice : public Service {
     static void                     fill_write_descriptor_sets( GpuDevice& gpu, const DescriptorSetLayout* descriptor_set_layout, DescriptorSet* descriptor_set,
                                                                 VkWriteDescriptorSet* descriptor_write, VkDescriptorBufferInfo* buffer_info, VkDescriptorImageInfo* image_info,
                                                                 VkSampler vk_default_sampler, u32& num_resources );
+    static void                     sort_descriptor_set_resources( const DescriptorSetCreation& creation, ResourceHandle* out_resources, SamplerHandle* out_samplers, u16* out_bindings );
+    static DescriptorSetKey         get_descriptor_set_key( const DescriptorSet* descriptor_set );
+    // Hash of the Vulkan objects the key resources currently resolve to, it changes when a texture is resized.
+    u64                             get_descriptor_set_views_hash( const DescriptorSetLayout* descriptor_set_layout, const DescriptorSetKey& key );
 
     // Init/Terminate methods
     void                            init( const GpuDeviceCreation& creation );
@@ -135,6 +143,11 @@ struct GpuDevice : public Service {
     SamplerHandle                   create_sampler( const SamplerCreation& creation );
     DescriptorSetLayoutHandle       create_descriptor_set_layout( const DescriptorSetLayoutCreation& creation );
     DescriptorSetHandle             create_descriptor_set( const DescriptorSetCreation& creation );
+    // Allocates the set from the given pool and writes its content, key resources must be sorted by binding.
+    bool                            init_descriptor_set( DescriptorSet* descriptor_set, VkDescriptorPool descriptor_pool, const DescriptorSetLayout* descriptor_set_layout,
+                                                         const DescriptorSetKey& key );
+    // Stops sharing the cached sets that reference the resource, their current owners keep them.
+    void                            uncache_descriptor_sets( ResourceHandle resource, bool texture );
     RenderPassHandle                create_render_pass( const RenderPassCreation& creation );
     FramebufferHandle               create_framebuffer( const FramebufferCreation& creation );
     ShaderStateHandle               create_shader_state( const ShaderStateCreation& creation );
@@ -142,6 +155,8 @@ struct GpuDevice : public Service {
     void                            destroy_buffer( BufferHandle buffer );
     void                            destroy_texture( TextureHandle texture );
     void                            destroy_pipeline( PipelineHandle pipeline );
+    // Moves the replacement pipeline into the existing handle, the replacement handle is released.
+    void                            replace_pipeline( PipelineHandle pipeline, PipelineHandle replacement );
     void                            destroy_sampler( SamplerHandle sampler );
     void                            destroy_descriptor_set_layout( DescriptorSetLayoutHandle layout );
     void                            destroy_descriptor_set( DescriptorSetHandle set );
@@ -179,11 +194,19 @@ struct GpuDevice : public Service {
     void                            set_present_mode( PresentMode::Enum mode );
 
     void                            frame_counters_advance();
+    // Graphics timeline value signaled by the submission of the current frame.
+    u64                             frame_timeline_value() const    { return absolute_frame + 1; }
+    // Frames up to this timeline value are done on the gpu, after new_frame waited for them.
+    u64                             completed_frame_timeline_value() const { return absolute_frame >= k_max_frames ? absolute_frame - ( k_max_frames - 1 ) : 0; }
 
     bool                            get_family_queue( VkPhysicalDevice physical_device );
 
     VkDeviceAddress                 get_buffer_device_address( BufferHandle handle );
     VkShaderModuleCreateInfo        compile_shader( cstring code, u32 code_size, VkShaderStageFlagBits stage, cstring name );
+    // Compiles with a caller owned allocator and temporary files, to compile outside of the main thread.
+    // Defines are added to the compiler arguments, e.g. "--D NAME=1".
+    VkShaderModuleCreateInfo        compile_shader( cstring code, u32 code_size, VkShaderStageFlagBits stage, cstring name, Allocator* allocator, cstring temp_file_prefix,
+                                                    cstring defines = "" );
 
     // Swapchain //////////////////////////////////////////////////////////
     void                            create_swapchain();
@@ -249,6 +272,8 @@ struct GpuDevice : public Service {
     void                            destroy_framebuffer_instant( ResourceHandle framebuffer );
     void                            destroy_shader_state_instant( ResourceHandle shader );
     void                            destroy_page_pool_instant( ResourceHandle handle );
+    // Destroys a batch of resources of the same type.
+    void                            destroy_resources_instant( ResourceUpdateType::Enum type, const u32* handles, u32 count );
 
     void                            update_descriptor_set_instant( const DescriptorSetUpdate& update );
 
@@ -402,10 +427,13 @@ struct GpuDevice : public Service {
     Array<VkPhysicalDeviceFragmentShadingRateKHR> fragment_shading_rates;
 
     // These are dynamic - so that workload can be handled correctly.
-    Array<ResourceUpdate>           resource_deletion_queue;
+    DeletionQueue                   deletion_queue;
+    GpuMemoryBudget                 memory_budget;              // Updated in new_frame, streamable resources register evictors.
     Array<DescriptorSetUpdate>      descriptor_set_updates;
+    DescriptorSetCache              descriptor_set_cache;       // Shares persistent sets with identical content.
+    SpirvReflectionCache            reflection_cache;           // Parsed shader stages, persisted across runs.
     // [TAG: BINDLESS]
-    Array<ResourceUpdate>           texture_to_update_bindless;
+    Array<BindlessTextureUpdate>    texture_to_update_bindless;
 
     Array<SparseMemoryBindInfo>     pending_sparse_memory_info;
     Array<VkSparseImageMemoryBind>  pending_sparse_queue_binds;
@@ -418,6 +446,7 @@ struct GpuDevice : public Service {
     bool                            synchronization2_extension_present      = false;
     bool                            mesh_shaders_extension_present  = false;
     bool                            multiview_extension_present     = false;
+    bool                            memory_budget_extension_present = false;
     bool                            fragment_shading_rate_present   = false;
     bool                            ray_tracing_present             = false;
     bool                            ray_query_present               = false;
@@ -430,6 +459,7 @@ struct GpuDevice : public Service {
     VkPhysicalDeviceRayTracingPipelineFeaturesKHR   ray_tracing_pipeline_features;
     VkPhysicalDeviceRayQueryFeaturesKHR             ray_query_features;
     VkPhysicalDeviceRayTracingPipelinePropertiesKHR ray_tracing_pipeline_properties;
+    VkPhysicalDeviceAccelerationStructurePropertiesKHR acceleration_structure_properties;
     VkPhysicalDeviceAccelerationStructureFeaturesKHR acceleration_structure_features;
 
     char                            vulkan_binaries_path[ 512 ];
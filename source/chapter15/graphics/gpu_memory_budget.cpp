@@ -0,0 +1,350 @@
+#include "graphics/gpu_memory_budget.hpp"
+
+#include "foundation/assert.hpp"
+#include "foundation/log.hpp"
+#include "foundation/numerics.hpp"
+
+#include "external/imgui/imgui.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+namespace raptor {
+
+// Names in the report and the debug window.
+static cstring s_category_names[] = {
+    "Textures", "RenderTargets", "Geometry", "AccelerationStructures", "PagePools", "Other"
+};
+
+static cstring s_pressure_names[] = {
+    "None", "Soft", "Hard"
+};
+
+static_assert( ArraySize( s_category_names ) == GpuMemoryCategory::Count, "Update s_category_names" );
+static_assert( ArraySize( s_pressure_names ) == GpuMemoryPressure::Count, "Update s_pressure_names" );
+
+static f64 to_megabytes( u64 bytes ) {
+    return bytes / ( 1024.0 * 1024.0 );
+}
+
+// GpuMemoryBudgetCreation ////////////////////////////////////////////////
+GpuMemoryBudgetCreation& GpuMemoryBudgetCreation::set_device_limits( u64 device_local_bytes ) {
+    // Soft and hard fractions per category, they add up to more than 1 as not every category is full at once.
+    static const f64 k_limit_ratios[ GpuMemoryCategory::Count ][ 2 ] = {
+        { 0.40, 0.55 },     // Textures
+        { 0.00, 0.35 },     // RenderTargets
+        { 0.00, 0.30 },     // Geometry
+        { 0.00, 0.20 },     // AccelerationStructures
+        { 0.10, 0.20 },     // PagePools
+        { 0.00, 0.00 },     // Other
+    };
+
+    for ( u32 c = 0; c < GpuMemoryCategory::Count; ++c ) {
+        limits[ c ].soft_bytes = ( u64 )( device_local_bytes * k_limit_ratios[ c ][ 0 ] );
+        limits[ c ].hard_bytes = ( u64 )( device_local_bytes * k_limit_ratios[ c ][ 1 ] );
+    }
+    return *this;
+}
+
+// GpuMemoryBudget ////////////////////////////////////////////////////////
+void GpuMemoryBudget::init( const GpuMemoryBudgetCreation& creation ) {
+    provider = creation.provider;
+    provider_context = creation.provider_context;
+    device_soft_ratio = creation.device_soft_ratio;
+    device_hard_ratio = creation.device_hard_ratio;
+    eviction_latency_frames = creation.eviction_latency_frames;
+
+    for ( u32 c = 0; c < GpuMemoryCategory::Count; ++c ) {
+        bytes[ c ].store( 0, std::memory_order_relaxed );
+        allocations[ c ].store( 0, std::memory_order_relaxed );
+        hard_limit_hits[ c ].store( 0, std::memory_order_relaxed );
+
+        peak_bytes[ c ] = 0;
+        evicted_bytes[ c ] = 0;
+        category_pressure[ c ] = GpuMemoryPressure::None;
+        limits[ c ] = creation.limits[ c ];
+    }
+
+    heap_count = 0;
+    evictor_count = 0;
+    event_count = 0;
+
+    current_frame = 0;
+    device_usage = 0;
+    device_budget = 0;
+    device_peak_usage = 0;
+    device_pressure = GpuMemoryPressure::None;
+}
+
+void GpuMemoryBudget::shutdown() {
+    RASSERTM( evictor_count == 0, "Gpu memory budget still has %u evictors registered", evictor_count );
+
+    for ( u32 c = 0; c < GpuMemoryCategory::Count; ++c ) {
+        const u64 category_size = bytes[ c ].load( std::memory_order_relaxed );
+        if ( category_size ) {
+            rprint( "Gpu memory budget: %s still has %" PRIu64 " bytes in %u allocations at shutdown\n", s_category_names[ c ],
+                    category_size, allocations[ c ].load( std::memory_order_relaxed ) );
+        }
+    }
+}
+
+void GpuMemoryBudget::register_evictor( GpuMemoryCategory::Enum category, GpuMemoryEvictionCallback callback, void* context, u8 priority ) {
+    RASSERT( evictor_count < k_gpu_memory_max_evictors );
+
+    // Kept sorted by priority, registration order between equal ones.
+    u32 index = evictor_count;
+    while ( index > 0 && evictors[ index - 1 ].priority > priority ) {
+        evictors[ index ] = evictors[ index - 1 ];
+        --index;
+    }
+
+    GpuMemoryEvictor& evictor = evictors[ index ];
+    evictor.callback = callback;
+    evictor.context = context;
+    evictor.last_frame = 0;
+    evictor.last_freed_bytes = 0;
+    evictor.freed_bytes = 0;
+    evictor.category = category;
+    evictor.priority = priority;
+
+    ++evictor_count;
+}
+
+void GpuMemoryBudget::unregister_evictor( GpuMemoryEvictionCallback callback, void* context ) {
+    for ( u32 e = 0; e < evictor_count; ++e ) {
+        if ( evictors[ e ].callback == callback && evictors[ e ].context == context ) {
+            for ( u32 n = e + 1; n < evictor_count; ++n ) {
+                evictors[ n - 1 ] = evictors[ n ];
+            }
+            --evictor_count;
+            return;
+        }
+    }
+}
+
+void GpuMemoryBudget::on_allocation( GpuMemoryCategory::Enum category, u64 allocation_size ) {
+    const u64 category_size = bytes[ category ].fetch_add( allocation_size, std::memory_order_relaxed ) + allocation_size;
+    allocations[ category ].fetch_add( 1, std::memory_order_relaxed );
+
+    if ( limits[ category ].hard_bytes && category_size > limits[ category ].hard_bytes ) {
+        hard_limit_hits[ category ].fetch_add( 1, std::memory_order_relaxed );
+    }
+}
+
+void GpuMemoryBudget::on_free( GpuMemoryCategory::Enum category, u64 allocation_size ) {
+    bytes[ category ].fetch_sub( allocation_size, std::memory_order_relaxed );
+    allocations[ category ].fetch_sub( 1, std::memory_order_relaxed );
+}
+
+bool GpuMemoryBudget::can_allocate( GpuMemoryCategory::Enum category, u64 allocation_size ) const {
+    const u64 hard_bytes = limits[ category ].hard_bytes;
+    if ( hard_bytes && category_bytes( category ) + allocation_size > hard_bytes ) {
+        return false;
+    }
+
+    return device_budget == 0 || device_usage + allocation_size <= ( u64 )( device_budget * ( f64 )device_hard_ratio );
+}
+
+u64 GpuMemoryBudget::pending_freed_bytes( GpuMemoryCategory::Enum category, bool all_categories ) const {
+    u64 pending = 0;
+    for ( u32 e = 0; e < evictor_count; ++e ) {
+        const GpuMemoryEvictor& evictor = evictors[ e ];
+        if ( ( all_categories || evictor.category == category ) && current_frame < evictor.last_frame + eviction_latency_frames ) {
+            pending += evictor.last_freed_bytes;
+        }
+    }
+    return pending;
+}
+
+u64 GpuMemoryBudget::evict( u32 evictor_index, u64 requested_bytes, GpuMemoryPressure::Enum pressure, bool device ) {
+    GpuMemoryEvictor& evictor = evictors[ evictor_index ];
+    const u64 freed = evictor.callback( evictor.context, evictor.category, requested_bytes );
+
+    // Previous evictions still in flight stay counted.
+    const bool in_flight = evictor.last_freed_bytes && current_frame < evictor.last_frame + eviction_latency_frames;
+    evictor.last_freed_bytes = in_flight ? evictor.last_freed_bytes + freed : freed;
+    evictor.last_frame = current_frame;
+    evictor.freed_bytes += freed;
+    evicted_bytes[ evictor.category ] += freed;
+
+    GpuMemoryBudgetEvent& event = events[ event_count % k_gpu_memory_max_events ];
+    event.frame = current_frame;
+    event.requested_bytes = requested_bytes;
+    event.freed_bytes = freed;
+    event.category = evictor.category;
+    event.pressure = pressure;
+    event.device = device;
+    ++event_count;
+
+    return freed;
+}
+
+void GpuMemoryBudget::update( u64 frame ) {
+    current_frame = frame;
+
+    // Device local heaps, or all of them when none is (software implementations).
+    if ( provider ) {
+        heap_count = raptor::min( provider( provider_context, heaps, k_gpu_memory_max_heaps ), k_gpu_memory_max_heaps );
+    }
+
+    bool has_device_local = false;
+    for ( u32 h = 0; h < heap_count; ++h ) {
+        has_device_local = has_device_local || heaps[ h ].device_local;
+    }
+
+    device_usage = 0;
+    device_budget = 0;
+    for ( u32 h = 0; h < heap_count; ++h ) {
+        if ( heaps[ h ].device_local || !has_device_local ) {
+            device_usage += heaps[ h ].usage;
+            device_budget += heaps[ h ].budget;
+        }
+    }
+    device_peak_usage = raptor::max( device_peak_usage, device_usage );
+
+    const u64 device_soft_bytes = ( u64 )( device_budget * ( f64 )device_soft_ratio );
+    const u64 device_hard_bytes = ( u64 )( device_budget * ( f64 )device_hard_ratio );
+    device_pressure = device_budget == 0 ? GpuMemoryPressure::None :
+                      device_usage > device_hard_bytes ? GpuMemoryPressure::Hard :
+                      device_usage > device_soft_bytes ? GpuMemoryPressure::Soft : GpuMemoryPressure::None;
+
+    // Category limits first, only the evictors of the category.
+    for ( u32 c = 0; c < GpuMemoryCategory::Count; ++c ) {
+        const GpuMemoryCategory::Enum category = ( GpuMemoryCategory::Enum )c;
+        const GpuMemoryCategoryLimits& category_limits = limits[ c ];
+        const u64 category_size = category_bytes( category );
+        peak_bytes[ c ] = raptor::max( peak_bytes[ c ], category_size );
+
+        category_pressure[ c ] = category_limits.hard_bytes && category_size > category_limits.hard_bytes ? GpuMemoryPressure::Hard :
+                                 category_limits.soft_bytes && category_size > category_limits.soft_bytes ? GpuMemoryPressure::Soft : GpuMemoryPressure::None;
+
+        if ( category_pressure[ c ] == GpuMemoryPressure::None ) {
+            continue;
+        }
+
+        // Back under the soft limit, or under the hard one when it is the only limit.
+        const u64 target_bytes = category_limits.soft_bytes ? category_limits.soft_bytes : category_limits.hard_bytes;
+        const u64 pending = pending_freed_bytes( category, false );
+        u64 excess = category_size - target_bytes;
+        excess = excess > pending ? excess - pending : 0;
+
+        for ( u32 e = 0; e < evictor_count && excess; ++e ) {
+            if ( evictors[ e ].category != category ) {
+                continue;
+            }
+
+            const u64 freed = evict( e, excess, category_pressure[ c ], false );
+            excess -= raptor::min( freed, excess );
+        }
+    }
+
+    // Device heaps, all evictors by priority.
+    if ( device_pressure != GpuMemoryPressure::None ) {
+        const u64 pending = pending_freed_bytes( GpuMemoryCategory::Count, true );
+        u64 excess = device_usage - device_soft_bytes;
+        excess = excess > pending ? excess - pending : 0;
+
+        for ( u32 e = 0; e < evictor_count && excess; ++e ) {
+            const u64 freed = evict( e, excess, device_pressure, true );
+            excess -= raptor::min( freed, excess );
+        }
+    }
+}
+
+bool GpuMemoryBudget::write_json( cstring path ) const {
+    FILE* file = fopen( path, "w" );
+    if ( !file ) {
+        rprint( "Cannot write gpu memory budget report %s\n", path );
+        return false;
+    }
+
+    write_json( file );
+
+    fclose( file );
+    return true;
+}
+
+void GpuMemoryBudget::write_json( FILE* file ) const {
+    fprintf( file, "{\n\t\"frame\": %" PRIu64 ",\n", current_frame );
+    fprintf( file, "\t\"device\": { \"usage\": %" PRIu64 ", \"budget\": %" PRIu64 ", \"peak_usage\": %" PRIu64 ", \"soft_ratio\": %f, \"hard_ratio\": %f, \"pressure\": \"%s\" },\n",
+             device_usage, device_budget, device_peak_usage, device_soft_ratio, device_hard_ratio, s_pressure_names[ device_pressure ] );
+
+    fprintf( file, "\t\"heaps\": [" );
+    for ( u32 h = 0; h < heap_count; ++h ) {
+        fprintf( file, "%s\n\t\t{ \"usage\": %" PRIu64 ", \"budget\": %" PRIu64 ", \"device_local\": %s }", h ? "," : "", heaps[ h ].usage, heaps[ h ].budget,
+                 heaps[ h ].device_local ? "true" : "false" );
+    }
+    fprintf( file, "\n\t],\n" );
+
+    fprintf( file, "\t\"categories\": [" );
+    for ( u32 c = 0; c < GpuMemoryCategory::Count; ++c ) {
+        fprintf( file, "%s\n\t\t{ \"name\": \"%s\", \"bytes\": %" PRIu64 ", \"peak_bytes\": %" PRIu64 ", \"allocations\": %u, \"soft_bytes\": %" PRIu64 ", \"hard_bytes\": %" PRIu64 ", "
+                 "\"pressure\": \"%s\", \"evicted_bytes\": %" PRIu64 ", \"hard_limit_hits\": %u }", c ? "," : "", s_category_names[ c ],
+                 category_bytes( ( GpuMemoryCategory::Enum )c ), peak_bytes[ c ], allocations[ c ].load( std::memory_order_relaxed ), limits[ c ].soft_bytes,
+                 limits[ c ].hard_bytes, s_pressure_names[ category_pressure[ c ] ], evicted_bytes[ c ], hard_limit_hits[ c ].load( std::memory_order_relaxed ) );
+    }
+    fprintf( file, "\n\t],\n" );
+
+    fprintf( file, "\t\"evictors\": [" );
+    for ( u32 e = 0; e < evictor_count; ++e ) {
+        fprintf( file, "%s\n\t\t{ \"category\": \"%s\", \"priority\": %u, \"freed_bytes\": %" PRIu64 ", \"last_frame\": %" PRIu64 " }", e ? "," : "",
+                 s_category_names[ evictors[ e ].category ], evictors[ e ].priority, evictors[ e ].freed_bytes, evictors[ e ].last_frame );
+    }
+    fprintf( file, "\n\t],\n" );
+
+    fprintf( file, "\t\"event_count\": %u,\n\t\"events\": [", event_count );
+    const u32 kept_events = raptor::min( event_count, k_gpu_memory_max_events );
+    for ( u32 i = 0; i < kept_events; ++i ) {
+        const GpuMemoryBudgetEvent& event = events[ ( event_count - kept_events + i ) % k_gpu_memory_max_events ];
+        fprintf( file, "%s\n\t\t{ \"frame\": %" PRIu64 ", \"category\": \"%s\", \"pressure\": \"%s\", \"device\": %s, \"requested_bytes\": %" PRIu64 ", \"freed_bytes\": %" PRIu64 " }",
+                 i ? "," : "", event.frame, s_category_names[ event.category ], s_pressure_names[ event.pressure ],
+                 event.device ? "true" : "false", event.requested_bytes, event.freed_bytes );
+    }
+    fprintf( file, "\n\t]\n}\n" );
+}
+
+void GpuMemoryBudget::imgui_draw() {
+    if ( !ImGui::CollapsingHeader( "Memory Budget" ) ) {
+        return;
+    }
+
+    ImGui::Text( "Device local: %.1fMB / %.1fMB (peak %.1fMB), pressure %s", to_megabytes( device_usage ), to_megabytes( device_budget ),
+                 to_megabytes( device_peak_usage ), s_pressure_names[ device_pressure ] );
+    ImGui::SliderFloat( "Soft ratio", &device_soft_ratio, 0.5f, device_hard_ratio );
+    ImGui::SliderFloat( "Hard ratio", &device_hard_ratio, device_soft_ratio, 1.f );
+
+    if ( ImGui::BeginTable( "Memory categories", 6 ) ) {
+        ImGui::TableSetupColumn( "Category" );
+        ImGui::TableSetupColumn( "MB" );
+        ImGui::TableSetupColumn( "Peak MB" );
+        ImGui::TableSetupColumn( "Soft/Hard MB" );
+        ImGui::TableSetupColumn( "Evicted MB" );
+        ImGui::TableSetupColumn( "Pressure" );
+        ImGui::TableHeadersRow();
+
+        for ( u32 c = 0; c < GpuMemoryCategory::Count; ++c ) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted( s_category_names[ c ] );
+            ImGui::TableNextColumn();
+            ImGui::Text( "%.1f", to_megabytes( category_bytes( ( GpuMemoryCategory::Enum )c ) ) );
+            ImGui::TableNextColumn();
+            ImGui::Text( "%.1f", to_megabytes( peak_bytes[ c ] ) );
+            ImGui::TableNextColumn();
+            ImGui::Text( "%.0f/%.0f", to_megabytes( limits[ c ].soft_bytes ), to_megabytes( limits[ c ].hard_bytes ) );
+            ImGui::TableNextColumn();
+            ImGui::Text( "%.1f", to_megabytes( evicted_bytes[ c ] ) );
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted( s_pressure_names[ category_pressure[ c ] ] );
+        }
+
+        ImGui::EndTable();
+    }
+
+    ImGui::Text( "Evictions %u", event_count );
+    if ( ImGui::Button( "Export report" ) ) {
+        write_json( "gpu_memory_budget.json" );
+    }
+}
+
+} // namespace raptor
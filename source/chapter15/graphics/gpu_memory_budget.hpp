@@ -0,0 +1,168 @@
+#pragma once
+
+#include "foundation/platform.hpp"
+
+#include <atomic>
+#include <stdio.h>
+
+namespace raptor {
+
+// Categories of the gpu allocations, derived by GpuDevice from the resource usage. Page pools back sparse textures
+// (point light shadows).
+namespace GpuMemoryCategory {
+    enum Enum : u8 {
+        Textures, RenderTargets, Geometry, AccelerationStructures, PagePools, Other, Count
+    };
+} // namespace GpuMemoryCategory
+
+namespace GpuMemoryPressure {
+    enum Enum : u8 {
+        None, Soft, Hard, Count
+    };
+} // namespace GpuMemoryPressure
+
+static const u32                    k_gpu_memory_max_heaps      = 16;       // VK_MAX_MEMORY_HEAPS
+static const u32                    k_gpu_memory_max_evictors   = 16;
+static const u32                    k_gpu_memory_max_events     = 64;
+
+//
+//
+struct GpuMemoryHeapBudget {
+
+    u64                             usage;
+    u64                             budget;
+    bool                            device_local;
+
+}; // struct GpuMemoryHeapBudget
+
+// Fills the budgets of the memory heaps, returns the heap count. GpuDevice uses vmaGetHeapBudgets.
+typedef u32                         ( *GpuMemoryBudgetProvider )( void* context, GpuMemoryHeapBudget* out_heaps, u32 max_heaps );
+// Frees up to bytes of the category, usually through deferred destruction. Returns the bytes that will be freed.
+typedef u64                         ( *GpuMemoryEvictionCallback )( void* context, GpuMemoryCategory::Enum category, u64 bytes );
+
+//
+// Zero means no limit.
+struct GpuMemoryCategoryLimits {
+
+    u64                             soft_bytes          = 0;    // Over it the evictors of the category are called.
+    u64                             hard_bytes          = 0;    // Over it can_allocate fails.
+
+}; // struct GpuMemoryCategoryLimits
+
+//
+//
+struct GpuMemoryEvictor {
+
+    GpuMemoryEvictionCallback       callback;
+    void*                           context;
+
+    u64                             last_frame;
+    u64                             last_freed_bytes;   // Still counted as freed until eviction_latency_frames passed.
+    u64                             freed_bytes;
+
+    GpuMemoryCategory::Enum         category;
+    u8                              priority;           // Lower are asked first when the device heaps are over budget.
+
+}; // struct GpuMemoryEvictor
+
+//
+//
+struct GpuMemoryBudgetEvent {
+
+    u64                             frame;
+    u64                             requested_bytes;
+    u64                             freed_bytes;
+
+    GpuMemoryCategory::Enum         category;
+    GpuMemoryPressure::Enum         pressure;
+    bool                            device;             // Caused by the device heaps instead of the category limits.
+
+}; // struct GpuMemoryBudgetEvent
+
+//
+//
+struct GpuMemoryBudgetCreation {
+
+    // Limits as fractions of the device local memory: streamed textures and page pools are evicted past their soft
+    // limit, render targets, geometry and acceleration structures cannot be evicted and only have a hard one.
+    GpuMemoryBudgetCreation&        set_device_limits( u64 device_local_bytes );
+
+    GpuMemoryBudgetProvider         provider            = nullptr;
+    void*                           provider_context    = nullptr;
+
+    GpuMemoryCategoryLimits         limits[ GpuMemoryCategory::Count ];
+
+    f32                             device_soft_ratio   = 0.85f;    // Of the device local budget.
+    f32                             device_hard_ratio   = 0.95f;
+    u32                             eviction_latency_frames = 4;    // Frames before evicted memory shows in the budgets.
+
+}; // struct GpuMemoryBudgetCreation
+
+//
+// Tracks the gpu memory per category and polls the heap budgets once per frame. Categories over their soft limit,
+// or the device local heaps over device_soft_ratio of their budget, call the eviction callbacks of the streamable
+// resources. Evicted memory is freed frames later through the deletion queue, so the bytes an evictor returned are
+// considered gone for eviction_latency_frames and the same memory is not asked twice.
+// Allocations are tracked from any thread, everything else is on the main thread.
+struct GpuMemoryBudget {
+
+    void                            init( const GpuMemoryBudgetCreation& creation );
+    void                            shutdown();
+
+    void                            register_evictor( GpuMemoryCategory::Enum category, GpuMemoryEvictionCallback callback, void* context, u8 priority );
+    void                            unregister_evictor( GpuMemoryEvictionCallback callback, void* context );
+
+    void                            on_allocation( GpuMemoryCategory::Enum category, u64 bytes );
+    void                            on_free( GpuMemoryCategory::Enum category, u64 bytes );
+
+    // False when the allocation would go over the hard limit of the category or of the device heaps.
+    bool                            can_allocate( GpuMemoryCategory::Enum category, u64 bytes ) const;
+
+    void                            update( u64 frame );
+
+    u64                             category_bytes( GpuMemoryCategory::Enum category ) const    { return bytes[ category ].load( std::memory_order_relaxed ); }
+
+    bool                            write_json( cstring path ) const;
+    void                            write_json( FILE* file ) const;
+
+    void                            imgui_draw();
+
+    std::atomic<u64>                bytes[ GpuMemoryCategory::Count ];
+    std::atomic<u32>                allocations[ GpuMemoryCategory::Count ];
+    std::atomic<u32>                hard_limit_hits[ GpuMemoryCategory::Count ];    // Allocations made over the hard limit.
+
+    u64                             peak_bytes[ GpuMemoryCategory::Count ];         // Sampled in update.
+    u64                             evicted_bytes[ GpuMemoryCategory::Count ];
+    GpuMemoryPressure::Enum         category_pressure[ GpuMemoryCategory::Count ];
+    GpuMemoryCategoryLimits         limits[ GpuMemoryCategory::Count ];
+
+    GpuMemoryHeapBudget             heaps[ k_gpu_memory_max_heaps ];
+    u32                             heap_count          = 0;
+
+    GpuMemoryEvictor                evictors[ k_gpu_memory_max_evictors ];
+    u32                             evictor_count       = 0;
+
+    GpuMemoryBudgetEvent            events[ k_gpu_memory_max_events ];
+    u32                             event_count         = 0;            // Since init, the last k_gpu_memory_max_events are kept.
+
+    GpuMemoryBudgetProvider         provider            = nullptr;
+    void*                           provider_context    = nullptr;
+
+    u64                             current_frame       = 0;
+    u64                             device_usage        = 0;
+    u64                             device_budget       = 0;
+    u64                             device_peak_usage   = 0;
+    GpuMemoryPressure::Enum         device_pressure     = GpuMemoryPressure::None;
+
+    f32                             device_soft_ratio   = 0.85f;
+    f32                             device_hard_ratio   = 0.95f;
+    u32                             eviction_latency_frames = 4;
+
+private:
+
+    u64                             pending_freed_bytes( GpuMemoryCategory::Enum category, bool all_categories ) const;
+    u64                             evict( u32 evictor_index, u64 requested_bytes, GpuMemoryPressure::Enum pressure, bool device );
+
+}; // struct GpuMemoryBudget
+
+} // namespace raptor
@@ -36,12 +36,20 @@ void GpuVisualProfiler::init( Allocator* allocator_, u32 max_frames_, u32 max_qu
 
     name_to_color.init( allocator, 16 );
     name_to_color.set_default_value( u32_max );
+
+    capture_statistics.init( allocator, 64 );
+    capture_baseline.init( allocator, 64 );
+    capture_regressions.init( allocator, 64 );
 }
 
 void GpuVisualProfiler::shutdown() {
 
     name_to_color.shutdown();
 
+    capture_statistics.shutdown();
+    capture_baseline.shutdown();
+    capture_regressions.shutdown();
+
     rfree( timestamps, allocator );
     rfree( per_frame_active, allocator );
 }
@@ -85,6 +93,10 @@ void GpuVisualProfiler::update( GpuDevice& gpu ) {
         timestamp.color = raptor::Color::get_distinct_color( color_index );
     }
 
+    if ( capture ) {
+        capture->record_frame( &timestamps[ max_queries_per_frame * current_frame ], active_timestamps, pipeline_statistics );
+    }
+
     current_frame = ( current_frame + 1 ) % max_frames;
 
     // Reset Min/Max/Average after few frames
@@ -291,6 +303,71 @@ void GpuVisualProfiler::imgui_draw() {
     }
 
     ImGui::Combo( "Stat Units", &stat_unit_index, stat_unit_names, IM_ARRAYSIZE( stat_unit_names ) );
+
+    if ( capture && ImGui::CollapsingHeader( "Capture" ) ) {
+        ImGui::Checkbox( "Record", &capture->recording );
+        ImGui::SameLine();
+        if ( ImGui::Button( "Clear" ) ) {
+            capture->reset();
+        }
+        ImGui::Text( "Frames %u/%u, dropped queries %u", capture->frame_count, capture->max_frames, capture->dropped_queries );
+
+        if ( ImGui::Button( "Export" ) ) {
+            capture->write_chrome_trace( "gpu_capture.json" );
+            capture->write_csv( "gpu_capture.csv" );
+            capture->write_frames_csv( "gpu_capture_frames.csv" );
+
+            capture->compute_pass_statistics( capture_statistics );
+            gpu_profiler_write_statistics_csv( "gpu_capture_passes.csv", capture_statistics );
+        }
+        ImGui::SameLine();
+        if ( ImGui::Button( "Set baseline" ) ) {
+            capture->compute_pass_statistics( capture_baseline );
+        }
+
+        capture->compute_pass_statistics( capture_statistics );
+        const u32 regressed_passes = gpu_profiler_compare_statistics( capture_baseline, capture_statistics, 0.1f, 0.05f, capture_regressions );
+        if ( capture_baseline.size ) {
+            ImGui::Text( "Regressed passes (p95 +10%% and +0.05ms): %u", regressed_passes );
+        }
+
+        if ( ImGui::BeginTable( "GPU passes", 6 ) ) {
+            ImGui::TableSetupColumn( "Pass" );
+            ImGui::TableSetupColumn( "Avg" );
+            ImGui::TableSetupColumn( "P95" );
+            ImGui::TableSetupColumn( "P99" );
+            ImGui::TableSetupColumn( "Max" );
+            ImGui::TableSetupColumn( "Baseline P95" );
+            ImGui::TableHeadersRow();
+
+            for ( u32 i = 0; i < capture_statistics.size; ++i ) {
+                const GpuPassStatistics& pass_statistics = capture_statistics[ i ];
+                const GpuPassRegression& regression = capture_regressions[ i ];
+
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                if ( regression.regressed ) {
+                    ImGui::TextColored( { 1.f, 0.3f, 0.3f, 1.f }, "%s", pass_statistics.name );
+                } else {
+                    ImGui::TextUnformatted( pass_statistics.name );
+                }
+                ImGui::TableNextColumn();
+                ImGui::Text( "%2.3f", pass_statistics.average_ms );
+                ImGui::TableNextColumn();
+                ImGui::Text( "%2.3f", pass_statistics.p95_ms );
+                ImGui::TableNextColumn();
+                ImGui::Text( "%2.3f", pass_statistics.p99_ms );
+                ImGui::TableNextColumn();
+                ImGui::Text( "%2.3f", pass_statistics.max_ms );
+                ImGui::TableNextColumn();
+                if ( !regression.added ) {
+                    ImGui::Text( "%2.3f", regression.baseline_p95_ms );
+                }
+            }
+
+            ImGui::EndTable();
+        }
+    }
 }
 
 
@@ -2,6 +2,7 @@
 
 #include "foundation/memory.hpp"
 #include "graphics/gpu_device.hpp"
+#include "graphics/gpu_profiler_capture.hpp"
 
 namespace raptor {
 
@@ -105,6 +106,11 @@ struct GpuVisualProfiler {
     u16*                        per_frame_active;
     GpuPipelineStatistics*      pipeline_statistics;    // Per frame collected pipeline statistics.
 
+    GpuProfilerCapture*         capture = nullptr;      // Optional, records the collected frames.
+    Array<GpuPassStatistics>    capture_statistics;
+    Array<GpuPassStatistics>    capture_baseline;       // Statistics of a previous capture to compare with.
+    Array<GpuPassRegression>    capture_regressions;
+
     u32                         max_frames;
     u32                         max_queries_per_frame;
     u32                         current_frame;
@@ -0,0 +1,473 @@
+#include "graphics/gpu_profiler_capture.hpp"
+
+#include "graphics/gpu_profiler.hpp"
+
+#include "foundation/assert.hpp"
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+#include "foundation/time.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace raptor {
+
+static_assert( GpuPipelineStatistics::Count == k_gpu_capture_pipeline_statistics, "Update k_gpu_capture_pipeline_statistics" );
+
+static cstring s_pipeline_statistics_names[] = {
+    "vertices", "primitives", "vertex_shader_invocations", "clipping_invocations", "clipping_primitives",
+    "fragment_shader_invocations", "compute_shader_invocations"
+};
+
+static const u16 k_unnamed_query_index = 0;
+
+static void write_json_string( FILE* file, cstring text ) {
+    fputc( '"', file );
+    for ( cstring c = text; c && *c; ++c ) {
+        if ( *c == '"' || *c == '\\' ) {
+            fputc( '\\', file );
+        }
+        fputc( *c, file );
+    }
+    fputc( '"', file );
+}
+
+static void write_csv_string( FILE* file, cstring text ) {
+    fputc( '"', file );
+    for ( cstring c = text; c && *c; ++c ) {
+        if ( *c == '"' ) {
+            fputc( '"', file );
+        }
+        fputc( *c, file );
+    }
+    fputc( '"', file );
+}
+
+static int sorting_ms_fn( const void* a, const void* b ) {
+    const f32 ms_a = *( const f32* )a;
+    const f32 ms_b = *( const f32* )b;
+    return ms_a < ms_b ? -1 : ( ms_a > ms_b ? 1 : 0 );
+}
+
+// Nearest rank on sorted samples.
+static f32 percentile( const f32* sorted_samples, u32 count, f32 p ) {
+    const u32 rank = ( u32 )ceilf( p * count );
+    return sorted_samples[ raptor::clamp( rank, 1u, count ) - 1 ];
+}
+
+// GpuProfilerCapture /////////////////////////////////////////////////////
+void GpuProfilerCapture::init( Allocator* allocator_, u32 max_frames_, u32 max_queries_per_frame_ ) {
+    allocator = allocator_;
+    max_frames = max_frames_;
+    max_queries_per_frame = max_queries_per_frame_;
+
+    frames.init( allocator, max_frames, max_frames );
+    queries.init( allocator, max_frames * max_queries_per_frame, max_frames * max_queries_per_frame );
+
+    name_to_index.init( allocator, 64 );
+    name_to_index.set_default_value( u32_max );
+    names.init( allocator, 64 );
+    names_buffer.init( rkilo( 16 ), allocator );
+    names.push( names_buffer.append_use( "unnamed" ) );
+
+    reset();
+}
+
+void GpuProfilerCapture::shutdown() {
+    frames.shutdown();
+    queries.shutdown();
+    name_to_index.shutdown();
+    names.shutdown();
+    names_buffer.shutdown();
+}
+
+// Names are kept, statistics computed before still point to them.
+void GpuProfilerCapture::reset() {
+    start_time = time_now();
+    recorded_frames = 0;
+    frame_count = 0;
+    next_frame = 0;
+    dropped_queries = 0;
+}
+
+u16 GpuProfilerCapture::get_name_index( cstring name ) {
+    if ( name == nullptr ) {
+        return k_unnamed_query_index;
+    }
+
+    const u64 name_hash = hash_calculate( name );
+    const u32 existing_index = name_to_index.get( name_hash );
+    if ( existing_index != u32_max ) {
+        return ( u16 )existing_index;
+    }
+
+    // The pointers of the queries can go away with the frame graph, keep a copy.
+    cstring name_copy = names.size < u16_max ? names_buffer.append_use( name ) : nullptr;
+    if ( name_copy == nullptr ) {
+        return k_unnamed_query_index;
+    }
+
+    const u16 name_index = ( u16 )names.size;
+    names.push( name_copy );
+    name_to_index.insert( name_hash, name_index );
+
+    return name_index;
+}
+
+void GpuProfilerCapture::record_frame( const GPUTimeQuery* timestamps, u32 num_timestamps, const GpuPipelineStatistics* pipeline_statistics ) {
+    record_frame( timestamps, num_timestamps, pipeline_statistics, time_from_milliseconds( start_time ) );
+}
+
+void GpuProfilerCapture::record_frame( const GPUTimeQuery* timestamps, u32 num_timestamps, const GpuPipelineStatistics* pipeline_statistics, f64 cpu_time_ms ) {
+    if ( !recording || max_frames == 0 ) {
+        return;
+    }
+
+    GpuCapturedFrame& frame = frames[ next_frame ];
+    GpuCapturedQuery* frame_queries = &queries[ next_frame * max_queries_per_frame ];
+
+    frame.frame_number = recorded_frames++;
+    frame.cpu_time_ms = cpu_time_ms;
+    frame.gpu_frame_ms = 0.f;
+    frame.query_count = 0;
+
+    for ( u32 s = 0; s < k_gpu_capture_pipeline_statistics; ++s ) {
+        frame.pipeline_statistics[ s ] = pipeline_statistics ? pipeline_statistics->statistics[ s ] : 0;
+    }
+
+    // Queries are in push order, the trees of the different threads one after the other, each starting with a root.
+    // Where the next child of each depth starts:
+    f32 depth_cursors_ms[ k_gpu_capture_max_depth + 1 ];
+    u16 track = u16_max;
+
+    for ( u32 i = 0; i < num_timestamps; ++i ) {
+        const GPUTimeQuery& timestamp = timestamps[ i ];
+
+        if ( frame.query_count == max_queries_per_frame || timestamp.depth >= k_gpu_capture_max_depth ) {
+            ++dropped_queries;
+            continue;
+        }
+
+        if ( timestamp.depth == 0 ) {
+            ++track;
+            depth_cursors_ms[ 0 ] = 0.f;
+            frame.gpu_frame_ms += ( f32 )timestamp.elapsed_ms;
+        } else if ( track == u16_max ) {
+            // Children without a root.
+            ++dropped_queries;
+            continue;
+        }
+
+        GpuCapturedQuery& query = frame_queries[ frame.query_count++ ];
+        query.start_ms = depth_cursors_ms[ timestamp.depth ];
+        query.elapsed_ms = ( f32 )timestamp.elapsed_ms;
+        query.name_index = get_name_index( timestamp.name );
+        query.depth = timestamp.depth;
+        query.track = track;
+        query.pad = 0;
+
+        depth_cursors_ms[ timestamp.depth ] = query.start_ms + query.elapsed_ms;
+        depth_cursors_ms[ timestamp.depth + 1 ] = query.start_ms;
+    }
+
+    next_frame = ( next_frame + 1 ) % max_frames;
+    frame_count = raptor::min( frame_count + 1, max_frames );
+}
+
+const GpuCapturedFrame& GpuProfilerCapture::get_frame( u32 index ) const {
+    RASSERT( index < frame_count );
+    return frames[ ( next_frame + max_frames - frame_count + index ) % max_frames ];
+}
+
+const GpuCapturedQuery* GpuProfilerCapture::get_queries( u32 index ) const {
+    RASSERT( index < frame_count );
+    return &queries[ ( ( next_frame + max_frames - frame_count + index ) % max_frames ) * max_queries_per_frame ];
+}
+
+void GpuProfilerCapture::compute_pass_statistics( Array<GpuPassStatistics>& out_statistics ) const {
+    out_statistics.clear();
+    if ( frame_count == 0 ) {
+        return;
+    }
+
+    // Per frame time of each name, then samples of each name in a segment of frame_count.
+    const u32 num_names = names.size;
+
+    Array<f32> frame_ms;
+    frame_ms.init( allocator, num_names, num_names );
+    Array<u32> last_frame;
+    last_frame.init( allocator, num_names, num_names );
+    memset( last_frame.data, 0xff, last_frame.size_in_bytes() );
+    Array<u16> frame_names;
+    frame_names.init( allocator, num_names );
+
+    Array<f32> samples;
+    samples.init( allocator, num_names * frame_count, num_names * frame_count );
+    Array<u32> sample_counts;
+    sample_counts.init( allocator, num_names, num_names );
+    memset( sample_counts.data, 0, sample_counts.size_in_bytes() );
+
+    for ( u32 f = 0; f < frame_count; ++f ) {
+        const GpuCapturedFrame& frame = get_frame( f );
+        const GpuCapturedQuery* frame_queries = get_queries( f );
+
+        frame_names.clear();
+        for ( u32 q = 0; q < frame.query_count; ++q ) {
+            const GpuCapturedQuery& query = frame_queries[ q ];
+            if ( last_frame[ query.name_index ] != f ) {
+                last_frame[ query.name_index ] = f;
+                frame_ms[ query.name_index ] = 0.f;
+                frame_names.push( query.name_index );
+            }
+            frame_ms[ query.name_index ] += query.elapsed_ms;
+        }
+
+        for ( u32 n = 0; n < frame_names.size; ++n ) {
+            const u16 name_index = frame_names[ n ];
+            samples[ name_index * frame_count + sample_counts[ name_index ]++ ] = frame_ms[ name_index ];
+        }
+    }
+
+    for ( u32 n = 0; n < num_names; ++n ) {
+        const u32 count = sample_counts[ n ];
+        if ( count == 0 ) {
+            continue;
+        }
+
+        f32* name_samples = &samples[ n * frame_count ];
+        qsort( name_samples, count, sizeof( f32 ), sorting_ms_fn );
+
+        f64 sum = 0.0;
+        for ( u32 s = 0; s < count; ++s ) {
+            sum += name_samples[ s ];
+        }
+
+        GpuPassStatistics pass_statistics;
+        pass_statistics.name_hash = hash_calculate( names[ n ] );
+        pass_statistics.name = names[ n ];
+        pass_statistics.samples = count;
+        pass_statistics.min_ms = name_samples[ 0 ];
+        pass_statistics.average_ms = ( f32 )( sum / count );
+        pass_statistics.p95_ms = percentile( name_samples, count, 0.95f );
+        pass_statistics.p99_ms = percentile( name_samples, count, 0.99f );
+        pass_statistics.max_ms = name_samples[ count - 1 ];
+
+        out_statistics.push( pass_statistics );
+    }
+
+    sample_counts.shutdown();
+    samples.shutdown();
+    frame_names.shutdown();
+    last_frame.shutdown();
+    frame_ms.shutdown();
+}
+
+void GpuProfilerCapture::compute_pipeline_statistics( GpuPipelineStatisticsSummary& out_summary ) const {
+    out_summary.frames = frame_count;
+
+    for ( u32 s = 0; s < k_gpu_capture_pipeline_statistics; ++s ) {
+        u64 min_value = u64_max;
+        u64 max_value = 0;
+        f64 sum = 0.0;
+
+        for ( u32 f = 0; f < frame_count; ++f ) {
+            const u64 value = get_frame( f ).pipeline_statistics[ s ];
+            min_value = raptor::min( min_value, value );
+            max_value = raptor::max( max_value, value );
+            sum += ( f64 )value;
+        }
+
+        out_summary.min[ s ] = frame_count ? min_value : 0;
+        out_summary.max[ s ] = max_value;
+        out_summary.average[ s ] = frame_count ? sum / frame_count : 0.0;
+    }
+}
+
+bool GpuProfilerCapture::write_chrome_trace( cstring path ) const {
+    FILE* file = fopen( path, "w" );
+    if ( !file ) {
+        rprint( "Cannot write GPU capture %s\n", path );
+        return false;
+    }
+
+    write_chrome_trace( file );
+
+    fclose( file );
+    return true;
+}
+
+// Trace event format: complete events for the queries, one thread per track, counters for the pipeline statistics.
+// Times are in microseconds.
+void GpuProfilerCapture::write_chrome_trace( FILE* file ) const {
+    fprintf( file, "{\n\t\"displayTimeUnit\": \"ms\",\n\t\"traceEvents\": [" );
+
+    u32 events = 0;
+    for ( u32 f = 0; f < frame_count; ++f ) {
+        const GpuCapturedFrame& frame = get_frame( f );
+        const GpuCapturedQuery* frame_queries = get_queries( f );
+        const f64 frame_start_us = frame.cpu_time_ms * 1000.0;
+
+        for ( u32 q = 0; q < frame.query_count; ++q ) {
+            const GpuCapturedQuery& query = frame_queries[ q ];
+
+            fprintf( file, "%s\n\t\t{ \"name\": ", events++ ? "," : "" );
+            write_json_string( file, names[ query.name_index ] );
+            fprintf( file, ", \"cat\": \"gpu\", \"ph\": \"X\", \"pid\": 0, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f, \"args\": { \"frame\": %llu, \"depth\": %u } }",
+                     query.track, frame_start_us + query.start_ms * 1000.0, query.elapsed_ms * 1000.0, frame.frame_number, query.depth );
+        }
+
+        fprintf( file, "%s\n\t\t{ \"name\": \"pipeline statistics\", \"ph\": \"C\", \"pid\": 0, \"ts\": %.3f, \"args\": { ", events++ ? "," : "", frame_start_us );
+        for ( u32 s = 0; s < k_gpu_capture_pipeline_statistics; ++s ) {
+            fprintf( file, "%s\"%s\": %llu", s ? ", " : "", s_pipeline_statistics_names[ s ], frame.pipeline_statistics[ s ] );
+        }
+        fprintf( file, " } }" );
+    }
+
+    fprintf( file, "\n\t]\n}\n" );
+}
+
+bool GpuProfilerCapture::write_csv( cstring path ) const {
+    FILE* file = fopen( path, "w" );
+    if ( !file ) {
+        rprint( "Cannot write GPU capture %s\n", path );
+        return false;
+    }
+
+    write_csv( file );
+
+    fclose( file );
+    return true;
+}
+
+void GpuProfilerCapture::write_csv( FILE* file ) const {
+    fprintf( file, "frame,cpu_time_ms,track,depth,name,start_ms,elapsed_ms\n" );
+
+    for ( u32 f = 0; f < frame_count; ++f ) {
+        const GpuCapturedFrame& frame = get_frame( f );
+        const GpuCapturedQuery* frame_queries = get_queries( f );
+
+        for ( u32 q = 0; q < frame.query_count; ++q ) {
+            const GpuCapturedQuery& query = frame_queries[ q ];
+
+            fprintf( file, "%llu,%.4f,%u,%u,", frame.frame_number, frame.cpu_time_ms, query.track, query.depth );
+            write_csv_string( file, names[ query.name_index ] );
+            fprintf( file, ",%.4f,%.4f\n", query.start_ms, query.elapsed_ms );
+        }
+    }
+}
+
+bool GpuProfilerCapture::write_frames_csv( cstring path ) const {
+    FILE* file = fopen( path, "w" );
+    if ( !file ) {
+        rprint( "Cannot write GPU capture %s\n", path );
+        return false;
+    }
+
+    write_frames_csv( file );
+
+    fclose( file );
+    return true;
+}
+
+void GpuProfilerCapture::write_frames_csv( FILE* file ) const {
+    fprintf( file, "frame,cpu_time_ms,gpu_frame_ms,queries" );
+    for ( u32 s = 0; s < k_gpu_capture_pipeline_statistics; ++s ) {
+        fprintf( file, ",%s", s_pipeline_statistics_names[ s ] );
+    }
+    fprintf( file, "\n" );
+
+    for ( u32 f = 0; f < frame_count; ++f ) {
+        const GpuCapturedFrame& frame = get_frame( f );
+
+        fprintf( file, "%llu,%.4f,%.4f,%u", frame.frame_number, frame.cpu_time_ms, frame.gpu_frame_ms, frame.query_count );
+        for ( u32 s = 0; s < k_gpu_capture_pipeline_statistics; ++s ) {
+            fprintf( file, ",%llu", frame.pipeline_statistics[ s ] );
+        }
+        fprintf( file, "\n" );
+    }
+}
+
+// Statistics comparison //////////////////////////////////////////////////
+u32 gpu_profiler_compare_statistics( const Array<GpuPassStatistics>& baseline, const Array<GpuPassStatistics>& current,
+                                     f32 threshold, f32 min_delta_ms, Array<GpuPassRegression>& out_regressions ) {
+    out_regressions.clear();
+
+    u32 regressed_passes = 0;
+    for ( u32 c = 0; c < current.size; ++c ) {
+        const GpuPassStatistics& current_pass = current[ c ];
+
+        GpuPassRegression regression{ };
+        regression.name = current_pass.name;
+        regression.current_average_ms = current_pass.average_ms;
+        regression.current_p95_ms = current_pass.p95_ms;
+        regression.added = true;
+
+        for ( u32 b = 0; b < baseline.size; ++b ) {
+            const GpuPassStatistics& baseline_pass = baseline[ b ];
+            if ( baseline_pass.name_hash != current_pass.name_hash ) {
+                continue;
+            }
+
+            regression.baseline_average_ms = baseline_pass.average_ms;
+            regression.baseline_p95_ms = baseline_pass.p95_ms;
+            regression.added = false;
+
+            const f32 delta_ms = current_pass.p95_ms - baseline_pass.p95_ms;
+            regression.regressed = current_pass.p95_ms > baseline_pass.p95_ms * ( 1.f + threshold ) && delta_ms >= min_delta_ms;
+            break;
+        }
+
+        regressed_passes += regression.regressed ? 1 : 0;
+        out_regressions.push( regression );
+    }
+
+    for ( u32 b = 0; b < baseline.size; ++b ) {
+        const GpuPassStatistics& baseline_pass = baseline[ b ];
+
+        bool found = false;
+        for ( u32 c = 0; c < current.size && !found; ++c ) {
+            found = current[ c ].name_hash == baseline_pass.name_hash;
+        }
+
+        if ( !found ) {
+            GpuPassRegression regression{ };
+            regression.name = baseline_pass.name;
+            regression.baseline_average_ms = baseline_pass.average_ms;
+            regression.baseline_p95_ms = baseline_pass.p95_ms;
+            regression.removed = true;
+
+            out_regressions.push( regression );
+        }
+    }
+
+    return regressed_passes;
+}
+
+bool gpu_profiler_write_statistics_csv( cstring path, const Array<GpuPassStatistics>& statistics ) {
+    FILE* file = fopen( path, "w" );
+    if ( !file ) {
+        rprint( "Cannot write GPU pass statistics %s\n", path );
+        return false;
+    }
+
+    gpu_profiler_write_statistics_csv( file, statistics );
+
+    fclose( file );
+    return true;
+}
+
+void gpu_profiler_write_statistics_csv( FILE* file, const Array<GpuPassStatistics>& statistics ) {
+    fprintf( file, "name,samples,min_ms,average_ms,p95_ms,p99_ms,max_ms\n" );
+
+    for ( u32 i = 0; i < statistics.size; ++i ) {
+        const GpuPassStatistics& pass_statistics = statistics[ i ];
+
+        write_csv_string( file, pass_statistics.name );
+        fprintf( file, ",%u,%.4f,%.4f,%.4f,%.4f,%.4f\n", pass_statistics.samples, pass_statistics.min_ms, pass_statistics.average_ms,
+                 pass_statistics.p95_ms, pass_statistics.p99_ms, pass_statistics.max_ms );
+    }
+}
+
+} // namespace raptor
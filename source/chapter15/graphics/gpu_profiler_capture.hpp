@@ -0,0 +1,157 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/hash_map.hpp"
+#include "foundation/platform.hpp"
+#include "foundation/string.hpp"
+
+#include <stdio.h>
+
+namespace raptor {
+
+struct Allocator;
+struct GPUTimeQuery;
+struct GpuPipelineStatistics;
+
+static const u32                    k_gpu_capture_pipeline_statistics = 7;     // GpuPipelineStatistics::Count
+static const u32                    k_gpu_capture_max_depth     = 16;
+
+//
+// Query of a recorded frame. GPUTimeQuery has only durations: children are laid out one after the other from
+// the start of their parent, so gaps between siblings are not visible in the exported timeline.
+struct GpuCapturedQuery {
+
+    f32                             start_ms;       // From the start of the frame.
+    f32                             elapsed_ms;
+
+    u16                             name_index;
+    u16                             depth;
+    u16                             track;          // Index of the root query, one per command buffer tree.
+    u16                             pad;
+
+}; // struct GpuCapturedQuery
+
+//
+//
+struct GpuCapturedFrame {
+
+    u64                             frame_number;
+    f64                             cpu_time_ms;    // When the frame was recorded, from the start of the capture.
+    f32                             gpu_frame_ms;   // Sum of the root queries.
+
+    u32                             query_count;
+
+    u64                             pipeline_statistics[ k_gpu_capture_pipeline_statistics ];
+
+}; // struct GpuCapturedFrame
+
+//
+// Time of a pass in the frames of a capture, summed when the pass runs more than once in a frame.
+struct GpuPassStatistics {
+
+    u64                             name_hash;
+    cstring                         name;
+
+    u32                             samples;        // Frames containing the pass.
+
+    f32                             min_ms;
+    f32                             average_ms;
+    f32                             p95_ms;
+    f32                             p99_ms;
+    f32                             max_ms;
+
+}; // struct GpuPassStatistics
+
+//
+//
+struct GpuPipelineStatisticsSummary {
+
+    u64                             min[ k_gpu_capture_pipeline_statistics ];
+    u64                             max[ k_gpu_capture_pipeline_statistics ];
+    f64                             average[ k_gpu_capture_pipeline_statistics ];
+
+    u32                             frames;
+
+}; // struct GpuPipelineStatisticsSummary
+
+//
+//
+struct GpuPassRegression {
+
+    cstring                         name;
+
+    f32                             baseline_average_ms;
+    f32                             current_average_ms;
+    f32                             baseline_p95_ms;
+    f32                             current_p95_ms;
+
+    bool                            regressed;
+    bool                            added;          // Not present in the baseline.
+    bool                            removed;        // Present only in the baseline.
+
+}; // struct GpuPassRegression
+
+//
+// Records the GPU query trees and pipeline statistics of the last max_frames frames, for export as Chrome trace
+// events (chrome://tracing or Perfetto) and CSV, and for per pass statistics that can be compared between captures.
+// Query names are copied, the frame graph can be reloaded during a capture, and kept until shutdown.
+struct GpuProfilerCapture {
+
+    void                            init( Allocator* allocator, u32 max_frames, u32 max_queries_per_frame );
+    void                            shutdown();
+
+    void                            reset();
+
+    void                            record_frame( const GPUTimeQuery* timestamps, u32 num_timestamps, const GpuPipelineStatistics* pipeline_statistics );
+    void                            record_frame( const GPUTimeQuery* timestamps, u32 num_timestamps, const GpuPipelineStatistics* pipeline_statistics, f64 cpu_time_ms );
+
+    // Recorded frames, from the oldest.
+    const GpuCapturedFrame&         get_frame( u32 index ) const;
+    const GpuCapturedQuery*         get_queries( u32 index ) const;
+    cstring                         get_name( u16 name_index ) const    { return names[ name_index ]; }
+
+    void                            compute_pass_statistics( Array<GpuPassStatistics>& out_statistics ) const;
+    void                            compute_pipeline_statistics( GpuPipelineStatisticsSummary& out_summary ) const;
+
+    bool                            write_chrome_trace( cstring path ) const;
+    void                            write_chrome_trace( FILE* file ) const;
+    // One row per query.
+    bool                            write_csv( cstring path ) const;
+    void                            write_csv( FILE* file ) const;
+    // One row per frame, with the pipeline statistics.
+    bool                            write_frames_csv( cstring path ) const;
+    void                            write_frames_csv( FILE* file ) const;
+
+    u16                             get_name_index( cstring name );
+
+    Array<GpuCapturedFrame>         frames;
+    Array<GpuCapturedQuery>         queries;        // max_queries_per_frame per frame.
+
+    FlatHashMap<u64, u32>           name_to_index;
+    Array<cstring>                  names;
+    StringBuffer                    names_buffer;
+
+    Allocator*                      allocator               = nullptr;
+
+    i64                             start_time              = 0;
+    u64                             recorded_frames         = 0;
+
+    u32                             max_frames              = 0;
+    u32                             max_queries_per_frame   = 0;
+    u32                             frame_count             = 0;    // Valid frames, up to max_frames.
+    u32                             next_frame              = 0;
+    u32                             dropped_queries         = 0;    // Queries over max_queries_per_frame or k_gpu_capture_max_depth.
+
+    bool                            recording               = false;
+
+}; // struct GpuProfilerCapture
+
+// Passes whose p95 grew more than threshold (relative) and min_delta_ms, plus the ones added or removed.
+// Returns the number of regressed passes.
+u32                                 gpu_profiler_compare_statistics( const Array<GpuPassStatistics>& baseline, const Array<GpuPassStatistics>& current,
+                                                                     f32 threshold, f32 min_delta_ms, Array<GpuPassRegression>& out_regressions );
+
+bool                                gpu_profiler_write_statistics_csv( cstring path, const Array<GpuPassStatistics>& statistics );
+void                                gpu_profiler_write_statistics_csv( FILE* file, const Array<GpuPassStatistics>& statistics );
+
+} // namespace raptor
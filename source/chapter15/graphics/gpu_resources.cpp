@@ -253,6 +253,7 @@ SamplerCreation& SamplerCreation::set_name( const char* name_ ) {
 // ShaderStateCreation ////////////////////////////////////////////////////
 ShaderStateCreation& ShaderStateCreation::reset() {
     stages_count = 0;
+    specializations_count = 0;
 
     return *this;
 }
@@ -282,6 +283,16 @@ ShaderStateCreation& ShaderStateCreation::add_stage( const char* code, sizet cod
     return *this;
 }
 
+ShaderStateCreation& ShaderStateCreation::add_specialization( cstring name_, u32 value ) {
+    RASSERT( specializations_count < k_max_shader_specializations );
+
+    specializations[ specializations_count ].name = name_;
+    specializations[ specializations_count ].value = value;
+    ++specializations_count;
+
+    return *this;
+}
+
 ShaderStateCreation& ShaderStateCreation::set_spv_input( bool value ) {
     spv_input = value;
     return *this;
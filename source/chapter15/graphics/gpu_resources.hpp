@@ -84,6 +84,7 @@ static const u8                     k_max_shader_stages = 5;                // M
 static const u8                     k_max_descriptors_per_set = 32;         // Maximum list elements for both descriptor set layout and descriptor sets.
 static const u8                     k_max_vertex_streams = 16;
 static const u8                     k_max_vertex_attributes = 16;
+static const u8                     k_max_shader_specializations = 4;       // Specialization constant values set by a shader state creation.
 
 static const u32                    k_submit_header_sentinel = 0xfefeb7ba;
 static const u32                    k_max_resource_deletions = 64;
@@ -326,21 +327,33 @@ struct ShaderStage {
 
 }; // struct ShaderStage
 
+//
+// Value of a specialization constant, matched by name with the constants found in the Spir-V.
+struct ShaderSpecialization {
+
+    cstring                         name            = nullptr;
+    u32                             value           = 0;
+
+}; // struct ShaderSpecialization
+
 //
 //
 struct ShaderStateCreation {
 
     ShaderStage                     stages[ k_max_shader_stages ];
+    ShaderSpecialization            specializations[ k_max_shader_specializations ];
 
     cstring                         name            = nullptr;
 
     u32                             stages_count    = 0;
+    u32                             specializations_count = 0;
     u32                             spv_input       = 0;
 
     // Building helpers
     ShaderStateCreation&            reset();
     ShaderStateCreation&            set_name( const char* name );
     ShaderStateCreation&            add_stage( const char* code, sizet code_size, VkShaderStageFlagBits type );
+    ShaderStateCreation&            add_specialization( cstring name, u32 value );
     ShaderStateCreation&            set_spv_input( bool value );
 
 }; // struct ShaderStateCreation
@@ -763,13 +776,11 @@ struct ExecutionBarrier {
 
 //
 //
-struct ResourceUpdate {
+struct BindlessTextureUpdate {
 
-    ResourceUpdateType::Enum        type;
     ResourceHandle                  handle;
-    u32                             current_frame;
     u32                             deleting;
-}; // struct ResourceUpdate
+}; // struct BindlessTextureUpdate
 
 // Resources /////////////////////////////////////////////////////////////
 
@@ -899,6 +910,10 @@ struct DescriptorSet {
 
     const DescriptorSetLayout*      layout          = nullptr;
     u32                             num_resources   = 0;
+
+    u64                             cache_hash      = 0;        // Hash of the content, used to share identical sets.
+    u64                             views_hash      = 0;        // Hash of the image views and buffers written, checked on cache hits.
+    u32                             references      = 0;
 }; // struct DesciptorSet
 
 
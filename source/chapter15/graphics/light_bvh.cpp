@@ -0,0 +1,562 @@
+#include "graphics/light_bvh.hpp"
+
+#include "foundation/assert.hpp"
+#include "foundation/bit.hpp"
+#include "foundation/memory.hpp"
+
+#include "external/cglm/struct/vec3.h"
+#include "external/cglm/struct/vec4.h"
+
+#include <math.h>
+#include <new>
+
+namespace raptor {
+
+static const u32                    k_light_bvh_invalid         = 0xffffffff;
+static const u32                    k_light_bvh_min_range       = 1024;
+
+enum LightBVHStage {
+    LightBVHStage_MortonCodes = 0,
+    LightBVHStage_Hierarchy,
+    LightBVHStage_Refit,
+}; // enum LightBVHStage
+
+// Spreads the 10 low bits so that there are two zero bits between each.
+static u32 light_bvh_expand_bits( u32 v ) {
+    v = ( v * 0x00010001u ) & 0xFF0000FFu;
+    v = ( v * 0x00000101u ) & 0x0F00F00Fu;
+    v = ( v * 0x00000011u ) & 0xC30C30C3u;
+    v = ( v * 0x00000005u ) & 0x49249249u;
+    return v;
+}
+
+static u32 light_bvh_quantize( f32 value ) {
+    const f32 max_value = ( f32 )( ( 1 << k_light_bvh_morton_bits ) - 1 );
+    value = value < 0.f ? 0.f : ( value > max_value ? max_value : value );
+    return ( u32 )value;
+}
+
+static u32 leading_zeroes_u64( u64 value ) {
+    const u32 high = ( u32 )( value >> 32 );
+    const u32 low = ( u32 )value;
+    if ( high ) {
+        return leading_zeroes_u32( high );
+    }
+    return low ? 32 + leading_zeroes_u32( low ) : 64;
+}
+
+// Length of the common prefix of two sorted keys, -1 outside of the keys. Keys contain the light index, they are unique.
+static i32 light_bvh_delta( const u64* keys, u32 count, i32 i, i32 j ) {
+    if ( j < 0 || j >= ( i32 )count ) {
+        return -1;
+    }
+    return ( i32 )leading_zeroes_u64( keys[ i ] ^ keys[ j ] );
+}
+
+static vec3s sphere_min( vec4s sphere ) {
+    return { sphere.x - sphere.w, sphere.y - sphere.w, sphere.z - sphere.w };
+}
+
+static vec3s sphere_max( vec4s sphere ) {
+    return { sphere.x + sphere.w, sphere.y + sphere.w, sphere.z + sphere.w };
+}
+
+static bool sphere_inside_planes( vec4s sphere, const vec4s* planes, u32 num_planes ) {
+    for ( u32 p = 0; p < num_planes; ++p ) {
+        if ( planes[ p ].x * sphere.x + planes[ p ].y * sphere.y + planes[ p ].z * sphere.z + planes[ p ].w < -sphere.w ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns 0 when outside, 1 when intersecting and 2 when entirely inside the planes.
+static u32 aabb_planes_test( const vec3s& aabb_min, const vec3s& aabb_max, const vec4s* planes, u32 num_planes ) {
+    u32 result = 2;
+    for ( u32 p = 0; p < num_planes; ++p ) {
+        const vec4s& plane = planes[ p ];
+        // Farthest corner along the normal, then the nearest one.
+        const f32 far_distance = plane.x * ( plane.x > 0.f ? aabb_max.x : aabb_min.x ) +
+                                 plane.y * ( plane.y > 0.f ? aabb_max.y : aabb_min.y ) +
+                                 plane.z * ( plane.z > 0.f ? aabb_max.z : aabb_min.z ) + plane.w;
+        if ( far_distance < 0.f ) {
+            return 0;
+        }
+
+        const f32 near_distance = plane.x * ( plane.x > 0.f ? aabb_min.x : aabb_max.x ) +
+                                  plane.y * ( plane.y > 0.f ? aabb_min.y : aabb_max.y ) +
+                                  plane.z * ( plane.z > 0.f ? aabb_min.z : aabb_max.z ) + plane.w;
+        if ( near_distance < 0.f ) {
+            result = 1;
+        }
+    }
+    return result;
+}
+
+static f32 aabb_sphere_distance2( const vec3s& aabb_min, const vec3s& aabb_max, vec4s sphere ) {
+    const f32 dx = sphere.x < aabb_min.x ? aabb_min.x - sphere.x : ( sphere.x > aabb_max.x ? sphere.x - aabb_max.x : 0.f );
+    const f32 dy = sphere.y < aabb_min.y ? aabb_min.y - sphere.y : ( sphere.y > aabb_max.y ? sphere.y - aabb_max.y : 0.f );
+    const f32 dz = sphere.z < aabb_min.z ? aabb_min.z - sphere.z : ( sphere.z > aabb_max.z ? sphere.z - aabb_max.z : 0.f );
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// LightBVHTask ///////////////////////////////////////////////////////////
+
+void LightBVHTask::ExecuteRange( enki::TaskSetPartition range, uint32_t ) {
+    LightBVH& b = *bvh;
+    const u32 count = b.light_count;
+
+    switch ( stage ) {
+        case LightBVHStage_MortonCodes:
+        {
+            for ( u32 i = range.start; i < range.end; ++i ) {
+                const vec4s& s = light_spheres[ i ];
+                const u32 x = light_bvh_quantize( ( s.x - b.centers_min.x ) * b.centers_scale.x );
+                const u32 y = light_bvh_quantize( ( s.y - b.centers_min.y ) * b.centers_scale.y );
+                const u32 z = light_bvh_quantize( ( s.z - b.centers_min.z ) * b.centers_scale.z );
+
+                const u64 morton = ( light_bvh_expand_bits( x ) << 2 ) | ( light_bvh_expand_bits( y ) << 1 ) | light_bvh_expand_bits( z );
+                b.sorter.keys[ i ] = ( morton << 32 ) | i;
+            }
+            break;
+        }
+
+        case LightBVHStage_Hierarchy:
+        {
+            // Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees".
+            const u64* keys = b.sorter.keys.data;
+
+            for ( u32 n = range.start; n < range.end; ++n ) {
+                const i32 i = ( i32 )n;
+
+                // Direction of the range of the node, then its other end.
+                const i32 direction = light_bvh_delta( keys, count, i, i + 1 ) > light_bvh_delta( keys, count, i, i - 1 ) ? 1 : -1;
+                const i32 delta_min = light_bvh_delta( keys, count, i, i - direction );
+
+                i32 length_max = 2;
+                while ( light_bvh_delta( keys, count, i, i + length_max * direction ) > delta_min ) {
+                    length_max *= 2;
+                }
+
+                i32 length = 0;
+                for ( i32 t = length_max / 2; t >= 1; t /= 2 ) {
+                    if ( light_bvh_delta( keys, count, i, i + ( length + t ) * direction ) > delta_min ) {
+                        length += t;
+                    }
+                }
+                const i32 j = i + length * direction;
+
+                // Split where the common prefix of the range changes.
+                const i32 delta_node = light_bvh_delta( keys, count, i, j );
+                i32 split = 0;
+                for ( i32 divisor = 2; ; divisor *= 2 ) {
+                    const i32 t = ( length + divisor - 1 ) / divisor;
+                    if ( light_bvh_delta( keys, count, i, i + ( split + t ) * direction ) > delta_node ) {
+                        split += t;
+                    }
+                    if ( t <= 1 ) {
+                        break;
+                    }
+                }
+                const i32 gamma = i + split * direction + ( direction < 0 ? -1 : 0 );
+
+                const u32 first = ( u32 )( i < j ? i : j );
+                const u32 last = ( u32 )( i < j ? j : i );
+
+                LightBVHNode& node = b.nodes[ n ];
+                node.first_leaf = first;
+                node.last_leaf = last;
+
+                if ( first == ( u32 )gamma ) {
+                    node.left = gamma | k_light_bvh_leaf_flag;
+                    b.leaf_parents[ gamma ] = n;
+                } else {
+                    node.left = gamma;
+                    b.nodes[ gamma ].parent = n;
+                }
+
+                if ( last == ( u32 )gamma + 1 ) {
+                    node.right = ( gamma + 1 ) | k_light_bvh_leaf_flag;
+                    b.leaf_parents[ gamma + 1 ] = n;
+                } else {
+                    node.right = gamma + 1;
+                    b.nodes[ gamma + 1 ].parent = n;
+                }
+            }
+            break;
+        }
+
+        case LightBVHStage_Refit:
+        {
+            const u32* leaf_lights = b.sorter.values.data;
+
+            for ( u32 leaf = range.start; leaf < range.end; ++leaf ) {
+                b.leaf_spheres[ leaf ] = light_spheres[ leaf_lights[ leaf ] ];
+
+                // The second child to arrive computes the bounds of the parent, when both are done.
+                u32 n = b.leaf_parents[ leaf ];
+                while ( n != k_light_bvh_invalid ) {
+                    if ( b.refit_visits[ n ].fetch_add( 1, std::memory_order_acq_rel ) == 0 ) {
+                        break;
+                    }
+
+                    LightBVHNode& node = b.nodes[ n ];
+                    vec3s child_min[ 2 ], child_max[ 2 ];
+                    const u32 children[ 2 ] = { node.left, node.right };
+                    for ( u32 c = 0; c < 2; ++c ) {
+                        if ( children[ c ] & k_light_bvh_leaf_flag ) {
+                            const vec4s& sphere = b.leaf_spheres[ children[ c ] & ~k_light_bvh_leaf_flag ];
+                            child_min[ c ] = sphere_min( sphere );
+                            child_max[ c ] = sphere_max( sphere );
+                        } else {
+                            child_min[ c ] = b.nodes[ children[ c ] ].aabb_min;
+                            child_max[ c ] = b.nodes[ children[ c ] ].aabb_max;
+                        }
+                    }
+
+                    node.aabb_min = glms_vec3_minv( child_min[ 0 ], child_min[ 1 ] );
+                    node.aabb_max = glms_vec3_maxv( child_max[ 0 ], child_max[ 1 ] );
+
+                    n = node.parent;
+                }
+            }
+            break;
+        }
+    }
+}
+
+// LightBVH ///////////////////////////////////////////////////////////////
+
+void LightBVH::init( Allocator* allocator_, u32 initial_capacity ) {
+    allocator = allocator_;
+
+    nodes.init( allocator, initial_capacity );
+    leaf_spheres.init( allocator, initial_capacity );
+    leaf_parents.init( allocator, initial_capacity );
+    light_leaves.init( allocator, initial_capacity );
+    sorter.init( allocator, initial_capacity );
+
+    refit_visits = nullptr;
+    refit_capacity = 0;
+    light_count = 0;
+    refits_since_build = 0;
+}
+
+void LightBVH::shutdown() {
+    nodes.shutdown();
+    leaf_spheres.shutdown();
+    leaf_parents.shutdown();
+    light_leaves.shutdown();
+    sorter.shutdown();
+
+    if ( refit_visits ) {
+        rfree( refit_visits, allocator );
+        refit_visits = nullptr;
+    }
+    refit_capacity = 0;
+}
+
+void LightBVH::run_stage( u32 stage, u32 count, const vec4s* light_spheres ) {
+    LightBVHTask task;
+    task.m_SetSize = count;
+    task.m_MinRange = k_light_bvh_min_range;
+    task.bvh = this;
+    task.light_spheres = light_spheres;
+    task.stage = stage;
+
+    if ( task_scheduler && count >= min_parallel_count ) {
+        task_scheduler->AddTaskSetToPipe( &task );
+        task_scheduler->WaitforTask( &task );
+    } else {
+        task.ExecuteRange( { 0, count }, 0 );
+    }
+}
+
+void LightBVH::build( const vec4s* light_spheres, u32 count, enki::TaskScheduler* task_scheduler_ ) {
+    task_scheduler = task_scheduler_;
+    light_count = count;
+
+    const u32 num_nodes = count > 1 ? count - 1 : 0;
+    nodes.set_size( num_nodes );
+    leaf_spheres.set_size( count );
+    leaf_parents.set_size( count );
+    light_leaves.set_size( count );
+
+    if ( count == 0 ) {
+        sorter.begin( 0 );
+        refits_since_build = 0;
+        return;
+    }
+
+    // Codes are quantized inside the bounds of the centers.
+    vec3s max_center = glms_vec3( light_spheres[ 0 ] );
+    centers_min = max_center;
+    for ( u32 i = 1; i < count; ++i ) {
+        const vec3s center = glms_vec3( light_spheres[ i ] );
+        centers_min = glms_vec3_minv( centers_min, center );
+        max_center = glms_vec3_maxv( max_center, center );
+    }
+
+    const f32 max_code = ( f32 )( 1 << k_light_bvh_morton_bits );
+    const vec3s extent = glms_vec3_sub( max_center, centers_min );
+    centers_scale.x = extent.x > 0.f ? max_code / extent.x : 0.f;
+    centers_scale.y = extent.y > 0.f ? max_code / extent.y : 0.f;
+    centers_scale.z = extent.z > 0.f ? max_code / extent.z : 0.f;
+
+    sorter.begin( count );
+    run_stage( LightBVHStage_MortonCodes, count, light_spheres );
+    sorter.sort( task_scheduler );
+
+    for ( u32 leaf = 0; leaf < count; ++leaf ) {
+        light_leaves[ sorter.values[ leaf ] ] = leaf;
+    }
+
+    if ( num_nodes ) {
+        nodes[ 0 ].parent = k_light_bvh_invalid;
+        run_stage( LightBVHStage_Hierarchy, num_nodes, light_spheres );
+    } else {
+        leaf_parents[ 0 ] = k_light_bvh_invalid;
+    }
+
+    refit( light_spheres, task_scheduler );
+    refits_since_build = 0;
+}
+
+void LightBVH::refit( const vec4s* light_spheres, enki::TaskScheduler* task_scheduler_ ) {
+    task_scheduler = task_scheduler_;
+
+    const u32 num_nodes = nodes.size;
+    if ( num_nodes > refit_capacity ) {
+        if ( refit_visits ) {
+            rfree( refit_visits, allocator );
+        }
+
+        refit_capacity = num_nodes * 2;
+        refit_visits = ( std::atomic<u32>* )rallocaa( sizeof( std::atomic<u32> ) * refit_capacity, allocator, alignof( std::atomic<u32> ) );
+        for ( u32 i = 0; i < refit_capacity; ++i ) {
+            new ( &refit_visits[ i ] ) std::atomic<u32>( 0 );
+        }
+    }
+
+    for ( u32 i = 0; i < num_nodes; ++i ) {
+        refit_visits[ i ].store( 0, std::memory_order_relaxed );
+    }
+
+    run_stage( LightBVHStage_Refit, light_count, light_spheres );
+    ++refits_since_build;
+}
+
+void LightBVH::update( const vec4s* light_spheres, u32 count, enki::TaskScheduler* task_scheduler_ ) {
+    if ( count != light_count || refits_since_build >= rebuild_interval ) {
+        build( light_spheres, count, task_scheduler_ );
+    } else {
+        refit( light_spheres, task_scheduler_ );
+    }
+}
+
+u32 LightBVH::query_planes( const vec4s* planes, u32 num_planes, Array<u32>& out_lights ) const {
+    if ( light_count == 0 ) {
+        return 0;
+    }
+
+    const u32* leaf_lights = sorter.values.data;
+
+    if ( nodes.size == 0 ) {
+        if ( sphere_inside_planes( leaf_spheres[ 0 ], planes, num_planes ) ) {
+            out_lights.push( leaf_lights[ 0 ] );
+        }
+        return 1;
+    }
+
+    u32 stack[ k_light_bvh_stack_size ];
+    u32 stack_size = 0;
+    stack[ stack_size++ ] = 0;
+
+    u32 visited = 0;
+    while ( stack_size ) {
+        const u32 index = stack[ --stack_size ];
+        ++visited;
+
+        if ( index & k_light_bvh_leaf_flag ) {
+            const u32 leaf = index & ~k_light_bvh_leaf_flag;
+            if ( sphere_inside_planes( leaf_spheres[ leaf ], planes, num_planes ) ) {
+                out_lights.push( leaf_lights[ leaf ] );
+            }
+            continue;
+        }
+
+        const LightBVHNode& node = nodes[ index ];
+        const u32 test = aabb_planes_test( node.aabb_min, node.aabb_max, planes, num_planes );
+        if ( test == 0 ) {
+            continue;
+        }
+
+        if ( test == 2 ) {
+            // Spheres are inside the bounds, all of them are inside the planes.
+            for ( u32 leaf = node.first_leaf; leaf <= node.last_leaf; ++leaf ) {
+                out_lights.push( leaf_lights[ leaf ] );
+            }
+            continue;
+        }
+
+        RASSERT( stack_size + 2 <= k_light_bvh_stack_size );
+        stack[ stack_size++ ] = node.right;
+        stack[ stack_size++ ] = node.left;
+    }
+
+    return visited;
+}
+
+u32 LightBVH::query_sphere( vec4s sphere, Array<u32>& out_lights ) const {
+    if ( light_count == 0 ) {
+        return 0;
+    }
+
+    const u32* leaf_lights = sorter.values.data;
+
+    u32 stack[ k_light_bvh_stack_size ];
+    u32 stack_size = 0;
+    stack[ stack_size++ ] = nodes.size ? 0 : k_light_bvh_leaf_flag;
+
+    u32 visited = 0;
+    while ( stack_size ) {
+        const u32 index = stack[ --stack_size ];
+        ++visited;
+
+        if ( index & k_light_bvh_leaf_flag ) {
+            const u32 leaf = index & ~k_light_bvh_leaf_flag;
+            const vec4s& light_sphere = leaf_spheres[ leaf ];
+            const f32 radius = light_sphere.w + sphere.w;
+            if ( glms_vec3_distance2( glms_vec3( light_sphere ), glms_vec3( sphere ) ) <= radius * radius ) {
+                out_lights.push( leaf_lights[ leaf ] );
+            }
+            continue;
+        }
+
+        const LightBVHNode& node = nodes[ index ];
+        if ( aabb_sphere_distance2( node.aabb_min, node.aabb_max, sphere ) > sphere.w * sphere.w ) {
+            continue;
+        }
+
+        RASSERT( stack_size + 2 <= k_light_bvh_stack_size );
+        stack[ stack_size++ ] = node.right;
+        stack[ stack_size++ ] = node.left;
+    }
+
+    return visited;
+}
+
+// Min heap on the scores, the root is the least important selected light.
+static void light_heap_sift_down( u32* lights, f32* scores, u32 count, u32 index ) {
+    for ( ;; ) {
+        const u32 left = index * 2 + 1;
+        const u32 right = left + 1;
+
+        u32 smallest = index;
+        if ( left < count && scores[ left ] < scores[ smallest ] ) {
+            smallest = left;
+        }
+        if ( right < count && scores[ right ] < scores[ smallest ] ) {
+            smallest = right;
+        }
+        if ( smallest == index ) {
+            return;
+        }
+
+        const u32 light = lights[ index ];
+        lights[ index ] = lights[ smallest ];
+        lights[ smallest ] = light;
+
+        const f32 score = scores[ index ];
+        scores[ index ] = scores[ smallest ];
+        scores[ smallest ] = score;
+
+        index = smallest;
+    }
+}
+
+void LightBVH::select_lights( const vec4s* frustum_planes, vec3s camera_position, const f32* light_intensities,
+                              u32 max_lights, Array<u32>& out_lights, Array<f32>& out_scores ) const {
+    out_lights.clear();
+    out_scores.clear();
+
+    // Visible lights are gathered in the output, then the most important are moved to its start.
+    query_planes( frustum_planes, 6, out_lights );
+
+    const u32 visible_lights = out_lights.size;
+    out_scores.set_size( visible_lights );
+
+    u32* lights = out_lights.data;
+    f32* scores = out_scores.data;
+
+    u32 heap_size = 0;
+    for ( u32 i = 0; i < visible_lights; ++i ) {
+        const u32 light = lights[ i ];
+        const vec4s& sphere = leaf_spheres[ light_leaves[ light ] ];
+
+        // Solid angle of the sphere over the one of the whole sphere of directions, 1 when the camera is inside.
+        const f32 distance2 = glms_vec3_distance2( glms_vec3( sphere ), camera_position );
+        const f32 radius2 = sphere.w * sphere.w;
+        const f32 coverage = distance2 > radius2 ? 0.5f * ( 1.f - sqrtf( 1.f - radius2 / distance2 ) ) : 1.f;
+        const f32 score = coverage * light_intensities[ light ];
+
+        // Lights before i have been read, the heap can overwrite them.
+        if ( heap_size < max_lights ) {
+            u32 child = heap_size++;
+            while ( child > 0 ) {
+                const u32 parent = ( child - 1 ) / 2;
+                if ( scores[ parent ] <= score ) {
+                    break;
+                }
+                lights[ child ] = lights[ parent ];
+                scores[ child ] = scores[ parent ];
+                child = parent;
+            }
+            lights[ child ] = light;
+            scores[ child ] = score;
+        } else if ( heap_size && score > scores[ 0 ] ) {
+            lights[ 0 ] = light;
+            scores[ 0 ] = score;
+            light_heap_sift_down( lights, scores, heap_size, 0 );
+        }
+    }
+
+    // Popping the minimum to the end sorts the selection from the highest score.
+    for ( u32 end = heap_size; end > 1; --end ) {
+        const u32 light = lights[ 0 ];
+        lights[ 0 ] = lights[ end - 1 ];
+        lights[ end - 1 ] = light;
+
+        const f32 score = scores[ 0 ];
+        scores[ 0 ] = scores[ end - 1 ];
+        scores[ end - 1 ] = score;
+
+        light_heap_sift_down( lights, scores, end - 1, 0 );
+    }
+
+    out_lights.set_size( heap_size );
+    out_scores.set_size( heap_size );
+}
+
+// Gribb and Hartmann: planes are sums of the rows of the matrix.
+void light_bvh_frustum_planes( const mat4s& m, vec4s* out_planes ) {
+    const vec4s row0 = { m.raw[ 0 ][ 0 ], m.raw[ 1 ][ 0 ], m.raw[ 2 ][ 0 ], m.raw[ 3 ][ 0 ] };
+    const vec4s row1 = { m.raw[ 0 ][ 1 ], m.raw[ 1 ][ 1 ], m.raw[ 2 ][ 1 ], m.raw[ 3 ][ 1 ] };
+    const vec4s row2 = { m.raw[ 0 ][ 2 ], m.raw[ 1 ][ 2 ], m.raw[ 2 ][ 2 ], m.raw[ 3 ][ 2 ] };
+    const vec4s row3 = { m.raw[ 0 ][ 3 ], m.raw[ 1 ][ 3 ], m.raw[ 2 ][ 3 ], m.raw[ 3 ][ 3 ] };
+
+    out_planes[ 0 ] = glms_vec4_add( row3, row0 );
+    out_planes[ 1 ] = glms_vec4_sub( row3, row0 );
+    out_planes[ 2 ] = glms_vec4_add( row3, row1 );
+    out_planes[ 3 ] = glms_vec4_sub( row3, row1 );
+    // Near plane of a -1..1 depth range, conservative for 0..1 depth.
+    out_planes[ 4 ] = glms_vec4_add( row3, row2 );
+    out_planes[ 5 ] = glms_vec4_sub( row3, row2 );
+
+    for ( u32 p = 0; p < 6; ++p ) {
+        const f32 length = sqrtf( out_planes[ p ].x * out_planes[ p ].x + out_planes[ p ].y * out_planes[ p ].y + out_planes[ p ].z * out_planes[ p ].z );
+        out_planes[ p ] = glms_vec4_scale( out_planes[ p ], length > 0.f ? 1.f / length : 0.f );
+    }
+}
+
+} // namespace raptor
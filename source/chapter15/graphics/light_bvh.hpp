@@ -0,0 +1,103 @@
+#pragma once
+
+#include "graphics/draw_sort.hpp"
+
+#include "foundation/array.hpp"
+#include "foundation/platform.hpp"
+
+#include "external/cglm/types-struct.h"
+#include "external/enkiTS/TaskScheduler.h"
+
+#include <atomic>
+
+namespace raptor {
+
+struct Allocator;
+struct LightBVH;
+
+static const u32                    k_light_bvh_leaf_flag       = 0x80000000;   // Set on child indices of leaves.
+static const u32                    k_light_bvh_stack_size      = 128;          // Keys are 64 bits, so is the depth.
+static const u32                    k_light_bvh_morton_bits     = 10;           // Per axis.
+
+//
+//
+struct LightBVHNode {
+
+    vec3s                           aabb_min;
+    u32                             left;
+
+    vec3s                           aabb_max;
+    u32                             right;
+
+    u32                             first_leaf;             // Leaves under a node are contiguous.
+    u32                             last_leaf;
+    u32                             parent;
+    u32                             pad;
+
+}; // struct LightBVHNode
+
+//
+// Runs one stage of the build or the refit over a range of lights or nodes.
+struct LightBVHTask : public enki::ITaskSet {
+
+    void                            ExecuteRange( enki::TaskSetPartition range, uint32_t thread_index ) override;
+
+    LightBVH*                       bvh                     = nullptr;
+    const vec4s*                    light_spheres           = nullptr;
+    u32                             stage                   = 0;
+
+}; // struct LightBVHTask
+
+//
+// Linear BVH over light spheres: lights are sorted along a Morton curve of their centers and the hierarchy is
+// emitted from the sorted codes, with all the nodes built in parallel. Refit keeps the hierarchy and only updates
+// the bounds, for lights that moved a little.
+// Nodes are internal, children with k_light_bvh_leaf_flag are the sorted leaves.
+struct LightBVH {
+
+    void                            init( Allocator* allocator, u32 initial_capacity );
+    void                            shutdown();
+
+    // Spheres are world space center and radius, indexed by light.
+    void                            build( const vec4s* light_spheres, u32 count, enki::TaskScheduler* task_scheduler );
+    void                            refit( const vec4s* light_spheres, enki::TaskScheduler* task_scheduler );
+    // Rebuilds when the count changed or after rebuild_interval refits.
+    void                            update( const vec4s* light_spheres, u32 count, enki::TaskScheduler* task_scheduler );
+
+    // Appends the lights intersecting the planes, normals pointing inside. Returns the number of nodes visited.
+    u32                             query_planes( const vec4s* planes, u32 num_planes, Array<u32>& out_lights ) const;
+    u32                             query_sphere( vec4s sphere, Array<u32>& out_lights ) const;
+
+    // Lights inside the frustum with the highest intensity times coverage, the fraction of the view covered
+    // by the light sphere from the camera position. Highest first.
+    void                            select_lights( const vec4s* frustum_planes, vec3s camera_position, const f32* light_intensities,
+                                                   u32 max_lights, Array<u32>& out_lights, Array<f32>& out_scores ) const;
+
+    void                            run_stage( u32 stage, u32 count, const vec4s* light_spheres );
+
+    Array<LightBVHNode>             nodes;
+    Array<vec4s>                    leaf_spheres;           // In leaf order.
+    Array<u32>                      leaf_parents;
+    Array<u32>                      light_leaves;           // Leaf of each light.
+    DrawSorter                      sorter;                 // Keys are Morton codes, values the lights of the leaves.
+
+    std::atomic<u32>*               refit_visits            = nullptr;
+    u32                             refit_capacity          = 0;
+
+    Allocator*                      allocator               = nullptr;
+    enki::TaskScheduler*            task_scheduler          = nullptr;
+
+    vec3s                           centers_min;            // Quantization of the Morton codes.
+    vec3s                           centers_scale;
+
+    u32                             light_count             = 0;
+    u32                             refits_since_build      = 0;
+    u32                             rebuild_interval        = 30;
+    u32                             min_parallel_count      = 4 * 1024;
+
+}; // struct LightBVH
+
+// Frustum planes of a view projection with normals pointing inside, for -1..1 or 0..1 depth.
+void                                light_bvh_frustum_planes( const mat4s& view_projection, vec4s* out_planes );
+
+} // namespace raptor
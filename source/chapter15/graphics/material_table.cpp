@@ -0,0 +1,146 @@
+#include "graphics/material_table.hpp"
+
+#include "foundation/assert.hpp"
+
+#include <string.h>
+
+namespace raptor {
+
+// MaterialTable //////////////////////////////////////////////////////////
+
+void MaterialTable::init( Allocator* allocator, u32 initial_capacity ) {
+    materials.init( allocator, initial_capacity );
+    hashes.init( allocator, initial_capacity );
+    references.init( allocator, initial_capacity );
+    free_indices.init( allocator, 16 );
+    retired.init( allocator, 16 );
+
+    hash_to_index.init( allocator, initial_capacity );
+    hash_to_index.set_default_value( u32_max );
+
+    dirty_begin = u32_max;
+    dirty_end = 0;
+
+    stats = MaterialTableStats();
+}
+
+void MaterialTable::shutdown() {
+    materials.shutdown();
+    hashes.shutdown();
+    references.shutdown();
+    free_indices.shutdown();
+    retired.shutdown();
+
+    hash_to_index.shutdown();
+}
+
+u32 MaterialTable::add( const GpuMaterial& material ) {
+    ++stats.requests;
+
+    const u64 hash = hash_bytes( ( void* )&material, sizeof( GpuMaterial ) );
+
+    const u32 cached_index = hash_to_index.get( hash );
+    if ( cached_index != u32_max ) {
+        if ( memcmp( &materials[ cached_index ], &material, sizeof( GpuMaterial ) ) == 0 ) {
+            ++references[ cached_index ];
+            ++stats.shared;
+
+            return cached_index;
+        }
+
+        ++stats.collisions;
+    }
+
+    u32 index;
+    if ( free_indices.size > 0 ) {
+        index = free_indices.back();
+        free_indices.pop();
+
+        materials[ index ] = material;
+        hashes[ index ] = hash;
+        references[ index ] = 1;
+    } else {
+        index = materials.size;
+
+        materials.push( material );
+        hashes.push( hash );
+        references.push( 1 );
+    }
+
+    // A colliding material is not cached, it gets its own slot for every request.
+    if ( cached_index == u32_max ) {
+        hash_to_index.insert( hash, index );
+    }
+
+    dirty_begin = dirty_begin < index ? dirty_begin : index;
+    dirty_end = dirty_end > index + 1 ? dirty_end : index + 1;
+
+    ++stats.live;
+
+    return index;
+}
+
+void MaterialTable::release( u32 index, u64 timeline_value ) {
+    if ( index >= materials.size ) {
+        return;
+    }
+
+    RASSERTM( references[ index ] > 0, "Material %u released more times than added", index );
+    if ( --references[ index ] > 0 ) {
+        return;
+    }
+
+    FlatHashMapIterator it = hash_to_index.find( hashes[ index ] );
+    if ( it.is_valid() && hash_to_index.get( it ) == index ) {
+        hash_to_index.remove( it );
+    }
+
+    RetiredMaterial retired_material;
+    retired_material.timeline_value = timeline_value;
+    retired_material.index = index;
+    retired.push( retired_material );
+
+    --stats.live;
+    ++stats.retired;
+}
+
+u32 MaterialTable::update( u32 index, const GpuMaterial& material, u64 timeline_value ) {
+    // Add first, so that an unchanged material keeps its index.
+    const u32 new_index = add( material );
+    release( index, timeline_value );
+
+    return new_index;
+}
+
+void MaterialTable::collect( u64 completed_value ) {
+    // Swap removal, the order of the free indices does not matter.
+    for ( u32 r = 0; r < retired.size; ) {
+        if ( retired[ r ].timeline_value > completed_value ) {
+            ++r;
+            continue;
+        }
+
+        free_indices.push( retired[ r ].index );
+        retired.delete_swap( r );
+
+        --stats.retired;
+    }
+}
+
+void MaterialTable::upload( GpuMaterial* gpu_materials, u32 gpu_capacity ) {
+    if ( !needs_upload() ) {
+        return;
+    }
+
+    RASSERTM( dirty_end <= gpu_capacity, "Material table has %u materials, gpu buffer holds %u", dirty_end, gpu_capacity );
+    const u32 end = dirty_end < gpu_capacity ? dirty_end : gpu_capacity;
+
+    if ( dirty_begin < end ) {
+        memcpy( gpu_materials + dirty_begin, materials.data + dirty_begin, sizeof( GpuMaterial ) * ( end - dirty_begin ) );
+    }
+
+    dirty_begin = u32_max;
+    dirty_end = 0;
+}
+
+} // namespace raptor
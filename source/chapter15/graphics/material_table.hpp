@@ -0,0 +1,91 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/hash_map.hpp"
+#include "foundation/platform.hpp"
+
+#include "external/cglm/types-struct.h"
+
+namespace raptor {
+
+struct Allocator;
+
+//
+// Gpu material, same layout as struct Material in shaders/mesh.h.
+// Padding is part of the content hash, so materials should be value initialized.
+struct alignas( 16 ) GpuMaterial {
+
+    u32                             textures[ 4 ];      // diffuse, roughness, normal, occlusion
+    vec4s                           emissive;           // emissive_color_factor + emissive texture index
+    vec4s                           base_color_factor;
+    vec4s                           metallic_roughness_occlusion_factor; // metallic, roughness, occlusion
+
+    u32                             flags;
+    f32                             alpha_cutoff;
+    u32                             padding_[ 2 ];
+
+}; // struct GpuMaterial
+
+//
+//
+struct MaterialTableStats {
+
+    u32                             requests            = 0;
+    u32                             shared              = 0;    // Requests satisfied by an existing material.
+    u32                             collisions          = 0;    // Same hash, different content.
+    u32                             live                = 0;
+    u32                             retired             = 0;    // Released slots waiting for the gpu.
+
+}; // struct MaterialTableStats
+
+//
+// Slot released at a frame, that in flight frames can still read.
+struct RetiredMaterial {
+
+    u64                             timeline_value      = 0;
+    u32                             index               = 0;
+
+}; // struct RetiredMaterial
+
+//
+// Single table of all materials, uploaded in one storage buffer and indexed by the mesh instances.
+// Materials with the same content share an index and are reference counted. Released indices
+// are reused once the gpu timeline passed the frame that released them, so the index of a live material
+// never changes and frames in flight never see a slot overwritten.
+struct MaterialTable {
+
+    void                            init( Allocator* allocator, u32 initial_capacity );
+    void                            shutdown();
+
+    u32                             add( const GpuMaterial& material );
+    // The slot can be reused once the completed timeline value is >= timeline_value.
+    void                            release( u32 index, u64 timeline_value );
+    // As the old content can be shared, returns the index of the new content.
+    u32                             update( u32 index, const GpuMaterial& material, u64 timeline_value );
+
+    // Makes the slots released up to completed_value available again.
+    void                            collect( u64 completed_value );
+
+    // Number of slots, including released ones. This is the size of the gpu table.
+    u32                             size() const        { return materials.size; }
+
+    bool                            needs_upload() const { return dirty_begin < dirty_end; }
+    // Copies the slots changed since the last upload.
+    void                            upload( GpuMaterial* gpu_materials, u32 gpu_capacity );
+
+    Array<GpuMaterial>              materials;
+    Array<u64>                      hashes;
+    Array<u32>                      references;
+    Array<u32>                      free_indices;
+    Array<RetiredMaterial>          retired;
+
+    FlatHashMap<u64, u32>           hash_to_index;
+
+    u32                             dirty_begin         = u32_max;
+    u32                             dirty_end           = 0;
+
+    MaterialTableStats              stats;
+
+}; // struct MaterialTable
+
+} // namespace raptor
@@ -19,7 +19,14 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <new>
+
+// Cloth simulation of obj scenes, enabled by the RAPTOR_CHAPTER15_PHYSICS CMake option.
+#if defined( RAPTOR_ENABLE_PHYSICS )
+static const bool k_enable_physics = true;
+#else
 static const bool k_enable_physics = false;
+#endif // RAPTOR_ENABLE_PHYSICS
 
 namespace raptor {
 
@@ -304,7 +311,7 @@ void ObjScene::add_mesh( cstring filename, cstring path, StackAllocator* temp_al
         PhysicsMesh* physics_mesh = nullptr;
 
         if ( k_enable_physics ) {
-            physics_mesh = ( PhysicsMesh* )resident_allocator->allocate( sizeof( PhysicsMesh ), 64 );
+            physics_mesh = new ( resident_allocator->allocate( sizeof( PhysicsMesh ), 64 ) ) PhysicsMesh( );
 
             physics_mesh->vertices.init( resident_allocator, mesh->mNumVertices );
         }
@@ -396,7 +403,7 @@ void ObjScene::add_mesh( cstring filename, cstring path, StackAllocator* temp_al
 
         {
             BufferCreation creation{ };
-            creation.set( VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, ResourceUsageType::Dynamic, sizeof( GpuMaterialData ) ).set_name( "mesh_data" );
+            creation.set( VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, ResourceUsageType::Dynamic, sizeof( GpuMeshDrawData ) ).set_name( "mesh_data" );
 
             render_mesh.pbr_material.material_buffer = renderer->gpu->create_buffer( creation );
         }
@@ -449,6 +456,11 @@ void ObjScene::add_mesh( cstring filename, cstring path, StackAllocator* temp_al
                 vertex_data[ vertex_index ] = gpu_data;
             }
 
+            // The buffer counts the vertices of the previous meshes too, the solver only reads the ones of this mesh.
+            PhysicsMeshGpuData solver_mesh_data = *mesh_data;
+            solver_mesh_data.vertex_count = physics_mesh->vertices.size;
+            physics_mesh->cpu_solver.init( resident_allocator, solver_mesh_data, vertex_data, indices.data + render_mesh.index_offset / sizeof( u32 ) );
+
             creation.reset().set( VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Immutable, buffer_size ).set_device_only( true ).set_name( "physics_mesh_data_gpu" );
 
             BufferResource* gpu_buffer = renderer->create_buffer( creation );
@@ -638,6 +650,7 @@ void ObjScene::shutdown( Renderer* renderer ) {
             gpu.destroy_descriptor_set( physics_mesh->debug_mesh_descriptor_set );
 
             physics_mesh->vertices.shutdown();
+            physics_mesh->cpu_solver.shutdown();
 
             resident_allocator->deallocate( physics_mesh );
         }
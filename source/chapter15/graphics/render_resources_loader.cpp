@@ -1,5 +1,6 @@
 #include "graphics/render_resources_loader.hpp"
 #include "graphics/frame_graph.hpp"
+#include "graphics/shader_dependency_graph.hpp"
 
 #include "foundation/file.hpp"
 #include "foundation/time.hpp"
@@ -19,7 +20,8 @@ static bool             parse_gpu_pipeline( nlohmann::json& pipeline, raptor::Pi
                                             raptor::StringBuffer& shader_buffer, raptor::Allocator* temp_allocator, raptor::Renderer* renderer,
                                             raptor::FrameGraph* frame_graph, raptor::StringBuffer& pass_name_buffer,
                                             const Array<VertexInputCreation>& vertex_input_creations, FlatHashMap<u64, u16>& name_to_vertex_inputs,
-                                            cstring technique_name, bool use_cache, bool parent_technique, bool& is_shader_changed );
+                                            cstring technique_name, bool use_cache, bool parent_technique, bool& is_shader_changed,
+                                            const ShaderReloadContext* reload_context );
 
 // RenderResourcesLoader //////////////////////////////////////////////////
 void RenderResourcesLoader::init( raptor::Renderer* renderer_, raptor::StackAllocator* temp_allocator_, raptor::FrameGraph* frame_graph_ ) {
@@ -31,12 +33,15 @@ void RenderResourcesLoader::init( raptor::Renderer* renderer_, raptor::StackAllo
 void RenderResourcesLoader::shutdown() {
 }
 
-void RenderResourcesLoader::parse_gpu_technique( GpuTechniqueCreation& technique_creation, cstring json_path, bool use_shader_cache, bool& is_techinque_changed ) {
+void RenderResourcesLoader::parse_gpu_technique( GpuTechniqueCreation& technique_creation, cstring json_path, bool use_shader_cache, bool& is_techinque_changed,
+                                                 const ShaderReloadContext* reload_context ) {
 
     using namespace raptor;
     
     is_techinque_changed = false;
 
+    StackAllocator* temp_allocator = reload_context ? reload_context->allocator : this->temp_allocator;
+
     FileReadResult read_result = file_read_text( json_path, temp_allocator );
 
     StringBuffer path_buffer;
@@ -163,6 +168,16 @@ void RenderResourcesLoader::parse_gpu_technique( GpuTechniqueCreation& technique
         for ( u32 i = 0; i < size; ++i ) {
             json pipeline = pipelines[ i ];
 
+            if ( reload_context && reload_context->pass_name ) {
+                std::string pipeline_name;
+                if ( pipeline[ "name" ].is_string() ) {
+                    pipeline[ "name" ].get_to( pipeline_name );
+                }
+                if ( pipeline_name != reload_context->pass_name ) {
+                    continue;
+                }
+            }
+
             PipelineCreation pc{};
             pc.shaders.reset();
 
@@ -181,14 +196,14 @@ void RenderResourcesLoader::parse_gpu_technique( GpuTechniqueCreation& technique
                     pipeline_i[ "name" ].get_to( name );
 
                     if ( name == inherited_name ) {
-                        add_pass = parse_gpu_pipeline( pipeline_i, pc, path_buffer, shader_code_buffer, temp_allocator, renderer, frame_graph, pass_name_buffer, vertex_input_creations, name_to_vertex_inputs, technique_creation.name, false, true, parent_shader_changed );
+                        add_pass = parse_gpu_pipeline( pipeline_i, pc, path_buffer, shader_code_buffer, temp_allocator, renderer, frame_graph, pass_name_buffer, vertex_input_creations, name_to_vertex_inputs, technique_creation.name, false, true, parent_shader_changed, reload_context );
                         break;
                     }
                 }
             }
 
             bool current_shader_changed = false;
-            add_pass = add_pass && parse_gpu_pipeline( pipeline, pc, path_buffer, shader_code_buffer, temp_allocator, renderer, frame_graph, pass_name_buffer, vertex_input_creations, name_to_vertex_inputs, technique_creation.name, use_shader_cache, false, current_shader_changed );
+            add_pass = add_pass && parse_gpu_pipeline( pipeline, pc, path_buffer, shader_code_buffer, temp_allocator, renderer, frame_graph, pass_name_buffer, vertex_input_creations, name_to_vertex_inputs, technique_creation.name, use_shader_cache, false, current_shader_changed, reload_context );
 
             if ( add_pass ) {
                 technique_creation.creations[ technique_creation.num_creations++ ] = pc;
@@ -228,11 +243,7 @@ void RenderResourcesLoader::reload_gpu_technique( cstring json_path, bool use_sh
     parse_gpu_technique( technique_creation, json_path, use_shader_cache, is_technique_changed );
 
     if ( is_technique_changed ) {
-        // Destroy old gpu technique
-        GpuTechnique* old_technique = renderer->resource_cache.techniques.get( hash_calculate( technique_creation.name ) );
-        renderer->destroy_technique( old_technique );
-        // Load new one
-        GpuTechnique* new_technique = renderer->create_technique( technique_creation );
+        swap_gpu_technique( technique_creation );
     }
 
     temp_allocator->free_marker( allocated_marker );
@@ -241,6 +252,19 @@ void RenderResourcesLoader::reload_gpu_technique( cstring json_path, bool use_sh
 }
 
 
+void RenderResourcesLoader::swap_gpu_technique( const GpuTechniqueCreation& technique_creation ) {
+    GpuTechnique* old_technique = renderer->resource_cache.techniques.get( hash_calculate( technique_creation.name ) );
+    // Pipelines are replaced in place, so passes and materials keep their handles.
+    if ( old_technique && renderer->reload_technique( old_technique, technique_creation ) ) {
+        return;
+    }
+
+    // Destroy old gpu technique
+    renderer->destroy_technique( old_technique );
+    // Load new one
+    renderer->create_technique( technique_creation );
+}
+
 TextureResource* RenderResourcesLoader::load_texture( cstring path, bool generate_mipmaps ) {
     int comp, width, height;
     uint8_t* image_data = stbi_load( path, &width, &height, &comp, 4 );
@@ -397,7 +421,8 @@ bool parse_gpu_pipeline( nlohmann::json& pipeline, raptor::PipelineCreation& pc,
                          raptor::StringBuffer& shader_buffer, raptor::Allocator* temp_allocator, raptor::Renderer* renderer,
                          raptor::FrameGraph* frame_graph, raptor::StringBuffer& pass_name_buffer,
                          const Array<VertexInputCreation>& vertex_input_creations, FlatHashMap<u64, u16>& name_to_vertex_inputs,
-                         cstring technique_name, bool use_cache, bool parent_technique, bool& shader_changed ) {
+                         cstring technique_name, bool use_cache, bool parent_technique, bool& shader_changed,
+                         const ShaderReloadContext* reload_context ) {
     using json = nlohmann::json;
     using namespace raptor;
 
@@ -516,21 +541,31 @@ bool parse_gpu_pipeline( nlohmann::json& pipeline, raptor::PipelineCreation& pc,
             cstring shader_spirv_path = nullptr;
             cstring shader_hash_path = nullptr;
 
+            // Hashes only cover the listed files, stages depending on a changed #include are compiled in any case.
+            bool stage_dirty = false;
+            if ( reload_context && reload_context->dirty_stages ) {
+                const u64 stage_key = shader_stage_key( technique_name, pc.shaders.name, name.c_str() );
+                for ( u32 d = 0; d < reload_context->dirty_stages->size && !stage_dirty; ++d ) {
+                    stage_dirty = ( *reload_context->dirty_stages )[ d ] == stage_key;
+                }
+            }
+
             if ( use_cache ) {
+                cstring cache_suffix = reload_context ? reload_context->cache_suffix : "";
                 // Check shader cache and eventually compile the code.
                 path_buffer.clear();
-                shader_spirv_path = path_buffer.append_use_f( "%s/%s_%s_%s.spv",
+                shader_spirv_path = path_buffer.append_use_f( "%s/%s_%s_%s%s.spv",
                                                               renderer->resource_cache.binary_data_folder, technique_name, pc.shaders.name,
-                                                              to_compiler_extension( shader_stage.type ) );
-                shader_hash_path = path_buffer.append_use_f( "%s/%s_%s_%s.hash.cache",
+                                                              to_compiler_extension( shader_stage.type ), cache_suffix );
+                shader_hash_path = path_buffer.append_use_f( "%s/%s_%s_%s%s.hash.cache",
                                                              renderer->resource_cache.binary_data_folder, technique_name, pc.shaders.name,
-                                                             to_compiler_extension( shader_stage.type ) );
+                                                             to_compiler_extension( shader_stage.type ), cache_suffix );
                 //FileReadResult shader_read_result = file_read_text( shader_path, temp_allocator );
                 bool cache_exists = file_exists( shader_hash_path );
 
                 //rprint( "\nfile %s\n", shader_hash_path );
                 // TODO: still not working
-                if ( cache_exists ) {
+                if ( cache_exists && !stage_dirty ) {
 
                     FileReadResult frr = file_read_binary( shader_hash_path, temp_allocator );
                     if ( frr.data ) {
@@ -555,7 +590,10 @@ bool parse_gpu_pipeline( nlohmann::json& pipeline, raptor::PipelineCreation& pc,
 
             // Cache is not present or shader has changed, compile shaders.
             if ( compile_shader ) {
-                VkShaderModuleCreateInfo shader_create_info = renderer->gpu->compile_shader( code, code_size, shader_stage.type, pc.shaders.name );
+                VkShaderModuleCreateInfo shader_create_info = reload_context ?
+                    renderer->gpu->compile_shader( code, code_size, shader_stage.type, pc.shaders.name, temp_allocator, reload_context->temp_file_prefix,
+                                                   reload_context->defines ) :
+                    renderer->gpu->compile_shader( code, code_size, shader_stage.type, pc.shaders.name );
                 if ( shader_create_info.pCode ) {
                     shader_stage.code = reinterpret_cast< cstring >( shader_create_info.pCode );
                     shader_stage.code_size = ( u32 )shader_create_info.codeSize;
@@ -6,6 +6,22 @@ namespace raptor {
 
     struct FrameGraph;
 
+    //
+    // Parsing between frames, with its own memory and temporary files. Main thread only: compilation runs
+    // glslangValidator from the working directory with a shared output buffer, and parsing reads the frame graph.
+    struct ShaderReloadContext {
+
+        StackAllocator*     allocator           = nullptr;
+        cstring             temp_file_prefix    = "";
+        const Array<u64>*   dirty_stages        = nullptr;  // shader_stage_key of the stages compiled even if their cached hashes match.
+
+        // Shader variants: only the named pipeline is parsed, compiled with the defines and cached with the suffix.
+        cstring             pass_name           = nullptr;
+        cstring             defines             = "";
+        cstring             cache_suffix        = "";
+
+    }; // struct ShaderReloadContext
+
     //
     //
     struct RenderResourcesLoader {
@@ -16,8 +32,11 @@ namespace raptor {
         GpuTechnique*   load_gpu_technique( cstring json_path, bool use_shader_cache, bool& is_shader_changed );
         TextureResource* load_texture( cstring path, bool generate_mipmaps = true );
 
-        void            parse_gpu_technique( GpuTechniqueCreation& technique_creation, cstring json_path, bool use_shader_cache, bool& is_techinque_changed );
+        void            parse_gpu_technique( GpuTechniqueCreation& technique_creation, cstring json_path, bool use_shader_cache, bool& is_techinque_changed,
+                                             const ShaderReloadContext* reload_context = nullptr );
         void            reload_gpu_technique( cstring json_path, bool use_shader_cache, bool& is_techinque_changed );
+        // Replaces the pipelines of the technique with the same name, must be called between frames.
+        void            swap_gpu_technique( const GpuTechniqueCreation& technique_creation );
 
         Renderer*       renderer;
         FrameGraph*     frame_graph;
@@ -2,8 +2,10 @@
 #include "graphics/renderer.hpp"
 #include "graphics/scene_graph.hpp"
 #include "graphics/asynchronous_loader.hpp"
+#include "graphics/frame_statistics.hpp"
 #include "graphics/raptor_imgui.hpp"
 #include "graphics/gpu_profiler.hpp"
+#include "graphics/shader_variants.hpp"
 
 #include "foundation/time.hpp"
 #include "foundation/numerics.hpp"
@@ -50,21 +52,28 @@ static int mesh_material_compare( const void* a, const void* b ) {
 
 //
 //
-static void copy_gpu_material_data( GpuDevice& gpu, GpuMaterialData& gpu_mesh_data, const Mesh& mesh ) {
-    gpu_mesh_data.textures[ 0 ] = mesh.pbr_material.diffuse_texture_index;
-    gpu_mesh_data.textures[ 1 ] = mesh.pbr_material.roughness_texture_index;
-    gpu_mesh_data.textures[ 2 ] = mesh.pbr_material.normal_texture_index;
-    gpu_mesh_data.textures[ 3 ] = mesh.pbr_material.occlusion_texture_index;
+static void copy_gpu_material( GpuMaterial& gpu_material, const PBRMaterial& pbr_material ) {
+    gpu_material.textures[ 0 ] = pbr_material.diffuse_texture_index;
+    gpu_material.textures[ 1 ] = pbr_material.roughness_texture_index;
+    gpu_material.textures[ 2 ] = pbr_material.normal_texture_index;
+    gpu_material.textures[ 3 ] = pbr_material.occlusion_texture_index;
 
-    gpu_mesh_data.emissive = { mesh.pbr_material.emissive_factor.x, mesh.pbr_material.emissive_factor.y, mesh.pbr_material.emissive_factor.z, ( float )mesh.pbr_material.emissive_texture_index };
+    gpu_material.emissive = { pbr_material.emissive_factor.x, pbr_material.emissive_factor.y, pbr_material.emissive_factor.z, ( float )pbr_material.emissive_texture_index };
 
-    gpu_mesh_data.base_color_factor = mesh.pbr_material.base_color_factor;
-    gpu_mesh_data.metallic_roughness_occlusion_factor.x = mesh.pbr_material.metallic;
-    gpu_mesh_data.metallic_roughness_occlusion_factor.y = mesh.pbr_material.roughness;
-    gpu_mesh_data.metallic_roughness_occlusion_factor.z = mesh.pbr_material.occlusion;
-    gpu_mesh_data.alpha_cutoff = mesh.pbr_material.alpha_cutoff;
+    gpu_material.base_color_factor = pbr_material.base_color_factor;
+    gpu_material.metallic_roughness_occlusion_factor.x = pbr_material.metallic;
+    gpu_material.metallic_roughness_occlusion_factor.y = pbr_material.roughness;
+    gpu_material.metallic_roughness_occlusion_factor.z = pbr_material.occlusion;
+    gpu_material.alpha_cutoff = pbr_material.alpha_cutoff;
 
+    gpu_material.flags = pbr_material.flags;
+}
+
+//
+//
+static void copy_gpu_mesh_draw_data( GpuDevice& gpu, GpuMeshDrawData& gpu_mesh_data, const Mesh& mesh ) {
     gpu_mesh_data.flags = mesh.pbr_material.flags;
+    gpu_mesh_data.material_index = mesh.pbr_material.material_index;
 
     gpu_mesh_data.mesh_index = mesh.gpu_mesh_index;
     gpu_mesh_data.meshlet_offset = mesh.meshlet_offset;
@@ -93,6 +102,71 @@ static void copy_gpu_mesh_transform( GpuMeshInstanceData& gpu_mesh_data, const M
     }
 
     gpu_mesh_data.mesh_index = mesh_instance.mesh->gpu_mesh_index;
+    gpu_mesh_data.material_index = mesh_instance.mesh->pbr_material.material_index;
+}
+
+// Sort key pass field of the mesh draws.
+static const u32 k_draw_pass_depth_pre = 0;
+static const u32 k_draw_pass_gbuffer = 1;
+static const u32 k_draw_pass_transparent = 2;
+
+// Sorts the draws of a pass by pipeline, descriptor set, depth and mesh, or back to front for transparent draws.
+// Uses the camera of the previous upload, as the scene data is updated after the passes.
+static void sort_mesh_instance_draws( RenderScene& scene, Array<MeshInstanceDraw>& mesh_instance_draws, DrawSorter& draw_sorter, u32 pass, bool transparent ) {
+    Renderer* renderer = scene.renderer;
+
+    const vec3s camera_position = glms_vec3( scene.scene_data.camera_position );
+    const f32 z_near = scene.scene_data.z_near;
+    const f32 z_far = scene.scene_data.z_far;
+    const mat4s scale_matrix = glms_scale_make( { scene.global_scale, scene.global_scale, -scene.global_scale } );
+
+    draw_sorter.begin( mesh_instance_draws.size );
+
+    for ( u32 i = 0; i < mesh_instance_draws.size; ++i ) {
+        MeshInstanceDraw& mesh_instance_draw = mesh_instance_draws[ i ];
+        MeshInstance& mesh_instance = *mesh_instance_draw.mesh_instance;
+        Mesh& mesh = *mesh_instance.mesh;
+
+        const PipelineHandle pipeline = renderer->get_pipeline( mesh.pbr_material.material, mesh_instance_draw.material_pass_index );
+        const DescriptorSetHandle descriptor_set = transparent ? mesh.pbr_material.descriptor_set_transparent : mesh.pbr_material.descriptor_set_main;
+
+        u32 depth = 0;
+        if ( scene.scene_graph ) {
+            const mat4s world = glms_mat4_mul( scale_matrix, scene.scene_graph->world_matrices[ mesh_instance.scene_graph_node_index ] );
+            const vec4s center = glms_mat4_mulv( world, vec4s{ mesh.bounding_sphere.x, mesh.bounding_sphere.y, mesh.bounding_sphere.z, 1.0f } );
+            depth = draw_sort_depth( glms_vec3_distance( glms_vec3( center ), camera_position ), z_near, z_far );
+        }
+
+        draw_sorter.keys[ i ] = transparent ? draw_sort_key_back_to_front( pass, pipeline.index, descriptor_set.index, depth, mesh.gpu_mesh_index ) :
+                                              draw_sort_key( pass, pipeline.index, descriptor_set.index, depth, mesh.gpu_mesh_index );
+    }
+
+    draw_sorter.sort( scene.task_scheduler );
+}
+
+// Records the draws of a pass in sorted order, binding pipelines only when they change.
+static void draw_sorted_mesh_instances( RenderScene* render_scene, CommandBuffer* gpu_commands, Array<MeshInstanceDraw>& mesh_instance_draws, DrawSorter& draw_sorter, bool transparent ) {
+    Renderer* renderer = render_scene->renderer;
+
+    // Draws added after the last sort are recorded in scene order.
+    const bool sorted = draw_sorter.values.size == mesh_instance_draws.size;
+
+    PipelineHandle bound_pipeline = k_invalid_pipeline;
+    DescriptorSetHandle bound_set = k_invalid_set;
+    for ( u32 i = 0; i < mesh_instance_draws.size; ++i ) {
+        MeshInstanceDraw& mesh_instance_draw = mesh_instance_draws[ sorted ? draw_sorter.values[ i ] : i ];
+        Mesh& mesh = *mesh_instance_draw.mesh_instance->mesh;
+
+        const PipelineHandle pipeline = renderer->get_pipeline( mesh.pbr_material.material, mesh_instance_draw.material_pass_index );
+        if ( pipeline.index != bound_pipeline.index ) {
+            gpu_commands->bind_pipeline( pipeline );
+
+            bound_pipeline = pipeline;
+            bound_set = k_invalid_set;
+        }
+
+        render_scene->draw_mesh_instance( gpu_commands, *mesh_instance_draw.mesh_instance, transparent, bound_set );
+    }
 }
 
 static FrameGraphResource* get_output_texture( FrameGraph* frame_graph, FrameGraphResourceHandle input ) {
@@ -139,21 +213,7 @@ void DepthPrePass::render( u32 current_frame_index, CommandBuffer* gpu_commands,
         gpu_commands->draw_mesh_task_indirect_count( render_scene->mesh_task_indirect_early_commands_sb[ current_frame_index ], offsetof( GpuMeshDrawCommand, indirectMS ), render_scene->mesh_task_indirect_early_commands_sb[ current_frame_index ], 0, render_scene->mesh_instances.size, sizeof( GpuMeshDrawCommand ) );
     }
     else {
-        Material* last_material = nullptr;
-        for ( u32 mesh_index = 0; mesh_index < mesh_instance_draws.size; ++mesh_index ) {
-            MeshInstanceDraw& mesh_instance_draw = mesh_instance_draws[ mesh_index ];
-            Mesh& mesh = *mesh_instance_draw.mesh_instance->mesh;
-
-            if ( mesh.pbr_material.material != last_material ) {
-                PipelineHandle pipeline = renderer->get_pipeline( mesh.pbr_material.material, mesh_instance_draw.material_pass_index );
-
-                gpu_commands->bind_pipeline( pipeline );
-
-                last_material = mesh.pbr_material.material;
-            }
-
-            render_scene->draw_mesh_instance( gpu_commands, *mesh_instance_draw.mesh_instance, false );
-        }
+        draw_sorted_mesh_instances( render_scene, gpu_commands, mesh_instance_draws, draw_sorter, false );
     }
 }
 
@@ -175,6 +235,7 @@ void DepthPrePass::prepare_draws( RenderScene& scene, FrameGraph* frame_graph, A
     GpuTechnique* main_technique = renderer->resource_cache.techniques.get( hashed_name );
 
     mesh_instance_draws.init( resident_allocator, 16 );
+    draw_sorter.init( resident_allocator, 16 );
 
     // Copy all mesh draws and change only material.
     for ( u32 i = 0; i < scene.mesh_instances.size; ++i ) {
@@ -201,11 +262,19 @@ void DepthPrePass::prepare_draws( RenderScene& scene, FrameGraph* frame_graph, A
     }
 }
 
+void DepthPrePass::upload_gpu_data( RenderScene& scene ) {
+    if ( !enabled || scene.use_meshlets )
+        return;
+
+    sort_mesh_instance_draws( scene, mesh_instance_draws, draw_sorter, k_draw_pass_depth_pre, false );
+}
+
 void DepthPrePass::free_gpu_resources( GpuDevice& gpu ) {
     if ( !enabled )
         return;
 
     mesh_instance_draws.shutdown();
+    draw_sorter.shutdown();
 }
 
 //
@@ -416,7 +485,6 @@ void GBufferPass::render( u32 current_frame_index, CommandBuffer* gpu_commands,
     if ( !enabled )
         return;
 
-    Renderer* renderer = render_scene->renderer;
     if ( render_scene->use_meshlets_emulation ) {
 
         gpu_commands->bind_pipeline( meshlet_emulation_draw_pipeline );
@@ -435,21 +503,7 @@ void GBufferPass::render( u32 current_frame_index, CommandBuffer* gpu_commands,
         gpu_commands->draw_mesh_task_indirect_count( render_scene->mesh_task_indirect_early_commands_sb[ current_frame_index ], offsetof( GpuMeshDrawCommand, indirectMS ), render_scene->mesh_task_indirect_count_early_sb[ current_frame_index ], 0, render_scene->mesh_instances.size, sizeof( GpuMeshDrawCommand ) );
     }
     else {
-        Material* last_material = nullptr;
-        for ( u32 mesh_index = 0; mesh_index < mesh_instance_draws.size; ++mesh_index ) {
-            MeshInstanceDraw& mesh_instance_draw = mesh_instance_draws[ mesh_index ];
-            Mesh& mesh = *mesh_instance_draw.mesh_instance->mesh;
-
-            if ( mesh.pbr_material.material != last_material ) {
-                PipelineHandle pipeline = renderer->get_pipeline( mesh.pbr_material.material, mesh_instance_draw.material_pass_index );
-
-                gpu_commands->bind_pipeline( pipeline );
-
-                last_material = mesh.pbr_material.material;
-            }
-
-            render_scene->draw_mesh_instance( gpu_commands, *mesh_instance_draw.mesh_instance, false );
-        }
+        draw_sorted_mesh_instances( render_scene, gpu_commands, mesh_instance_draws, draw_sorter, false );
     }
 }
 
@@ -471,6 +525,7 @@ void GBufferPass::prepare_draws( RenderScene& scene, FrameGraph* frame_graph, Al
     GpuTechnique* main_technique = renderer->resource_cache.techniques.get( hashed_name );
 
     mesh_instance_draws.init( resident_allocator, 16 );
+    draw_sorter.init( resident_allocator, 16 );
 
     // Copy all mesh draws and change only material.
     for ( u32 i = 0; i < scene.mesh_instances.size; ++i ) {
@@ -556,11 +611,19 @@ void GBufferPass::prepare_draws( RenderScene& scene, FrameGraph* frame_graph, Al
     }
 }
 
+void GBufferPass::upload_gpu_data( RenderScene& scene ) {
+    if ( !enabled || scene.use_meshlets )
+        return;
+
+    sort_mesh_instance_draws( scene, mesh_instance_draws, draw_sorter, k_draw_pass_gbuffer, false );
+}
+
 void GBufferPass::free_gpu_resources( GpuDevice& gpu ) {
     if ( !enabled )
         return;
 
     mesh_instance_draws.shutdown();
+    draw_sorter.shutdown();
 
     for ( u32 i = 0; i < k_max_frames; ++i ) {
         gpu.destroy_buffer( meshlet_instance_culling_indirect_buffer[ i ] );
@@ -664,15 +727,12 @@ void LightPass::render( u32 current_frame_index, CommandBuffer* gpu_commands, Re
         return;
 
     if ( use_compute ) {
-        PipelineHandle pipeline = renderer->get_pipeline( mesh.pbr_material.material, 1 );
-        gpu_commands->bind_pipeline( pipeline );
+        gpu_commands->bind_pipeline( lighting_pipeline );
         gpu_commands->bind_descriptor_set( &lighting_descriptor_set[ current_frame_index ], 1, nullptr, 0 );
 
         gpu_commands->dispatch( ceilu32( renderer->gpu->swapchain_width * 1.f / 8 ), ceilu32( renderer->gpu->swapchain_height * 1.f / 8 ), 1 );
     } else {
-        PipelineHandle pipeline = renderer->get_pipeline( mesh.pbr_material.material, 0 );
-
-        gpu_commands->bind_pipeline( pipeline );
+        gpu_commands->bind_pipeline( lighting_pipeline );
         gpu_commands->bind_vertex_buffer( mesh.position_buffer, 0, 0 );
         gpu_commands->bind_descriptor_set( &lighting_descriptor_set[ current_frame_index ], 1, nullptr, 0 );
 
@@ -761,6 +821,7 @@ void LightPass::prepare_draws( RenderScene& scene, FrameGraph* frame_graph, Allo
     output_texture = frame_graph->access_resource( node->outputs[ 0 ] );
 
     mesh.pbr_material.material = material_pbr;
+    lighting_pipeline = renderer->get_pipeline( material_pbr, use_compute ? 1 : 0 );
 
     // Create debug texture
     TextureCreation texture_creation;
@@ -832,6 +893,21 @@ void LightPass::upload_gpu_data( RenderScene& scene ) {
 
     u32 current_frame_index = renderer->gpu->current_frame;
 
+    // Variants are compiled on first use, the technique pipeline is used until they are ready.
+    const u32 pass_index = use_compute ? 1 : 0;
+    lighting_pipeline = renderer->get_pipeline( mesh.pbr_material.material, pass_index );
+    if ( scene.shader_variants ) {
+        ShaderVariantManager* shader_variants = scene.shader_variants;
+
+        u32 feature_mask = 0;
+        const u32 debug_options_bit = shader_variants->find_feature( "pbr_lighting", "DEBUG_OPTIONS" );
+        const u32 optimization_bit = shader_variants->find_feature( "pbr_lighting", "ENABLE_OPTIMIZATION" );
+        feature_mask |= ( debug_options_bit != u32_max && scene.lighting_debug_options ) ? ( 1 << debug_options_bit ) : 0;
+        feature_mask |= ( optimization_bit != u32_max && scene.lighting_culling_optimization ) ? ( 1 << optimization_bit ) : 0;
+
+        lighting_pipeline = shader_variants->get_pipeline( "pbr_lighting", use_compute ? "deferred_lighting_compute" : "deferred_lighting_pixel", feature_mask );
+    }
+
     MapBufferParameters cb_map = { mesh.pbr_material.material_buffer, 0, 0 };
     LightingConstants* lighting_data = ( LightingConstants* )renderer->gpu->map_buffer( cb_map );
     if ( lighting_data ) {
@@ -943,21 +1019,7 @@ void TransparentPass::render( u32 current_frame_index, CommandBuffer* gpu_comman
                                                render_scene->mesh_task_indirect_count_early_sb[ current_frame_index ], indirect_count_offset, render_scene->mesh_instances.size, sizeof( GpuMeshDrawCommand ) );
     }
     else {
-        Material* last_material = nullptr;
-        for ( u32 mesh_index = 0; mesh_index < mesh_instance_draws.size; ++mesh_index ) {
-            MeshInstanceDraw& mesh_instance_draw = mesh_instance_draws[ mesh_index ];
-            Mesh& mesh = *mesh_instance_draw.mesh_instance->mesh;
-
-            if ( mesh.pbr_material.material != last_material ) {
-                PipelineHandle pipeline = renderer->get_pipeline( mesh.pbr_material.material, mesh_instance_draw.material_pass_index );
-
-                gpu_commands->bind_pipeline( pipeline );
-
-                last_material = mesh.pbr_material.material;
-            }
-
-            render_scene->draw_mesh_instance( gpu_commands, *mesh_instance_draw.mesh_instance, true );
-        }
+        draw_sorted_mesh_instances( render_scene, gpu_commands, mesh_instance_draws, draw_sorter, true );
     }
 }
 
@@ -979,6 +1041,7 @@ void TransparentPass::prepare_draws( RenderScene& scene, FrameGraph* frame_graph
     GpuTechnique* main_technique = renderer->resource_cache.techniques.get( hashed_name );
 
     mesh_instance_draws.init( resident_allocator, 16 );
+    draw_sorter.init( resident_allocator, 16 );
 
     for ( u32 i = 0; i < scene.mesh_instances.size; ++i ) {
 
@@ -1002,11 +1065,19 @@ void TransparentPass::prepare_draws( RenderScene& scene, FrameGraph* frame_graph
     }
 }
 
+void TransparentPass::upload_gpu_data( RenderScene& scene ) {
+    if ( !enabled || scene.use_meshlets )
+        return;
+
+    sort_mesh_instance_draws( scene, mesh_instance_draws, draw_sorter, k_draw_pass_transparent, true );
+}
+
 void TransparentPass::free_gpu_resources( GpuDevice& gpu ) {
     if ( !enabled )
         return;
 
     mesh_instance_draws.shutdown();
+    draw_sorter.shutdown();
 }
 
 //
@@ -1811,7 +1882,7 @@ void CullingLatePass::prepare_draws( RenderScene& scene, FrameGraph* frame_graph
             DescriptorSetCreation ds_creation{};
             ds_creation.buffer( scene.meshes_sb, 2 ).buffer( scene.mesh_instances_sb, 10 ).buffer( scene.scene_cb, 0 )
                 .buffer( scene.mesh_task_indirect_count_late_sb[ i ], 11 ).buffer( scene.mesh_task_indirect_count_early_sb[ i ], 13 ).buffer(scene.mesh_task_indirect_late_commands_sb[ i ], 1 ).buffer(scene.mesh_task_indirect_culled_commands_sb[ i ], 3 )
-                .buffer( scene.mesh_bounds_sb, 12 )
+                .buffer( scene.mesh_bounds_sb, 12 ).buffer( scene.materials_sb, 14 )
                 .set_layout(layout);
 
                 scene.add_debug_descriptors( ds_creation, pass );
@@ -1908,7 +1979,7 @@ void RayTracingTestPass::prepare_draws( RenderScene& scene, FrameGraph* frame_gr
         uniform_buffer[ i ] = gpu.create_buffer( uniform_buffer_creation );
 
         DescriptorSetCreation ds_creation{};
-        ds_creation.buffer( scene.scene_cb, 0 ).set_as( scene.tlas, 1 ).buffer( scene.meshes_sb, 2 ).buffer( scene.mesh_instances_sb, 10 ).buffer( scene.mesh_bounds_sb, 12 ).buffer( uniform_buffer[ i ], 3 ).set_layout( layout );
+        ds_creation.buffer( scene.scene_cb, 0 ).set_as( scene.tlas, 1 ).buffer( scene.meshes_sb, 2 ).buffer( scene.mesh_instances_sb, 10 ).buffer( scene.mesh_bounds_sb, 12 ).buffer( scene.materials_sb, 14 ).buffer( uniform_buffer[ i ], 3 ).set_layout( layout );
 
         descriptor_set[ i ] = gpu.create_descriptor_set( ds_creation );
     }
@@ -2344,6 +2415,43 @@ static void calculate_cubemap_view_projection( vec3s light_world_position, f32 l
     }
 }
 
+// View projections of the 6 faces of a light cubemap, as rendered in the cubemap array.
+static void calculate_cubemap_view_projections( const Light& light, mat4s* out_view_projections ) {
+
+    const mat4s left_handed_scale_matrix = glms_scale_make( { 1,1,-1 } );
+    const mat4s projection = glms_perspective( glm_rad( 90.f ), 1.f, 0.01f, light.radius );
+
+    // Positive X matrices
+    mat4s view = glms_look( light.world_position, { -1,0,0 }, { 0,1,0 } );
+    view = glms_mat4_mul( left_handed_scale_matrix, view );
+    out_view_projections[ 0 ] = glms_mat4_mul( projection, view );
+
+    // Negative X
+    view = glms_look( light.world_position, { 1,0,0 }, { 0,1,0 } );
+    view = glms_mat4_mul( left_handed_scale_matrix, view );
+    out_view_projections[ 1 ] = glms_mat4_mul( projection, view );
+
+    // Positive Y
+    view = glms_look( light.world_position, { 0,-1,0 }, { 0,0,-1 } );
+    view = glms_mat4_mul( left_handed_scale_matrix, view );
+    out_view_projections[ 2 ] = glms_mat4_mul( projection, view );
+
+    // Negative Y
+    view = glms_look( light.world_position, { 0,1,0 }, { 0,0,1 } );
+    view = glms_mat4_mul( left_handed_scale_matrix, view );
+    out_view_projections[ 3 ] = glms_mat4_mul( projection, view );
+
+    // Positive Z
+    view = glms_look( light.world_position, { 0,0,-1 }, { 0,1,0 } );
+    view = glms_mat4_mul( left_handed_scale_matrix, view );
+    out_view_projections[ 4 ] = glms_mat4_mul( projection, view );
+
+    // Negative Z
+    view = glms_look( light.world_position, { 0,0,1 }, { 0,1,0 } );
+    view = glms_mat4_mul( left_handed_scale_matrix, view );
+    out_view_projections[ 5 ] = glms_mat4_mul( projection, view );
+}
+
 void PointlightShadowPass::render( u32 current_frame_index, CommandBuffer* gpu_commands, RenderScene* render_scene ) {
 
     if ( !render_scene->pointlight_rendering ) {
@@ -2561,34 +2669,60 @@ void PointlightShadowPass::render( u32 current_frame_index, CommandBuffer* gpu_c
 
         u32 width = depth_texture_array->width;
         u32 height = depth_texture_array->height;
-        // Perform manual clear of active lights shadowmaps.
-        {
+
+        // Faces still valid from the previous frames keep their depth, only the others are cleared and rendered.
+        u32 light_faces[ k_num_lights ];
+        u32 rendered_faces = 0;
+        for ( u32 l = 0; l < render_scene->active_lights; ++l ) {
+            light_faces[ l ] = shadow_cache.consume_faces( l );
+            rendered_faces |= light_faces[ l ];
+        }
+
+        // Perform manual clear of the rendered faces.
+        if ( rendered_faces ) {
             util_add_image_barrier_ext( gpu, gpu_commands->vk_command_buffer, depth_texture_array, RESOURCE_STATE_COPY_DEST, 0, 1, 0, layer_count, true );
 
             // TODO: Clearing 256 cubemaps is incredibly slow, for the future try with point sprites at far with depth test always.
-            VkClearRect clear_rect;
-            clear_rect.baseArrayLayer = 0;
-            clear_rect.layerCount = layer_count;
-            clear_rect.rect.extent.width = width;
-            clear_rect.rect.extent.height = height;
-            clear_rect.rect.offset.x = 0;
-            clear_rect.rect.offset.y = 0;
-
             VkClearDepthStencilValue clear_depth_stencil_value;
             clear_depth_stencil_value.depth = 1.f;
 
-            VkImageSubresourceRange clear_range;
-            clear_range.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-            clear_range.baseArrayLayer = 0;
-            clear_range.baseMipLevel = 0;
-            clear_range.levelCount = 1;
-            clear_range.layerCount = layer_count;
-            vkCmdClearDepthStencilImage( gpu_commands->vk_command_buffer, depth_texture_array->vk_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_depth_stencil_value, 1, &clear_range );
+            // One range per run of consecutive rendered faces.
+            static const u32 k_max_clear_ranges = 64;
+            VkImageSubresourceRange clear_ranges[ k_max_clear_ranges ];
+            u32 clear_range_count = 0;
+
+            for ( u32 layer = 0; layer < layer_count; ) {
+                if ( ( ( light_faces[ layer / 6 ] >> ( layer % 6 ) ) & 1 ) == 0 ) {
+                    ++layer;
+                    continue;
+                }
+
+                const u32 first_layer = layer;
+                while ( layer < layer_count && ( ( light_faces[ layer / 6 ] >> ( layer % 6 ) ) & 1 ) ) {
+                    ++layer;
+                }
+
+                VkImageSubresourceRange& clear_range = clear_ranges[ clear_range_count++ ];
+                clear_range.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+                clear_range.baseArrayLayer = first_layer;
+                clear_range.baseMipLevel = 0;
+                clear_range.levelCount = 1;
+                clear_range.layerCount = layer - first_layer;
+
+                if ( clear_range_count == k_max_clear_ranges ) {
+                    vkCmdClearDepthStencilImage( gpu_commands->vk_command_buffer, depth_texture_array->vk_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_depth_stencil_value, clear_range_count, clear_ranges );
+                    clear_range_count = 0;
+                }
+            }
+
+            if ( clear_range_count ) {
+                vkCmdClearDepthStencilImage( gpu_commands->vk_command_buffer, depth_texture_array->vk_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_depth_stencil_value, clear_range_count, clear_ranges );
+            }
 
             util_add_image_barrier_ext( gpu, gpu_commands->vk_command_buffer, depth_texture_array, RESOURCE_STATE_DEPTH_WRITE, 0, 1, 0, layer_count, true );
-        }
 
-        depth_texture_array->state = RESOURCE_STATE_DEPTH_WRITE;
+            depth_texture_array->state = RESOURCE_STATE_DEPTH_WRITE;
+        }
 
         // Setup scissor and viewport
         Rect2DInt scissor{ 0, 0,( u16 )width, ( u16 )height };
@@ -2601,7 +2735,9 @@ void PointlightShadowPass::render( u32 current_frame_index, CommandBuffer* gpu_c
 
         gpu_commands->set_viewport( &viewport );
 
-        gpu_commands->bind_pass( cubemap_render_pass, cubemap_framebuffer, false );
+        if ( rendered_faces ) {
+            gpu_commands->bind_pass( cubemap_render_pass, cubemap_framebuffer, false );
+        }
 
         // Update view projection matrices and camera spheres.
         // NOTE: this operation can be slow on CPU if many lights are casting shadows, thus
@@ -2614,8 +2750,6 @@ void PointlightShadowPass::render( u32 current_frame_index, CommandBuffer* gpu_c
             mat4s* gpu_view_projections = ( mat4s* )gpu->map_buffer( view_projections_cb_map );
             vec4s* gpu_light_spheres = ( vec4s* )gpu->map_buffer( light_spheres_cb_map );
 
-            const mat4s left_handed_scale_matrix = glms_scale_make( { 1,1,-1 } );
-
             if ( gpu_view_projections && gpu_light_spheres ) {
 
                 for ( u32 l = 0; l < render_scene->active_lights; ++l ) {
@@ -2624,49 +2758,7 @@ void PointlightShadowPass::render( u32 current_frame_index, CommandBuffer* gpu_c
                     // Update camera spheres
                     gpu_light_spheres[ l ] = glms_vec4( light.world_position, light.radius );
 
-                    const mat4s projection = glms_perspective( glm_rad( 90.f ), 1.f, 0.01f, light.radius );
-
-                    // Positive X matrices
-                    mat4s view = glms_look( light.world_position, { -1,0,0 }, { 0,1,0 } );
-                    view = glms_mat4_mul( left_handed_scale_matrix, view );
-                    mat4s view_projection = glms_mat4_mul( projection, view );
-
-                    gpu_view_projections[ l * 6 + 0 ] = view_projection;
-
-                    // Negative X
-                    view = glms_look( light.world_position, { 1,0,0 }, { 0,1,0 } );
-                    view = glms_mat4_mul( left_handed_scale_matrix, view );
-                    view_projection = glms_mat4_mul( projection, view );
-
-                    gpu_view_projections[ l * 6 + 1 ] = view_projection;
-
-                    // Positive Y
-                    view = glms_look( light.world_position, { 0,-1,0 }, { 0,0,-1 } );
-                    view = glms_mat4_mul( left_handed_scale_matrix, view );
-                    view_projection = glms_mat4_mul( projection, view );
-
-                    gpu_view_projections[ l * 6 + 2 ] = view_projection;
-
-                    // Negative Y
-                    view = glms_look( light.world_position, { 0,1,0 }, { 0,0,1 } );
-                    view = glms_mat4_mul( left_handed_scale_matrix, view );
-                    view_projection = glms_mat4_mul( projection, view );
-
-                    gpu_view_projections[ l * 6 + 3 ] = view_projection;
-
-                    // Positive Z
-                    view = glms_look( light.world_position, { 0,0,-1 }, { 0,1,0 } );
-                    view = glms_mat4_mul( left_handed_scale_matrix, view );
-                    view_projection = glms_mat4_mul( projection, view );
-
-                    gpu_view_projections[ l * 6 + 4 ] = view_projection;
-
-                    // Negative Z
-                    view = glms_look( light.world_position, { 0,0,1 }, { 0,1,0 } );
-                    view = glms_mat4_mul( left_handed_scale_matrix, view );
-                    view_projection = glms_mat4_mul( projection, view );
-
-                    gpu_view_projections[ l * 6 + 5 ] = view_projection;
+                    calculate_cubemap_view_projections( light, &gpu_view_projections[ l * 6 ] );
                 }
 
                 gpu->unmap_buffer( view_projections_cb_map );
@@ -2688,17 +2780,31 @@ void PointlightShadowPass::render( u32 current_frame_index, CommandBuffer* gpu_c
             gpu_commands->bind_descriptor_set( handles, 2, nullptr, 0 );
 
             // Draw each light individually
-            for ( u32 l = 0; l < render_scene->active_lights; ++l ) {
+            for ( u32 l = 0; l < render_scene->active_lights && rendered_faces; ++l ) {
                 const Light& light = render_scene->lights[ l ];
 
                 //rprint( "Shadow resolution %u, light %u\n", shadow_resolution_read[ l ], l );
 
                 gpu_commands->set_viewport( &viewport );
 
-                const u32 argument_offset = sizeof( f32 ) * 4 * 6 * l;
-                u32 draw_offset = l * 6;
-                gpu_commands->push_constants( cubemap_meshlets_pipeline, 0, 16, &draw_offset );
-                gpu_commands->draw_mesh_task_indirect( meshlet_shadow_indirect_cb[ current_frame_index ], argument_offset, 6, sizeof( vec4s ) );
+                // One draw per run of consecutive faces, the commands of the faces of a light are consecutive.
+                const u32 faces = light_faces[ l ];
+                for ( u32 face = 0; face < 6; ) {
+                    if ( ( ( faces >> face ) & 1 ) == 0 ) {
+                        ++face;
+                        continue;
+                    }
+
+                    const u32 first_face = face;
+                    while ( face < 6 && ( ( faces >> face ) & 1 ) ) {
+                        ++face;
+                    }
+
+                    const u32 argument_offset = sizeof( f32 ) * 4 * ( 6 * l + first_face );
+                    u32 draw_offset = l * 6 + first_face;
+                    gpu_commands->push_constants( cubemap_meshlets_pipeline, 0, 16, &draw_offset );
+                    gpu_commands->draw_mesh_task_indirect( meshlet_shadow_indirect_cb[ current_frame_index ], argument_offset, face - first_face, sizeof( vec4s ) );
+                }
             }
         } else {
             // Support for non-meshlet pointlights needed ?
@@ -2706,7 +2812,9 @@ void PointlightShadowPass::render( u32 current_frame_index, CommandBuffer* gpu_c
 
         gpu->unmap_buffer( shadow_resolution_map );
 
-        gpu_commands->end_current_render_pass();
+        if ( rendered_faces ) {
+            gpu_commands->end_current_render_pass();
+        }
 
         // Copy debug texture
         // TODO: subresource state complains a lot.
@@ -2717,6 +2825,36 @@ void PointlightShadowPass::render( u32 current_frame_index, CommandBuffer* gpu_c
     }
 }
 
+static const u32            k_pointlight_shadow_pool_size   = rgiga( 1 );   // Texels, the pool only grows back up to it.
+
+// Shrinks the page pool down to the pages of the active lights, the pool is recreated on the next render.
+static u64 pointlight_shadow_pool_evict( void* context, GpuMemoryCategory::Enum category, u64 bytes ) {
+    PointlightShadowPass* pass = ( PointlightShadowPass* )context;
+
+    // The pool is recreated together with the light resources, only once they exist.
+    if ( pass->shadow_maps_pool.index == k_invalid_index || pass->last_active_lights == 0 || pass->shadow_face_blocks == 0 ) {
+        return 0;
+    }
+
+    // Pool sizes are in texels, memory is allocated in blocks of the sparse format.
+    const PagePool* page_pool = pass->renderer->gpu->access_page_pool( pass->shadow_maps_pool );
+    const u32 block_texels = page_pool->block_width * page_pool->block_height;
+    const u32 pool_blocks = pass->shadow_maps_pool_size / block_texels;
+    // bind_texture_pages keeps one block free.
+    const u32 required_blocks = pass->last_active_lights * 6 * pass->shadow_face_blocks + 1;
+    if ( pool_blocks <= required_blocks ) {
+        return 0;
+    }
+
+    const u64 requested_blocks = ( bytes + page_pool->block_size - 1 ) / page_pool->block_size;
+    const u32 freed_blocks = ( u32 )raptor::min<u64>( requested_blocks, pool_blocks - required_blocks );
+
+    pass->shadow_maps_pool_size = ( pool_blocks - freed_blocks ) * block_texels;
+    pass->shadow_maps_pool_resize = true;
+
+    return ( u64 )freed_blocks * page_pool->block_size;
+}
+
 void PointlightShadowPass::prepare_draws( RenderScene& scene, FrameGraph* frame_graph,
                                           Allocator* resident_allocator, StackAllocator* scratch_allocator ) {
     renderer = scene.renderer;
@@ -2734,12 +2872,17 @@ void PointlightShadowPass::prepare_draws( RenderScene& scene, FrameGraph* frame_
 
     GpuDevice& gpu = *renderer->gpu;
 
+    shadow_cache.init( resident_allocator, k_num_lights, scene.mesh_instances.size );
+
     recreate_lightcount_dependent_resources( scene );
 
+    gpu.memory_budget.register_evictor( GpuMemoryCategory::PagePools, pointlight_shadow_pool_evict, this, 0 );
+
     // Create render pass
     RenderPassCreation render_pass_creation;
+    // Faces are cleared manually, load the depth to keep the cached faces.
     render_pass_creation.reset().set_name( node->name ).set_depth_stencil_texture( VK_FORMAT_D16_UNORM, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL )
-        .set_depth_stencil_operations( RenderPassOperation::DontCare, RenderPassOperation::DontCare );
+        .set_depth_stencil_operations( RenderPassOperation::Load, RenderPassOperation::DontCare );
 
     cubemap_render_pass = gpu.create_render_pass( render_pass_creation );
 
@@ -2884,13 +3027,55 @@ void PointlightShadowPass::prepare_draws( RenderScene& scene, FrameGraph* frame_
 }
 
 void PointlightShadowPass::upload_gpu_data( RenderScene& scene ) {
+    if ( !enabled )
+        return;
+
+    shadow_cache.begin_frame( scene.active_lights );
+
+    // Tetrahedron shadows and disabled frames do not keep the cubemaps updated.
+    if ( !scene.pointlight_shadow_caching || !scene.pointlight_rendering || scene.use_tetrahedron_shadows ) {
+        shadow_cache.invalidate_all();
+    }
+
+    for ( u32 l = 0; l < scene.active_lights; ++l ) {
+        const Light& light = scene.lights[ l ];
+
+        if ( shadow_cache.update_light( l, light.world_position, light.radius ) ) {
+            mat4s face_view_projections[ k_shadow_cache_faces ];
+            calculate_cubemap_view_projections( light, face_view_projections );
+
+            shadow_cache.set_light_faces( l, face_view_projections );
+        }
+    }
+
+    // Same bounds as the meshlet culling against the lights.
+    const mat4s scale_matrix = glms_scale_make( { scene.global_scale, scene.global_scale, -scene.global_scale } );
+
+    for ( u32 i = 0; i < scene.mesh_instances.size; ++i ) {
+        MeshInstance& mesh_instance = scene.mesh_instances[ i ];
+        Mesh& mesh = *mesh_instance.mesh;
+        if ( mesh.is_transparent() ) {
+            continue;
+        }
+
+        const mat4s world = scene.scene_graph ? glms_mat4_mul( scale_matrix, scene.scene_graph->world_matrices[ mesh_instance.scene_graph_node_index ] ) : glms_mat4_identity();
+        const vec4s center = glms_mat4_mulv( world, vec4s{ mesh.bounding_sphere.x, mesh.bounding_sphere.y, mesh.bounding_sphere.z, 1.0f } );
+        const f32 radius = mesh.bounding_sphere.w * glms_vec3_norm( glms_vec3( world.col[ 0 ] ) ) * 1.1f;
+
+        // Skinned and simulated meshes change without moving.
+        const bool dynamic = mesh.has_skinning() || mesh.physics_mesh != nullptr;
+        shadow_cache.update_caster( i, vec4s{ center.x, center.y, center.z, radius }, dynamic );
+    }
 }
 
 void PointlightShadowPass::free_gpu_resources( GpuDevice& gpu ) {
     if ( !enabled )
         return;
 
+    gpu.memory_budget.unregister_evictor( pointlight_shadow_pool_evict, this );
+
     mesh_instance_draws.shutdown();
+    shadow_cache.shutdown();
 
     for ( u32 i = 0; i < k_max_frames; ++i ) {
         gpu.destroy_buffer( pointlight_view_projections_cb[ i ] );
@@ -2926,7 +3111,7 @@ void PointlightShadowPass::recreate_lightcount_dependent_resources( RenderScene&
 
     const u32 active_lights = scene.active_lights;
 
-    if ( active_lights == last_active_lights ) {
+    if ( active_lights == last_active_lights && !shadow_maps_pool_resize ) {
         return;
     }
 
@@ -2943,6 +3128,9 @@ void PointlightShadowPass::recreate_lightcount_dependent_resources( RenderScene&
 
     last_active_lights = active_lights;
 
+    // New textures have no cached faces.
+    shadow_cache.invalidate_all();
+
     // Create new resources
     // Create cube depth array texture
     raptor::TextureCreation texture_creation;
@@ -2967,8 +3155,36 @@ void PointlightShadowPass::recreate_lightcount_dependent_resources( RenderScene&
         .set_flags( TextureFlags::RenderTarget_mask | TextureFlags::Sparse_mask ).set_name( "depth_cubemap_array" );
     cubemap_shadow_array_texture = gpu.create_texture( texture_creation );
 
+    // Grow back when the pool was shrunk below the pages of the new lights, plus the block bind_texture_pages keeps free.
+    if ( shadow_maps_pool.index != k_invalid_index ) {
+        const PagePool* page_pool = gpu.access_page_pool( shadow_maps_pool );
+        const u32 block_texels = page_pool->block_width * page_pool->block_height;
+        const u32 required_pool_size = ( active_lights * 6 * shadow_face_blocks + 1 ) * block_texels;
+
+        if ( required_pool_size > shadow_maps_pool_size ) {
+            // Doubling, so that growing back does not undo the eviction at once, and only what is needed near the limit.
+            u32 new_pool_size = raptor::max( required_pool_size, raptor::min( shadow_maps_pool_size * 2, k_pointlight_shadow_pool_size ) );
+            const u64 growth_bytes = ( u64 )( ( new_pool_size - shadow_maps_pool_size ) / block_texels ) * page_pool->block_size;
+            if ( !gpu.memory_budget.can_allocate( GpuMemoryCategory::PagePools, growth_bytes ) ) {
+                new_pool_size = required_pool_size;
+            }
+
+            shadow_maps_pool_size = new_pool_size;
+            shadow_maps_pool_resize = true;
+        }
+    }
+
+    if ( shadow_maps_pool_resize && shadow_maps_pool.index != k_invalid_index ) {
+        gpu.destroy_page_pool( shadow_maps_pool );
+        shadow_maps_pool = k_invalid_page_pool;
+    }
+    shadow_maps_pool_resize = false;
+
     if ( shadow_maps_pool.index == k_invalid_index ) {
-        shadow_maps_pool = gpu.allocate_texture_pool( cubemap_shadow_array_texture, rgiga( 1 ) );
+        shadow_maps_pool = gpu.allocate_texture_pool( cubemap_shadow_array_texture, shadow_maps_pool_size );
+
+        const PagePool* page_pool = gpu.access_page_pool( shadow_maps_pool );
+        shadow_face_blocks = ( layer_width / page_pool->block_width ) * ( layer_height / page_pool->block_height );
     }
 
     gpu.reset_pool( shadow_maps_pool );
@@ -3113,6 +3329,9 @@ void VolumetricFogPass::prepare_draws( RenderScene& scene, FrameGraph* frame_gra
 
     renderer = scene.renderer;
 
+    froxel_light_assigner.init( resident_allocator, k_num_lights );
+    froxel_light_spheres.init( resident_allocator, k_num_lights );
+
     FrameGraphNode* node = frame_graph->get_node( "volumetric_fog_pass" );
     if ( node == nullptr ) {
         enabled = false;
@@ -3274,6 +3493,26 @@ void VolumetricFogPass::upload_gpu_data( RenderScene& scene ) {
         gpu.unmap_buffer( cb_map );
     }
 
+    if ( scene.volumetric_fog_cpu_light_assignment ) {
+        // Froxels are sampled away from their center by the temporal jittering and by the depth noise.
+        const f32 halton = raptor::max( fabsf( scene.scene_data.halton_x ), fabsf( scene.scene_data.halton_y ) );
+        froxel_light_assigner.set_grid( scene.volumetric_fog_tile_count_x, scene.volumetric_fog_tile_count_y, scene.volumetric_fog_slices,
+                                        scene.scene_data.z_near, scene.scene_data.z_far, scene.scene_data.projection_00, scene.scene_data.projection_11,
+                                        halton * scene.volumetric_fog_temporal_reprojection_jittering_scale, scene.volumetric_fog_noise_scale );
+
+        froxel_light_spheres.set_size( scene.active_lights );
+        for ( u32 i = 0; i < scene.active_lights; ++i ) {
+            const Light& light = scene.lights[ i ];
+            froxel_light_spheres[ i ] = glms_vec4( light.world_position, light.radius );
+        }
+
+        const vec3s box_half_size = glms_vec3_abs( glms_vec3_scale( scene.volumetric_fog_box_size, 0.5f ) );
+        FroxelVolume fog_box;
+        fog_box.aabb_min = glms_vec3_sub( scene.volumetric_fog_box_position, box_half_size );
+        fog_box.aabb_max = glms_vec3_add( scene.volumetric_fog_box_position, box_half_size );
+
+        froxel_light_assigner.assign( scene.scene_data.world_to_camera, froxel_light_spheres.data, scene.active_lights, &fog_box, 1, scene.task_scheduler );
+    }
 }
 
 void VolumetricFogPass::free_gpu_resources( GpuDevice& gpu ) {
@@ -3292,6 +3531,9 @@ void VolumetricFogPass::free_gpu_resources( GpuDevice& gpu ) {
 
     gpu.destroy_descriptor_set( fog_descriptor_set );
     gpu.destroy_buffer( fog_constants );
+
+    froxel_light_assigner.shutdown();
+    froxel_light_spheres.shutdown();
 }
 
 void VolumetricFogPass::update_dependent_resources( GpuDevice& gpu, FrameGraph* frame_graph, RenderScene* render_scene ) {
@@ -3594,11 +3836,6 @@ void IndirectPass::render( u32 current_frame_index, CommandBuffer* gpu_commands,
     if ( !enabled )
         return;
 
-    static i32 offsets_calculations_count = 24;
-    if ( render_scene->gi_recalculate_offsets ) {
-        offsets_calculations_count = 24;
-    }
-
     // Probe raytrace
     gpu_commands->push_marker( "RT" );
     gpu_commands->issue_texture_barrier( probe_raytrace_radiance_texture, RESOURCE_STATE_UNORDERED_ACCESS, 0, 1 );
@@ -3724,6 +3961,12 @@ void IndirectPass::prepare_draws( RenderScene& scene, FrameGraph* frame_graph, A
     // Cache status buffer
     scene.ddgi_probe_status_cache = ddgi_probe_status_buffer;
 
+    buffer_creation.set( VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, ResourceUsageType::Dynamic, sizeof( u32 ) * num_probes ).set_name( "ddgi_probe_update_list" );
+    ddgi_probe_update_list_buffer = gpu.create_buffer( buffer_creation );
+
+    probe_scheduler.init( resident_allocator, probe_count_x, probe_count_y, probe_count_z );
+    probe_scheduler_lights.init( resident_allocator, k_num_lights );
+
     half_resolution_output = scene.gi_use_half_resolution;
 
     // Create external texture used as pass output.
@@ -3785,7 +4028,7 @@ void IndirectPass::prepare_draws( RenderScene& scene, FrameGraph* frame_graph, A
         DescriptorSetLayoutHandle layout = gpu.get_descriptor_set_layout( probe_raytrace_pipeline, k_material_descriptor_set_index );
         DescriptorSetCreation ds_creation{};
         ds_creation.reset().set_layout( layout ).set_as( scene.tlas, 26 ).buffer( ddgi_constants_buffer, 55 )
-                   .buffer( scene.lights_list_sb, 27).buffer( ddgi_probe_status_buffer, 43 );
+                   .buffer( scene.lights_list_sb, 27).buffer( ddgi_probe_status_buffer, 43 ).buffer( ddgi_probe_update_list_buffer, 44 );
         scene.add_scene_descriptors( ds_creation, pass );
         scene.add_mesh_descriptors( ds_creation, pass );
 
@@ -3841,6 +4084,45 @@ void IndirectPass::upload_gpu_data( RenderScene& scene ) {
 
     GpuDevice& gpu = *renderer->gpu;
 
+    if ( scene.gi_recalculate_offsets ) {
+        offsets_calculations_count = 24;
+    }
+
+    // While offsets are calculated all the probes are traced, so the update list is not used.
+    const bool use_probe_update_list = scene.gi_use_probe_scheduler && offsets_calculations_count < 0;
+    if ( use_probe_update_list ) {
+        probe_scheduler.set_grid( scene.gi_probe_grid_position, scene.gi_probe_spacing, scene.gi_max_probe_offset, scene.gi_self_shadow_bias );
+
+        // Irradiance is not read back, so probes around lights that changed are marked as changed too.
+        const u32 active_lights = raptor::min( scene.active_lights, scene.lights.size );
+        for ( u32 i = 0; i < active_lights; ++i ) {
+            const Light& light = scene.lights[ i ];
+            if ( i < probe_scheduler_lights.size ) {
+                const Light& last_light = probe_scheduler_lights[ i ];
+                if ( glms_vec3_eqv( light.world_position, last_light.world_position ) && light.radius == last_light.radius &&
+                     glms_vec3_eqv( light.color, last_light.color ) && light.intensity == last_light.intensity ) {
+                    continue;
+                }
+                probe_scheduler.invalidate_sphere( glms_vec4( last_light.world_position, last_light.radius ) );
+            }
+            probe_scheduler.invalidate_sphere( glms_vec4( light.world_position, light.radius ) );
+        }
+        probe_scheduler_lights.set_size( active_lights );
+        memcpy( probe_scheduler_lights.data, scene.lights.data, sizeof( Light ) * active_lights );
+
+        probe_scheduler.schedule( glms_vec3( scene.scene_data.camera_position ), scene.gi_probe_ray_budget, probe_rays );
+
+        MapBufferParameters list_map = { ddgi_probe_update_list_buffer, 0, 0 };
+        u32* gpu_update_list = ( u32* )gpu.map_buffer( list_map );
+        if ( gpu_update_list ) {
+            memcpy( gpu_update_list, probe_scheduler.update_list.data, sizeof( u32 ) * probe_scheduler.update_list.size );
+
+            gpu.unmap_buffer( list_map );
+        }
+
+        per_frame_probe_updates = probe_scheduler.update_list.size;
+    }
+
     MapBufferParameters cb_map = { ddgi_constants_buffer, 0, 0 };
     GpuDDGIConstants* gpu_constants = ( GpuDDGIConstants* )gpu.map_buffer( cb_map );
     if ( gpu_constants ) {
@@ -3877,7 +4159,8 @@ void IndirectPass::upload_gpu_data( RenderScene& scene ) {
                                      | ( ( scene.gi_use_backface_blending ? 1 : 0 ) << 6 )
                                      | ( ( scene.gi_use_probe_offsetting ? 1 : 0 ) << 7 )
                                      | ( ( scene.gi_use_probe_status ? 1 : 0 ) << 8 )
-                                     | ( ( scene.gi_use_infinite_bounces ? 1 : 0 ) << 9 );
+                                     | ( ( scene.gi_use_infinite_bounces ? 1 : 0 ) << 9 )
+                                     | ( ( use_probe_update_list ? 1 : 0 ) << 10 );
 
         gpu_constants->irradiance_texture_width = irradiance_atlas_width;
         gpu_constants->irradiance_texture_height = irradiance_atlas_height;
@@ -3896,9 +4179,11 @@ void IndirectPass::upload_gpu_data( RenderScene& scene ) {
 
         gpu.unmap_buffer( cb_map );
 
-        const u32 num_probes = probe_count_x * probe_count_y * probe_count_z;
-        probe_update_offset = ( probe_update_offset + per_frame_probe_updates ) % num_probes;
-        per_frame_probe_updates = scene.gi_per_frame_probes_update;
+        if ( !use_probe_update_list ) {
+            const u32 num_probes = probe_count_x * probe_count_y * probe_count_z;
+            probe_update_offset = ( probe_update_offset + per_frame_probe_updates ) % num_probes;
+            per_frame_probe_updates = scene.gi_per_frame_probes_update;
+        }
     }
 }
 
@@ -3906,6 +4191,7 @@ void IndirectPass::free_gpu_resources( GpuDevice& gpu ) {
 
     gpu.destroy_buffer( ddgi_constants_buffer );
     gpu.destroy_buffer( ddgi_probe_status_buffer );
+    gpu.destroy_buffer( ddgi_probe_update_list_buffer );
     gpu.destroy_descriptor_set( probe_raytrace_descriptor_set );
     gpu.destroy_texture( probe_raytrace_radiance_texture );
     gpu.destroy_descriptor_set( probe_grid_update_descriptor_set );
@@ -3914,6 +4200,9 @@ void IndirectPass::free_gpu_resources( GpuDevice& gpu ) {
     gpu.destroy_texture( probe_offsets_texture );
     gpu.destroy_descriptor_set( sample_irradiance_descriptor_set );
     gpu.destroy_texture( indirect_texture );
+
+    probe_scheduler.shutdown();
+    probe_scheduler_lights.shutdown();
 }
 
 void IndirectPass::update_dependent_resources( GpuDevice& gpu, FrameGraph* frame_graph, RenderScene* render_scene ) {
@@ -3951,10 +4240,10 @@ void ReflectionsPass::render( u32 current_frame_index, CommandBuffer* gpu_comman
     gpu_commands->bind_pipeline( reflections_pipeline );
     gpu_commands->bind_descriptor_set( &reflections_descriptor_set, 1, nullptr, 0 );
 
-    f32 push_constants[] = { 1.f / texture_scale, 1.f };
+    f32 push_constants[] = { 1.f / dynamic_scale, 1.f };
     gpu_commands->push_constants( reflections_pipeline, 0, 8, &push_constants );
 
-    gpu_commands->trace_rays( reflections_pipeline, ceilu32(renderer->width * texture_scale ), ceilu32(renderer->height * texture_scale ), 1 );
+    gpu_commands->trace_rays( reflections_pipeline, ceilu32(renderer->width * dynamic_scale ), ceilu32(renderer->height * dynamic_scale ), 1 );
 }
 
 void ReflectionsPass::on_resize( GpuDevice& gpu, FrameGraph* frame_graph, u32 new_width, u32 new_height ) {
@@ -4050,6 +4339,9 @@ void ReflectionsPass::upload_gpu_data( RenderScene& scene ) {
     if ( !enabled )
         return;
 
+    // Textures are allocated at texture_scale, smaller scales render in their top left corner.
+    dynamic_scale = raptor::min( scene.rt_reflections_dynamic_scale, texture_scale );
+
     GpuDevice& gpu = *renderer->gpu;
 
     MapBufferParameters cb_map = { reflections_constants_buffer, 0, 0 };
@@ -4168,7 +4460,7 @@ void SVGFAccumulationPass::render( u32 current_frame_index, CommandBuffer* gpu_c
     gpu_commands->bind_pipeline( pipeline );
     gpu_commands->bind_descriptor_set( &descriptor_set, 1, nullptr, 0 );
 
-    gpu_commands->dispatch( raptor::ceilu32( renderer->width * texture_scale / 8.0f ), raptor::ceilu32( renderer->height * texture_scale / 8.0f ), 1 );
+    gpu_commands->dispatch( raptor::ceilu32( renderer->width * dynamic_scale / 8.0f ), raptor::ceilu32( renderer->height * dynamic_scale / 8.0f ), 1 );
 }
 
 void SVGFAccumulationPass::on_resize( GpuDevice& gpu, FrameGraph* frame_graph, u32 new_width, u32 new_height ) {
@@ -4289,6 +4581,11 @@ void SVGFAccumulationPass::upload_gpu_data( RenderScene& scene ) {
         return;
     }
 
+    // History textures were written at the previous scale, discard them when it changes.
+    const f32 new_scale = raptor::min( scene.rt_reflections_dynamic_scale, texture_scale );
+    const bool scale_changed = new_scale != dynamic_scale;
+    dynamic_scale = new_scale;
+
     GpuDevice& gpu = *renderer->gpu;
 
     MapBufferParameters cb_map = { gpu_constants, 0, 0 };
@@ -4313,9 +4610,9 @@ void SVGFAccumulationPass::upload_gpu_data( RenderScene& scene ) {
         gpu_constants->filtered_color_texture_index = 0;
         gpu_constants->updated_variance_texture_index = 0;
 
-        gpu_constants->resolution_scale = texture_scale;
-        gpu_constants->resolution_scale_rcp = 1.0f / texture_scale;
-        gpu_constants->temporal_depth_difference = scene.rt_temporal_depth_difference;
+        gpu_constants->resolution_scale = dynamic_scale;
+        gpu_constants->resolution_scale_rcp = 1.0f / dynamic_scale;
+        gpu_constants->temporal_depth_difference = scale_changed ? -1.f : scene.rt_temporal_depth_difference;
         gpu_constants->temporal_normal_difference = scene.rt_temporal_normal_difference;
 
         gpu.unmap_buffer( cb_map );
@@ -4378,9 +4675,9 @@ void SVGFVariancePass::render( u32 current_frame_index, CommandBuffer* gpu_comma
     gpu_commands->bind_pipeline( pipeline );
     gpu_commands->bind_descriptor_set( &descriptor_set, 1, nullptr, 0 );
 
-    gpu_commands->dispatch( raptor::ceilu32( renderer->width * texture_scale / 8.0f ), raptor::ceilu32( renderer->height * texture_scale / 8.0f ), 1 );
+    gpu_commands->dispatch( raptor::ceilu32( renderer->width * dynamic_scale / 8.0f ), raptor::ceilu32( renderer->height * dynamic_scale / 8.0f ), 1 );
 
-    if ( texture_scale < 1.f ) {
+    if ( dynamic_scale < 1.f ) {
 
         gpu_commands->issue_texture_barrier( last_frame_normals_texture, RESOURCE_STATE_UNORDERED_ACCESS, 0, 1 );
         gpu_commands->issue_texture_barrier( last_frame_mesh_id_texture, RESOURCE_STATE_UNORDERED_ACCESS, 0, 1 );
@@ -4390,7 +4687,7 @@ void SVGFVariancePass::render( u32 current_frame_index, CommandBuffer* gpu_comma
         gpu_commands->bind_pipeline( downsample_pipeline );
         gpu_commands->bind_descriptor_set( &downsample_descriptor_set, 1, nullptr, 0 );
 
-        gpu_commands->dispatch( raptor::ceilu32( renderer->width * texture_scale / 8.0f ), raptor::ceilu32( renderer->height * texture_scale / 8.0f ), 1 );
+        gpu_commands->dispatch( raptor::ceilu32( renderer->width * dynamic_scale / 8.0f ), raptor::ceilu32( renderer->height * dynamic_scale / 8.0f ), 1 );
 
         gpu_commands->issue_texture_barrier( last_frame_normals_texture, RESOURCE_STATE_SHADER_RESOURCE, 0, 1 );
         gpu_commands->issue_texture_barrier( last_frame_mesh_id_texture, RESOURCE_STATE_SHADER_RESOURCE, 0, 1 );
@@ -4514,6 +4811,8 @@ void SVGFVariancePass::upload_gpu_data( RenderScene& scene ) {
         return;
     }
 
+    dynamic_scale = raptor::min( scene.rt_reflections_dynamic_scale, texture_scale );
+
     GpuDevice& gpu = *renderer->gpu;
 
     MapBufferParameters cb_map = { gpu_constants, 0, 0 };
@@ -4538,8 +4837,8 @@ void SVGFVariancePass::upload_gpu_data( RenderScene& scene ) {
         gpu_constants->filtered_color_texture_index = 0;
         gpu_constants->updated_variance_texture_index = 0;
 
-        gpu_constants->resolution_scale = texture_scale;
-        gpu_constants->resolution_scale_rcp = 1.0f / texture_scale;
+        gpu_constants->resolution_scale = dynamic_scale;
+        gpu_constants->resolution_scale_rcp = 1.0f / dynamic_scale;
         gpu_constants->temporal_depth_difference = scene.rt_temporal_depth_difference;
         gpu_constants->temporal_normal_difference = scene.rt_temporal_normal_difference;
 
@@ -4639,7 +4938,7 @@ void SVGFWaveletPass::render( u32 current_frame_index, CommandBuffer* gpu_comman
         push_constants.step_size = 1 << i;
 
         gpu_commands->push_constants( pipeline, 0, sizeof( SVGFPushConstants ), &push_constants );
-        gpu_commands->dispatch( raptor::ceilu32( renderer->width * texture_scale / 8.0f ), raptor::ceilu32( renderer->height * texture_scale / 8.0f ), 1 );
+        gpu_commands->dispatch( raptor::ceilu32( renderer->width * dynamic_scale / 8.0f ), raptor::ceilu32( renderer->height * dynamic_scale / 8.0f ), 1 );
 
         if ( i == 0 ) {
             gpu_commands->copy_texture( ping_pong_color_texture, reflections_history_texture, ResourceState::RESOURCE_STATE_GENERIC_READ );
@@ -4767,6 +5066,8 @@ void SVGFWaveletPass::upload_gpu_data( RenderScene& scene ) {
         return;
     }
 
+    dynamic_scale = raptor::min( scene.rt_reflections_dynamic_scale, texture_scale );
+
     GpuDevice& gpu = *renderer->gpu;
 
     for ( u32 i = 0; i < k_num_passes; ++i ) {
@@ -4792,8 +5093,8 @@ void SVGFWaveletPass::upload_gpu_data( RenderScene& scene ) {
             gpu_constants->filtered_color_texture_index = ( i % 2 == 1 ) ? integrated_color_texture.index : ping_pong_color_texture.index;
             gpu_constants->updated_variance_texture_index = ( i % 2 == 1 ) ? variance_texture.index : ping_pong_variance_texture.index;
 
-            gpu_constants->resolution_scale = texture_scale;
-            gpu_constants->resolution_scale_rcp = 1.0f / texture_scale;
+            gpu_constants->resolution_scale = dynamic_scale;
+            gpu_constants->resolution_scale_rcp = 1.0f / dynamic_scale;
             gpu_constants->temporal_depth_difference = scene.rt_temporal_depth_difference;
             gpu_constants->temporal_normal_difference = scene.rt_temporal_normal_difference;
 
@@ -4852,132 +5153,42 @@ void SVGFWaveletPass::update_dependent_resources( GpuDevice& gpu, FrameGraph* fr
 CommandBuffer* RenderScene::update_physics( f32 delta_time, f32 air_density, f32 spring_stiffness, f32 spring_damping, vec3s wind_direction, bool reset_simulation ) {
     // Based on http://graphics.stanford.edu/courses/cs468-02-winter/Papers/Rigidcloth.pdf
 
-#if 0
-    // NOTE(marco): left for reference
-    const u32 sim_steps = 10;
-    const f32 dt_multiplier = 1.0f / sim_steps;
-    delta_time *= dt_multiplier;
-
-    const vec3s g{ 0.0f, -9.8f, 0.0f };
+    // The CPU solver replaced the reference code: it runs the same simulation as cloth.glsl from the same data,
+    // the results are kept in the physics vertices while the compute pass keeps updating the mesh buffers.
+    if ( cloth_use_cpu_solver ) {
+        PhysicsSceneData cpu_physics_data{ };
+        cpu_physics_data.wind_direction = wind_direction;
+        cpu_physics_data.reset_simulation = reset_simulation ? 1 : 0;
+        cpu_physics_data.air_density = air_density;
+        cpu_physics_data.spring_stiffness = spring_stiffness;
+        cpu_physics_data.spring_damping = spring_damping;
 
-    for ( u32 m = 0; m < meshes.size; ++m ) {
-        Mesh& mesh = meshes[ m ];
+        for ( u32 m = 0; m < meshes.size; ++m ) {
+            PhysicsMesh* physics_mesh = meshes[ m ].physics_mesh;
 
-        PhysicsMesh* physics_mesh = mesh.physics_mesh;
-
-        if ( physics_mesh != nullptr ) {
-            const vec3s fixed_vertex_1{ 0.0f,  1.0f, -1.0f };
-            const vec3s fixed_vertex_2{ 0.0f,  1.0f,  1.0f };
-            const vec3s fixed_vertex_3{ 0.0f, -1.0f,  1.0f };
-            const vec3s fixed_vertex_4{ 0.0f, -1.0f, -1.0f };
-
-            if ( reset_simulation ) {
-                for ( u32 v = 0; v < physics_mesh->vertices.size; ++v ) {
-                    PhysicsVertex& vertex = physics_mesh->vertices[ v ];
-                    vertex.position = vertex.start_position;
-                    vertex.previous_position = vertex.start_position;
-                    vertex.velocity = vec3s{ };
-                    vertex.force = vec3s{ };
-                }
-            }
-
-            for ( u32 s = 0; s < sim_steps; ++s ) {
-                // First calculate the force to apply to each vertex
-                for ( u32 v = 0; v < physics_mesh->vertices.size; ++v ) {
-                    PhysicsVertex& vertex = physics_mesh->vertices[ v ];
-
-                    if ( glms_vec3_eqv( vertex.start_position, fixed_vertex_1 ) || glms_vec3_eqv( vertex.start_position, fixed_vertex_2 ) ||
-                        glms_vec3_eqv( vertex.start_position, fixed_vertex_3 ) || glms_vec3_eqv( vertex.start_position, fixed_vertex_4 )) {
-                        continue;
-                    }
-
-                    f32 m = vertex.mass;
-
-                    vec3s spring_force{ };
-
-                    for ( u32 j = 0; j < vertex.joint_count; ++j ) {
-                        PhysicsVertex& other_vertex = physics_mesh->vertices[ vertex.joints[ j ].vertex_index ];
-
-                        f32 spring_rest_length =  glms_vec3_distance( vertex.start_position, other_vertex.start_position );
-
-                        vec3s pull_direction = glms_vec3_sub( vertex.position, other_vertex.position );
-                        vec3s relative_pull_direction = glms_vec3_sub( pull_direction, glms_vec3_scale( glms_vec3_normalize( pull_direction ), spring_rest_length ) );
-                        pull_direction = glms_vec3_scale( relative_pull_direction, spring_stiffness );
-                        spring_force = glms_vec3_add( spring_force, pull_direction );
-                    }
-
-                    vec3s viscous_damping = glms_vec3_scale( vertex.velocity, -spring_damping );
-
-                    vec3s viscous_velocity = glms_vec3_sub( wind_direction, vertex.velocity );
-                    viscous_velocity = glms_vec3_scale( vertex.normal, glms_vec3_dot( vertex.normal, viscous_velocity ) );
-                    viscous_velocity = glms_vec3_scale( viscous_velocity, air_density );
-
-                    vertex.force = glms_vec3_scale( g, m );
-                    vertex.force = glms_vec3_sub( vertex.force, spring_force );
-                    vertex.force = glms_vec3_add( vertex.force, viscous_damping );
-                    vertex.force = glms_vec3_add( vertex.force, viscous_velocity );
-                }
-
-                // Then update their position
-                for ( u32 v = 0; v < physics_mesh->vertices.size; ++v ) {
-                    PhysicsVertex& vertex = physics_mesh->vertices[ v ];
-
-                    vec3s previous_position = vertex.previous_position;
-                    vec3s current_position = vertex.position;
-
-                    // Verlet integration
-                    vertex.position = glms_vec3_scale( current_position, 2.0f );
-                    vertex.position = glms_vec3_sub( vertex.position, previous_position );
-                    vertex.position = glms_vec3_add( vertex.position, glms_vec3_scale( vertex.force, delta_time * delta_time ) );
-
-                    vertex.previous_position = current_position;
-
-                    vertex.velocity = glms_vec3_sub( vertex.position, current_position );
-                }
+            if ( physics_mesh == nullptr ) {
+                continue;
             }
 
-            Buffer* position_buffer = renderer->gpu->access_buffer( mesh.position_buffer );
-            vec3s* positions = ( vec3s* )( position_buffer->mapped_data + mesh.position_offset );
-
-            Buffer* normal_buffer = renderer->gpu->access_buffer( mesh.normal_buffer );
-            vec3s* normals = ( vec3s* )( normal_buffer->mapped_data + mesh.normal_offset );
-
-            Buffer* tangent_buffer = renderer->gpu->access_buffer( mesh.tangent_buffer );
-            vec3s* tangents = ( vec3s* )( tangent_buffer->mapped_data + mesh.tangent_offset );
-
-            Buffer* index_buffer = renderer->gpu->access_buffer( mesh.index_buffer );
-            u32* indices = ( u32* )( index_buffer->mapped_data + mesh.index_offset );
+            ClothSolver& solver = physics_mesh->cpu_solver;
+            solver.type = cloth_cpu_solver_type;
+            solver.use_avx2 = cloth_cpu_solver_avx2;
+            solver.simulate( cpu_physics_data, task_scheduler );
 
+            PhysicsVertexGpuData simulated_vertex;
             for ( u32 v = 0; v < physics_mesh->vertices.size; ++v ) {
-                positions[ v ] = physics_mesh->vertices[ v ].position;
-            }
-
-            for ( u32 i = 0; i < mesh.primitive_count; i += 3 ) {
-                u32 i0 = indices[ i + 0 ];
-                u32 i1 = indices[ i + 1 ];
-                u32 i2 = indices[ i + 2 ];
-
-                vec3s p0 = physics_mesh->vertices[ i0 ].position;
-                vec3s p1 = physics_mesh->vertices[ i1 ].position;
-                vec3s p2 = physics_mesh->vertices[ i2 ].position;
-
-                // TODO(marco): better normal compuation, also update tangents
-                vec3s edge1 = glms_vec3_sub( p1, p0 );
-                vec3s edge2 = glms_vec3_sub( p2, p0 );
-
-                vec3s n = glms_cross( edge1, edge2 );
-
-                physics_mesh->vertices[ i0 ].normal = glms_normalize( glms_vec3_add( normals[ i0 ], n ) );
-                physics_mesh->vertices[ i1 ].normal = glms_normalize( glms_vec3_add( normals[ i1 ], n ) );
-                physics_mesh->vertices[ i2 ].normal = glms_normalize( glms_vec3_add( normals[ i2 ], n ) );
-
-                normals[ i0 ] = physics_mesh->vertices[ i0 ].normal;
-                normals[ i1 ] = physics_mesh->vertices[ i1 ].normal;
-                normals[ i2 ] = physics_mesh->vertices[ i2 ].normal;
+                PhysicsVertex& vertex = physics_mesh->vertices[ v ];
+                solver.read_vertex( v, simulated_vertex );
+
+                vertex.position = simulated_vertex.position;
+                vertex.previous_position = simulated_vertex.previous_position;
+                vertex.normal = simulated_vertex.normal;
+                vertex.velocity = simulated_vertex.velocity;
+                vertex.force = simulated_vertex.force;
             }
         }
     }
-#else
+
     if ( physics_cb.index == k_invalid_buffer.index )
         return nullptr;
 
@@ -5044,7 +5255,6 @@ CommandBuffer* RenderScene::update_physics( f32 delta_time, f32 air_density, f32
     }
 
     return cb;
-#endif
 }
 
 // TODO: refactor
@@ -5201,17 +5411,31 @@ void RenderScene::upload_gpu_data( UploadGpuDataContext& context ) {
 
     GpuDevice& gpu = *renderer->gpu;
 
-    // Update per mesh material buffer
+    // Update per mesh draw buffer
     // TODO: update only changed stuff, this is now dynamic so it can't be done.
     MapBufferParameters cb_map = { meshes_sb, 0, 0 };
-    GpuMaterialData* gpu_mesh_data = ( GpuMaterialData* )gpu.map_buffer( cb_map );
+    GpuMeshDrawData* gpu_mesh_data = ( GpuMeshDrawData* )gpu.map_buffer( cb_map );
     if ( gpu_mesh_data ) {
         for ( u32 mesh_index = 0; mesh_index < meshes.size; ++mesh_index ) {
-            copy_gpu_material_data( gpu, gpu_mesh_data[ mesh_index ], meshes[ mesh_index ] );
+            copy_gpu_mesh_draw_data( gpu, gpu_mesh_data[ mesh_index ], meshes[ mesh_index ] );
         }
         gpu.unmap_buffer( cb_map );
     }
 
+    // Materials are not dynamic, only changed ones are copied. Released slots are reused only once
+    // no frame in flight reads them, so the copy never changes a material a frame is using.
+    material_table.collect( gpu.completed_frame_timeline_value() );
+    if ( material_table.needs_upload() ) {
+        cb_map = { materials_sb, 0, 0 };
+        GpuMaterial* gpu_materials = ( GpuMaterial* )gpu.map_buffer( cb_map );
+        if ( gpu_materials ) {
+            const u32 capacity = ( u32 )( gpu.access_buffer( materials_sb )->size / sizeof( GpuMaterial ) );
+            material_table.upload( gpu_materials, capacity );
+
+            gpu.unmap_buffer( cb_map );
+        }
+    }
+
     // Copy mesh bounding spheres
     cb_map.buffer = mesh_bounds_sb;
     vec4s* gpu_bounds_data = (vec4s*)gpu.map_buffer( cb_map );
@@ -5284,79 +5508,81 @@ void RenderScene::upload_gpu_data( UploadGpuDataContext& context ) {
         gpu.unmap_buffer( cb_map );
     }
 
+    // Cull the lights outside of the camera frustum, they are left out of the bins and of the tiles.
+    const bool cull_lights = use_light_bvh && !context.force_fullscreen_light_aabb;
+
+    Array<u8> light_visibility;
+    light_visibility.init( context.scratch_allocator, active_lights, active_lights );
+    memset( light_visibility.data, cull_lights ? 0 : 1, active_lights );
+    visible_lights = active_lights;
+
+    if ( use_light_bvh ) {
+        Array<vec4s> light_spheres;
+        light_spheres.init( context.scratch_allocator, active_lights, active_lights );
+        Array<f32> light_intensities;
+        light_intensities.init( context.scratch_allocator, active_lights, active_lights );
+
+        for ( u32 i = 0; i < active_lights; ++i ) {
+            const Light& light = lights[ i ];
+            light_spheres[ i ] = vec4s{ light.world_position.x, light.world_position.y, light.world_position.z, light.radius };
+            light_intensities[ i ] = light.intensity;
+        }
+
+        light_bvh.update( light_spheres.data, active_lights, task_scheduler );
+
+        vec4s frustum_planes[ 6 ];
+        light_bvh_frustum_planes( context.game_camera.camera.view_projection, frustum_planes );
+
+        if ( cull_lights ) {
+            Array<u32> frustum_lights;
+            frustum_lights.init( context.scratch_allocator, active_lights );
+
+            light_bvh_visited_nodes = light_bvh.query_planes( frustum_planes, 6, frustum_lights );
+            visible_lights = frustum_lights.size;
+
+            for ( u32 i = 0; i < frustum_lights.size; ++i ) {
+                light_visibility[ frustum_lights[ i ] ] = 1;
+            }
+        }
+
+        light_bvh.select_lights( frustum_planes, context.game_camera.camera.position, light_intensities.data, max_shadow_lights,
+                                 shadow_lights, shadow_light_scores );
+    } else {
+        shadow_lights.clear();
+        shadow_light_scores.clear();
+    }
+
     // Calculate lights LUT
     // NOTE(marco): it might be better to use logarithmic slices to have better resolution
     // closer to the camera. We could also use a different far plane and discard any lights
     // that are too far
     const f32 bin_size = 1.0f / k_light_z_bins;
 
-    Array<u32> bin_range_per_light;
-    bin_range_per_light.init( context.scratch_allocator, active_lights, active_lights );
+    for ( u32 bin = 0; bin < k_light_z_bins; ++bin ) {
+        lights_lut[ bin ] = k_num_lights + 1;
+    }
 
+    // Lights are sorted, the first light of a bin is the first one found and the last the last one found.
     for ( u32 i = 0; i < active_lights; ++i ) {
         const SortedLight& light = sorted_lights[ i ];
 
+        if ( !light_visibility[ light.light_index ] ) {
+            continue;
+        }
+
         if ( light.projected_z_min < 0.0f && light.projected_z_max < 0.0f ) {
             // NOTE(marco): this light is behind the camera
-            bin_range_per_light[ i ] = u32_max;
-
             continue;
         }
 
         const u32 min_bin = raptor::max( 0, raptor::floori32( light.projected_z_min * k_light_z_bins ) );
-        const u32 max_bin = raptor::max( 0, raptor::ceili32( light.projected_z_max * k_light_z_bins ) );
-
-        bin_range_per_light[ i ] = ( min_bin & 0xffff ) | ( ( max_bin & 0xffff ) << 16 );
+        const u32 max_bin = raptor::min( ( u32 )raptor::max( 0, raptor::ceili32( light.projected_z_max * k_light_z_bins ) ), k_light_z_bins - 1 );
         // rprint( "Light %u min %u, max %u, linear z min %f max %f\n", i, min_bin, max_bin, light.projected_z_min * z_far, light.projected_z_max * z_far );
-    }
-
-    for ( u32 bin = 0; bin < k_light_z_bins; ++bin ) {
-        u32 min_light_id = k_num_lights + 1;
-        u32 max_light_id = 0;
 
-        f32 bin_min = bin_size * bin;
-        f32 bin_max = bin_min + bin_size;
-
-        for ( u32 i = 0; i < active_lights; ++i ) {
-            const SortedLight& light = sorted_lights[ i ];
-            const u32 light_bins = bin_range_per_light[ i ];
-
-            if ( light_bins == u32_max ) {
-                continue;
-            }
-
-            const u32 min_bin = light_bins & 0xffff;
-            const u32 max_bin = light_bins >> 16;
-
-            if ( bin >= min_bin && bin <= max_bin ) {
-                if ( i < min_light_id ) {
-                    min_light_id = i;
-                }
-
-                if ( i > max_light_id ) {
-                    max_light_id = i;
-                }
-            }
-            // OLD: left as a reference if new implementation breaks too much.
-            //if ( ( light.projected_z >= bin_min && light.projected_z <= bin_max ) ||
-            //     ( light.projected_z_min >= bin_min && light.projected_z_min <= bin_max ) ||
-            //     ( light.projected_z_max >= bin_min && light.projected_z_max <= bin_max ) ) {
-            //    if ( i < min_light_id ) {
-            //        min_light_id = i;
-
-            //        //rprint( "Light in bin %u\n", bin );
-            //    }
-
-            //    if ( i > max_light_id ) {
-            //        max_light_id = i;
-            //    }
-            //}
+        for ( u32 bin = min_bin; bin <= max_bin; ++bin ) {
+            const u32 min_light_id = lights_lut[ bin ] == k_num_lights + 1 ? i : ( lights_lut[ bin ] & 0xffff );
+            lights_lut[ bin ] = min_light_id | ( i << 16 );
         }
-
-        //if (min_light_id != k_num_lights + 1)
-            //rprint( "Bin %u, light ids min %u, max %u\n", bin, min_light_id, max_light_id );
-
-        lights_lut[ bin ] = min_light_id | ( max_light_id << 16 );
     }
 
     // Upload light indices
@@ -5403,6 +5629,10 @@ void RenderScene::upload_gpu_data( UploadGpuDataContext& context ) {
         const u32 light_index = sorted_lights[ i ].light_index;
         Light& light = lights[ light_index ];
 
+        if ( !light_visibility[ light_index ] ) {
+            continue;
+        }
+
         vec4s pos{ light.world_position.x, light.world_position.y, light.world_position.z, 1.0f };
         float radius = light.radius;
 
@@ -5693,7 +5923,7 @@ void RenderScene::on_resize( GpuDevice& gpu, FrameGraph* frame_graph, u32 new_wi
     }
 }
 
-void RenderScene::draw_mesh_instance( CommandBuffer* gpu_commands, MeshInstance& mesh_instance, bool transparent ) {
+void RenderScene::draw_mesh_instance( CommandBuffer* gpu_commands, MeshInstance& mesh_instance, bool transparent, DescriptorSetHandle& bound_set ) {
 
     Mesh& mesh = *mesh_instance.mesh;
     BufferHandle buffers[]{ mesh.position_buffer, mesh.tangent_buffer, mesh.normal_buffer, mesh.texcoord_buffer, mesh.joints_buffer, mesh.weights_buffer };
@@ -5704,18 +5934,33 @@ void RenderScene::draw_mesh_instance( CommandBuffer* gpu_commands, MeshInstance&
 
     if ( recreate_per_thread_descriptors ) {
         DescriptorSetCreation ds_creation{};
-        ds_creation.buffer( scene_cb, 0 ).buffer( mesh_instances_sb, 10 ).buffer( meshes_sb, 2 );
+        ds_creation.buffer( scene_cb, 0 ).buffer( mesh_instances_sb, 10 ).buffer( meshes_sb, 2 ).buffer( materials_sb, 14 );
         DescriptorSetHandle descriptor_set = renderer->create_descriptor_set( gpu_commands, mesh.pbr_material.material, ds_creation );
 
-        gpu_commands->bind_local_descriptor_set( &descriptor_set, 1, nullptr, 0 );
+        // Command buffer sets are cached per content, the same handle means the same set.
+        if ( descriptor_set.index != bound_set.index ) {
+            gpu_commands->bind_local_descriptor_set( &descriptor_set, 1, nullptr, 0 );
+            bound_set = descriptor_set;
+        }
     } else {
-        gpu_commands->bind_descriptor_set( transparent ? &mesh.pbr_material.descriptor_set_transparent : &mesh.pbr_material.descriptor_set_main, 1, nullptr, 0 );
+        DescriptorSetHandle descriptor_set = transparent ? mesh.pbr_material.descriptor_set_transparent : mesh.pbr_material.descriptor_set_main;
+        if ( descriptor_set.index != bound_set.index ) {
+            gpu_commands->bind_descriptor_set( &descriptor_set, 1, nullptr, 0 );
+            bound_set = descriptor_set;
+        }
     }
 
-    // Gpu mesh index used to retrieve mesh data
+    // Instance index is used to retrieve the mesh instance, that holds the mesh and material indices.
     gpu_commands->draw_indexed( TopologyType::Triangle, mesh.primitive_count, 1, 0, 0, mesh_instance.gpu_mesh_instance_index );
 }
 
+u32 RenderScene::add_material( const PBRMaterial& pbr_material ) {
+    GpuMaterial gpu_material{ };
+    copy_gpu_material( gpu_material, pbr_material );
+
+    return material_table.add( gpu_material );
+}
+
 void RenderScene::add_scene_descriptors( DescriptorSetCreation& descriptor_set_creation, GpuTechniquePass& pass ) {
     const u16 binding = pass.get_binding_index( "SceneConstants" );
     descriptor_set_creation.buffer( scene_cb, binding );
@@ -5730,6 +5975,11 @@ void RenderScene::add_mesh_descriptors( DescriptorSetCreation& descriptor_set_cr
     const u16 binding_mb = pass.get_binding_index( "MeshBounds" );
 
     descriptor_set_creation.buffer( meshes_sb, binding_md ).buffer( mesh_instances_sb, binding_mid ).buffer( mesh_bounds_sb, binding_mb );
+
+    const u16 binding_materials = pass.get_binding_index( "Materials" );
+    if ( binding_materials != u16_max ) {
+        descriptor_set_creation.buffer( materials_sb, binding_materials );
+    }
 }
 
 void RenderScene::add_meshlet_descriptors( DescriptorSetCreation& descriptor_set_creation, GpuTechniquePass& pass ) {
@@ -5822,6 +6072,7 @@ void DrawTask::init( GpuDevice* gpu_, FrameGraph* frame_graph_, Renderer* render
 
 void DrawTask::ExecuteRange( enki::TaskSetPartition range_, uint32_t threadnum_ ) {
     ZoneScoped;
+    FramePhaseScope recording_scope( frame_statistics, FramePhase::Recording, threadnum_ );
 
     using namespace raptor;
 
@@ -6202,75 +6453,55 @@ vec2s hammersley_sequence( i32 index, i32 num_samples ) {
 
 // DebugRenderer //////////////////////////////////////////////////////////
 
-//
-//
-struct LineVertex {
-    vec3s                           position;
-    Color                           color;
-
-    void                            set( vec3s position_, Color color_ ) { position = position_; color = color_; }
-    void                            set( vec2s position_, Color color_ ) { position = { position_.x, position_.y, 0 }; color = color_; }
-}; // struct LineVertex
-
-//
-//
-struct LineVertex2D {
-    vec3s                           position;
-    u32                             color;
-
-    void                            set( vec2s position_, Color color_ ) { position = { position_.x, position_.y, 0 }, color = color_.abgr; }
-}; // struct LineVertex2D
-
-static const u32            k_max_lines = 1024 * 1024;
-
-static LineVertex           s_line_buffer[ k_max_lines ];
-static LineVertex2D         s_line_buffer_2d[ k_max_lines ];
-
+// Per thread command capacities.
+static const u32            k_debug_max_lines       = 16 * 1024;
+static const u32            k_debug_max_aabbs       = 8 * 1024;
+static const u32            k_debug_max_spheres     = 1024;
+static const u32            k_debug_max_lines_2d    = 8 * 1024;
+// Line instances drawn in a frame, the ring holds one more frame than the ones in flight.
+static const u32            k_debug_max_frame_lines = 256 * 1024;
 
 void DebugRenderer::render( u32 current_frame_index, CommandBuffer* gpu_commands, RenderScene* render_scene ) {
 
-    if ( current_line ) {
+    GpuDevice& gpu = *renderer->gpu;
+    ring.retire( gpu.completed_frame_timeline_value() );
+
+    const u32 line_count = raptor::min( draw.count_lines(), max_frame_lines );
+    const u32 line_count_2d = raptor::min( draw.count_lines_2d(), max_frame_lines - line_count );
+    if ( line_count + line_count_2d == 0 ) {
+        draw.clear();
+        return;
+    }
 
-        const u32 mapping_size = sizeof( LineVertex ) * current_line;
-        MapBufferParameters cb_map{ lines_vb, 0, mapping_size };
-        LineVertex* vtx_dst = ( LineVertex* )renderer->gpu->map_buffer( cb_map );
+    const u32 instance_size = sizeof( DebugLineCommand );
+    const u32 offset = ring.allocate( instance_size * ( line_count + line_count_2d ), gpu.frame_timeline_value() );
+    if ( offset == u32_max ) {
+        // The gpu is still reading the space, skip the lines of this frame.
+        draw.clear();
+        return;
+    }
 
-        if ( vtx_dst ) {
-            memcpy( vtx_dst, &s_line_buffer[ 0 ], mapping_size );
+    Buffer* lines_buffer = gpu.access_buffer( lines_ring_vb );
+    DebugLineVertex* vertices = ( DebugLineVertex* )( lines_buffer->mapped_data + offset );
+    draw.expand_lines( vertices, line_count );
+    draw.expand_lines_2d( vertices + line_count * 2, line_count_2d );
+    draw.clear();
 
-            renderer->gpu->unmap_buffer( cb_map );
-        }
+    // All threads and primitives in one instanced draw per pipeline, 2D lines follow the 3D ones.
+    gpu_commands->bind_vertex_buffer( lines_ring_vb, 0, offset );
+    // Draw using instancing and 6 vertices.
+    const uint32_t num_vertices = 6;
 
+    if ( line_count ) {
         gpu_commands->bind_pipeline( debug_lines_draw_pipeline );
-        gpu_commands->bind_vertex_buffer( lines_vb, 0, 0 );
         gpu_commands->bind_descriptor_set( &debug_lines_draw_set, 1, nullptr, 0 );
-        // Draw using instancing and 6 vertices.
-        const uint32_t num_vertices = 6;
-        gpu_commands->draw( TopologyType::Triangle, 0, num_vertices, 0, current_line / 2 );
-
-        current_line = 0;
+        gpu_commands->draw( TopologyType::Triangle, 0, num_vertices, 0, line_count );
     }
 
-    if ( current_line_2d ) {
-
-        const u32 mapping_size = sizeof( LineVertex2D ) * current_line_2d;
-        MapBufferParameters cb_map{ lines_vb_2d, 0, mapping_size };
-        LineVertex2D* vtx_dst = ( LineVertex2D* )renderer->gpu->map_buffer( cb_map );
-
-        if ( vtx_dst ) {
-            memcpy( vtx_dst, &s_line_buffer_2d[ 0 ], mapping_size );
-
-            renderer->gpu->unmap_buffer( cb_map );
-        }
-
+    if ( line_count_2d ) {
         gpu_commands->bind_pipeline( debug_lines_2d_draw_pipeline );
-        gpu_commands->bind_vertex_buffer( lines_vb_2d, 0, 0 );
         gpu_commands->bind_descriptor_set( &debug_lines_draw_set, 1, nullptr, 0 );
-        // Draw using instancing and 6 vertices.
-        const uint32_t num_vertices = 6;
-        gpu_commands->draw( TopologyType::Triangle, 0, num_vertices, 0, current_line_2d / 2 );
-
-        current_line_2d = 0;
+        gpu_commands->draw( TopologyType::Triangle, 0, num_vertices, line_count, line_count_2d );
     }
 }
 
@@ -6278,14 +6509,15 @@ void DebugRenderer::init( RenderScene& scene, Allocator* resident_allocator, Sta
 
     renderer = scene.renderer;
 
-    current_line_2d = current_line = 0;
+    draw.init( resident_allocator, renderer->gpu->num_threads, k_debug_max_lines, k_debug_max_aabbs, k_debug_max_spheres, k_debug_max_lines_2d );
 
-    BufferCreation buffer_creation;
-    buffer_creation.reset().set( VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, ResourceUsageType::Dynamic, sizeof( LineVertex ) * k_max_lines ).set_name( "lines_vb" );
-    lines_vb = renderer->gpu->create_buffer( buffer_creation );
+    max_frame_lines = k_debug_max_frame_lines;
+    const u32 ring_size = sizeof( DebugLineCommand ) * max_frame_lines * ( k_max_frames + 1 );
+    ring.init( ring_size, sizeof( DebugLineCommand ) );
 
-    buffer_creation.reset().set( VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, ResourceUsageType::Dynamic, sizeof( LineVertex2D ) * k_max_lines ).set_name( "lines_vb_2d" );
-    lines_vb_2d = renderer->gpu->create_buffer( buffer_creation );
+    BufferCreation buffer_creation;
+    buffer_creation.reset().set( VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, ResourceUsageType::Stream, ring_size ).set_persistent( true ).set_name( "debug_lines_ring_vb" );
+    lines_ring_vb = renderer->gpu->create_buffer( buffer_creation );
 
     const u64 hashed_name = hash_calculate( "debug" );
     GpuTechnique* main_technique = renderer->resource_cache.techniques.get( hashed_name );
@@ -6312,53 +6544,30 @@ void DebugRenderer::init( RenderScene& scene, Allocator* resident_allocator, Sta
 
 void DebugRenderer::shutdown() {
 
-    renderer->gpu->destroy_buffer( lines_vb );
-    renderer->gpu->destroy_buffer( lines_vb_2d );
+    renderer->gpu->destroy_buffer( lines_ring_vb );
     renderer->gpu->destroy_descriptor_set( debug_lines_draw_set );
+
+    draw.shutdown();
 }
 
-void DebugRenderer::line( const vec3s& from, const vec3s& to, Color color ) {
-    line( from, to, color, color );
+void DebugRenderer::line( const vec3s& from, const vec3s& to, Color color, u32 thread_index ) {
+    draw.line( thread_index, from, to, color, color );
 }
 
-void DebugRenderer::line_2d( const vec2s& from, const vec2s& to, Color color ) {
-    if ( current_line_2d >= k_max_lines ) {
-        return;
-    }
+void DebugRenderer::line_2d( const vec2s& from, const vec2s& to, Color color, u32 thread_index ) {
+    draw.line_2d( thread_index, from, to, color );
+}
 
-    s_line_buffer_2d[ current_line_2d++ ].set( from, color );
-    s_line_buffer_2d[ current_line_2d++ ].set( to, color );
+void DebugRenderer::line( const vec3s& from, const vec3s& to, Color color0, Color color1, u32 thread_index ) {
+    draw.line( thread_index, from, to, color0, color1 );
 }
 
-void DebugRenderer::line( const vec3s& from, const vec3s& to, Color color0, Color color1 ) {
-    if ( current_line >= k_max_lines )
-        return;
+void DebugRenderer::aabb( const vec3s& min, const vec3s max, Color color, u32 thread_index ) {
+    draw.aabb( thread_index, min, max, color );
+}
 
-    s_line_buffer[ current_line++ ].set( from, color0 );
-    s_line_buffer[ current_line++ ].set( to, color1 );
-}
-
-void DebugRenderer::aabb( const vec3s& min, const vec3s max, Color color ) {
-
-    const f32 x0 = min.x;
-    const f32 y0 = min.y;
-    const f32 z0 = min.z;
-    const f32 x1 = max.x;
-    const f32 y1 = max.y;
-    const f32 z1 = max.z;
-
-    line( { x0, y0, z0 }, { x0, y1, z0 }, color, color );
-    line( { x0, y1, z0 }, { x1, y1, z0 }, color, color );
-    line( { x1, y1, z0 }, { x1, y0, z0 }, color, color );
-    line( { x1, y0, z0 }, { x0, y0, z0 }, color, color );
-    line( { x0, y0, z0 }, { x0, y0, z1 }, color, color );
-    line( { x0, y1, z0 }, { x0, y1, z1 }, color, color );
-    line( { x1, y1, z0 }, { x1, y1, z1 }, color, color );
-    line( { x1, y0, z0 }, { x1, y0, z1 }, color, color );
-    line( { x0, y0, z1 }, { x0, y1, z1 }, color, color );
-    line( { x0, y1, z1 }, { x1, y1, z1 }, color, color );
-    line( { x1, y1, z1 }, { x1, y0, z1 }, color, color );
-    line( { x1, y0, z1 }, { x0, y0, z1 }, color, color );
+void DebugRenderer::sphere( const vec3s& center, f32 radius, Color color, u32 thread_index ) {
+    draw.sphere( thread_index, center, radius, color );
 }
 
 } // namespace raptor
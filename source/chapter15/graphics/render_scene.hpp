@@ -4,10 +4,18 @@
 #include "foundation/platform.hpp"
 #include "foundation/color.hpp"
 
+#include "graphics/cloth_solver.hpp"
+#include "graphics/debug_draw.hpp"
 #include "graphics/command_buffer.hpp"
+#include "graphics/draw_sort.hpp"
 #include "graphics/renderer.hpp"
 #include "graphics/gpu_resources.hpp"
+#include "graphics/ddgi_probe_scheduler.hpp"
 #include "graphics/frame_graph.hpp"
+#include "graphics/froxel_light_assigner.hpp"
+#include "graphics/light_bvh.hpp"
+#include "graphics/material_table.hpp"
+#include "graphics/shadow_cache.hpp"
 
 #include "external/cglm/types-struct.h"
 
@@ -22,17 +30,18 @@ namespace raptor {
     struct Allocator;
     struct AsynchronousLoader;
     struct FrameGraph;
+    struct FrameStatistics;
     struct GpuVisualProfiler;
     struct ImGuiService;
     struct Renderer;
     struct RenderScene;
     struct SceneGraph;
+    struct ShaderVariantManager;
     struct StackAllocator;
     struct GameCamera;
 
     static const u16    k_invalid_scene_texture_index      = u16_max;
     static const u32    k_material_descriptor_set_index    = 1;
-    static const u32    k_max_joint_count                  = 12;
     static const u32    k_max_depth_pyramid_levels         = 16;
 
     static const u32    k_num_lights                       = 256;
@@ -162,7 +171,9 @@ namespace raptor {
         f32                     raytraced_shadow_light_intensity;
 
         u32                     brdf_lut_texture_index;
-        u32                     pad[3];
+        f32                     reflections_uv_scale_x;
+        f32                     reflections_uv_scale_y;
+        u32                     pad;
     }; // GpuLightingData
 
     struct glTFScene;
@@ -178,6 +189,9 @@ namespace raptor {
         DescriptorSetHandle     descriptor_set_transparent  = k_invalid_set;
         DescriptorSetHandle     descriptor_set_main = k_invalid_set;
 
+        // Index in the scene material table.
+        u32                     material_index          = u32_max;
+
         // Indices used for bindless textures.
         u16                     diffuse_texture_index   = u16_max;
         u16                     roughness_texture_index = u16_max;
@@ -226,52 +240,6 @@ namespace raptor {
         bool                    fixed;
     };
 
-    //
-    //
-    struct PhysicsVertexGpuData {
-        vec3s                   position;
-        f32                     pad0_;
-
-        vec3s                   start_position;
-        f32                     pad1_;
-
-        vec3s                   previous_position;
-        f32                     pad2_;
-
-        vec3s                   normal;
-        u32                     joint_count;
-
-        vec3s                   velocity;
-        f32                     mass;
-
-        vec3s                   force;
-
-        // TODO(marco): better storage, values are never greater than 12
-        u32                     joints[ k_max_joint_count ];
-        u32                     pad3_;
-    };
-
-    //
-    //
-    struct PhysicsMeshGpuData {
-        u32                     index_count;
-        u32                     vertex_count;
-
-        u32                     padding_[ 2 ];
-    };
-
-    //
-    //
-    struct PhysicsSceneData {
-        vec3s                   wind_direction;
-        u32                     reset_simulation;
-
-        f32                     air_density;
-        f32                     spring_stiffness;
-        f32                     spring_damping;
-        f32                     padding_;
-    };
-
     //
     //
     struct PhysicsMesh {
@@ -283,6 +251,8 @@ namespace raptor {
         BufferHandle            draw_indirect_buffer;
         DescriptorSetHandle     descriptor_set;
         DescriptorSetHandle     debug_mesh_descriptor_set;
+
+        ClothSolver             cpu_solver;
     };
 
     //
@@ -393,16 +363,10 @@ namespace raptor {
 
     //
     //
-    struct alignas( 16 ) GpuMaterialData {
-
-        u32                     textures[ 4 ]; // diffuse, roughness, normal, occlusion
-        // PBR
-        vec4s                   emissive; // emissive_color_factor + emissive texture index
-        vec4s                   base_color_factor;
-        vec4s                   metallic_roughness_occlusion_factor; // metallic, roughness, occlusion
+    struct alignas( 16 ) GpuMeshDrawData {
 
         u32                     flags;
-        f32                     alpha_cutoff;
+        u32                     material_index;
         u32                     vertex_offset;
         u32                     mesh_index;
 
@@ -416,7 +380,7 @@ namespace raptor {
         VkDeviceAddress         index_buffer;
         VkDeviceAddress         normals_buffer;
 
-    }; // struct GpuMaterialData
+    }; // struct GpuMeshDrawData
 
     //
     //
@@ -425,7 +389,7 @@ namespace raptor {
         mat4s                   inverse_world;
 
         u32                     mesh_index;
-        u32                     pad000;
+        u32                     material_index;
         u32                     pad001;
         u32                     pad002;
     }; // struct GpuMeshInstanceData
@@ -515,6 +479,10 @@ namespace raptor {
 
         BufferHandle            joint_transforms;
 
+        // Mesh descriptor sets with the joint transforms, shared by the meshes using this skin.
+        DescriptorSetHandle     descriptor_set_main;
+        DescriptorSetHandle     descriptor_set_transparent;
+
     }; // struct Skin
 
     // Transform //////////////////////////////////////////////////////////
@@ -659,9 +627,11 @@ namespace raptor {
         void                    render( u32 current_frame_index, CommandBuffer* gpu_commands, RenderScene* render_scene ) override;
 
         void                    prepare_draws( RenderScene& scene, FrameGraph* frame_graph, Allocator* resident_allocator, StackAllocator* scratch_allocator ) override;
+        void                    upload_gpu_data( RenderScene& scene ) override;
         void                    free_gpu_resources( GpuDevice& gpu ) override;
 
         Array<MeshInstanceDraw> mesh_instance_draws;
+        DrawSorter              draw_sorter;
         Renderer*               renderer;
         u32                     meshlet_technique_index;
     }; // struct DepthPrePass
@@ -698,9 +668,11 @@ namespace raptor {
         void                    render( u32 current_frame_index, CommandBuffer* gpu_commands, RenderScene* render_scene ) override;
 
         void                    prepare_draws( RenderScene& scene, FrameGraph* frame_graph, Allocator* resident_allocator, StackAllocator* scratch_allocator ) override;
+        void                    upload_gpu_data( RenderScene& scene ) override;
         void                    free_gpu_resources( GpuDevice& gpu ) override;
 
         Array<MeshInstanceDraw> mesh_instance_draws;
+        DrawSorter              draw_sorter;
         Renderer*               renderer;
 
         PipelineHandle          meshlet_draw_pipeline;
@@ -747,6 +719,8 @@ namespace raptor {
         Renderer*               renderer;
         bool                    use_compute;
 
+        PipelineHandle          lighting_pipeline;      // Variant for the lighting features, resolved on upload.
+
         DescriptorSetHandle     lighting_descriptor_set[ k_max_frames ];
         TextureHandle           lighting_debug_texture;
 
@@ -768,9 +742,11 @@ namespace raptor {
         void                    render( u32 current_frame_index, CommandBuffer* gpu_commands, RenderScene* render_scene ) override;
 
         void                    prepare_draws( RenderScene& scene, FrameGraph* frame_graph, Allocator* resident_allocator, StackAllocator* scratch_allocator ) override;
+        void                    upload_gpu_data( RenderScene& scene ) override;
         void                    free_gpu_resources( GpuDevice& gpu ) override;
 
         Array<MeshInstanceDraw> mesh_instance_draws;
+        DrawSorter              draw_sorter;
         Renderer*               renderer;
         u32                     meshlet_technique_index;
     }; // struct TransparentPass
@@ -826,9 +802,15 @@ namespace raptor {
         BufferHandle            shadow_resolutions_readback[ k_max_frames ];
 
         PagePoolHandle          shadow_maps_pool = k_invalid_page_pool;
+        u32                     shadow_maps_pool_size = rgiga( 1 );     // In texels, as allocate_texture_pool takes it.
+        u32                     shadow_face_blocks = 0;                 // Pool blocks bound per cubemap face, from the sparse block shape of the depth format.
+        bool                    shadow_maps_pool_resize = false;        // Resized by the memory budget or the light count, recreated with the light resources.
 
         TextureHandle           cubemap_debug_face_texture;
 
+        // Cubemap faces that are still valid from previous frames are not rendered again.
+        PointlightShadowCache   shadow_cache;
+
     }; // struct PointlightShadowPass
 
 
@@ -874,6 +856,10 @@ namespace raptor {
         DescriptorSetHandle     fog_descriptor_set;
         BufferHandle            fog_constants;
 
+        // CPU reference of per froxel light and volume lists.
+        FroxelLightAssigner     froxel_light_assigner;
+        Array<vec4s>            froxel_light_spheres;
+
         Renderer*               renderer;
 
     }; // struct VolumetricFogPass
@@ -1151,6 +1137,7 @@ namespace raptor {
 
         BufferHandle            ddgi_constants_buffer;
         BufferHandle            ddgi_probe_status_buffer;
+        BufferHandle            ddgi_probe_update_list_buffer;
 
         PipelineHandle          probe_raytrace_pipeline;
         DescriptorSetHandle     probe_raytrace_descriptor_set;
@@ -1180,6 +1167,10 @@ namespace raptor {
 
         i32                     per_frame_probe_updates = 0;
         i32                     probe_update_offset = 0;
+        i32                     offsets_calculations_count = 24;    // Frames left tracing all the probes to place them.
+
+        DDGIProbeScheduler      probe_scheduler;
+        Array<Light>            probe_scheduler_lights;     // Previous frame lights, to find the ones that changed.
 
         i32                     probe_rays = 128;
         i32                     irradiance_atlas_width;
@@ -1235,6 +1226,7 @@ namespace raptor {
         TextureHandle           brdf_lut_texture;
 
         f32                     texture_scale       = 1.f;
+        f32                     dynamic_scale       = 1.f;  // Rendered this frame, up to texture_scale.
 
     }; // ReflectionsPass
 
@@ -1278,6 +1270,7 @@ namespace raptor {
         PipelineHandle          pipeline;
 
         f32                     texture_scale       = 1.f;
+        f32                     dynamic_scale       = 1.f;
 
     }; // SVGFAccumulationPass
 
@@ -1325,6 +1318,7 @@ namespace raptor {
         DescriptorSetHandle     downsample_descriptor_set;
 
         f32                     texture_scale       = 1.f;
+        f32                     dynamic_scale       = 1.f;
 
     }; // SVGFVariancePass
 
@@ -1375,6 +1369,7 @@ namespace raptor {
         PipelineHandle          pipeline;
 
         f32                     texture_scale       = 1.f;
+        f32                     dynamic_scale       = 1.f;
 
     }; // SVGFWaveletPass
 
@@ -1387,21 +1382,22 @@ namespace raptor {
 
         void                    render( u32 current_frame_index, CommandBuffer* gpu_commands, RenderScene* render_scene );
 
+        // Thread index is the enkiTS thread number when drawing from tasks.
+        void                    line( const vec3s& from, const vec3s& to, Color color, u32 thread_index = 0 );
+        void                    line_2d( const vec2s& from, const vec2s& to, Color color, u32 thread_index = 0 );
+        void                    line( const vec3s& from, const vec3s& to, Color color0, Color color1, u32 thread_index = 0 );
 
-        void                    line( const vec3s& from, const vec3s& to, Color color );
-        void                    line_2d( const vec2s& from, const vec2s& to, Color color );
-        void                    line( const vec3s& from, const vec3s& to, Color color0, Color color1 );
-
-        void                    aabb( const vec3s& min, const vec3s max, Color color );
+        void                    aabb( const vec3s& min, const vec3s max, Color color, u32 thread_index = 0 );
+        void                    sphere( const vec3s& center, f32 radius, Color color, u32 thread_index = 0 );
 
         Renderer*               renderer;
 
         // CPU rendering resources
-        BufferHandle            lines_vb;
-        BufferHandle            lines_vb_2d;
+        DebugDraw               draw;
+        DebugDrawRing           ring;
+        BufferHandle            lines_ring_vb;  // Persistently mapped, 3D and 2D lines of a frame are in one range.
 
-        u32                     current_line;
-        u32                     current_line_2d;
+        u32                     max_frame_lines;
 
         // Shared resources
         PipelineHandle          debug_lines_draw_pipeline;
@@ -1428,7 +1424,11 @@ namespace raptor {
         void                    update_joints();
 
         void                    upload_gpu_data( UploadGpuDataContext& context );
-        void                    draw_mesh_instance( CommandBuffer* gpu_commands, MeshInstance& mesh_instance, bool transparent );
+        // Binds the descriptor set of the mesh only if it differs from bound_set, callers reset it when binding a pipeline.
+        void                    draw_mesh_instance( CommandBuffer* gpu_commands, MeshInstance& mesh_instance, bool transparent, DescriptorSetHandle& bound_set );
+
+        // Adds the material to the material table, returns its index.
+        u32                     add_material( const PBRMaterial& pbr_material );
 
         // Helpers based on shaders. Ideally this would be coming from generated cpp files.
         void                    add_scene_descriptors( DescriptorSetCreation& descriptor_set_creation, GpuTechniquePass& pass );
@@ -1444,6 +1444,9 @@ namespace raptor {
         Array<MeshInstance>     mesh_instances;
         Array<u32>              gltf_mesh_to_mesh_offset;
 
+        // Materials of all meshes, indexed by the mesh instances
+        MaterialTable           material_table;
+
         // Meshlet data
         Array<GpuMeshlet>       meshlets;
         Array<GpuMeshletVertexPosition> meshlets_vertex_positions;
@@ -1462,9 +1465,29 @@ namespace raptor {
         u32                     active_lights   = 1;
         bool                    shadow_constants_cpu_update = true;
 
+        // Lights are frustum culled with the BVH before binning, it also selects the most important shadowed lights.
+        LightBVH                light_bvh;
+        Array<u32>              shadow_lights;  // Highest priority first.
+        Array<f32>              shadow_light_scores;
+        u32                     max_shadow_lights = 32;
+        u32                     visible_lights  = 0;
+        u32                     light_bvh_visited_nodes = 0;
+        bool                    use_light_bvh   = true;
+
+        // Lighting shader features, switched through shader variants.
+        ShaderVariantManager*   shader_variants = nullptr;
+        bool                    lighting_debug_options = true;
+        bool                    lighting_culling_optimization = true;
+
+        // Cloth simulated on the CPU too, the compute shader still updates the device only mesh buffers.
+        ClothSolverType::Enum   cloth_cpu_solver_type = ClothSolverType::MassSpring;
+        bool                    cloth_use_cpu_solver = false;
+        bool                    cloth_cpu_solver_avx2 = true;
+
         StringBuffer            names_buffer;   // Buffer containing all names of nodes, resources, etc.
 
         SceneGraph*             scene_graph;
+        enki::TaskScheduler*    task_scheduler  = nullptr;
 
         GpuSceneData            scene_data;
 
@@ -1473,6 +1496,7 @@ namespace raptor {
         BufferHandle            meshes_sb       = k_invalid_buffer;
         BufferHandle            mesh_bounds_sb  = k_invalid_buffer;
         BufferHandle            mesh_instances_sb = k_invalid_buffer;
+        BufferHandle            materials_sb    = k_invalid_buffer;
         BufferHandle            physics_cb      = k_invalid_buffer;
         BufferHandle            meshlets_sb     = k_invalid_buffer;
         BufferHandle            meshlets_vertex_pos_sb = k_invalid_buffer;
@@ -1516,7 +1540,7 @@ namespace raptor {
         Array<VkAccelerationStructureGeometryKHR> geometries;
         Array<VkAccelerationStructureBuildRangeInfoKHR> build_range_infos;
 
-        VkAccelerationStructureKHR blas;
+        Array<VkAccelerationStructureKHR> blases;
         BufferHandle            blas_buffer;
 
         VkAccelerationStructureKHR tlas;
@@ -1533,6 +1557,10 @@ namespace raptor {
         DescriptorSetHandle     mesh_shader_late_descriptor_set[ k_max_frames ];
         DescriptorSetHandle     mesh_shader_transparent_descriptor_set[ k_max_frames ];
 
+        // Shared by all mesh draws, except the transparent skinned ones that use their skin set.
+        DescriptorSetHandle     mesh_descriptor_set_main = k_invalid_set;
+        DescriptorSetHandle     mesh_descriptor_set_transparent = k_invalid_set;
+
         Allocator*              resident_allocator;
         Renderer*               renderer;
 
@@ -1572,6 +1600,7 @@ namespace raptor {
         f32                     volumetric_fog_box_density = 3.0f;
         u32                     volumetric_fog_box_color = raptor::Color::green;
         f32                     volumetric_fog_temporal_reprojection_jittering_scale = 0.2f;
+        bool                    volumetric_fog_cpu_light_assignment = false;
         f32                     volumetric_fog_application_dithering_scale = 0.005f;
         bool                    volumetric_fog_application_apply_opacity_anti_aliasing = false;
         bool                    volumetric_fog_application_apply_tricubic_filtering = false;
@@ -1618,8 +1647,11 @@ namespace raptor {
         bool                    gi_use_infinite_bounces = true;
         f32                     gi_infinite_bounces_multiplier = 0.75f;
         i32                     gi_per_frame_probes_update = 1000;
+        bool                    gi_use_probe_scheduler = false;
+        i32                     gi_probe_ray_budget = 128 * 1000;
         // Reflections
-        f32                     rt_reflections_scale = 0.5f;
+        f32                     rt_reflections_scale = 0.5f;         // Allocation scale of the reflection textures.
+        f32                     rt_reflections_dynamic_scale = 0.5f; // Rendered scale, up to rt_reflections_scale.
         f32                     rt_temporal_depth_difference = 10.f;
         f32                     rt_temporal_normal_difference = 16.f;
         f32                     rt_wavelet_sigma_z = 1.f;
@@ -1632,6 +1664,7 @@ namespace raptor {
         bool                    pointlight_rendering = true;
         bool                    pointlight_use_meshlets = true;
         bool                    use_tetrahedron_shadows = false;
+        bool                    pointlight_shadow_caching = true;
         bool                    show_light_edit_debug_draws = false;
 
         bool                    cubeface_flip[ 6 ];
@@ -1710,6 +1743,7 @@ namespace raptor {
         GpuVisualProfiler*      gpu_profiler = nullptr;
         RenderScene*            scene       = nullptr;
         FrameRenderer*          frame_renderer = nullptr;
+        FrameStatistics*        frame_statistics = nullptr;    // Optional, gets the recording time.
         u32                     thread_id   = 0;
         // NOTE(marco): gpu state might change between init and execute!
         u32                     current_frame_index = 0;
@@ -143,6 +143,8 @@ void Renderer::imgui_draw() {
 
     ImGui::Text( "GPU Memory Used: %lluMB, Total: %lluMB", memory_used / ( 1024 * 1024 ), memory_allocated / ( 1024 * 1024 ) );
 
+    gpu->memory_budget.imgui_draw();
+
     // Resorce pools
     ImGui::Separator();
     pool_imgui_draw( gpu->buffers, "Buffers" );
@@ -236,6 +238,25 @@ SamplerResource* Renderer::create_sampler( const SamplerCreation& creation ) {
     return nullptr;
 }
 
+// Cache names of each pass descriptor
+static void cache_descriptor_names( GpuDevice* gpu, GpuTechniquePass& pass ) {
+    Pipeline* pipeline = gpu->access_pipeline( pass.pipeline );
+
+    for ( u32 i = 0; i < pipeline->num_active_layouts; ++i) {
+        const DescriptorSetLayout* descriptor_set_layout = pipeline->descriptor_set_layout[ i ];
+        // First global layout is null
+        if ( descriptor_set_layout == nullptr ) {
+            continue;
+        }
+
+        for ( u32 b = 0; b < descriptor_set_layout->num_bindings; ++b ) {
+            const DescriptorBinding& binding = descriptor_set_layout->bindings[ b ];
+
+            pass.name_hash_to_descriptor_index.insert( hash_calculate( binding.name ), ( u16 )binding.index );
+        }
+    }
+}
+
 GpuTechnique* Renderer::create_technique( const GpuTechniqueCreation& creation ) {
     GpuTechnique* technique = techniques.obtain();
     if ( technique ) {
@@ -263,22 +284,7 @@ GpuTechnique* Renderer::create_technique( const GpuTechniqueCreation& creation )
             pass.name_hash_to_descriptor_index.init( resident_allocator, 16 );
             pass.name_hash_to_descriptor_index.set_default_value( u16_max );
 
-            // Cache names of each pass descriptor
-            Pipeline* pipeline = gpu->access_pipeline( pass.pipeline );
-
-            for ( u32 i = 0; i < pipeline->num_active_layouts; ++i) {
-                const DescriptorSetLayout* descriptor_set_layout = pipeline->descriptor_set_layout[ i ];
-                // First global layout is null
-                if ( descriptor_set_layout == nullptr ) {
-                    continue;
-                }
-                
-                for ( u32 b = 0; b < descriptor_set_layout->num_bindings; ++b ) {
-                    const DescriptorBinding& binding = descriptor_set_layout->bindings[ b ];
-                    
-                    pass.name_hash_to_descriptor_index.insert( hash_calculate( binding.name ), ( u16 )binding.index );
-                }
-            }
+            cache_descriptor_names( gpu, pass );
 
             RASSERT( pass_creation.name );
             technique->name_hash_to_index.insert( hash_calculate( pass_creation.name ), ( u32 )i );
@@ -295,6 +301,42 @@ GpuTechnique* Renderer::create_technique( const GpuTechniqueCreation& creation )
     return technique;
 }
 
+bool Renderer::reload_technique( GpuTechnique* technique, const GpuTechniqueCreation& creation ) {
+    // Passes are matched by name, a creation adding passes needs a new technique.
+    for ( u32 i = 0; i < creation.num_creations; ++i ) {
+        if ( creation.creations[ i ].name == nullptr || technique->get_pass_index( creation.creations[ i ].name ) == u16_max ) {
+            return false;
+        }
+    }
+
+    temporary_allocator.clear();
+
+    StringBuffer pipeline_cache_path;
+    pipeline_cache_path.init( 2048, &temporary_allocator );
+
+    // Passes missing from the creation failed to compile, they keep the previous pipeline.
+    for ( u32 i = 0; i < creation.num_creations; ++i ) {
+        const PipelineCreation& pass_creation = creation.creations[ i ];
+        GpuTechniquePass& pass = technique->passes[ technique->get_pass_index( pass_creation.name ) ];
+
+        char* cache_path = pipeline_cache_path.append_use_f( "%s/%s.cache", resource_cache.binary_data_folder, pass_creation.name );
+        PipelineHandle pipeline = gpu->create_pipeline( pass_creation, cache_path );
+        if ( pipeline.index == k_invalid_index ) {
+            rprint( "Cannot reload pass %s of technique %s, keeping the previous pipeline\n", pass_creation.name, creation.name );
+            continue;
+        }
+
+        gpu->replace_pipeline( pass.pipeline, pipeline );
+
+        pass.name_hash_to_descriptor_index.clear();
+        cache_descriptor_names( gpu, pass );
+    }
+
+    temporary_allocator.clear();
+
+    return true;
+}
+
 Material* Renderer::create_material( const MaterialCreation& creation ) {
     Material* material = materials.obtain();
     if ( material ) {
@@ -208,6 +208,9 @@ struct Renderer : public Service {
     SamplerResource*            create_sampler( const SamplerCreation& creation );
 
     GpuTechnique*               create_technique( const GpuTechniqueCreation& creation );
+    // Recreates the pipelines of the technique passes in place, keeping their handles valid.
+    // Returns false if the creation has passes the technique does not have.
+    bool                        reload_technique( GpuTechnique* technique, const GpuTechniqueCreation& creation );
 
     Material*                   create_material( const MaterialCreation& creation );
     Material*                   create_material( GpuTechnique* technique, cstring name );
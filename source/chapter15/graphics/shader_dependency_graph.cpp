@@ -0,0 +1,343 @@
+#include "graphics/shader_dependency_graph.hpp"
+
+#include "foundation/assert.hpp"
+#include "foundation/log.hpp"
+
+#include "external/json.hpp"
+
+namespace raptor {
+
+u64 shader_stage_key( cstring technique_name, cstring pipeline_name, cstring stage_name ) {
+    u64 key = hash_calculate( technique_name, 0 );
+    key = hash_calculate( pipeline_name, key );
+    return hash_calculate( stage_name, key );
+}
+
+// ShaderDependencyGraph //////////////////////////////////////////////////
+
+void ShaderDependencyGraph::init( Allocator* allocator_, u32 initial_capacity ) {
+    allocator = allocator_;
+
+    files.init( allocator, initial_capacity );
+    stages.init( allocator, initial_capacity );
+    techniques.init( allocator, 16 );
+
+    name_to_file.init( allocator, initial_capacity );
+    name_to_file.set_default_value( u32_max );
+
+    names.init( rkilo( 32 ), allocator );
+
+    visit_index = 0;
+}
+
+void ShaderDependencyGraph::shutdown() {
+    for ( u32 f = 0; f < files.size; ++f ) {
+        files[ f ].includes.shutdown();
+        files[ f ].included_by.shutdown();
+        files[ f ].stages.shutdown();
+    }
+    for ( u32 t = 0; t < techniques.size; ++t ) {
+        techniques[ t ].stages.shutdown();
+    }
+
+    files.shutdown();
+    stages.shutdown();
+    techniques.shutdown();
+    name_to_file.shutdown();
+    names.shutdown();
+}
+
+u32 ShaderDependencyGraph::find_file( cstring name ) {
+    return name_to_file.get( hash_calculate( name, 0 ) );
+}
+
+u32 ShaderDependencyGraph::find_file( u64 name_hash ) {
+    return name_to_file.get( name_hash );
+}
+
+u32 ShaderDependencyGraph::add_file( cstring name ) {
+    const u64 name_hash = hash_calculate( name, 0 );
+    u32 file_index = name_to_file.get( name_hash );
+    if ( file_index != u32_max ) {
+        return file_index;
+    }
+
+    file_index = files.size;
+
+    ShaderDependencyFile& file = files.push_use();
+    file = ShaderDependencyFile();
+    file.name = names.append_use( name );
+    file.includes.init( allocator, 4 );
+    file.included_by.init( allocator, 4 );
+    file.stages.init( allocator, 4 );
+
+    name_to_file.insert( name_hash, file_index );
+
+    return file_index;
+}
+
+static void remove_index( Array<u32>& indices, u32 index ) {
+    for ( u32 i = 0; i < indices.size; ++i ) {
+        if ( indices[ i ] == index ) {
+            indices.delete_swap( i );
+            return;
+        }
+    }
+}
+
+static void add_stage_file( ShaderDependencyGraph& graph, u32 stage, u32 file ) {
+    Array<u32>& file_stages = graph.files[ file ].stages;
+    for ( u32 i = 0; i < file_stages.size; ++i ) {
+        if ( file_stages[ i ] == stage ) {
+            return;
+        }
+    }
+    file_stages.push( stage );
+}
+
+u32 ShaderDependencyGraph::add_technique( cstring json_name, cstring json_text ) {
+    using json = nlohmann::json;
+
+    // A json being edited can be broken, keep the previous stages until it parses.
+    json json_data = json::parse( json_text, nullptr, false );
+    if ( json_data.is_discarded() ) {
+        rprint( "Shader dependencies: cannot parse technique %s\n", json_name );
+        return u32_max;
+    }
+
+    std::string technique_name;
+    if ( json_data[ "name" ].is_string() ) {
+        json_data[ "name" ].get_to( technique_name );
+    }
+
+    const u32 json_file = add_file( json_name );
+
+    u32 technique_index = files[ json_file ].technique;
+    if ( technique_index == u32_max ) {
+        technique_index = techniques.size;
+        files[ json_file ].technique = technique_index;
+
+        ShaderDependencyTechnique& technique = techniques.push_use();
+        technique = ShaderDependencyTechnique();
+        technique.json_file = json_file;
+        technique.stages.init( allocator, 8 );
+    } else {
+        // Detach the previous stages, they will be added again from the new json.
+        ShaderDependencyTechnique& technique = techniques[ technique_index ];
+        for ( u32 s = 0; s < technique.stages.size; ++s ) {
+            const u32 stage = technique.stages[ s ];
+            stages[ stage ].technique = u32_max;
+            stages[ stage ].dirty = false;
+
+            for ( u32 f = 0; f < files.size; ++f ) {
+                remove_index( files[ f ].stages, stage );
+            }
+        }
+        technique.stages.clear();
+    }
+
+    techniques[ technique_index ].name = names.append_use( technique_name.c_str() );
+
+    json pipelines = json_data[ "pipelines" ];
+    if ( !pipelines.is_array() ) {
+        return technique_index;
+    }
+
+    for ( sizet p = 0; p < pipelines.size(); ++p ) {
+        json pipeline = pipelines[ p ];
+
+        std::string pipeline_name;
+        if ( pipeline[ "name" ].is_string() ) {
+            pipeline[ "name" ].get_to( pipeline_name );
+        }
+
+        json shaders = pipeline[ "shaders" ];
+        if ( !shaders.is_array() ) {
+            continue;
+        }
+
+        for ( sizet s = 0; s < shaders.size(); ++s ) {
+            json shader_stage = shaders[ s ];
+
+            std::string stage_name;
+            if ( shader_stage[ "stage" ].is_string() ) {
+                shader_stage[ "stage" ].get_to( stage_name );
+            }
+
+            const u32 stage_index = stages.size;
+            ShaderDependencyStage& stage = stages.push_use();
+            stage.key = shader_stage_key( technique_name.c_str(), pipeline_name.c_str(), stage_name.c_str() );
+            stage.technique = technique_index;
+            stage.dirty = false;
+
+            techniques[ technique_index ].stages.push( stage_index );
+
+            std::string file_name;
+
+            json includes = shader_stage[ "includes" ];
+            if ( includes.is_array() ) {
+                for ( sizet i = 0; i < includes.size(); ++i ) {
+                    includes[ i ].get_to( file_name );
+                    add_stage_file( *this, stage_index, add_file( file_name.c_str() ) );
+                }
+            }
+
+            if ( shader_stage[ "shader" ].is_string() ) {
+                shader_stage[ "shader" ].get_to( file_name );
+                add_stage_file( *this, stage_index, add_file( file_name.c_str() ) );
+            }
+        }
+    }
+
+    return technique_index;
+}
+
+void ShaderDependencyGraph::scan_includes( u32 file_index, cstring source ) {
+    // Drop the previous edges.
+    Array<u32>& old_includes = files[ file_index ].includes;
+    for ( u32 i = 0; i < old_includes.size; ++i ) {
+        remove_index( files[ old_includes[ i ] ].included_by, file_index );
+    }
+    old_includes.clear();
+
+    files[ file_index ].scanned = true;
+
+    if ( !source ) {
+        return;
+    }
+
+    char include_name[ 256 ];
+    cstring line = source;
+    while ( *line ) {
+        cstring c = line;
+        while ( *c == ' ' || *c == '\t' ) {
+            ++c;
+        }
+
+        if ( strncmp( c, "#include", 8 ) == 0 ) {
+            c += 8;
+            while ( *c == ' ' || *c == '\t' ) {
+                ++c;
+            }
+
+            const char terminator = *c == '<' ? '>' : '"';
+            if ( *c == '"' || *c == '<' ) {
+                ++c;
+
+                u32 length = 0;
+                while ( c[ length ] && c[ length ] != terminator && c[ length ] != '\n' && length < ArraySize( include_name ) - 1 ) {
+                    include_name[ length ] = c[ length ];
+                    ++length;
+                }
+                include_name[ length ] = 0;
+
+                if ( length && c[ length ] == terminator ) {
+                    // Adding a file can grow the array, do not keep references across it.
+                    const u32 included = add_file( include_name );
+                    if ( included != file_index ) {
+                        Array<u32>& includes = files[ file_index ].includes;
+
+                        bool present = false;
+                        for ( u32 i = 0; i < includes.size; ++i ) {
+                            present = present || includes[ i ] == included;
+                        }
+
+                        if ( !present ) {
+                            includes.push( included );
+                            files[ included ].included_by.push( file_index );
+                        }
+                    }
+                }
+            }
+        }
+
+        // Next line
+        while ( *line && *line != '\n' ) {
+            ++line;
+        }
+        if ( *line ) {
+            ++line;
+        }
+    }
+}
+
+u32 ShaderDependencyGraph::invalidate( u32 file_index ) {
+    if ( file_index >= files.size ) {
+        return 0;
+    }
+
+    // Visit stamps avoid clearing flags and protect against include cycles.
+    ++visit_index;
+
+    u32 marked_stages = 0;
+
+    // A changed technique json invalidates all of its stages.
+    const u32 json_technique = files[ file_index ].technique;
+    if ( json_technique != u32_max ) {
+        ShaderDependencyTechnique& technique = techniques[ json_technique ];
+        for ( u32 s = 0; s < technique.stages.size; ++s ) {
+            ShaderDependencyStage& stage = stages[ technique.stages[ s ] ];
+            marked_stages += stage.dirty ? 0 : 1;
+            stage.dirty = true;
+        }
+        technique.dirty = true;
+    }
+
+    // Walk the files including this one, up to the files listed by the stages.
+    u32 stack[ 256 ];
+    u32 stack_size = 0;
+
+    files[ file_index ].visit = visit_index;
+    stack[ stack_size++ ] = file_index;
+
+    while ( stack_size ) {
+        ShaderDependencyFile& file = files[ stack[ --stack_size ] ];
+
+        for ( u32 s = 0; s < file.stages.size; ++s ) {
+            ShaderDependencyStage& stage = stages[ file.stages[ s ] ];
+            if ( stage.technique == u32_max ) {
+                continue;
+            }
+
+            marked_stages += stage.dirty ? 0 : 1;
+            stage.dirty = true;
+            techniques[ stage.technique ].dirty = true;
+        }
+
+        for ( u32 i = 0; i < file.included_by.size; ++i ) {
+            const u32 including = file.included_by[ i ];
+            if ( files[ including ].visit == visit_index ) {
+                continue;
+            }
+
+            RASSERTM( stack_size < ArraySize( stack ), "Shader include graph is too deep" );
+            files[ including ].visit = visit_index;
+            stack[ stack_size++ ] = including;
+        }
+    }
+
+    return marked_stages;
+}
+
+void ShaderDependencyGraph::collect_dirty( Array<u32>& out_techniques, Array<u64>& out_stages ) {
+    for ( u32 t = 0; t < techniques.size; ++t ) {
+        ShaderDependencyTechnique& technique = techniques[ t ];
+        if ( !technique.dirty ) {
+            continue;
+        }
+
+        out_techniques.push( t );
+
+        for ( u32 s = 0; s < technique.stages.size; ++s ) {
+            ShaderDependencyStage& stage = stages[ technique.stages[ s ] ];
+            if ( stage.dirty ) {
+                out_stages.push( stage.key );
+                stage.dirty = false;
+            }
+        }
+
+        technique.dirty = false;
+    }
+}
+
+} // namespace raptor
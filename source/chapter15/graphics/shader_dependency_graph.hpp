@@ -0,0 +1,89 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/hash_map.hpp"
+#include "foundation/string.hpp"
+
+namespace raptor {
+
+struct Allocator;
+
+// Identifies a shader stage of a technique pipeline, e.g. main / gbuffer_cull / fragment.
+u64                                 shader_stage_key( cstring technique_name, cstring pipeline_name, cstring stage_name );
+
+//
+// Shader source or technique json, named relative to the shader folder.
+struct ShaderDependencyFile {
+
+    cstring                         name                    = nullptr;
+
+    Array<u32>                      includes;               // Files referenced by #include directives.
+    Array<u32>                      included_by;
+    Array<u32>                      stages;                 // Stages concatenating this file.
+
+    u32                             technique               = u32_max;  // Technique described by this file, if a json.
+    u32                             visit                   = 0;
+    bool                            scanned                 = false;    // Includes were parsed from the source.
+
+}; // struct ShaderDependencyFile
+
+//
+//
+struct ShaderDependencyStage {
+
+    u64                             key                     = 0;        // shader_stage_key
+    u32                             technique               = u32_max;  // u32_max when the technique json dropped the stage.
+    bool                            dirty                   = false;
+
+}; // struct ShaderDependencyStage
+
+//
+//
+struct ShaderDependencyTechnique {
+
+    cstring                         name                    = nullptr;
+    u32                             json_file               = u32_max;
+
+    Array<u32>                      stages;
+    bool                            dirty                   = false;
+
+}; // struct ShaderDependencyTechnique
+
+//
+// Maps shader files to the technique stages that are compiled from them, following the files listed by the technique
+// jsons and the #include directives of the sources. Changed files mark the stages using them as dirty, so only those
+// are compiled again. Does not read files: sources and jsons are passed by the caller.
+struct ShaderDependencyGraph {
+
+    void                            init( Allocator* allocator, u32 initial_capacity );
+    void                            shutdown();
+
+    // Adds the stages of a technique json, replacing the ones previously added from the same file.
+    // Returns the technique index, or u32_max if the json cannot be parsed.
+    u32                             add_technique( cstring json_name, cstring json_text );
+    // Replaces the #include dependencies of a file with the ones found in its source.
+    void                            scan_includes( u32 file, cstring source );
+
+    // Marks the stages using the file, directly or through includes, as dirty. Returns the number of stages marked.
+    u32                             invalidate( u32 file );
+
+    // Appends the dirty techniques and the keys of their dirty stages, and clears the dirty flags.
+    void                            collect_dirty( Array<u32>& out_techniques, Array<u64>& out_stages );
+
+    u32                             find_file( cstring name );
+    u32                             find_file( u64 name_hash );
+    u32                             add_file( cstring name );
+
+    Array<ShaderDependencyFile>     files;
+    Array<ShaderDependencyStage>    stages;
+    Array<ShaderDependencyTechnique> techniques;
+
+    FlatHashMap<u64, u32>           name_to_file;
+    StringBuffer                    names;
+
+    Allocator*                      allocator               = nullptr;
+    u32                             visit_index             = 0;
+
+}; // struct ShaderDependencyGraph
+
+} // namespace raptor
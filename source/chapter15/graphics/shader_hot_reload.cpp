@@ -0,0 +1,320 @@
+#include "graphics/shader_hot_reload.hpp"
+
+#include "foundation/assert.hpp"
+#include "foundation/log.hpp"
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#elif defined(_WIN64)
+#include <windows.h>
+#endif // __linux__
+
+#include <string.h>
+
+namespace raptor {
+
+// FileWatcher ////////////////////////////////////////////////////////////
+
+void FileWatcher::init( cstring directory_ ) {
+    strncpy( directory, directory_, k_max_path - 1 );
+    directory[ k_max_path - 1 ] = 0;
+
+    num_changes = 0;
+    lost_changes = false;
+    running = false;
+
+#if defined(__linux__)
+    inotify_descriptor = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    if ( inotify_descriptor < 0 ) {
+        rprint( "File watcher: cannot initialize inotify\n" );
+        return;
+    }
+
+    // Editors either write the file in place or move a new file over it.
+    if ( inotify_add_watch( inotify_descriptor, directory, IN_CLOSE_WRITE | IN_MOVED_TO ) < 0 ) {
+        rprint( "File watcher: cannot watch %s\n", directory );
+        close( inotify_descriptor );
+        inotify_descriptor = -1;
+        return;
+    }
+#elif defined(_WIN64)
+    directory_handle = CreateFileA( directory, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                    nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr );
+    if ( directory_handle == INVALID_HANDLE_VALUE ) {
+        rprint( "File watcher: cannot watch %s\n", directory );
+        directory_handle = nullptr;
+        return;
+    }
+#else
+    rprint( "File watcher: not supported on this platform\n" );
+    return;
+#endif // __linux__
+
+    running = true;
+    thread = std::thread( &FileWatcher::run, this );
+}
+
+void FileWatcher::shutdown() {
+    if ( !running ) {
+        return;
+    }
+
+    running = false;
+
+#if defined(_WIN64)
+    // Wakes up the thread waiting for changes.
+    CancelIoEx( directory_handle, nullptr );
+#endif // _WIN64
+
+    thread.join();
+
+#if defined(__linux__)
+    close( inotify_descriptor );
+    inotify_descriptor = -1;
+#elif defined(_WIN64)
+    CloseHandle( directory_handle );
+    directory_handle = nullptr;
+#endif // __linux__
+}
+
+bool FileWatcher::get_changes( Array<u64>& out_name_hashes ) {
+    std::lock_guard<std::mutex> guard( mutex );
+
+    for ( u32 i = 0; i < num_changes; ++i ) {
+        out_name_hashes.push( changes[ i ] );
+    }
+    num_changes = 0;
+
+    const bool complete = !lost_changes;
+    lost_changes = false;
+    return complete;
+}
+
+void FileWatcher::add_change( cstring name ) {
+    const u64 name_hash = hash_calculate( name, 0 );
+
+    std::lock_guard<std::mutex> guard( mutex );
+
+    // Saving a file usually sends more than one event.
+    for ( u32 i = 0; i < num_changes; ++i ) {
+        if ( changes[ i ] == name_hash ) {
+            return;
+        }
+    }
+
+    if ( num_changes == k_file_watcher_max_changes ) {
+        lost_changes = true;
+        return;
+    }
+
+    changes[ num_changes++ ] = name_hash;
+}
+
+void FileWatcher::run() {
+#if defined(__linux__)
+    alignas( struct inotify_event ) char buffer[ 4096 ];
+
+    while ( running ) {
+        // Wake up periodically to check if the watcher is shut down.
+        pollfd poll_descriptor = { inotify_descriptor, POLLIN, 0 };
+        if ( poll( &poll_descriptor, 1, 100 ) <= 0 ) {
+            continue;
+        }
+
+        const ssize_t length = read( inotify_descriptor, buffer, sizeof( buffer ) );
+        if ( length <= 0 ) {
+            continue;
+        }
+
+        for ( char* current = buffer; current < buffer + length; ) {
+            const struct inotify_event* event = ( const struct inotify_event* )current;
+            if ( event->len && ( event->mask & IN_ISDIR ) == 0 ) {
+                add_change( event->name );
+            }
+
+            current += sizeof( struct inotify_event ) + event->len;
+        }
+    }
+#elif defined(_WIN64)
+    alignas( DWORD ) u8 buffer[ 4096 ];
+    char name[ k_max_path ];
+
+    while ( running ) {
+        DWORD length = 0;
+        if ( !ReadDirectoryChangesW( directory_handle, buffer, sizeof( buffer ), FALSE,
+                                     FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, &length, nullptr, nullptr ) ) {
+            // Cancelled by shutdown.
+            break;
+        }
+
+        if ( length == 0 ) {
+            // Buffer overflow, the changes are unknown.
+            std::lock_guard<std::mutex> guard( mutex );
+            lost_changes = true;
+            continue;
+        }
+
+        for ( u8* current = buffer; ; ) {
+            const FILE_NOTIFY_INFORMATION* information = ( const FILE_NOTIFY_INFORMATION* )current;
+
+            if ( information->Action == FILE_ACTION_MODIFIED || information->Action == FILE_ACTION_ADDED ||
+                 information->Action == FILE_ACTION_RENAMED_NEW_NAME ) {
+                const int name_length = WideCharToMultiByte( CP_UTF8, 0, information->FileName, information->FileNameLength / sizeof( WCHAR ),
+                                                             name, k_max_path - 1, nullptr, nullptr );
+                name[ name_length ] = 0;
+
+                add_change( name );
+            }
+
+            if ( information->NextEntryOffset == 0 ) {
+                break;
+            }
+            current += information->NextEntryOffset;
+        }
+    }
+#endif // __linux__
+}
+
+// ShaderHotReloader //////////////////////////////////////////////////////
+
+void ShaderHotReloader::init( Allocator* allocator_, RenderResourcesLoader* loader_, cstring* technique_files, u32 num_technique_files,
+                              bool use_shader_cache_ ) {
+    allocator = allocator_;
+    loader = loader_;
+    use_shader_cache = use_shader_cache_;
+    stats = ShaderHotReloadStats();
+
+    graph.init( allocator, 64 );
+
+    compile_allocator.init( rmega( 32 ) );
+    compile_context.allocator = &compile_allocator;
+    compile_context.temp_file_prefix = "hot_reload_";
+    compile_context.dirty_stages = &pending_stages;
+
+    pending_techniques.init( allocator, 16 );
+    pending_stages.init( allocator, 16 );
+    changes.init( allocator, k_file_watcher_max_changes );
+
+    for ( u32 t = 0; t < num_technique_files; ++t ) {
+        read_dependencies( graph.add_file( technique_files[ t ] ) );
+    }
+
+    watcher.init( RAPTOR_SHADER_FOLDER );
+}
+
+void ShaderHotReloader::shutdown() {
+    watcher.shutdown();
+    graph.shutdown();
+
+    compile_allocator.shutdown();
+
+    pending_techniques.shutdown();
+    pending_stages.shutdown();
+    changes.shutdown();
+}
+
+bool ShaderHotReloader::read_dependencies( u32 file ) {
+    StackAllocator* temp_allocator = loader->temp_allocator;
+    sizet marker = temp_allocator->get_marker();
+
+    StringBuffer path_buffer;
+    path_buffer.init( k_max_path, temp_allocator );
+    cstring path = path_buffer.append_use_f( "%s%s", RAPTOR_SHADER_FOLDER, graph.files[ file ].name );
+
+    FileReadResult read_result = file_read_text( path, temp_allocator );
+
+    bool valid = read_result.data != nullptr;
+
+    const u32 num_files = graph.files.size;
+    if ( strstr( graph.files[ file ].name, ".json" ) ) {
+        graph.files[ file ].scanned = true;
+        valid = valid && graph.add_technique( graph.files[ file ].name, read_result.data ) != u32_max;
+    } else {
+        graph.scan_includes( file, read_result.data );
+    }
+
+    temp_allocator->free_marker( marker );
+
+    // Files seen for the first time, e.g. a header included by a changed source.
+    for ( u32 f = num_files; f < graph.files.size; ++f ) {
+        if ( !graph.files[ f ].scanned ) {
+            read_dependencies( f );
+        }
+    }
+
+    return valid;
+}
+
+u32 ShaderHotReloader::update() {
+    changes.clear();
+    if ( !watcher.get_changes( changes ) ) {
+        // Unknown changes, check everything.
+        changes.clear();
+        for ( u32 f = 0; f < graph.files.size; ++f ) {
+            changes.push( hash_calculate( graph.files[ f ].name, 0 ) );
+        }
+    }
+
+    for ( u32 c = 0; c < changes.size; ++c ) {
+        const u32 file = graph.find_file( changes[ c ] );
+        if ( file == u32_max ) {
+            continue;
+        }
+
+        ++stats.file_changes;
+
+        // Files being written can be incomplete, wait for the next change.
+        if ( read_dependencies( file ) ) {
+            stats.dirty_stages += graph.invalidate( file );
+        }
+    }
+
+    // Accumulate, dirty techniques beyond the ones compiled by this call wait for the next ones.
+    const u32 first_new_technique = pending_techniques.size;
+    graph.collect_dirty( pending_techniques, pending_stages );
+    for ( u32 t = first_new_technique; t < pending_techniques.size; ++t ) {
+        for ( u32 p = 0; p < first_new_technique; ++p ) {
+            if ( pending_techniques[ p ] == pending_techniques[ t ] ) {
+                pending_techniques.delete_swap( t-- );
+                break;
+            }
+        }
+    }
+
+    u32 swapped_techniques = 0;
+    u32 compiled_techniques = 0;
+    while ( pending_techniques.size && compiled_techniques < k_shader_reload_max_techniques ) {
+        const ShaderDependencyTechnique& technique = graph.techniques[ pending_techniques.back() ];
+        pending_techniques.pop();
+
+        StringBuffer path_buffer;
+        path_buffer.init( k_max_path, &compile_allocator );
+        cstring path = path_buffer.append_use_f( "%s%s", RAPTOR_SHADER_FOLDER, graph.files[ technique.json_file ].name );
+
+        // The previous frame is recorded, the pipelines can be swapped right away.
+        compile_creation.reset();
+        bool changed = false;
+        loader->parse_gpu_technique( compile_creation, path, use_shader_cache, changed, &compile_context );
+        if ( changed && compile_creation.num_creations ) {
+            loader->swap_gpu_technique( compile_creation );
+            ++swapped_techniques;
+        }
+
+        ++compiled_techniques;
+        compile_allocator.clear();
+    }
+
+    // Stages are identified by their technique, keep them until all the pending techniques are compiled.
+    if ( pending_techniques.size == 0 ) {
+        pending_stages.clear();
+    }
+
+    stats.compilations += compiled_techniques;
+    stats.swapped_techniques += swapped_techniques;
+
+    return swapped_techniques;
+}
+
+} // namespace raptor
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "graphics/render_resources_loader.hpp"
+#include "graphics/shader_dependency_graph.hpp"
+
+#include "foundation/file.hpp"
+#include "foundation/memory.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace raptor {
+
+static const u32                    k_file_watcher_max_changes          = 256;
+static const u32                    k_shader_reload_max_techniques      = 8;    // Per update, the frame waits for them.
+
+//
+// Watches the files of a directory from its own thread, using inotify on Linux and ReadDirectoryChangesW on Windows.
+// Changes are reported as hashes of the file names, relative to the directory.
+struct FileWatcher {
+
+    void                            init( cstring directory );
+    void                            shutdown();
+
+    // Moves the changes reported since the last call into out_name_hashes. Returns false if changes were lost
+    // because too many happened at once, in which case any file could have changed.
+    bool                            get_changes( Array<u64>& out_name_hashes );
+
+    // Watcher thread.
+    void                            run();
+    void                            add_change( cstring name );
+
+    char                            directory[ k_max_path ];
+
+    std::thread                     thread;
+    std::mutex                      mutex;
+    std::atomic<bool>               running;
+
+    u64                             changes[ k_file_watcher_max_changes ];
+    u32                             num_changes             = 0;
+    bool                            lost_changes            = false;
+
+#if defined(__linux__)
+    int                             inotify_descriptor      = -1;
+#elif defined(_WIN64)
+    void*                           directory_handle        = nullptr;
+#endif // __linux__
+
+}; // struct FileWatcher
+
+//
+//
+struct ShaderHotReloadStats {
+
+    u32                             file_changes            = 0;
+    u32                             dirty_stages            = 0;
+    u32                             compilations            = 0;    // Techniques parsed again.
+    u32                             swapped_techniques      = 0;
+
+}; // struct ShaderHotReloadStats
+
+//
+// Recompiles the techniques depending on the shader files changed on disk. Stages to compile are found with the
+// dependency graph and compiled between frames on the main thread, like the shader variants: compilation runs
+// glslangValidator from the working directory with a shared output buffer and parsing reads the frame graph, so
+// only the file watching is done by another thread. The new pipelines replace the previous ones right away, while
+// the previous ones go through the deferred deletion queue.
+struct ShaderHotReloader {
+
+    void                            init( Allocator* allocator, RenderResourcesLoader* loader, cstring* technique_files, u32 num_technique_files,
+                                          bool use_shader_cache );
+    void                            shutdown();
+
+    // Call between frames. Compiles up to k_shader_reload_max_techniques dirty techniques and swaps their pipelines,
+    // the others wait for the next calls. Returns the number of swapped techniques: users caching resources derived
+    // from pipelines need to update them.
+    u32                             update();
+
+    // Reads the file and updates the dependencies it declares. Returns false if it cannot be read or parsed.
+    bool                            read_dependencies( u32 file );
+
+    ShaderDependencyGraph           graph;
+    FileWatcher                     watcher;
+
+    StackAllocator                  compile_allocator;
+    ShaderReloadContext             compile_context;
+    GpuTechniqueCreation            compile_creation;
+
+    Array<u32>                      pending_techniques;
+    Array<u64>                      pending_stages;
+    Array<u64>                      changes;
+
+    Allocator*                      allocator               = nullptr;
+    RenderResourcesLoader*          loader                  = nullptr;
+
+    ShaderHotReloadStats            stats;
+
+    bool                            use_shader_cache        = true;
+
+}; // struct ShaderHotReloader
+
+} // namespace raptor
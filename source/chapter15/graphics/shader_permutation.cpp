@@ -0,0 +1,294 @@
+#include "graphics/shader_permutation.hpp"
+
+#include "foundation/assert.hpp"
+#include "foundation/log.hpp"
+
+#include "external/json.hpp"
+
+namespace raptor {
+
+// ShaderFeatureSet ///////////////////////////////////////////////////////
+
+u32 ShaderFeatureSet::add( cstring name, bool specialization, bool enabled ) {
+    u32 bit = find( name );
+    if ( bit == u32_max ) {
+        if ( count == k_max_shader_features ) {
+            return u32_max;
+        }
+        bit = count++;
+    }
+
+    ShaderFeature& feature = features[ bit ];
+    feature.name = name;
+    feature.specialization = specialization;
+    feature.enabled = enabled;
+
+    return bit;
+}
+
+u32 ShaderFeatureSet::find( cstring name ) const {
+    for ( u32 i = 0; i < count; ++i ) {
+        if ( strcmp( features[ i ].name, name ) == 0 ) {
+            return i;
+        }
+    }
+    return u32_max;
+}
+
+u32 ShaderFeatureSet::default_mask() const {
+    u32 mask = 0;
+    for ( u32 i = 0; i < count; ++i ) {
+        mask |= features[ i ].enabled ? ( 1 << i ) : 0;
+    }
+    return mask;
+}
+
+u32 ShaderFeatureSet::specialization_mask() const {
+    u32 mask = 0;
+    for ( u32 i = 0; i < count; ++i ) {
+        mask |= features[ i ].specialization ? ( 1 << i ) : 0;
+    }
+    return mask;
+}
+
+u32 ShaderFeatureSet::define_mask( u32 feature_mask ) const {
+    const u32 valid_mask = count == 32 ? u32_max : ( 1u << count ) - 1;
+    return feature_mask & ~specialization_mask() & valid_mask;
+}
+
+bool shader_features_parse( ShaderFeatureSet& features, StringBuffer& names, cstring json_text, cstring* out_technique_name ) {
+    using json = nlohmann::json;
+
+    json json_data = json::parse( json_text, nullptr, false );
+    if ( json_data.is_discarded() ) {
+        return false;
+    }
+
+    if ( out_technique_name ) {
+        std::string technique_name;
+        if ( json_data[ "name" ].is_string() ) {
+            json_data[ "name" ].get_to( technique_name );
+        }
+        *out_technique_name = names.append_use( technique_name.c_str() );
+    }
+
+    json json_features = json_data[ "features" ];
+    if ( !json_features.is_array() ) {
+        return true;
+    }
+
+    for ( sizet f = 0; f < json_features.size(); ++f ) {
+        json feature = json_features[ f ];
+        if ( !feature[ "name" ].is_string() ) {
+            continue;
+        }
+
+        std::string name;
+        feature[ "name" ].get_to( name );
+
+        const bool specialization = feature[ "specialization" ].is_boolean() && feature[ "specialization" ].get<bool>();
+        const bool enabled = feature[ "default" ].is_boolean() && feature[ "default" ].get<bool>();
+
+        cstring feature_name = names.append_use( name.c_str() );
+        if ( !feature_name || features.add( feature_name, specialization, enabled ) == u32_max ) {
+            rprint( "Shader features: cannot add feature %s\n", name.c_str() );
+        }
+    }
+
+    return true;
+}
+
+cstring shader_features_defines( const ShaderFeatureSet& features, u32 feature_mask, StringBuffer& out_arguments ) {
+    char* arguments = out_arguments.current();
+
+    for ( u32 i = 0; i < features.count; ++i ) {
+        const ShaderFeature& feature = features.features[ i ];
+        if ( feature.specialization ) {
+            continue;
+        }
+        out_arguments.append_f( " --D %s=%u", feature.name, ( feature_mask >> i ) & 1 );
+    }
+    out_arguments.close_current_string();
+
+    return arguments;
+}
+
+u64 shader_pass_key( cstring technique_name, cstring pass_name ) {
+    return hash_calculate( pass_name, hash_calculate( technique_name, 0 ) );
+}
+
+u64 shader_variant_key( u64 pass_key, u32 feature_mask ) {
+    return hash_calculate( feature_mask, pass_key );
+}
+
+// ShaderVariantCache /////////////////////////////////////////////////////
+
+void ShaderVariantCache::init( Allocator* allocator, u32 initial_capacity ) {
+    variants.init( allocator, initial_capacity );
+    modules.init( allocator, initial_capacity );
+    pending_modules.init( allocator, initial_capacity );
+
+    variant_map.init( allocator, initial_capacity );
+    variant_map.set_default_value( u32_max );
+    module_map.init( allocator, initial_capacity );
+    module_map.set_default_value( u32_max );
+    spirv_map.init( allocator, initial_capacity );
+    spirv_map.set_default_value( u32_max );
+    pipeline_map.init( allocator, initial_capacity );
+    pipeline_map.set_default_value( u32_max );
+
+    names.init( rkilo( 8 ), allocator );
+
+    stats = ShaderVariantStats();
+}
+
+void ShaderVariantCache::shutdown() {
+    variants.shutdown();
+    modules.shutdown();
+    pending_modules.shutdown();
+
+    variant_map.shutdown();
+    module_map.shutdown();
+    spirv_map.shutdown();
+    pipeline_map.shutdown();
+
+    names.shutdown();
+}
+
+void ShaderVariantCache::clear() {
+    variants.clear();
+    modules.clear();
+    pending_modules.clear();
+
+    variant_map.clear();
+    module_map.clear();
+    spirv_map.clear();
+    pipeline_map.clear();
+
+    names.clear();
+}
+
+u32 ShaderVariantCache::request( cstring technique_name, cstring pass_name, const ShaderFeatureSet& features, u32 feature_mask ) {
+    ++stats.lookups;
+
+    const u64 pass_key = shader_pass_key( technique_name, pass_name );
+    const u64 variant_key = shader_variant_key( pass_key, feature_mask );
+
+    u32 variant_index = variant_map.get( variant_key );
+    if ( variant_index != u32_max ) {
+        return variant_index;
+    }
+
+    ++stats.requested_variants;
+
+    // Specialization constants do not change the module, only the #defines do.
+    const u32 define_mask = features.define_mask( feature_mask );
+    const u64 module_key = shader_variant_key( pass_key, define_mask );
+
+    u32 module_index = module_map.get( module_key );
+    if ( module_index == u32_max ) {
+        cstring technique_copy = names.append_use( technique_name );
+        cstring pass_copy = names.append_use( pass_name );
+        RASSERTM( technique_copy && pass_copy, "Shader variant names do not fit" );
+
+        module_index = modules.size;
+
+        ShaderVariantModule& module = modules.push_use();
+        module = ShaderVariantModule();
+        module.key = module_key;
+        module.pass_key = pass_key;
+        module.technique_name = technique_copy;
+        module.pass_name = pass_copy;
+        module.define_mask = define_mask;
+
+        module_map.insert( module_key, module_index );
+        pending_modules.push( module_index );
+
+        ++stats.requested_modules;
+    } else {
+        ++stats.specialized_variants;
+    }
+
+    variant_index = variants.size;
+
+    ShaderVariant& variant = variants.push_use();
+    variant = ShaderVariant();
+    variant.key = variant_key;
+    variant.feature_mask = feature_mask;
+    variant.specialization_mask = feature_mask & features.specialization_mask();
+    variant.module = module_index;
+
+    variant_map.insert( variant_key, variant_index );
+
+    return variant_index;
+}
+
+u32 ShaderVariantCache::find( u64 pass_key, u32 feature_mask ) {
+    return variant_map.get( shader_variant_key( pass_key, feature_mask ) );
+}
+
+u32 ShaderVariantCache::pop_pending_module() {
+    if ( pending_modules.size == 0 ) {
+        return u32_max;
+    }
+
+    // First requested, first compiled.
+    const u32 module_index = pending_modules[ 0 ];
+    for ( u32 i = 1; i < pending_modules.size; ++i ) {
+        pending_modules[ i - 1 ] = pending_modules[ i ];
+    }
+    pending_modules.pop();
+
+    modules[ module_index ].state = ShaderModuleState_Compiling;
+    return module_index;
+}
+
+u32 ShaderVariantCache::module_compiled( u32 module_index, u64 spirv_hash ) {
+    ShaderVariantModule& module = modules[ module_index ];
+    RASSERT( module.state == ShaderModuleState_Compiling );
+
+    // Passes with different pipeline states are never shared, even with the same code.
+    const u64 spirv_key = hash_calculate( spirv_hash, module.pass_key );
+
+    module.spirv_key = spirv_key;
+    module.state = ShaderModuleState_Ready;
+
+    ++stats.compiled_modules;
+
+    u32 spirv_module = spirv_map.get( spirv_key );
+    if ( spirv_module == u32_max ) {
+        spirv_module = module_index;
+        spirv_map.insert( spirv_key, module_index );
+    } else {
+        ++stats.deduplicated_spirv;
+    }
+
+    module.spirv_module = spirv_module;
+    return spirv_module;
+}
+
+void ShaderVariantCache::module_failed( u32 module_index ) {
+    modules[ module_index ].state = ShaderModuleState_Failed;
+    ++stats.failed_modules;
+}
+
+u64 ShaderVariantCache::pipeline_key( u32 variant_index ) const {
+    const ShaderVariant& variant = variants[ variant_index ];
+    const ShaderVariantModule& module = modules[ variant.module ];
+    RASSERT( module.state == ShaderModuleState_Ready );
+
+    return hash_calculate( variant.specialization_mask, module.spirv_key );
+}
+
+u32 ShaderVariantCache::find_pipeline( u64 key ) {
+    const u32 pipeline = pipeline_map.get( key );
+    stats.shared_pipelines += pipeline != u32_max ? 1 : 0;
+    return pipeline;
+}
+
+void ShaderVariantCache::add_pipeline( u64 key, u32 pipeline ) {
+    pipeline_map.insert( key, pipeline );
+    ++stats.created_pipelines;
+}
+
+} // namespace raptor
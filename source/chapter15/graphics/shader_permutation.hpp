@@ -0,0 +1,148 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/hash_map.hpp"
+#include "foundation/string.hpp"
+
+namespace raptor {
+
+struct Allocator;
+
+static const u32                    k_max_shader_features               = 16;   // Per technique, bits of a feature mask.
+
+//
+// Keyword listed in the "features" of a technique json. Features marked as specialization are specialization
+// constants with the same name, that do not need a new compilation; the others are #defines.
+struct ShaderFeature {
+
+    cstring                         name                    = nullptr;
+    bool                            specialization          = false;
+    bool                            enabled                 = false;    // Default value.
+
+}; // struct ShaderFeature
+
+//
+//
+struct ShaderFeatureSet {
+
+    // Returns the feature bit, or u32_max when the set is full.
+    u32                             add( cstring name, bool specialization, bool enabled );
+    u32                             find( cstring name ) const;
+
+    u32                             default_mask() const;
+    u32                             specialization_mask() const;
+    // Bits of the mask that need a compilation.
+    u32                             define_mask( u32 feature_mask ) const;
+
+    ShaderFeature                   features[ k_max_shader_features ];
+    u32                             count                   = 0;
+
+}; // struct ShaderFeatureSet
+
+// Adds the features listed by a technique json, returning the technique name too. Names are copied into the string
+// buffer. Returns false if the json cannot be parsed; a technique without features is valid.
+bool                                shader_features_parse( ShaderFeatureSet& features, StringBuffer& names, cstring json_text, cstring* out_technique_name = nullptr );
+// Appends the compiler arguments defining all the #define features, e.g. " --D FOG=1 --D SHADOWS=0".
+cstring                             shader_features_defines( const ShaderFeatureSet& features, u32 feature_mask, StringBuffer& out_arguments );
+
+u64                                 shader_pass_key( cstring technique_name, cstring pass_name );
+u64                                 shader_variant_key( u64 pass_key, u32 feature_mask );
+
+// ShaderVariantCache /////////////////////////////////////////////////////
+
+//
+//
+enum ShaderModuleState : u8 {
+    ShaderModuleState_Pending = 0,
+    ShaderModuleState_Compiling,
+    ShaderModuleState_Ready,
+    ShaderModuleState_Failed
+};
+
+//
+// Compilation of a pass with a combination of #define features. Variants differing only by specialization
+// constants share their module.
+struct ShaderVariantModule {
+
+    u64                             key                     = 0;        // shader_variant_key( pass_key, define mask )
+    u64                             pass_key                = 0;
+    u64                             spirv_key               = 0;        // Content hash of the stages, once compiled.
+
+    cstring                         technique_name          = nullptr;
+    cstring                         pass_name               = nullptr;
+
+    u32                             define_mask             = 0;
+    u32                             spirv_module            = u32_max;  // First module compiled to the same Spir-V.
+    ShaderModuleState               state                   = ShaderModuleState_Pending;
+
+}; // struct ShaderVariantModule
+
+//
+//
+struct ShaderVariant {
+
+    u64                             key                     = 0;        // shader_variant_key( pass_key, feature mask )
+    u32                             feature_mask            = 0;
+    u32                             specialization_mask     = 0;
+    u32                             module                  = u32_max;
+    u32                             pipeline                = u32_max;  // User value, set once the pipeline exists.
+
+}; // struct ShaderVariant
+
+//
+//
+struct ShaderVariantStats {
+
+    u32                             lookups                 = 0;
+    u32                             requested_variants      = 0;
+    u32                             requested_modules       = 0;
+    u32                             compiled_modules        = 0;
+    u32                             failed_modules          = 0;
+    u32                             deduplicated_spirv      = 0;    // Modules compiled to a Spir-V already present.
+    u32                             specialized_variants    = 0;    // Variants reusing a module of another variant.
+    u32                             created_pipelines       = 0;
+    u32                             shared_pipelines        = 0;
+
+}; // struct ShaderVariantStats
+
+//
+// Bookkeeping of shader variants, independent of the device: variants are keyed by pass and feature mask, compiled
+// modules by pass and #define features, and pipelines by the content of the Spir-V and the specialization values,
+// so identical results are compiled and created once. Modules to compile are queued and taken by the caller.
+struct ShaderVariantCache {
+
+    void                            init( Allocator* allocator, u32 initial_capacity );
+    void                            shutdown();
+    void                            clear();
+
+    // Returns the variant index, adding the variant and queueing its module on first use.
+    u32                             request( cstring technique_name, cstring pass_name, const ShaderFeatureSet& features, u32 feature_mask );
+    u32                             find( u64 pass_key, u32 feature_mask );
+
+    // Next module to compile, or u32_max.
+    u32                             pop_pending_module();
+    // Returns the module holding the same Spir-V, which is the module itself for new content.
+    u32                             module_compiled( u32 module, u64 spirv_hash );
+    void                            module_failed( u32 module );
+
+    // Pipelines are shared by variants with the same Spir-V and specialization values.
+    u64                             pipeline_key( u32 variant ) const;
+    u32                             find_pipeline( u64 pipeline_key );
+    void                            add_pipeline( u64 pipeline_key, u32 pipeline );
+
+    Array<ShaderVariant>            variants;
+    Array<ShaderVariantModule>      modules;
+    Array<u32>                      pending_modules;
+
+    FlatHashMap<u64, u32>           variant_map;
+    FlatHashMap<u64, u32>           module_map;
+    FlatHashMap<u64, u32>           spirv_map;
+    FlatHashMap<u64, u32>           pipeline_map;
+
+    StringBuffer                    names;
+
+    ShaderVariantStats              stats;
+
+}; // struct ShaderVariantCache
+
+} // namespace raptor
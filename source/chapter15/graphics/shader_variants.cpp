@@ -0,0 +1,236 @@
+#include "graphics/shader_variants.hpp"
+
+#include "foundation/file.hpp"
+
+namespace raptor {
+
+// ShaderVariantManager ///////////////////////////////////////////////////
+
+void ShaderVariantManager::init( Allocator* allocator_, Renderer* renderer_, RenderResourcesLoader* loader_, bool use_shader_cache_ ) {
+    allocator = allocator_;
+    renderer = renderer_;
+    loader = loader_;
+    use_shader_cache = use_shader_cache_;
+
+    cache.init( allocator, 64 );
+
+    techniques.init( allocator, k_shader_variant_max_techniques );
+    module_creations.init( allocator, 64 );
+    pipelines.init( allocator, 64 );
+    names.init( rkilo( 4 ), allocator );
+
+    compile_allocator.init( rmega( 16 ) );
+}
+
+void ShaderVariantManager::shutdown() {
+    release_modules();
+
+    cache.shutdown();
+
+    techniques.shutdown();
+    module_creations.shutdown();
+    pipelines.shutdown();
+    names.shutdown();
+
+    compile_allocator.shutdown();
+}
+
+bool ShaderVariantManager::add_technique( cstring json_path ) {
+    StackAllocator* temp_allocator = loader->temp_allocator;
+    sizet marker = temp_allocator->get_marker();
+
+    FileReadResult read_result = file_read_text( json_path, temp_allocator );
+
+    ShaderVariantTechnique technique;
+    cstring technique_name = nullptr;
+
+    bool valid = read_result.data && shader_features_parse( technique.features, names, read_result.data, &technique_name );
+
+    temp_allocator->free_marker( marker );
+
+    if ( !valid || technique.features.count == 0 ) {
+        return false;
+    }
+
+    RASSERTM( techniques.size < k_shader_variant_max_techniques, "Too many techniques with shader variants" );
+
+    technique.name = technique_name;
+    technique.json_path = names.append_use( json_path );
+    techniques.push( technique );
+
+    return true;
+}
+
+ShaderVariantTechnique* ShaderVariantManager::find_technique( cstring technique_name ) {
+    for ( u32 t = 0; t < techniques.size; ++t ) {
+        if ( strcmp( techniques[ t ].name, technique_name ) == 0 ) {
+            return &techniques[ t ];
+        }
+    }
+    return nullptr;
+}
+
+u32 ShaderVariantManager::find_feature( cstring technique_name, cstring feature_name ) {
+    ShaderVariantTechnique* technique = find_technique( technique_name );
+    return technique ? technique->features.find( feature_name ) : u32_max;
+}
+
+u32 ShaderVariantManager::default_mask( cstring technique_name ) {
+    ShaderVariantTechnique* technique = find_technique( technique_name );
+    return technique ? technique->features.default_mask() : 0;
+}
+
+PipelineHandle ShaderVariantManager::get_pipeline( cstring technique_name, cstring pass_name, u32 feature_mask ) {
+    GpuTechnique* gpu_technique = renderer->resource_cache.techniques.get( hash_calculate( technique_name ) );
+    RASSERT( gpu_technique );
+
+    const u32 pass_index = gpu_technique->get_pass_index( pass_name );
+    PipelineHandle base_pipeline = gpu_technique->passes[ pass_index ].pipeline;
+
+    ShaderVariantTechnique* technique = find_technique( technique_name );
+    if ( !technique || feature_mask == technique->features.default_mask() ) {
+        return base_pipeline;
+    }
+
+    const u32 variant_index = cache.request( technique_name, pass_name, technique->features, feature_mask );
+    // Keep the creations parallel to the modules.
+    while ( module_creations.size < cache.modules.size ) {
+        module_creations.push( PipelineCreation() );
+    }
+
+    ShaderVariant& variant = cache.variants[ variant_index ];
+    if ( variant.pipeline != u32_max ) {
+        return { variant.pipeline };
+    }
+
+    const ShaderVariantModule& module = cache.modules[ variant.module ];
+    if ( module.state != ShaderModuleState_Ready ) {
+        // Still compiling, or failed.
+        return base_pipeline;
+    }
+
+    const u64 pipeline_key = cache.pipeline_key( variant_index );
+    u32 pipeline_index = cache.find_pipeline( pipeline_key );
+    if ( pipeline_index == u32_max ) {
+        PipelineCreation creation = module_creations[ module.spirv_module ];
+
+        creation.shaders.specializations_count = 0;
+        for ( u32 f = 0; f < technique->features.count; ++f ) {
+            const ShaderFeature& feature = technique->features.features[ f ];
+            if ( feature.specialization ) {
+                creation.shaders.add_specialization( feature.name, ( feature_mask >> f ) & 1 );
+            }
+        }
+
+        PipelineHandle pipeline = renderer->gpu->create_pipeline( creation );
+        if ( pipeline.index == k_invalid_index ) {
+            rprint( "Cannot create variant %x of pass %s, technique %s\n", feature_mask, pass_name, technique_name );
+            // Do not try again every frame.
+            variant.pipeline = base_pipeline.index;
+            return base_pipeline;
+        }
+
+        pipelines.push( pipeline );
+
+        pipeline_index = pipeline.index;
+        cache.add_pipeline( pipeline_key, pipeline_index );
+    }
+
+    variant.pipeline = pipeline_index;
+    return { pipeline_index };
+}
+
+void ShaderVariantManager::update() {
+    for ( u32 c = 0; c < k_shader_variant_max_compilations; ++c ) {
+        const u32 module_index = cache.pop_pending_module();
+        if ( module_index == u32_max ) {
+            break;
+        }
+
+        // Compiled data of the previous module is copied already.
+        compile_allocator.clear();
+
+        const ShaderVariantModule& module = cache.modules[ module_index ];
+        ShaderVariantTechnique* technique = find_technique( module.technique_name );
+
+        StringBuffer arguments_buffer;
+        arguments_buffer.init( 512, &compile_allocator );
+
+        compile_context = ShaderReloadContext();
+        compile_context.allocator = &compile_allocator;
+        compile_context.temp_file_prefix = "variant_";
+        compile_context.pass_name = arguments_buffer.append_use( module.pass_name );
+
+        // The default #defines are the ones of the technique pipelines, use their cached Spir-V.
+        if ( module.define_mask != technique->features.define_mask( technique->features.default_mask() ) ) {
+            compile_context.defines = shader_features_defines( technique->features, module.define_mask, arguments_buffer );
+            compile_context.cache_suffix = arguments_buffer.append_use_f( "_variant_%x", module.define_mask );
+        }
+
+        compile_creation.reset();
+        bool changed = false;
+        loader->parse_gpu_technique( compile_creation, technique->json_path, use_shader_cache, changed, &compile_context );
+
+        if ( compile_creation.num_creations == 0 ) {
+            rprint( "Cannot compile variant of pass %s, technique %s\n", module.pass_name, module.technique_name );
+            cache.module_failed( module_index );
+            continue;
+        }
+
+        const PipelineCreation& compiled = compile_creation.creations[ 0 ];
+
+        u64 spirv_hash = 0;
+        for ( u32 s = 0; s < compiled.shaders.stages_count; ++s ) {
+            const ShaderStage& stage = compiled.shaders.stages[ s ];
+            spirv_hash = hash_bytes( ( void* )stage.code, stage.code_size, spirv_hash );
+        }
+
+        const u32 spirv_module = cache.module_compiled( module_index, spirv_hash );
+        if ( spirv_module != module_index ) {
+            // Same code of another module, share its creation.
+            module_creations[ module_index ] = module_creations[ spirv_module ];
+            continue;
+        }
+
+        // Compiled data lives in the compile allocator, keep a copy for the pipelines created later.
+        PipelineCreation& creation = module_creations[ module_index ];
+        creation = compiled;
+        creation.name = names.append_use( compiled.name );
+        creation.shaders.name = creation.name;
+
+        for ( u32 s = 0; s < creation.shaders.stages_count; ++s ) {
+            ShaderStage& stage = creation.shaders.stages[ s ];
+
+            char* code = ( char* )rallocaa( stage.code_size, allocator, 4 );
+            memcpy( code, compiled.shaders.stages[ s ].code, stage.code_size );
+            stage.code = code;
+        }
+    }
+}
+
+void ShaderVariantManager::release_modules() {
+    for ( u32 p = 0; p < pipelines.size; ++p ) {
+        renderer->gpu->destroy_pipeline( pipelines[ p ] );
+    }
+    pipelines.clear();
+
+    for ( u32 m = 0; m < cache.modules.size && m < module_creations.size; ++m ) {
+        // Only the first module with some Spir-V owns it.
+        if ( cache.modules[ m ].state != ShaderModuleState_Ready || cache.modules[ m ].spirv_module != m ) {
+            continue;
+        }
+
+        PipelineCreation& creation = module_creations[ m ];
+        for ( u32 s = 0; s < creation.shaders.stages_count; ++s ) {
+            rfree( ( void* )creation.shaders.stages[ s ].code, allocator );
+        }
+    }
+    module_creations.clear();
+}
+
+void ShaderVariantManager::reset() {
+    release_modules();
+    cache.clear();
+}
+
+} // namespace raptor
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "graphics/render_resources_loader.hpp"
+#include "graphics/shader_permutation.hpp"
+
+#include "foundation/memory.hpp"
+
+namespace raptor {
+
+static const u32                    k_shader_variant_max_techniques     = 16;
+static const u32                    k_shader_variant_max_compilations   = 2;    // Modules per update, the frame waits for them.
+
+//
+//
+struct ShaderVariantTechnique {
+
+    cstring                         json_path               = nullptr;
+    cstring                         name                    = nullptr;
+    ShaderFeatureSet                features;
+
+}; // struct ShaderVariantTechnique
+
+//
+// Pipelines of technique passes with a combination of features, created on first use. Passes keep the pipeline of
+// the technique until their variant is ready. #define features are compiled a few modules per update, between frames
+// on the main thread like the hot reloaded techniques, specialization features only create a new pipeline from an
+// existing module.
+// Features must not change the descriptor bindings, descriptor sets are shared with the technique pipeline.
+struct ShaderVariantManager {
+
+    void                            init( Allocator* allocator, Renderer* renderer, RenderResourcesLoader* loader, bool use_shader_cache );
+    void                            shutdown();
+
+    // Reads the features of a technique json, techniques without features have no variants.
+    bool                            add_technique( cstring json_path );
+    // Returns the feature bit, or u32_max if the technique does not have it.
+    u32                             find_feature( cstring technique_name, cstring feature_name );
+    u32                             default_mask( cstring technique_name );
+
+    // Call from the main thread, between frames or while recording.
+    PipelineHandle                  get_pipeline( cstring technique_name, cstring pass_name, u32 feature_mask );
+
+    // Call between frames: compiles up to k_shader_variant_max_compilations requested modules.
+    void                            update();
+    // Destroys all the variants, e.g. when the technique sources changed. They are created again when requested.
+    void                            reset();
+
+    ShaderVariantTechnique*         find_technique( cstring technique_name );
+    void                            release_modules();
+
+    ShaderVariantCache              cache;
+    Array<ShaderVariantTechnique>   techniques;
+    Array<PipelineCreation>         module_creations;   // Per cache module, with owned Spir-V once ready.
+    Array<PipelineHandle>           pipelines;
+    StringBuffer                    names;
+
+    StackAllocator                  compile_allocator;
+    ShaderReloadContext             compile_context;
+    GpuTechniqueCreation            compile_creation;
+
+    Allocator*                      allocator               = nullptr;
+    Renderer*                       renderer                = nullptr;
+    RenderResourcesLoader*          loader                  = nullptr;
+
+    bool                            use_shader_cache        = true;
+
+}; // struct ShaderVariantManager
+
+} // namespace raptor
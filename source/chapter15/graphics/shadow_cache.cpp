@@ -0,0 +1,204 @@
+#include "graphics/shadow_cache.hpp"
+
+#include "foundation/assert.hpp"
+
+#include "external/cglm/struct/vec3.h"
+#include "external/cglm/struct/vec4.h"
+
+#include <math.h>
+
+namespace raptor {
+
+// Faces are frustums with a far plane at the light radius, their corners are further away than the radius.
+static const f32                    k_cubemap_corner_scale  = 1.7320508f;
+
+static u32 count_faces( u32 faces ) {
+    u32 count = 0;
+    for ( ; faces; faces &= faces - 1 ) {
+        ++count;
+    }
+    return count;
+}
+
+static vec4s normalize_face_plane( vec4s plane ) {
+    const f32 length = sqrtf( plane.x * plane.x + plane.y * plane.y + plane.z * plane.z );
+    return glms_vec4_scale( plane, length > 0.f ? 1.f / length : 0.f );
+}
+
+static bool spheres_equal( vec4s a, vec4s b ) {
+    return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+// PointlightShadowCache //////////////////////////////////////////////////
+
+void PointlightShadowCache::init( Allocator* allocator, u32 max_lights, u32 initial_casters ) {
+    lights.init( allocator, max_lights, max_lights );
+    for ( u32 l = 0; l < max_lights; ++l ) {
+        lights[ l ] = ShadowCacheLight();
+    }
+
+    casters.init( allocator, initial_casters );
+
+    stats = ShadowCacheStats();
+    active_lights = 0;
+}
+
+void PointlightShadowCache::shutdown() {
+    lights.shutdown();
+    casters.shutdown();
+}
+
+void PointlightShadowCache::begin_frame( u32 active_lights_ ) {
+    RASSERT( active_lights_ <= lights.size );
+
+    // Inactive lights are not invalidated, their depth cannot be trusted when they are enabled again.
+    for ( u32 l = active_lights_; l < active_lights; ++l ) {
+        lights[ l ].valid = false;
+        lights[ l ].dirty_faces = k_shadow_cache_all_faces;
+    }
+
+    active_lights = active_lights_;
+
+    for ( u32 l = 0; l < active_lights; ++l ) {
+        lights[ l ].dynamic_faces = 0;
+    }
+
+    stats = ShadowCacheStats();
+    stats.lights = active_lights;
+}
+
+bool PointlightShadowCache::update_light( u32 light_index, vec3s position, f32 radius ) {
+    ShadowCacheLight& light = lights[ light_index ];
+
+    if ( light.valid && light.radius == radius && glms_vec3_eqv( light.position, position ) ) {
+        return false;
+    }
+
+    light.position = position;
+    light.radius = radius;
+    light.dirty_faces = k_shadow_cache_all_faces;
+    // Not valid until its faces are set.
+    light.valid = false;
+
+    ++stats.light_changes;
+    return true;
+}
+
+void PointlightShadowCache::set_light_faces( u32 light_index, const mat4s* face_view_projections ) {
+    ShadowCacheLight& light = lights[ light_index ];
+
+    for ( u32 f = 0; f < k_shadow_cache_faces; ++f ) {
+        const mat4s& m = face_view_projections[ f ];
+
+        const vec4s row0 = { m.raw[ 0 ][ 0 ], m.raw[ 1 ][ 0 ], m.raw[ 2 ][ 0 ], m.raw[ 3 ][ 0 ] };
+        const vec4s row1 = { m.raw[ 0 ][ 1 ], m.raw[ 1 ][ 1 ], m.raw[ 2 ][ 1 ], m.raw[ 3 ][ 1 ] };
+        const vec4s row2 = { m.raw[ 0 ][ 2 ], m.raw[ 1 ][ 2 ], m.raw[ 2 ][ 2 ], m.raw[ 3 ][ 2 ] };
+        const vec4s row3 = { m.raw[ 0 ][ 3 ], m.raw[ 1 ][ 3 ], m.raw[ 2 ][ 3 ], m.raw[ 3 ][ 3 ] };
+
+        vec4s* planes = light.face_planes[ f ];
+        planes[ 0 ] = normalize_face_plane( glms_vec4_add( row3, row0 ) );
+        planes[ 1 ] = normalize_face_plane( glms_vec4_sub( row3, row0 ) );
+        planes[ 2 ] = normalize_face_plane( glms_vec4_add( row3, row1 ) );
+        planes[ 3 ] = normalize_face_plane( glms_vec4_sub( row3, row1 ) );
+        // Near plane of a -1..1 depth range, conservative for 0..1 depth.
+        planes[ 4 ] = normalize_face_plane( glms_vec4_add( row3, row2 ) );
+        planes[ 5 ] = normalize_face_plane( glms_vec4_sub( row3, row2 ) );
+    }
+
+    light.valid = true;
+}
+
+void PointlightShadowCache::update_caster( u32 caster_index, vec4s world_sphere, bool dynamic ) {
+    while ( casters.size <= caster_index ) {
+        casters.push( ShadowCacheCaster() );
+    }
+
+    ShadowCacheCaster& caster = casters[ caster_index ];
+    const bool moved = !caster.valid || !spheres_equal( caster.sphere, world_sphere );
+
+    if ( dynamic ) {
+        ++stats.dynamic_casters;
+
+        invalidate_sphere( world_sphere, true );
+        // Remove its depth from the faces it left.
+        if ( caster.valid && moved ) {
+            invalidate_sphere( caster.sphere, true );
+        }
+    } else if ( moved || caster.dynamic ) {
+        ++stats.static_changes;
+
+        if ( caster.valid ) {
+            invalidate_sphere( caster.sphere, false );
+        }
+        invalidate_sphere( world_sphere, false );
+    }
+
+    caster.sphere = world_sphere;
+    caster.dynamic = dynamic;
+    caster.valid = true;
+}
+
+u32 PointlightShadowCache::sphere_faces( const ShadowCacheLight& light, vec4s world_sphere ) const {
+    const vec3s center = { world_sphere.x, world_sphere.y, world_sphere.z };
+    const f32 radius = world_sphere.w;
+
+    const f32 max_distance = light.radius * k_cubemap_corner_scale + radius;
+    if ( glms_vec3_distance2( center, light.position ) > max_distance * max_distance ) {
+        return 0;
+    }
+
+    u32 faces = 0;
+    for ( u32 f = 0; f < k_shadow_cache_faces; ++f ) {
+        const vec4s* planes = light.face_planes[ f ];
+
+        bool inside = true;
+        for ( u32 p = 0; p < k_shadow_cache_face_planes && inside; ++p ) {
+            inside = glms_vec3_dot( glms_vec3( planes[ p ] ), center ) + planes[ p ].w >= -radius;
+        }
+
+        faces |= inside ? ( 1 << f ) : 0;
+    }
+
+    return faces;
+}
+
+void PointlightShadowCache::invalidate_sphere( vec4s world_sphere, bool dynamic ) {
+    for ( u32 l = 0; l < active_lights; ++l ) {
+        ShadowCacheLight& light = lights[ l ];
+        // Invalid lights are rendered entirely.
+        if ( !light.valid ) {
+            continue;
+        }
+
+        const u32 faces = sphere_faces( light, world_sphere );
+        if ( dynamic ) {
+            light.dynamic_faces |= faces;
+        } else {
+            light.dirty_faces |= faces;
+        }
+    }
+}
+
+void PointlightShadowCache::invalidate_all() {
+    for ( u32 l = 0; l < lights.size; ++l ) {
+        lights[ l ].dirty_faces = k_shadow_cache_all_faces;
+    }
+}
+
+u32 PointlightShadowCache::consume_faces( u32 light_index ) {
+    ShadowCacheLight& light = lights[ light_index ];
+
+    const u32 faces = light.dirty_faces | light.dynamic_faces;
+    const u32 rendered = count_faces( faces );
+
+    stats.faces_rendered += rendered;
+    stats.faces_skipped += k_shadow_cache_faces - rendered;
+    stats.faces_dynamic += count_faces( light.dynamic_faces & ~light.dirty_faces );
+
+    light.dirty_faces = 0;
+    light.dynamic_faces = 0;
+
+    return faces;
+}
+
+} // namespace raptor
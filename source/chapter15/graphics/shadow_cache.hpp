@@ -0,0 +1,92 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/platform.hpp"
+
+#include "external/cglm/types-struct.h"
+
+namespace raptor {
+
+struct Allocator;
+
+static const u32                    k_shadow_cache_faces            = 6;
+static const u32                    k_shadow_cache_all_faces        = ( 1 << k_shadow_cache_faces ) - 1;
+static const u32                    k_shadow_cache_face_planes      = 6;
+
+//
+//
+struct ShadowCacheStats {
+
+    u32                             lights                  = 0;
+    u32                             faces_rendered          = 0;
+    u32                             faces_skipped           = 0;
+    u32                             faces_dynamic           = 0;    // Rendered because of dynamic casters.
+
+    u32                             light_changes           = 0;
+    u32                             static_changes          = 0;
+    u32                             dynamic_casters         = 0;
+
+}; // struct ShadowCacheStats
+
+//
+//
+struct ShadowCacheLight {
+
+    vec4s                           face_planes[ k_shadow_cache_faces ][ k_shadow_cache_face_planes ];
+
+    vec3s                           position;
+    f32                             radius;
+
+    u8                              dirty_faces             = k_shadow_cache_all_faces;
+    u8                              dynamic_faces           = 0;
+    bool                            valid                   = false;
+
+}; // struct ShadowCacheLight
+
+//
+//
+struct ShadowCacheCaster {
+
+    vec4s                           sphere;                 // World space center and radius.
+    bool                            dynamic                 = false;
+    bool                            valid                   = false;
+
+}; // struct ShadowCacheCaster
+
+//
+// Tracks which faces of the point light cubemaps are still valid between frames. Static casters only invalidate the
+// faces they touched when they move, dynamic casters (skinned or simulated meshes) force the faces they touch to be
+// rendered every frame, and the frame after they leave them. Lights invalidate all their faces when moved or resized.
+// Each frame: begin_frame, update the lights and the casters, then consume_faces for each light that is rendered.
+struct PointlightShadowCache {
+
+    void                            init( Allocator* allocator, u32 max_lights, u32 initial_casters );
+    void                            shutdown();
+
+    void                            begin_frame( u32 active_lights );
+
+    // Returns true if the light moved or changed radius, set_light_faces must then be called with its new matrices.
+    bool                            update_light( u32 light_index, vec3s position, f32 radius );
+    // Faces are culled with the frustum planes of the view projections used to render them.
+    void                            set_light_faces( u32 light_index, const mat4s* face_view_projections );
+
+    void                            update_caster( u32 caster_index, vec4s world_sphere, bool dynamic );
+
+    void                            invalidate_sphere( vec4s world_sphere, bool dynamic );
+    void                            invalidate_all();
+
+    // Faces to render this frame, their cached depth is considered valid afterwards.
+    u32                             consume_faces( u32 light_index );
+
+    // Returns the faces of a light intersected by a sphere.
+    u32                             sphere_faces( const ShadowCacheLight& light, vec4s world_sphere ) const;
+
+    Array<ShadowCacheLight>         lights;
+    Array<ShadowCacheCaster>        casters;
+
+    ShadowCacheStats                stats;
+    u32                             active_lights           = 0;
+
+}; // struct PointlightShadowCache
+
+} // namespace raptor
@@ -734,5 +734,67 @@ void parse_binary( const u32* data, size_t data_size, StringBuffer& name_buffer,
     }
 }
 
+void merge_parse_result( ParseResult* destination, const ParseResult& stage ) {
+    for ( u32 s = 0; s < stage.set_count; ++s ) {
+        const DescriptorSetLayoutCreation& stage_set = stage.sets[ s ];
+        if ( stage_set.num_bindings == 0 ) {
+            continue;
+        }
+
+        DescriptorSetLayoutCreation& set = destination->sets[ s ];
+        set.set_index = stage_set.set_index;
+
+        DescriptorSetLayoutCreation::Binding merged[ k_max_descriptors_per_set ];
+        u32 num_merged = 0;
+        u32 i = 0, j = 0;
+
+        while ( i < set.num_bindings || j < stage_set.num_bindings ) {
+            RASSERTM( num_merged < k_max_descriptors_per_set, "Too many bindings in descriptor set %u", s );
+
+            if ( j == stage_set.num_bindings || ( i < set.num_bindings && set.bindings[ i ].index < stage_set.bindings[ j ].index ) ) {
+                merged[ num_merged++ ] = set.bindings[ i++ ];
+            } else if ( i == set.num_bindings || stage_set.bindings[ j ].index < set.bindings[ i ].index ) {
+                merged[ num_merged++ ] = stage_set.bindings[ j++ ];
+            } else {
+                // Same binding used by both stages. Different types are kept, as parse_binary does.
+                if ( set.bindings[ i ].type == stage_set.bindings[ j ].type ) {
+                    ++j;
+                }
+                merged[ num_merged++ ] = set.bindings[ i++ ];
+            }
+        }
+
+        memcpy( set.bindings, merged, sizeof( DescriptorSetLayoutCreation::Binding ) * num_merged );
+        set.num_bindings = num_merged;
+    }
+
+    destination->set_count = max( destination->set_count, stage.set_count );
+
+    if ( stage.push_constants_stride ) {
+        destination->push_constants_stride = stage.push_constants_stride;
+    }
+
+    if ( stage.compute_local_size.x || stage.compute_local_size.y || stage.compute_local_size.z ) {
+        destination->compute_local_size = stage.compute_local_size;
+    }
+
+    for ( u32 c = 0; c < stage.specialization_constants_count; ++c ) {
+        // Constants declared in a shared header are seen by more stages, ids must be unique in the pipeline.
+        bool present = false;
+        for ( u32 d = 0; d < destination->specialization_constants_count && !present; ++d ) {
+            present = destination->specialization_constants[ d ].binding == stage.specialization_constants[ c ].binding;
+        }
+        if ( present ) {
+            continue;
+        }
+
+        RASSERT( destination->specialization_constants_count < k_max_specialization_constants );
+
+        destination->specialization_constants[ destination->specialization_constants_count ] = stage.specialization_constants[ c ];
+        destination->specialization_names[ destination->specialization_constants_count ] = stage.specialization_names[ c ];
+        ++destination->specialization_constants_count;
+    }
+}
+
 } // namespace spirv
 } // namespace raptor
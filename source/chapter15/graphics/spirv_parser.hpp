@@ -66,5 +66,9 @@ namespace spirv {
 
     void                            parse_binary( const u32* data, size_t data_size, StringBuffer& name_buffer, ParseResult* parse_result );
 
+    // Adds the reflection of a single stage to the one of the whole shader state.
+    // Both binding lists are sorted by index, so sets are merged without sorting again.
+    void                            merge_parse_result( ParseResult* destination, const ParseResult& stage );
+
 } // namespace spirv
 } // namespace raptor
@@ -0,0 +1,437 @@
+#include "graphics/spirv_reflection_cache.hpp"
+
+#include "foundation/blob_serialization.hpp"
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/time.hpp"
+
+#include <string.h>
+
+namespace raptor {
+
+static u32 pad_to_4( u32 size ) {
+    return ( size + 3 ) & ~3u;
+}
+
+static u64 spirv_key( const u32* spirv_data, sizet spirv_size ) {
+    return hash_bytes( ( void* )spirv_data, spirv_size, spirv_size );
+}
+
+static void clear_parse_result( spirv::ParseResult* parse_result ) {
+    memset( parse_result, 0, sizeof( spirv::ParseResult ) );
+}
+
+// Moves the names referenced by a result into the cache memory.
+static void intern_parse_result_names( SpirvReflectionCache& cache, spirv::ParseResult* parse_result ) {
+    for ( u32 s = 0; s < parse_result->set_count; ++s ) {
+        DescriptorSetLayoutCreation& set = parse_result->sets[ s ];
+        for ( u32 b = 0; b < set.num_bindings; ++b ) {
+            set.bindings[ b ].name = cache.intern_name( set.bindings[ b ].name );
+        }
+    }
+}
+
+static bool equal_parse_result( const spirv::ParseResult& a, const spirv::ParseResult& b ) {
+    if ( a.set_count != b.set_count || a.push_constants_stride != b.push_constants_stride ||
+         a.specialization_constants_count != b.specialization_constants_count ||
+         a.compute_local_size.x != b.compute_local_size.x || a.compute_local_size.y != b.compute_local_size.y ||
+         a.compute_local_size.z != b.compute_local_size.z ) {
+        return false;
+    }
+
+    for ( u32 s = 0; s < a.set_count; ++s ) {
+        const DescriptorSetLayoutCreation& set_a = a.sets[ s ];
+        const DescriptorSetLayoutCreation& set_b = b.sets[ s ];
+        if ( set_a.num_bindings != set_b.num_bindings || set_a.set_index != set_b.set_index ) {
+            return false;
+        }
+
+        for ( u32 i = 0; i < set_a.num_bindings; ++i ) {
+            const DescriptorSetLayoutCreation::Binding& binding_a = set_a.bindings[ i ];
+            const DescriptorSetLayoutCreation::Binding& binding_b = set_b.bindings[ i ];
+            if ( binding_a.type != binding_b.type || binding_a.index != binding_b.index || binding_a.count != binding_b.count ) {
+                return false;
+            }
+
+            cstring name_a = binding_a.name ? binding_a.name : "";
+            cstring name_b = binding_b.name ? binding_b.name : "";
+            if ( strcmp( name_a, name_b ) != 0 ) {
+                return false;
+            }
+        }
+    }
+
+    for ( u32 i = 0; i < a.specialization_constants_count; ++i ) {
+        const spirv::SpecializationConstant& constant_a = a.specialization_constants[ i ];
+        const spirv::SpecializationConstant& constant_b = b.specialization_constants[ i ];
+        if ( constant_a.binding != constant_b.binding || constant_a.byte_stride != constant_b.byte_stride ||
+             constant_a.default_value.type != constant_b.default_value.type || constant_a.default_value.value.value_u != constant_b.default_value.value.value_u ||
+             strncmp( a.specialization_names[ i ].name, b.specialization_names[ i ].name, 32 ) != 0 ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Relative arrays of a mapped file could point anywhere if the file is damaged.
+static bool blob_range_valid( const MappedFile& file, const void* data, sizet size ) {
+    const u8* begin = ( const u8* )data;
+    return begin >= file.data && begin + size <= file.data + file.size;
+}
+
+static bool blob_entry_valid( const MappedFile& file, const SpirvReflectionEntry& entry ) {
+    if ( entry.sets.size > spirv::k_max_count || entry.specialization_constants.size > spirv::k_max_specialization_constants ||
+         entry.set_count != entry.sets.size ) {
+        return false;
+    }
+
+    if ( !blob_range_valid( file, entry.sets.get(), sizeof( SpirvReflectionSet ) * entry.sets.size ) ||
+         !blob_range_valid( file, entry.specialization_constants.get(), sizeof( SpirvReflectionSpecialization ) * entry.specialization_constants.size ) ) {
+        return false;
+    }
+
+    for ( u32 s = 0; s < entry.sets.size; ++s ) {
+        const RelativeArray<SpirvReflectionBinding>& bindings = entry.sets[ s ].bindings;
+        if ( bindings.size > k_max_descriptors_per_set || !blob_range_valid( file, bindings.get(), sizeof( SpirvReflectionBinding ) * bindings.size ) ) {
+            return false;
+        }
+
+        for ( u32 b = 0; b < bindings.size; ++b ) {
+            const RelativeString& name = bindings[ b ].name;
+            if ( name.size && ( !blob_range_valid( file, name.c_str(), name.size + 1 ) || name.c_str()[ name.size ] != 0 ) ) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void read_blob_entry( const SpirvReflectionEntry& entry, spirv::ParseResult* parse_result ) {
+    clear_parse_result( parse_result );
+
+    parse_result->set_count = entry.set_count;
+    parse_result->push_constants_stride = entry.push_constants_stride;
+    parse_result->specialization_constants_count = entry.specialization_constants.size;
+    memcpy( &parse_result->compute_local_size, &entry.compute_local_size, sizeof( u32 ) );
+
+    for ( u32 s = 0; s < entry.sets.size; ++s ) {
+        const SpirvReflectionSet& source_set = entry.sets[ s ];
+        DescriptorSetLayoutCreation& set = parse_result->sets[ s ];
+        set.set_index = source_set.set_index;
+        set.num_bindings = source_set.bindings.size;
+
+        for ( u32 b = 0; b < source_set.bindings.size; ++b ) {
+            const SpirvReflectionBinding& source_binding = source_set.bindings[ b ];
+            DescriptorSetLayoutCreation::Binding& binding = set.bindings[ b ];
+            binding.type = ( VkDescriptorType )source_binding.type;
+            binding.index = source_binding.index;
+            binding.count = source_binding.count;
+            // Names are referenced in place, the file stays mapped until shutdown.
+            binding.name = source_binding.name.size ? source_binding.name.c_str() : nullptr;
+        }
+    }
+
+    for ( u32 i = 0; i < entry.specialization_constants.size; ++i ) {
+        const SpirvReflectionSpecialization& source = entry.specialization_constants[ i ];
+        spirv::SpecializationConstant& constant = parse_result->specialization_constants[ i ];
+        constant.binding = source.binding;
+        constant.byte_stride = source.byte_stride;
+        constant.default_value.value.value_u = source.value;
+        constant.default_value.type = ( spirv::ConstantValue::Type )source.type;
+
+        memcpy( parse_result->specialization_names[ i ].name, source.name, sizeof( source.name ) );
+    }
+}
+
+static u32 blob_entry_size( const spirv::ParseResult& parse_result ) {
+    u32 size = sizeof( SpirvReflectionEntry );
+    size += sizeof( SpirvReflectionSet ) * parse_result.set_count;
+    size += sizeof( SpirvReflectionSpecialization ) * parse_result.specialization_constants_count;
+
+    for ( u32 s = 0; s < parse_result.set_count; ++s ) {
+        const DescriptorSetLayoutCreation& set = parse_result.sets[ s ];
+        size += sizeof( SpirvReflectionBinding ) * set.num_bindings;
+
+        for ( u32 b = 0; b < set.num_bindings; ++b ) {
+            if ( set.bindings[ b ].name ) {
+                size += pad_to_4( ( u32 )strlen( set.bindings[ b ].name ) + 1 );
+            }
+        }
+    }
+    return size;
+}
+
+// SpirvReflectionCache ///////////////////////////////////////////////////
+
+void SpirvReflectionCache::init( Allocator* allocator_, u32 initial_capacity ) {
+    allocator = allocator_;
+
+    results.init( allocator, initial_capacity );
+    results.set_default_value( nullptr );
+    mapped_entries.init( allocator, initial_capacity );
+    mapped_entries.set_default_value( u32_max );
+    name_map.init( allocator, initial_capacity * 4 );
+    name_map.set_default_value( nullptr );
+
+    used_results.init( allocator, initial_capacity );
+    used_keys.init( allocator, initial_capacity );
+    used_sizes.init( allocator, initial_capacity );
+
+    names.init( rkilo( 64 ), allocator );
+    parse_names.init( 16000, allocator );
+
+    scratch = ( spirv::ParseResult* )allocator->allocate( sizeof( spirv::ParseResult ), 64 );
+
+    file = MappedFile{ };
+    blob = nullptr;
+    path[ 0 ] = 0;
+
+    stats = SpirvReflectionCacheStats{ };
+    dirty = false;
+}
+
+void SpirvReflectionCache::shutdown() {
+    // Results read from the blob reference the mapped file, save them before unmapping.
+    if ( dirty && path[ 0 ] ) {
+        save( path );
+    }
+
+    for ( u32 i = 0; i < used_results.size; ++i ) {
+        allocator->deallocate( used_results[ i ] );
+    }
+    allocator->deallocate( scratch );
+
+    file.close();
+    blob = nullptr;
+
+    results.shutdown();
+    mapped_entries.shutdown();
+    name_map.shutdown();
+    used_results.shutdown();
+    used_keys.shutdown();
+    used_sizes.shutdown();
+    names.shutdown();
+    parse_names.shutdown();
+}
+
+bool SpirvReflectionCache::load( cstring path_ ) {
+    strncpy( path, path_, k_max_path - 1 );
+    path[ k_max_path - 1 ] = 0;
+
+    if ( !file.open( path, FileAccessHint::WillNeed ) ) {
+        return false;
+    }
+
+    const BlobHeader* header = ( const BlobHeader* )file.data;
+    if ( file.size < sizeof( SpirvReflectionBlob ) || header->version != k_spirv_reflection_cache_version || !header->mappable ) {
+        rprint( "Spir-V reflection cache %s is outdated, discarding it\n", path );
+        file.close();
+        return false;
+    }
+
+    // Same version and mappable: the blob is used in place, nothing is read.
+    BlobSerializer blob_serializer;
+    blob = blob_serializer.read<SpirvReflectionBlob>( allocator, k_spirv_reflection_cache_version, file.size, ( char* )file.data );
+
+    if ( !blob_range_valid( file, blob->entries.get(), sizeof( SpirvReflectionEntry ) * blob->entries.size ) ) {
+        rprint( "Spir-V reflection cache %s is damaged, discarding it\n", path );
+        file.close();
+        blob = nullptr;
+        return false;
+    }
+
+    for ( u32 e = 0; e < blob->entries.size; ++e ) {
+        const SpirvReflectionEntry& entry = blob->entries[ e ];
+        if ( !blob_entry_valid( file, entry ) ) {
+            continue;
+        }
+
+        const u64 key = ( u64 )entry.spirv_hash_low | ( ( u64 )entry.spirv_hash_high << 32 );
+        mapped_entries.insert( key, e );
+        ++stats.loaded_entries;
+    }
+
+    return true;
+}
+
+const spirv::ParseResult* SpirvReflectionCache::get( const u32* spirv_data, sizet spirv_size ) {
+    const i64 start_time = time_now();
+    const u64 key = spirv_key( spirv_data, spirv_size );
+
+    spirv::ParseResult* parse_result = results.get( key );
+    if ( !parse_result ) {
+        const u32 entry_index = mapped_entries.get( key );
+        if ( entry_index != u32_max && blob->entries[ entry_index ].spirv_size == spirv_size ) {
+            parse_result = add_result( key, ( u32 )spirv_size );
+            read_blob_entry( blob->entries[ entry_index ], parse_result );
+        }
+    }
+
+    if ( parse_result && !validate ) {
+        ++stats.hits;
+        stats.lookup_ms += time_from_milliseconds( start_time );
+        return parse_result;
+    }
+
+    // Parse into the scratch result, names are then copied into the cache memory.
+    const i64 parse_start_time = time_now();
+
+    clear_parse_result( scratch );
+    parse_names.clear();
+    spirv::parse_binary( spirv_data, spirv_size, parse_names, scratch );
+
+    stats.parse_ms += time_from_milliseconds( parse_start_time );
+    stats.parsed_bytes += spirv_size;
+
+    if ( parse_result ) {
+        // Validating: keep the cached result only if it matches.
+        ++stats.hits;
+        if ( equal_parse_result( *parse_result, *scratch ) ) {
+            return parse_result;
+        }
+
+        rprint( "Spir-V reflection cache: cached result differs from the parsed one, replacing it\n" );
+        ++stats.mismatches;
+    } else {
+        ++stats.misses;
+        parse_result = add_result( key, ( u32 )spirv_size );
+    }
+
+    memcpy( parse_result, scratch, sizeof( spirv::ParseResult ) );
+    intern_parse_result_names( *this, parse_result );
+    dirty = true;
+
+    return parse_result;
+}
+
+spirv::ParseResult* SpirvReflectionCache::add_result( u64 key, u32 spirv_size ) {
+    spirv::ParseResult* parse_result = ( spirv::ParseResult* )allocator->allocate( sizeof( spirv::ParseResult ), 64 );
+    clear_parse_result( parse_result );
+
+    results.insert( key, parse_result );
+    used_results.push( parse_result );
+    used_keys.push( key );
+    used_sizes.push( spirv_size );
+
+    return parse_result;
+}
+
+cstring SpirvReflectionCache::intern_name( cstring name ) {
+    if ( !name ) {
+        return nullptr;
+    }
+
+    const u64 name_hash = hash_calculate( name, 0 );
+    cstring interned = name_map.get( name_hash );
+    if ( interned ) {
+        return interned;
+    }
+
+    interned = names.append_use( name );
+    RASSERTM( interned, "Spir-V reflection cache names are full" );
+    name_map.insert( name_hash, interned );
+
+    return interned;
+}
+
+bool SpirvReflectionCache::save( cstring path_ ) {
+    // Only the results used in this run are saved, so stale stages do not accumulate.
+    u32 blob_size = sizeof( SpirvReflectionBlob ) - sizeof( BlobHeader );
+    for ( u32 i = 0; i < used_results.size; ++i ) {
+        blob_size += blob_entry_size( *used_results[ i ] );
+    }
+
+    BlobSerializer blob_serializer;
+    SpirvReflectionBlob* output = blob_serializer.write_and_prepare<SpirvReflectionBlob>( allocator, k_spirv_reflection_cache_version, blob_size );
+    output->header.mappable = 1;
+
+    // Fixed size structures first, strings last: padding strings keeps the next allocations aligned anyway.
+    blob_serializer.allocate_and_set( output->entries, used_results.size );
+
+    for ( u32 i = 0; i < used_results.size; ++i ) {
+        const spirv::ParseResult& parse_result = *used_results[ i ];
+        SpirvReflectionEntry& entry = output->entries[ i ];
+
+        const u64 key = used_keys[ i ];
+        entry.spirv_hash_low = ( u32 )key;
+        entry.spirv_hash_high = ( u32 )( key >> 32 );
+        entry.spirv_size = used_sizes[ i ];
+        entry.set_count = parse_result.set_count;
+        entry.push_constants_stride = parse_result.push_constants_stride;
+        memcpy( &entry.compute_local_size, &parse_result.compute_local_size, sizeof( u32 ) );
+
+        blob_serializer.allocate_and_set( entry.sets, parse_result.set_count );
+        blob_serializer.allocate_and_set( entry.specialization_constants, parse_result.specialization_constants_count );
+
+        for ( u32 c = 0; c < parse_result.specialization_constants_count; ++c ) {
+            const spirv::SpecializationConstant& constant = parse_result.specialization_constants[ c ];
+            SpirvReflectionSpecialization& specialization = entry.specialization_constants[ c ];
+            specialization.binding = constant.binding;
+            specialization.byte_stride = constant.byte_stride;
+            specialization.value = constant.default_value.value.value_u;
+            specialization.type = ( u32 )constant.default_value.type;
+            memcpy( specialization.name, parse_result.specialization_names[ c ].name, sizeof( specialization.name ) );
+        }
+
+        for ( u32 s = 0; s < parse_result.set_count; ++s ) {
+            const DescriptorSetLayoutCreation& set = parse_result.sets[ s ];
+            entry.sets[ s ].set_index = set.set_index;
+            blob_serializer.allocate_and_set( entry.sets[ s ].bindings, set.num_bindings );
+
+            for ( u32 b = 0; b < set.num_bindings; ++b ) {
+                const DescriptorSetLayoutCreation::Binding& binding = set.bindings[ b ];
+                SpirvReflectionBinding& output_binding = entry.sets[ s ].bindings[ b ];
+                output_binding.type = ( u32 )binding.type;
+                output_binding.index = binding.index;
+                output_binding.count = binding.count;
+                output_binding.name.set_empty();
+            }
+        }
+    }
+
+    // Entry memory does not move, strings can be added in the same order.
+    for ( u32 i = 0; i < used_results.size; ++i ) {
+        const spirv::ParseResult& parse_result = *used_results[ i ];
+        SpirvReflectionEntry& entry = output->entries[ i ];
+
+        for ( u32 s = 0; s < parse_result.set_count; ++s ) {
+            const DescriptorSetLayoutCreation& set = parse_result.sets[ s ];
+            for ( u32 b = 0; b < set.num_bindings; ++b ) {
+                cstring name = set.bindings[ b ].name;
+                if ( !name ) {
+                    continue;
+                }
+
+                const u32 length = ( u32 )strlen( name );
+                blob_serializer.allocate_and_set( entry.sets[ s ].bindings[ b ].name, ( char* )name, length );
+                blob_serializer.allocate_static( pad_to_4( length + 1 ) - ( length + 1 ) );
+            }
+        }
+    }
+
+    RASSERT( blob_serializer.allocated_offset == blob_serializer.total_size );
+
+    // The file could be mapped: release it before writing over it.
+    if ( strcmp( path_, path ) == 0 ) {
+        // Results read from the mapping reference its names, they are not valid anymore.
+        for ( u32 i = 0; i < used_results.size; ++i ) {
+            intern_parse_result_names( *this, used_results[ i ] );
+        }
+        mapped_entries.clear();
+        file.close();
+        blob = nullptr;
+    }
+
+    file_write_binary( path_, blob_serializer.blob_memory, blob_serializer.allocated_offset );
+    blob_serializer.shutdown();
+
+    dirty = false;
+
+    rprint( "Saved %u Spir-V reflection results to %s\n", used_results.size, path_ );
+
+    return true;
+}
+
+} // namespace raptor
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "graphics/spirv_parser.hpp"
+
+#include "foundation/blob.hpp"
+#include "foundation/file.hpp"
+#include "foundation/hash_map.hpp"
+#include "foundation/relative_data_structures.hpp"
+#include "foundation/string.hpp"
+
+namespace raptor {
+
+struct Allocator;
+
+// Bump when the reflection data or the blob layout changes: older files are discarded.
+static const u32                    k_spirv_reflection_cache_version    = 1;
+
+// Blob layout ////////////////////////////////////////////////////////////
+
+// Only 4 byte fields, so the mapped file can be used in place.
+
+//
+//
+struct SpirvReflectionBinding {
+
+    u32                             type;               // VkDescriptorType
+    u16                             index;
+    u16                             count;
+    RelativeString                  name;
+
+}; // struct SpirvReflectionBinding
+
+//
+//
+struct SpirvReflectionSet {
+
+    u32                             set_index;
+    RelativeArray<SpirvReflectionBinding> bindings;
+
+}; // struct SpirvReflectionSet
+
+//
+//
+struct SpirvReflectionSpecialization {
+
+    u16                             binding;
+    u16                             byte_stride;
+    u32                             value;
+    u32                             type;
+    char                            name[ 32 ];
+
+}; // struct SpirvReflectionSpecialization
+
+//
+// Reflection of a single shader stage.
+struct SpirvReflectionEntry {
+
+    u32                             spirv_hash_low;
+    u32                             spirv_hash_high;
+    u32                             spirv_size;
+
+    u32                             set_count;
+    u32                             push_constants_stride;
+    u32                             compute_local_size;
+
+    RelativeArray<SpirvReflectionSet> sets;
+    RelativeArray<SpirvReflectionSpecialization> specialization_constants;
+
+}; // struct SpirvReflectionEntry
+
+//
+//
+struct SpirvReflectionBlob : public Blob {
+
+    RelativeArray<SpirvReflectionEntry> entries;
+
+}; // struct SpirvReflectionBlob
+
+// SpirvReflectionCache ///////////////////////////////////////////////////
+
+//
+//
+struct SpirvReflectionCacheStats {
+
+    u32                             loaded_entries      = 0;
+    u32                             hits                = 0;
+    u32                             misses              = 0;
+    u32                             mismatches          = 0;    // Cached results different from a new parse, when validating.
+
+    u64                             parsed_bytes        = 0;
+    f64                             parse_ms            = 0.0;  // Time spent parsing the misses.
+    f64                             lookup_ms           = 0.0;  // Time spent serving the hits.
+
+}; // struct SpirvReflectionCacheStats
+
+//
+// Reflection results of shader stages, keyed by the hash of their Spir-V, so unchanged stages are parsed only once.
+// Results are saved in a mappable blob next to the cached Spir-V and used in place on the next run. Binding names
+// point into the cache memory, that lives until shutdown.
+struct SpirvReflectionCache {
+
+    void                            init( Allocator* allocator, u32 initial_capacity );
+    // Saves the results used during the run, if any was parsed, then releases everything.
+    void                            shutdown();
+
+    // Maps the results saved by a previous run. They are saved back to the same path at shutdown.
+    bool                            load( cstring path );
+
+    // Reflection of a single stage, parsed only if not cached.
+    const spirv::ParseResult*       get( const u32* spirv_data, sizet spirv_size );
+
+    bool                            save( cstring path );
+
+    spirv::ParseResult*             add_result( u64 key, u32 spirv_size );
+    cstring                         intern_name( cstring name );
+
+    FlatHashMap<u64, spirv::ParseResult*> results;
+    FlatHashMap<u64, u32>           mapped_entries;     // Entry indices of the loaded blob.
+    FlatHashMap<u64, cstring>       name_map;
+
+    Array<spirv::ParseResult*>      used_results;
+    Array<u64>                      used_keys;
+    Array<u32>                      used_sizes;
+
+    StringBuffer                    names;              // Binding names of the parsed results.
+    StringBuffer                    parse_names;        // Scratch names used while parsing.
+    spirv::ParseResult*             scratch             = nullptr;
+
+    MappedFile                      file;
+    SpirvReflectionBlob*            blob                = nullptr;
+    char                            path[ k_max_path ];
+
+    Allocator*                      allocator           = nullptr;
+
+    SpirvReflectionCacheStats       stats;
+
+    bool                            validate            = false;    // Parse the cached stages too, checking they match.
+    bool                            dirty               = false;
+
+}; // struct SpirvReflectionCache
+
+} // namespace raptor
@@ -0,0 +1,403 @@
+#include "graphics/texture_streaming.hpp"
+
+#include "foundation/file.hpp"
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace raptor {
+
+// TextureStreamer ////////////////////////////////////////////////////////
+
+static int sorting_request_fn( const void* a, const void* b ) {
+    const TextureStreamingRequest* ra = ( const TextureStreamingRequest* )a;
+    const TextureStreamingRequest* rb = ( const TextureStreamingRequest* )b;
+
+    // Highest priority first, texture index as tie breaker to keep replays deterministic.
+    if ( ra->priority > rb->priority ) return -1;
+    else if ( ra->priority < rb->priority ) return 1;
+    else if ( ra->texture < rb->texture ) return -1;
+    else if ( ra->texture > rb->texture ) return 1;
+    return 0;
+}
+
+void TextureStreamer::init( const TextureStreamerCreation& creation ) {
+    textures.init( creation.allocator, creation.max_textures );
+    requests.init( creation.allocator, creation.max_requests_per_frame * 4 );
+    evictions.init( creation.allocator, 16 );
+
+    budget_bytes = creation.budget_bytes;
+    bytes_per_texel = creation.bytes_per_texel;
+    mip_tail_dimension = creation.mip_tail_dimension;
+    max_requests_per_frame = creation.max_requests_per_frame;
+    eviction_delay_frames = creation.eviction_delay_frames;
+    simulation = creation.simulation;
+    simulation_latency_frames = creation.simulation_latency_frames;
+
+    current_frame = 0;
+    stats = TextureStreamingStats{ };
+
+    // Evicted after the shadow page pools, which only give back unused pages.
+    memory_budget = creation.memory_budget;
+    if ( memory_budget ) {
+        memory_budget->register_evictor( GpuMemoryCategory::Textures, texture_streamer_evict_callback, this, 1 );
+    }
+}
+
+void TextureStreamer::shutdown() {
+    if ( memory_budget ) {
+        memory_budget->unregister_evictor( texture_streamer_evict_callback, this );
+        memory_budget = nullptr;
+    }
+
+    textures.shutdown();
+    requests.shutdown();
+    evictions.shutdown();
+}
+
+u32 TextureStreamer::register_texture( u32 width, u32 height, u32 mip_count ) {
+    RASSERT( mip_count > 0 );
+
+    StreamedTexture& texture = textures.push_use();
+    texture = StreamedTexture{ };
+    texture.width = width;
+    texture.height = height;
+    texture.mip_count = mip_count;
+
+    // Find the first mip that fits in the tail: all the following ones are always resident.
+    u32 mip_tail_first = mip_count - 1;
+    for ( u32 mip = 0; mip < mip_count; ++mip ) {
+        const u32 mip_width = max( width >> mip, 1u );
+        const u32 mip_height = max( height >> mip, 1u );
+        if ( mip_width <= mip_tail_dimension && mip_height <= mip_tail_dimension ) {
+            mip_tail_first = mip;
+            break;
+        }
+    }
+    texture.mip_tail_first = mip_tail_first;
+    texture.resident_mip = mip_tail_first;
+
+    const u32 texture_index = textures.size - 1;
+    stats.resident_bytes += resident_size( texture_index );
+    stats.peak_resident_bytes = max( stats.peak_resident_bytes, stats.resident_bytes );
+
+    return texture_index;
+}
+
+sizet TextureStreamer::mip_size( u32 texture_index, u32 mip ) const {
+    const StreamedTexture& texture = textures[ texture_index ];
+    const sizet mip_width = max( texture.width >> mip, 1u );
+    const sizet mip_height = max( texture.height >> mip, 1u );
+    return mip_width * mip_height * bytes_per_texel;
+}
+
+sizet TextureStreamer::resident_size( u32 texture_index ) const {
+    const StreamedTexture& texture = textures[ texture_index ];
+    sizet size = 0;
+    for ( u32 mip = texture.resident_mip; mip < texture.mip_count; ++mip ) {
+        size += mip_size( texture_index, mip );
+    }
+    return size;
+}
+
+sizet TextureStreamer::trim( sizet bytes ) {
+    // Mip tails and pending loads cannot be evicted.
+    sizet fixed_bytes = stats.pending_bytes;
+    for ( u32 t = 0; t < textures.size; ++t ) {
+        const StreamedTexture& texture = textures[ t ];
+        const u32 first_mip = texture.pending_mip != k_texture_streaming_no_pending ? texture.resident_mip : texture.mip_tail_first;
+        for ( u32 mip = first_mip; mip < texture.mip_count; ++mip ) {
+            fixed_bytes += mip_size( t, mip );
+        }
+    }
+
+    const sizet used_bytes = stats.resident_bytes + stats.pending_bytes;
+    const sizet current_budget = min( budget_bytes, used_bytes );
+    if ( current_budget <= fixed_bytes ) {
+        return 0;
+    }
+
+    const sizet trimmed_bytes = min( bytes, current_budget - fixed_bytes );
+    budget_bytes = current_budget - trimmed_bytes;
+
+    return used_bytes > budget_bytes ? used_bytes - budget_bytes : 0;
+}
+
+u32 TextureStreamer::desired_mip( const StreamedTexture& texture ) const {
+    if ( texture.requested_mip == k_texture_streaming_not_requested ) {
+        return texture.mip_tail_first;
+    }
+    // Let unsampled textures decay to their tail, so that they become the first eviction candidates.
+    if ( current_frame - texture.last_used_frame > eviction_delay_frames ) {
+        return texture.mip_tail_first;
+    }
+    return min( texture.requested_mip, texture.mip_tail_first );
+}
+
+bool TextureStreamer::evict_one( u32 protected_texture ) {
+    // Pick the least recently used texture that has something above its tail.
+    // Textures sampled this frame are only trimmed down to what they need.
+    u32 victim = u32_max;
+    u64 victim_frame = u64_max;
+    for ( u32 t = 0; t < textures.size; ++t ) {
+        const StreamedTexture& texture = textures[ t ];
+        if ( t == protected_texture || texture.pending_mip != k_texture_streaming_no_pending ) {
+            continue;
+        }
+
+        if ( texture.resident_mip >= texture.mip_tail_first ) {
+            continue;
+        }
+
+        const bool over_resident = texture.resident_mip < desired_mip( texture );
+        if ( !over_resident && texture.last_used_frame >= current_frame ) {
+            continue;
+        }
+
+        if ( texture.last_used_frame < victim_frame ) {
+            victim = t;
+            victim_frame = texture.last_used_frame;
+        }
+    }
+
+    if ( victim == u32_max ) {
+        return false;
+    }
+
+    StreamedTexture& texture = textures[ victim ];
+    stats.resident_bytes -= mip_size( victim, texture.resident_mip );
+
+    TextureStreamingRequest& eviction = evictions.push_use();
+    eviction.texture = victim;
+    eviction.mip = texture.resident_mip;
+    eviction.priority = 0;
+
+    ++texture.resident_mip;
+    ++stats.mips_evicted;
+
+    return true;
+}
+
+void TextureStreamer::update( const u32* feedback, u32 feedback_count, u64 frame ) {
+    current_frame = frame;
+
+    requests.clear();
+    evictions.clear();
+
+    if ( simulation ) {
+        for ( u32 t = 0; t < textures.size; ++t ) {
+            const StreamedTexture& texture = textures[ t ];
+            if ( texture.pending_mip != k_texture_streaming_no_pending && frame - texture.pending_frame >= simulation_latency_frames ) {
+                complete_request( t, texture.pending_mip );
+            }
+        }
+    }
+
+    // Consume feedback
+    const u32 count = min( feedback_count, textures.size );
+    for ( u32 t = 0; t < count; ++t ) {
+        if ( feedback[ t ] == k_texture_streaming_not_requested ) {
+            continue;
+        }
+
+        StreamedTexture& texture = textures[ t ];
+        texture.requested_mip = min( feedback[ t ], texture.mip_count - 1 );
+        texture.last_used_frame = frame;
+    }
+
+    // The budget could have been trimmed since the last update.
+    while ( stats.resident_bytes + stats.pending_bytes > budget_bytes ) {
+        if ( !evict_one( u32_max ) ) {
+            break;
+        }
+    }
+
+    // Gather textures missing mips. Streaming goes one level at a time so that
+    // each texture improves progressively and the budget is shared between all of them.
+    for ( u32 t = 0; t < textures.size; ++t ) {
+        const StreamedTexture& texture = textures[ t ];
+        // Only stream in what has been sampled this frame: older requests are kept around
+        // solely to delay eviction, otherwise evicted mips would be loaded again right away.
+        if ( texture.pending_mip != k_texture_streaming_no_pending || texture.last_used_frame != frame ) {
+            continue;
+        }
+
+        const u32 target_mip = desired_mip( texture );
+        if ( target_mip >= texture.resident_mip ) {
+            continue;
+        }
+
+        TextureStreamingRequest& request = requests.push_use();
+        request.texture = t;
+        request.mip = texture.resident_mip - 1;
+        // Textures further away from their target come first, finer mips last.
+        request.priority = ( ( texture.resident_mip - target_mip ) << 16 ) | ( request.mip & 0xffff );
+    }
+
+    if ( requests.size > 1 ) {
+        qsort( requests.data, requests.size, sizeof( TextureStreamingRequest ), sorting_request_fn );
+    }
+
+    // Issue as many requests as the budget and the per frame limit allow.
+    u32 issued = 0;
+    sizet issued_bytes = 0;
+    for ( u32 r = 0; r < requests.size && issued < max_requests_per_frame; ++r ) {
+        const TextureStreamingRequest& request = requests[ r ];
+        const sizet size = mip_size( request.texture, request.mip );
+
+        // The device is out of texture memory whatever the streaming budget says.
+        if ( memory_budget && !memory_budget->can_allocate( GpuMemoryCategory::Textures, issued_bytes + size ) ) {
+            ++stats.budget_stalls;
+            break;
+        }
+
+        bool fits = true;
+        while ( stats.resident_bytes + stats.pending_bytes + size > budget_bytes ) {
+            if ( !evict_one( request.texture ) ) {
+                fits = false;
+                break;
+            }
+        }
+
+        if ( !fits ) {
+            ++stats.budget_stalls;
+            break;
+        }
+
+        StreamedTexture& texture = textures[ request.texture ];
+        texture.pending_mip = request.mip;
+        texture.pending_frame = frame;
+
+        stats.pending_bytes += size;
+        issued_bytes += size;
+        ++stats.requests_issued;
+
+        requests[ issued++ ] = request;
+    }
+    requests.set_size( issued );
+}
+
+void TextureStreamer::complete_request( u32 texture_index, u32 mip ) {
+    StreamedTexture& texture = textures[ texture_index ];
+    if ( texture.pending_mip != mip ) {
+        return;
+    }
+
+    const sizet size = mip_size( texture_index, mip );
+    stats.pending_bytes -= size;
+    stats.resident_bytes += size;
+    stats.peak_resident_bytes = max( stats.peak_resident_bytes, stats.resident_bytes );
+    ++stats.requests_completed;
+
+    texture.resident_mip = mip;
+    texture.pending_mip = k_texture_streaming_no_pending;
+}
+
+void TextureStreamer::cancel_request( u32 texture_index ) {
+    StreamedTexture& texture = textures[ texture_index ];
+    if ( texture.pending_mip == k_texture_streaming_no_pending ) {
+        return;
+    }
+
+    stats.pending_bytes -= mip_size( texture_index, texture.pending_mip );
+    texture.pending_mip = k_texture_streaming_no_pending;
+}
+
+// TextureStreamingFeedbackLog ////////////////////////////////////////////
+
+struct TextureStreamingFeedbackHeader {
+    u32                             magic;
+    u32                             version;
+    u32                             texture_count;
+    u32                             frame_count;
+}; // struct TextureStreamingFeedbackHeader
+
+void TextureStreamingFeedbackLog::init( Allocator* allocator_, u32 texture_count_, u32 frame_capacity ) {
+    allocator = allocator_;
+    texture_count = texture_count_;
+    frame_count = 0;
+
+    data.init( allocator, texture_count * frame_capacity );
+}
+
+void TextureStreamingFeedbackLog::shutdown() {
+    data.shutdown();
+}
+
+void TextureStreamingFeedbackLog::record( const u32* feedback, u32 feedback_count ) {
+    for ( u32 t = 0; t < texture_count; ++t ) {
+        data.push( t < feedback_count ? feedback[ t ] : k_texture_streaming_not_requested );
+    }
+    ++frame_count;
+}
+
+const u32* TextureStreamingFeedbackLog::frame( u32 index ) const {
+    RASSERT( index < frame_count );
+    return data.data + ( index * texture_count );
+}
+
+bool TextureStreamingFeedbackLog::write( cstring filename ) {
+    FileHandle file;
+    file_open( filename, "wb", &file );
+    if ( !file ) {
+        rprint( "Error writing texture streaming feedback %s\n", filename );
+        return false;
+    }
+
+    TextureStreamingFeedbackHeader header{ k_magic, k_version, texture_count, frame_count };
+    file_write( ( u8* )&header, sizeof( TextureStreamingFeedbackHeader ), 1, file );
+    file_write( ( u8* )data.data, sizeof( u32 ), data.size, file );
+    file_close( file );
+
+    return true;
+}
+
+bool TextureStreamingFeedbackLog::read( cstring filename ) {
+    sizet size = 0;
+    char* memory = file_read_binary( filename, allocator, &size );
+    if ( !memory ) {
+        return false;
+    }
+
+    TextureStreamingFeedbackHeader* header = ( TextureStreamingFeedbackHeader* )memory;
+    const bool valid = size >= sizeof( TextureStreamingFeedbackHeader ) && header->magic == k_magic && header->version == k_version &&
+                       size == sizeof( TextureStreamingFeedbackHeader ) + ( sizet )header->texture_count * header->frame_count * sizeof( u32 );
+    if ( !valid ) {
+        rprint( "Invalid texture streaming feedback file %s\n", filename );
+        rfree( memory, allocator );
+        return false;
+    }
+
+    texture_count = header->texture_count;
+    frame_count = header->frame_count;
+
+    const u32 total = texture_count * frame_count;
+    data.set_size( total );
+    memcpy( data.data, memory + sizeof( TextureStreamingFeedbackHeader ), total * sizeof( u32 ) );
+
+    rfree( memory, allocator );
+    return true;
+}
+
+void TextureStreamingFeedbackLog::replay( TextureStreamer& streamer, u64 first_frame ) {
+    for ( u32 f = 0; f < frame_count; ++f ) {
+        streamer.update( frame( f ), texture_count, first_frame + f );
+    }
+}
+
+// TextureStreamer eviction callback //////////////////////////////////////
+
+u64 texture_streamer_evict_callback( void* context, GpuMemoryCategory::Enum category, u64 bytes ) {
+    // The streamer owns only texture memory.
+    if ( category != GpuMemoryCategory::Textures ) {
+        return 0;
+    }
+
+    TextureStreamer* streamer = ( TextureStreamer* )context;
+    return streamer->trim( ( sizet )bytes );
+}
+
+} // namespace raptor
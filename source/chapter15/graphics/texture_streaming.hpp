@@ -0,0 +1,160 @@
+#pragma once
+
+#include "foundation/array.hpp"
+#include "foundation/platform.hpp"
+
+#include "graphics/gpu_memory_budget.hpp"
+
+namespace raptor {
+
+struct Allocator;
+
+static const u32                    k_texture_streaming_not_requested = u32_max;
+static const u32                    k_texture_streaming_no_pending    = u32_max;
+
+//
+// Residency state of a single streamed texture. Mips are indexed like in Vulkan,
+// 0 being the finest one. Everything from resident_mip to the last mip is resident.
+struct StreamedTexture {
+
+    u32                             width               = 0;
+    u32                             height              = 0;
+    u32                             mip_count           = 0;
+    u32                             mip_tail_first      = 0;    // First mip of the always resident tail.
+
+    u32                             resident_mip        = 0;
+    u32                             requested_mip       = k_texture_streaming_not_requested;
+    u32                             pending_mip         = k_texture_streaming_no_pending;
+
+    u64                             last_used_frame     = 0;
+    u64                             pending_frame       = 0;
+
+}; // struct StreamedTexture
+
+//
+// Output of the streamer: a mip to be loaded or evicted.
+struct TextureStreamingRequest {
+
+    u32                             texture             = 0;
+    u32                             mip                 = 0;
+    u32                             priority            = 0;
+
+}; // struct TextureStreamingRequest
+
+//
+//
+struct TextureStreamingStats {
+
+    sizet                           resident_bytes      = 0;
+    sizet                           pending_bytes       = 0;
+    sizet                           peak_resident_bytes = 0;
+
+    u32                             requests_issued     = 0;
+    u32                             requests_completed  = 0;
+    u32                             mips_evicted        = 0;
+    u32                             budget_stalls       = 0;    // Requests that could not be issued because nothing could be evicted.
+
+}; // struct TextureStreamingStats
+
+//
+//
+struct TextureStreamerCreation {
+
+    Allocator*                      allocator           = nullptr;
+
+    sizet                           budget_bytes        = rmega( 256 );
+    u32                             max_textures        = 256;
+    u32                             bytes_per_texel     = 4;
+    u32                             mip_tail_dimension  = 128;  // Mips with both sides smaller or equal than this are never evicted.
+    u32                             max_requests_per_frame = 4;
+    u32                             eviction_delay_frames = 8;  // Frames a texture can go unsampled before its request decays to the tail.
+
+    bool                            simulation          = false;
+    u32                             simulation_latency_frames = 2;
+
+    GpuMemoryBudget*                memory_budget       = nullptr;  // Optional, the streamer registers as a Textures evictor.
+
+}; // struct TextureStreamerCreation
+
+//
+// CPU side of the mip streaming. Each frame consumes the feedback buffer (one u32 per texture with the
+// finest sampled mip), evicts least recently used mips when over budget and outputs prioritized load
+// requests, one mip level at a time. Device independent: in simulation mode requests complete
+// by themselves after a fixed latency, so recorded feedback can be replayed without a GPU.
+// The renderer does not drive it yet: there is no feedback pass and material textures are fully resident.
+struct TextureStreamer {
+
+    void                            init( const TextureStreamerCreation& creation );
+    void                            shutdown();
+
+    u32                             register_texture( u32 width, u32 height, u32 mip_count );
+
+    void                            update( const u32* feedback, u32 feedback_count, u64 frame );
+
+    void                            complete_request( u32 texture, u32 mip );
+    void                            cancel_request( u32 texture );
+
+    sizet                           mip_size( u32 texture, u32 mip ) const;
+    sizet                           resident_size( u32 texture ) const;
+
+    // Lowers the budget by up to bytes, not below the mip tails. The next update evicts down to it.
+    // Returns the bytes to be evicted, textures sampled in the next update keep what they need.
+    sizet                           trim( sizet bytes );
+
+    Array<StreamedTexture>          textures;
+
+    Array<TextureStreamingRequest>  requests;           // Loads to issue this frame, highest priority first.
+    Array<TextureStreamingRequest>  evictions;          // Mips to unbind this frame.
+
+    TextureStreamingStats           stats;
+
+    sizet                           budget_bytes        = 0;
+    u32                             bytes_per_texel     = 4;
+    u32                             mip_tail_dimension  = 128;
+    u32                             max_requests_per_frame = 4;
+    u32                             eviction_delay_frames = 8;
+
+    bool                            simulation          = false;
+    u32                             simulation_latency_frames = 2;
+
+    GpuMemoryBudget*                memory_budget       = nullptr;  // Loads wait while the Textures hard limit is reached.
+
+    u64                             current_frame       = 0;
+
+private:
+
+    u32                             desired_mip( const StreamedTexture& texture ) const;
+    bool                            evict_one( u32 protected_texture );
+
+}; // struct TextureStreamer
+
+// GpuMemoryEvictionCallback with the TextureStreamer as context, to register it into the GpuMemoryBudget.
+u64                                 texture_streamer_evict_callback( void* context, GpuMemoryCategory::Enum category, u64 bytes );
+
+//
+// Recorded feedback buffers, one u32 per texture per frame. Used to replay a capture through the streamer.
+struct TextureStreamingFeedbackLog {
+
+    void                            init( Allocator* allocator, u32 texture_count, u32 frame_capacity );
+    void                            shutdown();
+
+    void                            record( const u32* feedback, u32 feedback_count );
+    const u32*                      frame( u32 index ) const;
+
+    bool                            write( cstring filename );
+    bool                            read( cstring filename );
+
+    void                            replay( TextureStreamer& streamer, u64 first_frame = 0 );
+
+    Allocator*                      allocator           = nullptr;
+    Array<u32>                      data;
+
+    u32                             texture_count       = 0;
+    u32                             frame_count         = 0;
+
+    static const u32                k_magic             = 0x54534642;   // 'TSFB'
+    static const u32                k_version           = 1;
+
+}; // struct TextureStreamingFeedbackLog
+
+} // namespace raptor
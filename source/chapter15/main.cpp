@@ -7,6 +7,7 @@
 #include "graphics/gpu_device.hpp"
 #include "graphics/command_buffer.hpp"
 #include "graphics/spirv_parser.hpp"
+#include "graphics/frame_statistics.hpp"
 #include "graphics/gpu_profiler.hpp"
 #include "graphics/raptor_imgui.hpp"
 #include "graphics/renderer.hpp"
@@ -17,6 +18,10 @@
 #include "graphics/asynchronous_loader.hpp"
 #include "graphics/scene_graph.hpp"
 #include "graphics/render_resources_loader.hpp"
+#include "graphics/acceleration_structures.hpp"
+#include "graphics/shader_hot_reload.hpp"
+#include "graphics/shader_variants.hpp"
+#include "graphics/dynamic_resolution.hpp"
 
 #include "external/cglm/struct/vec2.h"
 #include "external/cglm/struct/mat2.h"
@@ -563,12 +568,48 @@ namespace JitterType {
     cstring names[] = { "Halton", "Martin Robert R2", "Hammersley", "Interleaved Gradients"};
 } // namespace JitterType
 
+//
+//
+static void print_usage() {
+    printf( "Usage: chapter15 [--compress-geometry] [--analyze-bvh] [--fast-build-as] [path to glTF or obj model]\n" );
+}
+
 //
 //
 int main( int argc, char** argv ) {
 
-    if ( argc < 2 ) {
-        printf( "Usage: chapter15 [path to glTF model]\n");
+    // Options are read before loading anything, so that they apply wherever they are on the command line.
+    bool compress_geometry = false;
+    bool analyze_bvh = false;
+    bool fast_build_as = false;
+    i32 model_count = 0;
+    for ( i32 arg_i = 1; arg_i < argc; ++arg_i ) {
+        cstring argument = argv[ arg_i ];
+
+        if ( strcmp( argument, "--compress-geometry" ) == 0 ) {
+            compress_geometry = true;
+        } else if ( strcmp( argument, "--analyze-bvh" ) == 0 ) {
+            analyze_bvh = true;
+        } else if ( strcmp( argument, "--fast-build-as" ) == 0 ) {
+            fast_build_as = true;
+        } else if ( strncmp( argument, "--", 2 ) == 0 ) {
+            printf( "Unknown option %s\n", argument );
+            print_usage();
+            return -1;
+        } else {
+            cstring extension = strrchr( argument, '.' );
+            if ( extension == nullptr || ( strcmp( extension, ".gltf" ) != 0 && strcmp( extension, ".obj" ) != 0 ) ) {
+                printf( "Cannot load %s, only glTF and obj models are supported\n", argument );
+                print_usage();
+                return -1;
+            }
+            ++model_count;
+        }
+    }
+
+    // Options only, the default model replaces them as they have been read already.
+    if ( model_count == 0 ) {
+        print_usage();
         InjectDefault3DModel();
     }
 
@@ -576,9 +617,18 @@ int main( int argc, char** argv ) {
 
     time_service_init();
 
+    enki::TaskSchedulerConfig config;
+    // In this example we create more threads than the hardware can run,
+    // because the IO thread will spend most of it's time idle or blocked
+    // and therefore not scheduled for CPU time by the OS
+    config.numTaskThreadsToCreate += 1;
+
     // Init services
     MemoryServiceConfiguration memory_configuration;
     memory_configuration.maximum_dynamic_size = rgiga( 2ull );
+    memory_configuration.telemetry = true;
+    // Task threads plus the main thread.
+    memory_configuration.num_threads = config.numTaskThreadsToCreate + 1;
 
     MemoryService::instance()->init( &memory_configuration );
     Allocator* allocator = &MemoryService::instance()->system_allocator;
@@ -586,14 +636,10 @@ int main( int argc, char** argv ) {
     StackAllocator scratch_allocator;
     scratch_allocator.init( rmega( 8 ) );
 
-    enki::TaskSchedulerConfig config;
-    // In this example we create more threads than the hardware can run,
-    // because the IO thread will spend most of it's time idle or blocked
-    // and therefore not scheduled for CPU time by the OS
-    config.numTaskThreadsToCreate += 1;
     enki::TaskScheduler task_scheduler;
 
     task_scheduler.Initialize( config );
+    MemoryService::instance()->thread_allocator.set_task_scheduler( &task_scheduler );
 
     // window
     WindowConfiguration wconf{ 1280, 800, "Raptor Chapter 15: RT Reflections", &MemoryService::instance()->system_allocator};
@@ -624,7 +670,10 @@ int main( int argc, char** argv ) {
     dc.descriptor_pool_creation.uniform_texel_buffers = 1;
 
     GpuDevice gpu;
-    gpu.init( dc );
+    {
+        MemoryTagScope memory_tag( memory_tag_register( "gpu_device" ) );
+        gpu.init( dc );
+    }
 
     ResourceManager rm;
     rm.init( allocator, nullptr );
@@ -632,9 +681,20 @@ int main( int argc, char** argv ) {
     GpuVisualProfiler gpu_profiler;
     gpu_profiler.init( allocator, 100, dc.gpu_time_queries_per_frame );
 
+    // Last 10 seconds at 60 fps.
+    GpuProfilerCapture gpu_profiler_capture;
+    gpu_profiler_capture.init( allocator, 600, dc.gpu_time_queries_per_frame );
+    gpu_profiler.capture = &gpu_profiler_capture;
+
+    FrameStatistics frame_statistics;
+    frame_statistics.init( allocator, 600, task_scheduler.GetNumTaskThreads() );
+
     Renderer renderer;
-    renderer.init( { &gpu, allocator } );
-    renderer.set_loaders( &rm );
+    {
+        MemoryTagScope memory_tag( memory_tag_register( "renderer" ) );
+        renderer.init( { &gpu, allocator } );
+        renderer.set_loaders( &rm );
+    }
 
     ImGuiService* imgui = ImGuiService::instance();
     ImGuiServiceConfiguration imgui_config{ &gpu, window.platform_handle };
@@ -662,6 +722,10 @@ int main( int argc, char** argv ) {
         }
     }
     strcpy( renderer.resource_cache.binary_data_folder, shader_binaries_folder );
+
+    // Reflection of the stages compiled by previous runs, saved at shutdown.
+    cstring reflection_cache_path = temporary_name_buffer.append_use_f( "%sspirv_reflection.bin", shader_binaries_folder );
+    gpu.reflection_cache.load( reflection_cache_path );
     temporary_name_buffer.clear();
 
     SceneGraph scene_graph;
@@ -675,10 +739,21 @@ int main( int argc, char** argv ) {
     directory_current(&cwd);
 
     RenderScene* scene = nullptr;
+    AccelerationStructureBuildSettings as_build_settings{ };
+    if ( fast_build_as ) {
+        as_build_settings.build_mode = BvhBuildMode::FastBuild;
+    }
     for ( i32 arg_i = 1; arg_i < argc; ++arg_i ) {
+        MemoryTagScope memory_tag( memory_tag_register( "scene" ) );
+
         cstring scene_path = argv[ arg_i ];
         sizet scene_path_len = strlen( argv[ arg_i ] );
 
+        // Options have been read at startup.
+        if ( strncmp( scene_path, "--", 2 ) == 0 ) {
+            continue;
+        }
+
         char file_base_path[ 512 ]{ };
         memcpy( file_base_path, scene_path, scene_path_len );
         file_directory_from_path( file_base_path );
@@ -694,11 +769,15 @@ int main( int argc, char** argv ) {
         if ( scene == nullptr ) {
             // TODO(marco): further refactor to allow different formats
             if ( strcmp( file_extension, "gltf" ) == 0 ) {
-                scene = new glTFScene;
+                glTFScene* gltf_scene = new glTFScene;
+                gltf_scene->write_compressed_geometry = compress_geometry;
+                gltf_scene->analyze_bvh = analyze_bvh;
+                scene = gltf_scene;
             } else if ( strcmp( file_extension, "obj" ) == 0 ) {
                 scene = new ObjScene;
             }
             scene->init( &scene_graph, allocator, &renderer );
+            scene->task_scheduler = &task_scheduler;
             scene->use_meshlets = gpu.mesh_shaders_extension_present;
             scene->use_meshlets_emulation = !scene->use_meshlets;
         }
@@ -710,10 +789,12 @@ int main( int argc, char** argv ) {
     directory_change( cwd.path );
 
     FrameGraphBuilder frame_graph_builder;
-    frame_graph_builder.init( &gpu );
-
     FrameGraph frame_graph;
-    frame_graph.init( &frame_graph_builder );
+    {
+        MemoryTagScope memory_tag( memory_tag_register( "frame_graph" ) );
+        frame_graph_builder.init( &gpu );
+        frame_graph.init( &frame_graph_builder );
+    }
 
     if ( gpu.fragment_shading_rate_present )
     {
@@ -826,147 +907,36 @@ int main( int argc, char** argv ) {
     }
 
     // NOTE(marco): build AS before preparing draws
-    {
-        CommandBuffer* gpu_commands = gpu.get_command_buffer( 0, 0, true );
-
-        // NOTE(marco): build BLAS
-        VkAccelerationStructureBuildGeometryInfoKHR as_info{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR };
-        as_info.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-        as_info.flags = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
-        as_info.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-        as_info.geometryCount = scene->geometries.size;
-        as_info.pGeometries = scene->geometries.data;
-
-        Array<u32> max_primitives_count;
-        max_primitives_count.init( gpu.allocator, scene->geometries.size, scene->geometries.size );
-
-        for ( u32 range_index = 0; range_index < scene->geometries.size; range_index++ ) {
-            max_primitives_count[ range_index ] = scene->build_range_infos[ range_index ].primitiveCount;
-        }
-
-        VkAccelerationStructureBuildSizesInfoKHR as_size_info{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR };
-        gpu.vkGetAccelerationStructureBuildSizesKHR( gpu.vulkan_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &as_info, max_primitives_count.data, &as_size_info );
-
-        BufferCreation as_buffer_creation{ };
-        as_buffer_creation.set( VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR, ResourceUsageType::Immutable, as_size_info.accelerationStructureSize ).set_device_only( true ).set_name( "blas_buffer" );
-        scene->blas_buffer = gpu.create_buffer( as_buffer_creation );
-
-        Buffer* blas_buffer = gpu.access_buffer( scene->blas_buffer );
-
-        as_buffer_creation.reset().set( VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR, ResourceUsageType::Immutable, as_size_info.buildScratchSize ).set_device_only( true ).set_name( "blas_scratch_buffer" );
-
-        BufferHandle blas_scratch_buffer_handle = gpu.create_buffer( as_buffer_creation );
-
-        VkAccelerationStructureCreateInfoKHR as_create_info{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR };
-        as_create_info.buffer = blas_buffer->vk_buffer;
-        as_create_info.offset = 0;
-        as_create_info.size = as_size_info.accelerationStructureSize;
-        as_create_info.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-
-        gpu.vkCreateAccelerationStructureKHR( gpu.vulkan_device, &as_create_info, gpu.vulkan_allocation_callbacks, &scene->blas );
-
-        as_info.dstAccelerationStructure = scene->blas;
-
-        as_info.scratchData.deviceAddress = gpu.get_buffer_device_address( blas_scratch_buffer_handle );
-
-        VkAccelerationStructureBuildRangeInfoKHR* blas_ranges[] = {
-            scene->build_range_infos.data
-        };
-
-        gpu.vkCmdBuildAccelerationStructuresKHR( gpu_commands->vk_command_buffer, 1, &as_info, blas_ranges );
-
-        gpu.submit_immediate( gpu_commands );
-
-        // NOTE(marco): build TLAS
-        VkAccelerationStructureDeviceAddressInfoKHR blas_address_info{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR };
-        blas_address_info.accelerationStructure = scene->blas;
-
-        VkDeviceAddress blas_address = gpu.vkGetAccelerationStructureDeviceAddressKHR( gpu.vulkan_device, &blas_address_info );
-
-        VkAccelerationStructureInstanceKHR tlas_structure{ };
-        // NOTE(marco): identity matrix
-        tlas_structure.transform.matrix[ 0 ][ 0 ] = 1.0f;
-        tlas_structure.transform.matrix[ 1 ][ 1 ] = 1.0f;
-        tlas_structure.transform.matrix[ 2 ][ 2 ] = -1.0f;
-        tlas_structure.mask = 0xff;
-        tlas_structure.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-        tlas_structure.accelerationStructureReference = blas_address;
-
-        as_buffer_creation.reset().set( VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, ResourceUsageType::Immutable, sizeof( VkAccelerationStructureInstanceKHR ) ).set_data( &tlas_structure ).set_name( "tlas_instance_buffer" );
-        BufferHandle tlas_instance_buffer_handle = gpu.create_buffer( as_buffer_creation );
-
-        VkAccelerationStructureGeometryKHR tlas_geometry{ VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR };
-        tlas_geometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
-        tlas_geometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
-        tlas_geometry.geometry.instances.arrayOfPointers = false;
-        tlas_geometry.geometry.instances.data.deviceAddress = gpu.get_buffer_device_address( tlas_instance_buffer_handle );
+    acceleration_structures_build( gpu, *scene, &task_scheduler, allocator, as_build_settings, nullptr );
 
-        as_info.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-        as_info.geometryCount = 1;
-        as_info.pGeometries = &tlas_geometry;
-
-        u32 max_instance_count = 1;
-
-        gpu.vkGetAccelerationStructureBuildSizesKHR( gpu.vulkan_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &as_info, &max_instance_count, &as_size_info );
-
-        as_buffer_creation.reset().set( VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR, ResourceUsageType::Immutable, as_size_info.accelerationStructureSize ).set_device_only( true ).set_name( "tlas_buffer" );
-        scene->tlas_buffer = gpu.create_buffer( as_buffer_creation );
-
-        Buffer* tlas_buffer = gpu.access_buffer( scene->tlas_buffer );
-
-        as_buffer_creation.reset().set( VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT_KHR, ResourceUsageType::Immutable, as_size_info.buildScratchSize ).set_device_only( true ).set_name( "tlas_scratch_buffer" );
-
-        BufferHandle tlas_scratch_buffer_handle = gpu.create_buffer( as_buffer_creation );
-
-        as_create_info.buffer = tlas_buffer->vk_buffer;
-        as_create_info.offset = 0;
-        as_create_info.size = as_size_info.accelerationStructureSize;
-        as_create_info.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
-
-        gpu.vkCreateAccelerationStructureKHR( gpu.vulkan_device, &as_create_info, gpu.vulkan_allocation_callbacks, &scene->tlas );
-
-        as_info.dstAccelerationStructure = scene->tlas;
-
-        as_info.scratchData.deviceAddress = gpu.get_buffer_device_address( tlas_scratch_buffer_handle );
-
-        VkAccelerationStructureBuildRangeInfoKHR tlas_range_info{ };
-        tlas_range_info.primitiveCount = 1;
-
-        VkAccelerationStructureBuildRangeInfoKHR* tlas_ranges[] = {
-            &tlas_range_info
-        };
-
-        gpu_commands->reset();
-
-        gpu_commands->begin();
-
-        // TODO(marco): we shouldn't be doing this manually
-        GpuThreadFramePools* thread_pools = gpu_commands->thread_frame_pool;
-        thread_pools->time_queries->reset();
-        vkCmdResetQueryPool( gpu_commands->vk_command_buffer, thread_pools->vulkan_timestamp_query_pool, 0, thread_pools->time_queries->time_queries.size );
-
-        vkCmdResetQueryPool( gpu_commands->vk_command_buffer, thread_pools->vulkan_pipeline_stats_query_pool, 0, GpuPipelineStatistics::Count );
-
-        vkCmdBeginQuery( gpu_commands->vk_command_buffer, thread_pools->vulkan_pipeline_stats_query_pool, 0, 0 );
-
-        gpu.vkCmdBuildAccelerationStructuresKHR( gpu_commands->vk_command_buffer, 1, &as_info, tlas_ranges );
-
-        gpu.submit_immediate( gpu_commands );
-
-        scene->geometries.shutdown();
-        scene->build_range_infos.shutdown();
-
-        gpu.destroy_buffer( blas_scratch_buffer_handle );
-        gpu.destroy_buffer( tlas_scratch_buffer_handle );
-        gpu.destroy_buffer( tlas_instance_buffer_handle );
-
-        max_primitives_count.shutdown();
+    // Feature variants of the techniques, compiled when first used.
+    ShaderVariantManager shader_variants;
+    shader_variants.init( allocator, &renderer, &render_resources_loader, use_shader_cache );
+    for ( u32 t = 0; t < ArraySize( techniques ); ++t ) {
+        temporary_name_buffer.clear();
+        cstring path = temporary_name_buffer.append_use_f( "%s/%s", RAPTOR_SHADER_FOLDER, techniques[ t ] );
+        shader_variants.add_technique( path );
     }
+    scene->shader_variants = &shader_variants;
 
     FrameRenderer frame_renderer;
     frame_renderer.init( allocator, &renderer, &frame_graph, &scene_graph, scene );
     frame_renderer.prepare_draws( &scratch_allocator );
 
+    // Recompile techniques when their shader files change.
+    ShaderHotReloader shader_hot_reloader;
+    shader_hot_reloader.init( allocator, &render_resources_loader, techniques, ArraySize( techniques ), use_shader_cache );
+
+    // Scale the raytraced reflections and their denoising to keep the GPU frame time under a target.
+    // The GBuffer and TAA passes are not scaled, there is no upscaler for them.
+    bool reflections_dynamic_resolution = false;
+    DynamicResolutionController reflections_resolution_controller;
+    reflections_resolution_controller.init( scene->rt_reflections_scale * 0.5f, scene->rt_reflections_scale, 16.6f );
+    reflections_resolution_controller.add_scaled_pass( "reflections_pass" );
+    reflections_resolution_controller.add_scaled_pass( "svgf_accumulation_pass" );
+    reflections_resolution_controller.add_scaled_pass( "svgf_variance_pass" );
+    reflections_resolution_controller.add_scaled_pass( "svgf_wavelet_pass" );
+
     // Start multithreading IO
     // Create IO threads at the end
     RunPinnedTaskLoopTask run_pinned_task;
@@ -1011,17 +981,34 @@ int main( int argc, char** argv ) {
 
         // New frame
         if ( !window.minimized ) {
-            gpu.new_frame();
+            {
+                FramePhaseScope present_wait_scope( &frame_statistics, FramePhase::PresentWait );
+                gpu.new_frame();
+            }
+
+            // Tasks of the previous frame are done.
+            MemoryService::instance()->thread_allocator.reset_scratch();
+
+            // Pipelines are swapped before any command is recorded for the frame.
+            if ( shader_hot_reloader.update() ) {
+                // Variants are compiled again from the new sources when used.
+                shader_variants.reset();
+                frame_graph.reload_shaders( *scene, allocator, &scratch_allocator );
+            }
+            shader_variants.update();
 
             static bool one_time_check = true;
-            if ( async_loader.file_load_requests.size == 0 && one_time_check ) {
+            if ( async_loader.file_load_requests.size == 0 && async_loader.file_reads.size == 0 && one_time_check ) {
                 one_time_check = false;
                 rprint( "Finished uploading textures in %f seconds\n", time_from_seconds( absolute_begin_frame_tick ) );
             }
         }
 
-        window.handle_os_messages();
-        input.new_frame();
+        {
+            FramePhaseScope input_scope( &frame_statistics, FramePhase::Input );
+            window.handle_os_messages();
+            input.new_frame();
+        }
 
         if ( window.resized ) {
             renderer.resize_swapchain( window.width, window.height );
@@ -1039,9 +1026,12 @@ int main( int argc, char** argv ) {
         f32 delta_time = ( f32 )time_delta_seconds( begin_frame_tick, current_tick );
         begin_frame_tick = current_tick;
 
-        input.update( delta_time );
-        game_camera.update( &input, window.width, window.height, delta_time );
-        window.center_mouse( game_camera.mouse_dragging );
+        {
+            FramePhaseScope input_scope( &frame_statistics, FramePhase::Input );
+            input.update( delta_time );
+            game_camera.update( &input, window.width, window.height, delta_time );
+            window.center_mouse( game_camera.mouse_dragging );
+        }
 
         static f32 animation_speed_multiplier = 0.05f;
         static bool enable_frustum_cull_meshes = true;
@@ -1119,6 +1109,7 @@ int main( int argc, char** argv ) {
 
         {
             ZoneScopedN( "ImGui Recording" );
+            FramePhaseScope imgui_scope( &frame_statistics, FramePhase::ImGui );
 
             if ( ImGui::Begin( "Raptor ImGui" ) ) {
                 ImGui::InputFloat( "Scene global scale", &scene->global_scale, 0.001f );
@@ -1138,6 +1129,26 @@ int main( int argc, char** argv ) {
                     ImGui::InputFloat( "Spring stiffness", &spring_stiffness );
                     ImGui::InputFloat( "Spring damping", &spring_damping );
                     ImGui::Checkbox( "Reset simulation", &reset_simulation );
+
+                    ImGui::Checkbox( "CPU cloth solver", &scene->cloth_use_cpu_solver );
+                    if ( scene->cloth_use_cpu_solver ) {
+                        i32 cloth_solver_type = scene->cloth_cpu_solver_type;
+                        if ( ImGui::Combo( "CPU solver", &cloth_solver_type, ClothSolverType::s_value_names, ClothSolverType::Count ) ) {
+                            scene->cloth_cpu_solver_type = ( ClothSolverType::Enum )cloth_solver_type;
+                        }
+                        ImGui::Checkbox( "CPU solver AVX2", &scene->cloth_cpu_solver_avx2 );
+
+                        for ( u32 m = 0; m < scene->meshes.size; ++m ) {
+                            const PhysicsMesh* physics_mesh = scene->meshes[ m ].physics_mesh;
+                            if ( physics_mesh == nullptr ) {
+                                continue;
+                            }
+
+                            const ClothSolverStats& cloth_stats = physics_mesh->cpu_solver.stats;
+                            ImGui::Text( "Mesh %u: %u vertices, %u springs, %u colors, %2.3f ms, %.0f vertex steps/ms", m, cloth_stats.vertices,
+                                         cloth_stats.constraints, cloth_stats.colors, cloth_stats.simulate_ms, cloth_stats.vertices_per_ms );
+                        }
+                    }
                 }
 
                 if ( ImGui::CollapsingHeader( "Math tests" ) ) {
@@ -1187,16 +1198,27 @@ int main( int argc, char** argv ) {
                     ImGui::Checkbox( "Skip invisible lights", &skip_invisible_lights );
                     ImGui::Checkbox( "use view aabb", &use_view_aabb );
                     ImGui::Checkbox( "force fullscreen light aabb", &force_fullscreen_light_aabb );
+                    ImGui::Checkbox( "Cull lights with BVH", &scene->use_light_bvh );
+                    ImGui::Text( "Visible lights %u/%u, BVH nodes visited %u", scene->visible_lights, scene->active_lights, scene->light_bvh_visited_nodes );
+                    ImGui::SliderUint( "Max shadowed lights", &scene->max_shadow_lights, 1, k_num_lights );
+                    ImGui::Text( "Selected shadowed lights %u, top score %f", scene->shadow_lights.size, scene->shadow_light_scores.size ? scene->shadow_light_scores[ 0 ] : 0.f );
                     ImGui::Checkbox( "debug show light tiles", &debug_show_light_tiles );
                     ImGui::Checkbox( "debug show tiles", &debug_show_tiles );
                     ImGui::Checkbox( "debug show bins", &debug_show_bins );
                     ImGui::SliderUint( "Lighting debug modes", &lighting_debug_modes, 0, 10 );
+                    ImGui::Checkbox( "Lighting debug options variant", &scene->lighting_debug_options );
+                    ImGui::Checkbox( "Lighting culling optimization variant", &scene->lighting_culling_optimization );
                 }
                 if ( ImGui::CollapsingHeader( "PointLight Shadows" ) ) {
                     ImGui::Checkbox( "Pointlight rendering", &scene->pointlight_rendering );
                     ImGui::Checkbox( "Pointlight rendering use meshlets", &scene->pointlight_use_meshlets );
                     ImGui::Checkbox( "Disable shadows", &disable_shadows );
                     ImGui::Checkbox( "Use tetrahedron shadows", &scene->use_tetrahedron_shadows );
+                    ImGui::Checkbox( "Cache static shadows", &scene->pointlight_shadow_caching );
+
+                    const ShadowCacheStats& shadow_cache_stats = frame_renderer.pointlight_shadow_pass.shadow_cache.stats;
+                    ImGui::Text( "Faces rendered %u, skipped %u, dynamic %u", shadow_cache_stats.faces_rendered, shadow_cache_stats.faces_skipped, shadow_cache_stats.faces_dynamic );
+                    ImGui::Text( "Changed lights %u, static casters %u, dynamic casters %u", shadow_cache_stats.light_changes, shadow_cache_stats.static_changes, shadow_cache_stats.dynamic_casters );
                     ImGui::Checkbox( "Cubeface switch Pos X", &scene->cubeface_flip[ 0 ] );
                     ImGui::Checkbox( "Cubeface switch Neg X", &scene->cubeface_flip[ 1 ] );
                     ImGui::Checkbox( "Cubeface switch Pos Y", &scene->cubeface_flip[ 2 ] );
@@ -1236,6 +1258,12 @@ int main( int argc, char** argv ) {
 
                         scene->volumetric_fog_box_color = box_color.abgr;
                     }
+
+                    ImGui::Checkbox( "CPU froxel light assignment", &scene->volumetric_fog_cpu_light_assignment );
+                    const FroxelLightStats& froxel_stats = frame_renderer.volumetric_fog_pass.froxel_light_assigner.stats;
+                    ImGui::Text( "Froxels %u, lights %u, volumes %u", froxel_stats.froxels, froxel_stats.lights, froxel_stats.volumes );
+                    ImGui::Text( "Light pairs %u, volume pairs %u, empty froxels %u", froxel_stats.light_pairs, froxel_stats.volume_pairs, froxel_stats.empty_froxels );
+                    ImGui::Text( "Lights per froxel %f, max %u, light tests saved per froxel %f", froxel_stats.average_lights_per_froxel, froxel_stats.max_lights_per_froxel, froxel_stats.light_tests_saved_per_froxel );
                 }
                 if ( ImGui::CollapsingHeader( "Temporal Anti-Aliasing" ) ) {
                     ImGui::Checkbox( "Enable", &scene->taa_enabled );
@@ -1307,6 +1335,13 @@ int main( int argc, char** argv ) {
 
                     ImGui::Text( "Total Rays: %u, Rays per probe %u, Total Probes %u", frame_renderer.indirect_pass.get_total_rays(), frame_renderer.indirect_pass.probe_rays, frame_renderer.indirect_pass.get_total_probes() );
                     ImGui::SliderInt( "Per frame probe updates", &scene->gi_per_frame_probes_update, 0, frame_renderer.indirect_pass.get_total_probes() );
+                    ImGui::Checkbox( "Use Probe Scheduler", &scene->gi_use_probe_scheduler );
+                    ImGui::SliderInt( "Probe ray budget", &scene->gi_probe_ray_budget, 0, frame_renderer.indirect_pass.get_total_rays() );
+
+                    const DDGIProbeSchedulerStats& probe_stats = frame_renderer.indirect_pass.probe_scheduler.stats;
+                    ImGui::Text( "Scheduled probes %u/%u, rays %u", probe_stats.scheduled_probes, probe_stats.budget_probes, probe_stats.scheduled_rays );
+                    ImGui::Text( "Probes active %u, inactive %u, off %u, uninitialized %u", probe_stats.active_probes, probe_stats.inactive_probes, probe_stats.off_probes, probe_stats.uninitialized_probes );
+                    ImGui::Text( "Oldest active probe %u frames, max variance %f", probe_stats.max_age, probe_stats.max_variance );
                     // Check if probe offsets needs to be recalculated.
                     scene->gi_recalculate_offsets = false;
 
@@ -1347,11 +1382,41 @@ int main( int argc, char** argv ) {
                     ImGui::SliderFloat( "Wavelet Sigma L", &scene->rt_wavelet_sigma_l, 0.0f, 20.0f );
                     ImGui::SliderFloat( "Wavelet Sigma N", &scene->rt_wavelet_sigma_n, 0.001f, 200.0f );
                     ImGui::SliderFloat( "Wavelet Sigma Z", &scene->rt_wavelet_sigma_z, 0.0f, 1.0f );
+                    if ( ImGui::Checkbox( "Dynamic Resolution", &reflections_dynamic_resolution ) ) {
+                        reflections_resolution_controller.reset( scene->rt_reflections_scale );
+                    }
+                    ImGui::SliderFloat( "Target GPU Frame Time (ms)", &reflections_resolution_controller.target_frame_ms, 4.0f, 50.0f );
+                    ImGui::SliderFloat( "Minimum Scale", &reflections_resolution_controller.min_scale, 0.1f, reflections_resolution_controller.max_scale );
+                    const DynamicResolutionStats& resolution_stats = reflections_resolution_controller.stats;
+                    ImGui::Text( "Scale %.3f (max %.3f), frame %.2f ms, filtered %.2f ms, scaled passes %.2f ms", scene->rt_reflections_dynamic_scale, scene->rt_reflections_scale,
+                                 resolution_stats.frame_ms, resolution_stats.filtered_frame_ms, resolution_stats.scaled_ms );
+                    ImGui::Text( "Model scale %.3f, %u changes (%u emergency), %u spikes ignored", resolution_stats.model_scale, resolution_stats.scale_changes,
+                                 resolution_stats.emergency_changes, resolution_stats.rejected_samples );
                 }
                 ImGui::Separator();
 
                 ImGui::Checkbox( "Show Debug GPU Draws", &scene->show_debug_gpu_draws );
                 ImGui::Checkbox( "Dynamically recreate descriptor sets", &recreate_per_thread_descriptors );
+                const DescriptorSetCacheStats& descriptor_set_stats = gpu.descriptor_set_cache.stats;
+                ImGui::Text( "Descriptor sets: %u allocated, %u shared, %u hash collisions, %u invalidated", descriptor_set_stats.allocations, descriptor_set_stats.hits,
+                             descriptor_set_stats.collisions, descriptor_set_stats.invalidations );
+                const MaterialTableStats& material_stats = scene->material_table.stats;
+                ImGui::Text( "Materials: %u in table, %u retired, %u shared, %u hash collisions", material_stats.live, material_stats.retired, material_stats.shared,
+                             material_stats.collisions );
+                const DeletionQueueStats& deletion_stats = gpu.deletion_queue.stats;
+                ImGui::Text( "Deferred deletions: %u pending, %u peak, %u destroyed, %u buckets (%u conflicts)", deletion_stats.pending, deletion_stats.peak_pending,
+                             deletion_stats.destroyed, gpu.deletion_queue.buckets.size, deletion_stats.bucket_conflicts );
+                const ShaderHotReloadStats& reload_stats = shader_hot_reloader.stats;
+                ImGui::Text( "Shader hot reload: %u file changes, %u dirty stages, %u techniques swapped", reload_stats.file_changes, reload_stats.dirty_stages, reload_stats.swapped_techniques );
+                const SpirvReflectionCacheStats& reflection_stats = gpu.reflection_cache.stats;
+                const f64 parse_throughput = reflection_stats.parse_ms > 0.0 ? ( reflection_stats.parsed_bytes / ( 1024.0 * 1024.0 ) ) / ( reflection_stats.parse_ms / 1000.0 ) : 0.0;
+                ImGui::Text( "Spir-V reflection: %u loaded, %u hits (%.2f ms), %u parsed (%.2f ms, %.1f MB/s), %u mismatches", reflection_stats.loaded_entries, reflection_stats.hits,
+                             reflection_stats.lookup_ms, reflection_stats.misses, reflection_stats.parse_ms, parse_throughput, reflection_stats.mismatches );
+                ImGui::Checkbox( "Validate Spir-V reflection cache", &gpu.reflection_cache.validate );
+                const ShaderVariantStats& variant_stats = shader_variants.cache.stats;
+                ImGui::Text( "Shader variants: %u requested, %u modules compiled (%u failed, %u same Spir-V), %u specialized, %u pipelines (%u shared)",
+                             variant_stats.requested_variants, variant_stats.compiled_modules, variant_stats.failed_modules, variant_stats.deduplicated_spirv,
+                             variant_stats.specialized_variants, variant_stats.created_pipelines, variant_stats.shared_pipelines );
                 ImGui::Checkbox( "Use secondary command buffers", &use_secondary_command_buffers );
                 ImGui::Separator();
                 ImGui::SliderFloat( "Animation Speed Multiplier", &animation_speed_multiplier, 0.0f, 10.0f );
@@ -1412,6 +1477,10 @@ int main( int argc, char** argv ) {
             }
             ImGui::End();
 
+            MemoryService::instance()->imgui_draw();
+
+            frame_statistics.imgui_draw();
+
             if ( ImGui::Begin( "Frame Graph Debug" ) ) {
 
                 frame_graph.debug_ui();
@@ -1479,19 +1548,23 @@ int main( int argc, char** argv ) {
         }
         {
             ZoneScopedN( "AnimationsUpdate" );
+            FramePhaseScope animation_scope( &frame_statistics, FramePhase::Animation );
             scene->update_animations( delta_time * animation_speed_multiplier );
         }
         {
             ZoneScopedN( "SceneGraphUpdate" );
+            FramePhaseScope scene_graph_scope( &frame_statistics, FramePhase::SceneGraph );
             scene_graph.update_matrices();
         }
         {
             ZoneScopedN( "JointsUpdate" );
+            FramePhaseScope scene_graph_scope( &frame_statistics, FramePhase::SceneGraph );
             scene->update_joints();
         }
 
         {
             ZoneScopedN( "Gpu Buffers Update" );
+            FramePhaseScope upload_scope( &frame_statistics, FramePhase::Upload );
 
             GpuSceneData& scene_data = scene->scene_data;
 
@@ -1579,6 +1652,18 @@ int main( int argc, char** argv ) {
                 gpu.unmap_buffer( cb_map );
             }
 
+            // Dynamic resolution of the reflections, from the timestamps of the last frame resolved by the profiler.
+            if ( reflections_dynamic_resolution ) {
+                if ( !gpu_profiler.paused ) {
+                    const u32 profiler_frame = ( gpu_profiler.current_frame + gpu_profiler.max_frames - 1 ) % gpu_profiler.max_frames;
+                    reflections_resolution_controller.update( &gpu_profiler.timestamps[ profiler_frame * gpu_profiler.max_queries_per_frame ],
+                                                              gpu_profiler.per_frame_active[ profiler_frame ] );
+                }
+                scene->rt_reflections_dynamic_scale = reflections_resolution_controller.scale;
+            } else {
+                scene->rt_reflections_dynamic_scale = scene->rt_reflections_scale;
+            }
+
             cb_map.buffer = scene->lighting_constants_cb[ gpu.current_frame ];
             GpuLightingData* gpu_lighting_data = ( GpuLightingData* )gpu.map_buffer( cb_map );
             if ( gpu_lighting_data ) {
@@ -1612,6 +1697,8 @@ int main( int argc, char** argv ) {
                 if ( resource ) {
                     gpu_lighting_data->reflections_texture_index = resource->resource_info.texture.handle.index;
                 }
+                gpu_lighting_data->reflections_uv_scale_x = scene->rt_reflections_dynamic_scale / scene->rt_reflections_scale;
+                gpu_lighting_data->reflections_uv_scale_y = gpu_lighting_data->reflections_uv_scale_x;
 
                 // Volumetric fog data
                 // TODO: parametrize it
@@ -1655,10 +1742,11 @@ int main( int argc, char** argv ) {
             upload_context.last_clicked_position_left_button = last_clicked_position;
             frame_renderer.upload_gpu_data( upload_context );
 
-            // Place light AABB with a smaller aabb to indicate the center.
+            // Place light AABB and sphere with a smaller aabb to indicate the center.
             if ( scene->show_light_edit_debug_draws ) {
                 const Light& light = scene->lights[ light_to_debug ];
                 f32 half_radius = light.radius;
+                scene->debug_renderer.sphere( light.world_position, light.radius, { Color::yellow } );
                 scene->debug_renderer.aabb( glms_vec3_sub( light.world_position, { half_radius, half_radius ,half_radius } ), glms_vec3_add( light.world_position, { half_radius, half_radius , half_radius } ), { Color::white } );
                 scene->debug_renderer.aabb( glms_vec3_sub( light.world_position, { .1, .1, .1 } ), glms_vec3_add( light.world_position, { .1, .1, .1 } ), { Color::green } );
             }
@@ -1667,17 +1755,20 @@ int main( int argc, char** argv ) {
         if ( !window.minimized ) {
             DrawTask draw_task;
             draw_task.init( renderer.gpu, &frame_graph, &renderer, imgui, &gpu_profiler, scene, &frame_renderer );
+            draw_task.frame_statistics = &frame_statistics;
             task_scheduler.AddTaskSetToPipe( &draw_task );
 
             CommandBuffer* async_compute_command_buffer = nullptr;
             {
                 ZoneScopedN( "PhysicsUpdate" );
+                FramePhaseScope physics_scope( &frame_statistics, FramePhase::Physics );
                 async_compute_command_buffer = scene->update_physics( delta_time, air_density, spring_stiffness, spring_damping, wind_direction, reset_simulation );
                 reset_simulation = false;
             }
 
             task_scheduler.WaitforTaskSet( &draw_task );
 
+            FramePhaseScope submit_scope( &frame_statistics, FramePhase::Submit );
             // Avoid using the same command buffer
             renderer.add_texture_update_commands( ( draw_task.thread_id + 1 ) % task_scheduler.GetNumTaskThreads() );
             gpu.present( async_compute_command_buffer );
@@ -1685,6 +1776,18 @@ int main( int argc, char** argv ) {
             ImGui::Render();
         }
 
+        {
+            // GPU time of the last frame collected by the profiler, a few frames behind.
+            f32 gpu_frame_ms = 0.f;
+            const u32 profiler_frame = ( gpu_profiler.current_frame + gpu_profiler.max_frames - 1 ) % gpu_profiler.max_frames;
+            const GPUTimeQuery* profiler_timestamps = &gpu_profiler.timestamps[ profiler_frame * gpu_profiler.max_queries_per_frame ];
+            for ( u32 t = 0; t < gpu_profiler.per_frame_active[ profiler_frame ]; ++t ) {
+                gpu_frame_ms += profiler_timestamps[ t ].depth == 0 ? ( f32 )profiler_timestamps[ t ].elapsed_ms : 0.f;
+            }
+
+            frame_statistics.end_frame( gpu_frame_ms );
+        }
+
         FrameMark;
     }
 
@@ -1695,23 +1798,26 @@ int main( int argc, char** argv ) {
     run_pinned_task.execute = false;
     async_load_task.execute = false;
 
+    shader_hot_reloader.shutdown();
+    shader_variants.shutdown();
+
     task_scheduler.WaitforAllAndShutdown();
+    MemoryService::instance()->thread_allocator.set_task_scheduler( nullptr );
 
     vkDeviceWaitIdle( gpu.vulkan_device );
 
     async_loader.shutdown();
 
     // Destroy resources built here.
-    gpu.destroy_buffer( scene->blas_buffer );
-    gpu.vkDestroyAccelerationStructureKHR( gpu.vulkan_device, scene->blas, gpu.vulkan_allocation_callbacks );
-    gpu.destroy_buffer( scene->tlas_buffer );
-    gpu.vkDestroyAccelerationStructureKHR( gpu.vulkan_device, scene->tlas, gpu.vulkan_allocation_callbacks );
+    acceleration_structures_destroy( gpu, *scene );
     gpu.destroy_sampler( repeat_nearest_sampler );
     gpu.destroy_sampler( repeat_sampler );
 
     imgui->shutdown();
 
     gpu_profiler.shutdown();
+    gpu_profiler_capture.shutdown();
+    frame_statistics.shutdown();
 
     scene_graph.shutdown();
 
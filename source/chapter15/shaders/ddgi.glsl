@@ -39,9 +39,17 @@ layout(std430, set = MATERIAL_SET, binding = 43) readonly buffer ProbeStatusSSBO
 
 layout( location = 0 ) rayPayloadEXT RayPayload payload;
 
+// Probes scheduled on the CPU, used instead of the probe update offset.
+layout(std430, set = MATERIAL_SET, binding = 44) readonly buffer ProbeUpdateListSSBO {
+    uint        probe_update_list[];
+};
+
 void main() {
 	const ivec2 pixel_coord = ivec2(gl_LaunchIDEXT.xy);
-    const int probe_index = pixel_coord.y + probe_update_offset;
+    if ( use_probe_update_list() && pixel_coord.y >= probe_update_count ) {
+        return;
+    }
+    const int probe_index = use_probe_update_list() ? int(probe_update_list[pixel_coord.y]) : pixel_coord.y + probe_update_offset;
     const int ray_index = pixel_coord.x;
 
     const bool skip_probe = (probe_status[probe_index] == PROBE_STATUS_OFF) || (probe_status[probe_index] == PROBE_STATUS_UNINITIALIZED);
@@ -90,8 +98,11 @@ void main() {
         distance *= -0.2;        
     }
     else {
-        uint mesh_index = mesh_instance_draws[ gl_GeometryIndexEXT ].mesh_draw_index;
+        // Each blas instance stores the index of its first geometry
+        const uint mesh_instance_index = gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT;
+        uint mesh_index = mesh_instance_draws[ mesh_instance_index ].mesh_draw_index;
         MeshDraw mesh = mesh_draws[ mesh_index ];
+        Material material = materials[ mesh_instance_draws[ mesh_instance_index ].material_index ];
 
         int_array_type index_buffer = int_array_type( mesh.index_buffer );
         int i0 = index_buffer[ gl_PrimitiveID * 3 ].v;
@@ -118,7 +129,7 @@ void main() {
             1.0
         );
 
-        const mat4 transform = mesh_instance_draws[ gl_GeometryIndexEXT ].model;
+        const mat4 transform = mesh_instance_draws[ mesh_instance_index ].model;
         vec4 p0_world = transform * p0;
         vec4 p1_world = transform * p1;
         vec4 p2_world = transform * p2;
@@ -140,7 +151,7 @@ void main() {
         vec2 uv = ( a * uv0 + b * uv1 + c * uv2 );
 
         // Use lower texture Lod to increase performances.
-        vec3 albedo = textureLod( global_textures[ nonuniformEXT( mesh.textures.x ) ], uv, 3 ).rgb;
+        vec3 albedo = textureLod( global_textures[ nonuniformEXT( material.textures.x ) ], uv, 3 ).rgb;
 
         // Compute plane normal
         // vec3 v0_v1 = p1_world.xyz - p0_world.xyz;
@@ -162,7 +173,7 @@ void main() {
 
         vec3 normal = a * n0 + b * n1 + c * n2;
 
-        const mat3 normal_transform = mat3(mesh_instance_draws[ gl_GeometryIndexEXT ].model_inverse);
+        const mat3 normal_transform = mat3(mesh_instance_draws[ mesh_instance_index ].model_inverse);
         normal = normal_transform * normal;
 
         const vec3 world_position = a * p0_world.xyz + b * p1_world.xyz + c * p2_world.xyz;
@@ -84,6 +84,10 @@ bool use_infinite_bounces() {
     return (ddgi_debug_options & 512) == 512;
 }
 
+bool use_probe_update_list() {
+    return (ddgi_debug_options & 1024) == 1024;
+}
+
 // Probe status //////////////////////////////////////////////////////////
 #define PROBE_STATUS_OFF 0
 #define PROBE_STATUS_SLEEP 1
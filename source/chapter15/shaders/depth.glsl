@@ -34,18 +34,18 @@ void main() {
 #if defined (FRAGMENT_DEPTH_PRE_SKINNING)
 
 layout (location = 0) in vec2 vTexcoord0;
-layout (location = 1) in flat uint mesh_draw_index;
+layout (location = 1) in flat uint material_index;
 
 void main() {
 
-    MeshDraw mesh_draw = mesh_draws[mesh_draw_index];
-    uint flags = mesh_draw.flags;
-    uvec4 textures = mesh_draw.textures;
+    Material material = materials[material_index];
+    uint flags = material.flags;
+    uvec4 textures = material.textures;
 
     float texture_alpha = texture(global_textures[nonuniformEXT(textures.x)], vTexcoord0).a;
 
     bool useAlphaMask = (flags & DrawFlags_AlphaMask) != 0;
-    if (useAlphaMask && texture_alpha < mesh_draw.alpha_cutoff) {
+    if (useAlphaMask && texture_alpha < material.alpha_cutoff) {
         discard;
     }
 
@@ -6,7 +6,7 @@ layout (location = 4) in ivec4 jointIndices;
 layout (location = 5) in vec4 jointWeights;
 
 layout (location = 0) out vec2 vTexcoord0;
-layout (location = 1) out flat uint mesh_draw_index;
+layout (location = 1) out flat uint material_index;
 
 layout(std430, set = MATERIAL_SET, binding = 3) readonly buffer JointMatrices {
     mat4 joint_matrices[];
@@ -15,7 +15,7 @@ layout(std430, set = MATERIAL_SET, binding = 3) readonly buffer JointMatrices {
 void main() {
 
     MeshInstanceDraw mesh_draw = mesh_instance_draws[gl_InstanceIndex];
-    mesh_draw_index = mesh_draw.mesh_draw_index;
+    material_index = mesh_draw.material_index;
 
     mat4 skinning_transform = 
         jointWeights.x * joint_matrices[(jointIndices.x)] +
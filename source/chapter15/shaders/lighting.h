@@ -5,8 +5,14 @@
 #extension GL_KHR_shader_subgroup_ballot : enable
 #extension GL_KHR_shader_subgroup_arithmetic : enable
 
-#define DEBUG_OPTIONS
-#define ENABLE_OPTIMIZATION 1
+// Shader features, see the "features" of pbr_lighting.json.
+#ifndef DEBUG_OPTIONS
+#define DEBUG_OPTIONS 1
+#endif // DEBUG_OPTIONS
+
+// Specialization constant: switching it does not need a new compilation.
+layout (constant_id = 1) const uint ENABLE_OPTIMIZATION = 1;
+
 #define RAYTRACED_SHADOWS 1
 #define FRAME_HISTORY_COUNT 4
 #define USE_SHADOW_VISIBILITY 1 // TODO(marco): make into scene option
@@ -73,8 +79,8 @@ layout ( std140, set = MATERIAL_SET, binding = 23 ) uniform LightConstants {
     float       raytraced_shadow_light_intensity;
 
     uint        brdf_lut_texture_index;
-    uint        pad001_lc;
-    uint        pad002_lc;
+    float       reflections_uv_scale_x;
+    float       reflections_uv_scale_y;
     uint        pad003_lc;
 };
 
@@ -604,61 +610,61 @@ vec4 calculate_lighting(vec4 base_colour, vec3 orm, vec3 normal, vec3 emissive,
     uint stride = uint( NUM_WORDS ) * ( uint( resolution.x ) / uint( TILE_SIZE ) );
     uint address = tile.y * stride + tile.x;
 
-#if ENABLE_OPTIMIZATION
-    // NOTE(marco): this version has been implemented following:
-    // https://www.activision.com/cdn/research/2017_Sig_Improved_Culling_final.pdf
-    // See the presentation for more details
+    if ( ENABLE_OPTIMIZATION != 0 ) {
+        // NOTE(marco): this version has been implemented following:
+        // https://www.activision.com/cdn/research/2017_Sig_Improved_Culling_final.pdf
+        // See the presentation for more details
 
-    // NOTE(marco): get the minimum and maximum light index across all threads of the wave. From this point,
-    // these values are stored in scalar registers and we avoid storing them in vector registers
-    uint merged_min = subgroupBroadcastFirst( subgroupMin( min_light_id ) );
-    uint merged_max = subgroupBroadcastFirst( subgroupMax( max_light_id ) );
+        // NOTE(marco): get the minimum and maximum light index across all threads of the wave. From this point,
+        // these values are stored in scalar registers and we avoid storing them in vector registers
+        uint merged_min = subgroupBroadcastFirst( subgroupMin( min_light_id ) );
+        uint merged_max = subgroupBroadcastFirst( subgroupMax( max_light_id ) );
 
-    uint word_min = max( merged_min / 32, 0 );
-    uint word_max = min( merged_max / 32, NUM_WORDS );
+        uint word_min = max( merged_min / 32, 0 );
+        uint word_max = min( merged_max / 32, NUM_WORDS );
 
-    for ( uint word_index = word_min; word_index <= word_max; ++word_index ) {
-        uint mask = tiles[ address + word_index ];
+        for ( uint word_index = word_min; word_index <= word_max; ++word_index ) {
+            uint mask = tiles[ address + word_index ];
 
-        // NOTE(marco): compute the minimum light id for this word and how many lights
-        // are active in this word
-        uint local_min = clamp( int( min_light_id ) - int( ( word_index * 32 ) ), 0, 31 );
-        uint mask_width = clamp( int( max_light_id ) - int( min_light_id ) + 1, 0, 32 );
+            // NOTE(marco): compute the minimum light id for this word and how many lights
+            // are active in this word
+            uint local_min = clamp( int( min_light_id ) - int( ( word_index * 32 ) ), 0, 31 );
+            uint mask_width = clamp( int( max_light_id ) - int( min_light_id ) + 1, 0, 32 );
 
-        // NOTE(marco): either the word is "full" or we need to compute the bit mask
-        // with bit sets from local_min and local_min + mask_width
-        uint zbin_mask = ( mask_width == 32 ) ? uint(0xFFFFFFFF) : bit_field_mask( mask_width, local_min );
-        mask &= zbin_mask;
+            // NOTE(marco): either the word is "full" or we need to compute the bit mask
+            // with bit sets from local_min and local_min + mask_width
+            uint zbin_mask = ( mask_width == 32 ) ? uint(0xFFFFFFFF) : bit_field_mask( mask_width, local_min );
+            mask &= zbin_mask;
 
-        // NOTE(marco): compute ORed mask across all threads. The while loop below can then use scalar
-        // registers as we know the value will be uniform across all threads
-        uint merged_mask = subgroupBroadcastFirst( subgroupOr( mask ) );
+            // NOTE(marco): compute ORed mask across all threads. The while loop below can then use scalar
+            // registers as we know the value will be uniform across all threads
+            uint merged_mask = subgroupBroadcastFirst( subgroupOr( mask ) );
 
-        while ( merged_mask != 0) {
-            uint bit_index = get_lowest_bit( merged_mask );
-            uint light_index = 32 * word_index + bit_index;
+            while ( merged_mask != 0) {
+                uint bit_index = get_lowest_bit( merged_mask );
+                uint light_index = 32 * word_index + bit_index;
 
-            merged_mask ^= ( 1 << bit_index );
+                merged_mask ^= ( 1 << bit_index );
 
-            uint global_light_index = light_indices[ light_index ];
+                uint global_light_index = light_indices[ light_index ];
 
-            final_color.rgb += calculate_point_light_contribution( albedo, roughness, normal, emissive, world_position, V, F0, NoV, position, global_light_index );
+                final_color.rgb += calculate_point_light_contribution( albedo, roughness, normal, emissive, world_position, V, F0, NoV, position, global_light_index );
+            }
         }
-    }
-#else
-    if ( min_light_id != NUM_LIGHTS + 1 ) {
-        for ( uint light_id = min_light_id; light_id <= max_light_id; ++light_id ) {
-            uint word_id = light_id / 32;
-            uint bit_id = light_id % 32;
+    } else {
+        if ( min_light_id != NUM_LIGHTS + 1 ) {
+            for ( uint light_id = min_light_id; light_id <= max_light_id; ++light_id ) {
+                uint word_id = light_id / 32;
+                uint bit_id = light_id % 32;
 
-            if ( ( tiles[ address + word_id ] & ( 1 << bit_id ) ) != 0 ) {
-                uint global_light_index = light_indices[ light_id ];
+                if ( ( tiles[ address + word_id ] & ( 1 << bit_id ) ) != 0 ) {
+                    uint global_light_index = light_indices[ light_id ];
 
-                final_color.rgb += calculate_point_light_contribution( albedo, roughness, normal, emissive, world_position, V, F0, NoV, position, global_light_index );
+                    final_color.rgb += calculate_point_light_contribution( albedo, roughness, normal, emissive, world_position, V, F0, NoV, position, global_light_index );
+                }
             }
         }
     }
-#endif // ENABLE_OPTIMIZATION
 
     if (!transparent) {
         // Pointlight
@@ -686,13 +692,17 @@ vec4 calculate_lighting(vec4 base_colour, vec3 orm, vec3 normal, vec3 emissive,
     const float ao = 1.0f;
     final_color.rgb += (kD * indirect_diffuse) * ao;
 
-    vec3 reflection_color = texture( global_textures[reflections_texture_index], screen_uv ).rgb;
+    // Reflections can be rendered in a corner of their texture, clamp to it to not filter pixels outside.
+    vec2 reflections_uv_scale = vec2( reflections_uv_scale_x, reflections_uv_scale_y );
+    vec2 reflections_texel_size = 1.0 / vec2( textureSize( global_textures[reflections_texture_index], 0 ) );
+    vec2 reflections_uv = min( screen_uv * reflections_uv_scale, reflections_uv_scale - reflections_texel_size * 0.5 );
+    vec3 reflection_color = texture( global_textures[reflections_texture_index], reflections_uv ).rgb;
 
     vec2 envBRDF  = textureLod(global_textures[nonuniformEXT(brdf_lut_texture_index)], vec2(NoV, roughness), 0).rg;
     vec3 indirect_specular = reflection_color * (F * envBRDF.x + envBRDF.y);
     final_color.rgb += (indirect_specular) * ao;
 
-#if defined(DEBUG_OPTIONS)
+#if DEBUG_OPTIONS
 
     if ( debug_show_light_tiles > 0 ) {
         uint v = 0;
@@ -32,15 +32,8 @@ layout(buffer_reference, std430, buffer_reference_align = 2) buffer int_array_ty
 
 struct MeshDraw {
 
-    // x = diffuse index, y = roughness index, z = normal index, w = occlusion index.
-    // Occlusion and roughness are encoded in the same texture
-    uvec4       textures;
-    vec4        emissive;
-    vec4        base_color_factor;
-    vec4        metallic_roughness_occlusion_factor;
-
     uint        flags;
-    float       alpha_cutoff;
+    uint        material_index;
     uint        vertexOffset; // == meshes[meshIndex].vertexOffset, helps data locality in mesh shader
     uint        meshIndex;
 
@@ -55,12 +48,27 @@ struct MeshDraw {
     uint64_t    normals_buffer;
 };
 
+struct Material {
+
+    // x = diffuse index, y = roughness index, z = normal index, w = occlusion index.
+    // Occlusion and roughness are encoded in the same texture
+    uvec4       textures;
+    vec4        emissive;
+    vec4        base_color_factor;
+    vec4        metallic_roughness_occlusion_factor;
+
+    uint        flags;
+    float       alpha_cutoff;
+    uint        pad000;
+    uint        pad001;
+};
+
 struct MeshInstanceDraw {
     mat4        model;
     mat4        model_inverse;
 
     uint        mesh_draw_index;
-    uint        pad000;
+    uint        material_index;
     uint        pad001;
     uint        pad002;
 };
@@ -96,6 +104,11 @@ layout ( std430, set = MATERIAL_SET, binding = 12 ) readonly buffer MeshBounds {
     vec4        mesh_bounds[];
 };
 
+layout ( std430, set = MATERIAL_SET, binding = 14 ) readonly buffer Materials {
+
+    Material    materials[];
+};
+
 // Material calculations /////////////////////////////////////////////////
 vec4 compute_diffuse_color(inout vec4 base_color, uint albedo_texture, vec2 uv) {
     if (albedo_texture != INVALID_TEXTURE_INDEX) {
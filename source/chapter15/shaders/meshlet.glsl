@@ -586,14 +586,14 @@ layout (location = 5) out vec2 depth_normal_fwidth;
 layout (location = 6) out vec2 linear_z_dd;
 
 void main() {
-    MeshDraw mesh_draw = mesh_draws[mesh_draw_index];
+    Material material = materials[mesh_draws[mesh_draw_index].material_index];
 
     // Diffuse color
-    vec4 base_colour = compute_diffuse_color( mesh_draw.base_color_factor, mesh_draw.textures.x, vTexcoord0_W.xy );
+    vec4 base_colour = compute_diffuse_color( material.base_color_factor, material.textures.x, vTexcoord0_W.xy );
 
-    const uint flags = mesh_draw.flags;
+    const uint flags = material.flags;
 
-    apply_alpha_discards( flags, base_colour.a, mesh_draw.alpha_cutoff );
+    apply_alpha_discards( flags, base_colour.a, material.alpha_cutoff );
 
 #if DEBUG
     color_out = vColour;
@@ -610,9 +610,9 @@ void main() {
 
     calculate_geometric_TBN( normal, tangent, bitangent, vTexcoord0_W.xy, world_position, flags );
 
-    normal = apply_pixel_normal( mesh_draw.textures.z, vTexcoord0_W.xy, normal, tangent, bitangent );
+    normal = apply_pixel_normal( material.textures.z, vTexcoord0_W.xy, normal, tangent, bitangent );
 
-    bool double_sided = ( mesh_draw.flags & DrawFlags_DoubleSided ) != 0;
+    bool double_sided = ( material.flags & DrawFlags_DoubleSided ) != 0;
 
     if ( !gl_FrontFacing && double_sided ) {
         normal *= -1;
@@ -621,10 +621,10 @@ void main() {
     normal_out.rg = octahedral_encode(normal);
 
     // PBR Parameters
-    occlusion_roughness_metalness_out.rgb = calculate_pbr_parameters( mesh_draw.metallic_roughness_occlusion_factor.x, mesh_draw.metallic_roughness_occlusion_factor.y,
-                                                                      mesh_draw.textures.y, mesh_draw.metallic_roughness_occlusion_factor.z, mesh_draw.textures.w, vTexcoord0_W.xy );
+    occlusion_roughness_metalness_out.rgb = calculate_pbr_parameters( material.metallic_roughness_occlusion_factor.x, material.metallic_roughness_occlusion_factor.y,
+                                                                      material.textures.y, material.metallic_roughness_occlusion_factor.z, material.textures.w, vTexcoord0_W.xy );
 
-    emissive_out = vec4( calculate_emissive(mesh_draw.emissive.rgb, uint(mesh_draw.emissive.w), vTexcoord0_W.xy ), 1.0 );
+    emissive_out = vec4( calculate_emissive(material.emissive.rgb, uint(material.emissive.w), vTexcoord0_W.xy ), 1.0 );
 
     mesh_id = mesh_draw_index;
 
@@ -653,13 +653,13 @@ layout (location = 5) in vec4 vColour;
 layout (location = 0) out vec4 color_out;
 
 void main() {
-    MeshDraw mesh_draw = mesh_draws[mesh_draw_index];
-    uint flags = mesh_draw.flags;
+    Material material = materials[mesh_draws[mesh_draw_index].material_index];
+    uint flags = material.flags;
 
     // Diffuse color
-    vec4 base_colour = compute_diffuse_color_alpha( mesh_draw.base_color_factor, mesh_draw.textures.x, vTexcoord0_W.xy );
+    vec4 base_colour = compute_diffuse_color_alpha( material.base_color_factor, material.textures.x, vTexcoord0_W.xy );
 
-    apply_alpha_discards( flags, base_colour.a, mesh_draw.alpha_cutoff );
+    apply_alpha_discards( flags, base_colour.a, material.alpha_cutoff );
 
     vec3 world_position = vPosition_BiTanZ.xyz;
     vec3 normal = normalize(vNormal_BiTanX.xyz);
@@ -668,12 +668,12 @@ void main() {
 
     calculate_geometric_TBN( normal, tangent, bitangent, vTexcoord0_W.xy, world_position, flags );
     // Pixel normals
-    normal = apply_pixel_normal( mesh_draw.textures.z, vTexcoord0_W.xy, normal, tangent, bitangent );
+    normal = apply_pixel_normal( material.textures.z, vTexcoord0_W.xy, normal, tangent, bitangent );
 
-    vec3 orm = calculate_pbr_parameters( mesh_draw.metallic_roughness_occlusion_factor.x, mesh_draw.metallic_roughness_occlusion_factor.y,
-                                                                      mesh_draw.textures.y, mesh_draw.metallic_roughness_occlusion_factor.z, mesh_draw.textures.w, vTexcoord0_W.xy );
+    vec3 orm = calculate_pbr_parameters( material.metallic_roughness_occlusion_factor.x, material.metallic_roughness_occlusion_factor.y,
+                                                                      material.textures.y, material.metallic_roughness_occlusion_factor.z, material.textures.w, vTexcoord0_W.xy );
 
-    vec3 emissive_colour = calculate_emissive(mesh_draw.emissive.rgb, uint(mesh_draw.emissive.w), vTexcoord0_W.xy );
+    vec3 emissive_colour = calculate_emissive(material.emissive.rgb, uint(material.emissive.w), vTexcoord0_W.xy );
 
 #if DEBUG
     color_out = vColour;
@@ -50,6 +50,7 @@ void main()
         MeshInstanceDraw instance = mesh_instance_draws[ payload.geometry_id ];
         uint mesh_index = instance.mesh_draw_index;
         MeshDraw mesh = mesh_draws[ mesh_index ];
+        Material material = materials[ instance.material_index ];
 
         int_array_type index_buffer = int_array_type( mesh.index_buffer );
         int i0 = index_buffer[ payload.primitive_id * 3 ].v;
@@ -84,7 +85,7 @@ void main()
         vec4 p1_screen = view_projection * p1_world;
         vec4 p2_screen = view_projection * p2_world;
 
-        ivec2 texture_size = textureSize( global_textures[ nonuniformEXT( mesh.textures.x ) ], 0 );
+        ivec2 texture_size = textureSize( global_textures[ nonuniformEXT( material.textures.x ) ], 0 );
 
         vec2_array_type uv_buffer = vec2_array_type( mesh.uv_buffer );
         vec2 uv0 = uv_buffer[ i0 ].v;
@@ -102,7 +103,7 @@ void main()
 
         vec2 uv = ( a * uv0 + b * uv1 + c * uv2 );
 
-        vec3 diffuse = textureLod( global_textures[ nonuniformEXT( mesh.textures.x ) ], uv, lod ).rgb;
+        vec3 diffuse = textureLod( global_textures[ nonuniformEXT( material.textures.x ) ], uv, lod ).rgb;
 
         imageStore( global_images_2d[ out_image_index ], ivec2( gl_LaunchIDEXT.xy ), vec4( diffuse, 1.0 ) );
     } else {
@@ -118,7 +119,7 @@ layout( location = 0 ) rayPayloadInEXT ray_payload payload;
 hitAttributeEXT vec2 barycentric_weights;
 
 void main() {
-    payload.geometry_id = gl_GeometryIndexEXT;
+    payload.geometry_id = gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT;
     payload.primitive_id = gl_PrimitiveID;
     payload.barycentric_weights = barycentric_weights;
     payload.object_to_world = gl_ObjectToWorldEXT;
@@ -171,6 +171,7 @@ void main() {
             MeshInstanceDraw instance = mesh_instance_draws[ payload.geometry_id ];
             uint mesh_index = instance.mesh_draw_index;
             MeshDraw mesh = mesh_draws[ mesh_index ];
+            Material material = materials[ instance.material_index ];
 
             int_array_type index_buffer = int_array_type( mesh.index_buffer );
             int i0 = index_buffer[ payload.primitive_id * 3 ].v;
@@ -208,7 +209,7 @@ void main() {
             vec4 p1_screen = view_projection * p1_world;
             vec4 p2_screen = view_projection * p2_world;
 
-            ivec2 texture_size = textureSize( global_textures[ nonuniformEXT( mesh.textures.x ) ], 0 );
+            ivec2 texture_size = textureSize( global_textures[ nonuniformEXT( material.textures.x ) ], 0 );
 
             vec2_array_type uv_buffer = vec2_array_type( mesh.uv_buffer );
             vec2 uv0 = uv_buffer[ i0 ].v;
@@ -308,8 +309,8 @@ void main() {
                 float NoL = clamp(dot( triangle_normal, l ), 0.0, 1.0);
 
                 if ( attenuation > 0.0001f  && NoL > 0.0001f ) {
-                    vec3 orm = calculate_pbr_parameters( mesh.metallic_roughness_occlusion_factor.x, mesh.metallic_roughness_occlusion_factor.y,
-                                                        mesh.textures.y, mesh.metallic_roughness_occlusion_factor.z, mesh.textures.w, uv );
+                    vec3 orm = calculate_pbr_parameters( material.metallic_roughness_occlusion_factor.x, material.metallic_roughness_occlusion_factor.y,
+                                                        material.textures.y, material.metallic_roughness_occlusion_factor.z, material.textures.w, uv );
 
                     vec3 view = normalize( world_pos - p_world.xyz );
                     float NoV = saturate( dot( triangle_normal, view ));
@@ -317,7 +318,7 @@ void main() {
                     float roughness = forced_roughness > 0.0 ? forced_roughness : orm.g * orm.g;
                     float metallic = forced_metalness > 0.0 ? forced_metalness : orm.b;
 
-                    vec4 albedo = textureLod( global_textures[ nonuniformEXT( mesh.textures.x ) ], uv, lod );
+                    vec4 albedo = textureLod( global_textures[ nonuniformEXT( material.textures.x ) ], uv, lod );
 
                     vec3 light_intensity = NoL * light.intensity * attenuation * light.color;
 
@@ -345,7 +346,7 @@ hitAttributeEXT vec2 barycentric_weights;
 
 void main() {
 
-    payload.geometry_id = gl_GeometryIndexEXT;
+    payload.geometry_id = gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT;
     payload.primitive_id = gl_PrimitiveID;
     payload.barycentric_weights = barycentric_weights;
     payload.object_to_world = gl_ObjectToWorldEXT;
@@ -728,12 +729,14 @@ ivec2 pixel_offsets[] = ivec2[]( ivec2(0,0), ivec2(0,1), ivec2(1,0), ivec2(1,1))
 layout (local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
 void main() {
     ivec2 frag_coord = ivec2( gl_GlobalInvocationID.xy );
+    // Top left of the full resolution pixels covered by this one.
+    ivec2 hiresolution_coord = ivec2( frag_coord * resolution_scale_rcp );
 
     int chosen_hiresolution_sample_index = 0;
     float closer_depth = 0.f;
     for ( int i = 0; i < 4; ++i ) {
 
-        float depth = texelFetch(global_textures[nonuniformEXT(depth_texture_index)], (frag_coord.xy) * 2 + pixel_offsets[i], 0).r;
+        float depth = texelFetch(global_textures[nonuniformEXT(depth_texture_index)], hiresolution_coord + pixel_offsets[i], 0).r;
 
         if ( closer_depth < depth ) {
             closer_depth = depth;
@@ -742,13 +745,13 @@ void main() {
     }
 
     // Write the most representative sample of all the textures
-    vec4 normals = texelFetch(global_textures[nonuniformEXT(normals_texture_index)], (frag_coord.xy) * 2 + pixel_offsets[chosen_hiresolution_sample_index], 0);
+    vec4 normals = texelFetch(global_textures[nonuniformEXT(normals_texture_index)], hiresolution_coord + pixel_offsets[chosen_hiresolution_sample_index], 0);
     imageStore( global_images_2d[ history_normals_texture_index ], frag_coord, normals );
 
-    vec4 mesh_id = texelFetch(global_textures[nonuniformEXT(mesh_id_texture_index)], (frag_coord.xy) * 2 + pixel_offsets[chosen_hiresolution_sample_index], 0);
+    vec4 mesh_id = texelFetch(global_textures[nonuniformEXT(mesh_id_texture_index)], hiresolution_coord + pixel_offsets[chosen_hiresolution_sample_index], 0);
     imageStore( global_images_2d[ history_mesh_id_texture_index ], frag_coord, mesh_id );
 
-    vec4 linear_z_dd = texelFetch(global_textures[nonuniformEXT(linear_z_dd_texture_index)], (frag_coord.xy) * 2 + pixel_offsets[chosen_hiresolution_sample_index], 0);
+    vec4 linear_z_dd = texelFetch(global_textures[nonuniformEXT(linear_z_dd_texture_index)], hiresolution_coord + pixel_offsets[chosen_hiresolution_sample_index], 0);
     imageStore( global_images_2d[ history_linear_depth_texture ], frag_coord, linear_z_dd );
 
     vec4 moments = texelFetch(global_textures[nonuniformEXT(integrated_moments_texture_index)], (frag_coord.xy), 0);
@@ -13,7 +13,7 @@ layout (location = 1) out vec3 vNormal;
 layout (location = 2) out vec3 vTangent;
 layout (location = 3) out vec3 vBiTangent;
 layout (location = 4) out vec3 vPosition;
-layout (location = 5) out flat uint mesh_draw_index;
+layout (location = 5) out flat uint material_index;
 
 layout(std430, set = MATERIAL_SET, binding = 3) readonly buffer JointMatrices {
 	mat4 joint_matrices[];
@@ -22,7 +22,7 @@ layout(std430, set = MATERIAL_SET, binding = 3) readonly buffer JointMatrices {
 void main() {
 
 	MeshInstanceDraw mesh_draw = mesh_instance_draws[gl_InstanceIndex];
-    mesh_draw_index = mesh_draw.mesh_draw_index;
+    material_index = mesh_draw.material_index;
 
 	mat4 skinning_transform = 
 		jointWeights.x * joint_matrices[(jointIndices.x)] +
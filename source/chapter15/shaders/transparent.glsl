@@ -11,12 +11,12 @@ layout (location = 1) out vec3 vNormal;
 layout (location = 2) out vec3 vTangent;
 layout (location = 3) out vec3 vBiTangent;
 layout (location = 4) out vec3 vPosition;
-layout (location = 5) out flat uint mesh_draw_index;
+layout (location = 5) out flat uint material_index;
 
 void main() {
 
     MeshInstanceDraw mesh_draw = mesh_instance_draws[gl_InstanceIndex];
-    mesh_draw_index = mesh_draw.mesh_draw_index;
+    material_index = mesh_draw.material_index;
 
     vec4 worldPosition = mesh_draw.model * vec4(position, 1.0);
     gl_Position = view_projection * worldPosition;
@@ -25,7 +25,7 @@ void main() {
     // NOTE(marco): assume texcoords are always specified for now
     vTexcoord0 = texCoord0;
 
-    uint flags = mesh_draws[mesh_draw_index].flags;
+    uint flags = materials[material_index].flags;
     if ( (flags & DrawFlags_HasNormals) != 0 ) {
         vNormal = normalize( mat3(mesh_draw.model_inverse) * normal );
     }
@@ -46,19 +46,19 @@ layout (location = 1) in vec3 vNormal;
 layout (location = 2) in vec3 vTangent;
 layout (location = 3) in vec3 vBiTangent;
 layout (location = 4) in vec3 vPosition;
-layout (location = 5) in flat uint mesh_draw_index;
+layout (location = 5) in flat uint material_index;
 
 layout (location = 0) out vec4 frag_color;
 
 void main() {
-    MeshDraw mesh_draw = mesh_draws[mesh_draw_index];
+    Material material = materials[material_index];
 
     // Diffuse color
-    vec4 base_colour = compute_diffuse_color( mesh_draw.base_color_factor, mesh_draw.textures.x, vTexcoord0 );
+    vec4 base_colour = compute_diffuse_color( material.base_color_factor, material.textures.x, vTexcoord0 );
 
-    const uint flags = mesh_draw.flags;
+    const uint flags = material.flags;
 
-    apply_alpha_discards( flags, base_colour.a, mesh_draw.alpha_cutoff );
+    apply_alpha_discards( flags, base_colour.a, material.alpha_cutoff );
 
     // Geometric Normals
     vec3 world_position = vPosition.xyz;
@@ -70,12 +70,12 @@ void main() {
     calculate_geometric_TBN( normal, tangent, bitangent, vTexcoord0.xy, world_position, flags );
 
     // Pixel normals
-    normal = apply_pixel_normal( mesh_draw.textures.z, vTexcoord0.xy, normal, tangent, bitangent );
+    normal = apply_pixel_normal( material.textures.z, vTexcoord0.xy, normal, tangent, bitangent );
 
-    vec3 pbr_parameters = calculate_pbr_parameters( mesh_draw.metallic_roughness_occlusion_factor.x, mesh_draw.metallic_roughness_occlusion_factor.y,
-                                                                      mesh_draw.textures.y, mesh_draw.metallic_roughness_occlusion_factor.z, mesh_draw.textures.w, vTexcoord0.xy );
+    vec3 pbr_parameters = calculate_pbr_parameters( material.metallic_roughness_occlusion_factor.x, material.metallic_roughness_occlusion_factor.y,
+                                                                      material.textures.y, material.metallic_roughness_occlusion_factor.z, material.textures.w, vTexcoord0.xy );
 
-    vec3 emissive_colour = calculate_emissive(mesh_draw.emissive.rgb, uint(mesh_draw.emissive.w), vTexcoord0.xy );
+    vec3 emissive_colour = calculate_emissive(material.emissive.rgb, uint(material.emissive.w), vTexcoord0.xy );
 
     uvec2 position = uvec2(gl_FragCoord.x - 0.5, gl_FragCoord.y - 0.5);
     position.y = uint( resolution.y ) - position.y;
@@ -0,0 +1,383 @@
+#include "graphics/bvh.hpp"
+
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+namespace raptor {
+
+static f32 random_f32( f32 min_value, f32 max_value ) {
+    return min_value + ( max_value - min_value ) * ( rand() / ( f32 )RAND_MAX );
+}
+
+// Boxes of very different sizes gathered in a few clusters, over a big ground quad:
+// the uneven distribution is where SAH splits pay off compared to midpoint splits.
+static void generate_box_scene( Array<f32>& positions, Array<u32>& indices, u32 box_count, u32 seed ) {
+    static const u32 s_box_indices[ 36 ] = { 0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+                                             2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5 };
+    srand( seed );
+
+    f32 clusters[ 8 ][ 3 ];
+    for ( u32 c = 0; c < 8; ++c ) {
+        clusters[ c ][ 0 ] = random_f32( -100.0f, 100.0f );
+        clusters[ c ][ 1 ] = random_f32( 0.0f, 20.0f );
+        clusters[ c ][ 2 ] = random_f32( -100.0f, 100.0f );
+    }
+
+    positions.clear();
+    indices.clear();
+
+    const f32 ground[ 12 ] = { -150.0f, 0.0f, -150.0f, 150.0f, 0.0f, -150.0f, -150.0f, 0.0f, 150.0f, 150.0f, 0.0f, 150.0f };
+    for ( u32 i = 0; i < 12; ++i ) {
+        positions.push( ground[ i ] );
+    }
+    const u32 ground_indices[ 6 ] = { 0, 2, 1, 1, 2, 3 };
+    for ( u32 i = 0; i < 6; ++i ) {
+        indices.push( ground_indices[ i ] );
+    }
+
+    for ( u32 b = 0; b < box_count; ++b ) {
+        const f32* cluster = clusters[ rand() % 8 ];
+        const f32 spread = random_f32( 0.0f, 1.0f ) * random_f32( 0.0f, 1.0f ) * 30.0f;
+        const f32 size = 0.05f * powf( 2.0f, random_f32( 0.0f, 6.0f ) );
+
+        f32 center[ 3 ];
+        for ( u32 a = 0; a < 3; ++a ) {
+            center[ a ] = cluster[ a ] + random_f32( -spread, spread );
+        }
+
+        const u32 first_vertex = positions.size / 3;
+        for ( u32 v = 0; v < 8; ++v ) {
+            positions.push( center[ 0 ] + ( ( v & 1 ) ? size : -size ) );
+            positions.push( center[ 1 ] + ( ( v & 2 ) ? size : -size ) );
+            positions.push( center[ 2 ] + ( ( v & 4 ) ? size : -size ) );
+        }
+        for ( u32 i = 0; i < 36; ++i ) {
+            indices.push( first_vertex + s_box_indices[ i ] );
+        }
+    }
+}
+
+//
+//
+struct BvhRayHit {
+
+    f32                             t                   = FLT_MAX;
+    u32                             visited_nodes       = 0;
+
+}; // struct BvhRayHit
+
+// Moller-Trumbore, double sided.
+static bool ray_triangle( const f32* origin, const f32* direction, const BvhTriangle& triangle, f32& out_t ) {
+    f32 edge1[ 3 ], edge2[ 3 ], p[ 3 ], s[ 3 ], q[ 3 ];
+    for ( u32 a = 0; a < 3; ++a ) {
+        edge1[ a ] = triangle.v1[ a ] - triangle.v0[ a ];
+        edge2[ a ] = triangle.v2[ a ] - triangle.v0[ a ];
+        s[ a ] = origin[ a ] - triangle.v0[ a ];
+    }
+
+    p[ 0 ] = direction[ 1 ] * edge2[ 2 ] - direction[ 2 ] * edge2[ 1 ];
+    p[ 1 ] = direction[ 2 ] * edge2[ 0 ] - direction[ 0 ] * edge2[ 2 ];
+    p[ 2 ] = direction[ 0 ] * edge2[ 1 ] - direction[ 1 ] * edge2[ 0 ];
+
+    const f32 determinant = edge1[ 0 ] * p[ 0 ] + edge1[ 1 ] * p[ 1 ] + edge1[ 2 ] * p[ 2 ];
+    if ( fabsf( determinant ) < 1e-12f ) {
+        return false;
+    }
+    const f32 inverse_determinant = 1.0f / determinant;
+
+    const f32 u = ( s[ 0 ] * p[ 0 ] + s[ 1 ] * p[ 1 ] + s[ 2 ] * p[ 2 ] ) * inverse_determinant;
+    if ( u < 0.0f || u > 1.0f ) {
+        return false;
+    }
+
+    q[ 0 ] = s[ 1 ] * edge1[ 2 ] - s[ 2 ] * edge1[ 1 ];
+    q[ 1 ] = s[ 2 ] * edge1[ 0 ] - s[ 0 ] * edge1[ 2 ];
+    q[ 2 ] = s[ 0 ] * edge1[ 1 ] - s[ 1 ] * edge1[ 0 ];
+
+    const f32 v = ( direction[ 0 ] * q[ 0 ] + direction[ 1 ] * q[ 1 ] + direction[ 2 ] * q[ 2 ] ) * inverse_determinant;
+    if ( v < 0.0f || u + v > 1.0f ) {
+        return false;
+    }
+
+    out_t = ( edge2[ 0 ] * q[ 0 ] + edge2[ 1 ] * q[ 1 ] + edge2[ 2 ] * q[ 2 ] ) * inverse_determinant;
+    return out_t > 0.0f;
+}
+
+static bool ray_node( const f32* origin, const f32* inverse_direction, const BvhNode& node, f32 t_max ) {
+    f32 t_near = 0.0f;
+    f32 t_far = t_max;
+    for ( u32 a = 0; a < 3; ++a ) {
+        f32 t0 = ( node.aabb_min[ a ] - origin[ a ] ) * inverse_direction[ a ];
+        f32 t1 = ( node.aabb_max[ a ] - origin[ a ] ) * inverse_direction[ a ];
+        if ( t0 > t1 ) {
+            const f32 temp = t0;
+            t0 = t1;
+            t1 = temp;
+        }
+        t_near = max( t_near, t0 );
+        t_far = min( t_far, t1 );
+    }
+    return t_near <= t_far;
+}
+
+// Closest hit, children are visited in storage order: visited node count compares tree quality, not traversal tricks.
+static BvhRayHit trace_bvh( const CpuBvh& bvh, const f32* origin, const f32* direction ) {
+    BvhRayHit hit;
+    if ( bvh.nodes.size == 0 ) {
+        return hit;
+    }
+
+    const f32 inverse_direction[ 3 ] = { 1.0f / direction[ 0 ], 1.0f / direction[ 1 ], 1.0f / direction[ 2 ] };
+
+    u32 stack[ 128 ];
+    u32 stack_size = 0;
+    stack[ stack_size++ ] = 0;
+
+    while ( stack_size > 0 ) {
+        const BvhNode& node = bvh.nodes[ stack[ --stack_size ] ];
+        ++hit.visited_nodes;
+
+        if ( !ray_node( origin, inverse_direction, node, hit.t ) ) {
+            continue;
+        }
+
+        if ( node.is_leaf() ) {
+            for ( u32 i = 0; i < node.triangle_count; ++i ) {
+                f32 t;
+                if ( ray_triangle( origin, direction, bvh.triangles[ bvh.triangle_indices[ node.left_or_first + i ] ], t ) && t < hit.t ) {
+                    hit.t = t;
+                }
+            }
+        } else {
+            stack[ stack_size++ ] = node.left_or_first + 1;
+            stack[ stack_size++ ] = node.left_or_first;
+        }
+    }
+
+    return hit;
+}
+
+static f32 trace_brute_force( const CpuBvh& bvh, const f32* origin, const f32* direction ) {
+    f32 closest = FLT_MAX;
+    for ( u32 t = 0; t < bvh.triangles.size; ++t ) {
+        f32 distance;
+        if ( ray_triangle( origin, direction, bvh.triangles[ t ], distance ) && distance < closest ) {
+            closest = distance;
+        }
+    }
+    return closest;
+}
+
+// Rays from above the scene towards random points of it.
+static void random_ray( f32* origin, f32* direction ) {
+    origin[ 0 ] = random_f32( -120.0f, 120.0f );
+    origin[ 1 ] = random_f32( 30.0f, 60.0f );
+    origin[ 2 ] = random_f32( -120.0f, 120.0f );
+
+    const f32 target[ 3 ] = { random_f32( -100.0f, 100.0f ), random_f32( 0.0f, 20.0f ), random_f32( -100.0f, 100.0f ) };
+    f32 length = 0.0f;
+    for ( u32 a = 0; a < 3; ++a ) {
+        direction[ a ] = target[ a ] - origin[ a ];
+        length += direction[ a ] * direction[ a ];
+    }
+    length = sqrtf( length );
+    for ( u32 a = 0; a < 3; ++a ) {
+        direction[ a ] /= length;
+    }
+}
+
+static void build_box_scene_bvh( CpuBvh& bvh, const Array<f32>& positions, const Array<u32>& indices, BvhBuildMode::Enum mode ) {
+    const u32 triangle_count = indices.size / 3;
+    bvh.init( &MemoryService::instance()->system_allocator, triangle_count );
+    bvh.add_triangles( ( const u8* )positions.data, sizeof( f32 ) * 3, ( const u8* )indices.data, 4, triangle_count, nullptr );
+
+    CpuBvhBuildOptions options;
+    options.mode = mode;
+    bvh.build( options );
+}
+
+RTEST( bvh_fast_trace_and_fast_build ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    Array<f32> positions;
+    positions.init( allocator, 1024 );
+    Array<u32> indices;
+    indices.init( allocator, 1024 );
+    generate_box_scene( positions, indices, 2000, 1 );
+
+    CpuBvh bvhs[ BvhBuildMode::Count ];
+    for ( u32 mode = 0; mode < BvhBuildMode::Count; ++mode ) {
+        CpuBvh& bvh = bvhs[ mode ];
+        build_box_scene_bvh( bvh, positions, indices, ( BvhBuildMode::Enum )mode );
+
+        RCHECK( bvh.validate() );
+        RCHECK( bvh.stats.triangle_count == indices.size / 3 );
+        RCHECK( bvh.stats.node_count == bvh.stats.leaf_count * 2 - 1 );
+        RCHECK( bvh.stats.max_depth < 64 );
+        RCHECK( bvh.stats.node_bytes == bvh.nodes.size * sizeof( BvhNode ) );
+    }
+
+    const CpuBvh& fast_trace = bvhs[ BvhBuildMode::FastTrace ];
+    const CpuBvh& fast_build = bvhs[ BvhBuildMode::FastBuild ];
+
+    // Midpoint splits go down to the leaf size, SAH can stop earlier or go further when it is cheaper.
+    RCHECK( fast_build.stats.max_leaf_triangles <= 4 );
+    RCHECK( fast_trace.stats.sah_cost < fast_build.stats.sah_cost );
+
+    // Both trees find the same closest hits as testing every triangle, the SAH one with fewer nodes visited.
+    srand( 2 );
+    u32 hits = 0;
+    u64 visited_nodes[ BvhBuildMode::Count ] = { };
+    for ( u32 r = 0; r < 500; ++r ) {
+        f32 origin[ 3 ], direction[ 3 ];
+        random_ray( origin, direction );
+
+        const f32 expected = trace_brute_force( fast_trace, origin, direction );
+        hits += expected < FLT_MAX ? 1 : 0;
+
+        for ( u32 mode = 0; mode < BvhBuildMode::Count; ++mode ) {
+            const BvhRayHit hit = trace_bvh( bvhs[ mode ], origin, direction );
+            RCHECK( hit.t == expected );
+            visited_nodes[ mode ] += hit.visited_nodes;
+        }
+    }
+    RCHECK( hits > 400 );
+    RCHECK( visited_nodes[ BvhBuildMode::FastTrace ] < visited_nodes[ BvhBuildMode::FastBuild ] );
+
+    for ( u32 mode = 0; mode < BvhBuildMode::Count; ++mode ) {
+        bvhs[ mode ].shutdown();
+    }
+    indices.shutdown();
+    positions.shutdown();
+}
+
+RTEST( bvh_degenerate_inputs ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    for ( u32 mode = 0; mode < BvhBuildMode::Count; ++mode ) {
+        CpuBvhBuildOptions options;
+        options.mode = ( BvhBuildMode::Enum )mode;
+
+        // Nothing to build.
+        CpuBvh bvh;
+        bvh.init( allocator, 0 );
+        bvh.build( options );
+        RCHECK( bvh.validate() && bvh.nodes.size == 0 );
+
+        // A single triangle from 16 bit indices, strided positions and a transform.
+        const f32 vertices[ 3 ][ 4 ] = { { 0, 0, 0, -1 }, { 1, 0, 0, -1 }, { 0, 1, 0, -1 } };
+        const u16 triangle[ 3 ] = { 0, 1, 2 };
+        const f32 transform[ 12 ] = { 2, 0, 0, 10,
+                                       0, 2, 0, 20,
+                                       0, 0, 2, 30 };
+        bvh.add_triangles( ( const u8* )vertices, sizeof( vertices[ 0 ] ), ( const u8* )triangle, 2, 1, transform );
+        bvh.build( options );
+        RCHECK( bvh.validate() && bvh.nodes.size == 1 && bvh.stats.leaf_count == 1 );
+        RCHECK( bvh.triangles[ 0 ].v1[ 0 ] == 12.0f && bvh.triangles[ 0 ].v2[ 1 ] == 22.0f && bvh.triangles[ 0 ].v0[ 2 ] == 30.0f );
+        RCHECK( bvh.nodes[ 0 ].aabb_min[ 0 ] == 10.0f && bvh.nodes[ 0 ].aabb_max[ 1 ] == 22.0f );
+
+        // Coincident triangles can not be split by position, ranges are halved instead.
+        const u32 coincident_count = 1000;
+        const u16 coincident[ 3 * coincident_count ] = { };
+        bvh.triangles.clear();
+        bvh.add_triangles( ( const u8* )vertices, sizeof( vertices[ 0 ] ), ( const u8* )coincident, 2, coincident_count, nullptr );
+        bvh.build( options );
+        RCHECK( bvh.validate() );
+        RCHECK( bvh.stats.max_leaf_triangles <= 4 && bvh.stats.max_depth <= 10 );
+
+        bvh.shutdown();
+    }
+}
+
+RTEST( bvh_blas_planning ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    Array<BlasBuildDesc> blases;
+    blases.init( allocator, 8 );
+
+    // Geometries are never split, limits start a new blas.
+    const u32 primitive_counts[ 7 ] = { 100, 200, 1000, 50, 50, 50, 50 };
+    blas_partition_geometries( primitive_counts, ArraySize( primitive_counts ), 500, 3, blases );
+    RCHECK( blases.size == 4 );
+    RCHECK( blases[ 0 ].first_geometry == 0 && blases[ 0 ].geometry_count == 2 && blases[ 0 ].primitive_count == 300 );
+    RCHECK( blases[ 1 ].first_geometry == 2 && blases[ 1 ].geometry_count == 1 && blases[ 1 ].primitive_count == 1000 );
+    RCHECK( blases[ 2 ].first_geometry == 3 && blases[ 2 ].geometry_count == 3 );
+    RCHECK( blases[ 3 ].first_geometry == 6 && blases[ 3 ].geometry_count == 1 );
+
+    const u64 structure_sizes[ 4 ] = { 1000, 256, 3000, 10 };
+    const u64 scratch_sizes[ 4 ] = { 300, 200, 1500, 100 };
+    for ( u32 b = 0; b < blases.size; ++b ) {
+        blases[ b ].acceleration_structure_size = structure_sizes[ b ];
+        blases[ b ].build_scratch_size = scratch_sizes[ b ];
+        blases[ b ].compacted_size = structure_sizes[ b ] / 2;
+    }
+
+    const u64 storage_size = blas_plan_storage( blases.data, blases.size, 256 );
+    RCHECK( storage_size == 1024 + 256 + 3072 + 256 );
+    RCHECK( blases[ 1 ].acceleration_structure_offset == 1024 && blases[ 3 ].acceleration_structure_offset == 1024 + 256 + 3072 );
+
+    const u64 compacted_size = blas_plan_compaction( blases.data, blases.size, 256 );
+    RCHECK( compacted_size == 512 + 256 + 1536 + 256 );
+    RCHECK( blases[ 2 ].compacted_offset == 512 + 256 );
+
+    // Scratch offsets are aligned, a blas bigger than the budget gets its own batch.
+    Array<BlasBuildBatch> batches;
+    batches.init( allocator, 4 );
+    const u64 max_scratch = blas_plan_batches( blases.data, blases.size, 1024, 128, batches );
+    RCHECK( batches.size == 3 );
+    RCHECK( batches[ 0 ].first_blas == 0 && batches[ 0 ].blas_count == 2 && batches[ 0 ].scratch_size == 384 + 256 );
+    RCHECK( batches[ 1 ].first_blas == 2 && batches[ 1 ].blas_count == 1 && batches[ 1 ].scratch_size == 1536 );
+    RCHECK( batches[ 2 ].first_blas == 3 && batches[ 2 ].scratch_size == 128 );
+    RCHECK( max_scratch == 1536 );
+    RCHECK( blases[ 1 ].batch == 0 && blases[ 1 ].scratch_offset == 384 && blases[ 3 ].batch == 2 && blases[ 3 ].scratch_offset == 0 );
+
+    batches.shutdown();
+    blases.shutdown();
+}
+
+// Build time of both modes on one million triangles, with the tree quality each one buys.
+RBENCHMARK( bvh_build_time ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    Array<f32> positions;
+    positions.init( allocator, 1024 );
+    Array<u32> indices;
+    indices.init( allocator, 1024 );
+    generate_box_scene( positions, indices, 1000000 / 12, 3 );
+
+    const u32 ray_count = 100000;
+    for ( u32 mode = 0; mode < BvhBuildMode::Count; ++mode ) {
+        CpuBvh bvh;
+        build_box_scene_bvh( bvh, positions, indices, ( BvhBuildMode::Enum )mode );
+        RCHECK( bvh.validate() );
+
+        srand( 4 );
+        u64 visited_nodes = 0;
+        const i64 trace_start = time_now();
+        for ( u32 r = 0; r < ray_count; ++r ) {
+            f32 origin[ 3 ], direction[ 3 ];
+            random_ray( origin, direction );
+            visited_nodes += trace_bvh( bvh, origin, direction ).visited_nodes;
+        }
+        const f64 trace_ms = time_from_milliseconds( trace_start );
+
+        rprint( "%-10s %8.1f ms build (%5.2f Mtriangles/s), sah cost %7.2f, %7u nodes, %6.1f nodes per ray, %5.2f Mrays/s\n",
+                BvhBuildMode::ToString( ( BvhBuildMode::Enum )mode ), bvh.stats.build_ms, bvh.stats.triangle_count / ( bvh.stats.build_ms * 1000.0 ),
+                bvh.stats.sah_cost, bvh.stats.node_count, visited_nodes / ( f64 )ray_count, ray_count / ( trace_ms * 1000.0 ) );
+
+        bvh.shutdown();
+    }
+
+    indices.shutdown();
+    positions.shutdown();
+}
+
+} // namespace raptor
@@ -0,0 +1,352 @@
+#include "graphics/cloth_solver.hpp"
+
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include "external/cglm/struct/vec3.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace raptor {
+
+//
+// Square cloth in the x = 0 plane hanging from the fixed vertices of cloth.glsl, with the joints of the obj scene:
+// direct and diagonal neighbours, and the next-next vertices in rows and columns.
+struct ClothGrid {
+
+    void                            init( u32 side );
+    void                            shutdown();
+
+    PhysicsMeshGpuData              mesh_data;
+    Array<PhysicsVertexGpuData>     vertices;
+    Array<u32>                      indices;
+
+}; // struct ClothGrid
+
+void ClothGrid::init( u32 side ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+    const u32 vertex_count = side * side;
+
+    vertices.init( allocator, vertex_count, vertex_count );
+    for ( u32 row = 0; row < side; ++row ) {
+        for ( u32 column = 0; column < side; ++column ) {
+            PhysicsVertexGpuData& vertex = vertices[ row * side + column ];
+            memset( &vertex, 0, sizeof( PhysicsVertexGpuData ) );
+
+            const vec3s position = { 0.f, -1.f + 2.f * row / ( side - 1 ), -1.f + 2.f * column / ( side - 1 ) };
+            vertex.position = position;
+            vertex.start_position = position;
+            vertex.previous_position = position;
+            vertex.normal = vec3s{ 1, 0, 0 };
+            vertex.mass = 1.f;
+
+            const i32 offsets[][ 2 ] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 }, { -1, -1 }, { -1, 1 }, { 1, -1 }, { 1, 1 }, { -2, 0 }, { 2, 0 }, { 0, -2 }, { 0, 2 } };
+            for ( u32 o = 0; o < ArraySize( offsets ); ++o ) {
+                const i32 other_row = ( i32 )row + offsets[ o ][ 0 ];
+                const i32 other_column = ( i32 )column + offsets[ o ][ 1 ];
+                if ( other_row >= 0 && other_row < ( i32 )side && other_column >= 0 && other_column < ( i32 )side ) {
+                    vertex.joints[ vertex.joint_count++ ] = other_row * side + other_column;
+                }
+            }
+        }
+    }
+
+    indices.init( allocator, ( side - 1 ) * ( side - 1 ) * 6 );
+    for ( u32 row = 0; row + 1 < side; ++row ) {
+        for ( u32 column = 0; column + 1 < side; ++column ) {
+            const u32 v = row * side + column;
+            const u32 quad[ 6 ] = { v, v + 1, v + side, v + 1, v + side + 1, v + side };
+            for ( u32 i = 0; i < 6; ++i ) {
+                indices.push( quad[ i ] );
+            }
+        }
+    }
+
+    mesh_data.vertex_count = vertex_count;
+    mesh_data.index_count = indices.size;
+}
+
+void ClothGrid::shutdown() {
+    indices.shutdown();
+    vertices.shutdown();
+}
+
+static PhysicsSceneData cloth_scene_data() {
+    PhysicsSceneData scene_data{ };
+    scene_data.wind_direction = vec3s{ -2.f, 0.f, 0.5f };
+    scene_data.air_density = 2.f;
+    scene_data.spring_stiffness = 10000.f;
+    scene_data.spring_damping = 5000.f;
+    return scene_data;
+}
+
+static bool cloth_is_fixed( vec3s position ) {
+    return position.x == 0.f && ( position.y == 1.f || position.y == -1.f ) && position.z == -1.f;
+}
+
+// Direct port of cloth.glsl on the vertices of the GPU buffer.
+static void cloth_reference_simulate( PhysicsVertexGpuData* vertices, u32 vertex_count, const u32* indices, u32 index_count, const PhysicsSceneData& scene_data ) {
+    const f32 dt = 1.f / 600.f;
+    const vec3s g = { 0.f, -9.8f, 0.f };
+
+    for ( u32 s = 0; s < 10; ++s ) {
+        for ( u32 v = 0; v < vertex_count; ++v ) {
+            PhysicsVertexGpuData& vertex = vertices[ v ];
+            if ( cloth_is_fixed( vertex.start_position ) ) {
+                continue;
+            }
+
+            vec3s spring_force = { 0.f, 0.f, 0.f };
+            for ( u32 j = 0; j < vertex.joint_count; ++j ) {
+                const PhysicsVertexGpuData& other = vertices[ vertex.joints[ j ] ];
+                const f32 sx = vertex.start_position.x - other.start_position.x;
+                const f32 sy = vertex.start_position.y - other.start_position.y;
+                const f32 sz = vertex.start_position.z - other.start_position.z;
+                const f32 rest_length = sqrtf( sx * sx + sy * sy + sz * sz );
+
+                const vec3s pull = { vertex.position.x - other.position.x, vertex.position.y - other.position.y, vertex.position.z - other.position.z };
+                const f32 inverse_length = 1.f / sqrtf( ( pull.x * pull.x + pull.y * pull.y ) + pull.z * pull.z );
+                for ( u32 axis = 0; axis < 3; ++axis ) {
+                    spring_force.raw[ axis ] = spring_force.raw[ axis ] + ( pull.raw[ axis ] - ( pull.raw[ axis ] * inverse_length ) * rest_length ) * scene_data.spring_stiffness;
+                }
+            }
+
+            const vec3s n = vertex.normal;
+            const vec3s velocity = vertex.velocity;
+            const f32 normal_wind = ( n.x * ( scene_data.wind_direction.x - velocity.x ) + n.y * ( scene_data.wind_direction.y - velocity.y ) ) +
+                                    n.z * ( scene_data.wind_direction.z - velocity.z );
+            for ( u32 axis = 0; axis < 3; ++axis ) {
+                vertex.force.raw[ axis ] = ( ( g.raw[ axis ] * vertex.mass - spring_force.raw[ axis ] ) + velocity.raw[ axis ] * -scene_data.spring_damping ) +
+                                           ( n.raw[ axis ] * normal_wind ) * scene_data.air_density;
+            }
+        }
+
+        for ( u32 v = 0; v < vertex_count; ++v ) {
+            PhysicsVertexGpuData& vertex = vertices[ v ];
+            const vec3s current_position = vertex.position;
+            for ( u32 axis = 0; axis < 3; ++axis ) {
+                vertex.position.raw[ axis ] = ( current_position.raw[ axis ] * 2.f - vertex.previous_position.raw[ axis ] ) + vertex.force.raw[ axis ] * ( dt * dt );
+                vertex.velocity.raw[ axis ] = vertex.position.raw[ axis ] - current_position.raw[ axis ];
+            }
+            vertex.previous_position = current_position;
+        }
+    }
+
+    for ( u32 i = 0; i < index_count; i += 3 ) {
+        const vec3s p0 = vertices[ indices[ i ] ].position;
+        const vec3s p1 = vertices[ indices[ i + 1 ] ].position;
+        const vec3s p2 = vertices[ indices[ i + 2 ] ].position;
+        const vec3s e1 = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+        const vec3s e2 = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+        const vec3s n = { e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x };
+
+        for ( u32 k = 0; k < 3; ++k ) {
+            vec3s& normal = vertices[ indices[ i + k ] ].normal;
+            normal = vec3s{ normal.x + n.x, normal.y + n.y, normal.z + n.z };
+            const f32 inverse_length = 1.f / sqrtf( ( normal.x * normal.x + normal.y * normal.y ) + normal.z * normal.z );
+            normal = vec3s{ normal.x * inverse_length, normal.y * inverse_length, normal.z * inverse_length };
+        }
+    }
+}
+
+static f32 cloth_max_difference( const PhysicsVertexGpuData* a, const PhysicsVertexGpuData* b, u32 vertex_count ) {
+    f32 difference = 0.f;
+    for ( u32 v = 0; v < vertex_count; ++v ) {
+        for ( u32 axis = 0; axis < 3; ++axis ) {
+            difference = fmaxf( difference, fabsf( a[ v ].position.raw[ axis ] - b[ v ].position.raw[ axis ] ) );
+            difference = fmaxf( difference, fabsf( a[ v ].normal.raw[ axis ] - b[ v ].normal.raw[ axis ] ) );
+        }
+    }
+    return difference;
+}
+
+static bool cloth_same_state( const ClothSolver& a, const ClothSolver& b ) {
+    return a.position_stream == b.position_stream && memcmp( a.streams.data, b.streams.data, a.streams.size_in_bytes() ) == 0;
+}
+
+// Mass spring results do not depend on the threads or on AVX2, and follow the shader.
+RTEST( cloth_mass_spring_determinism ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize( 4 );
+
+    const u32 sides[] = { 7, 33 };
+    for ( u32 s = 0; s < ArraySize( sides ); ++s ) {
+        ClothGrid grid;
+        grid.init( sides[ s ] );
+
+        ClothSolver scalar, avx2, threaded;
+        scalar.init( allocator, grid.mesh_data, grid.vertices.data, grid.indices.data );
+        avx2.init( allocator, grid.mesh_data, grid.vertices.data, grid.indices.data );
+        threaded.init( allocator, grid.mesh_data, grid.vertices.data, grid.indices.data );
+        scalar.use_avx2 = false;
+        threaded.min_parallel_blocks = 2;
+        threaded.blocks_per_task = 1;
+
+        RCHECK( scalar.stats.vertices == grid.mesh_data.vertex_count && scalar.padded_vertex_count % k_cloth_simd_width == 0 );
+
+        const PhysicsSceneData scene_data = cloth_scene_data();
+        for ( u32 frame = 0; frame < 20; ++frame ) {
+            scalar.simulate( scene_data, nullptr );
+            avx2.simulate( scene_data, nullptr );
+            threaded.simulate( scene_data, &task_scheduler );
+            cloth_reference_simulate( grid.vertices.data, grid.vertices.size, grid.indices.data, grid.indices.size, scene_data );
+        }
+        RCHECK( cloth_same_state( scalar, avx2 ) && cloth_same_state( scalar, threaded ) );
+        RCHECK( scalar.stats.steps == 200 );
+
+        Array<PhysicsVertexGpuData> simulated;
+        simulated.init( allocator, grid.vertices.size, grid.vertices.size );
+        scalar.read_vertices( simulated.data );
+        RCHECK( cloth_max_difference( simulated.data, grid.vertices.data, grid.vertices.size ) < 1e-5f );
+
+        // The cloth hangs from the fixed vertices.
+        u32 moved = 0, fixed_moved = 0;
+        for ( u32 v = 0; v < simulated.size; ++v ) {
+            const bool vertex_moved = memcmp( &simulated[ v ].position, &simulated[ v ].start_position, sizeof( vec3s ) ) != 0;
+            moved += vertex_moved ? 1 : 0;
+            fixed_moved += vertex_moved && cloth_is_fixed( simulated[ v ].start_position ) ? 1 : 0;
+        }
+        RCHECK( fixed_moved == 0 && moved == simulated.size - 2 );
+
+        // Reset goes back to the start positions.
+        PhysicsSceneData reset_data = scene_data;
+        reset_data.reset_simulation = 1;
+        scalar.sim_steps = 0;
+        scalar.simulate( reset_data, nullptr );
+        PhysicsVertexGpuData vertex;
+        scalar.read_vertex( grid.vertices.size - 1, vertex );
+        RCHECK( glms_vec3_eqv( vertex.position, vertex.start_position ) && vertex.velocity.x == 0.f && vertex.force.y == 0.f );
+
+        simulated.shutdown();
+        threaded.shutdown();
+        avx2.shutdown();
+        scalar.shutdown();
+        grid.shutdown();
+    }
+
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+// XPBD constraints are colored so that each color runs in parallel, results do not depend on the threads.
+RTEST( cloth_xpbd_determinism ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize( 4 );
+
+    ClothGrid grid;
+    grid.init( 97 );
+
+    ClothSolver single, threaded;
+    single.init( allocator, grid.mesh_data, grid.vertices.data, grid.indices.data );
+    threaded.init( allocator, grid.mesh_data, grid.vertices.data, grid.indices.data );
+    single.type = ClothSolverType::XPBD;
+    threaded.type = ClothSolverType::XPBD;
+    threaded.min_parallel_blocks = 2;
+
+    // Each joined pair is a single constraint, no two constraints of a color share a vertex.
+    u32 joints = 0;
+    for ( u32 v = 0; v < grid.vertices.size; ++v ) {
+        joints += grid.vertices[ v ].joint_count;
+    }
+    RCHECK( single.stats.constraints * 2 == joints && single.stats.colors > 1 && single.stats.colors <= 2 * k_max_joint_count );
+
+    Array<u32> vertex_colors;
+    vertex_colors.init( allocator, grid.vertices.size, grid.vertices.size );
+    memset( vertex_colors.data, 0xff, vertex_colors.size_in_bytes() );
+    u32 shared = 0, largest_color = 0;
+    for ( u32 color = 0; color < single.stats.colors; ++color ) {
+        largest_color = raptor::max( largest_color, single.color_offsets[ color + 1 ] - single.color_offsets[ color ] );
+        for ( u32 c = single.color_offsets[ color ]; c < single.color_offsets[ color + 1 ]; ++c ) {
+            for ( u32 k = 0; k < 2; ++k ) {
+                u32& vertex_color = vertex_colors[ single.constraint_vertices[ c * 2 + k ] ];
+                shared += vertex_color == color ? 1 : 0;
+                vertex_color = color;
+            }
+        }
+    }
+    RCHECK( shared == 0 && single.color_offsets[ single.stats.colors ] == single.stats.constraints );
+    // Large enough for the colors to run on tasks.
+    RCHECK( largest_color >= 1024 );
+
+    const PhysicsSceneData scene_data = cloth_scene_data();
+    for ( u32 frame = 0; frame < 20; ++frame ) {
+        single.simulate( scene_data, nullptr );
+        threaded.simulate( scene_data, &task_scheduler );
+    }
+    RCHECK( cloth_same_state( single, threaded ) );
+
+    // Stable: the cloth hangs from the fixed vertices without blowing up.
+    u32 fixed_moved = 0, unstable = 0;
+    for ( u32 v = 0; v < grid.vertices.size; ++v ) {
+        PhysicsVertexGpuData vertex;
+        single.read_vertex( v, vertex );
+        fixed_moved += cloth_is_fixed( vertex.start_position ) && !glms_vec3_eqv( vertex.position, vertex.start_position ) ? 1 : 0;
+        unstable += isfinite( vertex.position.y ) && fabsf( vertex.position.x ) < 3.f && fabsf( vertex.position.y ) < 3.f && fabsf( vertex.position.z ) < 3.f ? 0 : 1;
+    }
+    RCHECK( fixed_moved == 0 && unstable == 0 );
+
+    vertex_colors.shutdown();
+    threaded.shutdown();
+    single.shutdown();
+    grid.shutdown();
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+RBENCHMARK( cloth_solver_benchmark ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize();
+    rprint( "%u task threads\n", task_scheduler.GetNumTaskThreads() );
+
+    const u32 sides[] = { 33, 129, 257 };
+    for ( u32 s = 0; s < ArraySize( sides ); ++s ) {
+        ClothGrid grid;
+        grid.init( sides[ s ] );
+
+        struct Configuration {
+            cstring                 name;
+            ClothSolverType::Enum   type;
+            bool                    avx2;
+            bool                    tasks;
+        };
+        const Configuration configurations[] = { { "scalar", ClothSolverType::MassSpring, false, false }, { "avx2", ClothSolverType::MassSpring, true, false },
+                                                 { "avx2 tasks", ClothSolverType::MassSpring, true, true }, { "xpbd", ClothSolverType::XPBD, false, false },
+                                                 { "xpbd tasks", ClothSolverType::XPBD, false, true } };
+
+        for ( u32 c = 0; c < ArraySize( configurations ); ++c ) {
+            const Configuration& configuration = configurations[ c ];
+
+            ClothSolver solver;
+            solver.init( allocator, grid.mesh_data, grid.vertices.data, grid.indices.data );
+            solver.type = configuration.type;
+            solver.use_avx2 = configuration.avx2;
+
+            const u32 frames = 20;
+            const i64 start = time_now();
+            for ( u32 frame = 0; frame < frames; ++frame ) {
+                solver.simulate( cloth_scene_data(), configuration.tasks ? &task_scheduler : nullptr );
+            }
+            const f64 frame_ms = time_from_milliseconds( start ) / frames;
+
+            rprint( "%5u vertices, %-10s: %7.3f ms per frame, %8.0f vertex steps per ms%s\n", grid.mesh_data.vertex_count, configuration.name, frame_ms,
+                    ( grid.mesh_data.vertex_count * solver.sim_steps ) / frame_ms, configuration.avx2 && !solver.avx2_supported ? " (no AVX2)" : "" );
+
+            solver.shutdown();
+        }
+
+        grid.shutdown();
+    }
+
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+} // namespace raptor
@@ -0,0 +1,527 @@
+#include "graphics/ddgi_probe_scheduler.hpp"
+
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include "external/cglm/struct/vec3.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+namespace raptor {
+
+static const u32                    k_test_rays_per_probe   = 128;
+// Same values written by the raytracing shaders: misses store a far distance, backfaces a scaled negative one.
+static const f32                    k_test_miss_distance    = 1000.0f;
+static const f32                    k_test_backface_scale   = 0.2f;
+
+static f32 random_f32( f32 min_value, f32 max_value ) {
+    return min_value + ( max_value - min_value ) * ( rand() / ( f32 )RAND_MAX );
+}
+
+// Same directions as spherical_fibonacci in ddgi.glsl, without the random rotation.
+static void spherical_fibonacci_directions( vec3s* directions, u32 num_rays ) {
+    const f32 golden_angle = 3.14159265f * ( 3.0f - sqrtf( 5.0f ) );
+    for ( u32 i = 0; i < num_rays; ++i ) {
+        const f32 cos_theta = 1.0f - ( 2.0f * i + 1.0f ) / num_rays;
+        const f32 sin_theta = sqrtf( 1.0f - cos_theta * cos_theta );
+        const f32 phi = golden_angle * i;
+        directions[ i ] = vec3s{ cosf( phi ) * sin_theta, sinf( phi ) * sin_theta, cos_theta };
+    }
+}
+
+//
+// Closed boxes traced on the CPU, standing for the scene geometry.
+struct DDGITestScene {
+
+    void                            add_box( vec3s aabb_min, vec3s aabb_max );
+
+    f32                             trace( vec3s origin, vec3s direction ) const;
+    // Traces all the rays of a probe from its current position.
+    void                            trace_probe( const DDGIProbeScheduler& scheduler, u32 probe_index );
+
+    vec3s                           box_min[ 8 ];
+    vec3s                           box_max[ 8 ];
+    u32                             num_boxes               = 0;
+
+    vec3s                           directions[ k_test_rays_per_probe ];
+    f32                             distances[ k_test_rays_per_probe ];
+
+}; // struct DDGITestScene
+
+void DDGITestScene::add_box( vec3s aabb_min, vec3s aabb_max ) {
+    RASSERT( num_boxes < ArraySize( box_min ) );
+    box_min[ num_boxes ] = aabb_min;
+    box_max[ num_boxes ] = aabb_max;
+    ++num_boxes;
+}
+
+f32 DDGITestScene::trace( vec3s origin, vec3s direction ) const {
+    f32 closest = FLT_MAX;
+    bool backface = false;
+
+    for ( u32 b = 0; b < num_boxes; ++b ) {
+        f32 t_near = -FLT_MAX, t_far = FLT_MAX;
+        for ( u32 axis = 0; axis < 3; ++axis ) {
+            const f32 inverse = 1.0f / direction.raw[ axis ];
+            f32 t0 = ( box_min[ b ].raw[ axis ] - origin.raw[ axis ] ) * inverse;
+            f32 t1 = ( box_max[ b ].raw[ axis ] - origin.raw[ axis ] ) * inverse;
+            if ( t0 > t1 ) {
+                const f32 temp = t0;
+                t0 = t1;
+                t1 = temp;
+            }
+            t_near = t0 > t_near ? t0 : t_near;
+            t_far = t1 < t_far ? t1 : t_far;
+        }
+
+        if ( t_near > t_far || t_far <= 0.0f ) {
+            continue;
+        }
+        // From inside the box the first surface is a backface.
+        const bool inside = t_near <= 0.0f;
+        const f32 t = inside ? t_far : t_near;
+        if ( t < closest ) {
+            closest = t;
+            backface = inside;
+        }
+    }
+
+    if ( closest == FLT_MAX ) {
+        return k_test_miss_distance;
+    }
+    return backface ? -closest * k_test_backface_scale : closest;
+}
+
+void DDGITestScene::trace_probe( const DDGIProbeScheduler& scheduler, u32 probe_index ) {
+    const vec3s position = scheduler.probe_position( probe_index );
+    for ( u32 r = 0; r < k_test_rays_per_probe; ++r ) {
+        distances[ r ] = trace( position, directions[ r ] );
+    }
+}
+
+// Single probe scheduler placed at position.
+static void place_probe( DDGIProbeScheduler& scheduler, vec3s position ) {
+    scheduler.set_grid( position, vec3s{ 1, 1, 1 }, 0.4f, 0.3f );
+    scheduler.reset();
+}
+
+static DDGIProbeStatus::Enum classify_at( DDGIProbeScheduler& scheduler, DDGITestScene& scene, vec3s position ) {
+    place_probe( scheduler, position );
+    scene.trace_probe( scheduler, 0 );
+    return scheduler.classify_probe( 0, scene.distances, scene.directions, k_test_rays_per_probe );
+}
+
+RTEST( ddgi_probe_classification ) {
+    DDGIProbeScheduler scheduler;
+    scheduler.init( &MemoryService::instance()->system_allocator, 1, 1, 1 );
+
+    DDGITestScene scene;
+    spherical_fibonacci_directions( scene.directions, k_test_rays_per_probe );
+    // A floor and a box standing on it.
+    scene.add_box( vec3s{ -100, -1, -100 }, vec3s{ 100, 0, 100 } );
+    scene.add_box( vec3s{ 2, 0, 2 }, vec3s{ 4, 2, 4 } );
+
+    RCHECK( scheduler.probes[ 0 ].status == DDGIProbeStatus::Uninitialized );
+
+    // Surfaces in the shading range of the probe.
+    RCHECK( classify_at( scheduler, scene, vec3s{ 0, 0.5f, 0 } ) == DDGIProbeStatus::Active );
+    RCHECK( scheduler.probes[ 0 ].status == DDGIProbeStatus::Active );
+    RCHECK( classify_at( scheduler, scene, vec3s{ 1.5f, 5, 3 } ) == DDGIProbeStatus::Inactive );
+    RCHECK( classify_at( scheduler, scene, vec3s{ 1.2f, 3, 3 } ) == DDGIProbeStatus::Active );
+
+    // Far from everything: misses count as far frontfaces, nothing to shade.
+    RCHECK( classify_at( scheduler, scene, vec3s{ 0, 20, 0 } ) == DDGIProbeStatus::Inactive );
+
+    // Touching a surface, even with bounds too small to shade it.
+    place_probe( scheduler, vec3s{ -20, 0.02f, 0 } );
+    scheduler.self_shadow_bias = -0.85f;
+    scene.trace_probe( scheduler, 0 );
+    RCHECK( scheduler.classify_probe( 0, scene.distances, scene.directions, k_test_rays_per_probe ) == DDGIProbeStatus::Active );
+    scheduler.close_frontface_distance = 0.01f;
+    RCHECK( scheduler.classify_probe( 0, scene.distances, scene.directions, k_test_rays_per_probe ) == DDGIProbeStatus::Inactive );
+    scheduler.close_frontface_distance = 0.05f;
+
+    // Inside geometry, every ray sees a backface.
+    RCHECK( classify_at( scheduler, scene, vec3s{ 3, 1, 3 } ) == DDGIProbeStatus::Off );
+    RCHECK( classify_at( scheduler, scene, vec3s{ 0, -0.5f, 0 } ) == DDGIProbeStatus::Off );
+
+    // Rays with only backfaces and no distance.
+    for ( u32 r = 0; r < k_test_rays_per_probe; ++r ) {
+        scene.distances[ r ] = r < 8 ? -1.0f : 0.0f;
+    }
+    RCHECK( scheduler.classify_probe( 0, scene.distances, scene.directions, k_test_rays_per_probe ) == DDGIProbeStatus::Off );
+
+    // Under the backface ratio the probe is outside, seeing through a hole.
+    for ( u32 r = 0; r < k_test_rays_per_probe; ++r ) {
+        scene.distances[ r ] = r < k_test_rays_per_probe / 8 ? -0.1f : 0.5f;
+    }
+    RCHECK( scheduler.classify_probe( 0, scene.distances, scene.directions, k_test_rays_per_probe ) == DDGIProbeStatus::Active );
+
+    scheduler.shutdown();
+}
+
+RTEST( ddgi_probe_relocation ) {
+    DDGIProbeScheduler scheduler;
+    scheduler.init( &MemoryService::instance()->system_allocator, 1, 1, 1 );
+
+    DDGITestScene scene;
+    spherical_fibonacci_directions( scene.directions, k_test_rays_per_probe );
+    scene.add_box( vec3s{ -100, -1, -100 }, vec3s{ 100, 0, 100 } );
+    scene.add_box( vec3s{ 10, 0, -10 }, vec3s{ 14, 4, 10 } );
+
+    // A probe sunk in the floor crosses it in a few updates and shades it.
+    place_probe( scheduler, vec3s{ 0, -0.2f, 0 } );
+    const vec3s cell_offset_limit = glms_vec3_scale( scheduler.probe_spacing, scheduler.max_probe_offset );
+    for ( u32 update = 0; update < 4; ++update ) {
+        scene.trace_probe( scheduler, 0 );
+        scheduler.relocate_probe( 0, scene.distances, scene.directions, k_test_rays_per_probe );
+    }
+    const vec3s offset = scheduler.probes[ 0 ].offset;
+    RCHECK( scheduler.probe_position( 0 ).y > 0.0f && offset.y < cell_offset_limit.y );
+    RCHECK( fabsf( offset.x ) < cell_offset_limit.x && fabsf( offset.z ) < cell_offset_limit.z );
+    scene.trace_probe( scheduler, 0 );
+    RCHECK( scheduler.classify_probe( 0, scene.distances, scene.directions, k_test_rays_per_probe ) == DDGIProbeStatus::Active );
+
+    // Deep in a wall: the probe moves toward the closest side but never leaves its cell.
+    place_probe( scheduler, vec3s{ 11.5f, 2, 0 } );
+    for ( u32 update = 0; update < 16; ++update ) {
+        scene.trace_probe( scheduler, 0 );
+        scheduler.relocate_probe( 0, scene.distances, scene.directions, k_test_rays_per_probe );
+
+        const vec3s wall_offset = scheduler.probes[ 0 ].offset;
+        RCHECK( fabsf( wall_offset.x ) < cell_offset_limit.x && fabsf( wall_offset.y ) < cell_offset_limit.y && fabsf( wall_offset.z ) < cell_offset_limit.z );
+    }
+    RCHECK( scheduler.probes[ 0 ].offset.x < -0.3f );
+    scene.trace_probe( scheduler, 0 );
+    RCHECK( scheduler.classify_probe( 0, scene.distances, scene.directions, k_test_rays_per_probe ) == DDGIProbeStatus::Off );
+
+    // Too close to a surface: moved toward the farthest one, unless it is the same surface.
+    u32 lowest_ray = 0, highest_ray = 0;
+    for ( u32 r = 0; r < k_test_rays_per_probe; ++r ) {
+        lowest_ray = scene.directions[ r ].y < scene.directions[ lowest_ray ].y ? r : lowest_ray;
+        highest_ray = scene.directions[ r ].y > scene.directions[ highest_ray ].y ? r : highest_ray;
+        scene.distances[ r ] = 1.0f;
+    }
+    scene.distances[ lowest_ray ] = 0.01f;
+    scene.distances[ highest_ray ] = 5.0f;
+    place_probe( scheduler, vec3s{ 0, 0, 0 } );
+    scheduler.relocate_probe( 0, scene.distances, scene.directions, k_test_rays_per_probe );
+    RCHECK( glms_vec3_distance( scheduler.probes[ 0 ].offset, glms_vec3_scale( scene.directions[ highest_ray ], 0.2f ) ) < 1e-5f );
+
+    // The farthest hit is next to the closest one.
+    u32 neighbour_ray = highest_ray;
+    for ( u32 r = 0; r < k_test_rays_per_probe; ++r ) {
+        const f32 dot = glms_vec3_dot( scene.directions[ r ], scene.directions[ lowest_ray ] );
+        neighbour_ray = r != lowest_ray && dot > glms_vec3_dot( scene.directions[ neighbour_ray ], scene.directions[ lowest_ray ] ) ? r : neighbour_ray;
+    }
+    scene.distances[ highest_ray ] = 1.0f;
+    scene.distances[ neighbour_ray ] = 5.0f;
+    place_probe( scheduler, vec3s{ 0, 1, 0 } );
+    scheduler.relocate_probe( 0, scene.distances, scene.directions, k_test_rays_per_probe );
+    RCHECK( glms_vec3_eqv( scheduler.probes[ 0 ].offset, vec3s{ 0, 0, 0 } ) );
+
+    // In the open nothing moves.
+    place_probe( scheduler, vec3s{ -5, 5, 0 } );
+    scene.trace_probe( scheduler, 0 );
+    scheduler.relocate_probe( 0, scene.distances, scene.directions, k_test_rays_per_probe );
+    RCHECK( glms_vec3_eqv( scheduler.probes[ 0 ].offset, vec3s{ 0, 0, 0 } ) );
+
+    scheduler.shutdown();
+}
+
+static bool probe_scheduled( const DDGIProbeScheduler& scheduler, u32 probe_index ) {
+    return scheduler.probes[ probe_index ].last_update_frame == scheduler.frame;
+}
+
+RTEST( ddgi_probe_schedule ) {
+    DDGIProbeScheduler scheduler;
+    scheduler.init( &MemoryService::instance()->system_allocator, 8, 4, 8 );
+    scheduler.set_grid( vec3s{ 0, 0, 0 }, vec3s{ 1, 1, 1 }, 0.4f, 0.3f );
+
+    const u32 num_probes = scheduler.get_total_probes();
+    const u32 budget_probes = 16;
+    const u32 ray_budget = budget_probes * k_test_rays_per_probe + k_test_rays_per_probe / 2;
+    const vec3s camera_position = { 1, 1, 1 };
+
+    // Probes never traced come first, nearest to the camera first.
+    scheduler.schedule( camera_position, ray_budget, k_test_rays_per_probe );
+    RCHECK( scheduler.stats.budget_probes == budget_probes && scheduler.stats.scheduled_probes == budget_probes );
+    RCHECK( scheduler.stats.scheduled_rays == budget_probes * k_test_rays_per_probe && scheduler.stats.uninitialized_probes == num_probes );
+
+    f32 farthest_scheduled = 0.f, nearest_skipped = FLT_MAX;
+    for ( u32 p = 0; p < num_probes; ++p ) {
+        const f32 distance = glms_vec3_distance2( scheduler.probe_position( p ), camera_position );
+        if ( probe_scheduled( scheduler, p ) ) {
+            farthest_scheduled = raptor::max( farthest_scheduled, distance );
+        } else {
+            nearest_skipped = raptor::min( nearest_skipped, distance );
+        }
+    }
+    RCHECK( farthest_scheduled <= nearest_skipped );
+
+    bool sorted = true;
+    for ( u32 i = 1; i < scheduler.update_list.size; ++i ) {
+        sorted &= scheduler.update_list[ i - 1 ] < scheduler.update_list[ i ];
+    }
+    RCHECK( sorted );
+
+    // Every probe is traced once before any is traced twice.
+    for ( u32 f = 1; f < num_probes / budget_probes; ++f ) {
+        scheduler.schedule( camera_position, ray_budget, k_test_rays_per_probe );
+    }
+    u32 traced_once = 0;
+    for ( u32 p = 0; p < num_probes; ++p ) {
+        traced_once += scheduler.probes[ p ].updates == 1 ? 1 : 0;
+    }
+    RCHECK( traced_once == num_probes );
+
+    // Classified: the lowest layer shades the floor, two probes are in a wall, the rest is in the air.
+    const u32 off_probes[] = { 5 + 1 * 8 + 3 * 32, 6 + 1 * 8 + 3 * 32 };
+    for ( u32 p = 0; p < num_probes; ++p ) {
+        const bool floor = scheduler.probe_grid_indices( p ).y == 0.f;
+        scheduler.probes[ p ].status = floor ? DDGIProbeStatus::Active : DDGIProbeStatus::Inactive;
+    }
+    for ( u32 o = 0; o < ArraySize( off_probes ); ++o ) {
+        scheduler.probes[ off_probes[ o ] ].status = DDGIProbeStatus::Off;
+    }
+
+    // Nothing starves, active probes are refreshed more often and Off probes wait for their recheck.
+    scheduler.off_recheck_frames = 100;
+    u32 max_active_age = 0, active_updates = 0, inactive_updates = 0, off_updates = 0;
+    for ( u32 f = 0; f < 400; ++f ) {
+        const u32 off_last_update = scheduler.probes[ off_probes[ 0 ] ].last_update_frame;
+        scheduler.schedule( camera_position, ray_budget, k_test_rays_per_probe );
+        max_active_age = raptor::max( max_active_age, scheduler.stats.max_age );
+        RCHECK( scheduler.stats.scheduled_probes == budget_probes );
+
+        for ( u32 i = 0; i < scheduler.update_list.size; ++i ) {
+            const DDGIProbeStatus::Enum status = scheduler.probes[ scheduler.update_list[ i ] ].status;
+            active_updates += status == DDGIProbeStatus::Active ? 1 : 0;
+            inactive_updates += status == DDGIProbeStatus::Inactive ? 1 : 0;
+            off_updates += status == DDGIProbeStatus::Off ? 1 : 0;
+        }
+
+        if ( probe_scheduled( scheduler, off_probes[ 0 ] ) ) {
+            RCHECK( scheduler.frame - off_last_update >= scheduler.off_recheck_frames );
+        }
+    }
+    RCHECK( scheduler.stats.active_probes == 64 && scheduler.stats.off_probes == 2 && scheduler.stats.inactive_probes == num_probes - 66 );
+    RCHECK( max_active_age > 0 && max_active_age < 32 );
+    RCHECK( off_updates >= 2 && off_updates <= 8 );
+
+    u32 oldest_inactive = 0;
+    for ( u32 p = 0; p < num_probes; ++p ) {
+        if ( scheduler.probes[ p ].status == DDGIProbeStatus::Inactive ) {
+            oldest_inactive = raptor::max( oldest_inactive, scheduler.frame - scheduler.probes[ p ].last_update_frame );
+        }
+    }
+    RCHECK( oldest_inactive < 200 && inactive_updates > 0 );
+    // 64 active probes against 190 inactive ones.
+    RCHECK( active_updates / 64.f > 4.f * inactive_updates / 190.f );
+
+    // Changes near a light raise the variance of the probes around it, which are traced next.
+    for ( u32 p = 0; p < num_probes; ++p ) {
+        scheduler.probes[ p ].variance = 0.f;
+        scheduler.probes[ p ].status = DDGIProbeStatus::Active;
+    }
+    const vec4s light_sphere = { 5, 2, 5, 1.2f };
+    scheduler.invalidate_sphere( light_sphere );
+    u32 invalidated = 0, wrong_variance = 0;
+    for ( u32 p = 0; p < num_probes; ++p ) {
+        const bool inside = glms_vec3_distance( scheduler.probe_position( p ), vec3s{ light_sphere.x, light_sphere.y, light_sphere.z } ) <= light_sphere.w;
+        invalidated += inside ? 1 : 0;
+        wrong_variance += ( scheduler.probes[ p ].variance == scheduler.change_variance ) != inside ? 1 : 0;
+    }
+    RCHECK( invalidated == 7 && wrong_variance == 0 );
+
+    scheduler.schedule( camera_position, ray_budget, k_test_rays_per_probe );
+    u32 invalidated_scheduled = 0;
+    for ( u32 p = 0; p < num_probes; ++p ) {
+        invalidated_scheduled += probe_scheduled( scheduler, p ) && scheduler.probes[ p ].variance > 0.f ? 1 : 0;
+    }
+    RCHECK( invalidated_scheduled == 7 && scheduler.stats.max_variance == scheduler.change_variance );
+
+    // Reported changes raise the variance, scheduling decays it.
+    const u32 probe = scheduler.update_list[ 0 ];
+    const f32 variance = scheduler.probes[ probe ].variance;
+    scheduler.report_irradiance( probe, vec3s{ 2, 2, 2 } );
+    RCHECK( scheduler.probes[ probe ].variance > variance );
+    scheduler.report_irradiance( probe, vec3s{ 2, 2, 2 } );
+    RCHECK( glms_vec3_eqv( scheduler.probes[ probe ].irradiance, vec3s{ 2, 2, 2 } ) );
+
+    // Spheres away from the grid touch nothing.
+    scheduler.invalidate_sphere( vec4s{ 100, 0, 0, 5 } );
+    scheduler.invalidate_sphere( vec4s{ -10, 2, 2, 5 } );
+    u32 raised = 0;
+    for ( u32 p = 0; p < num_probes; ++p ) {
+        raised += scheduler.probes[ p ].variance >= scheduler.change_variance ? 1 : 0;
+    }
+    RCHECK( raised == 1 );
+
+    // No budget, nothing to trace.
+    scheduler.schedule( camera_position, k_test_rays_per_probe - 1, k_test_rays_per_probe );
+    RCHECK( scheduler.update_list.size == 0 && scheduler.stats.scheduled_rays == 0 );
+    scheduler.schedule( camera_position, ray_budget, 0 );
+    RCHECK( scheduler.update_list.size == 0 );
+
+    // Moving the grid invalidates offsets and statuses, setting the same grid does not.
+    scheduler.probes[ 5 ].offset = vec3s{ 0.1f, 0, 0 };
+    scheduler.set_grid( vec3s{ 0, 0, 0 }, vec3s{ 1, 1, 1 }, 0.3f, 0.2f );
+    RCHECK( scheduler.probes[ 5 ].offset.x == 0.1f && scheduler.probes[ 5 ].status == DDGIProbeStatus::Active && scheduler.max_probe_offset == 0.3f );
+    scheduler.set_grid( vec3s{ 0, 1, 0 }, vec3s{ 1, 1, 1 }, 0.3f, 0.2f );
+    RCHECK( scheduler.probes[ 5 ].offset.x == 0.0f && scheduler.probes[ 5 ].status == DDGIProbeStatus::Uninitialized && scheduler.probes[ 5 ].updates == 0 );
+
+    scheduler.shutdown();
+}
+
+//
+// Probes following an irradiance field lit by a moving light. Traced values are noisy and blended with hysteresis
+// as the probe update shaders do, only for the probes traced in a frame.
+struct DDGISimulation {
+
+    void                            init( DDGIProbeScheduler* scheduler );
+    void                            shutdown();
+
+    f32                             irradiance( vec3s position ) const;
+    void                            trace_probe( u32 probe_index );
+    // Absolute error of the probes, all of them and the ones near the camera.
+    void                            accumulate_error();
+
+    DDGIProbeScheduler*             scheduler;
+    Array<f32>                      probe_irradiance;
+
+    vec3s                           light_position;
+    vec3s                           camera_position;
+    f32                             hysteresis              = 0.8f;
+
+    f64                             total_error             = 0.0;
+    f64                             near_error              = 0.0;
+    u32                             total_samples           = 0;
+    u32                             near_samples            = 0;
+
+}; // struct DDGISimulation
+
+void DDGISimulation::init( DDGIProbeScheduler* scheduler_ ) {
+    scheduler = scheduler_;
+    const u32 num_probes = scheduler->get_total_probes();
+    probe_irradiance.init( &MemoryService::instance()->system_allocator, num_probes, num_probes );
+    for ( u32 p = 0; p < num_probes; ++p ) {
+        probe_irradiance[ p ] = 0.f;
+    }
+}
+
+void DDGISimulation::shutdown() {
+    probe_irradiance.shutdown();
+}
+
+f32 DDGISimulation::irradiance( vec3s position ) const {
+    return 0.1f + 100.0f / ( 1.0f + glms_vec3_distance2( position, light_position ) );
+}
+
+void DDGISimulation::trace_probe( u32 probe_index ) {
+    const f32 traced = irradiance( scheduler->probe_position( probe_index ) ) * random_f32( 0.9f, 1.1f );
+    f32& stored = probe_irradiance[ probe_index ];
+    stored = stored * hysteresis + traced * ( 1.0f - hysteresis );
+}
+
+void DDGISimulation::accumulate_error() {
+    for ( u32 p = 0; p < probe_irradiance.size; ++p ) {
+        const vec3s position = scheduler->probe_position( p );
+        const f32 error = fabsf( probe_irradiance[ p ] - irradiance( position ) );
+        total_error += error;
+        ++total_samples;
+        if ( glms_vec3_distance2( position, camera_position ) < 16.0f * 16.0f ) {
+            near_error += error;
+            ++near_samples;
+        }
+    }
+}
+
+RBENCHMARK( ddgi_probe_scheduler_simulation ) {
+    enum Strategy {
+        Strategy_FullGrid, Strategy_RoundRobin, Strategy_Scheduled, Strategy_Count
+    };
+    static cstring s_strategy_names[ Strategy_Count ] = { "Full grid", "Round robin", "Scheduled" };
+
+    DDGIProbeScheduler scheduler;
+    scheduler.init( &MemoryService::instance()->system_allocator, 32, 8, 32 );
+    scheduler.set_grid( vec3s{ 0, 0, 0 }, vec3s{ 2, 2, 2 }, 0.4f, 0.3f );
+
+    const u32 num_probes = scheduler.get_total_probes();
+    const u32 frames = 300, warmup_frames = 100;
+    const u32 budget_divisors[] = { 8, 32 };
+    rprint( "%u probes, %u rays per probe, %u frames\n", num_probes, k_test_rays_per_probe, frames );
+
+    for ( u32 d = 0; d < ArraySize( budget_divisors ); ++d ) {
+        const u32 budget_probes = num_probes / budget_divisors[ d ];
+
+        for ( u32 strategy = 0; strategy < Strategy_Count; ++strategy ) {
+            if ( strategy == Strategy_FullGrid && d > 0 ) {
+                continue;
+            }
+            srand( 7 );
+
+            scheduler.reset();
+            scheduler.frame = 0;
+            DDGISimulation simulation;
+            simulation.init( &scheduler );
+            simulation.camera_position = vec3s{ 16, 4, 16 };
+
+            u32 round_robin_cursor = 0;
+            u64 traced_probes = 0;
+            f64 schedule_ms = 0.0;
+
+            for ( u32 f = 0; f < frames; ++f ) {
+                // The light orbits around the center of the grid.
+                const f32 angle = f * 0.02f;
+                simulation.light_position = vec3s{ 32 + 20 * cosf( angle ), 8, 32 + 20 * sinf( angle ) };
+
+                if ( strategy == Strategy_FullGrid ) {
+                    for ( u32 p = 0; p < num_probes; ++p ) {
+                        simulation.trace_probe( p );
+                    }
+                    traced_probes += num_probes;
+                } else if ( strategy == Strategy_RoundRobin ) {
+                    for ( u32 i = 0; i < budget_probes; ++i ) {
+                        simulation.trace_probe( round_robin_cursor );
+                        round_robin_cursor = ( round_robin_cursor + 1 ) % num_probes;
+                    }
+                    traced_probes += budget_probes;
+                } else {
+                    const i64 start = time_now();
+                    scheduler.invalidate_sphere( vec4s{ simulation.light_position.x, simulation.light_position.y, simulation.light_position.z, 10.0f } );
+                    scheduler.schedule( simulation.camera_position, budget_probes * k_test_rays_per_probe, k_test_rays_per_probe );
+                    schedule_ms += time_from_milliseconds( start );
+
+                    for ( u32 i = 0; i < scheduler.update_list.size; ++i ) {
+                        const u32 probe_index = scheduler.update_list[ i ];
+                        simulation.trace_probe( probe_index );
+                        const f32 value = simulation.probe_irradiance[ probe_index ];
+                        scheduler.report_irradiance( probe_index, vec3s{ value, value, value } );
+                    }
+                    traced_probes += scheduler.update_list.size;
+                }
+
+                if ( f >= warmup_frames ) {
+                    simulation.accumulate_error();
+                }
+            }
+
+            rprint( "%-12s %5u probes per frame: error %.4f, near camera %.4f, schedule %.3f ms per frame\n", s_strategy_names[ strategy ],
+                    ( u32 )( traced_probes / frames ), simulation.total_error / simulation.total_samples, simulation.near_error / simulation.near_samples,
+                    schedule_ms / frames );
+
+            simulation.shutdown();
+        }
+    }
+
+    scheduler.shutdown();
+}
+
+} // namespace raptor
@@ -0,0 +1,344 @@
+#include "graphics/debug_draw.hpp"
+
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include "external/enkiTS/TaskScheduler.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace raptor {
+
+static f32 random_f32( f32 min_value, f32 max_value ) {
+    return min_value + ( max_value - min_value ) * ( rand() / ( f32 )RAND_MAX );
+}
+
+static bool same_position( const DebugLineVertex& a, const DebugLineVertex& b ) {
+    return a.position.x == b.position.x && a.position.y == b.position.y && a.position.z == b.position.z;
+}
+
+static f32 distance( const vec3s& a, const vec3s& b ) {
+    const f32 dx = a.x - b.x;
+    const f32 dy = a.y - b.y;
+    const f32 dz = a.z - b.z;
+    return sqrtf( dx * dx + dy * dy + dz * dz );
+}
+
+// The 12 edges of the box: corners, one axis changing per edge, no edge twice. SIMD and scalar write the same bytes.
+RTEST( debug_draw_expand_aabbs ) {
+    const DebugAabbCommand aabb = { { 1.f, 2.f, 3.f }, Color::green, { 4.f, 5.5f, -6.f }, 0 };
+
+    DebugLineVertex vertices[ 2 ][ k_debug_draw_lines_per_aabb * 2 ];
+    for ( u32 simd = 0; simd < 2; ++simd ) {
+        debug_draw_expand_aabbs( &aabb, 1, vertices[ simd ], simd == 1 );
+    }
+    RCHECK( memcmp( vertices[ 0 ], vertices[ 1 ], sizeof( vertices[ 0 ] ) ) == 0 );
+
+    u32 errors = 0;
+    u32 edge_mask = 0;
+    for ( u32 e = 0; e < k_debug_draw_lines_per_aabb; ++e ) {
+        u32 corners[ 2 ];
+        for ( u32 v = 0; v < 2; ++v ) {
+            const DebugLineVertex& vertex = vertices[ 0 ][ e * 2 + v ];
+            const bool x_max = vertex.position.x == aabb.max.x, y_max = vertex.position.y == aabb.max.y, z_max = vertex.position.z == aabb.max.z;
+            errors += ( x_max || vertex.position.x == aabb.min.x ) && ( y_max || vertex.position.y == aabb.min.y ) && ( z_max || vertex.position.z == aabb.min.z ) ? 0 : 1;
+            errors += vertex.color == Color::green ? 0 : 1;
+            corners[ v ] = ( x_max ? 1 : 0 ) | ( y_max ? 2 : 0 ) | ( z_max ? 4 : 0 );
+        }
+
+        // Edges as the corner they start from and the axis changing, 3 bits per corner.
+        const u32 axis = corners[ 0 ] ^ corners[ 1 ];
+        errors += axis == 1 || axis == 2 || axis == 4 ? 0 : 1;
+        edge_mask |= 1u << ( ( corners[ 0 ] & corners[ 1 ] ) * 3 + ( axis == 1 ? 0 : axis == 2 ? 1 : 2 ) );
+    }
+    RCHECK( errors == 0 );
+
+    u32 edges = 0;
+    for ( u32 b = 0; b < 24; ++b ) {
+        edges += ( edge_mask >> b ) & 1;
+    }
+    RCHECK( edges == k_debug_draw_lines_per_aabb );
+
+    // Many boxes.
+    srand( 3 );
+    const u32 num_aabbs = 1000;
+    DebugAabbCommand* aabbs = ( DebugAabbCommand* )malloc( sizeof( DebugAabbCommand ) * num_aabbs );
+    for ( u32 a = 0; a < num_aabbs; ++a ) {
+        const vec3s min = { random_f32( -100, 100 ), random_f32( -100, 100 ), random_f32( -100, 100 ) };
+        aabbs[ a ] = { min, ( u32 )rand(), { min.x + random_f32( 0, 10 ), min.y + random_f32( 0, 10 ), min.z + random_f32( 0, 10 ) }, ( u32 )rand() };
+    }
+
+    const u32 num_vertices = num_aabbs * k_debug_draw_lines_per_aabb * 2;
+    DebugLineVertex* scalar_vertices = ( DebugLineVertex* )malloc( sizeof( DebugLineVertex ) * num_vertices );
+    DebugLineVertex* simd_vertices = ( DebugLineVertex* )malloc( sizeof( DebugLineVertex ) * num_vertices );
+    debug_draw_expand_aabbs( aabbs, num_aabbs, scalar_vertices, false );
+    debug_draw_expand_aabbs( aabbs, num_aabbs, simd_vertices, true );
+    RCHECK( memcmp( scalar_vertices, simd_vertices, sizeof( DebugLineVertex ) * num_vertices ) == 0 );
+    RCHECK( scalar_vertices[ num_vertices - 1 ].color == aabbs[ num_aabbs - 1 ].color );
+
+    free( simd_vertices );
+    free( scalar_vertices );
+    free( aabbs );
+}
+
+// Three closed circles on the axis planes, at the radius from the center.
+RTEST( debug_draw_expand_spheres ) {
+    srand( 5 );
+    const u32 num_spheres = 200;
+    DebugSphereCommand spheres[ num_spheres ];
+    for ( u32 s = 0; s < num_spheres; ++s ) {
+        spheres[ s ] = { { random_f32( -100, 100 ), random_f32( -100, 100 ), random_f32( -100, 100 ) }, random_f32( 0.1f, 20.f ), ( u32 )rand() };
+    }
+
+    const u32 vertices_per_sphere = k_debug_draw_lines_per_sphere * 2;
+    const u32 num_vertices = num_spheres * vertices_per_sphere;
+    DebugLineVertex* scalar_vertices = ( DebugLineVertex* )malloc( sizeof( DebugLineVertex ) * num_vertices );
+    DebugLineVertex* simd_vertices = ( DebugLineVertex* )malloc( sizeof( DebugLineVertex ) * num_vertices );
+    debug_draw_expand_spheres( spheres, num_spheres, scalar_vertices, false );
+    debug_draw_expand_spheres( spheres, num_spheres, simd_vertices, true );
+
+    u32 errors = 0;
+    f32 max_difference = 0.f;
+    for ( u32 s = 0; s < num_spheres; ++s ) {
+        const DebugSphereCommand& sphere = spheres[ s ];
+        const DebugLineVertex* vertices = scalar_vertices + s * vertices_per_sphere;
+
+        for ( u32 plane = 0; plane < 3; ++plane ) {
+            const DebugLineVertex* circle = vertices + plane * k_debug_draw_sphere_segments * 2;
+            // Z for XY, Y for XZ, X for YZ.
+            const f32 fixed_center = plane == 0 ? sphere.center.z : plane == 1 ? sphere.center.y : sphere.center.x;
+
+            for ( u32 v = 0; v < k_debug_draw_sphere_segments * 2; ++v ) {
+                const DebugLineVertex& vertex = circle[ v ];
+                const f32 fixed = plane == 0 ? vertex.position.z : plane == 1 ? vertex.position.y : vertex.position.x;
+                errors += fixed == fixed_center && vertex.color == sphere.color ? 0 : 1;
+                errors += fabsf( distance( vertex.position, sphere.center ) - sphere.radius ) < 1e-3f ? 0 : 1;
+            }
+
+            // Each segment starts where the previous ends, the last one closes the circle.
+            for ( u32 segment = 0; segment < k_debug_draw_sphere_segments; ++segment ) {
+                const u32 next = ( segment + 1 ) % k_debug_draw_sphere_segments;
+                errors += same_position( circle[ segment * 2 + 1 ], circle[ next * 2 ] ) ? 0 : 1;
+                errors += same_position( circle[ segment * 2 ], circle[ segment * 2 + 1 ] ) ? 1 : 0;
+            }
+        }
+
+        for ( u32 v = 0; v < vertices_per_sphere; ++v ) {
+            const DebugLineVertex& scalar = vertices[ v ];
+            const DebugLineVertex& simd = simd_vertices[ s * vertices_per_sphere + v ];
+            max_difference = raptor::max( max_difference, distance( scalar.position, simd.position ) );
+            errors += scalar.color == simd.color ? 0 : 1;
+        }
+    }
+    RCHECK( errors == 0 );
+    RCHECK( max_difference < 1e-4f );
+
+    free( simd_vertices );
+    free( scalar_vertices );
+}
+
+// Commands of the threads expanded one after the other, lines, then boxes, then spheres, only whole primitives.
+RTEST( debug_draw_commands ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    DebugDraw draw;
+    draw.init( allocator, 2, 4, 4, 4, 4 );
+
+    draw.aabb( 1, { 0, 0, 0 }, { 1, 1, 1 }, { Color::red } );
+    draw.sphere( 0, { 0, 0, 0 }, 1.f, { Color::blue } );
+    draw.line( 1, { 0, 0, 0 }, { 1, 0, 0 }, { Color::white }, { Color::black } );
+    draw.line( 0, { 2, 0, 0 }, { 3, 0, 0 }, { Color::yellow }, { Color::yellow } );
+    draw.aabb( 0, { 2, 2, 2 }, { 3, 3, 3 }, { Color::green } );
+    draw.line_2d( 1, { 0.5f, 0.25f }, { -1.f, 1.f }, { Color::red } );
+
+    const u32 expected_lines = 2 + 2 * k_debug_draw_lines_per_aabb + k_debug_draw_lines_per_sphere;
+    RCHECK( draw.count_lines() == expected_lines && draw.count_lines_2d() == 1 );
+
+    DebugLineVertex vertices[ expected_lines * 2 ];
+    RCHECK( draw.expand_lines( vertices, expected_lines ) == expected_lines );
+    RCHECK( vertices[ 0 ].position.x == 2.f && vertices[ 0 ].color == Color::yellow );
+    RCHECK( vertices[ 2 ].position.x == 0.f && vertices[ 2 ].color == Color::white && vertices[ 3 ].color == Color::black );
+    RCHECK( vertices[ 4 ].color == Color::green && vertices[ 4 + k_debug_draw_lines_per_aabb * 2 ].color == Color::red );
+    RCHECK( vertices[ 4 + k_debug_draw_lines_per_aabb * 4 ].color == Color::blue && vertices[ expected_lines * 2 - 1 ].color == Color::blue );
+
+    // The sphere does not fit, the boxes do.
+    RCHECK( draw.expand_lines( vertices, expected_lines - 1 ) == 2 + 2 * k_debug_draw_lines_per_aabb );
+    RCHECK( draw.expand_lines( vertices, 2 + k_debug_draw_lines_per_aabb + 1 ) == 2 + k_debug_draw_lines_per_aabb );
+
+    DebugLineVertex vertices_2d[ 2 ];
+    RCHECK( draw.expand_lines_2d( vertices_2d, 1 ) == 1 );
+    RCHECK( vertices_2d[ 0 ].position.x == 0.5f && vertices_2d[ 0 ].position.y == 0.25f && vertices_2d[ 0 ].position.z == 0.f && vertices_2d[ 1 ].position.x == -1.f );
+
+    // Over the capacity of the thread.
+    for ( u32 i = 0; i < 5; ++i ) {
+        draw.sphere( 1, { 0, 0, 0 }, 1.f, { Color::blue } );
+    }
+    RCHECK( draw.dropped_commands() == 1 && draw.thread_commands[ 0 ].spheres.size == 1 );
+
+    draw.clear();
+    RCHECK( draw.count_lines() == 0 && draw.count_lines_2d() == 0 && draw.expand_lines( vertices, expected_lines ) == 0 );
+
+    draw.shutdown();
+}
+
+//
+// Boxes added from the tasks, each with the enkiTS thread number.
+struct DebugDrawTask : public enki::ITaskSet {
+
+    void                            ExecuteRange( enki::TaskSetPartition range, uint32_t thread_num ) override;
+
+    DebugDraw*                      draw                    = nullptr;
+
+}; // struct DebugDrawTask
+
+void DebugDrawTask::ExecuteRange( enki::TaskSetPartition range, uint32_t thread_num ) {
+    for ( u32 i = range.start; i < range.end; ++i ) {
+        const f32 x = ( f32 )i;
+        draw->aabb( thread_num, { x, 0, 0 }, { x + 0.5f, 1, 1 }, { i } );
+    }
+}
+
+RTEST( debug_draw_threads ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize( 4 );
+
+    DebugDraw draw;
+    draw.init( allocator, task_scheduler.GetNumTaskThreads(), 16, 4096, 16, 16 );
+
+    DebugDrawTask task;
+    task.draw = &draw;
+    task.m_SetSize = 4096;
+    task.m_MinRange = 16;
+    task_scheduler.AddTaskSetToPipe( &task );
+    task_scheduler.WaitforTask( &task );
+
+    RCHECK( draw.dropped_commands() == 0 && draw.count_lines() == 4096 * k_debug_draw_lines_per_aabb );
+
+    // Every box once, whatever thread added it.
+    const u32 num_lines = draw.count_lines();
+    DebugLineVertex* vertices = ( DebugLineVertex* )malloc( sizeof( DebugLineVertex ) * num_lines * 2 );
+    RCHECK( draw.expand_lines( vertices, num_lines ) == num_lines );
+
+    u8* seen = ( u8* )calloc( 4096, 1 );
+    u32 errors = 0;
+    for ( u32 a = 0; a < 4096; ++a ) {
+        const DebugLineVertex& first = vertices[ a * k_debug_draw_lines_per_aabb * 2 ];
+        errors += first.color < 4096 && first.position.x == ( f32 )first.color ? 0 : 1;
+        seen[ first.color & 4095 ] += 1;
+    }
+    for ( u32 a = 0; a < 4096; ++a ) {
+        errors += seen[ a ] == 1 ? 0 : 1;
+    }
+    RCHECK( errors == 0 );
+
+    free( seen );
+    free( vertices );
+    draw.shutdown();
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+// Space is reused only once the frame using it is retired, allocations of a frame are contiguous.
+RTEST( debug_draw_ring ) {
+    DebugDrawRing ring;
+    ring.init( 1024, 32 );
+
+    RCHECK( ring.allocate( 100, 1 ) == 0 && ring.head == 128 );
+    RCHECK( ring.allocate( 200, 1 ) == 128 && ring.frame_count == 1 && ring.frames[ 0 ].size == 352 );
+    RCHECK( ring.allocate( 512, 2 ) == 352 && ring.frame_count == 2 && ring.used == 864 );
+
+    // Frames 1 and 2 in flight: nothing fits.
+    RCHECK( ring.allocate( 256, 3 ) == u32_max && ring.failed_allocations == 1 && ring.frame_count == 2 );
+
+    // The start of the buffer is back, the end is skipped.
+    ring.retire( 1 );
+    RCHECK( ring.tail == 352 && ring.used == 512 );
+    RCHECK( ring.allocate( 256, 3 ) == 0 && ring.wraps == 1 && ring.used == 512 + 160 + 256 );
+    RCHECK( ring.allocate( 96, 3 ) == 256 && ring.allocate( 32, 3 ) == u32_max );
+
+    // The skipped end comes back with frame 3.
+    ring.retire( 2 );
+    RCHECK( ring.tail == 864 && ring.used == 512 );
+    RCHECK( ring.allocate( 480, 4 ) == 352 && ring.head == 832 );
+    ring.retire( 4 );
+    RCHECK( ring.used == 0 && ring.head == 0 && ring.tail == 0 && ring.frame_count == 0 );
+
+    // Full buffer.
+    RCHECK( ring.allocate( 1024, 5 ) == 0 && ring.allocate( 32, 5 ) == u32_max );
+    ring.retire( 5 );
+    RCHECK( ring.peak_used == 1024 );
+
+    // More frames than tracked.
+    for ( u32 f = 0; f < k_debug_draw_ring_max_frames; ++f ) {
+        RCHECK( ring.allocate( 32, 10 + f ) != u32_max );
+    }
+    RCHECK( ring.allocate( 32, 100 ) == u32_max && ring.allocate( 32, 10 + k_debug_draw_ring_max_frames - 1 ) != u32_max );
+}
+
+// Primitives per ms of the expansion, SIMD and scalar, and of recording from the task threads.
+RBENCHMARK( debug_draw_benchmark ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize();
+
+    const u32 num_primitives = 64 * 1024;
+    DebugDraw draw;
+    draw.init( allocator, task_scheduler.GetNumTaskThreads(), 16, num_primitives, num_primitives, 16 );
+
+    DebugDrawTask task;
+    task.draw = &draw;
+    task.m_SetSize = num_primitives;
+    task.m_MinRange = 256;
+
+    i64 start = time_now();
+    task_scheduler.AddTaskSetToPipe( &task );
+    task_scheduler.WaitforTask( &task );
+    const f64 record_ms = time_from_milliseconds( start );
+    rprint( "%u task threads, record %u boxes: %.0f per ms\n", task_scheduler.GetNumTaskThreads(), num_primitives, num_primitives / record_ms );
+    draw.clear();
+
+    srand( 7 );
+    DebugAabbCommand* aabbs = ( DebugAabbCommand* )malloc( sizeof( DebugAabbCommand ) * num_primitives );
+    DebugSphereCommand* spheres = ( DebugSphereCommand* )malloc( sizeof( DebugSphereCommand ) * num_primitives );
+    for ( u32 i = 0; i < num_primitives; ++i ) {
+        const vec3s center = { random_f32( -100, 100 ), random_f32( -100, 100 ), random_f32( -100, 100 ) };
+        aabbs[ i ] = { center, ( u32 )rand(), { center.x + 1.f, center.y + 2.f, center.z + 3.f }, 0 };
+        spheres[ i ] = { center, random_f32( 0.1f, 10.f ), ( u32 )rand() };
+    }
+
+    DebugLineVertex* vertices = ( DebugLineVertex* )malloc( sizeof( DebugLineVertex ) * num_primitives * k_debug_draw_lines_per_sphere * 2 );
+    const u32 repeats = 4;
+
+    for ( u32 simd = 0; simd < 2; ++simd ) {
+        start = time_now();
+        for ( u32 r = 0; r < repeats; ++r ) {
+            debug_draw_expand_aabbs( aabbs, num_primitives, vertices, simd == 1 );
+        }
+        const f64 aabbs_ms = time_from_milliseconds( start ) / repeats;
+
+        start = time_now();
+        for ( u32 r = 0; r < repeats; ++r ) {
+            debug_draw_expand_spheres( spheres, num_primitives, vertices, simd == 1 );
+        }
+        const f64 spheres_ms = time_from_milliseconds( start ) / repeats;
+
+        rprint( "%-6s boxes %8.0f per ms (%.2f ms), spheres %7.0f per ms (%.2f ms)\n", simd ? "simd" : "scalar", num_primitives / aabbs_ms, aabbs_ms,
+                num_primitives / spheres_ms, spheres_ms );
+    }
+
+    free( vertices );
+    free( spheres );
+    free( aabbs );
+    draw.shutdown();
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+} // namespace raptor
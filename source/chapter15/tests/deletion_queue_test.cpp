@@ -0,0 +1,187 @@
+#include "graphics/deletion_queue.hpp"
+
+#include "foundation/memory.hpp"
+
+#include "tests/test.hpp"
+
+#include <stdlib.h>
+
+namespace raptor {
+
+//
+// Stands in for the gpu: the timeline value it reached and the resources destroyed so far.
+struct FakeTimeline {
+
+    void                            init( u32 max_handles );
+    void                            shutdown();
+
+    Array<u64>                      safe_values;        // Per handle, the value it was enqueued with.
+    Array<u8>                       destroyed;          // Per handle, number of times it was destroyed.
+    Array<ResourceUpdateType::Enum> destroyed_types;    // In destruction order.
+
+    u64                             completed_value     = 0;
+    u32                             early_destructions  = 0;
+
+}; // struct FakeTimeline
+
+void FakeTimeline::init( u32 max_handles ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+    safe_values.init( allocator, max_handles, max_handles );
+    destroyed.init( allocator, max_handles, max_handles );
+    destroyed_types.init( allocator, 16 );
+    for ( u32 h = 0; h < max_handles; ++h ) {
+        safe_values[ h ] = 0;
+        destroyed[ h ] = 0;
+    }
+    completed_value = 0;
+    early_destructions = 0;
+}
+
+void FakeTimeline::shutdown() {
+    safe_values.shutdown();
+    destroyed.shutdown();
+    destroyed_types.shutdown();
+}
+
+static void fake_destroy_callback( void* context, ResourceUpdateType::Enum type, const u32* handles, u32 count ) {
+    FakeTimeline* timeline = ( FakeTimeline* )context;
+    for ( u32 i = 0; i < count; ++i ) {
+        const u32 handle = handles[ i ];
+        ++timeline->destroyed[ handle ];
+        timeline->early_destructions += timeline->safe_values[ handle ] > timeline->completed_value ? 1 : 0;
+        timeline->destroyed_types.push( type );
+    }
+}
+
+static void fake_enqueue( DeletionQueue& queue, FakeTimeline& timeline, ResourceUpdateType::Enum type, u32 handle, u64 timeline_value ) {
+    timeline.safe_values[ handle ] = timeline_value;
+    queue.enqueue( type, handle, timeline_value );
+}
+
+static u32 fake_collect( DeletionQueue& queue, FakeTimeline& timeline, u64 completed_value ) {
+    timeline.completed_value = completed_value;
+    return queue.collect( completed_value, fake_destroy_callback, &timeline );
+}
+
+RTEST( deletion_queue_waits_for_the_timeline ) {
+    DeletionQueue queue;
+    queue.init( &MemoryService::instance()->system_allocator, 4 );
+    FakeTimeline timeline;
+    timeline.init( 64 );
+
+    // Same values as GpuDevice: resources of frame f are freed with f + 1, safe once the gpu completed it.
+    const u32 max_frames = 3;
+    u32 next_handle = 0;
+    for ( u64 absolute_frame = 0; absolute_frame < 12; ++absolute_frame ) {
+        const u64 completed = absolute_frame >= max_frames ? absolute_frame - ( max_frames - 1 ) : 0;
+        fake_collect( queue, timeline, completed );
+
+        for ( u32 r = 0; r < 4; ++r ) {
+            fake_enqueue( queue, timeline, ( ResourceUpdateType::Enum )( r % ResourceUpdateType::Count ), next_handle++, absolute_frame + 1 );
+        }
+
+        // The resources of the frames in flight are all alive.
+        for ( u32 h = 0; h < next_handle; ++h ) {
+            RCHECK( timeline.destroyed[ h ] == ( timeline.safe_values[ h ] <= completed ? 1 : 0 ) );
+        }
+    }
+    RCHECK( queue.pending() == 4 * max_frames );
+    RCHECK( queue.stats.bucket_conflicts == 0 && queue.buckets.size == k_deletion_queue_buckets );
+
+    // Already completed values wait for the next value the gpu completes.
+    const u64 completed = timeline.completed_value;
+    fake_enqueue( queue, timeline, ResourceUpdateType::Buffer, next_handle++, 1 );
+    fake_collect( queue, timeline, completed );
+    RCHECK( timeline.destroyed[ next_handle - 1 ] == 0 );
+    RCHECK( fake_collect( queue, timeline, completed + 1 ) == 4 + 1 );
+    RCHECK( timeline.destroyed[ next_handle - 1 ] == 1 );
+
+    RCHECK( fake_collect( queue, timeline, u64_max ) == 4 * ( max_frames - 1 ) );
+    RCHECK( queue.pending() == 0 && queue.stats.destroyed == next_handle && timeline.early_destructions == 0 );
+
+    timeline.shutdown();
+    queue.shutdown();
+}
+
+RTEST( deletion_queue_destruction_order ) {
+    DeletionQueue queue;
+    queue.init( &MemoryService::instance()->system_allocator, 4 );
+    FakeTimeline timeline;
+    timeline.init( 16 );
+
+    // Resources that reference others are destroyed first, across all the completed values.
+    fake_enqueue( queue, timeline, ResourceUpdateType::Buffer, 0, 1 );
+    fake_enqueue( queue, timeline, ResourceUpdateType::Texture, 1, 2 );
+    fake_enqueue( queue, timeline, ResourceUpdateType::DescriptorSet, 2, 2 );
+    fake_enqueue( queue, timeline, ResourceUpdateType::TextureView, 3, 1 );
+    fake_enqueue( queue, timeline, ResourceUpdateType::Pipeline, 4, 1 );
+    fake_enqueue( queue, timeline, ResourceUpdateType::DescriptorSet, 5, 3 );
+
+    RCHECK( fake_collect( queue, timeline, 2 ) == 5 );
+    const ResourceUpdateType::Enum expected[] = { ResourceUpdateType::DescriptorSet, ResourceUpdateType::Pipeline, ResourceUpdateType::TextureView,
+                                                  ResourceUpdateType::Texture, ResourceUpdateType::Buffer };
+    RCHECK( timeline.destroyed_types.size == ArraySize( expected ) );
+    for ( u32 i = 0; i < timeline.destroyed_types.size && i < ArraySize( expected ); ++i ) {
+        RCHECK( timeline.destroyed_types[ i ] == expected[ i ] );
+    }
+    RCHECK( timeline.destroyed[ 5 ] == 0 );
+
+    fake_collect( queue, timeline, 3 );
+    RCHECK( timeline.destroyed[ 5 ] == 1 && queue.pending() == 0 );
+
+    timeline.shutdown();
+    queue.shutdown();
+}
+
+RTEST( deletion_queue_ring_conflicts ) {
+    DeletionQueue queue;
+    queue.init( &MemoryService::instance()->system_allocator, 4 );
+    FakeTimeline timeline;
+    timeline.init( 256 );
+
+    // Values 8 apart share a ring slot: the later one must not be destroyed with the earlier one.
+    fake_enqueue( queue, timeline, ResourceUpdateType::Texture, 0, 2 );
+    fake_enqueue( queue, timeline, ResourceUpdateType::Texture, 1, 2 + k_deletion_queue_buckets );
+    RCHECK( queue.stats.bucket_conflicts == 1 );
+    fake_collect( queue, timeline, 2 );
+    RCHECK( timeline.destroyed[ 0 ] == 1 && timeline.destroyed[ 1 ] == 0 );
+
+    // More pending values than buckets, e.g. page pools kept for more frames: the ring grows.
+    for ( u32 v = 0; v < 3 * k_deletion_queue_buckets; ++v ) {
+        fake_enqueue( queue, timeline, ResourceUpdateType::Buffer, 2 + v, 3 + v );
+    }
+    RCHECK( queue.buckets.size > k_deletion_queue_buckets );
+    for ( u64 completed = 3; completed < 3 + 3 * k_deletion_queue_buckets; ++completed ) {
+        fake_collect( queue, timeline, completed );
+        for ( u32 h = 0; h < 2 + 3 * k_deletion_queue_buckets; ++h ) {
+            RCHECK( timeline.destroyed[ h ] == ( timeline.safe_values[ h ] <= completed ? 1 : 0 ) );
+        }
+    }
+    RCHECK( timeline.early_destructions == 0 && queue.pending() == 0 );
+
+    // Random values in a window larger than the ring, with the gpu catching up randomly.
+    srand( 33 );
+    u64 gpu_value = timeline.completed_value;
+    u32 next_handle = 100;
+    while ( next_handle < 256 ) {
+        const u64 value = gpu_value + 1 + rand() % ( 2 * k_deletion_queue_buckets );
+        fake_enqueue( queue, timeline, ( ResourceUpdateType::Enum )( rand() % ResourceUpdateType::Count ), next_handle++, value );
+        if ( rand() % 4 == 0 ) {
+            gpu_value += rand() % 3;
+            fake_collect( queue, timeline, gpu_value );
+        }
+    }
+    fake_collect( queue, timeline, u64_max );
+
+    u32 destroyed_once = 0;
+    for ( u32 h = 0; h < 256; ++h ) {
+        destroyed_once += timeline.destroyed[ h ] == 1 ? 1 : 0;
+    }
+    RCHECK( destroyed_once == 2 + 3 * k_deletion_queue_buckets + ( 256 - 100 ) );
+    RCHECK( timeline.early_destructions == 0 && queue.pending() == 0 );
+
+    timeline.shutdown();
+    queue.shutdown();
+}
+
+} // namespace raptor
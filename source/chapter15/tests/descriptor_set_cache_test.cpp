@@ -0,0 +1,224 @@
+#include "graphics/descriptor_set_cache.hpp"
+
+#include "foundation/array.hpp"
+#include "foundation/memory.hpp"
+
+#include "tests/test.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace raptor {
+
+static const u32                    k_mock_max_resources = 4;
+
+//
+// Content of a set as the device keeps it.
+struct MockDescriptorSet {
+
+    u32                             resources[ k_mock_max_resources ];
+    u32                             samplers[ k_mock_max_resources ];
+    u16                             bindings[ k_mock_max_resources ];
+    u64                             layout;
+    u32                             num_resources;
+
+    DescriptorSetKey                key() const;
+
+}; // struct MockDescriptorSet
+
+DescriptorSetKey MockDescriptorSet::key() const {
+    DescriptorSetKey key;
+    key.resources = resources;
+    key.samplers = samplers;
+    key.bindings = bindings;
+    key.layout = layout;
+    key.num_resources = num_resources;
+    return key;
+}
+
+static MockDescriptorSet mock_set( u64 layout, u32 num_resources, u32 first_resource ) {
+    MockDescriptorSet set{ };
+    set.layout = layout;
+    set.num_resources = num_resources;
+    for ( u32 r = 0; r < num_resources; ++r ) {
+        set.resources[ r ] = first_resource + r;
+        set.samplers[ r ] = u32_max;
+        set.bindings[ r ] = ( u16 )r;
+    }
+    return set;
+}
+
+// Same lookup as GpuDevice::create_descriptor_set. A forced hash replaces the real one to create collisions.
+static u32 mock_create( DescriptorSetCache& cache, Array<MockDescriptorSet>& sets, const MockDescriptorSet& content, u64 forced_hash = 0 ) {
+    const DescriptorSetKey key = content.key();
+    const u64 hash = forced_hash ? forced_hash : descriptor_set_key_hash( key );
+
+    const u32 cached_index = cache.find( hash );
+    if ( cached_index != u32_max ) {
+        if ( descriptor_set_key_equals( key, sets[ cached_index ].key() ) ) {
+            ++cache.stats.hits;
+            return cached_index;
+        }
+        ++cache.stats.collisions;
+    }
+
+    const u32 index = sets.size;
+    sets.push( content );
+    ++cache.stats.allocations;
+
+    if ( cached_index == u32_max ) {
+        cache.add( hash, index );
+    }
+    return index;
+}
+
+RTEST( descriptor_set_key_compares_all_content ) {
+    MockDescriptorSet a = mock_set( 1, 3, 10 );
+    MockDescriptorSet b = a;
+    RCHECK( descriptor_set_key_equals( a.key(), b.key() ) );
+    RCHECK( descriptor_set_key_hash( a.key() ) == descriptor_set_key_hash( b.key() ) );
+
+    b.resources[ 2 ] = 99;
+    RCHECK( !descriptor_set_key_equals( a.key(), b.key() ) );
+    b = a;
+    b.samplers[ 0 ] = 5;
+    RCHECK( !descriptor_set_key_equals( a.key(), b.key() ) );
+    b = a;
+    b.bindings[ 1 ] = 7;
+    RCHECK( !descriptor_set_key_equals( a.key(), b.key() ) );
+    b = a;
+    b.layout = 2;
+    RCHECK( !descriptor_set_key_equals( a.key(), b.key() ) && descriptor_set_key_hash( a.key() ) != descriptor_set_key_hash( b.key() ) );
+    b = a;
+    b.num_resources = 2;
+    RCHECK( !descriptor_set_key_equals( a.key(), b.key() ) );
+
+    DescriptorSetKey with_acceleration_structure = a.key();
+    with_acceleration_structure.acceleration_structure = 0x1234;
+    RCHECK( !descriptor_set_key_equals( a.key(), with_acceleration_structure ) );
+
+    // 64 bit hashes of distinct keys do not repeat in practice.
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+    const u32 key_count = 200000;
+    Array<u64> hashes;
+    hashes.init( allocator, key_count, key_count );
+    for ( u32 k = 0; k < key_count; ++k ) {
+        const MockDescriptorSet set = mock_set( k % 7, 1 + k % k_mock_max_resources, k );
+        hashes[ k ] = descriptor_set_key_hash( set.key() );
+    }
+    qsort( hashes.data, key_count, sizeof( u64 ), []( const void* a, const void* b ) {
+        const u64 ha = *( const u64* )a, hb = *( const u64* )b;
+        return ha < hb ? -1 : ( ha > hb ? 1 : 0 );
+    } );
+    u32 duplicates = 0;
+    for ( u32 k = 1; k < key_count; ++k ) {
+        duplicates += hashes[ k ] == hashes[ k - 1 ] ? 1 : 0;
+    }
+    RCHECK( duplicates == 0 );
+    hashes.shutdown();
+}
+
+RTEST( descriptor_set_cache_shares_identical_sets ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    DescriptorSetCache cache;
+    cache.init( allocator, 16 );
+    Array<MockDescriptorSet> sets;
+    sets.init( allocator, 16 );
+
+    // Per mesh sets all binding the same scene buffers on three layouts.
+    u32 first_set_per_layout[ 3 ];
+    for ( u32 mesh = 0; mesh < 1000; ++mesh ) {
+        const u32 layout = mesh % 3;
+        const u32 set_index = mock_create( cache, sets, mock_set( 100 + layout, 3, 10 ) );
+        if ( mesh < 3 ) {
+            first_set_per_layout[ layout ] = set_index;
+        }
+        RCHECK( set_index == first_set_per_layout[ layout ] );
+    }
+
+    RCHECK( cache.stats.lookups == 1000 );
+    RCHECK( cache.stats.allocations == 3 && cache.stats.hits == 997 && cache.stats.collisions == 0 );
+    RCHECK( cache.sets.size == 3 );
+
+    // Different content, different sets.
+    const u32 other = mock_create( cache, sets, mock_set( 100, 3, 11 ) );
+    RCHECK( other == 3 && cache.stats.allocations == 4 );
+
+    cache.clear();
+    RCHECK( cache.find( descriptor_set_key_hash( sets[ 0 ].key() ) ) == u32_max );
+
+    sets.shutdown();
+    cache.shutdown();
+}
+
+RTEST( descriptor_set_cache_collisions ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    DescriptorSetCache cache;
+    cache.init( allocator, 16 );
+    Array<MockDescriptorSet> sets;
+    sets.init( allocator, 16 );
+
+    // Every key gets the same hash: the full comparison tells them apart, the colliding sets are not cached.
+    const u64 forced_hash = 0xabcdef;
+    const u32 first = mock_create( cache, sets, mock_set( 1, 2, 0 ), forced_hash );
+    const u32 second = mock_create( cache, sets, mock_set( 1, 2, 50 ), forced_hash );
+    const u32 third = mock_create( cache, sets, mock_set( 1, 2, 50 ), forced_hash );
+    RCHECK( first == 0 && second == 1 && third == 2 );
+    RCHECK( cache.stats.collisions == 2 && cache.stats.allocations == 3 );
+
+    RCHECK( mock_create( cache, sets, mock_set( 1, 2, 0 ), forced_hash ) == first );
+    RCHECK( cache.stats.hits == 1 );
+
+    // Destroying a colliding set leaves the cached one in place.
+    cache.remove( forced_hash, second );
+    RCHECK( cache.find( forced_hash ) == first );
+    cache.remove( forced_hash, first );
+    RCHECK( cache.find( forced_hash ) == u32_max );
+
+    sets.shutdown();
+    cache.shutdown();
+}
+
+RTEST( descriptor_set_cache_invalidation ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    DescriptorSetCache cache;
+    cache.init( allocator, 16 );
+    Array<MockDescriptorSet> sets;
+    sets.init( allocator, 64 );
+
+    for ( u32 s = 0; s < 40; ++s ) {
+        mock_create( cache, sets, mock_set( 1, 2, s * 2 ) );
+    }
+    RCHECK( cache.sets.size == 40 );
+
+    // A resized texture keeps its handle: the sets referencing it are not shared anymore.
+    const u32 resized = 31;
+    const u32 removed = cache.remove_if( [ & ]( u32 set_index ) {
+        const MockDescriptorSet& set = sets[ set_index ];
+        for ( u32 r = 0; r < set.num_resources; ++r ) {
+            if ( set.resources[ r ] == resized ) {
+                return true;
+            }
+        }
+        return false;
+    } );
+    RCHECK( removed == 1 && cache.stats.invalidations == 1 && cache.sets.size == 39 );
+
+    // The same content now gets a new set, written with the new views. Everything else is still shared.
+    const u32 allocations = cache.stats.allocations;
+    RCHECK( mock_create( cache, sets, mock_set( 1, 2, 30 ) ) == 40 );
+    RCHECK( mock_create( cache, sets, mock_set( 1, 2, 32 ) ) == 16 );
+    RCHECK( cache.stats.allocations == allocations + 1 );
+
+    // Removing everything while iterating.
+    RCHECK( cache.remove_if( []( u32 ) { return true; } ) == 40 );
+    RCHECK( cache.sets.size == 0 && cache.find( descriptor_set_key_hash( sets[ 0 ].key() ) ) == u32_max );
+
+    sets.shutdown();
+    cache.shutdown();
+}
+
+} // namespace raptor
@@ -0,0 +1,342 @@
+#include "graphics/command_state_filter.hpp"
+#include "graphics/draw_sort.hpp"
+
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include <algorithm>
+#include <stdlib.h>
+
+namespace raptor {
+
+static const u32                    k_scene_draws       = 50000;
+static const u32                    k_scene_meshes      = 3000;
+static const u32                    k_scene_pipelines   = 6;
+static const u32                    k_scene_sets        = 41;
+static const u32                    k_scene_layouts     = 2;
+
+//
+// Mesh draws of a synthetic scene, the state each one needs as the render passes record it.
+struct SyntheticDraw {
+
+    u32                             mesh;
+    u32                             pipeline;
+    u32                             descriptor_set;
+    u32                             depth;
+
+}; // struct SyntheticDraw
+
+static void generate_scene( Array<SyntheticDraw>& draws ) {
+    srand( 34 );
+    for ( u32 d = 0; d < draws.size; ++d ) {
+        SyntheticDraw& draw = draws[ d ];
+        draw.mesh = rand() % k_scene_meshes;
+        // Materials decide pipeline and set, instances of a mesh share them.
+        draw.pipeline = draw.mesh % k_scene_pipelines;
+        draw.descriptor_set = ( draw.mesh * 7 ) % k_scene_sets;
+        draw.depth = draw_sort_depth( 0.1f + ( rand() % 10000 ) * 0.1f, 0.1f, 1000.0f );
+    }
+}
+
+//
+// State of a command buffer: what the filter let through is what the gpu sees.
+struct RecordedState {
+
+    u64                             pipeline            = 0;
+    u64                             pipeline_layout     = 0;
+    u64                             descriptor_set      = 0;
+    u64                             vertex_buffer       = 0;
+    u64                             vertex_offset       = 0;
+    u64                             index_buffer        = 0;
+    u64                             index_offset        = 0;
+
+    u32                             pipeline_binds      = 0;
+    u32                             descriptor_set_binds = 0;
+    u32                             vertex_buffer_binds = 0;
+    u32                             index_buffer_binds  = 0;
+    u32                             wrong_draws         = 0;    // Draws recorded with state different from the one they need.
+
+}; // struct RecordedState
+
+// Handles as the filter sees them: Vulkan objects, meshes sub-allocated in one vertex and one index buffer.
+static u64 pipeline_handle( u32 pipeline )                  { return 0x1000 + pipeline; }
+static u64 pipeline_layout_handle( u32 pipeline )           { return 0x2000 + pipeline % k_scene_layouts; }
+static u64 descriptor_set_handle( u32 descriptor_set )      { return 0x3000 + descriptor_set; }
+static u64 mesh_vertex_offset( u32 mesh )                   { return ( u64 )mesh * 4096; }
+static u64 mesh_index_offset( u32 mesh )                    { return ( u64 )mesh * 1024; }
+
+static const u64                    k_vertex_buffer     = 0x4000;
+static const u64                    k_index_buffer      = 0x5000;
+
+// Same sequence of binds as the mesh passes. Without a filter every bind is recorded.
+static void record_draws( const Array<SyntheticDraw>& draws, const u32* order, CommandStateFilter* filter, RecordedState& state ) {
+    const u32 dynamic_offsets[ 1 ] = { 0 };
+
+    if ( filter ) {
+        filter->reset();
+    }
+
+    for ( u32 d = 0; d < draws.size; ++d ) {
+        const SyntheticDraw& draw = draws[ order ? order[ d ] : d ];
+
+        const u64 pipeline = pipeline_handle( draw.pipeline );
+        const u64 layout = pipeline_layout_handle( draw.pipeline );
+        if ( !filter || filter->bind_pipeline( 0, pipeline, layout ) ) {
+            // Sets bound with another layout are lost.
+            state.descriptor_set = state.pipeline_layout == layout ? state.descriptor_set : 0;
+            state.pipeline = pipeline;
+            state.pipeline_layout = layout;
+            ++state.pipeline_binds;
+        }
+
+        const u64 descriptor_set = descriptor_set_handle( draw.descriptor_set );
+        if ( !filter || filter->bind_descriptor_set( descriptor_set, dynamic_offsets, 0 ) ) {
+            state.descriptor_set = descriptor_set;
+            ++state.descriptor_set_binds;
+        }
+
+        const u64 vertex_offset = mesh_vertex_offset( draw.mesh );
+        if ( !filter || filter->bind_vertex_buffers( 0, 1, &k_vertex_buffer, &vertex_offset ) ) {
+            state.vertex_buffer = k_vertex_buffer;
+            state.vertex_offset = vertex_offset;
+            ++state.vertex_buffer_binds;
+        }
+
+        const u64 index_offset = mesh_index_offset( draw.mesh );
+        if ( !filter || filter->bind_index_buffer( k_index_buffer, index_offset, 1 ) ) {
+            state.index_buffer = k_index_buffer;
+            state.index_offset = index_offset;
+            ++state.index_buffer_binds;
+        }
+
+        const bool correct = state.pipeline == pipeline && state.descriptor_set == descriptor_set && state.vertex_buffer == k_vertex_buffer &&
+                             state.vertex_offset == vertex_offset && state.index_buffer == k_index_buffer && state.index_offset == index_offset;
+        state.wrong_draws += correct ? 0 : 1;
+    }
+}
+
+static void build_sort_keys( const Array<SyntheticDraw>& draws, DrawSorter& sorter ) {
+    sorter.begin( draws.size );
+    for ( u32 d = 0; d < draws.size; ++d ) {
+        const SyntheticDraw& draw = draws[ d ];
+        sorter.keys[ d ] = draw_sort_key( 0, draw.pipeline, draw.descriptor_set, draw.depth, draw.mesh );
+    }
+}
+
+RTEST( draw_sort_keys_order_state_then_depth ) {
+    // Opaque: pass, pipeline and material outrank depth, depth outranks the mesh.
+    RCHECK( draw_sort_key( 0, 5, 9, 9, 9 ) < draw_sort_key( 1, 0, 0, 0, 0 ) );
+    RCHECK( draw_sort_key( 0, 1, 9, 9, 9 ) < draw_sort_key( 0, 2, 0, 0, 0 ) );
+    RCHECK( draw_sort_key( 0, 1, 1, 9, 9 ) < draw_sort_key( 0, 1, 2, 0, 0 ) );
+    RCHECK( draw_sort_key( 0, 1, 1, 1, 9 ) < draw_sort_key( 0, 1, 1, 2, 0 ) );
+
+    // Transparent: far draws first whatever their state.
+    const u32 near_depth = draw_sort_depth( 1.0f, 0.1f, 1000.0f );
+    const u32 far_depth = draw_sort_depth( 500.0f, 0.1f, 1000.0f );
+    RCHECK( near_depth < far_depth );
+    RCHECK( draw_sort_key_back_to_front( 0, 0, 0, far_depth, 0 ) < draw_sort_key_back_to_front( 0, 0, 0, near_depth, 0 ) );
+    RCHECK( draw_sort_key_back_to_front( 0, 9, 9, far_depth, 9 ) < draw_sort_key_back_to_front( 0, 0, 0, near_depth, 0 ) );
+    RCHECK( draw_sort_key_back_to_front( 0, 1, 0, near_depth, 0 ) < draw_sort_key_back_to_front( 0, 2, 0, near_depth, 0 ) );
+
+    RCHECK( draw_sort_depth( 0.0f, 0.1f, 1000.0f ) == 0 && draw_sort_depth( 2000.0f, 0.1f, 1000.0f ) == ( 1u << k_draw_key_depth_bits ) - 1 );
+}
+
+RTEST( draw_sort_radix_matches_stable_sort ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize( 8 );
+
+    const u32 counts[] = { 0, 1, 2, 255, 4097, 100000 };
+    for ( u32 c = 0; c < ArraySize( counts ); ++c ) {
+        for ( u32 parallel = 0; parallel < 2; ++parallel ) {
+            const u32 count = counts[ c ];
+
+            DrawSorter sorter;
+            sorter.init( allocator, count );
+            sorter.min_parallel_count = 1024;
+            sorter.begin( count );
+
+            // Few distinct values in some fields, so that digits are skipped and many keys are equal.
+            srand( 7 + c );
+            for ( u32 i = 0; i < count; ++i ) {
+                sorter.keys[ i ] = draw_sort_key( rand() % 3, rand() % 6, rand() % 41, rand() % 64, rand() % 8 );
+            }
+
+            Array<u64> expected;
+            expected.init( allocator, count, count );
+            Array<u32> expected_values;
+            expected_values.init( allocator, count, count );
+            for ( u32 i = 0; i < count; ++i ) {
+                expected_values[ i ] = i;
+            }
+            const u64* keys = sorter.keys.data;
+            std::stable_sort( expected_values.data, expected_values.data + count, [ keys ]( u32 a, u32 b ) { return keys[ a ] < keys[ b ]; } );
+            for ( u32 i = 0; i < count; ++i ) {
+                expected[ i ] = keys[ expected_values[ i ] ];
+            }
+
+            sorter.sort( parallel ? &task_scheduler : nullptr );
+
+            u32 mismatches = 0;
+            for ( u32 i = 0; i < count; ++i ) {
+                mismatches += sorter.keys[ i ] == expected[ i ] && sorter.values[ i ] == expected_values[ i ] ? 0 : 1;
+            }
+            RCHECK( mismatches == 0 );
+
+            expected_values.shutdown();
+            expected.shutdown();
+            sorter.shutdown();
+        }
+    }
+
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+RTEST( command_state_filter_drops_redundant_binds ) {
+    CommandStateFilter filter;
+    filter.reset();
+
+    const u32 offsets_a[ 2 ] = { 0, 256 };
+    const u32 offsets_b[ 2 ] = { 0, 512 };
+
+    RCHECK( filter.bind_pipeline( 0, 1, 10 ) && !filter.bind_pipeline( 0, 1, 10 ) );
+    // Same pipeline on another bind point is another binding.
+    RCHECK( filter.bind_pipeline( 1, 1, 10 ) );
+
+    RCHECK( filter.bind_descriptor_set( 5, offsets_a, 2 ) && !filter.bind_descriptor_set( 5, offsets_a, 2 ) );
+    RCHECK( filter.bind_descriptor_set( 5, offsets_b, 2 ) && filter.bind_descriptor_set( 5, offsets_b, 1 ) );
+    // Another pipeline with the same layout keeps the sets, another layout loses them.
+    RCHECK( filter.bind_pipeline( 1, 2, 10 ) && !filter.bind_descriptor_set( 5, offsets_b, 1 ) );
+    RCHECK( filter.bind_pipeline( 1, 3, 11 ) && filter.bind_descriptor_set( 5, offsets_b, 1 ) );
+    // Sets bound without the filter.
+    filter.invalidate_descriptor_sets();
+    RCHECK( filter.bind_descriptor_set( 5, offsets_b, 1 ) );
+    RCHECK( filter.bind_descriptor_set( 6, nullptr, 0 ) && !filter.bind_descriptor_set( 6, nullptr, 0 ) );
+
+    const u64 buffers[ 2 ] = { 100, 101 };
+    const u64 offsets[ 2 ] = { 0, 64 };
+    const u64 other_offsets[ 2 ] = { 0, 128 };
+    RCHECK( filter.bind_vertex_buffers( 0, 2, buffers, offsets ) && !filter.bind_vertex_buffers( 0, 2, buffers, offsets ) );
+    RCHECK( !filter.bind_vertex_buffers( 1, 1, buffers + 1, offsets + 1 ) );
+    RCHECK( filter.bind_vertex_buffers( 0, 2, buffers, other_offsets ) );
+    // Bindings never bound are not skipped.
+    RCHECK( filter.bind_vertex_buffers( 2, 1, buffers, offsets ) );
+
+    RCHECK( filter.bind_index_buffer( 200, 0, 1 ) && !filter.bind_index_buffer( 200, 0, 1 ) );
+    RCHECK( filter.bind_index_buffer( 200, 0, 0 ) && filter.bind_index_buffer( 200, 16, 0 ) );
+
+    // A new recording knows nothing.
+    filter.reset();
+    RCHECK( filter.bind_pipeline( 1, 3, 11 ) && filter.bind_descriptor_set( 5, offsets_b, 1 ) );
+    RCHECK( filter.bind_vertex_buffers( 0, 2, buffers, other_offsets ) && filter.bind_index_buffer( 200, 16, 0 ) );
+}
+
+RTEST( command_state_filter_50k_draws ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    Array<SyntheticDraw> draws;
+    draws.init( allocator, k_scene_draws, k_scene_draws );
+    generate_scene( draws );
+
+    // Scene order, no filter: every draw binds everything.
+    RecordedState unfiltered;
+    record_draws( draws, nullptr, nullptr, unfiltered );
+    RCHECK( unfiltered.pipeline_binds == k_scene_draws && unfiltered.descriptor_set_binds == k_scene_draws );
+    RCHECK( unfiltered.wrong_draws == 0 );
+
+    // Scene order, filter: only consecutive draws sharing state are saved.
+    CommandStateFilter filter;
+    RecordedState scene_order;
+    record_draws( draws, nullptr, &filter, scene_order );
+    RCHECK( scene_order.wrong_draws == 0 );
+    RCHECK( scene_order.pipeline_binds < k_scene_draws && scene_order.descriptor_set_binds < k_scene_draws );
+    RCHECK( filter.stats.pipeline_binds == scene_order.pipeline_binds && filter.stats.descriptor_set_binds == scene_order.descriptor_set_binds );
+    RCHECK( filter.stats.pipeline_binds + filter.stats.pipeline_skipped == k_scene_draws );
+
+    // Sorted and filtered: one bind per pipeline, one set bind per pipeline and set in use.
+    DrawSorter sorter;
+    sorter.init( allocator, k_scene_draws );
+    build_sort_keys( draws, sorter );
+    sorter.sort( nullptr );
+
+    bool used_pairs[ k_scene_pipelines ][ k_scene_sets ] = { };
+    for ( u32 d = 0; d < draws.size; ++d ) {
+        used_pairs[ draws[ d ].pipeline ][ draws[ d ].descriptor_set ] = true;
+    }
+    u32 pair_count = 0;
+    for ( u32 p = 0; p < k_scene_pipelines; ++p ) {
+        for ( u32 s = 0; s < k_scene_sets; ++s ) {
+            pair_count += used_pairs[ p ][ s ] ? 1 : 0;
+        }
+    }
+
+    filter.stats = CommandStateFilterStats();
+    RecordedState sorted;
+    record_draws( draws, sorter.values.data, &filter, sorted );
+    RCHECK( sorted.wrong_draws == 0 );
+    RCHECK( sorted.pipeline_binds == k_scene_pipelines );
+    RCHECK( sorted.descriptor_set_binds == pair_count );
+    // Mesh buffers follow the depth order inside a state, they are rebound when the mesh changes.
+    RCHECK( sorted.vertex_buffer_binds <= k_scene_draws && sorted.vertex_buffer_binds >= k_scene_meshes );
+
+    rprint( "%u draws: scene order %u pipeline / %u set binds, filtered %u / %u, sorted and filtered %u / %u\n", k_scene_draws,
+            unfiltered.pipeline_binds, unfiltered.descriptor_set_binds, scene_order.pipeline_binds, scene_order.descriptor_set_binds,
+            sorted.pipeline_binds, sorted.descriptor_set_binds );
+
+    sorter.shutdown();
+    draws.shutdown();
+}
+
+RBENCHMARK( draw_recording ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize();
+
+    Array<SyntheticDraw> draws;
+    draws.init( allocator, k_scene_draws, k_scene_draws );
+    generate_scene( draws );
+
+    DrawSorter sorter;
+    sorter.init( allocator, k_scene_draws );
+
+    const u32 frame_count = 50;
+    rprint( "%u draws, %u frames, %u task threads\n", k_scene_draws, frame_count, task_scheduler.GetNumTaskThreads() );
+
+    cstring names[ 4 ] = { "scene order", "filtered", "sorted + filtered", "parallel sort + filtered" };
+    for ( u32 mode = 0; mode < 4; ++mode ) {
+        CommandStateFilter filter;
+        RecordedState state;
+        f64 sort_ms = 0.0;
+
+        const i64 start = time_now();
+        for ( u32 frame = 0; frame < frame_count; ++frame ) {
+            const u32* order = nullptr;
+            if ( mode >= 2 ) {
+                const i64 sort_start = time_now();
+                build_sort_keys( draws, sorter );
+                sorter.sort( mode == 3 ? &task_scheduler : nullptr );
+                sort_ms += time_from_milliseconds( sort_start );
+                order = sorter.values.data;
+            }
+
+            record_draws( draws, order, mode >= 1 ? &filter : nullptr, state );
+        }
+        const f64 elapsed_ms = time_from_milliseconds( start ) / frame_count;
+        RCHECK( state.wrong_draws == 0 );
+
+        const u32 recorded = ( state.pipeline_binds + state.descriptor_set_binds + state.vertex_buffer_binds + state.index_buffer_binds ) / frame_count;
+        rprint( "%-26s %6.2f ms per frame (keys and sort %5.2f ms), %6u binds recorded per frame\n", names[ mode ], elapsed_ms, sort_ms / frame_count,
+                recorded );
+    }
+
+    sorter.shutdown();
+    draws.shutdown();
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+} // namespace raptor
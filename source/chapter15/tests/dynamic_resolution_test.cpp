@@ -0,0 +1,226 @@
+#include "graphics/dynamic_resolution.hpp"
+#include "graphics/gpu_profiler.hpp"
+
+#include "foundation/numerics.hpp"
+
+#include "tests/test.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+
+namespace raptor {
+
+static const f32                    k_target_frame_ms       = 16.6f;
+
+static f32 random_f32( f32 min_value, f32 max_value ) {
+    return min_value + ( max_value - min_value ) * ( rand() / ( f32 )RAND_MAX );
+}
+
+//
+// Synthetic GPU: the scaled passes cost scaled_full_ms * scale ^ exponent and the samples reach the controller
+// latency frames after being rendered, as the timestamps read back from the profiler.
+struct ResolutionTrace {
+
+    void                            init( DynamicResolutionController* controller, f32 fixed_ms, f32 scaled_full_ms );
+
+    // Renders a frame at the current scale and feeds the sample of an older frame. Returns the frame time.
+    f32                             step( f32 spike_ms = 0.f );
+
+    DynamicResolutionController*    controller;
+
+    f32                             fixed_ms;
+    f32                             scaled_full_ms;
+    f32                             exponent                = 2.f;
+    f32                             noise                   = 0.1f;
+
+    f32                             frame_times[ 4 ];
+    f32                             scaled_times[ 4 ];
+    u32                             frame                   = 0;
+
+    u32                             changes                 = 0;
+    u32                             reversals               = 0;    // Changes in the opposite direction of the previous one.
+    i32                             last_direction          = 0;
+
+}; // struct ResolutionTrace
+
+void ResolutionTrace::init( DynamicResolutionController* controller_, f32 fixed_ms_, f32 scaled_full_ms_ ) {
+    controller = controller_;
+    fixed_ms = fixed_ms_;
+    scaled_full_ms = scaled_full_ms_;
+    controller->init( 0.25f, 1.0f, k_target_frame_ms );
+    srand( 11 );
+}
+
+f32 ResolutionTrace::step( f32 spike_ms ) {
+    const u32 latency = ArraySize( frame_times ) - 1;
+    const f32 jitter = 1.0f + random_f32( -noise, noise ) * 0.5f;
+    const f32 scaled_ms = scaled_full_ms * powf( controller->scale, exponent ) * jitter;
+
+    const u32 slot = frame % ArraySize( frame_times );
+    scaled_times[ slot ] = scaled_ms;
+    frame_times[ slot ] = fixed_ms * jitter + scaled_ms + spike_ms;
+    ++frame;
+
+    if ( frame <= latency ) {
+        return frame_times[ slot ];
+    }
+
+    const f32 previous_scale = controller->scale;
+    const u32 sample = ( frame - 1 - latency ) % ArraySize( frame_times );
+    if ( controller->update( frame_times[ sample ], scaled_times[ sample ] ) ) {
+        const i32 direction = controller->scale > previous_scale ? 1 : -1;
+        reversals += last_direction && direction != last_direction ? 1 : 0;
+        last_direction = direction;
+        ++changes;
+    }
+    return frame_times[ slot ];
+}
+
+RTEST( dynamic_resolution_quantize ) {
+    DynamicResolutionController controller;
+    controller.init( 0.25f, 1.0f, k_target_frame_ms );
+    RCHECK( controller.scale == 1.0f );
+
+    RCHECK( controller.quantize( 0.5f ) == 0.5f && controller.quantize( 0.51f ) == 0.5f && controller.quantize( 0.52f ) == 0.53125f );
+    RCHECK( controller.quantize( 0.1f ) == 0.25f && controller.quantize( 2.0f ) == 1.0f );
+    controller.scale_step = 0.f;
+    RCHECK( controller.quantize( 0.51f ) == 0.51f );
+
+    controller.reset( 0.1f );
+    RCHECK( controller.scale == 0.25f && controller.stats.samples == 0 );
+
+    // Nothing measured: no change.
+    RCHECK( !controller.update( 0.f, 0.f ) && controller.stats.samples == 0 );
+}
+
+// Frame time from the root queries, scaled time from the registered passes at any depth.
+RTEST( dynamic_resolution_timestamps ) {
+    DynamicResolutionController controller;
+    controller.init( 0.25f, 1.0f, k_target_frame_ms );
+    controller.add_scaled_pass( "reflections_pass" );
+    controller.add_scaled_pass( "svgf_wavelet_pass" );
+    controller.latency_frames = 0;
+
+    GPUTimeQuery timestamps[ 5 ] = { };
+    const cstring names[] = { "gbuffer_pass", "reflections_pass", "svgf_wavelet_pass", "frame", nullptr };
+    const f64 times[] = { 4.0, 3.0, 2.0, 1.0, 0.5 };
+    const u16 depths[] = { 0, 0, 1, 0, 0 };
+    for ( u32 t = 0; t < ArraySize( timestamps ); ++t ) {
+        timestamps[ t ].name = names[ t ];
+        timestamps[ t ].elapsed_ms = times[ t ];
+        timestamps[ t ].depth = depths[ t ];
+    }
+
+    controller.update( timestamps, ArraySize( timestamps ) );
+    RCHECK( controller.stats.frame_ms == 8.5f && controller.stats.scaled_ms == 5.0f );
+    RCHECK( controller.stats.fixed_ms == 3.5f && controller.stats.full_scale_ms == 5.0f && controller.stats.samples == 1 );
+}
+
+// A heavier scene: the scale goes down in a few frames and stays there.
+RTEST( dynamic_resolution_step_up ) {
+    DynamicResolutionController controller;
+    ResolutionTrace trace;
+    trace.init( &controller, 6.0f, 8.0f );
+
+    for ( u32 f = 0; f < 60; ++f ) {
+        trace.step();
+    }
+    RCHECK( controller.scale == 1.0f && trace.changes == 0 );
+
+    // Scaled passes 2.5 times slower: 26 ms at full scale.
+    trace.scaled_full_ms = 20.0f;
+    u32 frames_over = 0;
+    u32 last_over = 0;
+    for ( u32 f = 0; f < 200; ++f ) {
+        const f32 frame_ms = trace.step();
+        if ( frame_ms > k_target_frame_ms * 1.1f ) {
+            ++frames_over;
+            last_over = f;
+        }
+    }
+    RCHECK( trace.changes >= 1 && trace.changes <= 3 && trace.reversals == 0 );
+    RCHECK( last_over < 10 && frames_over < 10 );
+    RCHECK( controller.scale < 0.75f && controller.stats.emergency_changes >= 1 );
+    RCHECK( fabsf( controller.stats.filtered_frame_ms - k_target_frame_ms ) < k_target_frame_ms * 0.1f );
+}
+
+// A lighter scene: the scale goes up once, after the hold, without overshooting the target.
+RTEST( dynamic_resolution_step_down ) {
+    DynamicResolutionController controller;
+    ResolutionTrace trace;
+    trace.init( &controller, 6.0f, 20.0f );
+    controller.reset( 0.5f );
+
+    for ( u32 f = 0; f < 100; ++f ) {
+        trace.step();
+    }
+    const f32 settled_scale = controller.scale;
+    const u32 settled_changes = trace.changes;
+
+    trace.scaled_full_ms = 8.0f;
+    u32 first_raise = 0;
+    f32 max_frame_ms = 0.f;
+    for ( u32 f = 0; f < 300; ++f ) {
+        const u32 changes = trace.changes;
+        max_frame_ms = raptor::max( max_frame_ms, trace.step() );
+        if ( trace.changes != changes && first_raise == 0 ) {
+            first_raise = f + 1;
+        }
+    }
+    RCHECK( controller.scale > settled_scale && trace.changes - settled_changes == 1 && trace.reversals == 0 );
+    RCHECK( first_raise >= controller.raise_cooldown_frames );
+    RCHECK( max_frame_ms < k_target_frame_ms * 1.1f );
+}
+
+// Isolated hitches do not touch the scale, sustained ones do.
+RTEST( dynamic_resolution_spikes ) {
+    DynamicResolutionController controller;
+    ResolutionTrace trace;
+    trace.init( &controller, 6.0f, 8.0f );
+
+    for ( u32 f = 0; f < 500; ++f ) {
+        trace.step( f % 50 == 25 ? 30.0f : 0.f );
+    }
+    RCHECK( trace.changes == 0 && controller.stats.rejected_samples >= 9 );
+
+    for ( u32 f = 0; f < 10; ++f ) {
+        trace.step( 30.0f );
+    }
+    RCHECK( trace.changes >= 1 && controller.scale < 1.0f );
+}
+
+// Slowly growing cost: the frame time follows the target without large excursions.
+RTEST( dynamic_resolution_ramp ) {
+    DynamicResolutionController controller;
+    ResolutionTrace trace;
+    trace.init( &controller, 6.0f, 6.0f );
+
+    f32 max_frame_ms = 0.f;
+    for ( u32 f = 0; f < 600; ++f ) {
+        trace.scaled_full_ms = 6.0f + f * 0.03f;
+        const f32 frame_ms = trace.step();
+        max_frame_ms = f > 10 ? raptor::max( max_frame_ms, frame_ms ) : max_frame_ms;
+    }
+    RCHECK( max_frame_ms < k_target_frame_ms * 1.2f && controller.scale < 0.75f && trace.reversals <= 1 );
+}
+
+// Cost linear in the scale instead of quadratic: the integral term corrects the model without oscillating.
+RTEST( dynamic_resolution_wrong_model ) {
+    DynamicResolutionController controller;
+    ResolutionTrace trace;
+    trace.init( &controller, 6.0f, 20.0f );
+    trace.exponent = 1.0f;
+
+    u32 converged_frame = 0;
+    for ( u32 f = 0; f < 300; ++f ) {
+        trace.step();
+        const f32 error = fabsf( controller.stats.filtered_frame_ms - k_target_frame_ms ) / k_target_frame_ms;
+        if ( error > controller.dead_band * 2.f ) {
+            converged_frame = f + 1;
+        }
+    }
+    RCHECK( converged_frame < 60 && trace.reversals == 0 );
+    RCHECK( fabsf( controller.scale - ( k_target_frame_ms - 6.0f ) / 20.0f ) < 0.1f );
+}
+
+} // namespace raptor
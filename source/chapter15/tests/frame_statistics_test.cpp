@@ -0,0 +1,233 @@
+#include "graphics/frame_statistics.hpp"
+
+#include "foundation/file.hpp"
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include "external/enkiTS/TaskScheduler.h"
+#include "external/json.hpp"
+
+#include <math.h>
+#include <string.h>
+
+namespace raptor {
+
+static i64 ticks_from_milliseconds( f64 ms ) {
+    return ( i64 )( ms / time_milliseconds( 1 ) + 0.5 );
+}
+
+// A frame where the main thread runs the phases with the given times and the present wait is the rest.
+static void add_frame( FrameStatistics& frame_statistics, f32 frame_ms, f32 gpu_ms, f32 upload_ms, f32 recording_ms ) {
+    frame_statistics.add_phase_time( 0, FramePhase::Upload, ticks_from_milliseconds( upload_ms ) );
+    frame_statistics.add_phase_time( 0, FramePhase::Recording, ticks_from_milliseconds( recording_ms ) );
+    frame_statistics.add_phase_time( 0, FramePhase::PresentWait, ticks_from_milliseconds( frame_ms - upload_ms - recording_ms ) );
+    frame_statistics.end_frame( frame_ms, gpu_ms );
+}
+
+// Percentiles and histogram of the history, phases summed over the threads.
+RTEST( frame_statistics_summary ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    FrameStatistics frame_statistics;
+    frame_statistics.init( allocator, 100, 4 );
+
+    // 10 to 19 ms, 10 frames each. Recording is split on 3 threads, present wait only on even frames.
+    for ( u32 f = 0; f < 150; ++f ) {
+        for ( u32 t = 1; t < 4; ++t ) {
+            frame_statistics.add_phase_time( t, FramePhase::Recording, ticks_from_milliseconds( 1.0 ) );
+        }
+        frame_statistics.add_phase_time( 0, FramePhase::PresentWait, ticks_from_milliseconds( f % 2 ? 0.0 : 2.0 ) );
+        frame_statistics.end_frame( 10.f + f % 10, 8.f );
+    }
+    RCHECK( frame_statistics.history_count == 100 && frame_statistics.get_frame( 0 ).frame_number == 50 );
+
+    FrameStatisticsSummary summary;
+    frame_statistics.compute_summary( summary );
+    RCHECK( summary.frames == 100 && summary.frame_min_ms == 10.f && summary.frame_max_ms == 19.f && summary.frame_average_ms == 14.5f );
+    RCHECK( summary.frame_p50_ms == 14.f && summary.frame_p95_ms == 19.f && summary.frame_p99_ms == 19.f );
+    RCHECK( summary.phase_average_ms[ FramePhase::Recording ] == 3.f && summary.phase_p99_ms[ FramePhase::Recording ] == 3.f );
+    RCHECK( summary.phase_average_ms[ FramePhase::PresentWait ] == 1.f && summary.phase_p95_ms[ FramePhase::PresentWait ] == 2.f );
+    RCHECK( summary.gpu_bound_frames == 50 && summary.cpu_bound_frames == 50 && summary.gpu_average_ms == 8.f && summary.cpu_busy_average_ms == 13.5f );
+
+    // The histogram counts every frame since the reset, not only the history.
+    u32 histogram_frames = 0;
+    for ( u32 b = 0; b < k_frame_statistics_histogram_buckets; ++b ) {
+        histogram_frames += frame_statistics.histogram[ b ];
+    }
+    RCHECK( histogram_frames == 150 && frame_statistics.histogram[ 20 ] == 15 && frame_statistics.histogram[ 38 ] == 15 );
+
+    frame_statistics.reset();
+    frame_statistics.compute_summary( summary );
+    RCHECK( summary.frames == 0 && frame_statistics.histogram[ 20 ] == 0 );
+
+    // CPU and GPU in parallel: the frame lasts as the slowest.
+    frame_statistics.end_frame( 10.f, 10.f );
+    frame_statistics.compute_summary( summary );
+    RCHECK( summary.overlap == 1.f );
+
+    // Serialized: the frame is the sum of the two.
+    frame_statistics.reset();
+    frame_statistics.add_phase_time( 0, FramePhase::PresentWait, ticks_from_milliseconds( 4.0 ) );
+    frame_statistics.end_frame( 10.f, 4.f );
+    frame_statistics.compute_summary( summary );
+    RCHECK( summary.overlap == 0.f && summary.cpu_busy_average_ms == 6.f && summary.gpu_bound_frames == 1 );
+
+    frame_statistics.shutdown();
+}
+
+// Slow frames are attributed to the phase that grew, and stay out of the filtered times.
+RTEST( frame_statistics_hitches ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    FrameStatistics frame_statistics;
+    frame_statistics.init( allocator, 64, 1 );
+
+    // No detection during the warmup.
+    add_frame( frame_statistics, 16.f, 12.f, 2.f, 4.f );
+    add_frame( frame_statistics, 60.f, 12.f, 2.f, 50.f );
+    for ( u32 f = 0; f < 50; ++f ) {
+        add_frame( frame_statistics, 16.f, 12.f, 2.f, 4.f );
+    }
+    RCHECK( frame_statistics.hitch_count == 0 );
+    const f32 filtered_frame_ms = frame_statistics.filtered_frame_ms;
+    RCHECK( fabsf( filtered_frame_ms - 16.f ) < 1.f );
+
+    // Under the ratio or the minimum delta.
+    add_frame( frame_statistics, 22.f, 12.f, 2.f, 4.f );
+    add_frame( frame_statistics, 16.f, 12.f, 2.f, 4.f );
+    RCHECK( frame_statistics.hitch_count == 0 );
+
+    // An upload spike: the present wait shrinks, the upload grows the most.
+    add_frame( frame_statistics, 40.f, 12.f, 28.f, 4.f );
+    RCHECK( frame_statistics.hitch_count == 1 );
+    const FrameHitch& hitch = frame_statistics.hitches[ 0 ];
+    RCHECK( hitch.phase == FramePhase::Upload && hitch.phase_ms == 28.f && fabsf( hitch.expected_phase_ms - 2.f ) < 1e-3f );
+    RCHECK( hitch.frame_ms == 40.f && hitch.frame_number == 54 && fabsf( hitch.expected_frame_ms - 16.f ) < 1.f );
+
+    // The same spike again is still a hitch.
+    const f32 filtered_upload_ms = frame_statistics.filtered_phase_ms[ FramePhase::Upload ];
+    add_frame( frame_statistics, 40.f, 12.f, 2.f, 28.f );
+    RCHECK( frame_statistics.hitch_count == 2 && frame_statistics.hitches[ 1 ].phase == FramePhase::Recording );
+    RCHECK( frame_statistics.filtered_phase_ms[ FramePhase::Upload ] == filtered_upload_ms );
+
+    // Only the last ones are kept.
+    for ( u32 f = 0; f < k_frame_statistics_max_hitches; ++f ) {
+        add_frame( frame_statistics, 16.f, 12.f, 2.f, 4.f );
+        add_frame( frame_statistics, 50.f, 12.f, 2.f, 38.f );
+    }
+    RCHECK( frame_statistics.hitch_count == k_frame_statistics_max_hitches + 2 );
+
+    // Valid json, with the hitches attributed by name.
+    char path[ k_max_path ];
+    strcpy( path, test_temporary_path( "frame_statistics.json" ) );
+    RCHECK( frame_statistics.write_json( path ) );
+    sizet size = 0;
+    char* text = file_read_text( path, allocator, &size );
+    nlohmann::json report = nlohmann::json::parse( text, text + size, nullptr, false );
+    RCHECK( !report.is_discarded() && report[ "phases" ].size() == FramePhase::Count && report[ "frames" ].size() == 64 );
+    RCHECK( !report.is_discarded() && report[ "hitch_count" ] == k_frame_statistics_max_hitches + 2 && report[ "hitches" ].size() == k_frame_statistics_max_hitches );
+    RCHECK( !report.is_discarded() && report[ "hitches" ][ 0 ][ "phase" ] == "Recording" && report[ "histogram" ][ "counts" ].size() == k_frame_statistics_histogram_buckets );
+    rfree( text, allocator );
+    file_delete( path );
+
+    frame_statistics.shutdown();
+}
+
+//
+// Phase scopes of the tasks of a frame, on the slot of the thread or all on the same slot.
+struct FramePhaseTask : public enki::ITaskSet {
+
+    void                            ExecuteRange( enki::TaskSetPartition range, uint32_t thread_num ) override;
+
+    FrameStatistics*                frame_statistics        = nullptr;
+    u32                             scopes_per_item         = 0;
+    bool                            shared_slot             = false;
+    bool                            scoped                  = true;         // Timing the scopes, or adding constant times.
+
+}; // struct FramePhaseTask
+
+void FramePhaseTask::ExecuteRange( enki::TaskSetPartition range, uint32_t thread_num ) {
+    const u32 thread_index = shared_slot ? 0 : thread_num;
+    for ( u32 i = range.start; i < range.end; ++i ) {
+        for ( u32 s = 0; s < scopes_per_item; ++s ) {
+            if ( scoped ) {
+                FramePhaseScope scope( frame_statistics, FramePhase::Recording, thread_index );
+            } else {
+                frame_statistics->add_phase_time( thread_index, FramePhase::Recording, 1 );
+            }
+        }
+    }
+}
+
+// Cost of the timings added by the tasks, of the end of frame and of the export, for a 600 frames history as main.cpp.
+RBENCHMARK( frame_statistics_overhead ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize();
+
+    FrameStatistics frame_statistics;
+    frame_statistics.init( allocator, 600, task_scheduler.GetNumTaskThreads() );
+    rprint( "%u task threads\n", task_scheduler.GetNumTaskThreads() );
+
+    // Clock alone, the floor of a scope.
+    const u32 calls = 1000000;
+    i64 start = time_now();
+    i64 sum = 0;
+    for ( u32 i = 0; i < calls; ++i ) {
+        sum += time_now();
+    }
+    const f64 clock_ns = time_from_microseconds( start ) * 1000.0 / calls;
+    rprint( "time_now %.1f ns (%u)\n", clock_ns, ( u32 )( sum & 1 ) );
+
+    FramePhaseTask task;
+    task.frame_statistics = &frame_statistics;
+    task.scopes_per_item = 100;
+    task.m_SetSize = 10000;
+    task.m_MinRange = 64;
+
+    for ( u32 mode = 0; mode < 4; ++mode ) {
+        task.scoped = mode < 2;
+        task.shared_slot = mode % 2;
+
+        start = time_now();
+        task_scheduler.AddTaskSetToPipe( &task );
+        task_scheduler.WaitforTask( &task );
+        const f64 elapsed_ns = time_from_microseconds( start ) * 1000.0;
+        frame_statistics.end_frame( 16.f, 0.f );
+
+        const u32 scopes = task.m_SetSize * task.scopes_per_item;
+        rprint( "%-8s %-12s %.1f ns per call, %.2f ms for %u calls\n", task.scoped ? "scope" : "add", task.shared_slot ? "shared slot" : "thread slots",
+                elapsed_ns / scopes, elapsed_ns / 1000000.0, scopes );
+    }
+
+    const u32 frames = 10000;
+    start = time_now();
+    for ( u32 f = 0; f < frames; ++f ) {
+        frame_statistics.add_phase_time( 0, FramePhase::Recording, 1000 );
+        frame_statistics.end_frame( 16.f + ( f % 7 ), 12.f );
+    }
+    const f64 end_frame_us = time_from_microseconds( start ) / frames;
+
+    FrameStatisticsSummary summary;
+    start = time_now();
+    frame_statistics.compute_summary( summary );
+    const f64 summary_ms = time_from_milliseconds( start );
+
+    char path[ k_max_path ];
+    strcpy( path, test_temporary_path( "frame_statistics_benchmark.json" ) );
+    start = time_now();
+    frame_statistics.write_json( path );
+    const f64 json_ms = time_from_milliseconds( start );
+    file_delete( path );
+
+    rprint( "end_frame %.2f us, summary of %u frames %.2f ms, json %.2f ms\n", end_frame_us, summary.frames, summary_ms, json_ms );
+
+    frame_statistics.shutdown();
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+} // namespace raptor
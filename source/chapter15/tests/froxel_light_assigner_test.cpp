@@ -0,0 +1,242 @@
+#include "graphics/froxel_light_assigner.hpp"
+
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include "external/cglm/struct/vec3.h"
+#include "external/cglm/struct/mat4.h"
+#include "external/cglm/struct/affine.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace raptor {
+
+static f32 random_f32( f32 min_value, f32 max_value ) {
+    return min_value + ( max_value - min_value ) * ( rand() / ( f32 )RAND_MAX );
+}
+
+//
+// A camera and the lights and volumes around it, in world space.
+struct FroxelScene {
+
+    void                            init( u32 num_lights, u32 num_volumes, u32 seed );
+    void                            shutdown();
+
+    Array<vec4s>                    spheres;
+    Array<FroxelVolume>             volumes;
+    mat4s                           world_to_camera;
+
+}; // struct FroxelScene
+
+void FroxelScene::init( u32 num_lights, u32 num_volumes, u32 seed ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+    srand( seed );
+
+    // Views look down +z, the camera is turned and moved away from the origin.
+    world_to_camera = glms_mat4_mul( glms_rotate_make( 0.7f, vec3s{ 0, 1, 0 } ), glms_translate_make( vec3s{ -3, -1, 2 } ) );
+
+    // Lights around the camera: in front, crossing the near plane and behind it.
+    spheres.init( allocator, num_lights, num_lights );
+    for ( u32 l = 0; l < num_lights; ++l ) {
+        spheres[ l ] = { random_f32( -60, 60 ), random_f32( -10, 20 ), random_f32( -60, 60 ), random_f32( 0.2f, 8.0f ) };
+    }
+
+    volumes.init( allocator, num_volumes, num_volumes );
+    for ( u32 v = 0; v < num_volumes; ++v ) {
+        const vec3s center = { random_f32( -40, 40 ), random_f32( -5, 10 ), random_f32( -40, 40 ) };
+        const vec3s half_size = { random_f32( 0.5f, 15 ), random_f32( 0.5f, 5 ), random_f32( 0.5f, 15 ) };
+        volumes[ v ].aabb_min = glms_vec3_sub( center, half_size );
+        volumes[ v ].aabb_max = glms_vec3_add( center, half_size );
+    }
+}
+
+void FroxelScene::shutdown() {
+    volumes.shutdown();
+    spheres.shutdown();
+}
+
+static bool same_u32( const Array<u32>& a, const Array<u32>& b ) {
+    return a.size == b.size && memcmp( a.data, b.data, a.size * sizeof( u32 ) ) == 0;
+}
+
+static bool froxel_has_light( const FroxelLightAssigner& assigner, u32 froxel, u32 light ) {
+    for ( u32 i = assigner.light_offsets[ froxel ]; i < assigner.light_offsets[ froxel + 1 ]; ++i ) {
+        if ( assigner.light_indices[ i ] == light ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The lists of assign, with and without tasks, are the ones of testing every froxel against everything.
+RTEST( froxel_assign_reference ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize( 4 );
+
+    FroxelScene scene;
+    scene.init( 300, 6, 43 );
+
+    FroxelLightAssigner assigner, reference;
+    assigner.init( allocator, 16 );
+    reference.init( allocator, 16 );
+
+    struct GridConfig {
+        u32                         x, y, z;
+        f32                         near_z, far_z;
+        f32                         xy_jitter, z_jitter;
+    };
+    // Jitter is at least half a froxel, larger values enlarge the froxels.
+    const GridConfig configs[] = { { 16, 9, 32, 0.1f, 100.0f, 0.5f, 0.5f }, { 1, 1, 1, 1.0f, 50.0f, 0.0f, 0.0f }, { 7, 13, 5, 0.5f, 30.0f, 1.3f, 0.9f },
+                                   { 32, 18, 64, 0.1f, 200.0f, 0.5f, 2.0f } };
+
+    u32 mismatches = 0;
+    for ( u32 c = 0; c < ArraySize( configs ); ++c ) {
+        const GridConfig& config = configs[ c ];
+        const f32 projection_11 = 1.0f / tanf( glm_rad( 35.0f ) );
+        const f32 projection_00 = projection_11 * 9.0f / 16.0f;
+
+        assigner.set_grid( config.x, config.y, config.z, config.near_z, config.far_z, projection_00, projection_11, config.xy_jitter, config.z_jitter );
+        reference.set_grid( config.x, config.y, config.z, config.near_z, config.far_z, projection_00, projection_11, config.xy_jitter, config.z_jitter );
+        reference.assign_reference( scene.world_to_camera, scene.spheres.data, scene.spheres.size, scene.volumes.data, scene.volumes.size );
+
+        for ( u32 threads = 0; threads < 2; ++threads ) {
+            assigner.assign( scene.world_to_camera, scene.spheres.data, scene.spheres.size, scene.volumes.data, scene.volumes.size,
+                             threads ? &task_scheduler : nullptr );
+
+            const bool same = same_u32( assigner.light_offsets, reference.light_offsets ) && same_u32( assigner.light_indices, reference.light_indices ) &&
+                              same_u32( assigner.volume_offsets, reference.volume_offsets ) && same_u32( assigner.volume_indices, reference.volume_indices );
+            mismatches += same ? 0 : 1;
+        }
+
+        RCHECK( assigner.stats.light_pairs == reference.stats.light_pairs && assigner.stats.empty_froxels == reference.stats.empty_froxels );
+        RCHECK( assigner.stats.max_lights_per_froxel == reference.stats.max_lights_per_froxel && assigner.stats.lights < scene.spheres.size );
+    }
+    RCHECK( mismatches == 0 );
+    // The scene is not empty for the grids: lights and volumes were assigned.
+    RCHECK( reference.stats.light_pairs > 1000 && reference.stats.volume_pairs > 100 && reference.stats.light_tests_saved_per_froxel > 0.f );
+
+    // Nothing to assign.
+    assigner.assign( scene.world_to_camera, nullptr, 0, nullptr, 0, &task_scheduler );
+    RCHECK( assigner.light_indices.size == 0 && assigner.stats.empty_froxels == assigner.froxel_count() );
+    RCHECK( assigner.light_offsets[ assigner.froxel_count() ] == 0 );
+
+    reference.shutdown();
+    assigner.shutdown();
+    scene.shutdown();
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+// Points of a light inside the view find the light in the list of their froxel, independently of the froxel boxes.
+RTEST( froxel_assign_light_points ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    FroxelScene scene;
+    scene.init( 200, 0, 17 );
+
+    const u32 dimension_x = 24, dimension_y = 12, dimension_z = 48;
+    const f32 near_z = 0.1f, far_z = 80.0f;
+    const f32 projection_00 = 0.9f, projection_11 = 1.6f;
+
+    FroxelLightAssigner assigner;
+    assigner.init( allocator, 16 );
+    assigner.set_grid( dimension_x, dimension_y, dimension_z, near_z, far_z, projection_00, projection_11, 0.5f, 0.5f );
+    assigner.assign( scene.world_to_camera, scene.spheres.data, scene.spheres.size, nullptr, 0, nullptr );
+
+    u32 tested = 0, missed = 0;
+    for ( u32 l = 0; l < scene.spheres.size; ++l ) {
+        const vec4s& view_sphere = assigner.view_spheres[ l ];
+
+        for ( u32 p = 0; p < 200; ++p ) {
+            vec3s offset = { random_f32( -1, 1 ), random_f32( -1, 1 ), random_f32( -1, 1 ) };
+            if ( glms_vec3_norm2( offset ) > 1.0f ) {
+                continue;
+            }
+            offset = glms_vec3_scale( offset, view_sphere.w );
+            const vec3s point = { view_sphere.x + offset.x, view_sphere.y + offset.y, view_sphere.z + offset.z };
+            if ( point.z <= near_z || point.z >= far_z ) {
+                continue;
+            }
+
+            // Same mapping as the shaders: NDC for columns and rows, rows going down, exponential slices.
+            const f32 ndc_x = point.x * projection_00 / point.z;
+            const f32 ndc_y = point.y * projection_11 / point.z;
+            if ( fabsf( ndc_x ) >= 1.0f || fabsf( ndc_y ) >= 1.0f ) {
+                continue;
+            }
+
+            const u32 x = ( u32 )( ( ndc_x + 1.0f ) * 0.5f * dimension_x );
+            const u32 y = ( u32 )( ( 1.0f - ndc_y ) * 0.5f * dimension_y );
+            const u32 z = ( u32 )( logf( point.z / near_z ) / logf( far_z / near_z ) * dimension_z );
+            if ( x >= dimension_x || y >= dimension_y || z >= dimension_z ) {
+                continue;
+            }
+
+            ++tested;
+            missed += froxel_has_light( assigner, assigner.froxel_index( x, y, z ), l ) ? 0 : 1;
+        }
+    }
+
+    RCHECK( tested > 1000 );
+    RCHECK( missed == 0 );
+
+    assigner.shutdown();
+    scene.shutdown();
+}
+
+RBENCHMARK( froxel_assign_benchmark ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize();
+
+    FroxelLightAssigner assigner;
+    assigner.init( allocator, 16 );
+
+    // Default grid of the volumetric fog.
+    assigner.set_grid( 128, 128, 128, 0.1f, 100.0f, 1.0f, 1.7f, 0.5f, 0.5f );
+    rprint( "%u froxels, %u task threads\n", assigner.froxel_count(), task_scheduler.GetNumTaskThreads() );
+
+    const u32 light_counts[] = { 16, 64, 256, 1024 };
+    for ( u32 c = 0; c < ArraySize( light_counts ); ++c ) {
+        FroxelScene scene;
+        scene.init( light_counts[ c ], 1, 5 );
+
+        const u32 frames = 10;
+        i64 start = time_now();
+        for ( u32 f = 0; f < frames; ++f ) {
+            assigner.assign( scene.world_to_camera, scene.spheres.data, scene.spheres.size, scene.volumes.data, scene.volumes.size, nullptr );
+        }
+        const f64 single_ms = time_from_milliseconds( start ) / frames;
+
+        start = time_now();
+        for ( u32 f = 0; f < frames; ++f ) {
+            assigner.assign( scene.world_to_camera, scene.spheres.data, scene.spheres.size, scene.volumes.data, scene.volumes.size, &task_scheduler );
+        }
+        const f64 tasks_ms = time_from_milliseconds( start ) / frames;
+
+        // Every froxel against every light, only for the smaller counts.
+        f64 reference_ms = 0.0;
+        if ( light_counts[ c ] <= 64 ) {
+            start = time_now();
+            assigner.assign_reference( scene.world_to_camera, scene.spheres.data, scene.spheres.size, scene.volumes.data, scene.volumes.size );
+            reference_ms = time_from_milliseconds( start );
+        }
+
+        rprint( "%5u lights: assign %7.2f ms, tasks %7.2f ms, reference %8.2f ms, %8u pairs, %5.2f lights per froxel\n", light_counts[ c ], single_ms, tasks_ms,
+                reference_ms, assigner.stats.light_pairs, assigner.stats.average_lights_per_froxel );
+
+        scene.shutdown();
+    }
+
+    assigner.shutdown();
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+} // namespace raptor
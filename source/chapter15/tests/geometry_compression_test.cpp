@@ -0,0 +1,456 @@
+#include "graphics/geometry_compression.hpp"
+
+#include "foundation/file.hpp"
+#include "foundation/gltf.hpp"
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include "external/enkiTS/TaskScheduler.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace raptor {
+
+//
+// One triangle mesh with separate position, normal and uv streams, preceded by some bytes no codec touches.
+struct TestGeometry {
+
+    glTF::glTF                      scene;
+
+    u8*                             buffer              = nullptr;
+    sizet                           buffer_size         = 0;
+
+    u32                             index_size          = 0;
+    u32                             index_count         = 0;
+    u32                             vertex_count        = 0;
+
+    sizet                           indices_offset      = 0;
+    sizet                           positions_offset    = 0;
+    sizet                           normals_offset      = 0;
+    sizet                           uvs_offset          = 0;
+
+}; // struct TestGeometry
+
+struct TestVertex {
+    f32                             position[ 3 ];
+    f32                             normal[ 3 ];
+    f32                             uv[ 2 ];
+};
+
+struct TestTriangle {
+    TestVertex                      vertices[ 3 ];
+};
+
+static const sizet                  k_test_raw_prefix   = 100;
+
+// Grid of side x side vertices. Triangles and vertices are shuffled, so that there is something to optimize.
+static void test_geometry_init( TestGeometry& geometry, u32 side, u32 index_size, cstring name ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    geometry.index_size = index_size;
+    geometry.vertex_count = side * side;
+    geometry.index_count = ( side - 1 ) * ( side - 1 ) * 6;
+    RASSERT( index_size == 4 || geometry.vertex_count <= u16_max + 1 );
+
+    geometry.indices_offset = memory_align( k_test_raw_prefix, 4 );
+    geometry.positions_offset = memory_align( geometry.indices_offset + ( sizet )geometry.index_count * index_size, 4 );
+    geometry.normals_offset = geometry.positions_offset + ( sizet )geometry.vertex_count * 12;
+    geometry.uvs_offset = geometry.normals_offset + ( sizet )geometry.vertex_count * 12;
+    geometry.buffer_size = geometry.uvs_offset + ( sizet )geometry.vertex_count * 8;
+
+    geometry.buffer = rallocam( geometry.buffer_size, allocator );
+    memset( geometry.buffer, 0, geometry.buffer_size );
+
+    srand( side * 7 + index_size );
+    for ( sizet i = 0; i < k_test_raw_prefix; ++i ) {
+        geometry.buffer[ i ] = ( u8 )rand();
+    }
+
+    u32* vertex_order = ( u32* )ralloca( sizeof( u32 ) * geometry.vertex_count, allocator );
+    for ( u32 v = 0; v < geometry.vertex_count; ++v ) {
+        vertex_order[ v ] = v;
+    }
+    for ( u32 v = geometry.vertex_count - 1; v > 0; --v ) {
+        const u32 other = rand() % ( v + 1 );
+        const u32 temp = vertex_order[ v ];
+        vertex_order[ v ] = vertex_order[ other ];
+        vertex_order[ other ] = temp;
+    }
+
+    f32* positions = ( f32* )( geometry.buffer + geometry.positions_offset );
+    f32* normals = ( f32* )( geometry.buffer + geometry.normals_offset );
+    f32* uvs = ( f32* )( geometry.buffer + geometry.uvs_offset );
+    for ( u32 z = 0; z < side; ++z ) {
+        for ( u32 x = 0; x < side; ++x ) {
+            const u32 v = vertex_order[ z * side + x ];
+            const f32 height = sinf( x * 0.37f ) * cosf( z * 0.21f ) + ( rand() % 1000 ) * 0.0001f;
+            positions[ v * 3 + 0 ] = ( f32 )x;
+            positions[ v * 3 + 1 ] = height;
+            positions[ v * 3 + 2 ] = ( f32 )z;
+            normals[ v * 3 + 0 ] = -height * 0.1f;
+            normals[ v * 3 + 1 ] = 1.0f;
+            normals[ v * 3 + 2 ] = height * 0.05f;
+            uvs[ v * 2 + 0 ] = x / ( f32 )( side - 1 );
+            uvs[ v * 2 + 1 ] = z / ( f32 )( side - 1 );
+        }
+    }
+
+    const u32 triangle_count = geometry.index_count / 3;
+    u32* indices = ( u32* )ralloca( sizeof( u32 ) * geometry.index_count, allocator );
+    u32 index = 0;
+    for ( u32 z = 0; z + 1 < side; ++z ) {
+        for ( u32 x = 0; x + 1 < side; ++x ) {
+            const u32 v0 = vertex_order[ z * side + x ], v1 = vertex_order[ z * side + x + 1 ];
+            const u32 v2 = vertex_order[ ( z + 1 ) * side + x ], v3 = vertex_order[ ( z + 1 ) * side + x + 1 ];
+            indices[ index++ ] = v0; indices[ index++ ] = v2; indices[ index++ ] = v1;
+            indices[ index++ ] = v1; indices[ index++ ] = v2; indices[ index++ ] = v3;
+        }
+    }
+    for ( u32 t = triangle_count - 1; t > 0; --t ) {
+        const u32 other = rand() % ( t + 1 );
+        for ( u32 i = 0; i < 3; ++i ) {
+            const u32 temp = indices[ t * 3 + i ];
+            indices[ t * 3 + i ] = indices[ other * 3 + i ];
+            indices[ other * 3 + i ] = temp;
+        }
+    }
+
+    u8* index_data = geometry.buffer + geometry.indices_offset;
+    for ( u32 i = 0; i < geometry.index_count; ++i ) {
+        if ( index_size == 2 ) {
+            ( ( u16* )index_data )[ i ] = ( u16 )indices[ i ];
+        } else {
+            ( ( u32* )index_data )[ i ] = indices[ i ];
+        }
+    }
+
+    rfree( indices, allocator );
+    rfree( vertex_order, allocator );
+
+    // The scene describing the buffer goes through the real loader.
+    char buffer_name[ k_max_path ];
+    snprintf( buffer_name, k_max_path, "%s.bin", name );
+    char buffer_uri[ k_max_path ];
+    strcpy( buffer_uri, test_temporary_path( buffer_name ) );
+
+    char document_name[ k_max_path ];
+    snprintf( document_name, k_max_path, "%s.gltf", name );
+    char document_path[ k_max_path ];
+    strcpy( document_path, test_temporary_path( document_name ) );
+
+    FILE* file = fopen( document_path, "w" );
+    RASSERT( file );
+    fprintf( file, "{\"asset\":{\"version\":\"2.0\"},\n" );
+    fprintf( file, "\"buffers\":[{\"uri\":\"%s\",\"byteLength\":%zu}],\n", buffer_uri, geometry.buffer_size );
+    fprintf( file, "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu},", geometry.indices_offset, ( sizet )geometry.index_count * index_size );
+    fprintf( file, "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu},", geometry.positions_offset, ( sizet )geometry.vertex_count * 12 );
+    fprintf( file, "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu},", geometry.normals_offset, ( sizet )geometry.vertex_count * 12 );
+    fprintf( file, "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu}],\n", geometry.uvs_offset, ( sizet )geometry.vertex_count * 8 );
+    fprintf( file, "\"accessors\":[{\"bufferView\":0,\"componentType\":%u,\"count\":%u,\"type\":\"SCALAR\"},", index_size == 2 ? 5123 : 5125, geometry.index_count );
+    fprintf( file, "{\"bufferView\":1,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\"},", geometry.vertex_count );
+    fprintf( file, "{\"bufferView\":2,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\"},", geometry.vertex_count );
+    fprintf( file, "{\"bufferView\":3,\"componentType\":5126,\"count\":%u,\"type\":\"VEC2\"}],\n", geometry.vertex_count );
+    fprintf( file, "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":1,\"NORMAL\":2,\"TEXCOORD_0\":3},\"indices\":0}]}]}\n" );
+    fclose( file );
+
+    geometry.scene = gltf_load_file( document_path );
+    RASSERT( geometry.scene.buffers_count == 1 );
+
+    file_delete( document_path );
+}
+
+static void test_geometry_shutdown( TestGeometry& geometry ) {
+    gltf_free( geometry.scene );
+    rfree( geometry.buffer, &MemoryService::instance()->system_allocator );
+}
+
+static int sorting_triangle_fn( const void* a, const void* b ) {
+    return memcmp( a, b, sizeof( TestTriangle ) );
+}
+
+// Triangles of the buffer, each rotated to start from its smallest vertex and then sorted:
+// two buffers describe the same geometry, winding included, when the results are equal.
+static TestTriangle* gather_triangles( const TestGeometry& geometry, const u8* buffer ) {
+    const u32 triangle_count = geometry.index_count / 3;
+    TestTriangle* triangles = ( TestTriangle* )ralloca( sizeof( TestTriangle ) * triangle_count, &MemoryService::instance()->system_allocator );
+
+    const u8* index_data = buffer + geometry.indices_offset;
+    const f32* positions = ( const f32* )( buffer + geometry.positions_offset );
+    const f32* normals = ( const f32* )( buffer + geometry.normals_offset );
+    const f32* uvs = ( const f32* )( buffer + geometry.uvs_offset );
+
+    for ( u32 t = 0; t < triangle_count; ++t ) {
+        TestVertex vertices[ 3 ];
+        for ( u32 i = 0; i < 3; ++i ) {
+            const u32 v = geometry.index_size == 2 ? ( ( const u16* )index_data )[ t * 3 + i ] : ( ( const u32* )index_data )[ t * 3 + i ];
+            memcpy( vertices[ i ].position, positions + v * 3, sizeof( f32 ) * 3 );
+            memcpy( vertices[ i ].normal, normals + v * 3, sizeof( f32 ) * 3 );
+            memcpy( vertices[ i ].uv, uvs + v * 2, sizeof( f32 ) * 2 );
+        }
+
+        u32 first = 0;
+        for ( u32 i = 1; i < 3; ++i ) {
+            if ( memcmp( &vertices[ i ], &vertices[ first ], sizeof( TestVertex ) ) < 0 ) {
+                first = i;
+            }
+        }
+        for ( u32 i = 0; i < 3; ++i ) {
+            triangles[ t ].vertices[ i ] = vertices[ ( first + i ) % 3 ];
+        }
+    }
+
+    qsort( triangles, triangle_count, sizeof( TestTriangle ), sorting_triangle_fn );
+    return triangles;
+}
+
+static bool same_geometry( const TestGeometry& geometry, const u8* buffer_a, const u8* buffer_b ) {
+    TestTriangle* triangles_a = gather_triangles( geometry, buffer_a );
+    TestTriangle* triangles_b = gather_triangles( geometry, buffer_b );
+
+    const bool same = memcmp( triangles_a, triangles_b, sizeof( TestTriangle ) * ( geometry.index_count / 3 ) ) == 0;
+
+    rfree( triangles_b, &MemoryService::instance()->system_allocator );
+    rfree( triangles_a, &MemoryService::instance()->system_allocator );
+    return same;
+}
+
+// Encodes a copy of the buffer, the copy receives the triangle rotations chosen by the index codec.
+static u8* encode_copy( TestGeometry& geometry, bool optimize, Array<u8>& out_compressed ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    u8* copy = rallocam( geometry.buffer_size, allocator );
+    memcpy( copy, geometry.buffer, geometry.buffer_size );
+
+    if ( optimize ) {
+        RCHECK( geometry_optimize_gltf( geometry.scene, &copy, allocator ) == 1 );
+    }
+
+    Array<GeometryStream> streams;
+    streams.init( allocator, 8 );
+    geometry_collect_streams( geometry.scene, 0, streams );
+    RCHECK( streams.size == 4 );
+
+    geometry_encode( copy, geometry.buffer_size, streams.data, streams.size, out_compressed, allocator );
+    streams.shutdown();
+
+    return copy;
+}
+
+RTEST( geometry_compression_round_trip ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize( 4 );
+
+    const u32 index_sizes[ 2 ] = { 2, 4 };
+    for ( u32 s = 0; s < 2; ++s ) {
+        TestGeometry geometry;
+        test_geometry_init( geometry, index_sizes[ s ] == 2 ? 128 : 256, index_sizes[ s ], "geometry_round_trip" );
+
+        Array<u8> compressed;
+        compressed.init( allocator, 0 );
+        u8* encoded = encode_copy( geometry, false, compressed );
+
+        RCHECK( geometry_decoded_size( compressed.data, compressed.size ) == geometry.buffer_size );
+        RCHECK( compressed.size < geometry.buffer_size );
+        // Raw prefix and four streams, some of them split in several chunks so that decoding goes wide.
+        RCHECK( ( ( GeometryCompressedHeader* )compressed.data )->chunk_count > 5 );
+
+        // Decoding is byte exact against what was encoded, on one thread and on many.
+        u8* decoded = rallocam( geometry.buffer_size, allocator );
+        for ( u32 parallel = 0; parallel < 2; ++parallel ) {
+            memset( decoded, 0xcd, geometry.buffer_size );
+            RCHECK( geometry_decode( compressed.data, compressed.size, decoded, parallel ? &task_scheduler : nullptr ) );
+            RCHECK( memcmp( decoded, encoded, geometry.buffer_size ) == 0 );
+        }
+
+        // Against the source only triangle rotations can differ.
+        RCHECK( memcmp( decoded, geometry.buffer, geometry.indices_offset ) == 0 );
+        RCHECK( memcmp( decoded + geometry.positions_offset, geometry.buffer + geometry.positions_offset, geometry.buffer_size - geometry.positions_offset ) == 0 );
+        RCHECK( same_geometry( geometry, decoded, geometry.buffer ) );
+
+        rfree( decoded, allocator );
+        rfree( encoded, allocator );
+        compressed.shutdown();
+        test_geometry_shutdown( geometry );
+    }
+
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+RTEST( geometry_compression_optimized_is_equivalent ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    TestGeometry geometry;
+    test_geometry_init( geometry, 128, 4, "geometry_optimized" );
+
+    Array<u8> compressed;
+    compressed.init( allocator, 0 );
+    u8* encoded = encode_copy( geometry, true, compressed );
+
+    u8* decoded = rallocam( geometry.buffer_size, allocator );
+    RCHECK( geometry_decode( compressed.data, compressed.size, decoded, nullptr ) );
+    RCHECK( memcmp( decoded, encoded, geometry.buffer_size ) == 0 );
+
+    // Vertices and triangles are reordered: not the same bytes, the same triangles.
+    RCHECK( memcmp( decoded, geometry.buffer, geometry.buffer_size ) != 0 );
+    RCHECK( memcmp( decoded, geometry.buffer, k_test_raw_prefix ) == 0 );
+    RCHECK( same_geometry( geometry, decoded, geometry.buffer ) );
+
+    // Optimized data compresses better.
+    Array<u8> compressed_unoptimized;
+    compressed_unoptimized.init( allocator, 0 );
+    u8* encoded_unoptimized = encode_copy( geometry, false, compressed_unoptimized );
+    RCHECK( compressed.size < compressed_unoptimized.size );
+
+    rfree( encoded_unoptimized, allocator );
+    compressed_unoptimized.shutdown();
+
+    // Same through the file written next to the buffer.
+    GeometryCompressionStats stats;
+    void* buffers_data[ 1 ] = { geometry.buffer };
+    RCHECK( geometry_compress_gltf( geometry.scene, buffers_data, allocator, &stats, true ) );
+    RCHECK( stats.optimized_primitives == 1 && stats.raw_bytes == geometry.buffer_size );
+
+    char compressed_path[ k_max_path ];
+    geometry_compressed_path( geometry.scene.buffers[ 0 ].uri.data, compressed_path, k_max_path );
+
+    sizet file_size = 0;
+    u8* file_data = ( u8* )file_read_binary( compressed_path, allocator, &file_size );
+    RCHECK( file_data && file_size == stats.compressed_bytes && file_size == compressed.size );
+    if ( file_data ) {
+        memset( decoded, 0, geometry.buffer_size );
+        RCHECK( geometry_decode( file_data, file_size, decoded, nullptr ) );
+        RCHECK( memcmp( decoded, encoded, geometry.buffer_size ) == 0 );
+        rfree( file_data, allocator );
+    }
+    file_delete( compressed_path );
+
+    rfree( decoded, allocator );
+    rfree( encoded, allocator );
+    compressed.shutdown();
+    test_geometry_shutdown( geometry );
+}
+
+RTEST( geometry_compression_rejects_invalid_data ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    TestGeometry geometry;
+    test_geometry_init( geometry, 64, 2, "geometry_invalid" );
+
+    Array<u8> compressed;
+    compressed.init( allocator, 0 );
+    u8* encoded = encode_copy( geometry, false, compressed );
+    u8* decoded = rallocam( geometry.buffer_size, allocator );
+
+    GeometryCompressedHeader* header = ( GeometryCompressedHeader* )compressed.data;
+    GeometryCompressedChunk* chunks = ( GeometryCompressedChunk* )( header + 1 );
+    const sizet table_size = sizeof( GeometryCompressedHeader ) + sizeof( GeometryCompressedChunk ) * header->chunk_count;
+
+    // Truncated header, chunk table or payload.
+    RCHECK( geometry_decoded_size( compressed.data, sizeof( GeometryCompressedHeader ) - 1 ) == 0 );
+    RCHECK( geometry_decoded_size( compressed.data, table_size - 1 ) == 0 );
+    RCHECK( !geometry_decode( compressed.data, table_size - 1, decoded, nullptr ) );
+    RCHECK( !geometry_decode( compressed.data, compressed.size - 1, decoded, nullptr ) );
+
+    // Other files and versions.
+    header->magic ^= 1;
+    RCHECK( geometry_decoded_size( compressed.data, compressed.size ) == 0 );
+    header->magic ^= 1;
+    header->version += 1;
+    RCHECK( !geometry_decode( compressed.data, compressed.size, decoded, nullptr ) );
+    header->version -= 1;
+
+    // Chunks writing outside of the buffer or with unknown types.
+    const u64 destination_offset = chunks[ 1 ].destination_offset;
+    chunks[ 1 ].destination_offset = geometry.buffer_size - 1;
+    RCHECK( !geometry_decode( compressed.data, compressed.size, decoded, nullptr ) );
+    chunks[ 1 ].destination_offset = destination_offset;
+
+    const u32 chunk_type = chunks[ 1 ].type;
+    chunks[ 1 ].type = GeometryChunkType::Count;
+    RCHECK( !geometry_decode( compressed.data, compressed.size, decoded, nullptr ) );
+    chunks[ 1 ].type = chunk_type;
+    RCHECK( geometry_decode( compressed.data, compressed.size, decoded, nullptr ) );
+
+    // Corrupted codec data fails the chunk: the leading raw bytes are read as index data.
+    RCHECK( chunks[ 0 ].type == GeometryChunkType::Raw && chunks[ 0 ].source_offset == 0 );
+    for ( u32 c = 0; c < header->chunk_count; ++c ) {
+        if ( chunks[ c ].type == GeometryChunkType::Raw ) {
+            chunks[ c ].type = GeometryChunkType::Index;
+            chunks[ c ].element_size = 4;
+            chunks[ c ].element_count = ( u32 )( chunks[ c ].source_size / 4 ) / 3 * 3;
+        }
+    }
+    memset( compressed.data + table_size, 0xff, 16 );
+    RCHECK( !geometry_decode( compressed.data, compressed.size, decoded, nullptr ) );
+
+    rfree( decoded, allocator );
+    rfree( encoded, allocator );
+    compressed.shutdown();
+    test_geometry_shutdown( geometry );
+}
+
+// Compression ratio and decoding speed of a one million vertices mesh, decoded on the calling thread and with tasks.
+RBENCHMARK( geometry_compression_throughput ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize();
+
+    TestGeometry geometry;
+    test_geometry_init( geometry, 1024, 4, "geometry_benchmark" );
+
+    u8* decoded = rallocam( geometry.buffer_size, allocator );
+    const f64 gigabytes = geometry.buffer_size / ( 1024.0 * 1024.0 * 1024.0 );
+
+    // Plain copy of the same size, as reference.
+    f64 copy_ms = 1e9;
+    for ( u32 r = 0; r < 5; ++r ) {
+        const i64 start = time_now();
+        memcpy( decoded, geometry.buffer, geometry.buffer_size );
+        copy_ms = min( copy_ms, time_from_milliseconds( start ) );
+    }
+    rprint( "%-28s %8.2f GB/s\n", "memcpy", gigabytes / ( copy_ms / 1000.0 ) );
+
+    for ( u32 optimize = 0; optimize < 2; ++optimize ) {
+        Array<u8> compressed;
+        compressed.init( allocator, 0 );
+
+        const i64 encode_start = time_now();
+        u8* encoded = encode_copy( geometry, optimize != 0, compressed );
+        const f64 encode_ms = time_from_milliseconds( encode_start );
+
+        rprint( "%-28s %8.1f MB -> %6.1f MB (%.1f%%), encoded in %.1f ms\n", optimize ? "optimized" : "source order",
+                geometry.buffer_size / ( 1024.0 * 1024.0 ), compressed.size / ( 1024.0 * 1024.0 ),
+                compressed.size * 100.0 / geometry.buffer_size, encode_ms );
+
+        for ( u32 parallel = 0; parallel < 2; ++parallel ) {
+            f64 decode_ms = 1e9;
+            for ( u32 r = 0; r < 5; ++r ) {
+                const i64 start = time_now();
+                RCHECK( geometry_decode( compressed.data, compressed.size, decoded, parallel ? &task_scheduler : nullptr ) );
+                decode_ms = min( decode_ms, time_from_milliseconds( start ) );
+            }
+            RCHECK( memcmp( decoded, encoded, geometry.buffer_size ) == 0 );
+
+            rprint( "  decode %-19s %8.2f GB/s (%.2f ms)\n", parallel ? "tasks" : "single thread", gigabytes / ( decode_ms / 1000.0 ), decode_ms );
+        }
+
+        rfree( encoded, allocator );
+        compressed.shutdown();
+    }
+
+    rfree( decoded, allocator );
+    test_geometry_shutdown( geometry );
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+} // namespace raptor
@@ -0,0 +1,265 @@
+#include "graphics/gpu_memory_budget.hpp"
+#include "graphics/texture_streaming.hpp"
+
+#include "foundation/file.hpp"
+#include "foundation/memory.hpp"
+
+#include "tests/test.hpp"
+
+#include "external/json.hpp"
+
+#include <string.h>
+
+namespace raptor {
+
+static const u64                    k_mb                = 1024 * 1024;
+
+//
+// Heap budgets set by the test instead of VMA.
+struct MockBudgetProvider {
+
+    GpuMemoryHeapBudget             heaps[ 2 ];
+    u32                             heap_count          = 2;
+
+}; // struct MockBudgetProvider
+
+static u32 mock_budget_provider( void* context, GpuMemoryHeapBudget* out_heaps, u32 max_heaps ) {
+    const MockBudgetProvider* provider = ( const MockBudgetProvider* )context;
+    const u32 heap_count = provider->heap_count < max_heaps ? provider->heap_count : max_heaps;
+    memcpy( out_heaps, provider->heaps, sizeof( GpuMemoryHeapBudget ) * heap_count );
+    return heap_count;
+}
+
+//
+// Frees what is asked, up to what it has.
+struct MockEvictor {
+
+    u64                             available_bytes     = 0;
+    u64                             requested_bytes     = 0;
+    u32                             calls               = 0;
+    u32                             order               = u32_max;  // Of the last call.
+
+}; // struct MockEvictor
+
+static u32 s_eviction_calls = 0;
+
+static u64 mock_evict( void* context, GpuMemoryCategory::Enum, u64 bytes ) {
+    MockEvictor* evictor = ( MockEvictor* )context;
+    evictor->requested_bytes += bytes;
+    ++evictor->calls;
+    evictor->order = s_eviction_calls++;
+
+    const u64 freed = bytes < evictor->available_bytes ? bytes : evictor->available_bytes;
+    evictor->available_bytes -= freed;
+    return freed;
+}
+
+static void reset_evictors( MockEvictor* evictors, u32 count ) {
+    for ( u32 e = 0; e < count; ++e ) {
+        evictors[ e ].requested_bytes = 0;
+        evictors[ e ].calls = 0;
+        evictors[ e ].order = u32_max;
+    }
+    s_eviction_calls = 0;
+}
+
+// 1GB device local heap and 4GB of system memory.
+static GpuMemoryBudgetCreation mock_creation( MockBudgetProvider& provider ) {
+    provider.heaps[ 0 ] = { 100 * k_mb, 1000 * k_mb, true };
+    provider.heaps[ 1 ] = { 500 * k_mb, 4000 * k_mb, false };
+
+    GpuMemoryBudgetCreation creation;
+    creation.provider = mock_budget_provider;
+    creation.provider_context = &provider;
+    creation.limits[ GpuMemoryCategory::Textures ].soft_bytes = 200 * k_mb;
+    creation.limits[ GpuMemoryCategory::Textures ].hard_bytes = 300 * k_mb;
+    return creation;
+}
+
+RTEST( gpu_memory_budget_category_limits ) {
+    MockBudgetProvider provider;
+    GpuMemoryBudget budget;
+    budget.init( mock_creation( provider ) );
+
+    budget.update( 1 );
+    RCHECK( budget.device_usage == 100 * k_mb && budget.device_budget == 1000 * k_mb && budget.device_pressure == GpuMemoryPressure::None );
+
+    // Kept in priority order, registration order between equal ones.
+    MockEvictor textures_a{ 1000 * k_mb }, textures_b{ 1000 * k_mb }, pools{ 1000 * k_mb };
+    budget.register_evictor( GpuMemoryCategory::Textures, mock_evict, &textures_a, 5 );
+    budget.register_evictor( GpuMemoryCategory::PagePools, mock_evict, &pools, 0 );
+    budget.register_evictor( GpuMemoryCategory::Textures, mock_evict, &textures_b, 5 );
+    RCHECK( budget.evictors[ 0 ].context == &pools && budget.evictors[ 1 ].context == &textures_a && budget.evictors[ 2 ].context == &textures_b );
+
+    // Over the soft limit only the evictors of the category are asked, for the excess.
+    budget.on_allocation( GpuMemoryCategory::Textures, 250 * k_mb );
+    RCHECK( budget.can_allocate( GpuMemoryCategory::Textures, 50 * k_mb ) && !budget.can_allocate( GpuMemoryCategory::Textures, 51 * k_mb ) );
+    budget.update( 2 );
+    RCHECK( budget.category_pressure[ GpuMemoryCategory::Textures ] == GpuMemoryPressure::Soft );
+    RCHECK( textures_a.requested_bytes == 50 * k_mb && textures_a.calls == 1 && textures_b.calls == 0 && pools.calls == 0 );
+
+    // The evicted memory is still allocated while in the deletion queue: it is not asked again before the latency.
+    budget.update( 3 );
+    budget.update( 5 );
+    RCHECK( textures_a.calls == 1 );
+    budget.update( 6 );
+    RCHECK( textures_a.calls == 2 && textures_a.requested_bytes == 100 * k_mb );
+
+    // Over the hard limit allocations are counted.
+    budget.on_allocation( GpuMemoryCategory::Textures, 51 * k_mb );
+    RCHECK( budget.hard_limit_hits[ GpuMemoryCategory::Textures ] == 1 );
+    budget.update( 20 );
+    RCHECK( budget.category_pressure[ GpuMemoryCategory::Textures ] == GpuMemoryPressure::Hard );
+    budget.on_free( GpuMemoryCategory::Textures, 250 * k_mb );
+    budget.on_free( GpuMemoryCategory::Textures, 51 * k_mb );
+    RCHECK( budget.category_bytes( GpuMemoryCategory::Textures ) == 0 && budget.allocations[ GpuMemoryCategory::Textures ] == 0 );
+
+    budget.unregister_evictor( mock_evict, &textures_b );
+    RCHECK( budget.evictor_count == 2 && budget.evictors[ 1 ].context == &textures_a );
+    budget.unregister_evictor( mock_evict, &textures_a );
+    budget.unregister_evictor( mock_evict, &pools );
+    budget.shutdown();
+}
+
+RTEST( gpu_memory_budget_device_pressure ) {
+    MockBudgetProvider provider;
+    GpuMemoryBudget budget;
+    budget.init( mock_creation( provider ) );
+
+    MockEvictor evictors[ 3 ] = { { 1000 * k_mb }, { 1000 * k_mb }, { 1000 * k_mb } };
+    budget.register_evictor( GpuMemoryCategory::Textures, mock_evict, &evictors[ 1 ], 5 );
+    budget.register_evictor( GpuMemoryCategory::PagePools, mock_evict, &evictors[ 0 ], 0 );
+    budget.register_evictor( GpuMemoryCategory::Textures, mock_evict, &evictors[ 2 ], 5 );
+
+    // 90% of the device local budget is over the soft ratio: the excess over 85% is asked by priority.
+    provider.heaps[ 0 ].usage = 900 * k_mb;
+    budget.update( 1 );
+    RCHECK( budget.device_pressure == GpuMemoryPressure::Soft );
+    RCHECK( evictors[ 0 ].calls == 1 && evictors[ 0 ].requested_bytes > 49 * k_mb && evictors[ 0 ].requested_bytes <= 50 * k_mb );
+    RCHECK( evictors[ 1 ].calls == 0 && evictors[ 2 ].calls == 0 );
+
+    // The first evictor has little left, the next one frees the rest.
+    reset_evictors( evictors, 3 );
+    evictors[ 0 ].available_bytes = 10 * k_mb;
+    provider.heaps[ 0 ].usage = 980 * k_mb;
+    budget.update( 10 );
+    RCHECK( budget.device_pressure == GpuMemoryPressure::Hard );
+    RCHECK( evictors[ 0 ].order == 0 && evictors[ 1 ].order == 1 && evictors[ 2 ].calls == 0 );
+    RCHECK( !budget.can_allocate( GpuMemoryCategory::Other, 1 ) );
+
+    // Without device local heaps, as on software implementations, every heap counts.
+    provider.heaps[ 0 ].device_local = false;
+    provider.heaps[ 0 ].usage = 0;
+    budget.update( 20 );
+    RCHECK( budget.device_usage == 500 * k_mb && budget.device_budget == 5000 * k_mb && budget.device_pressure == GpuMemoryPressure::None );
+    RCHECK( budget.can_allocate( GpuMemoryCategory::Other, 1 ) );
+
+    // Only the last events are kept.
+    provider.heaps[ 0 ].device_local = true;
+    provider.heaps[ 0 ].usage = 990 * k_mb;
+    for ( u32 i = 0; i < 100; ++i ) {
+        budget.update( 100 + i * 10 );
+    }
+    RCHECK( budget.event_count > k_gpu_memory_max_events );
+
+    // The report is valid json.
+    char path[ k_max_path ];
+    strcpy( path, test_temporary_path( "gpu_memory_budget.json" ) );
+    RCHECK( budget.write_json( path ) );
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+    sizet size = 0;
+    char* text = file_read_text( path, allocator, &size );
+    nlohmann::json report = nlohmann::json::parse( text, text + size, nullptr, false );
+    RCHECK( !report.is_discarded() && report[ "events" ].size() == k_gpu_memory_max_events && report[ "categories" ].size() == GpuMemoryCategory::Count );
+    rfree( text, allocator );
+    file_delete( path );
+
+    for ( u32 e = 0; e < 3; ++e ) {
+        budget.unregister_evictor( mock_evict, &evictors[ e ] );
+    }
+    budget.shutdown();
+}
+
+RTEST( gpu_memory_budget_device_limits ) {
+    GpuMemoryBudgetCreation creation;
+    creation.set_device_limits( 8000 * k_mb );
+
+    // Evictable categories have a soft limit under their hard one, the others only a hard one.
+    const GpuMemoryCategoryLimits& textures = creation.limits[ GpuMemoryCategory::Textures ];
+    const GpuMemoryCategoryLimits& pools = creation.limits[ GpuMemoryCategory::PagePools ];
+    RCHECK( textures.soft_bytes && textures.soft_bytes < textures.hard_bytes && textures.hard_bytes < 8000 * k_mb );
+    RCHECK( pools.soft_bytes && pools.soft_bytes < pools.hard_bytes );
+    RCHECK( creation.limits[ GpuMemoryCategory::RenderTargets ].soft_bytes == 0 && creation.limits[ GpuMemoryCategory::RenderTargets ].hard_bytes );
+    RCHECK( creation.limits[ GpuMemoryCategory::AccelerationStructures ].hard_bytes == 1600 * k_mb );
+    RCHECK( creation.limits[ GpuMemoryCategory::Other ].hard_bytes == 0 );
+}
+
+RTEST( gpu_memory_budget_texture_streamer ) {
+    MockBudgetProvider provider;
+    GpuMemoryBudget budget;
+    budget.init( mock_creation( provider ) );
+
+    // The streamer registers itself.
+    TextureStreamerCreation creation;
+    creation.allocator = &MemoryService::instance()->system_allocator;
+    creation.budget_bytes = 64 * k_mb;
+    creation.simulation = true;
+    creation.simulation_latency_frames = 1;
+    creation.max_requests_per_frame = 64;
+    creation.memory_budget = &budget;
+
+    TextureStreamer streamer;
+    streamer.init( creation );
+    RCHECK( budget.evictor_count == 1 && budget.evictors[ 0 ].context == &streamer && budget.evictors[ 0 ].category == GpuMemoryCategory::Textures );
+
+    for ( u32 t = 0; t < 4; ++t ) {
+        streamer.register_texture( 2048, 2048, 12 );
+    }
+    u32 feedback[ 4 ] = { 0, 0, 0, 0 };
+    for ( u64 frame = 1; frame < 40; ++frame ) {
+        streamer.update( feedback, 4, frame );
+    }
+    const sizet resident_bytes = streamer.stats.resident_bytes;
+    RCHECK( resident_bytes > 40 * k_mb );
+
+    // Textures over their soft limit: the budget trims the streamer, which evicts on its next update.
+    budget.on_allocation( GpuMemoryCategory::Textures, 220 * k_mb );
+    budget.update( 40 );
+    RCHECK( streamer.budget_bytes == resident_bytes - 20 * k_mb && budget.evicted_bytes[ GpuMemoryCategory::Textures ] == 20 * k_mb );
+    // Other categories are not trimmed from the streamer.
+    RCHECK( texture_streamer_evict_callback( &streamer, GpuMemoryCategory::Geometry, 10 * k_mb ) == 0 && streamer.budget_bytes == resident_bytes - 20 * k_mb );
+    u32 not_sampled[ 4 ] = { u32_max, u32_max, u32_max, u32_max };
+    streamer.update( not_sampled, 4, 40 );
+    RCHECK( streamer.stats.resident_bytes + streamer.stats.pending_bytes <= streamer.budget_bytes && streamer.evictions.size > 0 );
+
+    // Trimming stops at the mip tails.
+    streamer.trim( 1ull << 40 );
+    for ( u64 frame = 41; frame < 60; ++frame ) {
+        streamer.update( not_sampled, 4, frame );
+    }
+    sizet tail_bytes = 0;
+    for ( u32 t = 0; t < 4; ++t ) {
+        for ( u32 mip = streamer.textures[ t ].mip_tail_first; mip < 12; ++mip ) {
+            tail_bytes += streamer.mip_size( t, mip );
+        }
+    }
+    RCHECK( streamer.budget_bytes == tail_bytes && streamer.stats.resident_bytes == tail_bytes && streamer.trim( k_mb ) == 0 );
+
+    // With the streaming budget back, loads still wait while the Textures hard limit is reached.
+    streamer.budget_bytes = 64 * k_mb;
+    budget.on_allocation( GpuMemoryCategory::Textures, 80 * k_mb );
+    const u32 stalls = streamer.stats.budget_stalls;
+    streamer.update( feedback, 4, 60 );
+    RCHECK( streamer.requests.size == 0 && streamer.stats.budget_stalls == stalls + 1 );
+
+    budget.on_free( GpuMemoryCategory::Textures, 220 * k_mb );
+    budget.on_free( GpuMemoryCategory::Textures, 80 * k_mb );
+    streamer.update( feedback, 4, 61 );
+    RCHECK( streamer.requests.size > 0 );
+
+    streamer.shutdown();
+    RCHECK( budget.evictor_count == 0 );
+    budget.shutdown();
+}
+
+} // namespace raptor
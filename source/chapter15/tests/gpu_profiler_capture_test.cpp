@@ -0,0 +1,370 @@
+#include "graphics/gpu_profiler_capture.hpp"
+#include "graphics/gpu_profiler.hpp"
+
+#include "foundation/file.hpp"
+#include "foundation/hash_map.hpp"
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include "external/json.hpp"
+
+#include <math.h>
+#include <string.h>
+
+namespace raptor {
+
+static void set_query( GPUTimeQuery& query, cstring name, f64 elapsed_ms, u16 depth ) {
+    query = { };
+    query.name = name;
+    query.elapsed_ms = elapsed_ms;
+    query.depth = depth;
+}
+
+// Two command buffer trees, the first two levels deep, and a query too deep to be kept.
+static u32 fill_frame( GPUTimeQuery* timestamps, cstring root_name ) {
+    set_query( timestamps[ 0 ], root_name, 5.0, 0 );
+    set_query( timestamps[ 1 ], "opaque", 3.0, 1 );
+    set_query( timestamps[ 2 ], "transparent", 1.5, 1 );
+    set_query( timestamps[ 3 ], "sort", 0.5, 2 );
+    set_query( timestamps[ 4 ], "compute", 2.0, 0 );
+    set_query( timestamps[ 5 ], "culling", 1.0, 1 );
+    set_query( timestamps[ 6 ], "too_deep", 1.0, k_gpu_capture_max_depth );
+    return 7;
+}
+
+static char* read_text( cstring path, sizet* size ) {
+    return file_read_text( path, &MemoryService::instance()->system_allocator, size );
+}
+
+// Start of the queries, tracks and frame time from the durations only.
+RTEST( gpu_profiler_capture_layout ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    GpuProfilerCapture capture;
+    capture.init( allocator, 4, 8 );
+
+    GPUTimeQuery timestamps[ 16 ];
+    char root_name[ 32 ];
+    strcpy( root_name, "gbuffer" );
+    const u32 num_timestamps = fill_frame( timestamps, root_name );
+
+    // Nothing is kept until recording.
+    capture.record_frame( timestamps, num_timestamps, nullptr, 0.0 );
+    RCHECK( capture.frame_count == 0 && capture.recorded_frames == 0 );
+
+    capture.recording = true;
+    capture.record_frame( timestamps, num_timestamps, nullptr, 16.0 );
+    RCHECK( capture.frame_count == 1 && capture.dropped_queries == 1 );
+
+    const GpuCapturedFrame& frame = capture.get_frame( 0 );
+    const GpuCapturedQuery* queries = capture.get_queries( 0 );
+    RCHECK( frame.query_count == 6 && frame.gpu_frame_ms == 7.0f && frame.cpu_time_ms == 16.0 && frame.pipeline_statistics[ 0 ] == 0 );
+
+    const f32 expected_start_ms[] = { 0.f, 0.f, 3.0f, 3.0f, 0.f, 0.f };
+    const u16 expected_tracks[] = { 0, 0, 0, 0, 1, 1 };
+    u32 mismatches = 0;
+    for ( u32 q = 0; q < frame.query_count; ++q ) {
+        mismatches += queries[ q ].start_ms == expected_start_ms[ q ] && queries[ q ].track == expected_tracks[ q ] ? 0 : 1;
+        mismatches += queries[ q ].elapsed_ms == ( f32 )timestamps[ q ].elapsed_ms && queries[ q ].depth == timestamps[ q ].depth ? 0 : 1;
+    }
+    RCHECK( mismatches == 0 );
+
+    // Names are copied, the frame graph can free them.
+    strcpy( root_name, "reloaded" );
+    RCHECK( strcmp( capture.get_name( queries[ 0 ].name_index ), "gbuffer" ) == 0 );
+    RCHECK( strcmp( capture.get_name( queries[ 5 ].name_index ), "culling" ) == 0 );
+
+    // Children before any root are dropped, unnamed queries are kept.
+    set_query( timestamps[ 0 ], "orphan", 1.0, 1 );
+    set_query( timestamps[ 1 ], nullptr, 1.0, 0 );
+    capture.record_frame( timestamps, 2, nullptr, 32.0 );
+    RCHECK( capture.dropped_queries == 2 && capture.get_frame( 1 ).query_count == 1 );
+    RCHECK( strcmp( capture.get_name( capture.get_queries( 1 )[ 0 ].name_index ), "unnamed" ) == 0 );
+
+    // Queries over the per frame limit.
+    for ( u32 t = 0; t < 10; ++t ) {
+        set_query( timestamps[ t ], "root", 0.5, 0 );
+    }
+    GpuPipelineStatistics pipeline_statistics;
+    for ( u32 s = 0; s < GpuPipelineStatistics::Count; ++s ) {
+        pipeline_statistics.statistics[ s ] = s + 1;
+    }
+    capture.record_frame( timestamps, 10, &pipeline_statistics, 48.0 );
+    const GpuCapturedFrame& full_frame = capture.get_frame( 2 );
+    RCHECK( capture.dropped_queries == 4 && full_frame.query_count == 8 && full_frame.gpu_frame_ms == 4.0f );
+    RCHECK( capture.get_queries( 2 )[ 7 ].track == 7 && full_frame.pipeline_statistics[ GpuPipelineStatistics::ComputeShaderInvocations ] == 7 );
+
+    capture.shutdown();
+}
+
+// The oldest frames are overwritten, indices go from the oldest kept.
+RTEST( gpu_profiler_capture_ring ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    GpuProfilerCapture capture;
+    capture.init( allocator, 4, 4 );
+    capture.recording = true;
+
+    GPUTimeQuery timestamp;
+    for ( u32 f = 0; f < 6; ++f ) {
+        set_query( timestamp, "frame", f + 1.0, 0 );
+        capture.record_frame( &timestamp, 1, nullptr, f * 16.0 );
+    }
+    RCHECK( capture.frame_count == 4 && capture.recorded_frames == 6 );
+
+    u32 mismatches = 0;
+    for ( u32 f = 0; f < capture.frame_count; ++f ) {
+        const GpuCapturedFrame& frame = capture.get_frame( f );
+        mismatches += frame.frame_number == f + 2 && frame.cpu_time_ms == ( f + 2 ) * 16.0 ? 0 : 1;
+        mismatches += capture.get_queries( f )[ 0 ].elapsed_ms == f + 3.0f ? 0 : 1;
+    }
+    RCHECK( mismatches == 0 );
+
+    capture.reset();
+    RCHECK( capture.frame_count == 0 && capture.recorded_frames == 0 && capture.dropped_queries == 0 );
+
+    capture.shutdown();
+}
+
+static const GpuPassStatistics* find_pass( const Array<GpuPassStatistics>& statistics, cstring name ) {
+    for ( u32 i = 0; i < statistics.size; ++i ) {
+        if ( strcmp( statistics[ i ].name, name ) == 0 ) {
+            return &statistics[ i ];
+        }
+    }
+    return nullptr;
+}
+
+static const GpuPassRegression* find_regression( const Array<GpuPassRegression>& regressions, cstring name ) {
+    for ( u32 i = 0; i < regressions.size; ++i ) {
+        if ( strcmp( regressions[ i ].name, name ) == 0 ) {
+            return &regressions[ i ];
+        }
+    }
+    return nullptr;
+}
+
+// 100 frames: shadows takes 1 to 100 ms, lighting runs twice per frame, ssao only on even frames.
+static void record_statistics_frames( GpuProfilerCapture& capture, f32 shadows_scale ) {
+    GPUTimeQuery timestamps[ 4 ];
+    GpuPipelineStatistics pipeline_statistics;
+
+    for ( u32 f = 0; f < 100; ++f ) {
+        u32 num_timestamps = 0;
+        set_query( timestamps[ num_timestamps++ ], "shadows", ( f + 1 ) * shadows_scale, 0 );
+        set_query( timestamps[ num_timestamps++ ], "lighting", 1.0, 0 );
+        set_query( timestamps[ num_timestamps++ ], "lighting", 1.0, 0 );
+        if ( f % 2 == 0 ) {
+            set_query( timestamps[ num_timestamps++ ], "ssao", 0.5, 0 );
+        }
+
+        for ( u32 s = 0; s < GpuPipelineStatistics::Count; ++s ) {
+            pipeline_statistics.statistics[ s ] = f * 10 + s;
+        }
+        capture.record_frame( timestamps, num_timestamps, &pipeline_statistics, f * 16.0 );
+    }
+}
+
+RTEST( gpu_profiler_capture_statistics ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    GpuProfilerCapture capture;
+    capture.init( allocator, 100, 4 );
+    capture.recording = true;
+    record_statistics_frames( capture, 1.0f );
+
+    Array<GpuPassStatistics> statistics;
+    statistics.init( allocator, 8 );
+    capture.compute_pass_statistics( statistics );
+    RCHECK( statistics.size == 3 && find_pass( statistics, "unnamed" ) == nullptr );
+
+    // Nearest rank percentiles.
+    const GpuPassStatistics* shadows = find_pass( statistics, "shadows" );
+    RCHECK( shadows && shadows->samples == 100 && shadows->min_ms == 1.0f && shadows->max_ms == 100.0f );
+    RCHECK( shadows && shadows->average_ms == 50.5f && shadows->p95_ms == 95.0f && shadows->p99_ms == 99.0f );
+    RCHECK( shadows && shadows->name_hash == hash_calculate( "shadows" ) );
+
+    // Repeated passes are summed in the frame, missing ones are not samples.
+    const GpuPassStatistics* lighting = find_pass( statistics, "lighting" );
+    RCHECK( lighting && lighting->samples == 100 && lighting->min_ms == 2.0f && lighting->max_ms == 2.0f && lighting->p99_ms == 2.0f );
+    const GpuPassStatistics* ssao = find_pass( statistics, "ssao" );
+    RCHECK( ssao && ssao->samples == 50 && ssao->average_ms == 0.5f );
+
+    GpuPipelineStatisticsSummary summary;
+    capture.compute_pipeline_statistics( summary );
+    RCHECK( summary.frames == 100 && summary.min[ 0 ] == 0 && summary.max[ 0 ] == 990 && summary.average[ 0 ] == 495.0 );
+    RCHECK( summary.min[ 6 ] == 6 && summary.max[ 6 ] == 996 && summary.average[ 6 ] == 501.0 );
+
+    // Same capture with slower shadows, no ssao and a new bloom pass.
+    GpuProfilerCapture current_capture;
+    current_capture.init( allocator, 100, 4 );
+    current_capture.recording = true;
+    record_statistics_frames( current_capture, 1.1f );
+
+    Array<GpuPassStatistics> current;
+    current.init( allocator, 8 );
+    current_capture.compute_pass_statistics( current );
+    for ( u32 i = 0; i < current.size; ++i ) {
+        if ( strcmp( current[ i ].name, "ssao" ) == 0 ) {
+            current[ i ].name = "bloom";
+            current[ i ].name_hash = hash_calculate( "bloom" );
+        }
+    }
+
+    Array<GpuPassRegression> regressions;
+    regressions.init( allocator, 8 );
+    RCHECK( gpu_profiler_compare_statistics( statistics, current, 0.05f, 1.0f, regressions ) == 1 );
+    RCHECK( regressions.size == 4 );
+
+    const GpuPassRegression* shadows_regression = find_regression( regressions, "shadows" );
+    RCHECK( shadows_regression && shadows_regression->regressed && !shadows_regression->added && !shadows_regression->removed );
+    RCHECK( shadows_regression && shadows_regression->baseline_p95_ms == 95.0f && fabsf( shadows_regression->current_p95_ms - 104.5f ) < 1e-3f );
+    const GpuPassRegression* lighting_regression = find_regression( regressions, "lighting" );
+    RCHECK( lighting_regression && !lighting_regression->regressed && !lighting_regression->added && !lighting_regression->removed );
+    const GpuPassRegression* bloom_regression = find_regression( regressions, "bloom" );
+    RCHECK( bloom_regression && bloom_regression->added && !bloom_regression->regressed );
+    const GpuPassRegression* ssao_regression = find_regression( regressions, "ssao" );
+    RCHECK( ssao_regression && ssao_regression->removed && ssao_regression->baseline_average_ms == 0.5f );
+
+    // Under the relative threshold or the absolute delta nothing regresses.
+    RCHECK( gpu_profiler_compare_statistics( statistics, current, 0.2f, 1.0f, regressions ) == 0 );
+    RCHECK( gpu_profiler_compare_statistics( statistics, current, 0.05f, 20.0f, regressions ) == 0 );
+
+    regressions.shutdown();
+    current.shutdown();
+    current_capture.shutdown();
+    statistics.shutdown();
+    capture.shutdown();
+}
+
+// Chrome trace events and CSV files, with names to escape.
+RTEST( gpu_profiler_capture_export ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    GpuProfilerCapture capture;
+    capture.init( allocator, 4, 8 );
+    capture.recording = true;
+
+    GPUTimeQuery timestamps[ 8 ];
+    const u32 num_timestamps = fill_frame( timestamps, "gbuffer \"main\", c:\\" );
+    GpuPipelineStatistics pipeline_statistics;
+    for ( u32 s = 0; s < GpuPipelineStatistics::Count; ++s ) {
+        pipeline_statistics.statistics[ s ] = 100 + s;
+    }
+    capture.record_frame( timestamps, num_timestamps, &pipeline_statistics, 16.0 );
+    capture.record_frame( timestamps, num_timestamps, &pipeline_statistics, 32.5 );
+
+    char path[ k_max_path ];
+    sizet size = 0;
+
+    // Trace: one complete event per query and a counter per frame, in microseconds.
+    strcpy( path, test_temporary_path( "gpu_profiler_capture.json" ) );
+    RCHECK( capture.write_chrome_trace( path ) );
+    char* text = read_text( path, &size );
+    nlohmann::json trace = nlohmann::json::parse( text, text + size, nullptr, false );
+    rfree( text, allocator );
+    file_delete( path );
+
+    RCHECK( !trace.is_discarded() && trace[ "traceEvents" ].size() == 14 );
+    if ( !trace.is_discarded() && trace[ "traceEvents" ].size() == 14 ) {
+        const nlohmann::json& events = trace[ "traceEvents" ];
+        RCHECK( events[ 0 ][ "name" ] == "gbuffer \"main\", c:\\" && events[ 0 ][ "ph" ] == "X" && events[ 0 ][ "tid" ] == 0 );
+
+        // Second frame, sort pass.
+        const nlohmann::json& sort = events[ 10 ];
+        RCHECK( sort[ "name" ] == "sort" && sort[ "args" ][ "frame" ] == 1 && sort[ "args" ][ "depth" ] == 2 );
+        RCHECK( fabs( sort[ "ts" ].get<f64>() - 35500.0 ) < 1e-3 && fabs( sort[ "dur" ].get<f64>() - 500.0 ) < 1e-3 );
+        RCHECK( events[ 11 ][ "tid" ] == 1 );
+
+        const nlohmann::json& counter = events[ 13 ];
+        RCHECK( counter[ "ph" ] == "C" && counter[ "args" ][ "vertices" ] == 100 && counter[ "args" ][ "compute_shader_invocations" ] == 106 );
+        RCHECK( fabs( counter[ "ts" ].get<f64>() - 32500.0 ) < 1e-3 );
+    }
+
+    // Queries: quotes doubled in quoted names.
+    strcpy( path, test_temporary_path( "gpu_profiler_capture.csv" ) );
+    RCHECK( capture.write_csv( path ) );
+    text = read_text( path, &size );
+    RCHECK( strncmp( text, "frame,cpu_time_ms,track,depth,name,start_ms,elapsed_ms\n", 55 ) == 0 );
+    RCHECK( strstr( text, "\n0,16.0000,0,0,\"gbuffer \"\"main\"\", c:\\\",0.0000,5.0000\n" ) != nullptr );
+    RCHECK( strstr( text, "\n1,32.5000,0,2,\"sort\",3.0000,0.5000\n" ) != nullptr );
+    RCHECK( strstr( text, "\n1,32.5000,1,1,\"culling\",0.0000,1.0000\n" ) != nullptr );
+    rfree( text, allocator );
+    file_delete( path );
+
+    strcpy( path, test_temporary_path( "gpu_profiler_capture_frames.csv" ) );
+    RCHECK( capture.write_frames_csv( path ) );
+    text = read_text( path, &size );
+    RCHECK( strstr( text, "frame,cpu_time_ms,gpu_frame_ms,queries,vertices,primitives,vertex_shader_invocations,clipping_invocations,"
+                          "clipping_primitives,fragment_shader_invocations,compute_shader_invocations\n" ) == text );
+    RCHECK( strstr( text, "\n1,32.5000,7.0000,6,100,101,102,103,104,105,106\n" ) != nullptr );
+    rfree( text, allocator );
+    file_delete( path );
+
+    Array<GpuPassStatistics> statistics;
+    statistics.init( allocator, 8 );
+    capture.compute_pass_statistics( statistics );
+
+    strcpy( path, test_temporary_path( "gpu_profiler_statistics.csv" ) );
+    RCHECK( gpu_profiler_write_statistics_csv( path, statistics ) );
+    text = read_text( path, &size );
+    RCHECK( strstr( text, "name,samples,min_ms,average_ms,p95_ms,p99_ms,max_ms\n" ) == text );
+    RCHECK( strstr( text, "\n\"transparent\",2,1.5000,1.5000,1.5000,1.5000,1.5000\n" ) != nullptr );
+    RCHECK( strstr( text, "\n\"gbuffer \"\"main\"\", c:\\\",2," ) != nullptr );
+    rfree( text, allocator );
+    file_delete( path );
+
+    statistics.shutdown();
+    capture.shutdown();
+}
+
+// Cost of recording a frame of the size of the chapter frame graph, and of the statistics and export at the end.
+RBENCHMARK( gpu_profiler_capture_benchmark ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    const u32 max_frames = 1000;
+    const u32 queries_per_frame = 256;
+
+    GpuProfilerCapture capture;
+    capture.init( allocator, max_frames, queries_per_frame );
+    capture.recording = true;
+
+    char pass_names[ 64 ][ 32 ];
+    GPUTimeQuery timestamps[ queries_per_frame ];
+    for ( u32 t = 0; t < queries_per_frame; ++t ) {
+        sprintf( pass_names[ t % 64 ], "pass_%u", t % 64 );
+        set_query( timestamps[ t ], pass_names[ t % 64 ], 0.01 + ( t % 7 ) * 0.02, ( u16 )( t % 4 ) );
+    }
+
+    GpuPipelineStatistics pipeline_statistics = { };
+
+    i64 start = time_now();
+    for ( u32 f = 0; f < max_frames; ++f ) {
+        capture.record_frame( timestamps, queries_per_frame, &pipeline_statistics, f * 16.0 );
+    }
+    const f64 record_ms = time_from_milliseconds( start );
+
+    Array<GpuPassStatistics> statistics;
+    statistics.init( allocator, 64 );
+    start = time_now();
+    capture.compute_pass_statistics( statistics );
+    const f64 statistics_ms = time_from_milliseconds( start );
+
+    char path[ k_max_path ];
+    strcpy( path, test_temporary_path( "gpu_profiler_capture_benchmark.json" ) );
+    start = time_now();
+    capture.write_chrome_trace( path );
+    const f64 trace_ms = time_from_milliseconds( start );
+    file_delete( path );
+
+    rprint( "%u frames of %u queries: record %.4f ms per frame, pass statistics %.2f ms, chrome trace %.2f ms\n", max_frames, queries_per_frame,
+            record_ms / max_frames, statistics_ms, trace_ms );
+
+    statistics.shutdown();
+    capture.shutdown();
+}
+
+} // namespace raptor
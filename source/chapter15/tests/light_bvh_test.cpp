@@ -0,0 +1,383 @@
+#include "graphics/light_bvh.hpp"
+
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include "external/cglm/struct/vec3.h"
+#include "external/cglm/struct/mat4.h"
+#include "external/cglm/struct/cam.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+namespace raptor {
+
+static f32 random_f32( f32 min_value, f32 max_value ) {
+    return min_value + ( max_value - min_value ) * ( rand() / ( f32 )RAND_MAX );
+}
+
+// Small lights spread in a city sized box, with a few clusters denser than the rest.
+static void generate_lights( Array<vec4s>& spheres, Array<f32>& intensities, u32 count, u32 seed ) {
+    srand( seed );
+    spheres.set_size( count );
+    intensities.set_size( count );
+
+    for ( u32 l = 0; l < count; ++l ) {
+        const bool clustered = ( l % 4 ) == 0;
+        const f32 extent = clustered ? 20.0f : 500.0f;
+        const f32 cluster_x = clustered ? ( f32 )( ( l / 4 ) % 8 ) * 100.0f - 400.0f : 0.0f;
+
+        spheres[ l ] = { cluster_x + random_f32( -extent, extent ), random_f32( 0.0f, 50.0f ), random_f32( -extent, extent ), random_f32( 0.5f, 15.0f ) };
+        intensities[ l ] = random_f32( 0.1f, 10.0f );
+    }
+}
+
+static void random_frustum( vec4s* planes, vec3s& camera_position ) {
+    camera_position = { random_f32( -400.0f, 400.0f ), random_f32( 2.0f, 40.0f ), random_f32( -400.0f, 400.0f ) };
+    const vec3s target = { random_f32( -400.0f, 400.0f ), random_f32( 0.0f, 20.0f ), random_f32( -400.0f, 400.0f ) };
+
+    const mat4s view = glms_lookat( camera_position, target, { 0, 1, 0 } );
+    const mat4s projection = glms_perspective( glm_rad( random_f32( 30.0f, 100.0f ) ), 16.0f / 9.0f, 0.1f, random_f32( 50.0f, 600.0f ) );
+    light_bvh_frustum_planes( glms_mat4_mul( projection, view ), planes );
+}
+
+static bool brute_force_sphere_in_planes( vec4s sphere, const vec4s* planes ) {
+    for ( u32 p = 0; p < 6; ++p ) {
+        if ( planes[ p ].x * sphere.x + planes[ p ].y * sphere.y + planes[ p ].z * sphere.z + planes[ p ].w < -sphere.w ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void brute_force_planes( const Array<vec4s>& spheres, const vec4s* planes, Array<u32>& out_lights ) {
+    out_lights.clear();
+    for ( u32 l = 0; l < spheres.size; ++l ) {
+        if ( brute_force_sphere_in_planes( spheres[ l ], planes ) ) {
+            out_lights.push( l );
+        }
+    }
+}
+
+static void brute_force_sphere( const Array<vec4s>& spheres, vec4s sphere, Array<u32>& out_lights ) {
+    out_lights.clear();
+    for ( u32 l = 0; l < spheres.size; ++l ) {
+        const f32 radius = spheres[ l ].w + sphere.w;
+        if ( glms_vec3_distance2( glms_vec3( spheres[ l ] ), glms_vec3( sphere ) ) <= radius * radius ) {
+            out_lights.push( l );
+        }
+    }
+}
+
+// Same lights, in any order and without duplicates.
+static bool same_lights( Array<u32>& lights, const Array<u32>& expected ) {
+    std::sort( lights.data, lights.data + lights.size );
+    if ( lights.size != expected.size ) {
+        return false;
+    }
+    for ( u32 i = 0; i < lights.size; ++i ) {
+        if ( lights[ i ] != expected[ i ] ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Nodes bound their children and cover contiguous leaves, every light has one leaf.
+static bool check_hierarchy( const LightBVH& bvh, const Array<vec4s>& spheres ) {
+    bool valid = bvh.nodes.size == ( spheres.size > 1 ? spheres.size - 1 : 0 );
+
+    for ( u32 l = 0; l < spheres.size && valid; ++l ) {
+        const u32 leaf = bvh.light_leaves[ l ];
+        valid = leaf < spheres.size && bvh.sorter.values[ leaf ] == l && memcmp( &bvh.leaf_spheres[ leaf ], &spheres[ l ], sizeof( vec4s ) ) == 0;
+    }
+
+    for ( u32 n = 0; n < bvh.nodes.size && valid; ++n ) {
+        const LightBVHNode& node = bvh.nodes[ n ];
+        valid = node.first_leaf < node.last_leaf && node.last_leaf < spheres.size;
+
+        for ( u32 leaf = node.first_leaf; leaf <= node.last_leaf && valid; ++leaf ) {
+            const vec4s& s = bvh.leaf_spheres[ leaf ];
+            valid = s.x - s.w >= node.aabb_min.x && s.y - s.w >= node.aabb_min.y && s.z - s.w >= node.aabb_min.z &&
+                    s.x + s.w <= node.aabb_max.x && s.y + s.w <= node.aabb_max.y && s.z + s.w <= node.aabb_max.z;
+        }
+
+        // Children split the leaves of their parent.
+        const u32 left_last = ( node.left & k_light_bvh_leaf_flag ) ? node.left & ~k_light_bvh_leaf_flag : bvh.nodes[ node.left ].last_leaf;
+        const u32 right_first = ( node.right & k_light_bvh_leaf_flag ) ? node.right & ~k_light_bvh_leaf_flag : bvh.nodes[ node.right ].first_leaf;
+        valid = valid && left_last + 1 == right_first;
+    }
+
+    return valid;
+}
+
+// Frustum and sphere queries against the brute force results. Returns the number of mismatches.
+static u32 compare_queries( const LightBVH& bvh, const Array<vec4s>& spheres, u32 query_count, Array<u32>& lights, Array<u32>& expected ) {
+    u32 mismatches = 0;
+    for ( u32 q = 0; q < query_count; ++q ) {
+        vec4s planes[ 6 ];
+        vec3s camera_position;
+        random_frustum( planes, camera_position );
+
+        lights.clear();
+        bvh.query_planes( planes, 6, lights );
+        brute_force_planes( spheres, planes, expected );
+        mismatches += same_lights( lights, expected ) ? 0 : 1;
+
+        const vec4s sphere = { random_f32( -500.0f, 500.0f ), random_f32( 0.0f, 50.0f ), random_f32( -500.0f, 500.0f ), random_f32( 0.0f, 60.0f ) };
+        lights.clear();
+        bvh.query_sphere( sphere, lights );
+        brute_force_sphere( spheres, sphere, expected );
+        mismatches += same_lights( lights, expected ) ? 0 : 1;
+    }
+    return mismatches;
+}
+
+RTEST( light_bvh_brute_force ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize( 4 );
+
+    Array<vec4s> spheres;
+    spheres.init( allocator, 8 );
+    Array<f32> intensities;
+    intensities.init( allocator, 8 );
+    Array<u32> lights, expected;
+    lights.init( allocator, 64 );
+    expected.init( allocator, 64 );
+
+    LightBVH bvh;
+    bvh.init( allocator, 16 );
+
+    // Past min_parallel_count the stages run as tasks.
+    const u32 counts[] = { 0, 1, 2, 3, 100, 1000, 10000 };
+    for ( u32 c = 0; c < ArraySize( counts ); ++c ) {
+        generate_lights( spheres, intensities, counts[ c ], 42 + c );
+
+        bvh.build( spheres.data, spheres.size, &task_scheduler );
+        RCHECK( check_hierarchy( bvh, spheres ) );
+        RCHECK( compare_queries( bvh, spheres, 50, lights, expected ) == 0 );
+
+        // Lights moving a little keep the hierarchy, the bounds follow them.
+        for ( u32 l = 0; l < spheres.size; ++l ) {
+            spheres[ l ].x += random_f32( -5.0f, 5.0f );
+            spheres[ l ].z += random_f32( -5.0f, 5.0f );
+            spheres[ l ].w *= random_f32( 0.5f, 2.0f );
+        }
+        bvh.refit( spheres.data, &task_scheduler );
+        RCHECK( check_hierarchy( bvh, spheres ) );
+        RCHECK( compare_queries( bvh, spheres, 50, lights, expected ) == 0 );
+    }
+
+    // Same results built on a single thread.
+    bvh.build( spheres.data, spheres.size, nullptr );
+    RCHECK( check_hierarchy( bvh, spheres ) && compare_queries( bvh, spheres, 20, lights, expected ) == 0 );
+
+    // Lights at the same position share their Morton codes.
+    for ( u32 l = 0; l < 64; ++l ) {
+        spheres[ l ] = { 1.0f, 2.0f, 3.0f, 1.0f + l };
+    }
+    spheres.set_size( 64 );
+    bvh.build( spheres.data, spheres.size, nullptr );
+    RCHECK( check_hierarchy( bvh, spheres ) && compare_queries( bvh, spheres, 20, lights, expected ) == 0 );
+
+    bvh.shutdown();
+    expected.shutdown();
+    lights.shutdown();
+    intensities.shutdown();
+    spheres.shutdown();
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+RTEST( light_bvh_update_and_selection ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    Array<vec4s> spheres;
+    spheres.init( allocator, 8 );
+    Array<f32> intensities;
+    intensities.init( allocator, 8 );
+    generate_lights( spheres, intensities, 2000, 7 );
+
+    LightBVH bvh;
+    bvh.init( allocator, 16 );
+    bvh.rebuild_interval = 3;
+
+    // Refits until the interval, rebuilds then and whenever the count changes.
+    bvh.update( spheres.data, spheres.size, nullptr );
+    RCHECK( bvh.refits_since_build == 0 );
+    bvh.update( spheres.data, spheres.size, nullptr );
+    bvh.update( spheres.data, spheres.size, nullptr );
+    bvh.update( spheres.data, spheres.size, nullptr );
+    RCHECK( bvh.refits_since_build == 3 );
+    bvh.update( spheres.data, spheres.size, nullptr );
+    RCHECK( bvh.refits_since_build == 0 );
+    bvh.update( spheres.data, spheres.size, nullptr );
+    bvh.update( spheres.data, spheres.size - 1, nullptr );
+    RCHECK( bvh.refits_since_build == 0 && bvh.light_count == spheres.size - 1 );
+    bvh.update( spheres.data, spheres.size, nullptr );
+
+    // The selection keeps the visible lights with the highest scores, highest first.
+    Array<u32> selected, visible;
+    selected.init( allocator, 64 );
+    visible.init( allocator, 64 );
+    Array<f32> scores, expected_scores;
+    scores.init( allocator, 64 );
+    expected_scores.init( allocator, 64 );
+
+    u32 wrong_selections = 0;
+    for ( u32 q = 0; q < 50; ++q ) {
+        vec4s planes[ 6 ];
+        vec3s camera_position;
+        random_frustum( planes, camera_position );
+        const u32 max_lights = q % 5 == 0 ? 1 : 32;
+
+        bvh.select_lights( planes, camera_position, intensities.data, max_lights, selected, scores );
+
+        brute_force_planes( spheres, planes, visible );
+        expected_scores.clear();
+        for ( u32 i = 0; i < visible.size; ++i ) {
+            const vec4s& sphere = spheres[ visible[ i ] ];
+            const f32 distance2 = glms_vec3_distance2( glms_vec3( sphere ), camera_position );
+            const f32 radius2 = sphere.w * sphere.w;
+            const f32 coverage = distance2 > radius2 ? 0.5f * ( 1.f - sqrtf( 1.f - radius2 / distance2 ) ) : 1.f;
+            expected_scores.push( coverage * intensities[ visible[ i ] ] );
+        }
+        std::sort( expected_scores.data, expected_scores.data + expected_scores.size, []( f32 a, f32 b ) { return a > b; } );
+
+        const u32 expected_count = visible.size < max_lights ? visible.size : max_lights;
+        bool valid = selected.size == expected_count && scores.size == expected_count;
+        for ( u32 i = 0; i < expected_count && valid; ++i ) {
+            valid = scores[ i ] == expected_scores[ i ];
+        }
+        wrong_selections += valid ? 0 : 1;
+    }
+    RCHECK( wrong_selections == 0 );
+
+    expected_scores.shutdown();
+    scores.shutdown();
+    visible.shutdown();
+    selected.shutdown();
+    bvh.shutdown();
+    intensities.shutdown();
+    spheres.shutdown();
+}
+
+// Frustum culling should visit a small part of the tree, growing far slower than the number of lights.
+RTEST( light_bvh_scaling ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    Array<vec4s> spheres;
+    spheres.init( allocator, 8 );
+    Array<f32> intensities;
+    intensities.init( allocator, 8 );
+    Array<u32> lights;
+    lights.init( allocator, 64 );
+
+    LightBVH bvh;
+    bvh.init( allocator, 16 );
+
+    const u32 counts[] = { 1024, 16 * 1024, 64 * 1024 };
+    f32 visited_per_light[ ArraySize( counts ) ];
+    for ( u32 c = 0; c < ArraySize( counts ); ++c ) {
+        generate_lights( spheres, intensities, counts[ c ], 3 );
+        bvh.build( spheres.data, spheres.size, nullptr );
+
+        // Narrow frustums, the usual case for a camera in the scene.
+        srand( 11 );
+        u64 visited = 0, visible = 0;
+        for ( u32 q = 0; q < 100; ++q ) {
+            vec4s planes[ 6 ];
+            vec3s camera_position;
+            random_frustum( planes, camera_position );
+
+            lights.clear();
+            visited += bvh.query_planes( planes, 6, lights );
+            visible += lights.size;
+        }
+
+        visited_per_light[ c ] = ( f32 )visited / ( f32 )( counts[ c ] * 100 );
+        // Whole visible subtrees are added without visiting them.
+        RCHECK( visited < ( visible + 1 ) * 4 );
+    }
+
+    RCHECK( visited_per_light[ 2 ] < visited_per_light[ 0 ] && visited_per_light[ 2 ] < 0.5f );
+
+    bvh.shutdown();
+    lights.shutdown();
+    intensities.shutdown();
+    spheres.shutdown();
+}
+
+RBENCHMARK( light_bvh_scaling_benchmark ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize();
+
+    Array<vec4s> spheres;
+    spheres.init( allocator, 8 );
+    Array<f32> intensities;
+    intensities.init( allocator, 8 );
+    Array<u32> lights;
+    lights.init( allocator, 64 );
+
+    LightBVH bvh;
+    bvh.init( allocator, 16 );
+
+    const u32 query_count = 100;
+    rprint( "%u task threads, %u frustum queries\n", task_scheduler.GetNumTaskThreads(), query_count );
+
+    const u32 counts[] = { 1024, 4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024 };
+    for ( u32 c = 0; c < ArraySize( counts ); ++c ) {
+        generate_lights( spheres, intensities, counts[ c ], 5 );
+
+        i64 start = time_now();
+        bvh.build( spheres.data, spheres.size, nullptr );
+        const f64 build_ms = time_from_milliseconds( start );
+
+        start = time_now();
+        bvh.build( spheres.data, spheres.size, &task_scheduler );
+        const f64 parallel_build_ms = time_from_milliseconds( start );
+
+        start = time_now();
+        bvh.refit( spheres.data, &task_scheduler );
+        const f64 refit_ms = time_from_milliseconds( start );
+
+        vec4s planes[ query_count ][ 6 ];
+        srand( 11 );
+        for ( u32 q = 0; q < query_count; ++q ) {
+            vec3s camera_position;
+            random_frustum( planes[ q ], camera_position );
+        }
+
+        u64 visited = 0;
+        start = time_now();
+        for ( u32 q = 0; q < query_count; ++q ) {
+            lights.clear();
+            visited += bvh.query_planes( planes[ q ], 6, lights );
+        }
+        const f64 query_ms = time_from_milliseconds( start ) / query_count;
+
+        start = time_now();
+        for ( u32 q = 0; q < query_count; ++q ) {
+            brute_force_planes( spheres, planes[ q ], lights );
+        }
+        const f64 brute_force_ms = time_from_milliseconds( start ) / query_count;
+
+        rprint( "%7u lights: build %7.2f ms, tasks %6.2f ms, refit %6.2f ms, query %7.4f ms (%6llu nodes), brute force %7.4f ms\n", counts[ c ],
+                build_ms, parallel_build_ms, refit_ms, query_ms, ( unsigned long long )( visited / query_count ), brute_force_ms );
+    }
+
+    bvh.shutdown();
+    lights.shutdown();
+    intensities.shutdown();
+    spheres.shutdown();
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+} // namespace raptor
@@ -0,0 +1,200 @@
+#include "graphics/command_state_filter.hpp"
+#include "graphics/draw_sort.hpp"
+#include "graphics/material_table.hpp"
+
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include <string.h>
+
+namespace raptor {
+
+static GpuMaterial test_material( u32 id ) {
+    GpuMaterial material{ };
+    material.textures[ 0 ] = id;
+    material.textures[ 1 ] = id + 1;
+    material.textures[ 2 ] = u32_max;
+    material.textures[ 3 ] = u32_max;
+    material.base_color_factor = { 1.0f, 1.0f, 1.0f, 1.0f };
+    material.alpha_cutoff = 0.5f;
+    return material;
+}
+
+// Gpu copy of the table, filled with a pattern so that the slots written by upload can be told apart.
+struct MockMaterialBuffer {
+
+    GpuMaterial                     materials[ 16 ];
+
+    void                            poison()                { memset( materials, 0xcd, sizeof( materials ) ); }
+    bool                            is_poisoned( u32 index ) const;
+
+}; // struct MockMaterialBuffer
+
+bool MockMaterialBuffer::is_poisoned( u32 index ) const {
+    const u8* bytes = ( const u8* )&materials[ index ];
+    for ( u32 b = 0; b < sizeof( GpuMaterial ); ++b ) {
+        if ( bytes[ b ] != 0xcd ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+RTEST( material_table_allocation ) {
+    MaterialTable table;
+    table.init( &MemoryService::instance()->system_allocator, 4 );
+
+    for ( u32 m = 0; m < 6; ++m ) {
+        RCHECK( table.add( test_material( m * 10 ) ) == m );
+    }
+    RCHECK( table.size() == 6 && table.stats.live == 6 );
+
+    MockMaterialBuffer gpu;
+    gpu.poison();
+    RCHECK( table.needs_upload() );
+    table.upload( gpu.materials, ArraySize( gpu.materials ) );
+    RCHECK( !table.needs_upload() );
+    for ( u32 m = 0; m < 6; ++m ) {
+        RCHECK( memcmp( &gpu.materials[ m ], &table.materials[ m ], sizeof( GpuMaterial ) ) == 0 );
+    }
+    RCHECK( gpu.is_poisoned( 6 ) );
+
+    // Released at frame 10, the slot is not reused while that frame can be in flight.
+    table.release( 2, 10 );
+    RCHECK( table.stats.live == 5 && table.stats.retired == 1 );
+    RCHECK( table.add( test_material( 100 ) ) == 6 );
+    table.collect( 9 );
+    RCHECK( table.add( test_material( 110 ) ) == 7 );
+
+    table.collect( 10 );
+    RCHECK( table.stats.retired == 0 && table.free_indices.size == 1 );
+    RCHECK( table.add( test_material( 120 ) ) == 2 );
+    RCHECK( table.size() == 8 && table.stats.live == 8 );
+
+    // Only the slots written since the last upload are copied.
+    gpu.poison();
+    table.upload( gpu.materials, ArraySize( gpu.materials ) );
+    RCHECK( gpu.is_poisoned( 0 ) && gpu.is_poisoned( 1 ) );
+    RCHECK( memcmp( &gpu.materials[ 2 ], &table.materials[ 2 ], sizeof( GpuMaterial ) ) == 0 );
+    RCHECK( memcmp( &gpu.materials[ 7 ], &table.materials[ 7 ], sizeof( GpuMaterial ) ) == 0 );
+    RCHECK( gpu.is_poisoned( 8 ) );
+
+    // Releasing does not write the slot, in flight frames keep reading the old material.
+    table.release( 5, 11 );
+    RCHECK( !table.needs_upload() );
+
+    // Each slot comes back once its own frame completed.
+    table.release( 0, 13 );
+    table.release( 1, 12 );
+    table.collect( 12 );
+    RCHECK( table.stats.retired == 1 && table.free_indices.size == 2 );
+    table.collect( u64_max );
+    RCHECK( table.stats.retired == 0 && table.free_indices.size == 3 );
+
+    table.shutdown();
+}
+
+RTEST( material_table_deduplication ) {
+    MaterialTable table;
+    table.init( &MemoryService::instance()->system_allocator, 4 );
+
+    const u32 a = table.add( test_material( 1 ) );
+    const u32 b = table.add( test_material( 2 ) );
+    RCHECK( a != b );
+    RCHECK( table.add( test_material( 1 ) ) == a && table.add( test_material( 1 ) ) == a );
+    RCHECK( table.references[ a ] == 3 && table.stats.shared == 2 && table.stats.live == 2 );
+
+    // Shared content survives until the last reference is released.
+    table.release( a, 1 );
+    table.release( a, 1 );
+    RCHECK( table.stats.live == 2 && table.stats.retired == 0 );
+
+    // Unchanged content keeps its index.
+    RCHECK( table.update( a, test_material( 1 ), 2 ) == a && table.references[ a ] == 1 );
+
+    // Content equal to another material moves to it, the old slot is retired.
+    RCHECK( table.update( a, test_material( 2 ), 3 ) == b );
+    RCHECK( table.references[ b ] == 2 && table.stats.live == 1 && table.stats.retired == 1 );
+
+    // A retired slot is not found by content anymore.
+    const u32 c = table.add( test_material( 1 ) );
+    RCHECK( c != a && c == 2 );
+
+    // Same hash, different content: the new material gets its own slot and is not cached.
+    GpuMaterial colliding = test_material( 3 );
+    table.hash_to_index.insert( hash_bytes( ( void* )&colliding, sizeof( GpuMaterial ) ), b );
+    const u32 d = table.add( colliding );
+    const u32 e = table.add( colliding );
+    RCHECK( d != b && e != d && table.stats.collisions == 2 );
+
+    // Padding is part of the content.
+    GpuMaterial padded = test_material( 1 );
+    padded.padding_[ 0 ] = 1;
+    RCHECK( table.add( padded ) != c );
+
+    table.shutdown();
+}
+
+//
+// Draws of a glTF scene: many meshes, few materials, sorted by pipeline and material.
+RBENCHMARK( material_table_draw_binds ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    const u32 mesh_count = 20000;
+    const u32 material_count = 64;
+    const u32 pipeline_count = 4;
+    const u32 frame_count = 100;
+
+    MaterialTable table;
+    table.init( allocator, material_count );
+
+    Array<u32> mesh_materials;
+    mesh_materials.init( allocator, mesh_count, mesh_count );
+    i64 start = time_now();
+    for ( u32 m = 0; m < mesh_count; ++m ) {
+        mesh_materials[ m ] = table.add( test_material( ( m * 7 ) % material_count ) );
+    }
+    const f64 add_ms = time_from_milliseconds( start );
+    RCHECK( table.stats.live == material_count );
+
+    DrawSorter sorter;
+    sorter.init( allocator, mesh_count );
+    sorter.begin( mesh_count );
+    for ( u32 m = 0; m < mesh_count; ++m ) {
+        sorter.keys[ m ] = draw_sort_key( 0, m % pipeline_count, mesh_materials[ m ], m & 0xffff, m );
+    }
+    sorter.sort( nullptr );
+
+    rprint( "%u meshes, %u materials in the table (%.1f ns per add)\n", mesh_count, table.stats.live, add_ms * 1e6 / mesh_count );
+
+    // Per mesh material sets, then the table: one set for all meshes and the material index in the instance.
+    cstring names[ 2 ] = { "per mesh sets", "material table" };
+    const u32 dynamic_offsets[ 1 ] = { 0 };
+    for ( u32 mode = 0; mode < 2; ++mode ) {
+        CommandStateFilter filter;
+        u64 draws = 0;
+        start = time_now();
+        for ( u32 frame = 0; frame < frame_count; ++frame ) {
+            filter.reset();
+            for ( u32 d = 0; d < mesh_count; ++d ) {
+                const u32 mesh = sorter.values[ d ];
+                filter.bind_pipeline( 0, 1 + mesh % pipeline_count, 1 );
+                filter.bind_descriptor_set( mode == 0 ? 1000 + mesh : 1000, dynamic_offsets, 0 );
+                ++draws;
+            }
+        }
+        const f64 record_ms = time_from_milliseconds( start );
+
+        rprint( "%-16s %8u descriptor set binds per frame, %5.1f ns per draw\n", names[ mode ], filter.stats.descriptor_set_binds / frame_count,
+                record_ms * 1e6 / draws );
+    }
+
+    sorter.shutdown();
+    mesh_materials.shutdown();
+    table.shutdown();
+}
+
+} // namespace raptor
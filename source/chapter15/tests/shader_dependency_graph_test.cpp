@@ -0,0 +1,171 @@
+#include "graphics/shader_dependency_graph.hpp"
+
+#include "foundation/memory.hpp"
+
+#include "tests/test.hpp"
+
+namespace raptor {
+
+// Two techniques sharing a header, the fragment stage of the first one reaching it through another include.
+static const char* s_forward_json = R"({
+    "name": "forward",
+    "pipelines": [
+        { "name": "main", "shaders": [
+            { "stage": "vertex", "shader": "forward.vert", "includes": [ "platform.h", "scene.h" ] },
+            { "stage": "fragment", "shader": "forward.frag", "includes": [ "platform.h" ] } ] },
+        { "name": "depth", "shaders": [
+            { "stage": "vertex", "shader": "depth.vert", "includes": [ "platform.h" ] } ] }
+    ]
+})";
+
+static const char* s_composite_json = R"({
+    "name": "composite",
+    "pipelines": [
+        { "name": "main", "shaders": [
+            { "stage": "compute", "shader": "composite.comp", "includes": [ "platform.h" ] } ] }
+    ]
+})";
+
+static bool contains( const Array<u64>& keys, u64 key ) {
+    for ( u32 i = 0; i < keys.size; ++i ) {
+        if ( keys[ i ] == key ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct DependencyGraphTest {
+
+    void                            init();
+    void                            shutdown();
+
+    // Invalidates the file and collects the dirty techniques and stages.
+    u32                             change( cstring file_name );
+
+    ShaderDependencyGraph           graph;
+    Array<u32>                      dirty_techniques;
+    Array<u64>                      dirty_stages;
+
+    u32                             forward             = u32_max;
+    u32                             composite           = u32_max;
+
+}; // struct DependencyGraphTest
+
+void DependencyGraphTest::init() {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+    graph.init( allocator, 4 );
+    dirty_techniques.init( allocator, 4 );
+    dirty_stages.init( allocator, 8 );
+
+    forward = graph.add_technique( "forward.json", s_forward_json );
+    composite = graph.add_technique( "composite.json", s_composite_json );
+
+    graph.scan_includes( graph.find_file( "forward.frag" ), "#version 460\n#include \"lighting.h\"\nvoid main() {}\n" );
+    graph.scan_includes( graph.add_file( "lighting.h" ), "  #include <scene.h>\n#include \"brdf.h\"\n" );
+    graph.scan_includes( graph.add_file( "scene.h" ), "struct Scene { int a; };\n" );
+}
+
+void DependencyGraphTest::shutdown() {
+    dirty_stages.shutdown();
+    dirty_techniques.shutdown();
+    graph.shutdown();
+}
+
+u32 DependencyGraphTest::change( cstring file_name ) {
+    dirty_techniques.clear();
+    dirty_stages.clear();
+    const u32 marked = graph.invalidate( graph.find_file( file_name ) );
+    graph.collect_dirty( dirty_techniques, dirty_stages );
+    return marked;
+}
+
+RTEST( shader_dependency_graph_invalidation ) {
+    DependencyGraphTest test;
+    test.init();
+    RCHECK( test.forward == 0 && test.composite == 1 );
+    RCHECK( test.graph.find_file( "brdf.h" ) != u32_max );
+
+    const u64 forward_vertex = shader_stage_key( "forward", "main", "vertex" );
+    const u64 forward_fragment = shader_stage_key( "forward", "main", "fragment" );
+    const u64 depth_vertex = shader_stage_key( "forward", "depth", "vertex" );
+
+    // A source only invalidates its own stage.
+    RCHECK( test.change( "forward.frag" ) == 1 );
+    RCHECK( test.dirty_techniques.size == 1 && test.dirty_techniques[ 0 ] == test.forward );
+    RCHECK( test.dirty_stages.size == 1 && test.dirty_stages[ 0 ] == forward_fragment );
+
+    // Includes found in the sources are followed: brdf.h -> lighting.h -> forward.frag.
+    RCHECK( test.change( "brdf.h" ) == 1 );
+    RCHECK( test.dirty_stages.size == 1 && test.dirty_stages[ 0 ] == forward_fragment );
+
+    // scene.h is listed by the vertex stage and included by the fragment one, each stage is marked once.
+    RCHECK( test.change( "scene.h" ) == 2 );
+    RCHECK( test.dirty_stages.size == 2 && contains( test.dirty_stages, forward_vertex ) && contains( test.dirty_stages, forward_fragment ) );
+
+    // A shared header invalidates every technique.
+    RCHECK( test.change( "platform.h" ) == 4 );
+    RCHECK( test.dirty_techniques.size == 2 && test.dirty_stages.size == 4 && contains( test.dirty_stages, depth_vertex ) );
+
+    // The json invalidates all the stages of its technique only.
+    RCHECK( test.change( "composite.json" ) == 1 );
+    RCHECK( test.dirty_techniques.size == 1 && test.dirty_techniques[ 0 ] == test.composite );
+
+    // Collected stages are clean, invalidating twice before collecting marks them once.
+    test.dirty_techniques.clear();
+    test.graph.collect_dirty( test.dirty_techniques, test.dirty_stages );
+    RCHECK( test.dirty_techniques.size == 0 );
+    RCHECK( test.graph.invalidate( test.graph.find_file( "depth.vert" ) ) == 1 );
+    RCHECK( test.graph.invalidate( test.graph.find_file( "depth.vert" ) ) == 0 );
+
+    // Unknown files are ignored.
+    RCHECK( test.graph.invalidate( u32_max ) == 0 );
+
+    test.shutdown();
+}
+
+RTEST( shader_dependency_graph_edits ) {
+    DependencyGraphTest test;
+    test.init();
+
+    // Removing an include drops the edge, adding one creates the file.
+    const u32 lighting = test.graph.find_file( "lighting.h" );
+    test.graph.scan_includes( lighting, "#include \"shadows.h\"\n#include \"shadows.h\"\n" );
+    RCHECK( test.graph.files[ lighting ].includes.size == 1 );
+    RCHECK( test.change( "brdf.h" ) == 0 );
+    RCHECK( test.change( "shadows.h" ) == 1 && test.dirty_stages[ 0 ] == shader_stage_key( "forward", "main", "fragment" ) );
+
+    // Include cycles and self includes terminate.
+    test.graph.scan_includes( test.graph.find_file( "shadows.h" ), "#include \"lighting.h\"\n#include \"shadows.h\"\n" );
+    RCHECK( test.change( "shadows.h" ) == 1 );
+    RCHECK( test.change( "lighting.h" ) == 1 );
+
+    // Unterminated directives are not includes.
+    test.graph.scan_includes( lighting, "#include \"broken.h\n#include <other.h\n" );
+    RCHECK( test.graph.files[ lighting ].includes.size == 0 && test.graph.find_file( "broken.h" ) == u32_max );
+
+    // A json being edited keeps the previous stages until it parses.
+    RCHECK( test.graph.add_technique( "forward.json", "{ \"name\": \"forward\", \"pipelines\": [" ) == u32_max );
+    RCHECK( test.change( "depth.vert" ) == 1 );
+
+    // Stages dropped from the json are not invalidated anymore, the new ones are.
+    const char* forward_json = R"({ "name": "forward", "pipelines": [
+        { "name": "main", "shaders": [ { "stage": "vertex", "shader": "forward_v2.vert", "includes": [ "platform.h" ] } ] } ] })";
+    RCHECK( test.graph.add_technique( "forward.json", forward_json ) == test.forward );
+    RCHECK( test.change( "depth.vert" ) == 0 && test.dirty_techniques.size == 0 );
+    RCHECK( test.change( "forward.vert" ) == 0 );
+    RCHECK( test.change( "forward_v2.vert" ) == 1 && test.dirty_stages[ 0 ] == shader_stage_key( "forward", "main", "vertex" ) );
+    RCHECK( test.change( "platform.h" ) == 2 && test.dirty_techniques.size == 2 );
+
+    // Dirty stages of a replaced technique are not reported.
+    test.graph.invalidate( test.graph.find_file( "forward_v2.vert" ) );
+    test.graph.add_technique( "forward.json", forward_json );
+    test.dirty_techniques.clear();
+    test.dirty_stages.clear();
+    test.graph.collect_dirty( test.dirty_techniques, test.dirty_stages );
+    RCHECK( test.dirty_stages.size == 0 );
+
+    test.shutdown();
+}
+
+} // namespace raptor
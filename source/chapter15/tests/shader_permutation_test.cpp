@@ -0,0 +1,163 @@
+#include "graphics/shader_permutation.hpp"
+
+#include "foundation/memory.hpp"
+
+#include "tests/test.hpp"
+
+#include <string.h>
+
+namespace raptor {
+
+static const char* s_lighting_json = R"({
+    "name": "lighting",
+    "features": [
+        { "name": "FOG", "default": true },
+        { "name": "SHADOWS" },
+        { "name": "DEBUG_LIGHTS", "specialization": true },
+        { "name": "CULLING", "specialization": true, "default": true },
+        { "default": true }
+    ],
+    "pipelines": []
+})";
+
+RTEST( shader_features_masks ) {
+    StringBuffer names;
+    names.init( rkilo( 1 ), &MemoryService::instance()->system_allocator );
+
+    ShaderFeatureSet features;
+    cstring technique_name = nullptr;
+    RCHECK( shader_features_parse( features, names, s_lighting_json, &technique_name ) );
+    RCHECK( strcmp( technique_name, "lighting" ) == 0 );
+
+    // Features without a name are skipped.
+    RCHECK( features.count == 4 );
+    RCHECK( features.find( "FOG" ) == 0 && features.find( "CULLING" ) == 3 && features.find( "MISSING" ) == u32_max );
+    RCHECK( features.default_mask() == 0b1001 );
+    RCHECK( features.specialization_mask() == 0b1100 );
+
+    // Only #define features need a compilation, bits past the features are ignored.
+    RCHECK( features.define_mask( 0b1111 ) == 0b0011 );
+    RCHECK( features.define_mask( 0xff00 | 0b0110 ) == 0b0010 );
+
+    StringBuffer arguments;
+    arguments.init( 256, &MemoryService::instance()->system_allocator );
+    RCHECK( strcmp( shader_features_defines( features, 0b1101, arguments ), " --D FOG=1 --D SHADOWS=0" ) == 0 );
+    RCHECK( strcmp( shader_features_defines( features, 0b0010, arguments ), " --D FOG=0 --D SHADOWS=1" ) == 0 );
+
+    // Adding a feature again updates it, a full set refuses new ones.
+    RCHECK( features.add( "SHADOWS", false, true ) == 1 && features.count == 4 && features.default_mask() == 0b1011 );
+    for ( u32 f = features.count; f < k_max_shader_features; ++f ) {
+        RCHECK( features.add( names.append_use_f( "EXTRA_%u", f ), false, false ) == f );
+    }
+    RCHECK( features.add( "ONE_TOO_MANY", false, false ) == u32_max );
+    RCHECK( features.define_mask( u32_max ) == ( ( ( 1u << k_max_shader_features ) - 1 ) & ~0b1100u ) );
+
+    RCHECK( !shader_features_parse( features, names, "{ \"features\": [", nullptr ) );
+
+    arguments.shutdown();
+    names.shutdown();
+}
+
+RTEST( shader_variant_keys ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    // Every technique, pass and mask combination gets its own key.
+    cstring techniques[] = { "lighting", "light", "gbuffer" };
+    cstring passes[] = { "main", "ingmain", "depth", "" };
+
+    const u32 mask_count = 1 << 10;
+    const u32 key_count = ArraySize( techniques ) * ArraySize( passes ) * mask_count;
+
+    FlatHashMap<u64, u32> keys;
+    keys.init( allocator, key_count * 2 );
+    keys.set_default_value( u32_max );
+
+    u32 duplicates = 0;
+    for ( u32 t = 0; t < ArraySize( techniques ); ++t ) {
+        for ( u32 p = 0; p < ArraySize( passes ); ++p ) {
+            const u64 pass_key = shader_pass_key( techniques[ t ], passes[ p ] );
+            RCHECK( pass_key == shader_pass_key( techniques[ t ], passes[ p ] ) );
+
+            for ( u32 mask = 0; mask < mask_count; ++mask ) {
+                const u64 key = shader_variant_key( pass_key, mask );
+                duplicates += keys.get( key ) != u32_max ? 1 : 0;
+                keys.insert( key, mask );
+            }
+        }
+    }
+    RCHECK( duplicates == 0 && keys.size == key_count );
+
+    // Names are not concatenated before hashing.
+    RCHECK( shader_pass_key( "light", "ingmain" ) != shader_pass_key( "lighting", "main" ) );
+
+    keys.shutdown();
+}
+
+RTEST( shader_variant_deduplication ) {
+    StringBuffer names;
+    names.init( rkilo( 1 ), &MemoryService::instance()->system_allocator );
+    ShaderFeatureSet features;
+    shader_features_parse( features, names, s_lighting_json );
+
+    ShaderVariantCache cache;
+    cache.init( &MemoryService::instance()->system_allocator, 4 );
+
+    // The same request returns the same variant, without compiling again.
+    const u32 fog = cache.request( "lighting", "main", features, 0b0001 );
+    RCHECK( cache.request( "lighting", "main", features, 0b0001 ) == fog );
+    RCHECK( cache.find( shader_pass_key( "lighting", "main" ), 0b0001 ) == fog );
+    RCHECK( cache.stats.lookups == 2 && cache.stats.requested_variants == 1 && cache.pending_modules.size == 1 );
+
+    // Specialization features share the module of the same #defines.
+    const u32 fog_debug = cache.request( "lighting", "main", features, 0b0101 );
+    const u32 fog_culling = cache.request( "lighting", "main", features, 0b1001 );
+    RCHECK( cache.variants[ fog_debug ].module == cache.variants[ fog ].module );
+    RCHECK( cache.variants[ fog_culling ].module == cache.variants[ fog ].module );
+    RCHECK( cache.variants[ fog_debug ].specialization_mask == 0b0100 );
+    RCHECK( cache.stats.specialized_variants == 2 && cache.modules.size == 1 );
+
+    // New #defines and other passes are new modules, compiled in request order.
+    const u32 shadows = cache.request( "lighting", "main", features, 0b0011 );
+    const u32 transparent = cache.request( "lighting", "transparent", features, 0b0001 );
+    const u32 transparent_debug = cache.request( "lighting", "transparent", features, 0b0101 );
+    RCHECK( cache.modules.size == 3 && cache.stats.requested_modules == 3 );
+
+    const u32 fog_module = cache.pop_pending_module();
+    const u32 shadows_module = cache.pop_pending_module();
+    const u32 transparent_module = cache.pop_pending_module();
+    RCHECK( fog_module == cache.variants[ fog ].module && shadows_module == cache.variants[ shadows ].module );
+    RCHECK( transparent_module == cache.variants[ transparent ].module && cache.pop_pending_module() == u32_max );
+    RCHECK( cache.modules[ fog_module ].state == ShaderModuleState_Compiling );
+
+    // Same Spir-V in the same pass is kept once, never across passes with different pipeline states.
+    RCHECK( cache.module_compiled( fog_module, 0x1234 ) == fog_module );
+    RCHECK( cache.module_compiled( shadows_module, 0x1234 ) == fog_module );
+    RCHECK( cache.module_compiled( transparent_module, 0x1234 ) == transparent_module );
+    RCHECK( cache.stats.compiled_modules == 3 && cache.stats.deduplicated_spirv == 1 );
+
+    // Pipelines are shared by the same Spir-V and specialization values.
+    const u64 fog_pipeline = cache.pipeline_key( fog );
+    RCHECK( cache.find_pipeline( fog_pipeline ) == u32_max );
+    cache.add_pipeline( fog_pipeline, 7 );
+    RCHECK( cache.pipeline_key( shadows ) == fog_pipeline && cache.find_pipeline( cache.pipeline_key( shadows ) ) == 7 );
+    RCHECK( cache.pipeline_key( fog_debug ) != fog_pipeline && cache.pipeline_key( fog_debug ) != cache.pipeline_key( fog_culling ) );
+    RCHECK( cache.pipeline_key( transparent ) != fog_pipeline && cache.pipeline_key( transparent_debug ) != cache.pipeline_key( fog_debug ) );
+    RCHECK( cache.stats.created_pipelines == 1 && cache.stats.shared_pipelines == 1 );
+
+    // Failed modules are not queued again.
+    const u32 broken = cache.request( "lighting", "broken", features, 0 );
+    const u32 broken_module = cache.pop_pending_module();
+    cache.module_failed( broken_module );
+    RCHECK( cache.variants[ broken ].module == broken_module && cache.modules[ broken_module ].state == ShaderModuleState_Failed );
+    RCHECK( cache.request( "lighting", "broken", features, 0 ) == broken && cache.pending_modules.size == 0 );
+
+    // Cleared when the sources change, requests start over.
+    cache.clear();
+    RCHECK( cache.find( shader_pass_key( "lighting", "main" ), 0b0001 ) == u32_max );
+    RCHECK( cache.request( "lighting", "main", features, 0b0001 ) == 0 && cache.pending_modules.size == 1 );
+
+    cache.shutdown();
+    names.shutdown();
+}
+
+} // namespace raptor
@@ -0,0 +1,231 @@
+#include "graphics/shadow_cache.hpp"
+
+#include "foundation/memory.hpp"
+
+#include "tests/test.hpp"
+
+#include "external/cglm/struct/affine.h"
+#include "external/cglm/struct/cam.h"
+#include "external/cglm/struct/mat4.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+namespace raptor {
+
+static f32 random_f32( f32 min_value, f32 max_value ) {
+    return min_value + ( max_value - min_value ) * ( rand() / ( f32 )RAND_MAX );
+}
+
+// Same faces as the cubemap array rendered by PointlightShadowPass.
+static void cubemap_view_projections( vec3s position, f32 radius, mat4s* out_view_projections ) {
+    static const vec3s s_directions[ k_shadow_cache_faces ] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+    static const vec3s s_ups[ k_shadow_cache_faces ] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+
+    const mat4s left_handed_scale_matrix = glms_scale_make( { 1, 1, -1 } );
+    const mat4s projection = glms_perspective( glm_rad( 90.f ), 1.f, 0.01f, radius );
+
+    for ( u32 f = 0; f < k_shadow_cache_faces; ++f ) {
+        const mat4s view = glms_mat4_mul( left_handed_scale_matrix, glms_look( position, s_directions[ f ], s_ups[ f ] ) );
+        out_view_projections[ f ] = glms_mat4_mul( projection, view );
+    }
+}
+
+// Faces whose clip volume contains the point.
+static u32 point_faces( const mat4s* view_projections, vec3s point ) {
+    u32 faces = 0;
+    for ( u32 f = 0; f < k_shadow_cache_faces; ++f ) {
+        const vec4s clip = glms_mat4_mulv( view_projections[ f ], vec4s{ point.x, point.y, point.z, 1.0f } );
+        const bool inside = fabsf( clip.x ) <= clip.w && fabsf( clip.y ) <= clip.w && fabsf( clip.z ) <= clip.w;
+        faces |= inside ? ( 1 << f ) : 0;
+    }
+    return faces;
+}
+
+struct ShadowCacheTest {
+
+    void                            init( u32 max_lights );
+    void                            shutdown();
+
+    // Moves or resizes the light like the shadow pass does.
+    void                            set_light( u32 light_index, vec3s position, f32 radius );
+
+    // The face containing the point, to name the faces independently of their order.
+    u32                             face_of( u32 light_index, vec3s point ) const;
+
+    PointlightShadowCache           cache;
+    mat4s                           view_projections[ 4 ][ k_shadow_cache_faces ];
+
+}; // struct ShadowCacheTest
+
+void ShadowCacheTest::init( u32 max_lights ) {
+    RASSERT( max_lights <= ArraySize( view_projections ) );
+    cache.init( &MemoryService::instance()->system_allocator, max_lights, 4 );
+}
+
+void ShadowCacheTest::shutdown() {
+    cache.shutdown();
+}
+
+void ShadowCacheTest::set_light( u32 light_index, vec3s position, f32 radius ) {
+    if ( cache.update_light( light_index, position, radius ) ) {
+        cubemap_view_projections( position, radius, view_projections[ light_index ] );
+        cache.set_light_faces( light_index, view_projections[ light_index ] );
+    }
+}
+
+u32 ShadowCacheTest::face_of( u32 light_index, vec3s point ) const {
+    return point_faces( view_projections[ light_index ], point );
+}
+
+RTEST( shadow_cache_dirty_faces ) {
+    ShadowCacheTest test;
+    test.init( 2 );
+
+    const vec3s light_position = { 10, 2, -5 };
+
+    // A new light renders all its faces once.
+    test.cache.begin_frame( 1 );
+    test.set_light( 0, light_position, 8 );
+    RCHECK( test.cache.consume_faces( 0 ) == k_shadow_cache_all_faces && test.cache.stats.light_changes == 1 );
+
+    const u32 x_face = test.face_of( 0, { 14, 2, -5 } );
+    const u32 y_face = test.face_of( 0, { 10, 6, -5 } );
+    const u32 z_face = test.face_of( 0, { 10, 2, -9 } );
+    RCHECK( x_face && y_face && z_face && ( x_face & ( x_face - 1 ) ) == 0 && x_face != y_face && y_face != z_face );
+
+    // Nothing changed: every face is cached.
+    test.cache.begin_frame( 1 );
+    test.set_light( 0, light_position, 8 );
+    RCHECK( test.cache.consume_faces( 0 ) == 0 && test.cache.stats.faces_skipped == 6 && test.cache.stats.light_changes == 0 );
+
+    // A new static caster invalidates the faces it touches, then is cached.
+    test.cache.begin_frame( 1 );
+    test.cache.update_caster( 0, { 14, 2, -5, 0.5f }, false );
+    RCHECK( test.cache.consume_faces( 0 ) == x_face && test.cache.stats.static_changes == 1 );
+
+    test.cache.begin_frame( 1 );
+    test.cache.update_caster( 0, { 14, 2, -5, 0.5f }, false );
+    RCHECK( test.cache.consume_faces( 0 ) == 0 && test.cache.stats.static_changes == 0 );
+
+    // Moving it invalidates the faces it left and the ones it enters.
+    test.cache.begin_frame( 1 );
+    test.cache.update_caster( 0, { 10, 6, -5, 0.5f }, false );
+    RCHECK( test.cache.consume_faces( 0 ) == ( x_face | y_face ) );
+
+    // Casters out of the light range touch nothing.
+    test.cache.begin_frame( 1 );
+    test.cache.update_caster( 1, { 40, 2, -5, 1.0f }, false );
+    RCHECK( test.cache.consume_faces( 0 ) == 0 && test.cache.stats.static_changes == 1 );
+
+    // Dynamic casters render their faces every frame, and the faces they left once more.
+    test.cache.begin_frame( 1 );
+    test.cache.update_caster( 2, { 10, 2, -9, 0.5f }, true );
+    RCHECK( test.cache.consume_faces( 0 ) == z_face && test.cache.stats.faces_dynamic == 1 && test.cache.stats.dynamic_casters == 1 );
+
+    test.cache.begin_frame( 1 );
+    test.cache.update_caster( 2, { 10, 2, -9, 0.5f }, true );
+    RCHECK( test.cache.consume_faces( 0 ) == z_face );
+
+    test.cache.begin_frame( 1 );
+    test.cache.update_caster( 2, { 14, 2, -5, 0.5f }, true );
+    RCHECK( test.cache.consume_faces( 0 ) == ( x_face | z_face ) && test.cache.stats.faces_dynamic == 2 );
+
+    // A dynamic caster becoming static is rendered a last time where it stays.
+    test.cache.begin_frame( 1 );
+    test.cache.update_caster( 2, { 14, 2, -5, 0.5f }, false );
+    RCHECK( test.cache.consume_faces( 0 ) == x_face && test.cache.stats.faces_dynamic == 0 && test.cache.stats.static_changes == 1 );
+
+    test.cache.begin_frame( 1 );
+    test.cache.update_caster( 2, { 14, 2, -5, 0.5f }, false );
+    RCHECK( test.cache.consume_faces( 0 ) == 0 );
+
+    test.shutdown();
+}
+
+RTEST( shadow_cache_invalidation ) {
+    ShadowCacheTest test;
+    test.init( 2 );
+
+    test.cache.begin_frame( 2 );
+    test.set_light( 0, { 0, 0, 0 }, 5 );
+    test.set_light( 1, { 20, 0, 0 }, 5 );
+    test.cache.consume_faces( 0 );
+    test.cache.consume_faces( 1 );
+
+    // Moving or resizing a light invalidates its faces only.
+    test.cache.begin_frame( 2 );
+    test.set_light( 0, { 0, 1, 0 }, 5 );
+    RCHECK( test.cache.consume_faces( 0 ) == k_shadow_cache_all_faces && test.cache.consume_faces( 1 ) == 0 );
+
+    test.cache.begin_frame( 2 );
+    test.set_light( 1, { 20, 0, 0 }, 6 );
+    RCHECK( test.cache.consume_faces( 0 ) == 0 && test.cache.consume_faces( 1 ) == k_shadow_cache_all_faces );
+
+    // A caster between the two lights only touches the faces in range.
+    test.cache.begin_frame( 2 );
+    test.cache.update_caster( 0, { 4, 1, 0, 0.5f }, false );
+    RCHECK( test.cache.consume_faces( 0 ) == test.face_of( 0, { 4, 1, 0 } ) && test.cache.consume_faces( 1 ) == 0 );
+
+    // A light disabled for a frame has lost its depth when enabled again, even without moving.
+    test.cache.begin_frame( 1 );
+    RCHECK( test.cache.consume_faces( 0 ) == 0 );
+    test.cache.begin_frame( 2 );
+    test.set_light( 1, { 20, 0, 0 }, 6 );
+    RCHECK( test.cache.consume_faces( 0 ) == 0 && test.cache.consume_faces( 1 ) == k_shadow_cache_all_faces );
+    RCHECK( test.cache.stats.light_changes == 1 && test.cache.stats.faces_rendered == 6 && test.cache.stats.faces_skipped == 6 );
+
+    // Invalidating everything, e.g. for new textures.
+    test.cache.begin_frame( 2 );
+    test.cache.invalidate_all();
+    RCHECK( test.cache.consume_faces( 0 ) == k_shadow_cache_all_faces && test.cache.consume_faces( 1 ) == k_shadow_cache_all_faces );
+
+    // Casters moving while a light waits for its faces do not touch it.
+    test.cache.begin_frame( 2 );
+    test.cache.update_light( 0, { 0, 2, 0 }, 5 );
+    test.cache.update_caster( 0, { 4, 1, 2, 0.5f }, false );
+    RCHECK( test.cache.lights[ 0 ].valid == false && test.cache.consume_faces( 0 ) == k_shadow_cache_all_faces );
+
+    test.shutdown();
+}
+
+// Spheres are tested against the face frustums: any face reached by a point of the sphere must be reported.
+RTEST( shadow_cache_sphere_faces ) {
+    ShadowCacheTest test;
+    test.init( 1 );
+    srand( 41 );
+
+    const vec3s light_position = { 3, -1, 2 };
+    const f32 light_radius = 10;
+    test.cache.begin_frame( 1 );
+    test.set_light( 0, light_position, light_radius );
+    const ShadowCacheLight& light = test.cache.lights[ 0 ];
+
+    u32 missed = 0, faces_found = 0, faces_reported = 0;
+    for ( u32 s = 0; s < 2000; ++s ) {
+        const vec4s sphere = { light_position.x + random_f32( -16, 16 ), light_position.y + random_f32( -16, 16 ),
+                               light_position.z + random_f32( -16, 16 ), random_f32( 0.05f, 3.0f ) };
+        const u32 faces = test.cache.sphere_faces( light, sphere );
+
+        u32 sampled_faces = 0;
+        for ( u32 p = 0; p < 400; ++p ) {
+            vec3s direction = { random_f32( -1, 1 ), random_f32( -1, 1 ), random_f32( -1, 1 ) };
+            const f32 length = sqrtf( direction.x * direction.x + direction.y * direction.y + direction.z * direction.z );
+            const f32 distance = length > 0.f ? sphere.w * ( p & 1 ? 1.0f : random_f32( 0, 1 ) ) / length : 0.f;
+
+            sampled_faces |= point_faces( test.view_projections[ 0 ], { sphere.x + direction.x * distance, sphere.y + direction.y * distance, sphere.z + direction.z * distance } );
+        }
+
+        missed += ( sampled_faces & ~faces ) ? 1 : 0;
+        faces_found += sampled_faces ? 1 : 0;
+        faces_reported += faces ? 1 : 0;
+    }
+
+    // Conservative but not everything: far spheres are rejected.
+    RCHECK( missed == 0 );
+    RCHECK( faces_found > 100 && faces_reported >= faces_found && faces_reported < 2000 );
+
+    test.shutdown();
+}
+
+} // namespace raptor
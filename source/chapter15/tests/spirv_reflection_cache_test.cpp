@@ -0,0 +1,409 @@
+#include "graphics/spirv_reflection_cache.hpp"
+
+#include "foundation/file.hpp"
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include <initializer_list>
+#include <string.h>
+
+namespace raptor {
+
+//
+// Writes Spir-V words, enough of the format for the reflection parser.
+struct SpirvModuleWriter {
+
+    void                            init( Allocator* allocator );
+    void                            shutdown();
+
+    u32                             new_id()            { return id_bound++; }
+
+    void                            op( SpvOp op, std::initializer_list<u32> operands );
+    // Instruction ending with a literal string, e.g. OpName.
+    void                            op_string( SpvOp op, std::initializer_list<u32> operands, cstring string );
+
+    const u32*                      data()              { words[ 3 ] = id_bound; return words.data; }
+    sizet                           size() const        { return words.size * sizeof( u32 ); }
+
+    Array<u32>                      words;
+    u32                             id_bound            = 1;
+
+}; // struct SpirvModuleWriter
+
+void SpirvModuleWriter::init( Allocator* allocator ) {
+    words.init( allocator, 256 );
+    id_bound = 1;
+
+    // Magic, version 1.3, generator, bound and schema.
+    words.push( 0x07230203 );
+    words.push( 0x00010300 );
+    words.push( 0 );
+    words.push( 0 );
+    words.push( 0 );
+}
+
+void SpirvModuleWriter::shutdown() {
+    words.shutdown();
+}
+
+void SpirvModuleWriter::op( SpvOp op, std::initializer_list<u32> operands ) {
+    words.push( ( ( u32 )( operands.size() + 1 ) << 16 ) | op );
+    for ( u32 operand : operands ) {
+        words.push( operand );
+    }
+}
+
+void SpirvModuleWriter::op_string( SpvOp op, std::initializer_list<u32> operands, cstring string ) {
+    const u32 string_words = ( u32 )strlen( string ) / 4 + 1;
+    words.push( ( ( u32 )( operands.size() + string_words + 1 ) << 16 ) | op );
+    for ( u32 operand : operands ) {
+        words.push( operand );
+    }
+
+    const u32 first_word = words.size;
+    for ( u32 w = 0; w < string_words; ++w ) {
+        words.push( 0 );
+    }
+    memcpy( &words[ first_word ], string, strlen( string ) );
+}
+
+// Compute shader with a uniform buffer, a storage buffer, a sampled and a storage image, the bindless textures,
+// push constants and a specialization constant. Extra uniform buffers fill set 3, to make the stage bigger.
+static void write_compute_module( SpirvModuleWriter& module, u32 extra_buffers ) {
+    const u32 main = module.new_id();
+    const u32 type_void = module.new_id();
+    const u32 type_function = module.new_id();
+    const u32 type_uint = module.new_id();
+    const u32 type_float = module.new_id();
+    const u32 type_vec4 = module.new_id();
+    const u32 type_vec4_array = module.new_id();
+    const u32 type_constants = module.new_id();
+    const u32 type_particles = module.new_id();
+    const u32 type_push = module.new_id();
+    const u32 type_image = module.new_id();
+    const u32 type_storage_image = module.new_id();
+    const u32 type_sampled_image = module.new_id();
+    const u32 type_textures = module.new_id();
+    const u32 pointer_constants = module.new_id();
+    const u32 pointer_particles = module.new_id();
+    const u32 pointer_push = module.new_id();
+    const u32 pointer_sampled_image = module.new_id();
+    const u32 pointer_storage_image = module.new_id();
+    const u32 pointer_textures = module.new_id();
+    const u32 constants = module.new_id();
+    const u32 particles = module.new_id();
+    const u32 push = module.new_id();
+    const u32 albedo = module.new_id();
+    const u32 output_image = module.new_id();
+    const u32 textures = module.new_id();
+    const u32 subgroup_size = module.new_id();
+    const u32 first_extra = module.id_bound;
+    module.id_bound += extra_buffers;
+
+    module.op( SpvOpCapability, { SpvCapabilityShader } );
+    module.op( SpvOpMemoryModel, { SpvAddressingModelLogical, SpvMemoryModelGLSL450 } );
+    module.op_string( SpvOpEntryPoint, { SpvExecutionModelGLCompute, main }, "main" );
+    module.op( SpvOpExecutionMode, { main, SpvExecutionModeLocalSize, 8, 4, 1 } );
+
+    module.op_string( SpvOpName, { main }, "main" );
+    module.op_string( SpvOpName, { type_constants }, "Constants" );
+    module.op_string( SpvOpMemberName, { type_constants, 0 }, "color" );
+    module.op_string( SpvOpName, { type_particles }, "Particles" );
+    module.op_string( SpvOpName, { type_push }, "PushConstants" );
+    module.op_string( SpvOpName, { albedo }, "albedo" );
+    module.op_string( SpvOpName, { output_image }, "output_image" );
+    module.op_string( SpvOpName, { textures }, "global_textures" );
+    module.op_string( SpvOpName, { subgroup_size }, "SUBGROUP_SIZE" );
+
+    module.op( SpvOpDecorate, { type_constants, SpvDecorationBlock } );
+    module.op( SpvOpMemberDecorate, { type_constants, 0, SpvDecorationOffset, 0 } );
+    module.op( SpvOpMemberDecorate, { type_constants, 1, SpvDecorationOffset, 16 } );
+    module.op( SpvOpDecorate, { constants, SpvDecorationDescriptorSet, 1 } );
+    module.op( SpvOpDecorate, { constants, SpvDecorationBinding, 0 } );
+    module.op( SpvOpDecorate, { type_particles, SpvDecorationBlock } );
+    module.op( SpvOpMemberDecorate, { type_particles, 0, SpvDecorationOffset, 0 } );
+    module.op( SpvOpDecorate, { particles, SpvDecorationDescriptorSet, 1 } );
+    module.op( SpvOpDecorate, { particles, SpvDecorationBinding, 2 } );
+    module.op( SpvOpDecorate, { albedo, SpvDecorationDescriptorSet, 1 } );
+    module.op( SpvOpDecorate, { albedo, SpvDecorationBinding, 1 } );
+    module.op( SpvOpDecorate, { output_image, SpvDecorationDescriptorSet, 2 } );
+    module.op( SpvOpDecorate, { output_image, SpvDecorationBinding, 0 } );
+    module.op( SpvOpDecorate, { textures, SpvDecorationDescriptorSet, 0 } );
+    module.op( SpvOpDecorate, { textures, SpvDecorationBinding, 10 } );
+    module.op( SpvOpDecorate, { type_push, SpvDecorationBlock } );
+    module.op( SpvOpMemberDecorate, { type_push, 0, SpvDecorationOffset, 0 } );
+    module.op( SpvOpMemberDecorate, { type_push, 1, SpvDecorationOffset, 16 } );
+    module.op( SpvOpDecorate, { subgroup_size, SpvDecorationSpecId, 3 } );
+    for ( u32 e = 0; e < extra_buffers; ++e ) {
+        module.op( SpvOpDecorate, { first_extra + e, SpvDecorationDescriptorSet, 3 } );
+        module.op( SpvOpDecorate, { first_extra + e, SpvDecorationBinding, extra_buffers - e } );
+    }
+
+    module.op( SpvOpTypeVoid, { type_void } );
+    module.op( SpvOpTypeFunction, { type_function, type_void } );
+    module.op( SpvOpTypeInt, { type_uint, 32, 0 } );
+    module.op( SpvOpTypeFloat, { type_float, 32 } );
+    module.op( SpvOpTypeVector, { type_vec4, type_float, 4 } );
+    module.op( SpvOpTypeRuntimeArray, { type_vec4_array, type_vec4 } );
+    module.op( SpvOpTypeStruct, { type_constants, type_vec4, type_uint } );
+    module.op( SpvOpTypeStruct, { type_particles, type_vec4_array } );
+    module.op( SpvOpTypeStruct, { type_push, type_uint, type_vec4 } );
+    module.op( SpvOpTypeImage, { type_image, type_float, SpvDim2D, 0, 0, 0, 1, SpvImageFormatUnknown } );
+    module.op( SpvOpTypeImage, { type_storage_image, type_float, SpvDim2D, 0, 0, 0, 2, SpvImageFormatRgba8 } );
+    module.op( SpvOpTypeSampledImage, { type_sampled_image, type_image } );
+    module.op( SpvOpTypeRuntimeArray, { type_textures, type_sampled_image } );
+    module.op( SpvOpTypePointer, { pointer_constants, SpvStorageClassUniform, type_constants } );
+    module.op( SpvOpTypePointer, { pointer_particles, SpvStorageClassStorageBuffer, type_particles } );
+    module.op( SpvOpTypePointer, { pointer_push, SpvStorageClassPushConstant, type_push } );
+    module.op( SpvOpTypePointer, { pointer_sampled_image, SpvStorageClassUniformConstant, type_sampled_image } );
+    module.op( SpvOpTypePointer, { pointer_storage_image, SpvStorageClassUniformConstant, type_storage_image } );
+    module.op( SpvOpTypePointer, { pointer_textures, SpvStorageClassUniformConstant, type_textures } );
+    module.op( SpvOpSpecConstant, { type_uint, subgroup_size, 32 } );
+
+    module.op( SpvOpVariable, { pointer_constants, constants, SpvStorageClassUniform } );
+    module.op( SpvOpVariable, { pointer_particles, particles, SpvStorageClassStorageBuffer } );
+    module.op( SpvOpVariable, { pointer_push, push, SpvStorageClassPushConstant } );
+    module.op( SpvOpVariable, { pointer_sampled_image, albedo, SpvStorageClassUniformConstant } );
+    module.op( SpvOpVariable, { pointer_storage_image, output_image, SpvStorageClassUniformConstant } );
+    module.op( SpvOpVariable, { pointer_textures, textures, SpvStorageClassUniformConstant } );
+    for ( u32 e = 0; e < extra_buffers; ++e ) {
+        module.op( SpvOpVariable, { pointer_constants, first_extra + e, SpvStorageClassUniform } );
+    }
+
+    module.op( SpvOpFunction, { type_void, main, SpvFunctionControlMaskNone, type_function } );
+    module.op( SpvOpLabel, { module.new_id() } );
+    module.op( SpvOpReturn, { } );
+    module.op( SpvOpFunctionEnd, { } );
+}
+
+// Expected reflection of write_compute_module without extra buffers.
+static void check_compute_reflection( const spirv::ParseResult& result ) {
+    // Set 0 only holds the bindless textures, managed by the device.
+    RCHECK( result.set_count == 3 );
+    RCHECK( result.sets[ 0 ].num_bindings == 0 );
+
+    // Bindings are sorted by index.
+    const DescriptorSetLayoutCreation& set_1 = result.sets[ 1 ];
+    RCHECK( set_1.set_index == 1 && set_1.num_bindings == 3 );
+    if ( set_1.num_bindings == 3 ) {
+        RCHECK( set_1.bindings[ 0 ].index == 0 && set_1.bindings[ 0 ].type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER && set_1.bindings[ 0 ].count == 1 );
+        RCHECK( set_1.bindings[ 0 ].name && strcmp( set_1.bindings[ 0 ].name, "Constants" ) == 0 );
+        RCHECK( set_1.bindings[ 1 ].index == 1 && set_1.bindings[ 1 ].type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER );
+        RCHECK( set_1.bindings[ 1 ].name && strcmp( set_1.bindings[ 1 ].name, "albedo" ) == 0 );
+        RCHECK( set_1.bindings[ 2 ].index == 2 && set_1.bindings[ 2 ].type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER );
+        RCHECK( set_1.bindings[ 2 ].name && strcmp( set_1.bindings[ 2 ].name, "Particles" ) == 0 );
+    }
+
+    const DescriptorSetLayoutCreation& set_2 = result.sets[ 2 ];
+    RCHECK( set_2.set_index == 2 && set_2.num_bindings == 1 );
+    RCHECK( set_2.bindings[ 0 ].index == 0 && set_2.bindings[ 0 ].type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE );
+    RCHECK( set_2.bindings[ 0 ].name && strcmp( set_2.bindings[ 0 ].name, "output_image" ) == 0 );
+
+    // uint + vec4, rounded up to 16 bytes.
+    RCHECK( result.push_constants_stride == 32 );
+    RCHECK( result.compute_local_size.x == 8 && result.compute_local_size.y == 4 && result.compute_local_size.z == 1 );
+
+    RCHECK( result.specialization_constants_count == 1 );
+    RCHECK( result.specialization_constants[ 0 ].binding == 3 && result.specialization_constants[ 0 ].default_value.value.value_u == 32 );
+    RCHECK( strcmp( result.specialization_names[ 0 ].name, "SUBGROUP_SIZE" ) == 0 );
+}
+
+RTEST( spirv_reflection_golden ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    SpirvModuleWriter module;
+    module.init( allocator );
+    write_compute_module( module, 0 );
+
+    StringBuffer names;
+    names.init( rkilo( 4 ), allocator );
+
+    spirv::ParseResult* result = ( spirv::ParseResult* )allocator->allocate( sizeof( spirv::ParseResult ), 64 );
+    memset( ( void* )result, 0, sizeof( spirv::ParseResult ) );
+    spirv::parse_binary( module.data(), module.size(), names, result );
+    check_compute_reflection( *result );
+
+    // The cache returns the same reflection, parsed once.
+    SpirvReflectionCache cache;
+    cache.init( allocator, 4 );
+
+    const spirv::ParseResult* cached = cache.get( module.data(), module.size() );
+    check_compute_reflection( *cached );
+    RCHECK( cache.get( module.data(), module.size() ) == cached );
+    RCHECK( cache.stats.misses == 1 && cache.stats.hits == 1 && cache.stats.parsed_bytes == module.size() );
+
+    // Names live in the cache, not in the scratch memory of the parser.
+    cache.parse_names.clear();
+    memset( cache.parse_names.data, 0, cache.parse_names.buffer_size );
+    check_compute_reflection( *cached );
+
+    // Another stage is another entry.
+    SpirvModuleWriter bigger_module;
+    bigger_module.init( allocator );
+    write_compute_module( bigger_module, 4 );
+    const spirv::ParseResult* bigger = cache.get( bigger_module.data(), bigger_module.size() );
+    RCHECK( bigger != cached && cache.stats.misses == 2 );
+    RCHECK( bigger->set_count == 4 && bigger->sets[ 3 ].num_bindings == 4 && bigger->sets[ 3 ].bindings[ 0 ].index == 1 );
+
+    cache.shutdown();
+    bigger_module.shutdown();
+
+    allocator->deallocate( result );
+    names.shutdown();
+    module.shutdown();
+}
+
+RTEST( spirv_reflection_cache_file ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    SpirvModuleWriter modules[ 2 ];
+    modules[ 0 ].init( allocator );
+    write_compute_module( modules[ 0 ], 0 );
+    modules[ 1 ].init( allocator );
+    write_compute_module( modules[ 1 ], 6 );
+
+    char path[ k_max_path ];
+    strcpy( path, test_temporary_path( "spirv_reflection_cache.bin" ) );
+    file_delete( path );
+
+    // First run: nothing to load, results are saved at shutdown.
+    SpirvReflectionCache first_run;
+    first_run.init( allocator, 4 );
+    RCHECK( !first_run.load( path ) );
+    first_run.get( modules[ 0 ].data(), modules[ 0 ].size() );
+    first_run.get( modules[ 1 ].data(), modules[ 1 ].size() );
+    RCHECK( first_run.dirty );
+    first_run.shutdown();
+    RCHECK( file_exists( path ) );
+
+    // Second run: results come from the mapped file, nothing is parsed or saved.
+    SpirvReflectionCache cache;
+    cache.init( allocator, 4 );
+    RCHECK( cache.load( path ) && cache.stats.loaded_entries == 2 );
+    check_compute_reflection( *cache.get( modules[ 0 ].data(), modules[ 0 ].size() ) );
+    const spirv::ParseResult* bigger = cache.get( modules[ 1 ].data(), modules[ 1 ].size() );
+    RCHECK( bigger->set_count == 4 && bigger->sets[ 3 ].num_bindings == 6 && strcmp( bigger->sets[ 3 ].bindings[ 5 ].name, "Constants" ) == 0 );
+    RCHECK( cache.stats.misses == 0 && cache.stats.hits == 2 && !cache.dirty );
+
+    // Validation parses the cached stages again, the loaded results match.
+    cache.validate = true;
+    cache.get( modules[ 0 ].data(), modules[ 0 ].size() );
+    cache.get( modules[ 1 ].data(), modules[ 1 ].size() );
+    RCHECK( cache.stats.mismatches == 0 && cache.stats.parsed_bytes == modules[ 0 ].size() + modules[ 1 ].size() );
+    cache.shutdown();
+
+    // A damaged entry is parsed again instead of being used.
+    FileReadResult file_data = file_read_binary( path, allocator );
+    RCHECK( file_data.data != nullptr );
+    SpirvReflectionBlob* blob = ( SpirvReflectionBlob* )file_data.data;
+    blob->entries[ 0 ].set_count = spirv::k_max_count + 1;
+    file_write_binary( path, file_data.data, file_data.size );
+
+    SpirvReflectionCache damaged;
+    damaged.init( allocator, 4 );
+    RCHECK( damaged.load( path ) && damaged.stats.loaded_entries == 1 );
+    check_compute_reflection( *damaged.get( modules[ 0 ].data(), modules[ 0 ].size() ) );
+    RCHECK( damaged.stats.misses == 1 );
+    damaged.shutdown();
+
+    // Files of another version are discarded.
+    blob->header.version = k_spirv_reflection_cache_version + 1;
+    file_write_binary( path, file_data.data, file_data.size );
+
+    SpirvReflectionCache outdated;
+    outdated.init( allocator, 4 );
+    RCHECK( !outdated.load( path ) && outdated.stats.loaded_entries == 0 );
+    outdated.shutdown();
+
+    rfree( file_data.data, allocator );
+    file_delete( path );
+
+    modules[ 0 ].shutdown();
+    modules[ 1 ].shutdown();
+}
+
+//
+// Stages of a technique parsed at every load, compared to the cache hits of the following runs.
+RBENCHMARK( spirv_reflection_cache_throughput ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    const u32 stage_count = 64;
+    const u32 repetitions = 20;
+
+    SpirvModuleWriter modules[ stage_count ];
+    sizet total_size = 0;
+    for ( u32 s = 0; s < stage_count; ++s ) {
+        modules[ s ].init( allocator );
+        write_compute_module( modules[ s ], 8 + s % 16 );
+        total_size += modules[ s ].size();
+    }
+
+    StringBuffer names;
+    names.init( 16000, allocator );
+    spirv::ParseResult* result = ( spirv::ParseResult* )allocator->allocate( sizeof( spirv::ParseResult ), 64 );
+
+    i64 start = time_now();
+    for ( u32 r = 0; r < repetitions; ++r ) {
+        for ( u32 s = 0; s < stage_count; ++s ) {
+            memset( ( void* )result, 0, sizeof( spirv::ParseResult ) );
+            names.clear();
+            spirv::parse_binary( modules[ s ].data(), modules[ s ].size(), names, result );
+        }
+    }
+    const f64 parse_ms = time_from_milliseconds( start );
+
+    char path[ k_max_path ];
+    strcpy( path, test_temporary_path( "spirv_reflection_benchmark.bin" ) );
+    file_delete( path );
+
+    SpirvReflectionCache first_run;
+    first_run.init( allocator, stage_count );
+    first_run.load( path );
+    for ( u32 s = 0; s < stage_count; ++s ) {
+        first_run.get( modules[ s ].data(), modules[ s ].size() );
+    }
+    first_run.shutdown();
+
+    // Each run maps the file and reads the entries of the stages it uses.
+    f64 load_ms = 0.0;
+    f64 hit_ms = 0.0;
+    for ( u32 r = 0; r < repetitions; ++r ) {
+        start = time_now();
+        SpirvReflectionCache cache;
+        cache.init( allocator, stage_count );
+        cache.load( path );
+        for ( u32 s = 0; s < stage_count; ++s ) {
+            cache.get( modules[ s ].data(), modules[ s ].size() );
+        }
+        load_ms += time_from_milliseconds( start );
+
+        // Pipelines sharing the stages only hash them.
+        start = time_now();
+        for ( u32 s = 0; s < stage_count; ++s ) {
+            cache.get( modules[ s ].data(), modules[ s ].size() );
+        }
+        hit_ms += time_from_milliseconds( start );
+
+        RCHECK( cache.stats.misses == 0 );
+        cache.shutdown();
+    }
+
+    const f64 megabytes = ( f64 )total_size * repetitions / ( 1024.0 * 1024.0 );
+    rprint( "%u stages, %.1f KB of Spir-V\n", stage_count, total_size / 1024.0 );
+    rprint( "parse             %8.3f ms per run, %8.1f MB/s\n", parse_ms / repetitions, megabytes / ( parse_ms / 1000.0 ) );
+    rprint( "load from file    %8.3f ms per run, %8.1f MB/s\n", load_ms / repetitions, megabytes / ( load_ms / 1000.0 ) );
+    rprint( "hit               %8.3f ms per run, %8.1f MB/s\n", hit_ms / repetitions, megabytes / ( hit_ms / 1000.0 ) );
+
+    file_delete( path );
+
+    allocator->deallocate( result );
+    names.shutdown();
+    for ( u32 s = 0; s < stage_count; ++s ) {
+        modules[ s ].shutdown();
+    }
+}
+
+} // namespace raptor
@@ -0,0 +1,271 @@
+#include "graphics/texture_streaming.hpp"
+
+#include "foundation/file.hpp"
+#include "foundation/memory.hpp"
+
+#include "tests/test.hpp"
+
+#include <stdlib.h>
+
+namespace raptor {
+
+static const sizet                  k_mip_tail_1024     = 0x15554;      // Mips 3-10 of a 1024x1024 RGBA8 texture.
+
+static TextureStreamerCreation simulation_creation( sizet budget_bytes ) {
+    TextureStreamerCreation creation;
+    creation.allocator = &MemoryService::instance()->system_allocator;
+    creation.budget_bytes = budget_bytes;
+    creation.simulation = true;
+    creation.simulation_latency_frames = 1;
+    creation.eviction_delay_frames = 4;
+    return creation;
+}
+
+static void fill_feedback( u32* feedback, u32 count, u32 mip ) {
+    for ( u32 t = 0; t < count; ++t ) {
+        feedback[ t ] = mip;
+    }
+}
+
+// Accounting must always match the mips actually resident, and the budget must hold once the mip tails fit.
+static void check_streamer_consistency( const TextureStreamer& streamer ) {
+    sizet resident = 0;
+    sizet pending = 0;
+    for ( u32 t = 0; t < streamer.textures.size; ++t ) {
+        const StreamedTexture& texture = streamer.textures[ t ];
+        resident += streamer.resident_size( t );
+        if ( texture.pending_mip != k_texture_streaming_no_pending ) {
+            pending += streamer.mip_size( t, texture.pending_mip );
+            RCHECK( texture.pending_mip + 1 == texture.resident_mip );
+        }
+        RCHECK( texture.resident_mip <= texture.mip_tail_first );
+    }
+
+    RCHECK( resident == streamer.stats.resident_bytes );
+    RCHECK( pending == streamer.stats.pending_bytes );
+    RCHECK( streamer.stats.resident_bytes + streamer.stats.pending_bytes <= streamer.budget_bytes );
+}
+
+RTEST( texture_streaming_mip_tail ) {
+    TextureStreamer streamer;
+    streamer.init( simulation_creation( rmega( 64 ) ) );
+
+    const u32 texture = streamer.register_texture( 1024, 1024, 11 );
+    RCHECK( streamer.textures[ texture ].mip_tail_first == 3 );
+    RCHECK( streamer.textures[ texture ].resident_mip == 3 );
+    RCHECK( streamer.stats.resident_bytes == k_mip_tail_1024 );
+
+    // Small textures are all tail.
+    const u32 small = streamer.register_texture( 64, 32, 7 );
+    RCHECK( streamer.textures[ small ].mip_tail_first == 0 );
+
+    streamer.shutdown();
+}
+
+RTEST( texture_streaming_one_mip_per_frame ) {
+    TextureStreamer streamer;
+    streamer.init( simulation_creation( rmega( 64 ) ) );
+    streamer.register_texture( 1024, 1024, 11 );
+
+    u32 feedback = 0;
+    u32 previous_mip = 3;
+    for ( u64 frame = 1; frame < 16; ++frame ) {
+        streamer.update( &feedback, 1, frame );
+        check_streamer_consistency( streamer );
+
+        const u32 resident_mip = streamer.textures[ 0 ].resident_mip;
+        RCHECK( resident_mip == previous_mip || resident_mip + 1 == previous_mip );
+        previous_mip = resident_mip;
+    }
+
+    RCHECK( streamer.textures[ 0 ].resident_mip == 0 );
+    RCHECK( streamer.stats.requests_issued == 3 && streamer.stats.requests_completed == 3 );
+    RCHECK( streamer.stats.resident_bytes == streamer.resident_size( 0 ) );
+
+    streamer.shutdown();
+}
+
+RTEST( texture_streaming_request_limit_and_priority ) {
+    TextureStreamerCreation creation = simulation_creation( rmega( 256 ) );
+    creation.max_requests_per_frame = 4;
+    creation.simulation_latency_frames = 100;
+
+    TextureStreamer streamer;
+    streamer.init( creation );
+
+    u32 feedback[ 10 ];
+    for ( u32 t = 0; t < 10; ++t ) {
+        streamer.register_texture( 1024, 1024, 11 );
+        // Textures further from their target first.
+        feedback[ t ] = t < 5 ? 0 : 2;
+    }
+
+    streamer.update( feedback, 10, 1 );
+    RCHECK( streamer.requests.size == 4 );
+    for ( u32 r = 0; r < streamer.requests.size; ++r ) {
+        RCHECK( streamer.requests[ r ].texture < 5 );
+        RCHECK( streamer.requests[ r ].mip == 2 );
+    }
+    for ( u32 r = 1; r < streamer.requests.size; ++r ) {
+        RCHECK( streamer.requests[ r - 1 ].priority >= streamer.requests[ r ].priority );
+    }
+
+    streamer.shutdown();
+}
+
+RTEST( texture_streaming_budget_evicts_least_recently_used ) {
+    // Tails of three textures plus mips 2 and 1 of one of them.
+    const sizet budget = 3 * k_mip_tail_1024 + rkilo( 256 ) + rmega( 1 );
+
+    TextureStreamer streamer;
+    streamer.init( simulation_creation( budget ) );
+    for ( u32 t = 0; t < 3; ++t ) {
+        streamer.register_texture( 1024, 1024, 11 );
+    }
+
+    // Texture 0 sampled at mip 1 fills the budget.
+    u32 feedback[ 3 ] = { 1, k_texture_streaming_not_requested, k_texture_streaming_not_requested };
+    u64 frame = 1;
+    for ( ; frame < 8; ++frame ) {
+        streamer.update( feedback, 3, frame );
+        check_streamer_consistency( streamer );
+    }
+    RCHECK( streamer.textures[ 0 ].resident_mip == 1 );
+    RCHECK( streamer.stats.resident_bytes == budget );
+
+    // Texture 2 sampled once, then texture 1: texture 0 is the least recently used and loses its mips first.
+    feedback[ 0 ] = k_texture_streaming_not_requested;
+    feedback[ 2 ] = 2;
+    streamer.update( feedback, 3, frame++ );
+    check_streamer_consistency( streamer );
+    RCHECK( streamer.evictions.size == 1 && streamer.evictions[ 0 ].texture == 0 && streamer.evictions[ 0 ].mip == 1 );
+
+    // Texture 1 needs all the memory: texture 0 is emptied before texture 2.
+    feedback[ 2 ] = k_texture_streaming_not_requested;
+    feedback[ 1 ] = 1;
+    for ( u32 i = 0; i < 4; ++i ) {
+        streamer.update( feedback, 3, frame++ );
+        check_streamer_consistency( streamer );
+        RCHECK( streamer.textures[ 2 ].resident_mip < 3 || streamer.textures[ 0 ].resident_mip == 3 );
+    }
+
+    RCHECK( streamer.textures[ 1 ].resident_mip == 1 );
+    RCHECK( streamer.textures[ 0 ].resident_mip == 3 );
+    RCHECK( streamer.textures[ 2 ].resident_mip == 3 );
+    RCHECK( streamer.stats.mips_evicted == 3 );
+    RCHECK( streamer.stats.peak_resident_bytes <= budget );
+
+    streamer.shutdown();
+}
+
+RTEST( texture_streaming_evicts_only_under_pressure ) {
+    TextureStreamerCreation creation = simulation_creation( 2 * k_mip_tail_1024 + rmega( 4 ) + rmega( 1 ) + rkilo( 256 ) );
+
+    TextureStreamer streamer;
+    streamer.init( creation );
+    streamer.register_texture( 1024, 1024, 11 );
+    streamer.register_texture( 1024, 1024, 11 );
+
+    u32 feedback[ 2 ] = { 0, k_texture_streaming_not_requested };
+    u64 frame = 1;
+    for ( ; frame < 8; ++frame ) {
+        streamer.update( feedback, 2, frame );
+    }
+    RCHECK( streamer.textures[ 0 ].resident_mip == 0 );
+
+    // Unsampled textures keep their mips past the eviction delay while nothing else needs the memory.
+    feedback[ 0 ] = k_texture_streaming_not_requested;
+    for ( u32 i = 0; i < creation.eviction_delay_frames + 8; ++i, ++frame ) {
+        streamer.update( feedback, 2, frame );
+        check_streamer_consistency( streamer );
+    }
+    RCHECK( streamer.textures[ 0 ].resident_mip == 0 );
+    RCHECK( streamer.stats.mips_evicted == 0 );
+
+    feedback[ 1 ] = 0;
+    for ( u32 i = 0; i < 8; ++i, ++frame ) {
+        streamer.update( feedback, 2, frame );
+        check_streamer_consistency( streamer );
+    }
+    RCHECK( streamer.textures[ 1 ].resident_mip == 0 );
+    RCHECK( streamer.textures[ 0 ].resident_mip == 3 );
+
+    streamer.shutdown();
+}
+
+RTEST( texture_streaming_feedback_replay ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    const u32 texture_count = 16;
+    const u32 frame_count = 300;
+    const sizet budget = texture_count * k_mip_tail_1024 + rmega( 6 );
+
+    TextureStreamer recorded;
+    recorded.init( simulation_creation( budget ) );
+
+    TextureStreamingFeedbackLog log;
+    log.init( allocator, texture_count, frame_count );
+
+    for ( u32 t = 0; t < texture_count; ++t ) {
+        recorded.register_texture( 1024, 1024, 11 );
+    }
+
+    // Camera like feedback: a moving window of visible textures, nearer ones at finer mips.
+    srand( 1234 );
+    u32 feedback[ texture_count ];
+    for ( u32 frame = 0; frame < frame_count; ++frame ) {
+        fill_feedback( feedback, texture_count, k_texture_streaming_not_requested );
+        const u32 first_visible = ( frame / 20 ) % texture_count;
+        for ( u32 v = 0; v < 5; ++v ) {
+            feedback[ ( first_visible + v ) % texture_count ] = ( v + rand() % 2 ) % 4;
+        }
+
+        log.record( feedback, texture_count );
+        recorded.update( feedback, texture_count, frame + 1 );
+        check_streamer_consistency( recorded );
+    }
+
+    RCHECK( recorded.stats.mips_evicted > 0 );
+    RCHECK( recorded.stats.requests_completed > 0 );
+
+    // Written, read back and replayed the streamer ends up in the same state.
+    cstring path = test_temporary_path( "texture_streaming_feedback.bin" );
+    RCHECK( log.write( path ) );
+
+    TextureStreamingFeedbackLog read_log;
+    read_log.init( allocator, 1, 1 );
+    RCHECK( read_log.read( path ) );
+    RCHECK( read_log.texture_count == texture_count && read_log.frame_count == frame_count );
+
+    TextureStreamer replayed;
+    replayed.init( simulation_creation( budget ) );
+    for ( u32 t = 0; t < texture_count; ++t ) {
+        replayed.register_texture( 1024, 1024, 11 );
+    }
+    read_log.replay( replayed, 1 );
+
+    for ( u32 t = 0; t < texture_count; ++t ) {
+        RCHECK( replayed.textures[ t ].resident_mip == recorded.textures[ t ].resident_mip );
+        RCHECK( replayed.textures[ t ].pending_mip == recorded.textures[ t ].pending_mip );
+    }
+    RCHECK( replayed.stats.resident_bytes == recorded.stats.resident_bytes );
+    RCHECK( replayed.stats.mips_evicted == recorded.stats.mips_evicted );
+    RCHECK( replayed.stats.requests_issued == recorded.stats.requests_issued );
+
+    // Truncated files are rejected.
+    FileHandle file;
+    file_open( path, "wb", &file );
+    const u32 truncated[ 3 ] = { TextureStreamingFeedbackLog::k_magic, TextureStreamingFeedbackLog::k_version, texture_count };
+    file_write( ( u8* )truncated, sizeof( u32 ), 3, file );
+    file_close( file );
+    RCHECK( !read_log.read( path ) );
+
+    file_delete( path );
+
+    replayed.shutdown();
+    read_log.shutdown();
+    log.shutdown();
+    recorded.shutdown();
+}
+
+} // namespace raptor
@@ -9,6 +9,8 @@
 #else
 #define MAX_PATH 65536
 #include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #endif
@@ -436,6 +438,133 @@ void file_write_binary( cstring filename, void* memory, sizet size ) {
     fclose( file );
 }
 
+// Mapped file //////////////////////////////////////////////////////////////////
+#if !defined(_WIN64)
+static int to_madvise( FileAccessHint::Enum hint ) {
+    switch ( hint ) {
+        case FileAccessHint::Sequential:
+            return MADV_SEQUENTIAL;
+        case FileAccessHint::Random:
+            return MADV_RANDOM;
+        case FileAccessHint::WillNeed:
+            return MADV_WILLNEED;
+        case FileAccessHint::DontNeed:
+            return MADV_DONTNEED;
+        default:
+            return MADV_NORMAL;
+    }
+}
+#endif // _WIN64
+
+bool MappedFile::open( cstring filename, FileAccessHint::Enum hint ) {
+    data = nullptr;
+    size = 0;
+
+#if defined(_WIN64)
+    HANDLE file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, hint == FileAccessHint::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr );
+    if ( file == INVALID_HANDLE_VALUE ) {
+        return false;
+    }
+
+    LARGE_INTEGER file_size;
+    if ( !GetFileSizeEx( file, &file_size ) || file_size.QuadPart == 0 ) {
+        CloseHandle( file );
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+    if ( mapping == nullptr ) {
+        CloseHandle( file );
+        return false;
+    }
+
+    data = ( u8* )MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+    if ( data == nullptr ) {
+        CloseHandle( mapping );
+        CloseHandle( file );
+        return false;
+    }
+
+    file_handle = file;
+    mapping_handle = mapping;
+    size = ( sizet )file_size.QuadPart;
+#else
+    int fd = ::open( filename, O_RDONLY );
+    if ( fd < 0 ) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if ( fstat( fd, &file_stat ) != 0 || file_stat.st_size == 0 ) {
+        ::close( fd );
+        return false;
+    }
+
+    void* mapping = mmap( nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( mapping == MAP_FAILED ) {
+        ::close( fd );
+        return false;
+    }
+
+    file_descriptor = fd;
+    data = ( u8* )mapping;
+    size = file_stat.st_size;
+
+    if ( hint != FileAccessHint::Normal ) {
+        madvise( data, size, to_madvise( hint ) );
+    }
+#endif // _WIN64
+
+    return true;
+}
+
+void MappedFile::close() {
+#if defined(_WIN64)
+    if ( data ) {
+        UnmapViewOfFile( data );
+    }
+    if ( mapping_handle ) {
+        CloseHandle( mapping_handle );
+    }
+    if ( file_handle ) {
+        CloseHandle( file_handle );
+    }
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+#else
+    if ( data ) {
+        munmap( data, size );
+    }
+    if ( file_descriptor >= 0 ) {
+        ::close( file_descriptor );
+    }
+    file_descriptor = -1;
+#endif // _WIN64
+
+    data = nullptr;
+    size = 0;
+}
+
+void MappedFile::advise( sizet offset, sizet range_size, FileAccessHint::Enum hint ) {
+    if ( data == nullptr || offset >= size ) {
+        return;
+    }
+
+    range_size = ( offset + range_size > size ) ? size - offset : range_size;
+
+#if defined(_WIN64)
+    // NOTE: only prefetching has a Windows equivalent.
+    if ( hint == FileAccessHint::WillNeed ) {
+        WIN32_MEMORY_RANGE_ENTRY range{ data + offset, range_size };
+        PrefetchVirtualMemory( GetCurrentProcess(), 1, &range, 0 );
+    }
+#else
+    const sizet page_size = ( sizet )sysconf( _SC_PAGESIZE );
+    const sizet aligned_offset = offset & ~( page_size - 1 );
+    madvise( data + aligned_offset, range_size + ( offset - aligned_offset ), to_madvise( hint ) );
+#endif // _WIN64
+}
+
 // Scoped file //////////////////////////////////////////////////////////////////
 ScopedFile::ScopedFile( cstring filename, cstring mode ) {
     file_open( filename, mode, &file );
@@ -86,6 +86,36 @@ namespace raptor {
     // TODO: move
     void                            environment_variable_get( cstring name, char* output, u32 output_size );
 
+    //
+    //
+    namespace FileAccessHint {
+        enum Enum {
+            Normal, Sequential, Random, WillNeed, DontNeed
+        };
+    } // namespace FileAccessHint
+
+    //
+    // Read-only mapping of a whole file. Data can be referenced in place until close,
+    // avoiding the allocation and copy done by file_read_binary.
+    struct MappedFile {
+
+        bool                        open( cstring filename, FileAccessHint::Enum hint = FileAccessHint::Normal );
+        void                        close();
+
+        // Hint the OS about the access pattern of a range. Offset is rounded down to the page size.
+        void                        advise( sizet offset, sizet size, FileAccessHint::Enum hint );
+
+        u8*                         data            = nullptr;
+        sizet                       size            = 0;
+
+#if defined(_WIN64)
+        void*                       file_handle     = nullptr;
+        void*                       mapping_handle  = nullptr;
+#else
+        i32                         file_descriptor = -1;
+#endif
+    }; // struct MappedFile
+
     struct ScopedFile {
         ScopedFile( cstring filename, cstring mode );
         ~ScopedFile();
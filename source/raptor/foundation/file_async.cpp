@@ -0,0 +1,189 @@
+#include "foundation/file_async.hpp"
+
+#include "foundation/assert.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/numerics.hpp"
+
+#if defined(_WIN64)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <new>
+#include <string.h>
+
+namespace raptor {
+
+// FileReadTask ///////////////////////////////////////////////////////////
+
+static sizet file_read_range( cstring filename, sizet offset, sizet size, u8* destination ) {
+    sizet bytes_read = 0;
+
+#if defined(_WIN64)
+    HANDLE file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+    if ( file == INVALID_HANDLE_VALUE ) {
+        return 0;
+    }
+
+    while ( bytes_read < size ) {
+        OVERLAPPED overlapped{ };
+        const u64 position = offset + bytes_read;
+        overlapped.Offset = ( DWORD )( position & 0xffffffff );
+        overlapped.OffsetHigh = ( DWORD )( position >> 32 );
+
+        const DWORD chunk = ( DWORD )min( size - bytes_read, ( sizet )rgiga( 1 ) );
+        DWORD chunk_read = 0;
+        if ( !ReadFile( file, destination + bytes_read, chunk, &chunk_read, &overlapped ) || chunk_read == 0 ) {
+            break;
+        }
+        bytes_read += chunk_read;
+    }
+
+    CloseHandle( file );
+#else
+    int fd = open( filename, O_RDONLY );
+    if ( fd < 0 ) {
+        return 0;
+    }
+
+    while ( bytes_read < size ) {
+        ssize_t chunk_read = pread( fd, destination + bytes_read, size - bytes_read, offset + bytes_read );
+        if ( chunk_read <= 0 ) {
+            break;
+        }
+        bytes_read += chunk_read;
+    }
+
+    close( fd );
+#endif // _WIN64
+
+    return bytes_read;
+}
+
+static sizet file_size( cstring filename ) {
+#if defined(_WIN64)
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if ( !GetFileAttributesExA( filename, GetFileExInfoStandard, &data ) ) {
+        return 0;
+    }
+    return ( ( sizet )data.nFileSizeHigh << 32 ) | data.nFileSizeLow;
+#else
+    struct stat file_stat;
+    if ( stat( filename, &file_stat ) != 0 ) {
+        return 0;
+    }
+    return file_stat.st_size;
+#endif // _WIN64
+}
+
+void FileReadTask::ExecuteRange( enki::TaskSetPartition /*range*/, uint32_t /*thread_index*/ ) {
+    request.bytes_read = file_read_range( request.path, request.offset, request.size, request.data );
+    request.success = request.bytes_read == request.size;
+
+    if ( request.callback ) {
+        request.callback( &request );
+    }
+}
+
+// AsynchronousFileReader /////////////////////////////////////////////////
+
+void AsynchronousFileReader::init( enki::TaskScheduler* task_scheduler_, Allocator* allocator_, u32 max_requests_ ) {
+    task_scheduler = task_scheduler_;
+    allocator = allocator_;
+    max_requests = max_requests_;
+    tasks_in_use = 0;
+
+    tasks = ( FileReadTask* )ralloca( sizeof( FileReadTask ) * max_requests, allocator );
+    for ( u32 i = 0; i < max_requests; ++i ) {
+        new ( tasks + i ) FileReadTask();
+    }
+}
+
+void AsynchronousFileReader::shutdown() {
+    wait_all();
+    RASSERTM( tasks_in_use == 0, "%u file reads were not released", tasks_in_use );
+
+    for ( u32 i = 0; i < max_requests; ++i ) {
+        tasks[ i ].~FileReadTask();
+    }
+    rfree( tasks, allocator );
+
+    tasks = nullptr;
+    max_requests = 0;
+}
+
+FileReadTask* AsynchronousFileReader::read( const FileReadRequest& request ) {
+    sizet size = request.size;
+    if ( size == 0 ) {
+        const sizet total_size = file_size( request.path );
+        size = total_size > request.offset ? total_size - request.offset : 0;
+    }
+
+    if ( size == 0 ) {
+        return nullptr;
+    }
+
+    // Tasks are never reused behind the back of the caller still holding them.
+    FileReadTask* task = nullptr;
+    for ( u32 i = 0; i < max_requests; ++i ) {
+        if ( !tasks[ i ].in_use ) {
+            task = &tasks[ i ];
+            break;
+        }
+    }
+
+    if ( task == nullptr ) {
+        rprint( "Cannot read %s, all %u file read tasks are in use\n", request.path, max_requests );
+        return nullptr;
+    }
+
+    u8* data = request.destination ? request.destination : ( u8* )ralloca( size, allocator );
+    if ( data == nullptr ) {
+        rprint( "Cannot read %s, allocation of %zu bytes failed\n", request.path, size );
+        return nullptr;
+    }
+
+    task->in_use = true;
+    ++tasks_in_use;
+
+    task->request = request;
+    task->request.size = size;
+    task->request.data = data;
+    task->request.bytes_read = 0;
+    task->request.success = false;
+
+    task_scheduler->AddTaskSetToPipe( task );
+
+    return task;
+}
+
+void AsynchronousFileReader::release( FileReadTask* task ) {
+    RASSERT( task >= tasks && task < tasks + max_requests && task->in_use );
+
+    wait( task );
+
+    task->in_use = false;
+    --tasks_in_use;
+}
+
+bool AsynchronousFileReader::has_free_task() const {
+    return tasks_in_use < max_requests;
+}
+
+void AsynchronousFileReader::wait( FileReadTask* task ) {
+    // Completed tasks are not waited on, so that shutdown works after the scheduler has been shut down.
+    if ( !task->GetIsComplete() ) {
+        task_scheduler->WaitforTask( task );
+    }
+}
+
+void AsynchronousFileReader::wait_all() {
+    for ( u32 i = 0; i < max_requests; ++i ) {
+        wait( &tasks[ i ] );
+    }
+}
+
+} // namespace raptor
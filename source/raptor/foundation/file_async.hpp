@@ -0,0 +1,76 @@
+#pragma once
+
+#include "foundation/file.hpp"
+#include "foundation/platform.hpp"
+
+#include "external/enkiTS/TaskScheduler.h"
+
+namespace raptor {
+
+    struct Allocator;
+    struct FileReadRequest;
+
+    // Called from the worker thread that executed the read.
+    typedef void                    ( *FileReadCallback )( FileReadRequest* request );
+
+    //
+    //
+    struct FileReadRequest {
+
+        char                        path[ k_max_path ];
+        sizet                       offset          = 0;
+        sizet                       size            = 0;        // 0 reads until the end of the file.
+
+        u8*                         destination     = nullptr;  // If null, memory is allocated by the reader and owned by the caller.
+
+        FileReadCallback            callback        = nullptr;
+        void*                       user_data       = nullptr;
+
+        // Filled when the read completes.
+        u8*                         data            = nullptr;
+        sizet                       bytes_read      = 0;
+        bool                        success         = false;
+
+    }; // struct FileReadRequest
+
+    //
+    //
+    struct FileReadTask : public enki::ITaskSet {
+
+        void                        ExecuteRange( enki::TaskSetPartition range, uint32_t thread_index ) override;
+
+        FileReadRequest             request;
+        bool                        in_use          = false;    // From read until release, even once complete.
+
+    }; // struct FileReadTask
+
+    //
+    // Asynchronous reads executed as enkiTS tasks with blocking positional reads.
+    // The returned task can be waited on or used as an enki::Dependency to chain work after the read.
+    // A task stays owned by the caller until release, read and release must be called from the same thread.
+    struct AsynchronousFileReader {
+
+        void                        init( enki::TaskScheduler* task_scheduler, Allocator* allocator, u32 max_requests );
+        void                        shutdown();
+
+        // Returns null if the file does not exist, the range is empty, all tasks are in use or allocation fails.
+        // Memory for requests without destination is allocated here, on the calling thread.
+        FileReadTask*               read( const FileReadRequest& request );
+        // Waits for the read and gives the task back to the reader. Allocated data is not freed.
+        void                        release( FileReadTask* task );
+
+        bool                        has_free_task() const;
+
+        void                        wait( FileReadTask* task );
+        void                        wait_all();
+
+        enki::TaskScheduler*        task_scheduler  = nullptr;
+        Allocator*                  allocator       = nullptr;
+
+        FileReadTask*               tasks           = nullptr;
+        u32                         max_requests    = 0;
+        u32                         tasks_in_use    = 0;
+
+    }; // struct AsynchronousFileReader
+
+} // namespace raptor
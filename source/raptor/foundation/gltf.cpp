@@ -1,548 +1,1139 @@
 #include "gltf.hpp"
 
-#include "external/json.hpp"
-
 #include "assert.hpp"
 #include "file.hpp"
+#include "numerics.hpp"
 
-using json = nlohmann::json;
+#include <stdlib.h>
+#include <string.h>
 
 namespace raptor {
 
-static void* allocate_and_zero( Allocator* allocator, sizet size ) {
-    void* result = allocator->allocate( size, 64 );
-    memset( result, 0, size );
-
-    return result;
+// JSON reader ////////////////////////////////////////////////////////////
+//
+// Pull parser working directly on the mapped document: values are decoded
+// straight into the glTF structures, with arrays sized by a quick scan ahead.
+// No intermediate DOM is built and all memory comes from the glTF arena.
+
+struct JsonReader {
+    const char*                     cursor;
+    const char*                     begin;
+    const char*                     end;
+    bool                            error;
+}; // struct JsonReader
+
+struct JsonKey {
+    const char*                     text;
+    u32                             length;
+}; // struct JsonKey
+
+static void json_error( JsonReader& reader, cstring message ) {
+    if ( !reader.error ) {
+        rprint( "glTF parsing error at offset %llu: %s\n", ( u64 )( reader.cursor - reader.begin ), message );
+    }
+    reader.error = true;
+    // Stop any further parsing.
+    reader.cursor = reader.end;
 }
 
-static void try_load_string( json& json_data, cstring key, StringBuffer& string_buffer, Allocator* allocator ) {
-    auto it = json_data.find( key );
-    if ( it == json_data.end() )
-        return;
-
-    std::string value = json_data.value( key, "" );
+static inline void json_skip_whitespace( JsonReader& reader ) {
+    const char* cursor = reader.cursor;
+    while ( cursor < reader.end && ( *cursor == ' ' || *cursor == '\n' || *cursor == '\r' || *cursor == '\t' ) ) {
+        ++cursor;
+    }
+    reader.cursor = cursor;
+}
 
-    string_buffer.init( value.length() + 1, allocator );
-    string_buffer.append( value.c_str() );
+static inline char json_peek( JsonReader& reader ) {
+    json_skip_whitespace( reader );
+    return reader.cursor < reader.end ? *reader.cursor : 0;
 }
 
-static void try_load_int( json& json_data, cstring key, i32& value ) {
-    auto it = json_data.find( key );
-    if ( it == json_data.end() )
-    {
-        value = glTF::INVALID_INT_VALUE;
-        return;
+static inline bool json_consume( JsonReader& reader, char c ) {
+    if ( json_peek( reader ) == c ) {
+        ++reader.cursor;
+        return true;
     }
+    return false;
+}
 
-    value = json_data.value( key, 0 );
+static inline bool json_key_equals( const JsonKey& key, cstring name ) {
+    const sizet length = strlen( name );
+    return key.length == length && memcmp( key.text, name, length ) == 0;
 }
 
-static void try_load_float( json& json_data, cstring key, f32& value ) {
-    auto it = json_data.find( key );
-    if ( it == json_data.end() )
-    {
-        value = glTF::INVALID_FLOAT_VALUE;
-        return;
+// Returns the raw content between quotes, escapes are left untouched.
+static bool json_read_raw_string( JsonReader& reader, JsonKey& out_string, bool* has_escapes ) {
+    if ( !json_consume( reader, '"' ) ) {
+        json_error( reader, "expected string" );
+        return false;
     }
 
-    value = json_data.value( key, 0.0f );
-}
+    const char* start = reader.cursor;
+    bool escapes = false;
+    while ( reader.cursor < reader.end && *reader.cursor != '"' ) {
+        if ( *reader.cursor == '\\' ) {
+            escapes = true;
+            ++reader.cursor;
+        }
+        ++reader.cursor;
+    }
 
-static void try_load_bool( json& json_data, cstring key, bool& value ) {
-    auto it = json_data.find( key );
-    if ( it == json_data.end() )
-    {
-        value = false;
-        return;
+    if ( reader.cursor >= reader.end ) {
+        json_error( reader, "unterminated string" );
+        return false;
     }
 
-    value = json_data.value( key, false );
-}
+    out_string.text = start;
+    out_string.length = ( u32 )( reader.cursor - start );
+    ++reader.cursor;
 
-static void try_load_type( json& json_data, cstring key, glTF::Accessor::Type& type ) {
-    std::string value = json_data.value( key, "" );
-    if ( value == "SCALAR" ) {
-        type = glTF::Accessor::Type::Scalar;
-    }
-    else if ( value == "VEC2" ) {
-        type = glTF::Accessor::Type::Vec2;
-    }
-    else if ( value == "VEC3" ) {
-        type = glTF::Accessor::Type::Vec3;
-    }
-    else if ( value == "VEC4" ) {
-        type = glTF::Accessor::Type::Vec4;
+    if ( has_escapes ) {
+        *has_escapes = escapes;
     }
-    else if ( value == "MAT2" ) {
-        type = glTF::Accessor::Type::Mat2;
+    return true;
+}
+
+static u32 json_parse_hex4( const char* text ) {
+    u32 value = 0;
+    for ( u32 i = 0; i < 4; ++i ) {
+        const char c = text[ i ];
+        value <<= 4;
+        if ( c >= '0' && c <= '9' ) value |= c - '0';
+        else if ( c >= 'a' && c <= 'f' ) value |= c - 'a' + 10;
+        else if ( c >= 'A' && c <= 'F' ) value |= c - 'A' + 10;
     }
-    else if ( value == "MAT3" ) {
-        type = glTF::Accessor::Type::Mat3;
+    return value;
+}
+
+static u32 json_encode_utf8( u32 codepoint, char* output ) {
+    if ( codepoint < 0x80 ) {
+        output[ 0 ] = ( char )codepoint;
+        return 1;
     }
-    else if ( value == "MAT4" ) {
-        type = glTF::Accessor::Type::Mat4;
+    if ( codepoint < 0x800 ) {
+        output[ 0 ] = ( char )( 0xC0 | ( codepoint >> 6 ) );
+        output[ 1 ] = ( char )( 0x80 | ( codepoint & 0x3F ) );
+        return 2;
     }
-    else {
-        RASSERT( false );
+    if ( codepoint < 0x10000 ) {
+        output[ 0 ] = ( char )( 0xE0 | ( codepoint >> 12 ) );
+        output[ 1 ] = ( char )( 0x80 | ( ( codepoint >> 6 ) & 0x3F ) );
+        output[ 2 ] = ( char )( 0x80 | ( codepoint & 0x3F ) );
+        return 3;
     }
+    output[ 0 ] = ( char )( 0xF0 | ( codepoint >> 18 ) );
+    output[ 1 ] = ( char )( 0x80 | ( ( codepoint >> 12 ) & 0x3F ) );
+    output[ 2 ] = ( char )( 0x80 | ( ( codepoint >> 6 ) & 0x3F ) );
+    output[ 3 ] = ( char )( 0x80 | ( codepoint & 0x3F ) );
+    return 4;
 }
 
-static void try_load_int_array( json& json_data, cstring key, u32& count, i32** array, Allocator* allocator ) {
-    auto it = json_data.find( key );
-    if ( it == json_data.end() ) {
-        count = 0;
-        *array = nullptr;
+// Decoded string is never longer than the raw one, so the raw length is enough to size the buffer.
+static void json_read_string( JsonReader& reader, StringBuffer& string_buffer, Allocator* allocator ) {
+    JsonKey raw;
+    bool has_escapes = false;
+    if ( !json_read_raw_string( reader, raw, &has_escapes ) ) {
         return;
     }
 
-    json json_array = json_data.at( key );
+    string_buffer.init( raw.length + 1, allocator );
 
-    count = json_array.size();
+    if ( !has_escapes ) {
+        memcpy( string_buffer.data, raw.text, raw.length );
+        string_buffer.current_size = raw.length;
+        string_buffer.data[ raw.length ] = 0;
+        return;
+    }
 
-    i32* values = ( i32* )allocate_and_zero( allocator, sizeof( i32 ) * count );
+    char* output = string_buffer.data;
+    const char* input = raw.text;
+    const char* input_end = raw.text + raw.length;
+    while ( input < input_end ) {
+        if ( *input != '\\' ) {
+            *output++ = *input++;
+            continue;
+        }
 
-    for ( sizet i = 0; i < count; ++i ) {
-        values[ i ] = json_array.at( i );
+        ++input;
+        switch ( *input ) {
+            case 'b': *output++ = '\b'; break;
+            case 'f': *output++ = '\f'; break;
+            case 'n': *output++ = '\n'; break;
+            case 'r': *output++ = '\r'; break;
+            case 't': *output++ = '\t'; break;
+            case 'u': {
+                if ( input + 5 > input_end ) {
+                    json_error( reader, "truncated unicode escape" );
+                    return;
+                }
+                u32 codepoint = json_parse_hex4( input + 1 );
+                input += 4;
+                // Surrogate pair
+                if ( codepoint >= 0xD800 && codepoint <= 0xDBFF && input + 7 <= input_end && input[ 1 ] == '\\' && input[ 2 ] == 'u' ) {
+                    const u32 low = json_parse_hex4( input + 3 );
+                    codepoint = 0x10000 + ( ( codepoint - 0xD800 ) << 10 ) + ( low - 0xDC00 );
+                    input += 6;
+                }
+                output += json_encode_utf8( codepoint, output );
+                break;
+            }
+            default:
+                // '"', '\\' and '/'
+                *output++ = *input;
+                break;
+        }
+        ++input;
     }
 
-    *array = values;
+    string_buffer.current_size = ( u32 )( output - string_buffer.data );
+    *output = 0;
 }
 
-static void try_load_float_array( json& json_data, cstring key, u32& count, float** array, Allocator* allocator ) {
-    auto it = json_data.find( key );
-    if ( it == json_data.end() ) {
-        count = 0;
-        *array = nullptr;
-        return;
-    }
+static f64 json_read_number( JsonReader& reader ) {
+    json_skip_whitespace( reader );
 
-    json json_array = json_data.at( key );
+    const char* start = reader.cursor;
+    const char* cursor = start;
 
-    count = json_array.size();
+    const bool negative = cursor < reader.end && *cursor == '-';
+    if ( negative ) {
+        ++cursor;
+    }
 
-    float* values = ( float* )allocate_and_zero( allocator, sizeof( float ) * count );
+    // Fast path for integers, the vast majority of glTF numbers.
+    u64 integer = 0;
+    const char* digits_start = cursor;
+    while ( cursor < reader.end && *cursor >= '0' && *cursor <= '9' ) {
+        integer = integer * 10 + ( *cursor - '0' );
+        ++cursor;
+    }
 
-    for ( sizet i = 0; i < count; ++i ) {
-        values[ i ] = json_array.at( i );
+    if ( cursor == digits_start ) {
+        json_error( reader, "expected number" );
+        return 0.0;
     }
 
-    *array = values;
-}
+    const bool is_integer = cursor >= reader.end || ( *cursor != '.' && *cursor != 'e' && *cursor != 'E' );
+    if ( is_integer && ( cursor - digits_start ) < 19 ) {
+        reader.cursor = cursor;
+        return negative ? -( f64 )integer : ( f64 )integer;
+    }
 
-static void load_asset( json& json_data, glTF::Asset& asset, Allocator* allocator ) {
-    json json_asset = json_data[ "asset" ];
+    // Copy the token so that strtod never reads past the mapped document.
+    while ( cursor < reader.end && ( ( *cursor >= '0' && *cursor <= '9' ) || *cursor == '.' || *cursor == 'e' || *cursor == 'E' || *cursor == '+' || *cursor == '-' ) ) {
+        ++cursor;
+    }
 
-    try_load_string( json_asset, "copyright", asset.copyright, allocator );
-    try_load_string( json_asset, "generator", asset.generator, allocator );
-    try_load_string( json_asset, "minVersion", asset.minVersion, allocator );
-    try_load_string( json_asset, "version", asset.version, allocator );
-}
+    char token[ 64 ];
+    const sizet token_length = cursor - start;
+    if ( token_length >= sizeof( token ) ) {
+        json_error( reader, "number too long" );
+        return 0.0;
+    }
+    memcpy( token, start, token_length );
+    token[ token_length ] = 0;
 
-static void load_scene( json& json_data, glTF::Scene& scene, Allocator* allocator ) {
-    try_load_int_array( json_data, "nodes", scene.nodes_count, &scene.nodes, allocator );
+    reader.cursor = cursor;
+    return strtod( token, nullptr );
 }
 
-static void load_scenes( json& json_data, glTF::glTF& gltf_data, Allocator* allocator ) {
-    json scenes = json_data[ "scenes" ];
-
-    sizet scene_count = scenes.size();
-    gltf_data.scenes = ( glTF::Scene* )allocate_and_zero( allocator, sizeof( glTF::Scene ) * scene_count );
-    gltf_data.scenes_count = scene_count;
-
-    for ( sizet i = 0; i < scene_count; ++i ) {
-        load_scene( scenes[ i ], gltf_data.scenes[ i ], allocator );
+static bool json_read_literal( JsonReader& reader, cstring literal ) {
+    json_skip_whitespace( reader );
+    const sizet length = strlen( literal );
+    if ( ( sizet )( reader.end - reader.cursor ) >= length && memcmp( reader.cursor, literal, length ) == 0 ) {
+        reader.cursor += length;
+        return true;
     }
+    return false;
 }
 
-static void load_buffer( json& json_data, glTF::Buffer& buffer, Allocator* allocator ) {
-    try_load_string( json_data, "uri", buffer.uri, allocator );
-    try_load_int( json_data, "byteLength", buffer.byte_length );
-    try_load_string( json_data, "name", buffer.name, allocator );
+static bool json_read_bool( JsonReader& reader ) {
+    if ( json_read_literal( reader, "true" ) ) {
+        return true;
+    }
+    if ( !json_read_literal( reader, "false" ) ) {
+        json_error( reader, "expected boolean" );
+    }
+    return false;
 }
 
-static void load_buffers( json& json_data, glTF::glTF& gltf_data, Allocator* allocator ) {
-    json buffers = json_data[ "buffers" ];
-
-    sizet buffer_count = buffers.size();
-    gltf_data.buffers = ( glTF::Buffer* )allocate_and_zero( allocator, sizeof( glTF::Buffer ) * buffer_count );
-    gltf_data.buffers_count = buffer_count;
-
-    for ( sizet i = 0; i < buffer_count; ++i ) {
-        load_buffer( buffers[ i ], gltf_data.buffers[ i ], allocator );
+static void json_skip_value( JsonReader& reader ) {
+    const char c = json_peek( reader );
+    if ( c == '"' ) {
+        JsonKey unused;
+        json_read_raw_string( reader, unused, nullptr );
     }
-}
+    else if ( c == '{' || c == '[' ) {
+        // Skip the whole container tracking only nesting and strings.
+        u32 depth = 0;
+        while ( reader.cursor < reader.end ) {
+            const char current = *reader.cursor;
+            if ( current == '"' ) {
+                JsonKey unused;
+                json_read_raw_string( reader, unused, nullptr );
+                continue;
+            }
 
-static void load_buffer_view( json& json_data, glTF::BufferView& buffer_view, Allocator* allocator ) {
-    try_load_int( json_data, "buffer", buffer_view.buffer );
-    try_load_int( json_data, "byteLength", buffer_view.byte_length );
-    try_load_int( json_data, "byteOffset", buffer_view.byte_offset );
-    try_load_int( json_data, "byteStride", buffer_view.byte_stride );
-    try_load_int( json_data, "target", buffer_view.target );
-    try_load_string( json_data, "name", buffer_view.name, allocator );
+            ++reader.cursor;
+            if ( current == '{' || current == '[' ) {
+                ++depth;
+            }
+            else if ( current == '}' || current == ']' ) {
+                if ( --depth == 0 ) {
+                    return;
+                }
+            }
+        }
+        json_error( reader, "unterminated container" );
+    }
+    else if ( c == 't' || c == 'f' ) {
+        json_read_bool( reader );
+    }
+    else if ( c == 'n' ) {
+        if ( !json_read_literal( reader, "null" ) ) {
+            json_error( reader, "unexpected literal" );
+        }
+    }
+    else {
+        json_read_number( reader );
+    }
 }
 
-static void load_buffer_views( json& json_data, glTF::glTF& gltf_data, Allocator* allocator ) {
-    json buffers = json_data[ "bufferViews" ];
-
-    sizet buffer_count = buffers.size();
-    gltf_data.buffer_views = ( glTF::BufferView* )allocate_and_zero( allocator, sizeof( glTF::BufferView ) * buffer_count );
-    gltf_data.buffer_views_count = buffer_count;
+// Count the elements of the array or object starting at the cursor, without consuming it.
+static u32 json_count_elements( JsonReader& reader ) {
+    json_skip_whitespace( reader );
+
+    const char* cursor = reader.cursor + 1;
+    u32 depth = 0;
+    u32 count = 0;
+    bool empty = true;
+
+    while ( cursor < reader.end ) {
+        const char c = *cursor;
+        if ( c == '"' ) {
+            ++cursor;
+            while ( cursor < reader.end && *cursor != '"' ) {
+                cursor += ( *cursor == '\\' ) ? 2 : 1;
+            }
+            ++cursor;
+            empty = false;
+            continue;
+        }
 
-    for ( sizet i = 0; i < buffer_count; ++i ) {
-        load_buffer_view( buffers[ i ], gltf_data.buffer_views[ i ], allocator );
+        if ( c == '{' || c == '[' ) {
+            ++depth;
+            empty = false;
+        }
+        else if ( c == '}' || c == ']' ) {
+            if ( depth == 0 ) {
+                break;
+            }
+            --depth;
+        }
+        else if ( c == ',' && depth == 0 ) {
+            ++count;
+        }
+        else if ( c != ' ' && c != '\n' && c != '\r' && c != '\t' ) {
+            empty = false;
+        }
+        ++cursor;
     }
-}
 
-static void load_node( json& json_data, glTF::Node& node, Allocator* allocator ) {
-    try_load_int( json_data, "camera", node.camera );
-    try_load_int( json_data, "mesh", node.mesh );
-    try_load_int( json_data, "skin", node.skin );
-    try_load_int_array( json_data, "children", node.children_count, &node.children, allocator );
-    try_load_float_array( json_data, "matrix", node.matrix_count, &node.matrix, allocator );
-    try_load_float_array( json_data, "rotation", node.rotation_count, &node.rotation, allocator );
-    try_load_float_array( json_data, "scale", node.scale_count, &node.scale, allocator );
-    try_load_float_array( json_data, "translation", node.translation_count, &node.translation, allocator );
-    try_load_float_array( json_data, "weights", node.weights_count, &node.weights, allocator );
-    try_load_string( json_data, "name", node.name, allocator );
+    return empty ? 0 : count + 1;
 }
 
-static void load_nodes( json& json_data, glTF::glTF& gltf_data, Allocator* allocator ) {
-    json array = json_data[ "nodes" ];
-
-    sizet array_count = array.size();
-    gltf_data.nodes = ( glTF::Node* )allocate_and_zero( allocator, sizeof( glTF::Node ) * array_count );
-    gltf_data.nodes_count = array_count;
-
-    for ( sizet i = 0; i < array_count; ++i ) {
-        load_node( array[ i ], gltf_data.nodes[ i ], allocator );
+static bool json_object_begin( JsonReader& reader ) {
+    if ( !json_consume( reader, '{' ) ) {
+        json_error( reader, "expected object" );
+        return false;
     }
+    return true;
 }
 
-static void load_mesh_primitive( json& json_data, glTF::MeshPrimitive& mesh_primitive, Allocator* allocator ) {
-    try_load_int( json_data, "indices", mesh_primitive.indices );
-    try_load_int( json_data, "material", mesh_primitive.material );
-    try_load_int( json_data, "mode", mesh_primitive.mode );
-
-    json attributes = json_data[ "attributes" ];
+// Reads the next key and the following colon. Returns false at the end of the object.
+static bool json_object_next( JsonReader& reader, JsonKey& key, bool& first ) {
+    if ( reader.error ) {
+        return false;
+    }
 
-    mesh_primitive.attributes = ( glTF::MeshPrimitive::Attribute* )allocate_and_zero( allocator, sizeof( glTF::MeshPrimitive::Attribute ) * attributes.size() );
-    mesh_primitive.attribute_count = attributes.size();
+    if ( json_consume( reader, '}' ) ) {
+        return false;
+    }
 
-    u32 index = 0;
-    for ( auto json_attribute : attributes.items() ) {
-        std::string key = json_attribute.key();
-        glTF::MeshPrimitive::Attribute& attribute = mesh_primitive.attributes[ index ];
+    if ( !first && !json_consume( reader, ',' ) ) {
+        json_error( reader, "expected ',' or '}'" );
+        return false;
+    }
+    first = false;
 
-        attribute.key.init( key.size() + 1, allocator );
-        attribute.key.append( key.c_str() );
+    if ( !json_read_raw_string( reader, key, nullptr ) ) {
+        return false;
+    }
 
-        attribute.accessor_index = json_attribute.value();
+    if ( !json_consume( reader, ':' ) ) {
+        json_error( reader, "expected ':'" );
+        return false;
+    }
+    return true;
+}
 
-        ++index;
+static bool json_array_begin( JsonReader& reader ) {
+    if ( !json_consume( reader, '[' ) ) {
+        json_error( reader, "expected array" );
+        return false;
     }
+    return true;
 }
 
-static void load_mesh_primitives( json& json_data, glTF::Mesh& mesh, Allocator* allocator ) {
-    json array = json_data[ "primitives" ];
+// Returns false at the end of the array.
+static bool json_array_next( JsonReader& reader, bool& first ) {
+    if ( reader.error ) {
+        return false;
+    }
 
-    sizet array_count = array.size();
-    mesh.primitives = ( glTF::MeshPrimitive* )allocate_and_zero( allocator, sizeof( glTF::MeshPrimitive ) * array_count );
-    mesh.primitives_count = array_count;
+    if ( json_consume( reader, ']' ) ) {
+        return false;
+    }
 
-    for ( sizet i = 0; i < array_count; ++i ) {
-        load_mesh_primitive( array[ i ], mesh.primitives[ i ], allocator );
+    if ( !first && !json_consume( reader, ',' ) ) {
+        json_error( reader, "expected ',' or ']'" );
+        return false;
     }
+    first = false;
+    return true;
 }
 
-static void load_mesh( json& json_data, glTF::Mesh& mesh, Allocator* allocator ) {
-    load_mesh_primitives( json_data, mesh, allocator );
-    try_load_float_array( json_data, "weights", mesh.weights_count, &mesh.weights, allocator );
-    try_load_string( json_data, "name", mesh.name, allocator );
-}
+// glTF arena ////////////////////////////////////////////////////////////
 
-static void load_meshes( json& json_data, glTF::glTF& gltf_data, Allocator* allocator ) {
-    json array = json_data[ "meshes" ];
+struct glTF::ArenaBlock {
+    ArenaBlock*                     next;
+}; // struct ArenaBlock
 
-    sizet array_count = array.size();
-    gltf_data.meshes = ( glTF::Mesh* )allocate_and_zero( allocator, sizeof( glTF::Mesh ) * array_count );
-    gltf_data.meshes_count = array_count;
+// Block data starts after the header, at the largest alignment used by the parser.
+static const sizet                  k_arena_alignment       = 64;
+static const sizet                  k_arena_header_size     = k_arena_alignment;
+static_assert( sizeof( glTF::ArenaBlock ) <= k_arena_header_size, "Arena block header does not fit" );
 
-    for ( sizet i = 0; i < array_count; ++i ) {
-        load_mesh( array[ i ], gltf_data.meshes[ i ], allocator );
+static glTF::ArenaBlock* arena_add_block( glTF::Arena& arena, sizet size ) {
+    glTF::ArenaBlock* block = ( glTF::ArenaBlock* )malloc( k_arena_header_size + size );
+    if ( block == nullptr ) {
+        return nullptr;
     }
-}
 
-static void load_accessor( json& json_data, glTF::Accessor& accessor, Allocator* allocator ) {
-    try_load_int( json_data, "bufferView", accessor.buffer_view );
-    try_load_int( json_data, "byteOffset", accessor.byte_offset );
-    try_load_int( json_data, "componentType", accessor.component_type );
-    try_load_int( json_data, "count", accessor.count );
-    try_load_int( json_data, "sparse", accessor.sparse );
-    try_load_float_array( json_data, "max", accessor.max_count, &accessor.max, allocator );
-    try_load_float_array( json_data, "min", accessor.min_count, &accessor.min, allocator );
-    try_load_bool( json_data, "normalized", accessor.normalized );
-    try_load_type( json_data, "type", accessor.type );
+    block->next = arena.blocks;
+    arena.blocks = block;
+    arena.block_size = size;
+    arena.block_offset = 0;
+    ++arena.block_count;
+
+    return block;
 }
 
-static void load_accessors( json& json_data, glTF::glTF& gltf_data, Allocator* allocator ) {
-    json array = json_data[ "accessors" ];
+void glTF::Arena::init( sizet first_block_size ) {
+    blocks = nullptr;
+    block_size = 0;
+    block_offset = 0;
+    allocated_size = 0;
+    block_count = 0;
 
-    sizet array_count = array.size();
-    gltf_data.accessors = ( glTF::Accessor* )allocate_and_zero( allocator, sizeof( glTF::Accessor ) * array_count );
-    gltf_data.accessors_count = array_count;
+    arena_add_block( *this, first_block_size );
+}
 
-    for ( sizet i = 0; i < array_count; ++i ) {
-        load_accessor( array[ i ], gltf_data.accessors[ i ], allocator );
+void glTF::Arena::shutdown() {
+    while ( blocks ) {
+        ArenaBlock* next = blocks->next;
+        free( blocks );
+        blocks = next;
     }
+
+    block_count = 0;
+    allocated_size = 0;
 }
 
-static void try_load_TextureInfo( json& json_data, cstring key, glTF::TextureInfo** texture_info, Allocator* allocator ) {
-    auto it = json_data.find( key );
-    if ( it == json_data.end() ) {
-        *texture_info = nullptr;
-        return;
+void* glTF::Arena::allocate( sizet size, sizet alignment ) {
+    RASSERT( alignment <= k_arena_alignment );
+
+    sizet offset = memory_align( block_offset, alignment );
+    if ( blocks == nullptr || offset + size > block_size ) {
+        // New blocks are never smaller than the previous one, so that large documents need a few of them.
+        if ( arena_add_block( *this, max( size, block_size ) ) == nullptr ) {
+            return nullptr;
+        }
+        offset = 0;
     }
 
-    glTF::TextureInfo* ti = ( glTF::TextureInfo* ) allocator->allocate( sizeof( glTF::TextureInfo ), 64 );
+    block_offset = offset + size;
+    allocated_size += size;
 
-    try_load_int( *it, "index", ti->index );
-    try_load_int( *it, "texCoord", ti->texCoord );
+    return ( u8* )blocks + k_arena_header_size + offset;
+}
 
-    *texture_info = ti;
+void* glTF::Arena::allocate( sizet size, sizet alignment, cstring, i32 ) {
+    return allocate( size, alignment );
 }
 
-static void try_load_MaterialNormalTextureInfo( json& json_data, cstring key, glTF::MaterialNormalTextureInfo** texture_info, Allocator* allocator ) {
-    auto it = json_data.find( key );
-    if ( it == json_data.end() ) {
-        *texture_info = nullptr;
-        return;
-    }
+void glTF::Arena::deallocate( void* ) {
+    // Memory is released all together on shutdown.
+}
 
-    glTF::MaterialNormalTextureInfo* ti = ( glTF::MaterialNormalTextureInfo* ) allocator->allocate( sizeof( glTF::MaterialNormalTextureInfo ), 64 );
+// glTF helpers ///////////////////////////////////////////////////////////
 
-    try_load_int( *it, "index", ti->index );
-    try_load_int( *it, "texCoord", ti->tex_coord );
-    try_load_float( *it, "scale", ti->scale );
+// Failed allocations stop the parsing, callers only need to skip writing through the null result.
+static void* allocate_and_zero( JsonReader& reader, Allocator* allocator, sizet size ) {
+    void* result = allocator->allocate( size, 64 );
+    if ( result == nullptr ) {
+        json_error( reader, "out of memory" );
+        return nullptr;
+    }
+    memset( result, 0, size );
 
-    *texture_info = ti;
+    return result;
 }
 
-static void try_load_MaterialOcclusionTextureInfo( json& json_data, cstring key, glTF::MaterialOcclusionTextureInfo** texture_info, Allocator* allocator ) {
-    auto it = json_data.find( key );
-    if ( it == json_data.end() ) {
-        *texture_info = nullptr;
-        return;
+// Allocates an array sized from the document, leaving the cursor on the opening bracket.
+template <typename T>
+static T* allocate_array( JsonReader& reader, u32& count, Allocator* allocator ) {
+    count = json_count_elements( reader );
+    T* result = count ? ( T* )allocate_and_zero( reader, allocator, sizeof( T ) * count ) : nullptr;
+    if ( result == nullptr ) {
+        count = 0;
     }
+    return result;
+}
 
-    glTF::MaterialOcclusionTextureInfo* ti = ( glTF::MaterialOcclusionTextureInfo* ) allocator->allocate( sizeof( glTF::MaterialOcclusionTextureInfo ), 64 );
-
-    try_load_int( *it, "index", ti->index );
-    try_load_int( *it, "texCoord", ti->texCoord );
-    try_load_float( *it, "strength", ti->strength );
+static bool json_is_null( JsonReader& reader ) {
+    if ( json_peek( reader ) == 'n' ) {
+        json_skip_value( reader );
+        return true;
+    }
+    return false;
+}
 
-    *texture_info = ti;
+static void load_int( JsonReader& reader, i32& value ) {
+    value = json_is_null( reader ) ? glTF::INVALID_INT_VALUE : ( i32 )json_read_number( reader );
 }
 
-static void try_load_MaterialPBRMetallicRoughness( json& json_data, cstring key, glTF::MaterialPBRMetallicRoughness** texture_info, Allocator* allocator ) {
-    auto it = json_data.find( key );
-    if ( it == json_data.end() )
-    {
-        *texture_info = nullptr;
-        return;
-    }
+static void load_float( JsonReader& reader, f32& value ) {
+    value = json_is_null( reader ) ? glTF::INVALID_FLOAT_VALUE : ( f32 )json_read_number( reader );
+}
 
-    glTF::MaterialPBRMetallicRoughness* ti = ( glTF::MaterialPBRMetallicRoughness* ) allocator->allocate( sizeof( glTF::MaterialPBRMetallicRoughness ), 64 );
+static void load_int_array( JsonReader& reader, u32& count, i32** array, Allocator* allocator ) {
+    i32* values = allocate_array<i32>( reader, count, allocator );
 
-    try_load_float_array( *it, "baseColorFactor", ti->base_color_factor_count, &ti->base_color_factor, allocator );
-    try_load_TextureInfo( *it, "baseColorTexture", &ti->base_color_texture, allocator );
-    try_load_float( *it, "metallicFactor", ti->metallic_factor );
-    try_load_TextureInfo( *it, "metallicRoughnessTexture", &ti->metallic_roughness_texture, allocator );
-    try_load_float( *it, "roughnessFactor", ti->roughness_factor );
+    bool first = true;
+    u32 index = 0;
+    json_array_begin( reader );
+    while ( json_array_next( reader, first ) ) {
+        values[ index++ ] = ( i32 )json_read_number( reader );
+    }
 
-    *texture_info = ti;
+    *array = values;
 }
 
-static void load_material( json& json_data, glTF::Material& material, Allocator* allocator ) {
-    try_load_float_array( json_data, "emissiveFactor", material.emissive_factor_count, &material.emissive_factor, allocator );
-    try_load_float( json_data, "alphaCutoff", material.alpha_cutoff );
-    try_load_string( json_data, "alphaMode", material.alpha_mode, allocator );
-    try_load_bool( json_data, "doubleSided", material.double_sided );
+static void load_float_array( JsonReader& reader, u32& count, f32** array, Allocator* allocator ) {
+    f32* values = allocate_array<f32>( reader, count, allocator );
 
-    try_load_TextureInfo( json_data, "emissiveTexture", &material.emissive_texture, allocator );
-    try_load_MaterialNormalTextureInfo( json_data, "normalTexture", &material.normal_texture, allocator );
-    try_load_MaterialOcclusionTextureInfo( json_data, "occlusionTexture", &material.occlusion_texture, allocator );
-    try_load_MaterialPBRMetallicRoughness( json_data, "pbrMetallicRoughness", &material.pbr_metallic_roughness, allocator );
+    bool first = true;
+    u32 index = 0;
+    json_array_begin( reader );
+    while ( json_array_next( reader, first ) ) {
+        values[ index++ ] = ( f32 )json_read_number( reader );
+    }
 
-    try_load_string( json_data, "name", material.name, allocator );
+    *array = values;
 }
 
-static void load_materials( json& json_data, glTF::glTF& gltf_data, Allocator* allocator ) {
-    json array = json_data[ "materials" ];
+static void load_type( JsonReader& reader, glTF::Accessor::Type& type ) {
+    JsonKey value;
+    json_read_raw_string( reader, value, nullptr );
 
-    sizet array_count = array.size();
-    gltf_data.materials = ( glTF::Material* )allocate_and_zero( allocator, sizeof( glTF::Material ) * array_count );
-    gltf_data.materials_count = array_count;
-
-    for ( sizet i = 0; i < array_count; ++i ) {
-        load_material( array[ i ], gltf_data.materials[ i ], allocator );
+    if ( json_key_equals( value, "SCALAR" ) ) {
+        type = glTF::Accessor::Type::Scalar;
+    }
+    else if ( json_key_equals( value, "VEC2" ) ) {
+        type = glTF::Accessor::Type::Vec2;
+    }
+    else if ( json_key_equals( value, "VEC3" ) ) {
+        type = glTF::Accessor::Type::Vec3;
+    }
+    else if ( json_key_equals( value, "VEC4" ) ) {
+        type = glTF::Accessor::Type::Vec4;
+    }
+    else if ( json_key_equals( value, "MAT2" ) ) {
+        type = glTF::Accessor::Type::Mat2;
+    }
+    else if ( json_key_equals( value, "MAT3" ) ) {
+        type = glTF::Accessor::Type::Mat3;
+    }
+    else if ( json_key_equals( value, "MAT4" ) ) {
+        type = glTF::Accessor::Type::Mat4;
+    }
+    else {
+        RASSERT( false );
     }
 }
 
-static void load_texture( json& json_data, glTF::Texture& texture, Allocator* allocator ) {
-    try_load_int( json_data, "sampler", texture.sampler );
-    try_load_int( json_data, "source", texture.source );
-    try_load_string( json_data, "name", texture.name, allocator );
+static void load_asset( JsonReader& reader, glTF::Asset& asset, Allocator* allocator ) {
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "copyright" ) ) {
+            json_read_string( reader, asset.copyright, allocator );
+        } else if ( json_key_equals( key, "generator" ) ) {
+            json_read_string( reader, asset.generator, allocator );
+        } else if ( json_key_equals( key, "minVersion" ) ) {
+            json_read_string( reader, asset.minVersion, allocator );
+        } else if ( json_key_equals( key, "version" ) ) {
+            json_read_string( reader, asset.version, allocator );
+        } else {
+            json_skip_value( reader );
+        }
+    }
 }
 
-static void load_textures( json& json_data, glTF::glTF& gltf_data, Allocator* allocator ) {
-    json array = json_data[ "textures" ];
+static void load_scene( JsonReader& reader, glTF::Scene& scene, Allocator* allocator ) {
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "nodes" ) ) {
+            load_int_array( reader, scene.nodes_count, &scene.nodes, allocator );
+        } else {
+            json_skip_value( reader );
+        }
+    }
+}
 
-    sizet array_count = array.size();
-    gltf_data.textures = ( glTF::Texture* )allocate_and_zero( allocator, sizeof( glTF::Texture ) * array_count );
-    gltf_data.textures_count = array_count;
+static void load_buffer( JsonReader& reader, glTF::Buffer& buffer, Allocator* allocator ) {
+    buffer.byte_length = glTF::INVALID_INT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "uri" ) ) {
+            json_read_string( reader, buffer.uri, allocator );
+        } else if ( json_key_equals( key, "byteLength" ) ) {
+            load_int( reader, buffer.byte_length );
+        } else if ( json_key_equals( key, "name" ) ) {
+            json_read_string( reader, buffer.name, allocator );
+        } else {
+            json_skip_value( reader );
+        }
+    }
+}
 
-    for ( sizet i = 0; i < array_count; ++i ) {
-        load_texture( array[ i ], gltf_data.textures[ i ], allocator );
+static void load_buffer_view( JsonReader& reader, glTF::BufferView& buffer_view, Allocator* allocator ) {
+    buffer_view.buffer = glTF::INVALID_INT_VALUE;
+    buffer_view.byte_length = glTF::INVALID_INT_VALUE;
+    buffer_view.byte_offset = glTF::INVALID_INT_VALUE;
+    buffer_view.byte_stride = glTF::INVALID_INT_VALUE;
+    buffer_view.target = glTF::INVALID_INT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "buffer" ) ) {
+            load_int( reader, buffer_view.buffer );
+        } else if ( json_key_equals( key, "byteLength" ) ) {
+            load_int( reader, buffer_view.byte_length );
+        } else if ( json_key_equals( key, "byteOffset" ) ) {
+            load_int( reader, buffer_view.byte_offset );
+        } else if ( json_key_equals( key, "byteStride" ) ) {
+            load_int( reader, buffer_view.byte_stride );
+        } else if ( json_key_equals( key, "target" ) ) {
+            load_int( reader, buffer_view.target );
+        } else if ( json_key_equals( key, "name" ) ) {
+            json_read_string( reader, buffer_view.name, allocator );
+        } else {
+            json_skip_value( reader );
+        }
     }
 }
 
-static void load_image( json& json_data, glTF::Image& image, Allocator* allocator ) {
-    try_load_int( json_data, "bufferView", image.buffer_view );
-    try_load_string( json_data, "mimeType", image.mime_type, allocator );
-    try_load_string( json_data, "uri", image.uri, allocator );
+static void load_node( JsonReader& reader, glTF::Node& node, Allocator* allocator ) {
+    node.camera = glTF::INVALID_INT_VALUE;
+    node.mesh = glTF::INVALID_INT_VALUE;
+    node.skin = glTF::INVALID_INT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "camera" ) ) {
+            load_int( reader, node.camera );
+        } else if ( json_key_equals( key, "mesh" ) ) {
+            load_int( reader, node.mesh );
+        } else if ( json_key_equals( key, "skin" ) ) {
+            load_int( reader, node.skin );
+        } else if ( json_key_equals( key, "children" ) ) {
+            load_int_array( reader, node.children_count, &node.children, allocator );
+        } else if ( json_key_equals( key, "matrix" ) ) {
+            load_float_array( reader, node.matrix_count, &node.matrix, allocator );
+        } else if ( json_key_equals( key, "rotation" ) ) {
+            load_float_array( reader, node.rotation_count, &node.rotation, allocator );
+        } else if ( json_key_equals( key, "scale" ) ) {
+            load_float_array( reader, node.scale_count, &node.scale, allocator );
+        } else if ( json_key_equals( key, "translation" ) ) {
+            load_float_array( reader, node.translation_count, &node.translation, allocator );
+        } else if ( json_key_equals( key, "weights" ) ) {
+            load_float_array( reader, node.weights_count, &node.weights, allocator );
+        } else if ( json_key_equals( key, "name" ) ) {
+            json_read_string( reader, node.name, allocator );
+        } else {
+            json_skip_value( reader );
+        }
+    }
 }
 
-static void load_images( json& json_data, glTF::glTF& gltf_data, Allocator* allocator ) {
-    json array = json_data[ "images" ];
+static void load_mesh_primitive_attributes( JsonReader& reader, glTF::MeshPrimitive& mesh_primitive, Allocator* allocator ) {
+    mesh_primitive.attributes = allocate_array<glTF::MeshPrimitive::Attribute>( reader, mesh_primitive.attribute_count, allocator );
 
-    sizet array_count = array.size();
-    gltf_data.images = ( glTF::Image* )allocate_and_zero( allocator, sizeof( glTF::Image ) * array_count );
-    gltf_data.images_count = array_count;
+    u32 index = 0;
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        glTF::MeshPrimitive::Attribute& attribute = mesh_primitive.attributes[ index++ ];
+
+        attribute.key.init( key.length + 1, allocator );
+        attribute.key.append_m( ( void* )key.text, key.length );
+        attribute.key.data[ key.length ] = 0;
 
-    for ( sizet i = 0; i < array_count; ++i ) {
-        load_image( array[ i ], gltf_data.images[ i ], allocator );
+        load_int( reader, attribute.accessor_index );
     }
 }
 
-static void load_sampler( json& json_data, glTF::Sampler& sampler, Allocator* allocator ) {
-    try_load_int( json_data, "magFilter", sampler.mag_filter );
-    try_load_int( json_data, "minFilter", sampler.min_filter );
-    try_load_int( json_data, "wrapS", sampler.wrap_s );
-    try_load_int( json_data, "wrapT", sampler.wrap_t );
+static void load_mesh_primitive( JsonReader& reader, glTF::MeshPrimitive& mesh_primitive, Allocator* allocator ) {
+    mesh_primitive.indices = glTF::INVALID_INT_VALUE;
+    mesh_primitive.material = glTF::INVALID_INT_VALUE;
+    mesh_primitive.mode = glTF::INVALID_INT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "indices" ) ) {
+            load_int( reader, mesh_primitive.indices );
+        } else if ( json_key_equals( key, "material" ) ) {
+            load_int( reader, mesh_primitive.material );
+        } else if ( json_key_equals( key, "mode" ) ) {
+            load_int( reader, mesh_primitive.mode );
+        } else if ( json_key_equals( key, "attributes" ) ) {
+            load_mesh_primitive_attributes( reader, mesh_primitive, allocator );
+        } else {
+            json_skip_value( reader );
+        }
+    }
 }
 
-static void load_samplers( json& json_data, glTF::glTF& gltf_data, Allocator* allocator ) {
-    json array = json_data[ "samplers" ];
+static void load_mesh( JsonReader& reader, glTF::Mesh& mesh, Allocator* allocator ) {
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "primitives" ) ) {
+            mesh.primitives = allocate_array<glTF::MeshPrimitive>( reader, mesh.primitives_count, allocator );
+
+            u32 index = 0;
+            bool first_primitive = true;
+            json_array_begin( reader );
+            while ( json_array_next( reader, first_primitive ) ) {
+                load_mesh_primitive( reader, mesh.primitives[ index++ ], allocator );
+            }
+        } else if ( json_key_equals( key, "weights" ) ) {
+            load_float_array( reader, mesh.weights_count, &mesh.weights, allocator );
+        } else if ( json_key_equals( key, "name" ) ) {
+            json_read_string( reader, mesh.name, allocator );
+        } else {
+            json_skip_value( reader );
+        }
+    }
+}
 
-    sizet array_count = array.size();
-    gltf_data.samplers = ( glTF::Sampler* )allocate_and_zero( allocator, sizeof( glTF::Sampler ) * array_count );
-    gltf_data.samplers_count = array_count;
+static void load_accessor( JsonReader& reader, glTF::Accessor& accessor, Allocator* allocator ) {
+    accessor.buffer_view = glTF::INVALID_INT_VALUE;
+    accessor.byte_offset = glTF::INVALID_INT_VALUE;
+    accessor.component_type = glTF::INVALID_INT_VALUE;
+    accessor.count = glTF::INVALID_INT_VALUE;
+    accessor.sparse = glTF::INVALID_INT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "bufferView" ) ) {
+            load_int( reader, accessor.buffer_view );
+        } else if ( json_key_equals( key, "byteOffset" ) ) {
+            load_int( reader, accessor.byte_offset );
+        } else if ( json_key_equals( key, "componentType" ) ) {
+            load_int( reader, accessor.component_type );
+        } else if ( json_key_equals( key, "count" ) ) {
+            load_int( reader, accessor.count );
+        } else if ( json_key_equals( key, "max" ) ) {
+            load_float_array( reader, accessor.max_count, &accessor.max, allocator );
+        } else if ( json_key_equals( key, "min" ) ) {
+            load_float_array( reader, accessor.min_count, &accessor.min, allocator );
+        } else if ( json_key_equals( key, "normalized" ) ) {
+            accessor.normalized = json_read_bool( reader );
+        } else if ( json_key_equals( key, "type" ) ) {
+            load_type( reader, accessor.type );
+        } else {
+            // NOTE: sparse accessors are objects and are not supported yet.
+            json_skip_value( reader );
+        }
+    }
+}
 
-    for ( sizet i = 0; i < array_count; ++i ) {
-        load_sampler( array[ i ], gltf_data.samplers[ i ], allocator );
+static void load_texture_info( JsonReader& reader, glTF::TextureInfo** texture_info, Allocator* allocator ) {
+    glTF::TextureInfo* ti = ( glTF::TextureInfo* )allocate_and_zero( reader, allocator, sizeof( glTF::TextureInfo ) );
+    if ( ti == nullptr ) {
+        return;
+    }
+    ti->index = glTF::INVALID_INT_VALUE;
+    ti->texCoord = glTF::INVALID_INT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "index" ) ) {
+            load_int( reader, ti->index );
+        } else if ( json_key_equals( key, "texCoord" ) ) {
+            load_int( reader, ti->texCoord );
+        } else {
+            json_skip_value( reader );
+        }
     }
+
+    *texture_info = ti;
 }
 
-static void load_skin( json& json_data, glTF::Skin& skin, Allocator* allocator ) {
-    try_load_int( json_data, "skeleton", skin.skeleton_root_node_index );
-    try_load_int( json_data, "inverseBindMatrices", skin.inverse_bind_matrices_buffer_index );
-    try_load_int_array( json_data, "joints", skin.joints_count, &skin.joints, allocator );
+static void load_material_normal_texture_info( JsonReader& reader, glTF::MaterialNormalTextureInfo** texture_info, Allocator* allocator ) {
+    glTF::MaterialNormalTextureInfo* ti = ( glTF::MaterialNormalTextureInfo* )allocate_and_zero( reader, allocator, sizeof( glTF::MaterialNormalTextureInfo ) );
+    if ( ti == nullptr ) {
+        return;
+    }
+    ti->index = glTF::INVALID_INT_VALUE;
+    ti->tex_coord = glTF::INVALID_INT_VALUE;
+    ti->scale = glTF::INVALID_FLOAT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "index" ) ) {
+            load_int( reader, ti->index );
+        } else if ( json_key_equals( key, "texCoord" ) ) {
+            load_int( reader, ti->tex_coord );
+        } else if ( json_key_equals( key, "scale" ) ) {
+            load_float( reader, ti->scale );
+        } else {
+            json_skip_value( reader );
+        }
+    }
+
+    *texture_info = ti;
 }
 
-static void load_skins( json& json_data, glTF::glTF& gltf_data, Allocator* allocator ) {
-    json array = json_data[ "skins" ];
+static void load_material_occlusion_texture_info( JsonReader& reader, glTF::MaterialOcclusionTextureInfo** texture_info, Allocator* allocator ) {
+    glTF::MaterialOcclusionTextureInfo* ti = ( glTF::MaterialOcclusionTextureInfo* )allocate_and_zero( reader, allocator, sizeof( glTF::MaterialOcclusionTextureInfo ) );
+    if ( ti == nullptr ) {
+        return;
+    }
+    ti->index = glTF::INVALID_INT_VALUE;
+    ti->texCoord = glTF::INVALID_INT_VALUE;
+    ti->strength = glTF::INVALID_FLOAT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "index" ) ) {
+            load_int( reader, ti->index );
+        } else if ( json_key_equals( key, "texCoord" ) ) {
+            load_int( reader, ti->texCoord );
+        } else if ( json_key_equals( key, "strength" ) ) {
+            load_float( reader, ti->strength );
+        } else {
+            json_skip_value( reader );
+        }
+    }
 
-    sizet array_count = array.size();
-    gltf_data.skins = ( glTF::Skin* )allocate_and_zero( allocator, sizeof( glTF::Skin ) * array_count );
-    gltf_data.skins_count = array_count;
+    *texture_info = ti;
+}
 
-    for ( sizet i = 0; i < array_count; ++i ) {
-        load_skin( array[ i ], gltf_data.skins[ i ], allocator );
+static void load_material_pbr_metallic_roughness( JsonReader& reader, glTF::MaterialPBRMetallicRoughness** texture_info, Allocator* allocator ) {
+    glTF::MaterialPBRMetallicRoughness* ti = ( glTF::MaterialPBRMetallicRoughness* )allocate_and_zero( reader, allocator, sizeof( glTF::MaterialPBRMetallicRoughness ) );
+    if ( ti == nullptr ) {
+        return;
     }
+    ti->base_color_factor_count = 0;
+    ti->base_color_factor = nullptr;
+    ti->base_color_texture = nullptr;
+    ti->metallic_factor = glTF::INVALID_FLOAT_VALUE;
+    ti->metallic_roughness_texture = nullptr;
+    ti->roughness_factor = glTF::INVALID_FLOAT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "baseColorFactor" ) ) {
+            load_float_array( reader, ti->base_color_factor_count, &ti->base_color_factor, allocator );
+        } else if ( json_key_equals( key, "baseColorTexture" ) ) {
+            load_texture_info( reader, &ti->base_color_texture, allocator );
+        } else if ( json_key_equals( key, "metallicFactor" ) ) {
+            load_float( reader, ti->metallic_factor );
+        } else if ( json_key_equals( key, "metallicRoughnessTexture" ) ) {
+            load_texture_info( reader, &ti->metallic_roughness_texture, allocator );
+        } else if ( json_key_equals( key, "roughnessFactor" ) ) {
+            load_float( reader, ti->roughness_factor );
+        } else {
+            json_skip_value( reader );
+        }
+    }
+
+    *texture_info = ti;
 }
 
-static void load_animation( json& json_data, glTF::Animation& animation, Allocator* allocator ) {
+static void load_material( JsonReader& reader, glTF::Material& material, Allocator* allocator ) {
+    material.alpha_cutoff = glTF::INVALID_FLOAT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "emissiveFactor" ) ) {
+            load_float_array( reader, material.emissive_factor_count, &material.emissive_factor, allocator );
+        } else if ( json_key_equals( key, "alphaCutoff" ) ) {
+            load_float( reader, material.alpha_cutoff );
+        } else if ( json_key_equals( key, "alphaMode" ) ) {
+            json_read_string( reader, material.alpha_mode, allocator );
+        } else if ( json_key_equals( key, "doubleSided" ) ) {
+            material.double_sided = json_read_bool( reader );
+        } else if ( json_key_equals( key, "emissiveTexture" ) ) {
+            load_texture_info( reader, &material.emissive_texture, allocator );
+        } else if ( json_key_equals( key, "normalTexture" ) ) {
+            load_material_normal_texture_info( reader, &material.normal_texture, allocator );
+        } else if ( json_key_equals( key, "occlusionTexture" ) ) {
+            load_material_occlusion_texture_info( reader, &material.occlusion_texture, allocator );
+        } else if ( json_key_equals( key, "pbrMetallicRoughness" ) ) {
+            load_material_pbr_metallic_roughness( reader, &material.pbr_metallic_roughness, allocator );
+        } else if ( json_key_equals( key, "name" ) ) {
+            json_read_string( reader, material.name, allocator );
+        } else {
+            json_skip_value( reader );
+        }
+    }
+}
 
-    json json_array = json_data.at( "samplers" );
-    if ( json_array.is_array() ) {
-        sizet count = json_array.size();
+static void load_texture( JsonReader& reader, glTF::Texture& texture, Allocator* allocator ) {
+    texture.sampler = glTF::INVALID_INT_VALUE;
+    texture.source = glTF::INVALID_INT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "sampler" ) ) {
+            load_int( reader, texture.sampler );
+        } else if ( json_key_equals( key, "source" ) ) {
+            load_int( reader, texture.source );
+        } else if ( json_key_equals( key, "name" ) ) {
+            json_read_string( reader, texture.name, allocator );
+        } else {
+            json_skip_value( reader );
+        }
+    }
+}
 
-        glTF::AnimationSampler* values = ( glTF::AnimationSampler* )allocate_and_zero( allocator, sizeof( glTF::AnimationSampler ) * count );
+static void load_image( JsonReader& reader, glTF::Image& image, Allocator* allocator ) {
+    image.buffer_view = glTF::INVALID_INT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "bufferView" ) ) {
+            load_int( reader, image.buffer_view );
+        } else if ( json_key_equals( key, "mimeType" ) ) {
+            json_read_string( reader, image.mime_type, allocator );
+        } else if ( json_key_equals( key, "uri" ) ) {
+            json_read_string( reader, image.uri, allocator );
+        } else {
+            json_skip_value( reader );
+        }
+    }
+}
 
-        for ( sizet i = 0; i < count; ++i ) {
-            json element = json_array.at( i );
-            glTF::AnimationSampler& sampler = values[ i ];
+static void load_sampler( JsonReader& reader, glTF::Sampler& sampler, Allocator* allocator ) {
+    sampler.mag_filter = glTF::INVALID_INT_VALUE;
+    sampler.min_filter = glTF::INVALID_INT_VALUE;
+    sampler.wrap_s = glTF::INVALID_INT_VALUE;
+    sampler.wrap_t = glTF::INVALID_INT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "magFilter" ) ) {
+            load_int( reader, sampler.mag_filter );
+        } else if ( json_key_equals( key, "minFilter" ) ) {
+            load_int( reader, sampler.min_filter );
+        } else if ( json_key_equals( key, "wrapS" ) ) {
+            load_int( reader, sampler.wrap_s );
+        } else if ( json_key_equals( key, "wrapT" ) ) {
+            load_int( reader, sampler.wrap_t );
+        } else {
+            json_skip_value( reader );
+        }
+    }
+}
 
-            try_load_int( element, "input", sampler.input_keyframe_buffer_index );
-            try_load_int( element, "output", sampler.output_keyframe_buffer_index );
+static void load_skin( JsonReader& reader, glTF::Skin& skin, Allocator* allocator ) {
+    skin.skeleton_root_node_index = glTF::INVALID_INT_VALUE;
+    skin.inverse_bind_matrices_buffer_index = glTF::INVALID_INT_VALUE;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "skeleton" ) ) {
+            load_int( reader, skin.skeleton_root_node_index );
+        } else if ( json_key_equals( key, "inverseBindMatrices" ) ) {
+            load_int( reader, skin.inverse_bind_matrices_buffer_index );
+        } else if ( json_key_equals( key, "joints" ) ) {
+            load_int_array( reader, skin.joints_count, &skin.joints, allocator );
+        } else {
+            json_skip_value( reader );
+        }
+    }
+}
 
-            std::string value = element.value( "interpolation", "");
-            if ( value == "LINEAR" ) {
-                sampler.interpolation = glTF::AnimationSampler::Linear;
-            }
-            else if ( value == "STEP" ) {
+static void load_animation_sampler( JsonReader& reader, glTF::AnimationSampler& sampler ) {
+    sampler.input_keyframe_buffer_index = glTF::INVALID_INT_VALUE;
+    sampler.output_keyframe_buffer_index = glTF::INVALID_INT_VALUE;
+    sampler.interpolation = glTF::AnimationSampler::Linear;
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "input" ) ) {
+            load_int( reader, sampler.input_keyframe_buffer_index );
+        } else if ( json_key_equals( key, "output" ) ) {
+            load_int( reader, sampler.output_keyframe_buffer_index );
+        } else if ( json_key_equals( key, "interpolation" ) ) {
+            JsonKey value;
+            json_read_raw_string( reader, value, nullptr );
+
+            if ( json_key_equals( value, "STEP" ) ) {
                 sampler.interpolation = glTF::AnimationSampler::Step;
             }
-            else if ( value == "CUBICSPLINE" ) {
+            else if ( json_key_equals( value, "CUBICSPLINE" ) ) {
                 sampler.interpolation = glTF::AnimationSampler::CubicSpline;
             }
             else {
                 sampler.interpolation = glTF::AnimationSampler::Linear;
             }
+        } else {
+            json_skip_value( reader );
         }
-
-        animation.samplers = values;
-        animation.samplers_count = count;
     }
+}
 
-    json_array = json_data.at( "channels" );
-    if ( json_array.is_array() ) {
-        sizet count = json_array.size();
-
-        glTF::AnimationChannel* values = ( glTF::AnimationChannel* )allocate_and_zero( allocator, sizeof( glTF::AnimationChannel ) * count );
-
-        for ( sizet i = 0; i < count; ++i ) {
-            json element = json_array.at( i );
-            glTF::AnimationChannel& channel = values[ i ];
-
-            try_load_int( element, "sampler", channel.sampler );
-            json target = element.at( "target" );
-            try_load_int( target, "node", channel.target_node );
-
-            std::string target_path = target.value( "path", "");
-            if ( target_path == "scale" ) {
+static void load_animation_channel_target( JsonReader& reader, glTF::AnimationChannel& channel ) {
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "node" ) ) {
+            load_int( reader, channel.target_node );
+        } else if ( json_key_equals( key, "path" ) ) {
+            JsonKey value;
+            json_read_raw_string( reader, value, nullptr );
+
+            if ( json_key_equals( value, "scale" ) ) {
                 channel.target_type = glTF::AnimationChannel::Scale;
             }
-            else if ( target_path == "rotation" ) {
+            else if ( json_key_equals( value, "rotation" ) ) {
                 channel.target_type = glTF::AnimationChannel::Rotation;
             }
-            else if ( target_path == "translation" ) {
+            else if ( json_key_equals( value, "translation" ) ) {
                 channel.target_type = glTF::AnimationChannel::Translation;
             }
-            else if ( target_path == "weights" ) {
+            else if ( json_key_equals( value, "weights" ) ) {
                 channel.target_type = glTF::AnimationChannel::Weights;
             }
             else {
-                RASSERTM( false, "Error parsing target path %s\n", target_path.c_str() );
+                RASSERTM( false, "Error parsing target path %.*s\n", value.length, value.text );
                 channel.target_type = glTF::AnimationChannel::Count;
             }
+        } else {
+            json_skip_value( reader );
         }
-
-        animation.channels = values;
-        animation.channels_count = count;
     }
 }
 
-static void load_animations( json& json_data, glTF::glTF& gltf_data, Allocator* allocator ) {
-    json array = json_data[ "animations" ];
+static void load_animation( JsonReader& reader, glTF::Animation& animation, Allocator* allocator ) {
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "samplers" ) ) {
+            animation.samplers = allocate_array<glTF::AnimationSampler>( reader, animation.samplers_count, allocator );
+
+            u32 index = 0;
+            bool first_sampler = true;
+            json_array_begin( reader );
+            while ( json_array_next( reader, first_sampler ) ) {
+                load_animation_sampler( reader, animation.samplers[ index++ ] );
+            }
+        } else if ( json_key_equals( key, "channels" ) ) {
+            animation.channels = allocate_array<glTF::AnimationChannel>( reader, animation.channels_count, allocator );
+
+            u32 index = 0;
+            bool first_channel = true;
+            json_array_begin( reader );
+            while ( json_array_next( reader, first_channel ) ) {
+                glTF::AnimationChannel& channel = animation.channels[ index++ ];
+                channel.sampler = glTF::INVALID_INT_VALUE;
+                channel.target_node = glTF::INVALID_INT_VALUE;
+                channel.target_type = glTF::AnimationChannel::Count;
+
+                JsonKey channel_key;
+                bool first_key = true;
+                json_object_begin( reader );
+                while ( json_object_next( reader, channel_key, first_key ) ) {
+                    if ( json_key_equals( channel_key, "sampler" ) ) {
+                        load_int( reader, channel.sampler );
+                    } else if ( json_key_equals( channel_key, "target" ) ) {
+                        load_animation_channel_target( reader, channel );
+                    } else {
+                        json_skip_value( reader );
+                    }
+                }
+            }
+        } else {
+            json_skip_value( reader );
+        }
+    }
+}
 
-    sizet array_count = array.size();
-    gltf_data.animations = ( glTF::Animation* )allocate_and_zero( allocator, sizeof( glTF::Animation ) * array_count );
-    gltf_data.animations_count = array_count;
+// Parse a top level array of objects with the given element loader.
+template <typename T>
+static void load_array( JsonReader& reader, T*& elements, u32& count, void ( *load_element )( JsonReader&, T&, Allocator* ), Allocator* allocator ) {
+    elements = allocate_array<T>( reader, count, allocator );
 
-    for ( sizet i = 0; i < array_count; ++i ) {
-        load_animation( array[ i ], gltf_data.animations[ i ], allocator );
+    u32 index = 0;
+    bool first = true;
+    json_array_begin( reader );
+    while ( json_array_next( reader, first ) ) {
+        load_element( reader, elements[ index++ ], allocator );
     }
 }
 
@@ -554,48 +1145,65 @@ glTF::glTF gltf_load_file( cstring file_path ) {
         return result;
     }
 
-    Allocator* heap_allocator = &MemoryService::instance()->system_allocator;
+    MappedFile gltf_file;
+    if ( !gltf_file.open( file_path, FileAccessHint::Sequential ) ) {
+        rprint( "Error: cannot map file %s.\n", file_path );
+        return result;
+    }
 
-    FileReadResult read_result = file_read_text( file_path, heap_allocator );
+    // Parsed data is usually smaller than the text, documents of many small elements grow the arena past it.
+    result.allocator.init( max( ( sizet )rmega( 2 ), gltf_file.size * 2 ) );
+    if ( result.allocator.blocks == nullptr ) {
+        rprint( "Error: cannot allocate memory for %s.\n", file_path );
+        gltf_file.close();
+        return result;
+    }
+    Allocator* allocator = &result.allocator;
 
-    json gltf_data = json::parse( read_result.data );
+    JsonReader reader{ ( cstring )gltf_file.data, ( cstring )gltf_file.data, ( cstring )gltf_file.data + gltf_file.size, false };
+
+    JsonKey key;
+    bool first = true;
+    json_object_begin( reader );
+    while ( json_object_next( reader, key, first ) ) {
+        if ( json_key_equals( key, "asset" ) ) {
+            load_asset( reader, result.asset, allocator );
+        } else if ( json_key_equals( key, "scene" ) ) {
+            load_int( reader, result.scene );
+        } else if ( json_key_equals( key, "scenes" ) ) {
+            load_array( reader, result.scenes, result.scenes_count, load_scene, allocator );
+        } else if ( json_key_equals( key, "buffers" ) ) {
+            load_array( reader, result.buffers, result.buffers_count, load_buffer, allocator );
+        } else if ( json_key_equals( key, "bufferViews" ) ) {
+            load_array( reader, result.buffer_views, result.buffer_views_count, load_buffer_view, allocator );
+        } else if ( json_key_equals( key, "nodes" ) ) {
+            load_array( reader, result.nodes, result.nodes_count, load_node, allocator );
+        } else if ( json_key_equals( key, "meshes" ) ) {
+            load_array( reader, result.meshes, result.meshes_count, load_mesh, allocator );
+        } else if ( json_key_equals( key, "accessors" ) ) {
+            load_array( reader, result.accessors, result.accessors_count, load_accessor, allocator );
+        } else if ( json_key_equals( key, "materials" ) ) {
+            load_array( reader, result.materials, result.materials_count, load_material, allocator );
+        } else if ( json_key_equals( key, "textures" ) ) {
+            load_array( reader, result.textures, result.textures_count, load_texture, allocator );
+        } else if ( json_key_equals( key, "images" ) ) {
+            load_array( reader, result.images, result.images_count, load_image, allocator );
+        } else if ( json_key_equals( key, "samplers" ) ) {
+            load_array( reader, result.samplers, result.samplers_count, load_sampler, allocator );
+        } else if ( json_key_equals( key, "skins" ) ) {
+            load_array( reader, result.skins, result.skins_count, load_skin, allocator );
+        } else if ( json_key_equals( key, "animations" ) ) {
+            load_array( reader, result.animations, result.animations_count, load_animation, allocator );
+        } else {
+            json_skip_value( reader );
+        }
+    }
 
-    result.allocator.init( rmega(2) );
-    Allocator* allocator = &result.allocator;
+    if ( reader.error ) {
+        rprint( "Error: malformed glTF file %s.\n", file_path );
+    }
 
-    for ( auto properties : gltf_data.items() ) {
-        if ( properties.key() == "asset" ) {
-            load_asset( gltf_data, result.asset, allocator );
-        } else if ( properties.key() == "scene" ) {
-            try_load_int( gltf_data, "scene", result.scene );
-        } else if ( properties.key() == "scenes" ) {
-            load_scenes( gltf_data, result, allocator );
-        } else if ( properties.key() == "buffers" ) {
-            load_buffers( gltf_data, result, allocator );
-        } else if ( properties.key() == "bufferViews" ) {
-            load_buffer_views( gltf_data, result, allocator );
-        } else if ( properties.key() == "nodes" ) {
-            load_nodes( gltf_data, result, allocator );
-        } else if ( properties.key() == "meshes" ) {
-            load_meshes( gltf_data, result, allocator );
-        } else if ( properties.key() == "accessors" ) {
-            load_accessors( gltf_data, result, allocator );
-        } else if ( properties.key() == "materials" ) {
-            load_materials( gltf_data, result, allocator );
-        } else if ( properties.key() == "textures" ) {
-            load_textures( gltf_data, result, allocator );
-        } else if ( properties.key() == "images" ) {
-            load_images( gltf_data, result, allocator );
-        } else if ( properties.key() == "samplers" ) {
-            load_samplers( gltf_data, result, allocator );
-        } else if ( properties.key() == "skins" ) {
-            load_skins( gltf_data, result, allocator );
-        } else if ( properties.key() == "animations" ) {
-            load_animations( gltf_data, result, allocator );
-        }
-    }
-
-    heap_allocator->deallocate( read_result.data );
+    gltf_file.close();
 
     return result;
 }
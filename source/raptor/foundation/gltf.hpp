@@ -276,6 +276,29 @@ namespace glTF {
         i32                         wrap_t;
     };
 
+    struct ArenaBlock;
+
+    //
+    // Linear arena holding all the parsed data of a document. The first block is sized from the file,
+    // more blocks are chained when small elements expand past it. Memory is released only on shutdown.
+    struct Arena : public Allocator {
+
+        void                        init( sizet first_block_size );
+        void                        shutdown();
+
+        void*                       allocate( sizet size, sizet alignment ) override;
+        void*                       allocate( sizet size, sizet alignment, cstring file, i32 line ) override;
+
+        void                        deallocate( void* pointer ) override;
+
+        ArenaBlock*                 blocks          = nullptr;  // Most recent first.
+        sizet                       block_size      = 0;
+        sizet                       block_offset    = 0;
+
+        sizet                       allocated_size  = 0;
+        u32                         block_count     = 0;
+    }; // struct Arena
+
     struct glTF {
         u32                         accessors_count;
         Accessor*                   accessors;
@@ -310,7 +333,7 @@ namespace glTF {
         u32                         textures_count;
         Texture*                    textures;
 
-        LinearAllocator             allocator;
+        Arena                       allocator;
     };
 
     i32                             get_data_offset( i32 accessor_offset, i32 buffer_view_offset );
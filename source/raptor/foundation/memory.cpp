@@ -3,9 +3,17 @@
 #include "assert.hpp"
 
 #include "external/tlsf.h"
+#include "external/enkiTS/TaskScheduler.h"
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <memory.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <mutex>
+#include <new>
+#include <thread>
 
 #if defined RAPTOR_IMGUI
 #include "external/imgui/imgui.h"
@@ -21,6 +29,17 @@
 #include "external/StackWalker.h"
 #endif // RAPTOR_MEMORY_STACK
 
+// Define this to capture the call stack of each allocation when telemetry is enabled, printed for leaks.
+//#define RAPTOR_MEMORY_LEAK_STACKS
+
+#if defined (RAPTOR_MEMORY_LEAK_STACKS)
+#if defined (_MSC_VER)
+#include <windows.h>
+#else
+#include <execinfo.h>
+#endif // _MSC_VER
+#endif // RAPTOR_MEMORY_LEAK_STACKS
+
 namespace raptor {
 
 //#define RAPTOR_MEMORY_DEBUG
@@ -40,6 +59,120 @@ static size_t s_size = rmega(32) + tlsf_size() + 8;
 // Walker methods
 static void exit_walker( void* ptr, size_t size, int used, void* user );
 static void imgui_walker( void* ptr, size_t size, int used, void* user );
+static void telemetry_exit_walker( void* ptr, size_t size, int used, void* user );
+static void statistics_walker( void* ptr, size_t size, int used, void* user );
+
+// Memory Telemetry ///////////////////////////////////////////////////////
+
+//
+// Stored before the memory returned by a heap allocator with telemetry.
+struct MemoryAllocationHeader {
+    cstring                         file;
+    sizet                           size;
+#if defined (RAPTOR_MEMORY_LEAK_STACKS)
+    void*                           stack[ k_memory_stack_depth ];
+#endif // RAPTOR_MEMORY_LEAK_STACKS
+    u32                             line;
+    u32                             tag;
+    u32                             magic;
+    u32                             offset;     // From the header to the returned memory, also stored right before it.
+}; // struct MemoryAllocationHeader
+
+static_assert( offsetof( MemoryAllocationHeader, offset ) + sizeof( u32 ) == sizeof( MemoryAllocationHeader ), "The offset must precede the returned memory" );
+
+static const u32                    k_memory_header_magic   = 0x7A6E4D21;
+
+static cstring                      s_memory_tag_names[ k_memory_max_tags ] = { "untagged" };
+static u32                          s_memory_num_tags = 1;
+static thread_local u32             s_memory_current_tag = 0;
+
+u32 memory_tag_register( cstring name ) {
+    for ( u32 t = 0; t < s_memory_num_tags; ++t ) {
+        if ( strcmp( s_memory_tag_names[ t ], name ) == 0 ) {
+            return t;
+        }
+    }
+
+    RASSERTM( s_memory_num_tags < k_memory_max_tags, "Too many memory tags, cannot register %s", name );
+    if ( s_memory_num_tags == k_memory_max_tags ) {
+        return 0;
+    }
+
+    s_memory_tag_names[ s_memory_num_tags ] = name;
+    return s_memory_num_tags++;
+}
+
+cstring memory_tag_name( u32 tag ) {
+    return tag < s_memory_num_tags ? s_memory_tag_names[ tag ] : "invalid";
+}
+
+u32 memory_tag_current() {
+    return s_memory_current_tag;
+}
+
+u32 memory_size_class( sizet size ) {
+    u32 size_class = 0;
+    for ( sizet class_size = 16; class_size < size && size_class < k_memory_size_classes - 1; class_size <<= 1 ) {
+        ++size_class;
+    }
+    return size_class;
+}
+
+MemoryTagScope::MemoryTagScope( u32 tag ) {
+    previous_tag = s_memory_current_tag;
+    s_memory_current_tag = tag;
+}
+
+MemoryTagScope::~MemoryTagScope() {
+    s_memory_current_tag = previous_tag;
+}
+
+void MemoryTelemetry::reset() {
+    memset( tags, 0, sizeof( tags ) );
+    current_bytes = 0;
+    peak_bytes = 0;
+}
+
+void MemoryTelemetry::on_allocate( u32 tag, sizet size ) {
+    MemoryTagStats& tag_stats = tags[ tag ];
+    tag_stats.current_bytes += size;
+    tag_stats.peak_bytes = tag_stats.current_bytes > tag_stats.peak_bytes ? tag_stats.current_bytes : tag_stats.peak_bytes;
+    ++tag_stats.current_count;
+    ++tag_stats.total_count;
+    ++tag_stats.size_classes[ memory_size_class( size ) ];
+
+    current_bytes += size;
+    peak_bytes = current_bytes > peak_bytes ? current_bytes : peak_bytes;
+}
+
+void MemoryTelemetry::on_deallocate( u32 tag, sizet size ) {
+    MemoryTagStats& tag_stats = tags[ tag ];
+    tag_stats.current_bytes -= size;
+    --tag_stats.current_count;
+    --tag_stats.size_classes[ memory_size_class( size ) ];
+
+    current_bytes -= size;
+}
+
+static void print_allocation_stack( const MemoryAllocationHeader* header ) {
+#if defined (RAPTOR_MEMORY_LEAK_STACKS)
+    u32 depth = 0;
+    while ( depth < k_memory_stack_depth && header->stack[ depth ] ) {
+        ++depth;
+    }
+#if defined (_MSC_VER)
+    for ( u32 i = 0; i < depth; ++i ) {
+        rprint( "\t\t%p\n", header->stack[ i ] );
+    }
+#else
+    char** symbols = backtrace_symbols( header->stack, depth );
+    for ( u32 i = 0; i < depth; ++i ) {
+        rprint( "\t\t%s\n", symbols ? symbols[ i ] : "?" );
+    }
+    free( symbols );
+#endif // _MSC_VER
+#endif // RAPTOR_MEMORY_LEAK_STACKS
+}
 
 MemoryService* MemoryService::instance() {
     return &s_memory_service;
@@ -52,10 +185,22 @@ void MemoryService::init( void* configuration ) {
     rprint( "Memory Service Init\n" );
     MemoryServiceConfiguration* memory_configuration = static_cast< MemoryServiceConfiguration* >( configuration );
     system_allocator.init( memory_configuration ? memory_configuration->maximum_dynamic_size : s_size );
+
+    if ( memory_configuration && memory_configuration->telemetry ) {
+        system_allocator.enable_telemetry();
+    }
+
+    if ( memory_configuration && memory_configuration->num_threads ) {
+        thread_allocator.init( memory_configuration->num_threads, memory_configuration->thread_scratch_size, memory_configuration->thread_heap_size );
+    }
 }
 
 void MemoryService::shutdown() {
 
+    if ( thread_allocator.num_threads ) {
+        thread_allocator.shutdown();
+    }
+
     system_allocator.shutdown();
 
     rprint( "Memory Service Shutdown\n" );
@@ -66,7 +211,36 @@ void exit_walker( void* ptr, size_t size, int used, void* user ) {
     stats->add( used ? size : 0 );
 
     if ( used )
-        rprint( "Found active allocation %p, %llu\n", ptr, size );
+        rprint( "Found active allocation %p, %zu\n", ptr, size );
+}
+
+void telemetry_exit_walker( void* ptr, size_t size, int used, void* user ) {
+    MemoryStatistics* stats = ( MemoryStatistics* )user;
+    stats->add( used ? size : 0 );
+
+    if ( !used ) {
+        return;
+    }
+
+    // Blocks start with the header when telemetry is enabled.
+    const MemoryAllocationHeader* header = ( const MemoryAllocationHeader* )ptr;
+    RASSERT( header->magic == k_memory_header_magic );
+
+    rprint( "Found active allocation %p, %zu, tag %s, %s:%u\n", ( u8* )ptr + header->offset, header->size, memory_tag_name( header->tag ),
+            header->file ? header->file : "unknown", header->line );
+    print_allocation_stack( header );
+}
+
+void statistics_walker( void* ptr, size_t size, int used, void* user ) {
+    HeapStatistics* stats = ( HeapStatistics* )user;
+    if ( used ) {
+        stats->used_bytes += size;
+        ++stats->used_blocks;
+    } else {
+        stats->free_bytes += size;
+        ++stats->free_blocks;
+        stats->largest_free_block = size > stats->largest_free_block ? size : stats->largest_free_block;
+    }
 }
 
 #if defined RAPTOR_IMGUI
@@ -82,7 +256,7 @@ void imgui_walker( void* ptr, size_t size, int used, void* user ) {
         memory_size /= 1024;
         memory_unit = "kb";
     }
-    ImGui::Text( "\t%p %s size: %4llu %s\n", ptr, used ? "used" : "free", memory_size, memory_unit );
+    ImGui::Text( "\t%p %s size: %4u %s\n", ptr, used ? "used" : "free", memory_size, memory_unit );
 
     MemoryStatistics* stats = ( MemoryStatistics* )user;
     stats->add( used ? size : 0 );
@@ -94,6 +268,10 @@ void MemoryService::imgui_draw() {
     if ( ImGui::Begin( "Memory Service" ) ) {
 
         system_allocator.debug_ui();
+
+        if ( thread_allocator.num_threads && ImGui::CollapsingHeader( "Thread allocator" ) ) {
+            thread_allocator.debug_ui();
+        }
     }
     ImGui::End();
 }
@@ -137,7 +315,10 @@ void HeapAllocator::init( sizet size ) {
 
     tlsf_handle = tlsf_create_with_pool( memory, size );
 
-    rprint( "HeapAllocator of size %llu created\n", size );
+    telemetry_enabled = false;
+    telemetry.reset();
+
+    rprint( "HeapAllocator of size %zu created\n", size );
 }
 
 void HeapAllocator::shutdown() {
@@ -145,10 +326,19 @@ void HeapAllocator::shutdown() {
     // Check memory at the application exit.
     MemoryStatistics stats{ 0, max_size };
     pool_t pool = tlsf_get_pool( tlsf_handle );
-    tlsf_walk_pool( pool, exit_walker, ( void* )&stats );
+    tlsf_walk_pool( pool, telemetry_enabled ? telemetry_exit_walker : exit_walker, ( void* )&stats );
 
     if ( stats.allocated_bytes ) {
-        rprint( "HeapAllocator Shutdown.\n===============\nFAILURE! Allocated memory detected. allocated %llu, total %llu\n===============\n\n", stats.allocated_bytes, stats.total_bytes );
+        rprint( "HeapAllocator Shutdown.\n===============\nFAILURE! Allocated memory detected. allocated %zu, total %zu\n===============\n\n", stats.allocated_bytes, stats.total_bytes );
+
+        if ( telemetry_enabled ) {
+            for ( u32 t = 0; t < s_memory_num_tags; ++t ) {
+                const MemoryTagStats& tag_stats = telemetry.tags[ t ];
+                if ( tag_stats.current_count ) {
+                    rprint( "\tTag %s: %u allocations, %zu bytes\n", memory_tag_name( t ), tag_stats.current_count, tag_stats.current_bytes );
+                }
+            }
+        }
     } else {
         rprint( "HeapAllocator Shutdown - all memory free!\n" );
     }
@@ -166,16 +356,151 @@ void HeapAllocator::debug_ui() {
     ImGui::Separator();
     ImGui::Text( "Heap Allocator" );
     ImGui::Separator();
-    MemoryStatistics stats{ 0, max_size };
-    pool_t pool = tlsf_get_pool( tlsf_handle );
-    tlsf_walk_pool( pool, imgui_walker, ( void* )&stats );
 
-    ImGui::Separator();
-    ImGui::Text( "\tAllocation count %d", stats.allocation_count );
-    ImGui::Text( "\tAllocated %llu K, free %llu Mb, total %llu Mb", stats.allocated_bytes / (1024 * 1024), ( max_size - stats.allocated_bytes ) / ( 1024 * 1024 ), max_size / ( 1024 * 1024 ) );
+    HeapStatistics heap_stats;
+    get_statistics( heap_stats );
+    ImGui::Text( "\tBlocks: %u used, %u free. Largest free block %zu Kb of %zu Kb free, fragmentation %.2f", heap_stats.used_blocks, heap_stats.free_blocks,
+                 heap_stats.largest_free_block / 1024, heap_stats.free_bytes / 1024, heap_stats.fragmentation );
+
+    if ( telemetry_enabled ) {
+        ImGui::Text( "\tRequested %zu Kb, peak %zu Kb", telemetry.current_bytes / 1024, telemetry.peak_bytes / 1024 );
+
+        if ( ImGui::BeginTable( "Memory tags", 5 ) ) {
+            ImGui::TableSetupColumn( "Tag" );
+            ImGui::TableSetupColumn( "Current Kb" );
+            ImGui::TableSetupColumn( "Peak Kb" );
+            ImGui::TableSetupColumn( "Live" );
+            ImGui::TableSetupColumn( "Total" );
+            ImGui::TableHeadersRow();
+
+            for ( u32 t = 0; t < s_memory_num_tags; ++t ) {
+                const MemoryTagStats& tag_stats = telemetry.tags[ t ];
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::Text( "%s", memory_tag_name( t ) );
+                ImGui::TableNextColumn();
+                ImGui::Text( "%zu", tag_stats.current_bytes / 1024 );
+                ImGui::TableNextColumn();
+                ImGui::Text( "%zu", tag_stats.peak_bytes / 1024 );
+                ImGui::TableNextColumn();
+                ImGui::Text( "%u", tag_stats.current_count );
+                ImGui::TableNextColumn();
+                ImGui::Text( "%u", tag_stats.total_count );
+            }
+            ImGui::EndTable();
+        }
+
+        if ( ImGui::Button( "Export memory report" ) ) {
+            write_report_json( "memory_report.json" );
+        }
+    }
+
+    // Walking every block is slow on big heaps.
+    if ( ImGui::CollapsingHeader( "Heap blocks" ) ) {
+        MemoryStatistics stats{ 0, max_size };
+        pool_t pool = tlsf_get_pool( tlsf_handle );
+        tlsf_walk_pool( pool, imgui_walker, ( void* )&stats );
+
+        ImGui::Separator();
+        ImGui::Text( "\tAllocation count %d", stats.allocation_count );
+        ImGui::Text( "\tAllocated %zu Mb, free %zu Mb, total %zu Mb", stats.allocated_bytes / (1024 * 1024), ( max_size - stats.allocated_bytes ) / ( 1024 * 1024 ), max_size / ( 1024 * 1024 ) );
+    }
 }
 #endif // RAPTOR_IMGUI
 
+void HeapAllocator::enable_telemetry() {
+    RASSERTM( allocated_size == 0, "Telemetry must be enabled before allocating" );
+
+    telemetry_enabled = true;
+    telemetry.reset();
+}
+
+void HeapAllocator::get_statistics( HeapStatistics& out_statistics ) {
+    memset( &out_statistics, 0, sizeof( HeapStatistics ) );
+
+    pool_t pool = tlsf_get_pool( tlsf_handle );
+    tlsf_walk_pool( pool, statistics_walker, ( void* )&out_statistics );
+
+    out_statistics.fragmentation = out_statistics.free_bytes ? 1.0f - ( f32 )( ( f64 )out_statistics.largest_free_block / out_statistics.free_bytes ) : 0.0f;
+}
+
+static void write_json_string( FILE* file, cstring text ) {
+    fputc( '"', file );
+    for ( cstring c = text; c && *c; ++c ) {
+        if ( *c == '"' || *c == '\\' ) {
+            fputc( '\\', file );
+        }
+        fputc( *c, file );
+    }
+    fputc( '"', file );
+}
+
+struct JsonWalkerContext {
+    FILE*                           file;
+    u32                             count;
+}; // struct JsonWalkerContext
+
+static void json_allocations_walker( void* ptr, size_t size, int used, void* user ) {
+    if ( !used ) {
+        return;
+    }
+
+    JsonWalkerContext* context = ( JsonWalkerContext* )user;
+    const MemoryAllocationHeader* header = ( const MemoryAllocationHeader* )ptr;
+
+    fprintf( context->file, "%s\n\t\t{ \"size\": %zu, \"tag\": ", context->count ? "," : "", header->size );
+    write_json_string( context->file, memory_tag_name( header->tag ) );
+    fprintf( context->file, ", \"file\": " );
+    write_json_string( context->file, header->file ? header->file : "" );
+    fprintf( context->file, ", \"line\": %u }", header->line );
+
+    ++context->count;
+}
+
+bool HeapAllocator::write_report_json( cstring path ) {
+    FILE* file = fopen( path, "w" );
+    if ( !file ) {
+        rprint( "Cannot write memory report %s\n", path );
+        return false;
+    }
+
+    HeapStatistics heap_stats;
+    get_statistics( heap_stats );
+
+    fprintf( file, "{\n\t\"heap\": { \"size\": %zu, \"used_bytes\": %zu, \"free_bytes\": %zu, \"largest_free_block\": %zu, \"used_blocks\": %u, \"free_blocks\": %u, \"fragmentation\": %f },\n",
+             max_size, heap_stats.used_bytes, heap_stats.free_bytes, heap_stats.largest_free_block, heap_stats.used_blocks, heap_stats.free_blocks, heap_stats.fragmentation );
+
+    fprintf( file, "\t\"telemetry\": %s,\n", telemetry_enabled ? "true" : "false" );
+    fprintf( file, "\t\"requested_bytes\": %zu,\n\t\"peak_requested_bytes\": %zu,\n", telemetry.current_bytes, telemetry.peak_bytes );
+
+    fprintf( file, "\t\"tags\": [" );
+    for ( u32 t = 0; telemetry_enabled && t < s_memory_num_tags; ++t ) {
+        const MemoryTagStats& tag_stats = telemetry.tags[ t ];
+
+        fprintf( file, "%s\n\t\t{ \"name\": ", t ? "," : "" );
+        write_json_string( file, memory_tag_name( t ) );
+        fprintf( file, ", \"current_bytes\": %zu, \"peak_bytes\": %zu, \"current_count\": %u, \"total_count\": %u, \"size_classes\": [",
+                 tag_stats.current_bytes, tag_stats.peak_bytes, tag_stats.current_count, tag_stats.total_count );
+        for ( u32 c = 0; c < k_memory_size_classes; ++c ) {
+            fprintf( file, "%s%u", c ? ", " : "", tag_stats.size_classes[ c ] );
+        }
+        fprintf( file, "] }" );
+    }
+    fprintf( file, "\n\t],\n" );
+
+    fprintf( file, "\t\"allocations\": [" );
+    if ( telemetry_enabled ) {
+        JsonWalkerContext context{ file, 0 };
+
+        pool_t pool = tlsf_get_pool( tlsf_handle );
+        tlsf_walk_pool( pool, json_allocations_walker, ( void* )&context );
+    }
+    fprintf( file, "\n\t]\n}\n" );
+
+    fclose( file );
+    return true;
+}
+
 
 #if defined (RAPTOR_MEMORY_STACK)
 class RaptorStackWalker : public StackWalker {
@@ -197,12 +522,63 @@ void* HeapAllocator::allocate( sizet size, sizet alignment ) {
     }*/
 
     void* mem = tlsf_malloc( tlsf_handle, size );
-    rprint( "Mem: %p, size %llu \n", mem, size );
+    rprint( "Mem: %p, size %zu \n", mem, size );
     return mem;
 }
+
+void* HeapAllocator::allocate( sizet size, sizet alignment, cstring file, i32 line ) {
+    return allocate( size, alignment );
+}
 #else
 
 void* HeapAllocator::allocate( sizet size, sizet alignment ) {
+    return allocate( size, alignment, nullptr, 0 );
+}
+
+static void* allocate_with_header( HeapAllocator* heap, sizet size, sizet alignment, cstring file, i32 line ) {
+    // The header is padded to keep the returned memory aligned.
+    const sizet block_alignment = alignment > sizeof( u64 ) ? alignment : sizeof( u64 );
+    const sizet header_size = memory_align( sizeof( MemoryAllocationHeader ), block_alignment );
+
+    u8* block = ( u8* )( block_alignment == sizeof( u64 ) ? tlsf_malloc( heap->tlsf_handle, header_size + size ) : tlsf_memalign( heap->tlsf_handle, block_alignment, header_size + size ) );
+    if ( !block ) {
+        return nullptr;
+    }
+
+    heap->allocated_size += tlsf_block_size( block );
+
+    const u32 tag = memory_tag_current();
+
+    MemoryAllocationHeader* header = ( MemoryAllocationHeader* )block;
+    header->file = file;
+    header->size = size;
+    header->line = ( u32 )line;
+    header->tag = tag;
+    header->magic = k_memory_header_magic;
+    header->offset = ( u32 )header_size;
+#if defined (RAPTOR_MEMORY_LEAK_STACKS)
+    memset( header->stack, 0, sizeof( header->stack ) );
+#if defined (_MSC_VER)
+    RtlCaptureStackBackTrace( 2, k_memory_stack_depth, header->stack, nullptr );
+#else
+    backtrace( header->stack, k_memory_stack_depth );
+#endif // _MSC_VER
+#endif // RAPTOR_MEMORY_LEAK_STACKS
+
+    u8* memory = block + header_size;
+    // Padded headers store the offset right before the memory too.
+    ( ( u32* )memory )[ -1 ] = ( u32 )header_size;
+
+    heap->telemetry.on_allocate( tag, size );
+
+    return memory;
+}
+
+void* HeapAllocator::allocate( sizet size, sizet alignment, cstring file, i32 line ) {
+    if ( telemetry_enabled ) {
+        return allocate_with_header( this, size, alignment, file, line );
+    }
+
 #if defined (HEAP_ALLOCATOR_STATS)
     void* allocated_memory = alignment == 1 ? tlsf_malloc( tlsf_handle, size ) : tlsf_memalign( tlsf_handle, alignment, size );
     sizet actual_size = tlsf_block_size( allocated_memory );
@@ -218,11 +594,24 @@ void* HeapAllocator::allocate( sizet size, sizet alignment ) {
 }
 #endif // RAPTOR_MEMORY_STACK
 
-void* HeapAllocator::allocate( sizet size, sizet alignment, cstring file, i32 line ) {
-    return allocate( size, alignment );
-}
-
 void HeapAllocator::deallocate( void* pointer ) {
+    if ( telemetry_enabled ) {
+        if ( !pointer ) {
+            return;
+        }
+
+        u8* block = ( u8* )pointer - ( ( u32* )pointer )[ -1 ];
+        MemoryAllocationHeader* header = ( MemoryAllocationHeader* )block;
+        RASSERTM( header->magic == k_memory_header_magic, "Freeing memory %p not allocated by this heap, or freed twice", pointer );
+
+        telemetry.on_deallocate( header->tag, header->size );
+        header->magic = 0;
+
+        allocated_size -= tlsf_block_size( block );
+        tlsf_free( tlsf_handle, block );
+        return;
+    }
+
 #if defined (HEAP_ALLOCATOR_STATS)
     sizet actual_size = tlsf_block_size( pointer );
     allocated_size -= actual_size;
@@ -243,6 +632,7 @@ void LinearAllocator::init( sizet size ) {
     memory = ( u8* )malloc( size );
     total_size = size;
     allocated_size = 0;
+    peak_size = 0;
 }
 
 void LinearAllocator::shutdown() {
@@ -262,6 +652,7 @@ void* LinearAllocator::allocate( sizet size, sizet alignment ) {
     }
 
     allocated_size = new_allocated_size;
+    peak_size = allocated_size > peak_size ? allocated_size : peak_size;
     return memory + new_start;
 }
 
@@ -304,6 +695,7 @@ void MallocAllocator::deallocate( void* pointer ) {
 void StackAllocator::init( sizet size ) {
     memory = (u8*)malloc( size );
     allocated_size = 0;
+    peak_size = 0;
     total_size = size;
 }
 
@@ -323,6 +715,7 @@ void* StackAllocator::allocate( sizet size, sizet alignment ) {
     }
 
     allocated_size = new_allocated_size;
+    peak_size = allocated_size > peak_size ? allocated_size : peak_size;
     return memory + new_start;
 }
 
@@ -333,8 +726,8 @@ void* StackAllocator::allocate( sizet size, sizet alignment, cstring file, i32 l
 void StackAllocator::deallocate( void* pointer ) {
 
     RASSERT( pointer >= memory );
-    RASSERTM( pointer < memory + total_size, "Out of bound free on linear allocator (outside bounds). Tempting to free %p, %llu after beginning of buffer (memory %p size %llu, allocated %llu)", ( u8* )pointer, ( u8* )pointer - memory, memory, total_size, allocated_size );
-    RASSERTM( pointer < memory + allocated_size, "Out of bound free on linear allocator (inside bounds, after allocated). Tempting to free %p, %llu after beginning of buffer (memory %p size %llu, allocated %llu)", ( u8* )pointer, ( u8* )pointer - memory, memory, total_size, allocated_size );
+    RASSERTM( pointer < memory + total_size, "Out of bound free on linear allocator (outside bounds). Tempting to free %p, %td after beginning of buffer (memory %p size %zu, allocated %zu)", ( u8* )pointer, ( u8* )pointer - memory, memory, total_size, allocated_size );
+    RASSERTM( pointer < memory + allocated_size, "Out of bound free on linear allocator (inside bounds, after allocated). Tempting to free %p, %td after beginning of buffer (memory %p size %zu, allocated %zu)", ( u8* )pointer, ( u8* )pointer - memory, memory, total_size, allocated_size );
 
     const sizet size_at_pointer = ( u8* )pointer - memory;
 
@@ -453,4 +846,237 @@ void DoubleStackAllocator::clear_bottom() {
     bottom = 0;
 }
 
+// ThreadArenaAllocator ///////////////////////////////////////////////////
+
+// Blocks store their size class and the offset from the start of the heap block right before the returned memory.
+static const u32                    k_thread_block_header_size  = 16;
+static const u32                    k_thread_block_uncached     = u32_max;
+
+//
+// Stored in ThreadArenaAllocator::sync.
+struct ThreadArenaSync {
+    std::mutex                      mutex;          // Guards the heap.
+    std::thread::id                 main_thread;    // Unregistered threads are thread 0 for enkiTS too.
+}; // struct ThreadArenaSync
+
+static_assert( sizeof( ThreadArenaSync ) <= k_thread_arena_sync_size && alignof( ThreadArenaSync ) <= 64, "ThreadArenaSync does not fit its storage" );
+
+static ThreadArenaSync& thread_arena_sync( ThreadArenaAllocator& allocator ) {
+    return *( ThreadArenaSync* )allocator.sync;
+}
+
+static const ThreadArenaSync& thread_arena_sync( const ThreadArenaAllocator& allocator ) {
+    return *( const ThreadArenaSync* )allocator.sync;
+}
+
+// The enkiTS thread number of the calling thread, u32_max for threads without a cache that always use the heap.
+static u32 thread_cache_index( const ThreadArenaAllocator& allocator ) {
+    if ( !allocator.task_scheduler ) {
+        return u32_max;
+    }
+
+    const u32 thread_num = allocator.task_scheduler->GetThreadNum();
+    if ( thread_num >= allocator.num_threads ) {
+        return u32_max;
+    }
+    // enkiTS reports 0 for any thread it does not know about.
+    if ( thread_num == 0 && std::this_thread::get_id() != thread_arena_sync( allocator ).main_thread ) {
+        return u32_max;
+    }
+    return thread_num;
+}
+
+static u32 thread_cache_size_class( sizet size ) {
+    u32 size_class = 0;
+    for ( sizet class_size = 16; class_size < size; class_size <<= 1 ) {
+        ++size_class;
+    }
+    return size_class;
+}
+
+static void* thread_block_init( u8* block, u32 size_class, u32 header_size ) {
+    u8* memory = block + header_size;
+    ( ( u32* )memory )[ -2 ] = size_class;
+    ( ( u32* )memory )[ -1 ] = header_size;
+    return memory;
+}
+
+static void thread_cache_push( ThreadCache& cache, u32 size_class, void* memory ) {
+    *( void** )memory = cache.free_lists[ size_class ];
+    cache.free_lists[ size_class ] = memory;
+    ++cache.free_counts[ size_class ];
+}
+
+static void thread_cache_free( ThreadCache& cache, HeapAllocator& heap ) {
+    for ( u32 c = 0; c < k_thread_cache_size_classes; ++c ) {
+        void* memory = cache.free_lists[ c ];
+        while ( memory ) {
+            void* next = *( void** )memory;
+            heap.deallocate( ( u8* )memory - ( ( u32* )memory )[ -1 ] );
+            memory = next;
+        }
+
+        cache.free_lists[ c ] = nullptr;
+        cache.free_counts[ c ] = 0;
+    }
+}
+
+void ThreadArenaAllocator::init( u32 num_threads_, sizet scratch_size, sizet heap_size ) {
+    RASSERTM( num_threads_ <= k_thread_arena_max_threads, "Thread allocator supports %u threads, requested %u", k_thread_arena_max_threads, num_threads_ );
+    num_threads = num_threads_ < k_thread_arena_max_threads ? num_threads_ : k_thread_arena_max_threads;
+
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        scratch[ t ].allocator.init( scratch_size );
+    }
+
+    memset( caches, 0, sizeof( caches ) );
+    locked_operations = 0;
+    task_scheduler = nullptr;
+    new ( sync ) ThreadArenaSync();
+
+    heap.init( heap_size );
+}
+
+void ThreadArenaAllocator::set_task_scheduler( enki::TaskScheduler* task_scheduler_ ) {
+    RASSERTM( !task_scheduler_ || task_scheduler_->GetThreadNum() == 0, "The task scheduler must be set from its thread 0" );
+    RASSERTM( !task_scheduler_ || task_scheduler_->GetNumTaskThreads() <= num_threads, "Thread allocator has %u threads, the scheduler %u", num_threads, task_scheduler_->GetNumTaskThreads() );
+
+    task_scheduler = task_scheduler_;
+    thread_arena_sync( *this ).main_thread = std::this_thread::get_id();
+}
+
+void ThreadArenaAllocator::shutdown() {
+    // Tasks must be done, the cached blocks of every thread go back to the heap.
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        thread_cache_free( caches[ t ], heap );
+        scratch[ t ].allocator.shutdown();
+    }
+    num_threads = 0;
+    task_scheduler = nullptr;
+    thread_arena_sync( *this ).~ThreadArenaSync();
+
+    heap.shutdown();
+}
+
+#if defined RAPTOR_IMGUI
+void ThreadArenaAllocator::debug_ui() {
+    {
+        std::lock_guard<std::mutex> guard( thread_arena_sync( *this ).mutex );
+        ImGui::Text( "Heap used %zu Kb of %zu Mb, locked operations %u", heap.allocated_size / 1024, heap.max_size / ( 1024 * 1024 ), locked_operations );
+    }
+
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        const StackAllocator& thread_scratch = scratch[ t ].allocator;
+        // Cache counters are updated by their threads, the values can be slightly off.
+        ImGui::Text( "\tThread %u scratch peak %zu Kb of %zu Kb, cache hits %u misses %u", t, thread_scratch.peak_size / 1024, thread_scratch.total_size / 1024,
+                     caches[ t ].hits, caches[ t ].misses );
+    }
+}
+#endif // RAPTOR_IMGUI
+
+void* ThreadArenaAllocator::allocate( sizet size, sizet alignment ) {
+    const sizet max_cached_size = 16ull << ( k_thread_cache_size_classes - 1 );
+
+    if ( size > max_cached_size || alignment > k_thread_block_header_size ) {
+        const u32 header_size = ( u32 )( alignment > k_thread_block_header_size ? alignment : k_thread_block_header_size );
+
+        std::lock_guard<std::mutex> guard( thread_arena_sync( *this ).mutex );
+        ++locked_operations;
+
+        u8* block = ( u8* )heap.allocate( header_size + size, header_size );
+        return block ? thread_block_init( block, k_thread_block_uncached, header_size ) : nullptr;
+    }
+
+    const u32 size_class = thread_cache_size_class( size );
+    const sizet block_size = k_thread_block_header_size + ( 16ull << size_class );
+    const u32 cache_index = thread_cache_index( *this );
+
+    if ( cache_index == u32_max ) {
+        std::lock_guard<std::mutex> guard( thread_arena_sync( *this ).mutex );
+        ++locked_operations;
+
+        u8* block = ( u8* )heap.allocate( block_size, k_thread_block_header_size );
+        return block ? thread_block_init( block, size_class, k_thread_block_header_size ) : nullptr;
+    }
+
+    ThreadCache& cache = caches[ cache_index ];
+    void* memory = cache.free_lists[ size_class ];
+    if ( memory ) {
+        cache.free_lists[ size_class ] = *( void** )memory;
+        --cache.free_counts[ size_class ];
+        ++cache.hits;
+        return memory;
+    }
+
+    ++cache.misses;
+
+    // Refill the size class taking the lock once.
+    std::lock_guard<std::mutex> guard( thread_arena_sync( *this ).mutex );
+    ++locked_operations;
+
+    for ( u32 b = 0; b < k_thread_cache_refill_blocks; ++b ) {
+        u8* block = ( u8* )heap.allocate( block_size, k_thread_block_header_size );
+        if ( !block ) {
+            break;
+        }
+
+        if ( memory ) {
+            thread_cache_push( cache, size_class, memory );
+        }
+        memory = thread_block_init( block, size_class, k_thread_block_header_size );
+    }
+
+    return memory;
+}
+
+void* ThreadArenaAllocator::allocate( sizet size, sizet alignment, cstring file, i32 line ) {
+    return allocate( size, alignment );
+}
+
+void ThreadArenaAllocator::deallocate( void* pointer ) {
+    if ( !pointer ) {
+        return;
+    }
+
+    // Blocks can be freed by any thread, they are cached by the thread that frees them.
+    const u32 size_class = ( ( u32* )pointer )[ -2 ];
+    if ( size_class < k_thread_cache_size_classes ) {
+        const u32 cache_index = thread_cache_index( *this );
+        if ( cache_index != u32_max && caches[ cache_index ].free_counts[ size_class ] < k_thread_cache_max_blocks ) {
+            thread_cache_push( caches[ cache_index ], size_class, pointer );
+            return;
+        }
+    }
+
+    u8* block = ( u8* )pointer - ( ( u32* )pointer )[ -1 ];
+
+    std::lock_guard<std::mutex> guard( thread_arena_sync( *this ).mutex );
+    ++locked_operations;
+
+    heap.deallocate( block );
+}
+
+StackAllocator* ThreadArenaAllocator::get_scratch( u32 thread_index ) {
+    RASSERTM( thread_index < num_threads, "Thread %u has no scratch memory, %u threads", thread_index, num_threads );
+    return &scratch[ thread_index ].allocator;
+}
+
+void ThreadArenaAllocator::reset_scratch() {
+    for ( u32 t = 0; t < num_threads; ++t ) {
+        scratch[ t ].allocator.clear();
+    }
+}
+
+void ThreadArenaAllocator::flush_thread_cache() {
+    const u32 cache_index = thread_cache_index( *this );
+    if ( cache_index == u32_max ) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard( thread_arena_sync( *this ).mutex );
+    ++locked_operations;
+
+    thread_cache_free( caches[ cache_index ], heap );
+}
+
 } // namespace raptor
\ No newline at end of file
@@ -5,6 +5,10 @@
 
 #define RAPTOR_IMGUI
 
+namespace enki {
+    class TaskScheduler;
+}
+
 namespace raptor {
 
     // Memory Methods /////////////////////////////////////////////////////
@@ -31,6 +35,65 @@ namespace raptor {
         }
     }; // struct MemoryStatistics
 
+    // Memory Telemetry ///////////////////////////////////////////////////
+
+    static const u32                k_memory_max_tags       = 32;
+    static const u32                k_memory_size_classes   = 24;   // Powers of two, from 16 bytes or less to 128Mb or more.
+    static const u32                k_memory_stack_depth    = 8;
+
+    //
+    // Tags group allocations by subsystem: allocations done while a MemoryTagScope is alive are accounted to its tag.
+    // Tag 0 is for the untagged allocations. Registering the same name returns the same tag.
+    u32                             memory_tag_register( cstring name );
+    cstring                         memory_tag_name( u32 tag );
+    u32                             memory_tag_current();
+    u32                             memory_size_class( sizet size );
+
+    struct MemoryTagScope {
+        MemoryTagScope( u32 tag );
+        ~MemoryTagScope();
+
+        u32                         previous_tag;
+    }; // struct MemoryTagScope
+
+    //
+    //
+    struct MemoryTagStats {
+        sizet                       current_bytes;
+        sizet                       peak_bytes;
+        u32                         current_count;
+        u32                         total_count;
+
+        u32                         size_classes[ k_memory_size_classes ];  // Live allocations per size class.
+    }; // struct MemoryTagStats
+
+    //
+    // Per tag accounting of the requested sizes.
+    struct MemoryTelemetry {
+
+        void                        reset();
+
+        void                        on_allocate( u32 tag, sizet size );
+        void                        on_deallocate( u32 tag, sizet size );
+
+        MemoryTagStats              tags[ k_memory_max_tags ];
+        sizet                       current_bytes;
+        sizet                       peak_bytes;
+
+    }; // struct MemoryTelemetry
+
+    //
+    // State of the TLSF pool, gathered by walking it.
+    struct HeapStatistics {
+        sizet                       used_bytes;
+        sizet                       free_bytes;
+        sizet                       largest_free_block;
+        u32                         used_blocks;
+        u32                         free_blocks;
+
+        f32                         fragmentation;  // 1 - largest free block / total free: 0 when all free memory is contiguous.
+    }; // struct HeapStatistics
+
     //
     //
     struct Allocator {
@@ -60,10 +123,19 @@ namespace raptor {
 
         void                        deallocate( void* pointer ) override;
 
+        // Telemetry stores a header before each allocation, it must be enabled before allocating.
+        void                        enable_telemetry();
+        void                        get_statistics( HeapStatistics& out_statistics );
+        // Writes the heap statistics, the tags and the live allocations.
+        bool                        write_report_json( cstring path );
+
         void*                       tlsf_handle;
         void*                       memory;
         sizet                       allocated_size = 0;
         sizet                       max_size = 0;
+
+        MemoryTelemetry             telemetry;
+        bool                        telemetry_enabled = false;
         
     }; // struct HeapAllocator
 
@@ -87,6 +159,7 @@ namespace raptor {
         u8*                         memory          = nullptr;
         sizet                       total_size      = 0;
         sizet                       allocated_size  = 0;
+        sizet                       peak_size       = 0;    // High-water mark.
 
     }; // struct StackAllocator
 
@@ -143,6 +216,7 @@ namespace raptor {
         u8*                         memory          = nullptr;
         sizet                       total_size      = 0;
         sizet                       allocated_size  = 0;
+        sizet                       peak_size       = 0;    // High-water mark.
     }; // struct LinearAllocator
 
     //
@@ -154,12 +228,87 @@ namespace raptor {
         void                        deallocate( void* pointer ) override;
     };
 
+    // Thread Arena Allocator /////////////////////////////////////////////
+
+    static const u32                k_thread_arena_max_threads      = 32;
+    static const u32                k_thread_cache_size_classes     = 8;    // Powers of two, from 16 to 2048 bytes.
+    static const u32                k_thread_cache_max_blocks       = 128;  // Per size class, more are freed to the heap.
+    static const u32                k_thread_cache_refill_blocks    = 8;    // Allocated together when a class is empty.
+    static const u32                k_thread_arena_sync_size        = 128;  // Storage of the lock and the main thread id.
+
+    //
+    // Freed small blocks of a thread, linked through their memory.
+    struct alignas( 64 ) ThreadCache {
+        void*                       free_lists[ k_thread_cache_size_classes ];
+        u32                         free_counts[ k_thread_cache_size_classes ];
+
+        u32                         hits;
+        u32                         misses;
+    }; // struct ThreadCache
+
+    //
+    // Padded to avoid false sharing between the threads.
+    struct alignas( 64 ) ThreadScratch {
+        StackAllocator              allocator;
+    }; // struct ThreadScratch
+
+    //
+    // Memory for tasks running on the enkiTS threads.
+    // Each thread has its own scratch stack, indexed by the enkiTS thread number (0 is the main thread) and cleared
+    // by reset_scratch at the frame fence: scratch memory must not outlive the frame, nor be used by tasks running
+    // across frames. The allocator itself is a TLSF heap that can be used by any thread, for longer lived memory:
+    // small blocks are cached per thread so most allocations and frees do not take the lock. Caches are indexed by the
+    // enkiTS thread number like scratch, once the scheduler is set: other threads always go through the locked heap.
+    struct ThreadArenaAllocator : public Allocator {
+
+        void                        init( u32 num_threads, sizet scratch_size, sizet heap_size );
+        void                        shutdown();
+
+        // Call from the thread that initialized the scheduler, which is its thread 0. Null disables the caches.
+        void                        set_task_scheduler( enki::TaskScheduler* task_scheduler );
+
+#if defined RAPTOR_IMGUI
+        void                        debug_ui();
+#endif // RAPTOR_IMGUI
+
+        void*                       allocate( sizet size, sizet alignment ) override;
+        void*                       allocate( sizet size, sizet alignment, cstring file, i32 line ) override;
+
+        void                        deallocate( void* pointer ) override;
+
+        StackAllocator*             get_scratch( u32 thread_index );
+        // Call when no task is using scratch memory, e.g. after waiting for the frame fence.
+        void                        reset_scratch();
+
+        // Frees the blocks cached by the calling thread.
+        void                        flush_thread_cache();
+
+        HeapAllocator               heap;
+        u32                         locked_operations = 0;  // Heap allocations and frees, under the lock.
+
+        ThreadScratch               scratch[ k_thread_arena_max_threads ];
+        ThreadCache                 caches[ k_thread_arena_max_threads ];
+        u32                         num_threads     = 0;
+
+        enki::TaskScheduler*        task_scheduler  = nullptr;
+
+        // ThreadArenaSync, the lock guarding the heap and the id of the main thread. Defined in memory.cpp to keep the
+        // standard thread headers out of this one.
+        alignas( 64 ) u8            sync[ k_thread_arena_sync_size ];
+
+    }; // struct ThreadArenaAllocator
+
     // Memory Service /////////////////////////////////////////////////////
     // 
     // 
     struct MemoryServiceConfiguration {
 
         sizet                       maximum_dynamic_size = 32 * 1024 * 1024;    // Defaults to max 32MB of dynamic memory.
+        bool                        telemetry           = false;                // Per tag accounting of the system allocator.
+
+        u32                         num_threads         = 0;                    // Threads of the task scheduler, 0 disables the thread allocator.
+        sizet                       thread_scratch_size = 1024 * 1024;          // Per thread.
+        sizet                       thread_heap_size    = 64 * 1024 * 1024;
 
     }; // struct MemoryServiceConfiguration
     //
@@ -178,6 +327,8 @@ namespace raptor {
         // Frame allocator
         LinearAllocator             scratch_allocator;
         HeapAllocator               system_allocator;
+        // Tasks memory, when the configuration has threads.
+        ThreadArenaAllocator        thread_allocator;
 
         //
         // Test allocators.
@@ -1,114 +1,323 @@
 #include "serialization.hpp"
 
+#include "foundation/memory.hpp"
+#include "foundation/assert.hpp"
+#include "foundation/file.hpp"
+
+#include <string.h>
+
 namespace raptor {
 
-/*
+static const u32                    k_serializer_magic      = 0x52455352;   // 'RSER'
 
-void Serializer::start_writing( FILE* file, u32 data_version_ ) {
-    file_handle = file;
-    data_version = data_version_;
-    is_writing = true;
+// Serializer /////////////////////////////////////////////////////////////
 
-    Serialize( this, &data_version );
-}
+void Serializer::start_writing( Allocator* allocator_, sizet initial_size ) {
+    allocator = allocator_;
+    capacity = initial_size > 64 ? initial_size : 64;
+    memory = ( u8* )ralloca( capacity, allocator );
+    size = 0;
+    offset = 0;
 
-void Serializer::start_reading( FILE* file ) {
-    file_handle = file;
-    is_writing = false;
+    depth = 0;
+    is_reading = false;
+    error = false;
 
-    Serialize( this, &data_version );
+    u32 magic = k_serializer_magic;
+    u32 format_version = k_serializer_format_version;
+    raptor::serialize( this, &magic );
+    raptor::serialize( this, &format_version );
 }
 
-void Serialize( Serializer* s, i8* data ) {
-    if ( s->is_writing )     {
-        fwrite( data, sizeof( i8 ), 1, s->file_handle );
-    }     else     {
-        fread( data, sizeof( i8 ), 1, s->file_handle );
+bool Serializer::start_reading( Allocator* allocator_, const void* memory_, sizet size_ ) {
+    allocator = allocator_;
+    memory = ( u8* )memory_;
+    size = size_;
+    capacity = 0;
+    offset = 0;
+
+    depth = 0;
+    is_reading = true;
+    error = false;
+
+    u32 magic = 0;
+    u32 format_version = 0;
+    raptor::serialize( this, &magic );
+    raptor::serialize( this, &format_version );
+
+    if ( magic != k_serializer_magic || format_version > k_serializer_format_version ) {
+        error = true;
     }
+
+    return !error;
 }
 
-void Serialize( Serializer* s, u8* data ) {
-    if ( s->is_writing )     {
-        fwrite( data, sizeof( u8 ), 1, s->file_handle );
-    }     else     {
-        fread( data, sizeof( u8 ), 1, s->file_handle );
+void Serializer::shutdown() {
+    // Read memory is owned by the caller.
+    if ( !is_reading && memory ) {
+        rfree( memory, allocator );
     }
+
+    memory = nullptr;
+    size = capacity = offset = 0;
 }
 
-void Serialize( Serializer* s, i16* data ) {
-    if ( s->is_writing )     {
-        fwrite( data, sizeof( i16 ), 1, s->file_handle );
-    }     else     {
-        fread( data, sizeof( i16 ), 1, s->file_handle );
+u32 Serializer::begin_type( u32 code_version ) {
+    RASSERTM( depth < k_serializer_max_depth, "Serialized types are nested too deep" );
+
+    type_versions[ depth ] = data_version;
+
+    if ( is_reading ) {
+        u32 type_version = 0;
+        u32 type_size = 0;
+        raptor::serialize( this, &type_version );
+        raptor::serialize( this, &type_size );
+
+        if ( error || type_size > size - offset ) {
+            error = true;
+            type_size = 0;
+        }
+        type_offsets[ depth ] = offset + type_size;
+
+        // Fields of newer versions are unknown to the code, they are skipped by end_type.
+        data_version = type_version < code_version ? type_version : code_version;
+    } else {
+        u32 type_size = 0;
+        raptor::serialize( this, &code_version );
+        type_offsets[ depth ] = size;
+        raptor::serialize( this, &type_size );
+
+        data_version = code_version;
     }
+
+    ++depth;
+    return data_version;
 }
 
-void Serialize( Serializer* s, u16* data ) {
-    if ( s->is_writing )     {
-        fwrite( data, sizeof( u16 ), 1, s->file_handle );
-    }     else     {
-        fread( data, sizeof( u16 ), 1, s->file_handle );
+void Serializer::end_type() {
+    RASSERT( depth > 0 );
+    --depth;
+
+    if ( is_reading ) {
+        if ( offset > type_offsets[ depth ] ) {
+            // Read more than written, versions do not match the data.
+            error = true;
+        }
+        offset = type_offsets[ depth ];
+    } else {
+        const sizet size_offset = type_offsets[ depth ];
+        const u32 type_size = ( u32 )( size - size_offset - sizeof( u32 ) );
+
+        // Patch the size written by begin_type.
+        const u8 bytes[ 4 ] = { ( u8 )type_size, ( u8 )( type_size >> 8 ), ( u8 )( type_size >> 16 ), ( u8 )( type_size >> 24 ) };
+        memcpy( memory + size_offset, bytes, sizeof( bytes ) );
     }
+
+    data_version = type_versions[ depth ];
 }
 
-void Serialize( Serializer* s, i32* data ) {
-    if ( s->is_writing )     {
-        fwrite( data, sizeof( i32 ), 1, s->file_handle );
-    }     else     {
-        fread( data, sizeof( i32 ), 1, s->file_handle );
+void Serializer::serialize_memory( void* data, sizet data_size ) {
+    if ( data_size == 0 ) {
+        return;
     }
-}
 
-void Serialize( Serializer* s, u32* data ) {
-    if ( s->is_writing )     {
-        fwrite( data, sizeof( u32 ), 1, s->file_handle );
-    }     else     {
-        fread( data, sizeof( u32 ), 1, s->file_handle );
+    if ( is_reading ) {
+        if ( error || data_size > size - offset ) {
+            error = true;
+            memset( data, 0, data_size );
+            return;
+        }
+
+        memcpy( data, memory + offset, data_size );
+        offset += data_size;
+    } else {
+        if ( size + data_size > capacity ) {
+            sizet new_capacity = capacity * 2;
+            while ( new_capacity < size + data_size ) {
+                new_capacity *= 2;
+            }
+
+            u8* new_memory = ( u8* )ralloca( new_capacity, allocator );
+            memcpy( new_memory, memory, size );
+            rfree( memory, allocator );
+
+            memory = new_memory;
+            capacity = new_capacity;
+        }
+
+        memcpy( memory + size, data, data_size );
+        size += data_size;
     }
 }
 
-void Serialize( Serializer* s, i64* data ) {
-    if ( s->is_writing )     {
-        fwrite( data, sizeof( i64 ), 1, s->file_handle );
-    }     else     {
-        fread( data, sizeof( i64 ), 1, s->file_handle );
+bool Serializer::write_file( cstring path ) {
+    RASSERT( !is_reading );
+    RASSERTM( depth == 0, "Types not ended" );
+
+    FileHandle file = nullptr;
+    file_open( path, "wb", &file );
+    if ( !file ) {
+        return false;
     }
+
+    const sizet written = file_write( memory, 1, ( u32 )size, file );
+    file_close( file );
+
+    return written == size;
 }
 
-void Serialize( Serializer* s, u64* data ) {
-    if ( s->is_writing )     {
-        fwrite( data, sizeof( u64 ), 1, s->file_handle );
-    }     else     {
-        fread( data, sizeof( u64 ), 1, s->file_handle );
+// Serialization methods //////////////////////////////////////////////////
+
+// Data is little endian, swap the bytes of values on big endian machines.
+template <typename T>
+static void serialize_value( Serializer* s, T* data ) {
+#if defined( RAPTOR_BIG_ENDIAN )
+    u8 bytes[ sizeof( T ) ];
+    if ( !s->is_reading ) {
+        memcpy( bytes, data, sizeof( T ) );
+        for ( u32 i = 0; i < sizeof( T ) / 2; ++i ) {
+            const u8 byte = bytes[ i ];
+            bytes[ i ] = bytes[ sizeof( T ) - 1 - i ];
+            bytes[ sizeof( T ) - 1 - i ] = byte;
+        }
     }
-}
 
-void Serialize( Serializer* s, f32* data ) {
-    if ( s->is_writing )     {
-        fwrite( data, sizeof( f32 ), 1, s->file_handle );
-    }     else     {
-        fread( data, sizeof( f32 ), 1, s->file_handle );
+    s->serialize_memory( bytes, sizeof( T ) );
+
+    if ( s->is_reading ) {
+        for ( u32 i = 0; i < sizeof( T ); ++i ) {
+            ( ( u8* )data )[ i ] = bytes[ sizeof( T ) - 1 - i ];
+        }
     }
+#else
+    s->serialize_memory( data, sizeof( T ) );
+#endif // RAPTOR_BIG_ENDIAN
+}
+
+void serialize( Serializer* s, i8* data ) {
+    s->serialize_memory( data, sizeof( i8 ) );
+}
+
+void serialize( Serializer* s, u8* data ) {
+    s->serialize_memory( data, sizeof( u8 ) );
+}
+
+void serialize( Serializer* s, i16* data ) {
+    serialize_value( s, data );
+}
+
+void serialize( Serializer* s, u16* data ) {
+    serialize_value( s, data );
+}
+
+void serialize( Serializer* s, i32* data ) {
+    serialize_value( s, data );
+}
+
+void serialize( Serializer* s, u32* data ) {
+    serialize_value( s, data );
+}
+
+void serialize( Serializer* s, i64* data ) {
+    serialize_value( s, data );
+}
+
+void serialize( Serializer* s, u64* data ) {
+    serialize_value( s, data );
+}
+
+void serialize( Serializer* s, f32* data ) {
+    serialize_value( s, data );
+}
+
+void serialize( Serializer* s, f64* data ) {
+    serialize_value( s, data );
+}
+
+void serialize( Serializer* s, bool* data ) {
+    // Size of bool depends on the compiler.
+    u8 value = s->is_reading ? 0 : ( *data ? 1 : 0 );
+    s->serialize_memory( &value, sizeof( u8 ) );
+    *data = value != 0;
+}
+
+void serialize( Serializer* s, char* data ) {
+    s->serialize_memory( data, sizeof( char ) );
 }
 
+void serialize( Serializer* s, char* data, u32 max_length ) {
+    u32 length = s->is_reading ? 0 : ( u32 )strnlen( data, max_length - 1 );
+    serialize( s, &length );
+
+    if ( s->is_reading && length >= max_length ) {
+        // Drop the characters that do not fit, skipping them to keep reading in sync.
+        const u32 skipped = length - ( max_length - 1 );
+        length = max_length - 1;
+        s->serialize_memory( data, length );
 
-void Serialize( Serializer* s, f64* data ) {
-    if ( s->is_writing ) {
-        fwrite( data, sizeof( f64 ), 1, s->file_handle );
+        if ( skipped > s->size - s->offset ) {
+            s->error = true;
+        } else {
+            s->offset += skipped;
+        }
     } else {
-        fread( data, sizeof( f64 ), 1, s->file_handle );
+        s->serialize_memory( data, length );
+    }
+
+    if ( s->is_reading ) {
+        data[ length ] = 0;
     }
 }
 
+void serialize( Serializer* s, StringBuffer* data ) {
+    u32 length = data->current_size;
+    serialize( s, &length );
 
-void Serialize( Serializer* s, bool* data ) {
-    if ( s->is_writing ) {
-        fwrite( data, sizeof( bool ), 1, s->file_handle );
-    } else {
-        fread( data, sizeof( bool ), 1, s->file_handle );
+    if ( !s->is_reading ) {
+        s->serialize_memory( data->data, length );
+        return;
+    }
+
+    if ( s->error || length > s->size - s->offset ) {
+        s->error = true;
+        length = 0;
+    }
+
+    if ( !data->data ) {
+        data->init( length + 1, s->allocator );
     }
+    data->clear();
+
+    char* text = data->reserve( length );
+    if ( !text ) {
+        s->error = true;
+        return;
+    }
+    s->serialize_memory( text, length );
+    text[ length ] = 0;
 }
 
-*/
+void serialize( Serializer* s, RelativeString* data ) {
+    u32 length = data->size;
+    serialize( s, &length );
+
+    if ( !s->is_reading ) {
+        s->serialize_memory( ( void* )data->c_str(), length );
+        return;
+    }
+
+    if ( s->error || length > s->size - s->offset ) {
+        s->error = true;
+        data->set_empty();
+        return;
+    }
+
+    char* text = ( char* )ralloca( length + 1, s->allocator );
+    s->serialize_memory( text, length );
+    text[ length ] = 0;
+
+    data->set( text, length );
+    RASSERTM( data->c_str() == text, "Relative string is too far from its text" );
+}
 
-} // namespace raptor
\ No newline at end of file
+} // namespace raptor
@@ -1,65 +1,171 @@
 #pragma once
 
 #include "foundation/platform.hpp"
-#include "foundation/file.hpp"
+#include "foundation/array.hpp"
+#include "foundation/relative_data_structures.hpp"
+#include "foundation/string.hpp"
+
+#include <type_traits>
 
 namespace raptor {
 
+struct Allocator;
+
+static const u32                    k_serializer_format_version     = 1;
+static const u32                    k_serializer_max_depth          = 16;   // Nested types.
+
 // Serialization taken from article https://yave.handmade.network/blogs/p/2723-how_media_molecule_does_serialization
-    /*
+//
+// The same code reads and writes. Each type is serialized between begin_type and end_type, that store its version
+// and size: fields are added and removed with the macros below, keyed on the version, and fields written by a newer
+// version of a type are skipped, so older code can read newer data as long as the newer versions only added fields.
+// Values are stored little endian.
 struct Serializer {
 
-    void            start_writing( FILE* file, u32 data_version );
-    void            start_reading( FILE* file );
+    void                            start_writing( Allocator* allocator, sizet initial_size );
+    // Memory must outlive the reading, the allocator is used for arrays and strings.
+    // Returns false if the memory does not start with a serializer header.
+    bool                            start_reading( Allocator* allocator, const void* memory, sizet size );
+    void                            shutdown();
+
+    // Returns the version of the data, which is the code version when writing.
+    u32                             begin_type( u32 code_version );
+    void                            end_type();
+
+    // Called by the leaf methods. Reading past the end sets the error and returns zeroes.
+    void                            serialize_memory( void* data, sizet size );
+
+    bool                            write_file( cstring path );
+
+    u8*                             memory          = nullptr;  // Written memory, or the memory being read.
+    sizet                           size            = 0;        // Written or total bytes.
+    sizet                           capacity        = 0;
+    sizet                           offset          = 0;        // Read offset.
+
+    Allocator*                      allocator       = nullptr;
 
-    FILE*           file_handle;
-    u32             data_version;
-    u8              is_writing;
+    u32                             data_version    = 0;        // Of the current type.
+    u32                             depth           = 0;
+    u32                             type_versions[ k_serializer_max_depth ];
+    sizet                           type_offsets[ k_serializer_max_depth ];   // Size field when writing, end of the type when reading.
+
+    bool                            is_reading      = false;
+    bool                            error           = false;
 
 }; // struct Serializer
 
 // Serialization methods
-void                 Serialize( Serializer* s, i8* data );
-void                 Serialize( Serializer* s, u8* data );
-void                 Serialize( Serializer* s, i16* data );
-void                 Serialize( Serializer* s, u16* data );
-void                 Serialize( Serializer* s, i32* data );
-void                 Serialize( Serializer* s, u32* data );
-void                 Serialize( Serializer* s, i64* data );
-void                 Serialize( Serializer* s, u64* data );
-void                 Serialize( Serializer* s, f32* data );
-void                 Serialize( Serializer* s, f64* data );
-void                 Serialize( Serializer* s, bool* data );
-
-
-// Serialization macros
-#define VERSION_IN_RANGE(_from, _to) \
-    (s->data_version >= (_from) && serializer->data_version < (_to))
-
-#define ADD(_fieldAdded, _fieldName) \
-    if (s->data_version >= (_fieldAdded)) \
-    { \
-        Serialize(s, &(data->_fieldName)); \
+void                                serialize( Serializer* s, i8* data );
+void                                serialize( Serializer* s, u8* data );
+void                                serialize( Serializer* s, i16* data );
+void                                serialize( Serializer* s, u16* data );
+void                                serialize( Serializer* s, i32* data );
+void                                serialize( Serializer* s, u32* data );
+void                                serialize( Serializer* s, i64* data );
+void                                serialize( Serializer* s, u64* data );
+void                                serialize( Serializer* s, f32* data );
+void                                serialize( Serializer* s, f64* data );
+void                                serialize( Serializer* s, bool* data );
+void                                serialize( Serializer* s, char* data );
+
+// Fixed size string, including the null terminator.
+void                                serialize( Serializer* s, char* data, u32 max_length );
+// Reading initializes the string buffer with the serializer allocator if it has no memory.
+void                                serialize( Serializer* s, StringBuffer* data );
+// Reading allocates the string with the serializer allocator, free it with rfree( data->data.get() ).
+void                                serialize( Serializer* s, RelativeString* data );
+
+// Reading initializes the array with the serializer allocator, it must not be initialized before.
+template <typename T>
+void                                serialize( Serializer* s, Array<T>* data );
+// Reading allocates the elements with the serializer allocator, free them with rfree( data->get() ).
+// Relative offsets are 32 bits: the array must live in the same heap as the allocator, not on the stack.
+template <typename T>
+void                                serialize( Serializer* s, RelativeArray<T>* data );
+
+// Serialization macros, used in serialize( Serializer* s, Type* data ) between begin_type and end_type.
+#define RSERIALIZE_VERSION_IN_RANGE( _from, _to ) \
+    ( s->data_version >= ( _from ) && s->data_version < ( _to ) )
+
+#define RSERIALIZE_ADD( _field_added, _field_name ) \
+    if ( s->data_version >= ( _field_added ) ) { \
+        serialize( s, &( data->_field_name ) ); \
+    }
+
+#define RSERIALIZE_ADD_TYPED( _field_added, _field_name, _cast_type ) \
+    if ( s->data_version >= ( _field_added ) ) { \
+        serialize( s, ( _cast_type* )&( data->_field_name ) ); \
     }
 
-#define ADD_TYPED(_fieldAdded, _fieldName, _castType) \
-    if (s->data_version >= (_fieldAdded)) \
-    { \
-        Serialize(s, (_castType*)&(data->_fieldName)); \
+#define RSERIALIZE_ADD_LOCAL( _local_added, _type, _local_name, _default_value ) \
+    _type _local_name = ( _default_value ); \
+    if ( s->data_version >= ( _local_added ) ) { \
+        serialize( s, &( _local_name ) ); \
     }
 
-#define ADD_LOCAL(_localAdded, _type, _localName, _defaultValue) \
-    _type _localName = (_defaultValue); \
-    if (s->data_version >= (_localAdded)) \
-    { \
-        Serialize(s, &(_localName)); \
+#define RSERIALIZE_REM( _field_added, _field_removed, _type, _field_name, _default_value ) \
+    _type _field_name = ( _default_value ); \
+    if ( RSERIALIZE_VERSION_IN_RANGE( ( _field_added ), ( _field_removed ) ) ) { \
+        serialize( s, &( _field_name ) ); \
     }
 
-#define REM(_fieldAdded, _fieldRemoved, _type, _fieldName, _defaultValue) \
-    _type _fieldName = (_defaultValue); \
-    if (VERSION_IN_RANGE((_fieldAdded),(_fieldRemoved))) \
-    { \
-        Serialize(s, &(_fieldName)); \
+// Implementations/////////////////////////////////////////////////////////
+
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define RAPTOR_BIG_ENDIAN
+#endif // __BYTE_ORDER__
+
+template <typename T>
+inline void serialize( Serializer* s, Array<T>* data ) {
+    // The data is not initialized yet when reading, the size comes from the stream.
+    u32 size = s->is_reading ? 0 : data->size;
+    serialize( s, &size );
+
+    if ( s->is_reading ) {
+        // Do not trust the size of corrupted data.
+        if ( s->error || size > s->size - s->offset ) {
+            s->error = true;
+            size = 0;
+        }
+
+        data->init( s->allocator, size, size );
+    }
+
+#if !defined( RAPTOR_BIG_ENDIAN )
+    // Same layout in memory and in the data.
+    if constexpr ( std::is_arithmetic<T>::value && !std::is_same<T, bool>::value ) {
+        s->serialize_memory( data->data, sizeof( T ) * size );
+        return;
+    }
+#endif // RAPTOR_BIG_ENDIAN
+
+    for ( u32 i = 0; i < size; ++i ) {
+        serialize( s, &data->data[ i ] );
     }
-    */
-} // namespace raptor
\ No newline at end of file
+}
+
+template <typename T>
+inline void serialize( Serializer* s, RelativeArray<T>* data ) {
+    u32 size = s->is_reading ? 0 : data->size;
+    serialize( s, &size );
+
+    T* elements = nullptr;
+    if ( s->is_reading ) {
+        if ( s->error || size > s->size - s->offset ) {
+            s->error = true;
+            size = 0;
+        }
+
+        elements = size ? ( T* )rallocaa( sizeof( T ) * size, s->allocator, alignof( T ) ) : nullptr;
+        data->set( ( char* )elements, size );
+        RASSERTM( !elements || data->get() == elements, "Relative array elements are too far from the array" );
+    } else {
+        elements = data->get();
+    }
+
+    for ( u32 i = 0; i < size; ++i ) {
+        serialize( s, &elements[ i ] );
+    }
+}
+
+} // namespace raptor
@@ -0,0 +1,267 @@
+#include "foundation/file.hpp"
+#include "foundation/file_async.hpp"
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include "external/enkiTS/TaskScheduler.h"
+
+#if defined(_WIN64)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+namespace raptor {
+
+static u8 pattern_byte( sizet offset ) {
+    return ( u8 )( ( offset * 31 ) ^ ( offset >> 11 ) );
+}
+
+static void write_pattern_file( cstring path, sizet size ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+    u8* data = rallocam( size, allocator );
+    for ( sizet i = 0; i < size; ++i ) {
+        data[ i ] = pattern_byte( i );
+    }
+    file_write_binary( path, data, size );
+    rfree( data, allocator );
+}
+
+static bool check_pattern( const u8* data, sizet offset, sizet size ) {
+    for ( sizet i = 0; i < size; ++i ) {
+        if ( data[ i ] != pattern_byte( offset + i ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Resident set of the process, 0 where unsupported.
+static sizet process_resident_bytes() {
+#if defined(_WIN64)
+    PROCESS_MEMORY_COUNTERS counters;
+    if ( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) ) ) {
+        return counters.WorkingSetSize;
+    }
+    return 0;
+#else
+    FILE* statm = fopen( "/proc/self/statm", "r" );
+    if ( statm == nullptr ) {
+        return 0;
+    }
+    unsigned long total_pages = 0, resident_pages = 0;
+    const int read_count = fscanf( statm, "%lu %lu", &total_pages, &resident_pages );
+    fclose( statm );
+    return read_count == 2 ? resident_pages * ( sizet )sysconf( _SC_PAGESIZE ) : 0;
+#endif // _WIN64
+}
+
+RTEST( file_async_read_whole_file_and_range ) {
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize( 4 );
+
+    char path[ k_max_path ];
+    strcpy( path, test_temporary_path( "file_async.bin" ) );
+    const sizet file_size = rkilo( 300 ) + 17;
+    write_pattern_file( path, file_size );
+
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+    AsynchronousFileReader reader;
+    reader.init( &task_scheduler, allocator, 4 );
+
+    FileReadRequest whole;
+    strcpy( whole.path, path );
+    FileReadTask* whole_task = reader.read( whole );
+
+    u8 range_data[ 1000 ];
+    FileReadRequest range;
+    strcpy( range.path, path );
+    range.offset = rkilo( 100 ) + 3;
+    range.size = sizeof( range_data );
+    range.destination = range_data;
+    FileReadTask* range_task = reader.read( range );
+
+    RCHECK( whole_task && range_task );
+    reader.wait( whole_task );
+    reader.wait( range_task );
+
+    RCHECK( whole_task->request.success && whole_task->request.bytes_read == file_size );
+    RCHECK( check_pattern( whole_task->request.data, 0, file_size ) );
+    RCHECK( range_task->request.success && range_task->request.data == range_data );
+    RCHECK( check_pattern( range_data, range.offset, range.size ) );
+
+    // Reads past the end complete short and are not successful.
+    FileReadRequest past_end;
+    strcpy( past_end.path, path );
+    past_end.offset = file_size - 10;
+    past_end.size = 20;
+    past_end.destination = range_data;
+    FileReadTask* past_end_task = reader.read( past_end );
+    reader.wait( past_end_task );
+    RCHECK( !past_end_task->request.success && past_end_task->request.bytes_read == 10 );
+
+    FileReadRequest missing;
+    strcpy( missing.path, test_temporary_path( "file_async_missing.bin" ) );
+    RCHECK( reader.read( missing ) == nullptr );
+
+    rfree( whole_task->request.data, allocator );
+    reader.release( whole_task );
+    reader.release( range_task );
+    reader.release( past_end_task );
+    reader.shutdown();
+
+    // The mapping sees the same bytes.
+    MappedFile mapped_file;
+    RCHECK( mapped_file.open( path, FileAccessHint::Sequential ) );
+    RCHECK( mapped_file.size == file_size && check_pattern( mapped_file.data, 0, file_size ) );
+    mapped_file.close();
+
+    file_delete( path );
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+RTEST( file_async_held_tasks_are_not_reused ) {
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize( 2 );
+
+    cstring path = test_temporary_path( "file_async_slots.bin" );
+    write_pattern_file( path, rkilo( 64 ) );
+
+    AsynchronousFileReader reader;
+    reader.init( &task_scheduler, &MemoryService::instance()->system_allocator, 2 );
+
+    u8 data[ 3 ][ 256 ];
+    FileReadTask* tasks[ 3 ];
+    for ( u32 i = 0; i < 3; ++i ) {
+        FileReadRequest request;
+        strcpy( request.path, path );
+        request.offset = i * 1000;
+        request.size = sizeof( data[ i ] );
+        request.destination = data[ i ];
+        tasks[ i ] = reader.read( request );
+    }
+
+    // Completed but held tasks still count as used.
+    reader.wait_all();
+    RCHECK( tasks[ 0 ] && tasks[ 1 ] && tasks[ 0 ] != tasks[ 1 ] );
+    RCHECK( tasks[ 2 ] == nullptr && !reader.has_free_task() );
+    RCHECK( tasks[ 0 ]->request.offset == 0 && check_pattern( data[ 0 ], 0, sizeof( data[ 0 ] ) ) );
+    RCHECK( tasks[ 1 ]->request.offset == 1000 && check_pattern( data[ 1 ], 1000, sizeof( data[ 1 ] ) ) );
+
+    reader.release( tasks[ 0 ] );
+    RCHECK( reader.has_free_task() );
+
+    FileReadRequest request;
+    strcpy( request.path, path );
+    request.offset = 2000;
+    request.size = sizeof( data[ 2 ] );
+    request.destination = data[ 2 ];
+    tasks[ 2 ] = reader.read( request );
+    RCHECK( tasks[ 2 ] == tasks[ 0 ] );
+
+    reader.wait( tasks[ 2 ] );
+    RCHECK( check_pattern( data[ 2 ], 2000, sizeof( data[ 2 ] ) ) );
+    RCHECK( tasks[ 1 ]->request.offset == 1000 );
+
+    reader.release( tasks[ 1 ] );
+    reader.release( tasks[ 2 ] );
+    reader.shutdown();
+
+    file_delete( path );
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+// Throughput and resident memory of loading a whole file: read into memory, mapped, and read in parallel chunks.
+// The file has just been written, so this compares paths through a warm page cache.
+// Reads every byte, so that each method pays for bringing the whole file in and not only for touching its pages.
+static u64 checksum_bytes( const u8* data, sizet size ) {
+    u64 checksum = 0;
+    for ( sizet i = 0; i < size; ++i ) {
+        checksum += data[ i ];
+    }
+    return checksum;
+}
+
+RBENCHMARK( file_read_throughput ) {
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize();
+
+    cstring path = test_temporary_path( "file_read_benchmark.bin" );
+    const sizet file_size = rmega( 128 );
+    write_pattern_file( path, file_size );
+
+    const u32 k_chunk_count = 16;
+    const sizet chunk_size = file_size / k_chunk_count;
+
+    // Separate heaps, so that memory already touched by a previous method does not hide resident growth.
+    cstring method_names[ 3 ] = { "file_read_binary", "MappedFile", "AsynchronousFileReader" };
+    u64 checksums[ 3 ] = { };
+    for ( u32 method = 0; method < 3; ++method ) {
+        HeapAllocator heap;
+        // TLSF rounds large requests up to the next size class.
+        heap.init( file_size * 2 );
+
+        const sizet resident_before = process_resident_bytes();
+        const i64 start = time_now();
+
+        u64 checksum = 0;
+        sizet resident_after = 0;
+        if ( method == 0 ) {
+            sizet size = 0;
+            u8* data = ( u8* )file_read_binary( path, &heap, &size );
+            checksum = checksum_bytes( data, size );
+            resident_after = process_resident_bytes();
+            rfree( data, &heap );
+        } else if ( method == 1 ) {
+            MappedFile mapped_file;
+            mapped_file.open( path, FileAccessHint::Sequential );
+            checksum = checksum_bytes( mapped_file.data, mapped_file.size );
+            resident_after = process_resident_bytes();
+            mapped_file.close();
+        } else {
+            AsynchronousFileReader reader;
+            reader.init( &task_scheduler, &heap, k_chunk_count );
+
+            u8* data = rallocam( file_size, &heap );
+            FileReadTask* tasks[ k_chunk_count ];
+            for ( u32 c = 0; c < k_chunk_count; ++c ) {
+                FileReadRequest request;
+                strcpy( request.path, path );
+                request.offset = c * chunk_size;
+                request.size = chunk_size;
+                request.destination = data + c * chunk_size;
+                tasks[ c ] = reader.read( request );
+            }
+            for ( u32 c = 0; c < k_chunk_count; ++c ) {
+                reader.release( tasks[ c ] );
+            }
+            checksum = checksum_bytes( data, file_size );
+            resident_after = process_resident_bytes();
+
+            rfree( data, &heap );
+            reader.shutdown();
+        }
+
+        const f64 elapsed_ms = time_from_milliseconds( start );
+        checksums[ method ] = checksum;
+        RCHECK( checksum == checksums[ 0 ] );
+
+        rprint( "%-24s %8.1f MB/s, resident growth %6.1f MB\n", method_names[ method ],
+                ( file_size / ( 1024.0 * 1024.0 ) ) / ( elapsed_ms / 1000.0 ),
+                ( resident_after > resident_before ? resident_after - resident_before : 0 ) / ( 1024.0 * 1024.0 ) );
+
+        heap.shutdown();
+    }
+
+    file_delete( path );
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+} // namespace raptor
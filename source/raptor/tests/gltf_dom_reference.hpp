@@ -0,0 +1,10 @@
+#pragma once
+
+#include "foundation/gltf.hpp"
+
+namespace raptor {
+
+// Loads a document with the nlohmann::json DOM, as gltf_load_file used to. Free with gltf_free.
+glTF::glTF                          gltf_dom_load_file( cstring file_path );
+
+} // namespace raptor
@@ -0,0 +1,570 @@
+#include "foundation/file.hpp"
+#include "foundation/gltf.hpp"
+#include "foundation/log.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/gltf_dom_reference.hpp"
+#include "tests/test.hpp"
+
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Counts heap allocations made through new, mostly by the nlohmann::json DOM, for the loading benchmark.
+static std::atomic<uint64_t>        s_new_count{ 0 };
+
+void* operator new( size_t size ) {
+    ++s_new_count;
+    void* pointer = malloc( size ? size : 1 );
+    if ( pointer == nullptr ) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete( void* pointer ) noexcept {
+    free( pointer );
+}
+
+void operator delete( void* pointer, size_t ) noexcept {
+    free( pointer );
+}
+
+namespace raptor {
+
+// Document generation ////////////////////////////////////////////////////
+
+static u32 s_random_state = 1;
+
+static u32 random_u32( u32 range ) {
+    s_random_state = s_random_state * 1664525u + 1013904223u;
+    return ( s_random_state >> 8 ) % range;
+}
+
+static void write_float( FILE* file, u32 index ) {
+    // Mix of the notations found in exported files.
+    static cstring formats[ 4 ] = { "%.9g", "%.3f", "%.6e", "%.2E" };
+    const f32 value = ( ( f32 )random_u32( 20001 ) - 10000.0f ) * 0.0137f;
+    fprintf( file, formats[ index % 4 ], value );
+}
+
+static void write_float_array( FILE* file, cstring key, u32 count ) {
+    fprintf( file, ",\"%s\":[", key );
+    for ( u32 i = 0; i < count; ++i ) {
+        fprintf( file, i ? ", " : "" );
+        write_float( file, i + random_u32( 4 ) );
+    }
+    fprintf( file, "]" );
+}
+
+static void write_texture_info( FILE* file, cstring key, cstring extra_key, u32 texture_count ) {
+    fprintf( file, ",\"%s\":{\"index\":%u", key, random_u32( texture_count ) );
+    if ( random_u32( 2 ) ) {
+        fprintf( file, ",\"texCoord\":%u", random_u32( 2 ) );
+    }
+    if ( extra_key ) {
+        fprintf( file, ",\"%s\":", extra_key );
+        write_float( file, 0 );
+    }
+    fprintf( file, ",\"extensions\":{\"KHR_texture_transform\":{\"offset\":[0,1],\"scale\":[2,2]}}}" );
+}
+
+// Scene using every field the loader reads, with escaped names, unknown keys to skip and whitespace between tokens.
+static void write_scene_document( cstring path, u32 node_count, u32 seed ) {
+    s_random_state = seed;
+
+    const u32 mesh_count = node_count / 4 + 1;
+    const u32 accessor_count = mesh_count * 4;
+    const u32 material_count = mesh_count / 2 + 1;
+    const u32 texture_count = material_count + 1;
+    static cstring types[ 7 ] = { "SCALAR", "VEC2", "VEC3", "VEC4", "MAT2", "MAT3", "MAT4" };
+    static const u32 type_sizes[ 7 ] = { 1, 2, 3, 4, 4, 9, 16 };
+    static cstring attributes[ 4 ] = { "POSITION", "NORMAL", "TEXCOORD_0", "TANGENT" };
+
+    FILE* file = fopen( path, "wb" );
+
+    fprintf( file, "{\n  \"asset\" : { \"generator\" : \"raptor \\\"tests\\\" \\u00e9\\ud83d\\ude00\", \"version\" : \"2.0\", \"copyright\":\"a\\/b\\\\c\\n\" },\n" );
+    fprintf( file, "  \"extensionsUsed\" : [ \"KHR_texture_transform\" ],\n  \"scene\" : 0,\n" );
+    fprintf( file, "  \"scenes\" : [ { \"nodes\" : [ 0" );
+    for ( u32 i = 1; i < node_count && i < 8; ++i ) {
+        fprintf( file, ", %u", i );
+    }
+    fprintf( file, " ], \"name\" : \"scene\" } ],\n" );
+
+    fprintf( file, "  \"nodes\" : [" );
+    for ( u32 i = 0; i < node_count; ++i ) {
+        fprintf( file, "%s\n    {\"name\":\"node \\\"%u\\\"\\t\"", i ? "," : "", i );
+        if ( random_u32( 4 ) ) {
+            fprintf( file, ",\"mesh\":%u", random_u32( mesh_count ) );
+        }
+        if ( random_u32( 8 ) == 0 ) {
+            fprintf( file, ",\"camera\":0" );
+        }
+        if ( random_u32( 8 ) == 0 ) {
+            fprintf( file, ",\"skin\":0" );
+        }
+        if ( i + 2 < node_count && random_u32( 3 ) == 0 ) {
+            fprintf( file, ",\"children\":[%u,%u]", i + 1, i + 2 );
+        }
+        if ( random_u32( 2 ) ) {
+            write_float_array( file, "matrix", 16 );
+        } else {
+            write_float_array( file, "translation", 3 );
+            write_float_array( file, "rotation", 4 );
+            write_float_array( file, "scale", 3 );
+        }
+        if ( random_u32( 6 ) == 0 ) {
+            write_float_array( file, "weights", 2 );
+        }
+        if ( random_u32( 5 ) == 0 ) {
+            fprintf( file, ",\"extras\":{\"tag\":\"]}\",\"list\":[1,{\"nested\":[true,false,null]},\"\\\"\"]}" );
+        }
+        fprintf( file, "}" );
+    }
+    fprintf( file, "\n  ],\n" );
+
+    fprintf( file, "  \"meshes\":[" );
+    for ( u32 i = 0; i < mesh_count; ++i ) {
+        fprintf( file, "%s{\"primitives\":[", i ? "," : "" );
+        const u32 primitive_count = 1 + random_u32( 3 );
+        for ( u32 p = 0; p < primitive_count; ++p ) {
+            // Attribute order differs from the sorted order of the DOM.
+            fprintf( file, "%s{\"attributes\":{", p ? "," : "" );
+            const u32 first_attribute = random_u32( 4 );
+            for ( u32 a = 0; a < 3; ++a ) {
+                fprintf( file, "%s\"%s\":%u", a ? "," : "", attributes[ ( first_attribute + a ) % 4 ], random_u32( accessor_count ) );
+            }
+            fprintf( file, "},\"indices\":%u,\"material\":%u", random_u32( accessor_count ), random_u32( material_count ) );
+            if ( random_u32( 2 ) ) {
+                fprintf( file, ",\"mode\":4" );
+            }
+            fprintf( file, ",\"targets\":[{\"POSITION\":1}]}" );
+        }
+        fprintf( file, "]" );
+        if ( random_u32( 4 ) == 0 ) {
+            write_float_array( file, "weights", 2 );
+        }
+        fprintf( file, ",\"name\":\"mesh_%u\"}", i );
+    }
+    fprintf( file, "],\n" );
+
+    fprintf( file, "  \"accessors\":[" );
+    for ( u32 i = 0; i < accessor_count; ++i ) {
+        const u32 type = random_u32( 7 );
+        fprintf( file, "%s{\"bufferView\":%u,\"componentType\":%u,\"count\":%u,\"type\":\"%s\"", i ? "," : "",
+                 random_u32( 4 ), 5120 + random_u32( 7 ), 1 + random_u32( 100000 ), types[ type ] );
+        if ( random_u32( 2 ) ) {
+            fprintf( file, ",\"byteOffset\":%u", random_u32( 4096 ) * 4 );
+        }
+        if ( random_u32( 2 ) ) {
+            write_float_array( file, "min", type_sizes[ type ] );
+            write_float_array( file, "max", type_sizes[ type ] );
+        }
+        if ( random_u32( 4 ) == 0 ) {
+            fprintf( file, ",\"normalized\":%s", random_u32( 2 ) ? "true" : "false" );
+        }
+        fprintf( file, "}" );
+    }
+    fprintf( file, "],\n" );
+
+    fprintf( file, "  \"materials\":[" );
+    for ( u32 i = 0; i < material_count; ++i ) {
+        fprintf( file, "%s{\"name\":\"material_%u\"", i ? "," : "", i );
+        if ( random_u32( 4 ) ) {
+            fprintf( file, ",\"pbrMetallicRoughness\":{\"metallicFactor\":0.5" );
+            write_float_array( file, "baseColorFactor", 4 );
+            if ( random_u32( 2 ) ) {
+                write_texture_info( file, "baseColorTexture", nullptr, texture_count );
+            }
+            if ( random_u32( 2 ) ) {
+                write_texture_info( file, "metallicRoughnessTexture", nullptr, texture_count );
+                fprintf( file, ",\"roughnessFactor\":1" );
+            }
+            fprintf( file, "}" );
+        }
+        if ( random_u32( 2 ) ) {
+            write_texture_info( file, "normalTexture", "scale", texture_count );
+        }
+        if ( random_u32( 2 ) ) {
+            write_texture_info( file, "occlusionTexture", "strength", texture_count );
+        }
+        if ( random_u32( 2 ) ) {
+            write_texture_info( file, "emissiveTexture", nullptr, texture_count );
+            write_float_array( file, "emissiveFactor", 3 );
+        }
+        if ( random_u32( 3 ) == 0 ) {
+            fprintf( file, ",\"alphaMode\":\"MASK\",\"alphaCutoff\":0.25" );
+        }
+        if ( random_u32( 3 ) == 0 ) {
+            fprintf( file, ",\"doubleSided\":true" );
+        }
+        fprintf( file, "}" );
+    }
+    fprintf( file, "],\n" );
+
+    fprintf( file, "  \"textures\":[" );
+    for ( u32 i = 0; i < texture_count; ++i ) {
+        fprintf( file, "%s{\"sampler\":0,\"source\":%u%s}", i ? "," : "", i, i % 3 ? "" : ",\"name\":\"texture\"" );
+    }
+    fprintf( file, "],\n  \"images\":[" );
+    for ( u32 i = 0; i < texture_count; ++i ) {
+        if ( i % 4 == 3 ) {
+            fprintf( file, "%s{\"bufferView\":%u,\"mimeType\":\"image/png\"}", i ? "," : "", random_u32( 4 ) );
+        } else {
+            fprintf( file, "%s{\"uri\":\"textures/image %u.png\"}", i ? "," : "", i );
+        }
+    }
+    fprintf( file, "],\n" );
+
+    fprintf( file, "  \"samplers\":[{\"magFilter\":9729,\"minFilter\":9987,\"wrapS\":10497,\"wrapT\":33071},{}],\n" );
+    fprintf( file, "  \"cameras\":[{\"type\":\"perspective\",\"perspective\":{\"yfov\":0.8,\"znear\":0.1}}],\n" );
+    fprintf( file, "  \"skins\":[{\"inverseBindMatrices\":3,\"joints\":[0,1,2],\"skeleton\":0},{\"joints\":[]}],\n" );
+
+    fprintf( file, "  \"animations\":[{\"samplers\":[{\"input\":0,\"output\":1},{\"input\":0,\"output\":2,\"interpolation\":\"STEP\"},{\"input\":0,\"output\":3,\"interpolation\":\"CUBICSPLINE\"}]," );
+    fprintf( file, "\"channels\":[{\"sampler\":0,\"target\":{\"node\":0,\"path\":\"translation\"}},{\"sampler\":1,\"target\":{\"node\":1,\"path\":\"rotation\"}}," );
+    fprintf( file, "{\"sampler\":2,\"target\":{\"node\":0,\"path\":\"scale\"}},{\"sampler\":2,\"target\":{\"node\":0,\"path\":\"weights\"}}],\"name\":\"animation\"}],\n" );
+
+    fprintf( file, "  \"buffers\":[{\"byteLength\":1024,\"uri\":\"scene.bin\"},{\"byteLength\":16,\"name\":\"empty\"}],\n" );
+    fprintf( file, "  \"bufferViews\":[{\"buffer\":0,\"byteLength\":256},{\"buffer\":0,\"byteLength\":256,\"byteOffset\":256,\"byteStride\":12,\"target\":34962}," );
+    fprintf( file, "{\"buffer\":0,\"byteLength\":256,\"byteOffset\":512,\"target\":34963},{\"buffer\":1,\"byteLength\":16,\"name\":\"view\"}]\n}\n" );
+
+    fclose( file );
+}
+
+// Comparison /////////////////////////////////////////////////////////////
+
+static bool strings_equal( const StringBuffer& a, const StringBuffer& b ) {
+    if ( a.data == nullptr || b.data == nullptr ) {
+        return a.data == b.data;
+    }
+    return strcmp( a.data, b.data ) == 0;
+}
+
+template <typename T>
+static bool arrays_equal( u32 count_a, const T* a, u32 count_b, const T* b ) {
+    return count_a == count_b && ( count_a == 0 || memcmp( a, b, sizeof( T ) * count_a ) == 0 );
+}
+
+template <typename T>
+static bool texture_infos_equal( const T* a, const T* b ) {
+    if ( a == nullptr || b == nullptr ) {
+        return a == b;
+    }
+    return memcmp( a, b, sizeof( T ) ) == 0;
+}
+
+static void check_same_document( const glTF::glTF& a, const glTF::glTF& b ) {
+    RCHECK( strings_equal( a.asset.copyright, b.asset.copyright ) && strings_equal( a.asset.generator, b.asset.generator ) );
+    RCHECK( strings_equal( a.asset.minVersion, b.asset.minVersion ) && strings_equal( a.asset.version, b.asset.version ) );
+    RCHECK( a.scene == b.scene );
+
+    RCHECK( a.scenes_count == b.scenes_count );
+    for ( u32 i = 0; i < a.scenes_count && i < b.scenes_count; ++i ) {
+        RCHECK( arrays_equal( a.scenes[ i ].nodes_count, a.scenes[ i ].nodes, b.scenes[ i ].nodes_count, b.scenes[ i ].nodes ) );
+    }
+
+    RCHECK( a.buffers_count == b.buffers_count );
+    for ( u32 i = 0; i < a.buffers_count && i < b.buffers_count; ++i ) {
+        const glTF::Buffer& x = a.buffers[ i ];
+        const glTF::Buffer& y = b.buffers[ i ];
+        RCHECK( x.byte_length == y.byte_length && strings_equal( x.uri, y.uri ) && strings_equal( x.name, y.name ) );
+    }
+
+    RCHECK( a.buffer_views_count == b.buffer_views_count );
+    for ( u32 i = 0; i < a.buffer_views_count && i < b.buffer_views_count; ++i ) {
+        const glTF::BufferView& x = a.buffer_views[ i ];
+        const glTF::BufferView& y = b.buffer_views[ i ];
+        RCHECK( x.buffer == y.buffer && x.byte_length == y.byte_length && x.byte_offset == y.byte_offset );
+        RCHECK( x.byte_stride == y.byte_stride && x.target == y.target && strings_equal( x.name, y.name ) );
+    }
+
+    RCHECK( a.nodes_count == b.nodes_count );
+    u32 node_mismatches = 0;
+    for ( u32 i = 0; i < a.nodes_count && i < b.nodes_count; ++i ) {
+        const glTF::Node& x = a.nodes[ i ];
+        const glTF::Node& y = b.nodes[ i ];
+        const bool equal = x.camera == y.camera && x.mesh == y.mesh && x.skin == y.skin && strings_equal( x.name, y.name ) &&
+                           arrays_equal( x.children_count, x.children, y.children_count, y.children ) &&
+                           arrays_equal( x.matrix_count, x.matrix, y.matrix_count, y.matrix ) &&
+                           arrays_equal( x.rotation_count, x.rotation, y.rotation_count, y.rotation ) &&
+                           arrays_equal( x.scale_count, x.scale, y.scale_count, y.scale ) &&
+                           arrays_equal( x.translation_count, x.translation, y.translation_count, y.translation ) &&
+                           arrays_equal( x.weights_count, x.weights, y.weights_count, y.weights );
+        node_mismatches += equal ? 0 : 1;
+    }
+    RCHECK( node_mismatches == 0 );
+
+    RCHECK( a.meshes_count == b.meshes_count );
+    u32 mesh_mismatches = 0;
+    for ( u32 i = 0; i < a.meshes_count && i < b.meshes_count; ++i ) {
+        const glTF::Mesh& x = a.meshes[ i ];
+        const glTF::Mesh& y = b.meshes[ i ];
+        bool equal = x.primitives_count == y.primitives_count && strings_equal( x.name, y.name ) &&
+                     arrays_equal( x.weights_count, x.weights, y.weights_count, y.weights );
+
+        for ( u32 p = 0; equal && p < x.primitives_count; ++p ) {
+            const glTF::MeshPrimitive& xp = x.primitives[ p ];
+            const glTF::MeshPrimitive& yp = y.primitives[ p ];
+            equal = xp.indices == yp.indices && xp.material == yp.material && xp.mode == yp.mode && xp.attribute_count == yp.attribute_count;
+
+            // The DOM sorts attributes by name, lookups are by name.
+            for ( u32 attribute = 0; equal && attribute < xp.attribute_count; ++attribute ) {
+                const glTF::MeshPrimitive::Attribute& xa = xp.attributes[ attribute ];
+                equal = gltf_get_attribute_accessor_index( yp.attributes, yp.attribute_count, xa.key.data ) == xa.accessor_index;
+            }
+        }
+        mesh_mismatches += equal ? 0 : 1;
+    }
+    RCHECK( mesh_mismatches == 0 );
+
+    RCHECK( a.accessors_count == b.accessors_count );
+    u32 accessor_mismatches = 0;
+    for ( u32 i = 0; i < a.accessors_count && i < b.accessors_count; ++i ) {
+        const glTF::Accessor& x = a.accessors[ i ];
+        const glTF::Accessor& y = b.accessors[ i ];
+        const bool equal = x.buffer_view == y.buffer_view && x.byte_offset == y.byte_offset && x.component_type == y.component_type &&
+                           x.count == y.count && x.normalized == y.normalized && x.sparse == y.sparse && x.type == y.type &&
+                           arrays_equal( x.max_count, x.max, y.max_count, y.max ) && arrays_equal( x.min_count, x.min, y.min_count, y.min );
+        accessor_mismatches += equal ? 0 : 1;
+    }
+    RCHECK( accessor_mismatches == 0 );
+
+    RCHECK( a.materials_count == b.materials_count );
+    u32 material_mismatches = 0;
+    for ( u32 i = 0; i < a.materials_count && i < b.materials_count; ++i ) {
+        const glTF::Material& x = a.materials[ i ];
+        const glTF::Material& y = b.materials[ i ];
+        bool equal = x.alpha_cutoff == y.alpha_cutoff && x.double_sided == y.double_sided && strings_equal( x.alpha_mode, y.alpha_mode ) &&
+                     strings_equal( x.name, y.name ) && arrays_equal( x.emissive_factor_count, x.emissive_factor, y.emissive_factor_count, y.emissive_factor ) &&
+                     texture_infos_equal( x.emissive_texture, y.emissive_texture ) && texture_infos_equal( x.normal_texture, y.normal_texture ) &&
+                     texture_infos_equal( x.occlusion_texture, y.occlusion_texture );
+
+        const glTF::MaterialPBRMetallicRoughness* xr = x.pbr_metallic_roughness;
+        const glTF::MaterialPBRMetallicRoughness* yr = y.pbr_metallic_roughness;
+        if ( xr && yr ) {
+            equal = equal && xr->metallic_factor == yr->metallic_factor && xr->roughness_factor == yr->roughness_factor &&
+                    arrays_equal( xr->base_color_factor_count, xr->base_color_factor, yr->base_color_factor_count, yr->base_color_factor ) &&
+                    texture_infos_equal( xr->base_color_texture, yr->base_color_texture ) &&
+                    texture_infos_equal( xr->metallic_roughness_texture, yr->metallic_roughness_texture );
+        } else {
+            equal = equal && xr == yr;
+        }
+        material_mismatches += equal ? 0 : 1;
+    }
+    RCHECK( material_mismatches == 0 );
+
+    RCHECK( a.textures_count == b.textures_count );
+    for ( u32 i = 0; i < a.textures_count && i < b.textures_count; ++i ) {
+        const glTF::Texture& x = a.textures[ i ];
+        const glTF::Texture& y = b.textures[ i ];
+        RCHECK( x.sampler == y.sampler && x.source == y.source && strings_equal( x.name, y.name ) );
+    }
+
+    RCHECK( a.images_count == b.images_count );
+    for ( u32 i = 0; i < a.images_count && i < b.images_count; ++i ) {
+        const glTF::Image& x = a.images[ i ];
+        const glTF::Image& y = b.images[ i ];
+        RCHECK( x.buffer_view == y.buffer_view && strings_equal( x.mime_type, y.mime_type ) && strings_equal( x.uri, y.uri ) );
+    }
+
+    RCHECK( a.samplers_count == b.samplers_count );
+    for ( u32 i = 0; i < a.samplers_count && i < b.samplers_count; ++i ) {
+        RCHECK( memcmp( &a.samplers[ i ], &b.samplers[ i ], sizeof( glTF::Sampler ) ) == 0 );
+    }
+
+    RCHECK( a.skins_count == b.skins_count );
+    for ( u32 i = 0; i < a.skins_count && i < b.skins_count; ++i ) {
+        const glTF::Skin& x = a.skins[ i ];
+        const glTF::Skin& y = b.skins[ i ];
+        RCHECK( x.inverse_bind_matrices_buffer_index == y.inverse_bind_matrices_buffer_index && x.skeleton_root_node_index == y.skeleton_root_node_index );
+        RCHECK( arrays_equal( x.joints_count, x.joints, y.joints_count, y.joints ) );
+    }
+
+    RCHECK( a.animations_count == b.animations_count );
+    for ( u32 i = 0; i < a.animations_count && i < b.animations_count; ++i ) {
+        const glTF::Animation& x = a.animations[ i ];
+        const glTF::Animation& y = b.animations[ i ];
+        RCHECK( arrays_equal( x.samplers_count, x.samplers, y.samplers_count, y.samplers ) );
+        RCHECK( arrays_equal( x.channels_count, x.channels, y.channels_count, y.channels ) );
+    }
+}
+
+static void check_matches_dom( cstring path ) {
+    glTF::glTF streamed = gltf_load_file( path );
+    glTF::glTF reference = gltf_dom_load_file( path );
+
+    check_same_document( streamed, reference );
+
+    gltf_free( reference );
+    gltf_free( streamed );
+}
+
+// Tests //////////////////////////////////////////////////////////////////
+
+RTEST( gltf_matches_dom_reference ) {
+    char path[ k_max_path ];
+    strcpy( path, test_temporary_path( "scene.gltf" ) );
+
+    const u32 node_counts[ 4 ] = { 1, 7, 300, 5000 };
+    for ( u32 i = 0; i < 4; ++i ) {
+        write_scene_document( path, node_counts[ i ], 17 + i );
+        check_matches_dom( path );
+    }
+
+    // Decoded escapes.
+    glTF::glTF scene = gltf_load_file( path );
+    RCHECK( strcmp( scene.asset.generator.data, "raptor \"tests\" \xc3\xa9\xf0\x9f\x98\x80" ) == 0 );
+    RCHECK( strcmp( scene.asset.copyright.data, "a/b\\c\n" ) == 0 );
+    RCHECK( strcmp( scene.nodes[ 3 ].name.data, "node \"3\"\t" ) == 0 );
+    gltf_free( scene );
+
+    file_delete( path );
+}
+
+// Minified documents of many small elements expand well past the file size once parsed.
+RTEST( gltf_many_small_nodes ) {
+    char path[ k_max_path ];
+    strcpy( path, test_temporary_path( "small_nodes.gltf" ) );
+
+    const u32 node_count = 20000;
+    FILE* file = fopen( path, "wb" );
+    fprintf( file, "{\"asset\":{\"version\":\"2.0\"},\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0}}]}],\"nodes\":[" );
+    for ( u32 i = 0; i < node_count; ++i ) {
+        fprintf( file, "%s{\"mesh\":0,\"translation\":[1,2,3]}", i ? "," : "" );
+    }
+    fprintf( file, "]}" );
+    fclose( file );
+
+    glTF::glTF scene = gltf_load_file( path );
+    RCHECK( scene.nodes_count == node_count );
+    RCHECK( scene.allocator.allocated_size > rmega( 2 ) && scene.allocator.block_count > 1 );
+
+    u32 wrong_nodes = 0;
+    for ( u32 i = 0; i < scene.nodes_count; ++i ) {
+        const glTF::Node& node = scene.nodes[ i ];
+        const bool correct = node.mesh == 0 && node.translation_count == 3 && node.translation[ 0 ] == 1.0f && node.translation[ 2 ] == 3.0f &&
+                             node.matrix_count == 0 && node.camera == glTF::INVALID_INT_VALUE;
+        wrong_nodes += correct ? 0 : 1;
+    }
+    RCHECK( wrong_nodes == 0 );
+    gltf_free( scene );
+
+    check_matches_dom( path );
+
+    file_delete( path );
+}
+
+RTEST( gltf_malformed_documents ) {
+    char path[ k_max_path ];
+    strcpy( path, test_temporary_path( "malformed.gltf" ) );
+
+    static cstring documents[] = {
+        "",
+        "{",
+        "[]",
+        "{\"nodes\":[{\"mesh\":0},{\"mesh\":",
+        "{\"nodes\":[{\"mesh\":0}{\"mesh\":1}]}",
+        "{\"nodes\":[{\"name\":\"unterminated}]}",
+        "{\"accessors\":[{\"min\":[1,2,],\"type\":\"VEC3\"}]}",
+        "{\"asset\":{\"generator\":\"\\u00\"}}",
+        "{\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,}}]}]}",
+    };
+
+    // Errors are reported and whatever was parsed can be freed, nothing is read or written out of bounds.
+    for ( u32 i = 0; i < ArraySize( documents ); ++i ) {
+        FILE* file = fopen( path, "wb" );
+        fwrite( documents[ i ], 1, strlen( documents[ i ] ), file );
+        fclose( file );
+
+        glTF::glTF scene = gltf_load_file( path );
+        gltf_free( scene );
+    }
+
+    file_delete( path );
+}
+
+// Assets of the glTF sample models repository, found under the --data folder.
+static cstring k_sample_models[] = {
+    "2.0/Sponza/glTF/Sponza.gltf",
+    "2.0/FlightHelmet/glTF/FlightHelmet.gltf",
+    "2.0/DamagedHelmet/glTF/DamagedHelmet.gltf",
+    "2.0/BoxAnimated/glTF/BoxAnimated.gltf",
+    "2.0/CesiumMan/glTF/CesiumMan.gltf",
+    "2.0/BrainStem/glTF/BrainStem.gltf",
+    "2.0/MetalRoughSpheres/glTF/MetalRoughSpheres.gltf",
+    "2.0/SciFiHelmet/glTF/SciFiHelmet.gltf",
+};
+
+RTEST( gltf_sample_models_match_dom_reference ) {
+    cstring data_folder = test_data_folder();
+    if ( data_folder == nullptr ) {
+        rprint( "Skipped, sample models are read from --data <glTF-Sample-Models folder>\n" );
+        return;
+    }
+
+    u32 found = 0;
+    for ( u32 i = 0; i < ArraySize( k_sample_models ); ++i ) {
+        char path[ k_max_path ];
+        snprintf( path, sizeof( path ), "%s/%s", data_folder, k_sample_models[ i ] );
+        if ( !file_exists( path ) ) {
+            continue;
+        }
+
+        check_matches_dom( path );
+        ++found;
+    }
+
+    rprint( "Compared %u sample models\n", found );
+}
+
+// Loading time and heap allocations of both loaders, on a generated scene and on the sample models when given --data.
+static void benchmark_load( cstring name, cstring path, u32 iterations ) {
+    sizet file_size = 0;
+    FILE* file = fopen( path, "rb" );
+    if ( file ) {
+        fseek( file, 0, SEEK_END );
+        file_size = ftell( file );
+        fclose( file );
+    }
+
+    for ( u32 loader = 0; loader < 2; ++loader ) {
+        const u64 allocations_before = s_new_count;
+        const i64 start = time_now();
+
+        u32 arena_blocks = 0;
+        for ( u32 i = 0; i < iterations; ++i ) {
+            glTF::glTF scene = loader == 0 ? gltf_load_file( path ) : gltf_dom_load_file( path );
+            arena_blocks = scene.allocator.block_count;
+            gltf_free( scene );
+        }
+
+        const f64 elapsed_ms = time_from_milliseconds( start ) / iterations;
+        const u64 allocations = ( s_new_count - allocations_before ) / iterations;
+        rprint( "%-16s %-10s %8.2f ms %8.1f MB/s, %7llu new calls, %u arena blocks\n", name, loader == 0 ? "streaming" : "dom",
+                elapsed_ms, ( file_size / ( 1024.0 * 1024.0 ) ) / ( elapsed_ms / 1000.0 ), ( unsigned long long )allocations, arena_blocks );
+    }
+}
+
+RBENCHMARK( gltf_load_throughput ) {
+    char path[ k_max_path ];
+    strcpy( path, test_temporary_path( "benchmark.gltf" ) );
+
+    write_scene_document( path, 50000, 1 );
+    benchmark_load( "generated", path, 4 );
+    file_delete( path );
+
+    cstring data_folder = test_data_folder();
+    for ( u32 i = 0; data_folder && i < ArraySize( k_sample_models ); ++i ) {
+        snprintf( path, sizeof( path ), "%s/%s", data_folder, k_sample_models[ i ] );
+        if ( file_exists( path ) ) {
+            char name[ k_max_path ];
+            strcpy( name, k_sample_models[ i ] + 4 );
+            *strchr( name, '/' ) = 0;
+            benchmark_load( name, path, 8 );
+        }
+    }
+}
+
+} // namespace raptor
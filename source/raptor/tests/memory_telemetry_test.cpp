@@ -0,0 +1,244 @@
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace raptor {
+
+static bool file_contains( cstring path, cstring text ) {
+    FILE* file = fopen( path, "rb" );
+    if ( !file ) {
+        return false;
+    }
+
+    static char buffer[ 16 * 1024 ];
+    const sizet read = fread( buffer, 1, sizeof( buffer ) - 1, file );
+    buffer[ read ] = 0;
+    fclose( file );
+
+    return strstr( buffer, text ) != nullptr;
+}
+
+RTEST( memory_size_classes ) {
+    RCHECK( memory_size_class( 0 ) == 0 && memory_size_class( 16 ) == 0 );
+    RCHECK( memory_size_class( 17 ) == 1 && memory_size_class( 32 ) == 1 && memory_size_class( 33 ) == 2 );
+    RCHECK( memory_size_class( rkilo( 1 ) ) == 6 );
+    // The last class collects everything larger.
+    RCHECK( memory_size_class( rmega( 128 ) ) == k_memory_size_classes - 1 );
+    RCHECK( memory_size_class( ( sizet )rmega( 1024 ) * 4 ) == k_memory_size_classes - 1 );
+}
+
+RTEST( memory_telemetry_accounting ) {
+    const u32 textures = memory_tag_register( "test_textures" );
+    const u32 meshes = memory_tag_register( "test_meshes" );
+    RCHECK( textures != 0 && meshes != textures );
+    RCHECK( memory_tag_register( "test_textures" ) == textures );
+    RCHECK( strcmp( memory_tag_name( meshes ), "test_meshes" ) == 0 && strcmp( memory_tag_name( k_memory_max_tags ), "invalid" ) == 0 );
+
+    HeapAllocator heap;
+    heap.init( rmega( 4 ) );
+    heap.enable_telemetry();
+
+    const MemoryTagStats& texture_stats = heap.telemetry.tags[ textures ];
+    const MemoryTagStats& mesh_stats = heap.telemetry.tags[ meshes ];
+
+    void* untagged = heap.allocate( 100, 8 );
+    void* texture_a = nullptr;
+    void* texture_b = nullptr;
+    void* mesh = nullptr;
+    {
+        MemoryTagScope texture_scope( textures );
+        texture_a = heap.allocate( 1000, 8 );
+        {
+            // Scopes nest, the previous tag is restored at the end.
+            MemoryTagScope mesh_scope( meshes );
+            RCHECK( memory_tag_current() == meshes );
+            mesh = heap.allocate( 64, 64 );
+        }
+        RCHECK( memory_tag_current() == textures );
+        texture_b = heap.allocate( rkilo( 64 ), 16 );
+    }
+    RCHECK( memory_tag_current() == 0 );
+
+    // Requested sizes are accounted, not the block sizes.
+    RCHECK( texture_stats.current_bytes == 1000 + rkilo( 64 ) && texture_stats.current_count == 2 && texture_stats.total_count == 2 );
+    RCHECK( texture_stats.size_classes[ memory_size_class( 1000 ) ] == 1 && texture_stats.size_classes[ memory_size_class( rkilo( 64 ) ) ] == 1 );
+    RCHECK( mesh_stats.current_bytes == 64 && mesh_stats.current_count == 1 && mesh_stats.size_classes[ 2 ] == 1 );
+    RCHECK( heap.telemetry.tags[ 0 ].current_bytes == 100 );
+    RCHECK( heap.telemetry.current_bytes == 100 + 1000 + rkilo( 64 ) + 64 );
+
+    // Aligned allocations keep their alignment with the header in front.
+    RCHECK( ( ( uintptr_t )mesh & 63 ) == 0 && ( ( uintptr_t )texture_b & 15 ) == 0 );
+    memset( mesh, 0xff, 64 );
+
+    // Frees go to the tag of the allocation, whatever the current tag is. Peaks stay.
+    {
+        MemoryTagScope mesh_scope( meshes );
+        heap.deallocate( texture_b );
+    }
+    RCHECK( texture_stats.current_bytes == 1000 && texture_stats.peak_bytes == 1000 + rkilo( 64 ) );
+    RCHECK( texture_stats.current_count == 1 && texture_stats.total_count == 2 && texture_stats.size_classes[ memory_size_class( rkilo( 64 ) ) ] == 0 );
+    RCHECK( mesh_stats.current_count == 1 );
+    RCHECK( heap.telemetry.peak_bytes == 100 + 1000 + rkilo( 64 ) + 64 );
+
+    heap.deallocate( mesh );
+    heap.deallocate( texture_a );
+    heap.deallocate( untagged );
+    heap.deallocate( nullptr );
+
+    RCHECK( heap.telemetry.current_bytes == 0 && heap.allocated_size == 0 );
+    RCHECK( texture_stats.current_count == 0 && mesh_stats.current_bytes == 0 && mesh_stats.peak_bytes == 64 );
+
+    heap.shutdown();
+}
+
+RTEST( memory_heap_statistics ) {
+    HeapAllocator heap;
+    heap.init( rmega( 1 ) );
+
+    HeapStatistics statistics;
+    heap.get_statistics( statistics );
+    RCHECK( statistics.used_blocks == 0 && statistics.free_blocks == 1 && statistics.fragmentation == 0.0f );
+    const sizet free_bytes = statistics.free_bytes;
+
+    void* blocks[ 8 ];
+    for ( u32 b = 0; b < ArraySize( blocks ); ++b ) {
+        blocks[ b ] = heap.allocate( rkilo( 16 ), 8 );
+    }
+    heap.get_statistics( statistics );
+    RCHECK( statistics.used_blocks == 8 && statistics.used_bytes >= rkilo( 128 ) && statistics.used_bytes == heap.allocated_size );
+    RCHECK( statistics.used_bytes + statistics.free_bytes <= free_bytes && statistics.fragmentation == 0.0f );
+
+    // Every other block freed: holes that cannot be merged with the free memory at the end.
+    for ( u32 b = 0; b < ArraySize( blocks ); b += 2 ) {
+        heap.deallocate( blocks[ b ] );
+    }
+    heap.get_statistics( statistics );
+    RCHECK( statistics.used_blocks == 4 && statistics.free_blocks == 5 );
+    RCHECK( statistics.largest_free_block < statistics.free_bytes && statistics.fragmentation > 0.0f && statistics.fragmentation < 1.0f );
+
+    for ( u32 b = 1; b < ArraySize( blocks ); b += 2 ) {
+        heap.deallocate( blocks[ b ] );
+    }
+    heap.get_statistics( statistics );
+    RCHECK( statistics.used_blocks == 0 && statistics.free_blocks == 1 && statistics.free_bytes == free_bytes && statistics.fragmentation == 0.0f );
+
+    heap.shutdown();
+}
+
+RTEST( memory_report_json ) {
+    const u32 audio = memory_tag_register( "test_audio" );
+
+    HeapAllocator heap;
+    heap.init( rmega( 1 ) );
+    heap.enable_telemetry();
+
+    void* sound = nullptr;
+    {
+        MemoryTagScope audio_scope( audio );
+        sound = heap.allocate( 333, 8, "sound\"bank.cpp", 42 );
+    }
+
+    char path[ 512 ];
+    strcpy( path, test_temporary_path( "memory_report.json" ) );
+    RCHECK( heap.write_report_json( path ) );
+
+    // Live allocations are listed with their tag and source, strings are escaped.
+    RCHECK( file_contains( path, "\"telemetry\": true" ) );
+    RCHECK( file_contains( path, "\"requested_bytes\": 333," ) );
+    RCHECK( file_contains( path, "{ \"name\": \"test_audio\", \"current_bytes\": 333, \"peak_bytes\": 333, \"current_count\": 1, \"total_count\": 1" ) );
+    RCHECK( file_contains( path, "{ \"size\": 333, \"tag\": \"test_audio\", \"file\": \"sound\\\"bank.cpp\", \"line\": 42 }" ) );
+
+    heap.deallocate( sound );
+    RCHECK( heap.write_report_json( path ) );
+    RCHECK( file_contains( path, "\"allocations\": [\n\t]" ) );
+    remove( path );
+
+    RCHECK( !heap.write_report_json( "missing_folder/memory_report.json" ) );
+
+    heap.shutdown();
+}
+
+RTEST( memory_high_water_marks ) {
+    StackAllocator stack;
+    stack.init( rkilo( 4 ) );
+    const sizet marker = stack.get_marker();
+    stack.allocate( 1000, 1 );
+    stack.allocate( 500, 1 );
+    stack.free_marker( marker );
+    stack.allocate( 200, 1 );
+    RCHECK( stack.allocated_size == 200 && stack.peak_size == 1500 );
+    stack.shutdown();
+
+    LinearAllocator linear;
+    linear.init( rkilo( 4 ) );
+    linear.allocate( 3000, 1 );
+    linear.clear();
+    linear.allocate( 100, 1 );
+    RCHECK( linear.allocated_size == 100 && linear.peak_size == 3000 );
+    linear.shutdown();
+}
+
+// Alloc and free of random sizes, keeping some alive to exercise the free lists.
+static f64 churn_ns_per_operation( HeapAllocator& heap, u32 iterations ) {
+    void* live[ 64 ] = { };
+    u32 random = 1;
+
+    const i64 start = time_now();
+    for ( u32 i = 0; i < iterations; ++i ) {
+        random = random * 1664525u + 1013904223u;
+        const u32 slot = ( random >> 8 ) % 64;
+        heap.deallocate( live[ slot ] );
+        live[ slot ] = heap.allocate( 16 + ( random >> 16 ) % 2032, 8 );
+    }
+    const f64 elapsed_ms = time_from_milliseconds( start );
+
+    for ( u32 s = 0; s < 64; ++s ) {
+        heap.deallocate( live[ s ] );
+    }
+    return elapsed_ms * 1e6 / ( iterations * 2.0 );
+}
+
+RBENCHMARK( memory_telemetry_overhead ) {
+    const u32 tag = memory_tag_register( "benchmark" );
+    MemoryTagScope tag_scope( tag );
+
+    const u32 iterations = 2000000;
+    const u32 counts[] = { 10000, 10000, 10000, 2000, 500 };
+    const u32 sizes[] = { 16, 64, 256, rkilo( 4 ), rkilo( 64 ) };
+
+    for ( u32 telemetry = 0; telemetry < 2; ++telemetry ) {
+        HeapAllocator heap;
+        heap.init( rmega( 128 ) );
+        if ( telemetry ) {
+            heap.enable_telemetry();
+        }
+
+        rprint( "%s: alloc+free %.1f ns/op\n", telemetry ? "Telemetry" : "Plain", churn_ns_per_operation( heap, iterations ) );
+
+        // Memory taken per allocation past the requested size: TLSF rounding, plus the header with telemetry.
+        static void* blocks[ 10000 ];
+        for ( u32 s = 0; s < ArraySize( sizes ); ++s ) {
+            for ( u32 b = 0; b < counts[ s ]; ++b ) {
+                blocks[ b ] = heap.allocate( sizes[ s ], 8 );
+            }
+
+            HeapStatistics statistics;
+            heap.get_statistics( statistics );
+            const f64 overhead = ( ( f64 )statistics.used_bytes - ( f64 )sizes[ s ] * counts[ s ] ) / counts[ s ];
+            rprint( "\t%6u bytes: %5.1f bytes per allocation (%.1f%%)\n", sizes[ s ], overhead, overhead * 100.0 / sizes[ s ] );
+
+            for ( u32 b = 0; b < counts[ s ]; ++b ) {
+                heap.deallocate( blocks[ b ] );
+            }
+        }
+
+        heap.shutdown();
+    }
+}
+
+} // namespace raptor
@@ -0,0 +1,588 @@
+#include "foundation/file.hpp"
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/serialization.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include "external/json.hpp"
+
+#include <string.h>
+
+namespace raptor {
+
+// The same mesh description as three versions of the code would see it.
+// Version 2 added the lods and the shadow flag, version 3 replaced the scale with the bounding radius.
+
+struct MeshV1 {
+    char                            name[ 32 ];
+    u32                             vertex_count;
+    f32                             scale;
+}; // struct MeshV1
+
+struct MeshV2 {
+    char                            name[ 32 ];
+    u32                             vertex_count;
+    f32                             scale;
+    Array<u32>                      lod_offsets;
+    bool                            cast_shadows;
+}; // struct MeshV2
+
+struct MeshV3 {
+    char                            name[ 32 ];
+    u32                             vertex_count;
+    f32                             radius;
+    Array<u32>                      lod_offsets;
+    bool                            cast_shadows;
+}; // struct MeshV3
+
+static void serialize( Serializer* s, MeshV1* data ) {
+    s->begin_type( 1 );
+    serialize( s, data->name, ArraySize( data->name ) );
+    RSERIALIZE_ADD( 1, vertex_count );
+    RSERIALIZE_ADD( 1, scale );
+    s->end_type();
+}
+
+static void serialize( Serializer* s, MeshV2* data ) {
+    s->begin_type( 2 );
+    serialize( s, data->name, ArraySize( data->name ) );
+    RSERIALIZE_ADD( 1, vertex_count );
+    RSERIALIZE_ADD( 1, scale );
+    if ( s->data_version >= 2 ) {
+        serialize( s, &data->lod_offsets );
+    } else if ( s->is_reading ) {
+        data->lod_offsets.init( s->allocator, 0 );
+    }
+    RSERIALIZE_ADD( 2, cast_shadows );
+    if ( s->is_reading && s->data_version < 2 ) {
+        data->cast_shadows = true;
+    }
+    s->end_type();
+}
+
+static void serialize( Serializer* s, MeshV3* data ) {
+    s->begin_type( 3 );
+    serialize( s, data->name, ArraySize( data->name ) );
+    RSERIALIZE_ADD( 1, vertex_count );
+    RSERIALIZE_REM( 1, 3, f32, scale, 1.0f );
+    if ( s->data_version >= 2 ) {
+        serialize( s, &data->lod_offsets );
+    } else if ( s->is_reading ) {
+        data->lod_offsets.init( s->allocator, 0 );
+    }
+    RSERIALIZE_ADD( 2, cast_shadows );
+    if ( s->is_reading && s->data_version < 2 ) {
+        data->cast_shadows = true;
+    }
+    RSERIALIZE_ADD( 3, radius );
+    if ( s->is_reading && s->data_version < 3 ) {
+        data->radius = scale * 0.5f;
+    }
+    s->end_type();
+}
+
+//
+// Every supported kind of field, nested in a versioned type.
+struct SerializedScene {
+    i8                              i8_value;
+    u8                              u8_value;
+    i16                             i16_value;
+    u16                             u16_value;
+    i32                             i32_value;
+    u32                             u32_value;
+    i64                             i64_value;
+    u64                             u64_value;
+    f32                             f32_value;
+    f64                             f64_value;
+    bool                            bool_value;
+    char                            char_value;
+
+    char                            short_name[ 8 ];
+    StringBuffer                    description;
+    Array<f32>                      weights;
+    Array<MeshV3>                   meshes;
+    RelativeString                  path;
+    RelativeArray<u16>              indices;
+}; // struct SerializedScene
+
+static void serialize( Serializer* s, SerializedScene* data ) {
+    s->begin_type( 1 );
+    RSERIALIZE_ADD( 1, i8_value );
+    RSERIALIZE_ADD( 1, u8_value );
+    RSERIALIZE_ADD( 1, i16_value );
+    RSERIALIZE_ADD( 1, u16_value );
+    RSERIALIZE_ADD( 1, i32_value );
+    RSERIALIZE_ADD( 1, u32_value );
+    RSERIALIZE_ADD( 1, i64_value );
+    RSERIALIZE_ADD( 1, u64_value );
+    RSERIALIZE_ADD( 1, f32_value );
+    RSERIALIZE_ADD( 1, f64_value );
+    RSERIALIZE_ADD( 1, bool_value );
+    RSERIALIZE_ADD( 1, char_value );
+    serialize( s, data->short_name, ArraySize( data->short_name ) );
+    RSERIALIZE_ADD( 1, description );
+    RSERIALIZE_ADD( 1, weights );
+    RSERIALIZE_ADD( 1, meshes );
+    RSERIALIZE_ADD( 1, path );
+    RSERIALIZE_ADD( 1, indices );
+    s->end_type();
+}
+
+template <typename T>
+static void free_mesh_arrays( Array<T>& meshes ) {
+    for ( u32 m = 0; m < meshes.size; ++m ) {
+        meshes[ m ].lod_offsets.shutdown();
+    }
+    meshes.shutdown();
+}
+
+// Fields of a type whose header could not be read are left untouched.
+static void free_scene( SerializedScene* scene, Allocator* allocator ) {
+    if ( scene->description.data ) {
+        scene->description.shutdown();
+    }
+    scene->weights.shutdown();
+    free_mesh_arrays( scene->meshes );
+    if ( scene->path.get() ) {
+        rfree( scene->path.get(), allocator );
+    }
+    if ( scene->indices.get() ) {
+        rfree( scene->indices.get(), allocator );
+    }
+}
+
+static void fill_mesh( MeshV3& mesh, Allocator* allocator, u32 index, u32 lod_count ) {
+    snprintf( mesh.name, ArraySize( mesh.name ), "mesh_%u", index );
+    mesh.vertex_count = index * 100 + 3;
+    mesh.radius = index * 0.25f;
+    mesh.cast_shadows = ( index & 1 ) != 0;
+    mesh.lod_offsets.init( allocator, lod_count, lod_count );
+    for ( u32 l = 0; l < lod_count; ++l ) {
+        mesh.lod_offsets[ l ] = index * 1000 + l;
+    }
+}
+
+// Relative offsets need the scene in the same heap as the data it points to.
+static SerializedScene* create_scene( Allocator* allocator ) {
+    SerializedScene* scene = rallocat( SerializedScene, allocator );
+    *scene = SerializedScene{ };
+
+    scene->i8_value = -100;
+    scene->u8_value = 200;
+    scene->i16_value = -30000;
+    scene->u16_value = 60000;
+    scene->i32_value = -2000000000;
+    scene->u32_value = 4000000000u;
+    scene->i64_value = -( i64 )9000000000000000000ll;
+    scene->u64_value = 18000000000000000000ull;
+    scene->f32_value = -1.5e-20f;
+    scene->f64_value = 3.141592653589793;
+    scene->bool_value = true;
+    scene->char_value = 'r';
+
+    strcpy( scene->short_name, "raptor" );
+    scene->description.init( 64, allocator );
+    scene->description.append( "Scene with every kind of field" );
+
+    scene->weights.init( allocator, 5, 5 );
+    for ( u32 w = 0; w < 5; ++w ) {
+        scene->weights[ w ] = w * 0.5f - 1.0f;
+    }
+
+    scene->meshes.init( allocator, 3, 3 );
+    for ( u32 m = 0; m < 3; ++m ) {
+        fill_mesh( scene->meshes[ m ], allocator, m, m * 2 );
+    }
+
+    cstring path = "models/scene.gltf";
+    char* path_text = ( char* )ralloca( strlen( path ) + 1, allocator );
+    strcpy( path_text, path );
+    scene->path.set( path_text, ( u32 )strlen( path ) );
+
+    u16* indices = ( u16* )rallocaa( sizeof( u16 ) * 6, allocator, alignof( u16 ) );
+    for ( u16 i = 0; i < 6; ++i ) {
+        indices[ i ] = i * 1000;
+    }
+    scene->indices.set( ( char* )indices, 6 );
+
+    return scene;
+}
+
+static bool scenes_equal( const SerializedScene* a, const SerializedScene* b ) {
+    bool equal = a->i8_value == b->i8_value && a->u8_value == b->u8_value && a->i16_value == b->i16_value && a->u16_value == b->u16_value &&
+                 a->i32_value == b->i32_value && a->u32_value == b->u32_value && a->i64_value == b->i64_value && a->u64_value == b->u64_value &&
+                 a->f32_value == b->f32_value && a->f64_value == b->f64_value && a->bool_value == b->bool_value && a->char_value == b->char_value;
+    equal = equal && strcmp( a->short_name, b->short_name ) == 0 && strcmp( a->description.data, b->description.data ) == 0;
+    equal = equal && a->weights.size == b->weights.size && memcmp( a->weights.data, b->weights.data, sizeof( f32 ) * a->weights.size ) == 0;
+    equal = equal && a->meshes.size == b->meshes.size;
+    for ( u32 m = 0; equal && m < a->meshes.size; ++m ) {
+        const MeshV3& ma = a->meshes[ m ];
+        const MeshV3& mb = b->meshes[ m ];
+        equal = strcmp( ma.name, mb.name ) == 0 && ma.vertex_count == mb.vertex_count && ma.radius == mb.radius && ma.cast_shadows == mb.cast_shadows &&
+                ma.lod_offsets.size == mb.lod_offsets.size &&
+                ( ma.lod_offsets.size == 0 || memcmp( ma.lod_offsets.data, mb.lod_offsets.data, sizeof( u32 ) * ma.lod_offsets.size ) == 0 );
+    }
+    equal = equal && a->path.size == b->path.size && strcmp( a->path.c_str(), b->path.c_str() ) == 0;
+    equal = equal && a->indices.size == b->indices.size && memcmp( a->indices.get(), b->indices.get(), sizeof( u16 ) * a->indices.size ) == 0;
+    return equal;
+}
+
+RTEST( serializer_round_trip ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+    const sizet allocated_before = MemoryService::instance()->system_allocator.allocated_size;
+
+    SerializedScene* scene = create_scene( allocator );
+
+    Serializer writer;
+    writer.start_writing( allocator, 16 );
+    serialize( &writer, scene );
+    RCHECK( !writer.error && writer.depth == 0 );
+
+    // Little endian on disk, whatever the host.
+    RCHECK( writer.memory[ 0 ] == 0x52 && writer.memory[ 3 ] == 0x52 && writer.memory[ 4 ] == k_serializer_format_version );
+
+    Serializer reader;
+    RCHECK( reader.start_reading( allocator, writer.memory, writer.size ) );
+    SerializedScene* read_scene = rallocat( SerializedScene, allocator );
+    *read_scene = SerializedScene{ };
+    serialize( &reader, read_scene );
+    RCHECK( !reader.error && reader.offset == writer.size );
+    RCHECK( scenes_equal( scene, read_scene ) );
+    free_scene( read_scene, allocator );
+
+    // Through a file.
+    char path[ k_max_path ];
+    strcpy( path, test_temporary_path( "serializer.bin" ) );
+    RCHECK( writer.write_file( path ) );
+    sizet file_size = 0;
+    char* file_data = file_read_binary( path, allocator, &file_size );
+    RCHECK( file_data && file_size == writer.size );
+
+    *read_scene = SerializedScene{ };
+    RCHECK( reader.start_reading( allocator, file_data, file_size ) );
+    serialize( &reader, read_scene );
+    RCHECK( !reader.error && scenes_equal( scene, read_scene ) );
+    free_scene( read_scene, allocator );
+    rfree( file_data, allocator );
+    file_delete( path );
+
+    // A shorter fixed string keeps what fits and stays in sync with the fields after it.
+    Serializer names;
+    names.start_writing( allocator, 64 );
+    char long_name[ 32 ] = "a name too long for the reader";
+    u32 after = 0xdeadbeef;
+    serialize( &names, long_name, ArraySize( long_name ) );
+    serialize( &names, &after );
+
+    RCHECK( reader.start_reading( allocator, names.memory, names.size ) );
+    char short_name[ 8 ];
+    u32 read_after = 0;
+    serialize( &reader, short_name, ArraySize( short_name ) );
+    serialize( &reader, &read_after );
+    RCHECK( !reader.error && strcmp( short_name, "a name " ) == 0 && read_after == after );
+    names.shutdown();
+
+    rfree( read_scene, allocator );
+    free_scene( scene, allocator );
+    rfree( scene, allocator );
+    writer.shutdown();
+
+    RCHECK( MemoryService::instance()->system_allocator.allocated_size == allocated_before );
+}
+
+template <typename Written, typename Read>
+static bool read_meshes( Allocator* allocator, Array<Written>& written, Array<Read>& read ) {
+    Serializer writer;
+    writer.start_writing( allocator, 256 );
+    serialize( &writer, &written );
+    u32 sentinel = 0xcafe;
+    serialize( &writer, &sentinel );
+
+    Serializer reader;
+    bool success = reader.start_reading( allocator, writer.memory, writer.size );
+    serialize( &reader, &read );
+    u32 read_sentinel = 0;
+    serialize( &reader, &read_sentinel );
+    success = success && !reader.error && read_sentinel == sentinel && reader.offset == writer.size;
+
+    writer.shutdown();
+    return success;
+}
+
+RTEST( serializer_version_skew ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    // Version 1 data read by the version 3 code: the lods are empty, the shadows default on and the scale is converted.
+    Array<MeshV1> meshes_v1;
+    meshes_v1.init( allocator, 4, 4 );
+    for ( u32 m = 0; m < 4; ++m ) {
+        snprintf( meshes_v1[ m ].name, 32, "old_%u", m );
+        meshes_v1[ m ].vertex_count = m + 10;
+        meshes_v1[ m ].scale = m * 2.0f;
+    }
+
+    Array<MeshV3> meshes_v3;
+    RCHECK( read_meshes( allocator, meshes_v1, meshes_v3 ) );
+    RCHECK( meshes_v3.size == 4 );
+    for ( u32 m = 0; m < 4; ++m ) {
+        RCHECK( strcmp( meshes_v3[ m ].name, meshes_v1[ m ].name ) == 0 && meshes_v3[ m ].vertex_count == m + 10 );
+        RCHECK( meshes_v3[ m ].radius == m * 1.0f && meshes_v3[ m ].cast_shadows && meshes_v3[ m ].lod_offsets.size == 0 );
+    }
+    free_mesh_arrays( meshes_v3 );
+
+    // Version 2 data read by version 3 code, the scale is still there.
+    Array<MeshV2> meshes_v2;
+    meshes_v2.init( allocator, 3, 3 );
+    for ( u32 m = 0; m < 3; ++m ) {
+        snprintf( meshes_v2[ m ].name, 32, "v2_%u", m );
+        meshes_v2[ m ].vertex_count = m;
+        meshes_v2[ m ].scale = 4.0f;
+        meshes_v2[ m ].cast_shadows = false;
+        meshes_v2[ m ].lod_offsets.init( allocator, m, m );
+        for ( u32 l = 0; l < m; ++l ) {
+            meshes_v2[ m ].lod_offsets[ l ] = l + 7;
+        }
+    }
+
+    RCHECK( read_meshes( allocator, meshes_v2, meshes_v3 ) );
+    for ( u32 m = 0; m < 3; ++m ) {
+        RCHECK( meshes_v3[ m ].radius == 2.0f && !meshes_v3[ m ].cast_shadows );
+        RCHECK( meshes_v3[ m ].lod_offsets.size == m && ( m == 0 || meshes_v3[ m ].lod_offsets[ m - 1 ] == m + 6 ) );
+    }
+    free_mesh_arrays( meshes_v3 );
+
+    // Newer data read by older code: the fields added by version 2 are skipped, the values after the type are in sync.
+    Array<MeshV1> read_v1;
+    RCHECK( read_meshes( allocator, meshes_v2, read_v1 ) );
+    RCHECK( read_v1.size == 3 );
+    for ( u32 m = 0; m < 3; ++m ) {
+        RCHECK( strcmp( read_v1[ m ].name, meshes_v2[ m ].name ) == 0 && read_v1[ m ].vertex_count == m && read_v1[ m ].scale == 4.0f );
+    }
+    read_v1.shutdown();
+
+    free_mesh_arrays( meshes_v2 );
+    meshes_v1.shutdown();
+
+    // Data written with a newer format than the code knows is refused.
+    Serializer writer;
+    writer.start_writing( allocator, 64 );
+    writer.memory[ 4 ] = k_serializer_format_version + 1;
+    Serializer reader;
+    RCHECK( !reader.start_reading( allocator, writer.memory, writer.size ) && reader.error );
+    writer.memory[ 4 ] = k_serializer_format_version;
+    writer.memory[ 0 ] = 0;
+    RCHECK( !reader.start_reading( allocator, writer.memory, writer.size ) );
+    writer.shutdown();
+}
+
+RTEST( serializer_truncated_and_corrupted_data ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+    const sizet allocated_before = MemoryService::instance()->system_allocator.allocated_size;
+
+    SerializedScene* scene = create_scene( allocator );
+    Serializer writer;
+    writer.start_writing( allocator, 256 );
+    serialize( &writer, scene );
+
+    // Every truncation is detected, nothing is read past the end and whatever was allocated can be freed.
+    SerializedScene* read_scene = rallocat( SerializedScene, allocator );
+    u32 undetected = 0;
+    for ( sizet size = 0; size < writer.size; ++size ) {
+        // Copied so that the sanitizers see reads past the end.
+        u8* truncated = ( u8* )ralloca( size ? size : 1, allocator );
+        memcpy( truncated, writer.memory, size );
+
+        Serializer reader;
+        reader.start_reading( allocator, truncated, size );
+        *read_scene = SerializedScene{ };
+        serialize( &reader, read_scene );
+        undetected += reader.error ? 0 : 1;
+
+        free_scene( read_scene, allocator );
+        rfree( truncated, allocator );
+    }
+    RCHECK( undetected == 0 );
+
+    // Element counts larger than the data do not allocate.
+    Serializer sizes;
+    sizes.start_writing( allocator, 64 );
+    u32 huge_count = 0x7fffffff;
+    serialize( &sizes, &huge_count );
+    serialize( &sizes, &huge_count );
+
+    Serializer reader;
+    reader.start_reading( allocator, sizes.memory, sizes.size );
+    Array<u64> values;
+    serialize( &reader, &values );
+    RCHECK( reader.error && values.size == 0 );
+    values.shutdown();
+
+    reader.start_reading( allocator, sizes.memory, sizes.size );
+    StringBuffer text;
+    serialize( &reader, &text );
+    RCHECK( reader.error && text.current_size == 0 );
+    text.shutdown();
+    sizes.shutdown();
+
+    // A type size that does not match its fields.
+    Serializer types;
+    types.start_writing( allocator, 64 );
+    MeshV1 mesh = { "mesh", 3, 1.0f };
+    serialize( &types, &mesh );
+    types.memory[ 12 ] = 2; // Size of the type, right after its version.
+
+    reader.start_reading( allocator, types.memory, types.size );
+    serialize( &reader, &mesh );
+    RCHECK( reader.error );
+    types.shutdown();
+
+    rfree( read_scene, allocator );
+    free_scene( scene, allocator );
+    rfree( scene, allocator );
+    writer.shutdown();
+
+    RCHECK( MemoryService::instance()->system_allocator.allocated_size == allocated_before );
+}
+
+RTEST( serializer_reads_uninitialized_arrays ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    Array<u32> values;
+    values.init( allocator, 3 );
+    values.push( 7 );
+    values.push( 8 );
+    values.push( 9 );
+
+    Serializer writer;
+    writer.start_writing( allocator, 64 );
+    serialize( &writer, &values );
+    serialize( &writer, &values );
+
+    // Arrays read into are not initialized, only the size in the data is used.
+    Array<u32> read_values;
+    memset( ( void* )&read_values, 0xab, sizeof( read_values ) );
+    RelativeArray<u32>* read_relative = ( RelativeArray<u32>* )rallocaa( sizeof( RelativeArray<u32> ), allocator, 8 );
+    memset( ( void* )read_relative, 0xab, sizeof( RelativeArray<u32> ) );
+
+    Serializer reader;
+    reader.start_reading( allocator, writer.memory, writer.size );
+    serialize( &reader, &read_values );
+    serialize( &reader, read_relative );
+    RCHECK( !reader.error && reader.offset == writer.size );
+    RCHECK( read_values.size == 3 && read_values[ 0 ] == 7 && read_values[ 2 ] == 9 );
+    RCHECK( read_relative->size == 3 && ( *read_relative )[ 1 ] == 8 );
+
+    rfree( read_relative->get(), allocator );
+    rfree( read_relative, allocator );
+    read_values.shutdown();
+    writer.shutdown();
+    values.shutdown();
+}
+
+// Serializer and nlohmann json /////////////////////////////////////////////
+
+static void scene_to_json( const Array<MeshV3>& meshes, nlohmann::json& json ) {
+    nlohmann::json& json_meshes = json[ "meshes" ];
+    for ( u32 m = 0; m < meshes.size; ++m ) {
+        const MeshV3& mesh = meshes[ m ];
+        nlohmann::json json_mesh;
+        json_mesh[ "name" ] = mesh.name;
+        json_mesh[ "vertex_count" ] = mesh.vertex_count;
+        json_mesh[ "radius" ] = mesh.radius;
+        json_mesh[ "cast_shadows" ] = mesh.cast_shadows;
+        json_mesh[ "lod_offsets" ] = nlohmann::json::array();
+        for ( u32 l = 0; l < mesh.lod_offsets.size; ++l ) {
+            json_mesh[ "lod_offsets" ].push_back( mesh.lod_offsets[ l ] );
+        }
+        json_meshes.push_back( json_mesh );
+    }
+}
+
+static void scene_from_json( const nlohmann::json& json, Array<MeshV3>& meshes, Allocator* allocator ) {
+    const nlohmann::json& json_meshes = json[ "meshes" ];
+    const u32 count = ( u32 )json_meshes.size();
+    meshes.init( allocator, count, count );
+    for ( u32 m = 0; m < count; ++m ) {
+        const nlohmann::json& json_mesh = json_meshes[ m ];
+        MeshV3& mesh = meshes[ m ];
+        const std::string name = json_mesh.value( "name", "" );
+        snprintf( mesh.name, ArraySize( mesh.name ), "%s", name.c_str() );
+        mesh.vertex_count = json_mesh.value( "vertex_count", 0u );
+        mesh.radius = json_mesh.value( "radius", 0.0f );
+        mesh.cast_shadows = json_mesh.value( "cast_shadows", true );
+
+        const nlohmann::json& json_lods = json_mesh[ "lod_offsets" ];
+        const u32 lod_count = ( u32 )json_lods.size();
+        mesh.lod_offsets.init( allocator, lod_count, lod_count );
+        for ( u32 l = 0; l < lod_count; ++l ) {
+            mesh.lod_offsets[ l ] = json_lods[ l ].get<u32>();
+        }
+    }
+}
+
+RBENCHMARK( serializer_against_json ) {
+    Allocator* allocator = &MemoryService::instance()->system_allocator;
+
+    const u32 mesh_count = 20000;
+    Array<MeshV3> meshes;
+    meshes.init( allocator, mesh_count, mesh_count );
+    for ( u32 m = 0; m < mesh_count; ++m ) {
+        fill_mesh( meshes[ m ], allocator, m, 8 );
+    }
+
+    const u32 iterations = 5;
+
+    // Serializer.
+    i64 start = time_now();
+    Serializer writer;
+    for ( u32 i = 0; i < iterations; ++i ) {
+        writer.shutdown();
+        writer.start_writing( allocator, rkilo( 64 ) );
+        serialize( &writer, &meshes );
+    }
+    const f64 write_ms = time_from_milliseconds( start ) / iterations;
+
+    start = time_now();
+    bool equal = true;
+    for ( u32 i = 0; i < iterations; ++i ) {
+        Serializer reader;
+        reader.start_reading( allocator, writer.memory, writer.size );
+        Array<MeshV3> read;
+        serialize( &reader, &read );
+        equal = equal && !reader.error && read.size == mesh_count && read[ mesh_count - 1 ].lod_offsets[ 7 ] == meshes[ mesh_count - 1 ].lod_offsets[ 7 ];
+        free_mesh_arrays( read );
+    }
+    const f64 read_ms = time_from_milliseconds( start ) / iterations;
+    const sizet binary_size = writer.size;
+    writer.shutdown();
+
+    // Json, from and to the same structures.
+    start = time_now();
+    std::string text;
+    for ( u32 i = 0; i < iterations; ++i ) {
+        nlohmann::json json;
+        scene_to_json( meshes, json );
+        text = json.dump();
+    }
+    const f64 json_write_ms = time_from_milliseconds( start ) / iterations;
+
+    start = time_now();
+    for ( u32 i = 0; i < iterations; ++i ) {
+        nlohmann::json json = nlohmann::json::parse( text );
+        Array<MeshV3> read;
+        scene_from_json( json, read, allocator );
+        equal = equal && read.size == mesh_count && read[ mesh_count - 1 ].lod_offsets[ 7 ] == meshes[ mesh_count - 1 ].lod_offsets[ 7 ];
+        free_mesh_arrays( read );
+    }
+    const f64 json_read_ms = time_from_milliseconds( start ) / iterations;
+
+    rprint( "%u meshes, data read back %s\n", mesh_count, equal ? "equal" : "DIFFERENT" );
+    rprint( "Serializer %8zu bytes, write %7.2f ms, read %7.2f ms\n", binary_size, write_ms, read_ms );
+    rprint( "json       %8zu bytes, write %7.2f ms, read %7.2f ms\n", text.size(), json_write_ms, json_read_ms );
+
+    free_mesh_arrays( meshes );
+}
+
+} // namespace raptor
@@ -0,0 +1,97 @@
+#include "tests/test.hpp"
+
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/time.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace raptor {
+
+static TestCase*                    s_first_test        = nullptr;
+static TestCase*                    s_last_test         = nullptr;
+
+static u32                          s_test_failures     = 0;
+static cstring                      s_data_folder       = nullptr;
+static char                         s_temporary_path[ 512 ];
+
+TestRegistration::TestRegistration( TestCase* test_case ) {
+    // Appended, so that the tests of a file run in declaration order.
+    if ( s_last_test ) {
+        s_last_test->next = test_case;
+    } else {
+        s_first_test = test_case;
+    }
+    s_last_test = test_case;
+}
+
+void test_check( bool condition, cstring expression, cstring file, u32 line ) {
+    if ( condition ) {
+        return;
+    }
+
+    ++s_test_failures;
+    rprint( "%s(%u): check failed: %s\n", file, line, expression );
+}
+
+cstring test_data_folder() {
+    return s_data_folder;
+}
+
+cstring test_temporary_path( cstring name ) {
+    snprintf( s_temporary_path, sizeof( s_temporary_path ), "raptor_test_%s", name );
+    return s_temporary_path;
+}
+
+} // namespace raptor
+
+//
+// Usage: tests [--benchmark] [--data folder] [name filter]
+int main( int argc, char** argv ) {
+    using namespace raptor;
+
+    bool run_benchmarks = false;
+    cstring filter = nullptr;
+    for ( i32 arg_i = 1; arg_i < argc; ++arg_i ) {
+        if ( strcmp( argv[ arg_i ], "--benchmark" ) == 0 ) {
+            run_benchmarks = true;
+        } else if ( strcmp( argv[ arg_i ], "--data" ) == 0 && arg_i + 1 < argc ) {
+            s_data_folder = argv[ ++arg_i ];
+        } else {
+            filter = argv[ arg_i ];
+        }
+    }
+
+    time_service_init();
+
+    MemoryServiceConfiguration memory_configuration;
+    memory_configuration.maximum_dynamic_size = rmega( 512 );
+    MemoryService::instance()->init( &memory_configuration );
+
+    u32 run_count = 0;
+    u32 failed_count = 0;
+    for ( TestCase* test_case = s_first_test; test_case; test_case = test_case->next ) {
+        if ( test_case->benchmark != run_benchmarks || ( filter && !strstr( test_case->name, filter ) ) ) {
+            continue;
+        }
+
+        const u32 previous_failures = s_test_failures;
+        const i64 start = time_now();
+        test_case->function();
+        const f64 elapsed_ms = time_from_milliseconds( start );
+
+        const bool failed = s_test_failures != previous_failures;
+        rprint( "[%s] %s (%.1f ms)\n", failed ? "FAIL" : " OK ", test_case->name, elapsed_ms );
+
+        ++run_count;
+        failed_count += failed ? 1 : 0;
+    }
+
+    rprint( "%u of %u %s passed\n", run_count - failed_count, run_count, run_benchmarks ? "benchmarks" : "tests" );
+
+    MemoryService::instance()->shutdown();
+    time_service_shutdown();
+
+    return failed_count ? 1 : 0;
+}
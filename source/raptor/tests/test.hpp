@@ -0,0 +1,53 @@
+#pragma once
+
+#include "foundation/platform.hpp"
+
+namespace raptor {
+
+typedef void                        ( *TestFunction )();
+
+//
+// Tests and benchmarks register themselves during static initialization, test.cpp runs them.
+// Benchmarks run only with --benchmark and are not part of ctest.
+struct TestCase {
+
+    cstring                         name;
+    TestFunction                    function;
+    bool                            benchmark;
+
+    TestCase*                       next;
+
+}; // struct TestCase
+
+//
+//
+struct TestRegistration {
+
+    TestRegistration( TestCase* test_case );
+
+}; // struct TestRegistration
+
+// Records a failure of the running test, execution continues.
+void                                test_check( bool condition, cstring expression, cstring file, u32 line );
+
+// Folder given with --data, nullptr when missing. Tests needing external assets skip themselves without it.
+cstring                             test_data_folder();
+
+// Temporary file path in the working directory, unique per name.
+cstring                             test_temporary_path( cstring name );
+
+} // namespace raptor
+
+#define RTEST( name )                                                                               \
+    static void name();                                                                             \
+    static raptor::TestCase name##_test_case{ #name, name, false, nullptr };                       \
+    static raptor::TestRegistration name##_test_registration( &name##_test_case );                 \
+    static void name()
+
+#define RBENCHMARK( name )                                                                          \
+    static void name();                                                                             \
+    static raptor::TestCase name##_test_case{ #name, name, true, nullptr };                        \
+    static raptor::TestRegistration name##_test_registration( &name##_test_case );                 \
+    static void name()
+
+#define RCHECK( condition )         raptor::test_check( ( condition ), #condition, __FILE__, __LINE__ )
@@ -0,0 +1,293 @@
+#include "foundation/log.hpp"
+#include "foundation/memory.hpp"
+#include "foundation/time.hpp"
+
+#include "tests/test.hpp"
+
+#include "external/enkiTS/TaskScheduler.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include <string.h>
+
+namespace raptor {
+
+static const u32                    k_stress_live_blocks    = 64;
+static const u32                    k_stress_shared_slots   = 256;
+
+static u32 random_next( u32& state ) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Sizes over the cached classes, past them and with large alignments, so that every path of the allocator is used.
+static u8* stress_allocate( Allocator* allocator, u32& random ) {
+    const u32 choice = random_next( random ) % 16;
+    const u32 size = choice < 12 ? 8 + random_next( random ) % 2048 : 2049 + random_next( random ) % 8192;
+    const u32 alignment = choice == 15 ? 64 : 8;
+
+    u8* memory = ( u8* )allocator->allocate( size, alignment );
+    if ( memory ) {
+        const u32 seed = random_next( random );
+        memcpy( memory, &size, 4 );
+        memcpy( memory + 4, &seed, 4 );
+        memset( memory + 8, ( u8 )seed, size - 8 );
+    }
+    return memory;
+}
+
+static bool stress_check( const u8* memory ) {
+    u32 size, seed;
+    memcpy( &size, memory, 4 );
+    memcpy( &seed, memory + 4, 4 );
+    for ( u32 i = 8; i < size; ++i ) {
+        if ( memory[ i ] != ( u8 )seed ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// Allocates and frees blocks, keeping some alive and handing others to whichever thread picks them up next.
+struct AllocatorStressTask : public enki::ITaskSet {
+
+    void                            ExecuteRange( enki::TaskSetPartition range, uint32_t thread_index ) override;
+
+    void                            run( u32 seed, u32 iterations );
+
+    Allocator*                      allocator       = nullptr;
+    std::atomic<u8*>*               shared_slots    = nullptr;
+    std::atomic_uint32_t            corrupted{ 0 };
+    std::atomic_uint32_t            failed{ 0 };
+    u32                             iterations      = 0;
+
+}; // struct AllocatorStressTask
+
+void AllocatorStressTask::ExecuteRange( enki::TaskSetPartition range, uint32_t thread_index ) {
+    for ( u32 p = range.start; p < range.end; ++p ) {
+        run( p + 1, iterations );
+    }
+}
+
+void AllocatorStressTask::run( u32 seed, u32 iterations_ ) {
+    u32 random = seed * 0x9e3779b9u;
+    u8* live[ k_stress_live_blocks ] = { };
+
+    for ( u32 i = 0; i < iterations_; ++i ) {
+        const u32 slot = random_next( random ) % k_stress_live_blocks;
+        if ( live[ slot ] ) {
+            corrupted += stress_check( live[ slot ] ) ? 0 : 1;
+
+            // Freed here or by another thread.
+            u8* other = shared_slots[ random_next( random ) % k_stress_shared_slots ].exchange( live[ slot ] );
+            if ( other ) {
+                corrupted += stress_check( other ) ? 0 : 1;
+                allocator->deallocate( other );
+            }
+        }
+
+        live[ slot ] = stress_allocate( allocator, random );
+        failed += live[ slot ] ? 0 : 1;
+    }
+
+    for ( u32 b = 0; b < k_stress_live_blocks; ++b ) {
+        if ( live[ b ] ) {
+            corrupted += stress_check( live[ b ] ) ? 0 : 1;
+            allocator->deallocate( live[ b ] );
+        }
+    }
+}
+
+//
+// Frees the blocks cached by the thread it is pinned to.
+struct FlushThreadCacheTask : public enki::IPinnedTask {
+
+    void                            Execute() override { allocator->flush_thread_cache(); }
+
+    ThreadArenaAllocator*           allocator       = nullptr;
+
+}; // struct FlushThreadCacheTask
+
+static void flush_all_thread_caches( enki::TaskScheduler& task_scheduler, ThreadArenaAllocator& allocator ) {
+    FlushThreadCacheTask tasks[ k_thread_arena_max_threads ];
+    for ( u32 t = 1; t < task_scheduler.GetNumTaskThreads(); ++t ) {
+        tasks[ t ].threadNum = t;
+        tasks[ t ].allocator = &allocator;
+        task_scheduler.AddPinnedTask( &tasks[ t ] );
+    }
+    allocator.flush_thread_cache();
+
+    for ( u32 t = 1; t < task_scheduler.GetNumTaskThreads(); ++t ) {
+        task_scheduler.WaitforTask( &tasks[ t ] );
+    }
+}
+
+static void free_shared_slots( std::atomic<u8*>* shared_slots, Allocator* allocator ) {
+    for ( u32 s = 0; s < k_stress_shared_slots; ++s ) {
+        allocator->deallocate( shared_slots[ s ].exchange( nullptr ) );
+    }
+}
+
+RTEST( thread_allocator_stress ) {
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize( 4 );
+
+    ThreadArenaAllocator allocator;
+    allocator.init( task_scheduler.GetNumTaskThreads(), rkilo( 64 ), rmega( 64 ) );
+    allocator.set_task_scheduler( &task_scheduler );
+
+    std::atomic<u8*> shared_slots[ k_stress_shared_slots ];
+    for ( u32 s = 0; s < k_stress_shared_slots; ++s ) {
+        shared_slots[ s ] = nullptr;
+    }
+
+    // A thread enkiTS does not know about runs at the same time, on the locked heap.
+    AllocatorStressTask stress;
+    stress.allocator = &allocator;
+    stress.shared_slots = shared_slots;
+    stress.iterations = 5000;
+    stress.m_SetSize = 64;
+    stress.m_MinRange = 1;
+
+    task_scheduler.AddTaskSetToPipe( &stress );
+    std::thread external_thread( [ & ]() { stress.run( 1000, 20000 ); } );
+    task_scheduler.WaitforTask( &stress );
+    external_thread.join();
+
+    RCHECK( stress.corrupted == 0 && stress.failed == 0 );
+
+    u32 hits = 0;
+    for ( u32 t = 0; t < allocator.num_threads; ++t ) {
+        hits += allocator.caches[ t ].hits;
+    }
+    RCHECK( hits > 0 );
+
+    // Alone, the external thread does not touch the cache of the main thread, which enkiTS also calls thread 0.
+    const u32 main_hits = allocator.caches[ 0 ].hits, main_misses = allocator.caches[ 0 ].misses;
+    const u32 locked_operations = allocator.locked_operations;
+    std::thread( [ & ]() {
+        u32 random = 77;
+        for ( u32 i = 0; i < 100; ++i ) {
+            u8* memory = stress_allocate( &allocator, random );
+            allocator.deallocate( memory );
+        }
+    } ).join();
+    RCHECK( allocator.caches[ 0 ].hits == main_hits && allocator.caches[ 0 ].misses == main_misses );
+    RCHECK( allocator.locked_operations == locked_operations + 200 );
+
+    // Every block is back in the heap once the shared ones are freed and each thread flushed its cache.
+    free_shared_slots( shared_slots, &allocator );
+    flush_all_thread_caches( task_scheduler, allocator );
+    RCHECK( allocator.heap.allocated_size == 0 );
+
+    // Without a scheduler nothing is cached.
+    allocator.set_task_scheduler( nullptr );
+    const u32 locked_before = allocator.locked_operations;
+    u32 random = 5;
+    u8* memory = stress_allocate( &allocator, random );
+    allocator.deallocate( memory );
+    RCHECK( allocator.locked_operations == locked_before + 2 && allocator.heap.allocated_size == 0 );
+
+    allocator.shutdown();
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+//
+// The heap is not thread safe, this is what sharing it between tasks costs.
+struct LockedHeapAllocator : public Allocator {
+
+    void*                           allocate( sizet size, sizet alignment ) override {
+        std::lock_guard<std::mutex> guard( mutex );
+        return heap.allocate( size, alignment );
+    }
+    void*                           allocate( sizet size, sizet alignment, cstring file, i32 line ) override {
+        return allocate( size, alignment );
+    }
+    void                            deallocate( void* pointer ) override {
+        std::lock_guard<std::mutex> guard( mutex );
+        heap.deallocate( pointer );
+    }
+
+    HeapAllocator                   heap;
+    std::mutex                      mutex;
+
+}; // struct LockedHeapAllocator
+
+//
+// Small allocations freed soon after, in the order of the short lived task memory.
+struct AllocatorChurnTask : public enki::ITaskSet {
+
+    void                            ExecuteRange( enki::TaskSetPartition range, uint32_t thread_index ) override {
+        for ( u32 p = range.start; p < range.end; ++p ) {
+            u32 random = ( p + 1 ) * 0x9e3779b9u;
+            void* live[ 32 ] = { };
+            for ( u32 i = 0; i < iterations; ++i ) {
+                const u32 slot = random_next( random ) % 32;
+                allocator->deallocate( live[ slot ] );
+                live[ slot ] = allocator->allocate( 16 + random_next( random ) % 496, 8 );
+            }
+            for ( u32 b = 0; b < 32; ++b ) {
+                allocator->deallocate( live[ b ] );
+            }
+        }
+    }
+
+    Allocator*                      allocator       = nullptr;
+    u32                             iterations      = 0;
+
+}; // struct AllocatorChurnTask
+
+RBENCHMARK( thread_allocator_throughput ) {
+    enki::TaskScheduler task_scheduler;
+    task_scheduler.Initialize();
+
+    MallocAllocator malloc_allocator;
+    LockedHeapAllocator locked_heap;
+    locked_heap.heap.init( rmega( 64 ) );
+    ThreadArenaAllocator thread_allocator;
+    thread_allocator.init( task_scheduler.GetNumTaskThreads(), rkilo( 64 ), rmega( 64 ) );
+    thread_allocator.set_task_scheduler( &task_scheduler );
+
+    cstring names[ 3 ] = { "malloc", "HeapAllocator+lock", "ThreadArenaAllocator" };
+    Allocator* allocators[ 3 ] = { &malloc_allocator, &locked_heap, &thread_allocator };
+
+    const u32 iterations = 200000;
+    const u32 partitions = 64;
+    rprint( "%u threads, %u partitions of %u allocations and frees\n", task_scheduler.GetNumTaskThreads(), partitions, iterations );
+
+    for ( u32 a = 0; a < ArraySize( allocators ); ++a ) {
+        AllocatorChurnTask churn;
+        churn.allocator = allocators[ a ];
+        churn.iterations = iterations;
+
+        // Main thread only, then every task thread.
+        i64 start = time_now();
+        churn.ExecuteRange( { 0, 1 }, 0 );
+        const f64 single_ms = time_from_milliseconds( start );
+
+        churn.m_SetSize = partitions;
+        churn.m_MinRange = 1;
+        start = time_now();
+        task_scheduler.AddTaskSetToPipe( &churn );
+        task_scheduler.WaitforTask( &churn );
+        const f64 tasks_ms = time_from_milliseconds( start );
+
+        rprint( "%-22s single thread %6.1f ns/op, tasks %6.1f ns/op\n", names[ a ], single_ms * 1e6 / ( iterations * 2.0 ),
+                tasks_ms * 1e6 / ( iterations * 2.0 * partitions ) );
+    }
+
+    if ( thread_allocator.locked_operations ) {
+        rprint( "ThreadArenaAllocator took the lock %u times\n", thread_allocator.locked_operations );
+    }
+
+    thread_allocator.shutdown();
+    locked_heap.heap.shutdown();
+    task_scheduler.WaitforAllAndShutdown();
+}
+
+} // namespace raptor